@@ -25,8 +25,10 @@ EXPORT_SUBFOLDER = "protocols"
 EXPORT_FILENAME = "simplex_004"
 
 # Number of frames (i.e. protocol lines) to generate.
-# Do need exceed 5000 as this hits the memory limit of the microcontroller.
-N_FRAMES = 5000  # Leave it at 5000
+# The microcontroller stores the protocol compressed and accepts up to 30000
+# lines. Whether a protocol fits depends on how much changes from line to line;
+# the upload will report an error when it does not. 5000 always fits.
+N_FRAMES = 5000
 
 # Time interval between each frame [s].
 DT_FRAME = 0.05  # Leave it at 0.05
@@ -81,6 +83,14 @@ TARGET_TRANSPARENCY = 0.4
 # Tests show that the minimum valve duration is best kept at >= 0.25 seconds.
 MIN_VALVE_DURATION = 5
 
+# Generate the noise only at the valve locations, plus on a coarse grid for
+# the thresholding scheme, instead of as full images. Takes seconds instead of
+# minutes. The valves see the exact same
+# noise values. Only the transparency solved for by the Newton solver gets
+# estimated from 1 in every `SOLVER_PX_STRIDE`^2 pixels. The noise animation
+# of `make_proto_opensimplex.py` then shows this coarse grid.
+VALVE_SAMPLED = True
+
 # ------------------------------------------------------------------------------
 #  End of user-configurable parameters
 #  DO NOT ADJUST THE CODE FOLLOWING BELOW
@@ -90,8 +100,8 @@ MIN_VALVE_DURATION = 5
 __author__ = "Dennis van Gils"
 __authoremail__ = "vangils.dennis@gmail.com"
 __url__ = "https://github.com/Dennis-van-Gils/project-TWT-jetting-grid"
-__date__ = "19-09-2024"
-__version__ = "2.0"  # Export file header info. Bump when major changes occur
+__date__ = "15-10-2026"
+__version__ = "2.1"  # Export file header info. Bump when major changes occur
 
 import os as _os
 from datetime import datetime
@@ -106,6 +116,20 @@ import constants as C
 PCS_PIXEL_DIST = 32  # A.k.a. PCS_UNIT_PX
 N_PIXELS = PCS_PIXEL_DIST * (C.NUMEL_PCS_AXIS + 1)
 
+# Pixel distance of the coarse grid of `VALVE_SAMPLED`. 8 leaves 64 x 64 pixels
+# per frame, plenty to estimate the transparency. Leave it.
+SOLVER_PX_STRIDE = 8
+
+# Memory ceiling [bytes] of the noise held at once while generating the
+# protocol. The noise gets generated and binarized in chunks of frames, so
+# only the valve states and transparencies of all frames stay in memory and
+# protocols of tens of thousands of frames remain feasible. Leave it.
+CHUNK_MAX_BYTES = 256 * 1024**2
+
+# Subfolder caching the generated valve states and noise frames, one folder per
+# set of generation parameters. Safe to delete at any time.
+CACHE_SUBFOLDER = "cache"
+
 # Derived
 X_STEP_A = 1 / SPATIAL_FEATURE_SIZE_A
 T_STEP_A = 1 / TEMPORAL_FEATURE_SIZE_A
@@ -147,22 +171,34 @@ del _os, _np
 # ------------------------------------------------------------------------------
 
 
-def create_header_string() -> str:
+def create_header_string(overrides: dict = None) -> str:
+    """Header info of the protocol file. The parameters in `overrides`, e.g.
+    those of a parameter set of `make_proto_sweep.py`, take precedence over the
+    module globals."""
+    params = dict(
+        BW_THRESHOLD=BW_THRESHOLD,
+        TARGET_TRANSPARENCY=TARGET_TRANSPARENCY,
+        MIN_VALVE_DURATION=MIN_VALVE_DURATION,
+    )
+    params.update(overrides or {})
+
     w = 25
     header_str = (
         f"{'TYPE':<{w}}OpenSimplex noise v{__version__}\n"
         f"{'DATE':<{w}}{datetime.now().strftime('%Y-%m-%d %H:%M:%S')}\n\n"
         f"{'N_FRAMES':<{w}}{N_FRAMES}\n"
         f"{'DT_FRAME':<{w}}{DT_FRAME} s\n\n"
-        f"{'BW_THRESHOLD':<{w}}{BW_THRESHOLD}\n"
-        f"{'TARGET_TRANSPARENCY':<{w}}{TARGET_TRANSPARENCY}\n\n"
+        f"{'BW_THRESHOLD':<{w}}{params['BW_THRESHOLD']}\n"
+        f"{'TARGET_TRANSPARENCY':<{w}}{params['TARGET_TRANSPARENCY']}\n\n"
         f"{'SPATIAL_FEATURE_SIZE_A':<{w}}{SPATIAL_FEATURE_SIZE_A}\n"
         f"{'SPATIAL_FEATURE_SIZE_B':<{w}}{SPATIAL_FEATURE_SIZE_B}\n\n"
         f"{'TEMPORAL_FEATURE_SIZE_A':<{w}}{TEMPORAL_FEATURE_SIZE_A}\n"
         f"{'TEMPORAL_FEATURE_SIZE_B':<{w}}{TEMPORAL_FEATURE_SIZE_B}\n\n"
         f"{'SEED_A':<{w}}{SEED_A}\n"
         f"{'SEED_B':<{w}}{SEED_B}\n\n"
-        f"{'MIN_VALVE_DURATION':<{w}}{MIN_VALVE_DURATION} frames\n\n"
+        f"{'MIN_VALVE_DURATION':<{w}}{params['MIN_VALVE_DURATION']} frames\n\n"
+        f"{'VALVE_SAMPLED':<{w}}{VALVE_SAMPLED}\n"
+        f"{'SOLVER_PX_STRIDE':<{w}}{SOLVER_PX_STRIDE}\n\n"
         f"{'PCS_PIXEL_DIST':<{w}}{PCS_PIXEL_DIST}\n"
         f"{'N_PIXELS':<{w}}{N_PIXELS}\n"
         f"{'X_STEP_A':<{w}}{X_STEP_A}\n"
@@ -18,44 +18,40 @@ Usage:
 __author__ = "Dennis van Gils"
 __authoremail__ = "vangils.dennis@gmail.com"
 __url__ = "https://github.com/Dennis-van-Gils/project-TWT-jetting-grid"
-__date__ = "13-09-2024"
-__version__ = "2.0"
+__date__ = "15-10-2026"
+__version__ = "2.1"
 # pylint: disable=invalid-name, missing-function-docstring
 
 import sys
 from time import perf_counter
 
 import numpy as np
-from tqdm import trange
 
 from matplotlib import pyplot as plt
 from matplotlib import animation
 
 from utils_matplotlib import move_figure
-from utils_pillow import fig2img_RGB
 from utils_valves_stack import (
     adjust_minimum_valve_durations,
     valve_on_off_PDFs,
 )
 from utils_protocols import (
-    generate_OpenSimplex_grayscale_img_stack,
-    binarize_img_stack,
-    compute_valves_stack,
+    generate_valves_stack_cached,
     export_protocol_to_disk,
+    export_alpha_to_disk,
+    export_pdfs_to_disk,
 )
+from utils_valve_render import export_animation
 
 import constants as C
 import config_proto_opensimplex as CFG
 
 # Global flags
 EXPORT_GIF = 0  # Export animation as a .gif to disk?
+EXPORT_MP4 = 0  # Export animation as a .mp4 to disk? Requires `ffmpeg`
 SHOW_NOISE_IN_PLOT = 1  # [0] Only show valves,   [1] Show noise as well
 SHOW_NOISE_AS_GRAY = 0  # Show noise as [0] BW,   [1] Grayscale
 
-# Flags useful for developing. Leave both set to False for normal operation.
-LOAD_FROM_CACHE = False
-SAVE_TO_CACHE = False
-
 # ------------------------------------------------------------------------------
 #  Check validity of user configurable parameters
 # ------------------------------------------------------------------------------
@@ -73,42 +69,26 @@ if (CFG.BW_THRESHOLD is not None and CFG.TARGET_TRANSPARENCY is not None) or (
 #  Generate OpenSimplex protocol
 # ------------------------------------------------------------------------------
 
-if not LOAD_FROM_CACHE:
-    # Generate OpenSimplex grayscale noise
-    img_stack_gray = generate_OpenSimplex_grayscale_img_stack()
-
-    if SAVE_TO_CACHE:
-        print("Saving cache to disk...")
-        tick = perf_counter()
-        np.savez("cache.npz", img_stack_gray=img_stack_gray)
-        print(f"done in {(perf_counter() - tick):.2f} s\n")
-
+# Generate and binarize OpenSimplex noise in chunks of frames and map it onto
+# the valve locations, or read it from the cache when generated before with the
+# same parameters. The noise frames to plot get memory-mapped from disk.
+if not SHOW_NOISE_IN_PLOT:
+    noise_stage = None
+elif SHOW_NOISE_AS_GRAY:
+    noise_stage = "gray"
 else:
-    # Developer: Retrieving data straight from the cache file on disk
-    print("Reading cache from disk...")
-    tick = perf_counter()
-    with np.load("cache.npz", allow_pickle=False) as cache:
-        img_stack_gray = cache["img_stack_gray"]
-    print(f"done in {(perf_counter() - tick):.2f} s\n")
+    noise_stage = "BW"
 
-# Binarize OpenSimplex noise
 (
-    img_stack_BW,
+    valves_stack,
+    alpha_valves,
     alpha_BW,
     alpha_BW_did_converge,
-) = binarize_img_stack(img_stack_gray)
-
-# Determine which noise image stack to plot later
-if SHOW_NOISE_AS_GRAY:
-    img_stack_plot = img_stack_gray
-else:
-    img_stack_plot = img_stack_BW
-    del img_stack_gray  # Not needed anymore -> Free up large chunk of mem
-
-# Map OpenSimplex noise onto valve locations
-valves_stack, alpha_valves = compute_valves_stack(img_stack_BW)
+    img_stack_plot,
+) = generate_valves_stack_cached(noise_stage)
 
-# Adjust minimum valve durations
+# Adjust minimum valve durations. Needs the whole timeseries of each valve as
+# the protocol loops, but the valve states of all frames take little memory.
 (
     valves_stack_adj,
     alpha_valves_adj,
@@ -143,61 +123,50 @@ export_protocol_to_disk(valves_stack_adj, CFG.EXPORT_PATH_NO_EXT + ".proto")
 np.save(CFG.EXPORT_PATH_NO_EXT + "_valves_stack.npy", valves_stack_adj)
 
 # The transparencies per frame
-with open(CFG.EXPORT_PATH_NO_EXT + "_alpha.txt", "w", encoding="utf-8") as f:
-    if CFG.TARGET_TRANSPARENCY is not None:
-        f.write("Newton solver was used to solve for a wanted transparency.\n")
-        failed_convergences = CFG.N_FRAMES - sum(alpha_BW_did_converge)
-        if failed_convergences > 0:
-            f.write(f"{failed_convergences:d} frames failed to converge!\n")
-        else:
-            f.write("All frames did converge.\n")
-    else:
-        f.write("A simple BW threshold was used.\n")
-        f.write("Column `Newton_solver_converged?` can be ignored.\n")
-
-    f.write(
-        "\n"
-        "# frame\t"
-        "transparency_binary_noise\t"
-        "transparency_jet_grid\t"
-        "Newton_solver_converged?\n"
-    )
-    for i in range(CFG.N_FRAMES):
-        f.write(
-            f"{i:d}\t{alpha_BW[i]:.2f}\t"
-            f"{alpha_valves_adj[i]:.2f}\t"
-            f"{alpha_BW_did_converge[i]!s}\n"
-        )
+export_alpha_to_disk(
+    CFG.EXPORT_PATH_NO_EXT + "_alpha.txt",
+    alpha_BW,
+    alpha_valves_adj,
+    alpha_BW_did_converge,
+    CFG.TARGET_TRANSPARENCY is not None,
+)
 
 # PDFs
-idx_last_nonzero_bin = bins.size - np.min(
-    (
-        np.argmax(np.flipud(pdf_on) > 0),
-        np.argmax(np.flipud(pdf_on_adj) > 0),
-        np.argmax(np.flipud(pdf_off) > 0),
-        np.argmax(np.flipud(pdf_off_adj) > 0),
-    )
-)
-pdfs = np.zeros((idx_last_nonzero_bin, 5))
-pdfs[:, 0] = bins[:idx_last_nonzero_bin]
-pdfs[:, 1] = pdf_on[:idx_last_nonzero_bin]
-pdfs[:, 2] = pdf_on_adj[:idx_last_nonzero_bin]
-pdfs[:, 3] = pdf_off[:idx_last_nonzero_bin]
-pdfs[:, 4] = pdf_off_adj[:idx_last_nonzero_bin]
-
-np.savetxt(
+export_pdfs_to_disk(
     CFG.EXPORT_PATH_NO_EXT + "_pdfs.txt",
-    pdfs,
-    fmt="%.3f\t%.3e\t%.3e\t%.3e\t%.3e",
-    header=(
-        "duration[s]\t"
-        "open_theoretical_valve\t"
-        "open_jet_grid_valve\t"
-        "closed_theoretical_valve\t"
-        "closed_jet_grid_valve"
-    ),
+    bins,
+    pdf_on,
+    pdf_on_adj,
+    pdf_off,
+    pdf_off_adj,
 )
 
+# ------------------------------------------------------------------------------
+#  Export animation
+# ------------------------------------------------------------------------------
+# Rendered directly into frame buffers by a pool of processes, see
+# `utils_valve_render.py`. Done before any figure gets created, as the worker
+# processes get forked off.
+
+for export_ext, export_flag in ((".gif", EXPORT_GIF), (".mp4", EXPORT_MP4)):
+    if not export_flag:
+        continue
+
+    print(f"Exporting {export_ext} animation...")
+    tick = perf_counter()
+    export_animation(
+        CFG.EXPORT_PATH_NO_EXT + export_ext,
+        valves_stack_adj,
+        CFG.DT_FRAME,
+        noise_stack=img_stack_plot,
+        noise_range=(-1, 1) if SHOW_NOISE_AS_GRAY else (0, 1),
+        captions=[
+            f"frame {j:04d} | {alpha_valves_adj[j]:.2f}"
+            for j in range(CFG.N_FRAMES)
+        ],
+    )
+    print(f"done in {(perf_counter() - tick):.2f} s\n")
+
 # ------------------------------------------------------------------------------
 #  Plot
 # ------------------------------------------------------------------------------
@@ -217,8 +186,9 @@ ax_text = ax.text(0, 1.02, "", transform=ax.transAxes)
 # on a white background, than it is reversed. This is opposite to a masking
 # layer in Photoshop, where a white region indicates True. Here, black indicates
 # True.
+# Inverted per frame, as to not load all frames from disk at once
 if SHOW_NOISE_AS_GRAY:
-    img_stack_plot = -img_stack_plot
+    invert_frame = np.negative
 
     if 0:
         # Maximize contrast symmetrically around 0.
@@ -230,13 +200,13 @@ if SHOW_NOISE_AS_GRAY:
         vmin = -1
         vmax = 1
 else:
-    img_stack_plot = ~img_stack_plot
+    invert_frame = np.logical_not
     vmin = 0
     vmax = 1
 
 if SHOW_NOISE_IN_PLOT:
     hax_noise = ax.imshow(
-        img_stack_plot[0],
+        invert_frame(img_stack_plot[0]),
         cmap="gray",
         vmin=vmin,
         vmax=vmax,
@@ -284,7 +254,7 @@ ax.grid(which="major")
 def animate_fig_1(j):
     ax_text.set_text(f"frame {j:04d} | {alpha_valves_adj[j]:.2f}")
     if SHOW_NOISE_IN_PLOT:
-        hax_noise.set_data(img_stack_plot[j])
+        hax_noise.set_data(invert_frame(img_stack_plot[j]))
     hax_valves.set_data(valves_plot_pcs_x[j, :], valves_plot_pcs_y[j, :])
 
 
@@ -347,30 +317,6 @@ move_figure(fig_3, 1000, 0)
 fig_2.savefig(CFG.EXPORT_PATH_NO_EXT + "_alpha.png")
 fig_3.savefig(CFG.EXPORT_PATH_NO_EXT + "_pdfs.png")
 
-# Export animation
-# ----------------
-
-if EXPORT_GIF:
-    print("Generating gif frames...")
-    tick = perf_counter()
-    pil_imgs = []
-    for frame in trange(CFG.N_FRAMES):
-        animate_fig_1(frame)
-        pil_img = fig2img_RGB(fig_1)
-        pil_imgs.append(pil_img)
-    print(f"done in {(perf_counter() - tick):.2f} s\n")
-
-    print("Saving gif...")
-    tick = perf_counter()
-    pil_imgs[0].save(
-        CFG.EXPORT_PATH_NO_EXT + ".gif",
-        save_all=True,
-        append_images=pil_imgs[1:],
-        duration=CFG.DT_FRAME * 1000,  # [ms]
-        loop=0,
-    )
-    print(f"done in {(perf_counter() - tick):.2f} s\n")
-
 plt.show(block=False)
 plt.pause(0.001)
 input("Press [Enter] to close figures.")
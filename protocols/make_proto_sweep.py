@@ -0,0 +1,213 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""make_proto_sweep.py
+
+Sweeps the thresholding scheme and the minimum valve duration of an OpenSimplex
+protocol. The noise is shared: it gets generated once, as configured in
+`config_proto_opensimplex.py`, and binarized per distinct thresholding scheme
+in the same pass. The minimum valve duration adjustment and the exports to disk
+of each parameter set then fan out over the CPU cores.
+
+Per parameter set it writes `<EXPORT_FILENAME>_sweep<NN>` followed by `.proto`,
+`_alpha.txt` and `_pdfs.txt`, see `make_proto_opensimplex.py`, and one table
+`<EXPORT_FILENAME>_sweep.txt` summarizing all parameter sets.
+
+Usage:
+    Edit `config_proto_opensimplex.py` to your needs.
+    Edit `SWEEP` in this file to your needs.
+    In Anaconda prompt:
+    > conda activate twt
+    > python make_proto_sweep.py
+"""
+__author__ = "Dennis van Gils"
+__authoremail__ = "vangils.dennis@gmail.com"
+__url__ = "https://github.com/Dennis-van-Gils/project-TWT-jetting-grid"
+__date__ = "15-10-2026"
+__version__ = "1.0"
+# pylint: disable=invalid-name, missing-function-docstring
+
+import os
+from concurrent.futures import ProcessPoolExecutor
+from time import perf_counter
+
+import numpy as np
+
+from utils_valves_stack import (
+    adjust_minimum_valve_runs,
+    decode_valve_runs,
+    encode_valve_runs,
+    valve_on_off_PDFs,
+)
+from utils_protocols import (
+    generate_valves_stacks_swept,
+    export_protocol_to_disk,
+    export_alpha_to_disk,
+    export_pdfs_to_disk,
+)
+
+import constants as C
+import config_proto_opensimplex as CFG
+
+# Parameter sets to sweep. Each overrides a subset of `BW_THRESHOLD`,
+# `TARGET_TRANSPARENCY` and `MIN_VALVE_DURATION` of
+# `config_proto_opensimplex.py`. Specifying either one of `BW_THRESHOLD` or
+# `TARGET_TRANSPARENCY` disables the other.
+SWEEP = [
+    dict(TARGET_TRANSPARENCY=alpha, MIN_VALVE_DURATION=min_dur)
+    for alpha in (0.3, 0.4, 0.5)
+    for min_dur in (1, 5, 10)
+]
+
+# Number of worker processes, None for all CPU cores
+N_WORKERS = None
+
+# ------------------------------------------------------------------------------
+#  Parameter sets
+# ------------------------------------------------------------------------------
+
+
+def resolve_params(overrides: dict) -> dict:
+    """Complete a parameter set of `SWEEP` with the configuration."""
+    params = dict(
+        BW_THRESHOLD=CFG.BW_THRESHOLD,
+        TARGET_TRANSPARENCY=CFG.TARGET_TRANSPARENCY,
+        MIN_VALVE_DURATION=CFG.MIN_VALVE_DURATION,
+    )
+    if "BW_THRESHOLD" in overrides:
+        params["TARGET_TRANSPARENCY"] = None
+    if "TARGET_TRANSPARENCY" in overrides:
+        params["BW_THRESHOLD"] = None
+    params.update(overrides)
+
+    if (params["BW_THRESHOLD"] is None) == (
+        params["TARGET_TRANSPARENCY"] is None
+    ):
+        raise ValueError(
+            f"Invalid parameter set {overrides}. Either specify "
+            "`BW_THRESHOLD` or specify `TARGET_TRANSPARENCY`."
+        )
+    return params
+
+
+def build_stats_str(x):
+    return f"{np.mean(x):.2f} ± {np.std(x):.3f}"
+
+
+# ------------------------------------------------------------------------------
+#  finish_parameter_set
+# ------------------------------------------------------------------------------
+
+
+def finish_parameter_set(
+    export_path_no_ext: str,
+    params: dict,
+    valves_stack: np.ndarray,
+    alpha_BW: np.ndarray,
+    alpha_BW_did_converge: np.ndarray,
+) -> str:
+    """Adjust the minimum valve durations of a parameter set and export it to
+    disk. Runs inside of a worker process.
+
+    Returns:
+        The stats of the adjusted valve transparency.
+    """
+    runs = adjust_minimum_valve_runs(
+        encode_valve_runs(valves_stack),
+        params["MIN_VALVE_DURATION"],
+        C.N_VALVES,
+    )
+    valves_stack_adj = decode_valve_runs(runs, C.N_VALVES)
+    alpha_valves_adj = valves_stack_adj.sum(1) / C.N_VALVES
+
+    export_protocol_to_disk(
+        valves_stack_adj,
+        export_path_no_ext + ".proto",
+        header=CFG.create_header_string(params),
+        verbose=False,
+    )
+    export_alpha_to_disk(
+        export_path_no_ext + "_alpha.txt",
+        alpha_BW,
+        alpha_valves_adj,
+        alpha_BW_did_converge,
+        params["TARGET_TRANSPARENCY"] is not None,
+    )
+
+    bins, pdf_off, pdf_on = valve_on_off_PDFs(valves_stack, CFG.DT_FRAME)
+    _, pdf_off_adj, pdf_on_adj = valve_on_off_PDFs(
+        valves_stack_adj, CFG.DT_FRAME
+    )
+    export_pdfs_to_disk(
+        export_path_no_ext + "_pdfs.txt",
+        bins,
+        pdf_on,
+        pdf_on_adj,
+        pdf_off,
+        pdf_off_adj,
+    )
+
+    return build_stats_str(alpha_valves_adj)
+
+
+# ------------------------------------------------------------------------------
+#  Main
+# ------------------------------------------------------------------------------
+
+if __name__ == "__main__":
+    param_sets = [resolve_params(overrides) for overrides in SWEEP]
+
+    # Parameter sets differing only in `MIN_VALVE_DURATION` share the
+    # binarization
+    keys = [
+        (params["BW_THRESHOLD"], params["TARGET_TRANSPARENCY"])
+        for params in param_sets
+    ]
+    binarizations = list(dict.fromkeys(keys))
+    generated = generate_valves_stacks_swept(binarizations)
+    results = [generated[binarizations.index(key)] for key in keys]
+
+    print(f"Exporting {len(param_sets)} parameter sets to disk...")
+    tick = perf_counter()
+
+    with ProcessPoolExecutor(N_WORKERS) as pool:
+        futures = []
+        for idx, params in enumerate(param_sets):
+            valves_stack, _, alpha_BW, alpha_BW_did_converge = results[idx]
+            futures.append(
+                pool.submit(
+                    finish_parameter_set,
+                    f"{CFG.EXPORT_PATH_NO_EXT}_sweep{idx:02d}",
+                    params,
+                    valves_stack,
+                    alpha_BW,
+                    alpha_BW_did_converge,
+                )
+            )
+        stats = [future.result() for future in futures]
+
+    print(f"done in {perf_counter() - tick:.2f} s\n")
+
+    # Summary
+    summary_path = CFG.EXPORT_PATH_NO_EXT + "_sweep.txt"
+    with open(summary_path, "w", encoding="utf-8") as f:
+        f.write(
+            "# file\t"
+            "BW_THRESHOLD\t"
+            "TARGET_TRANSPARENCY\t"
+            "MIN_VALVE_DURATION\t"
+            "transparency_binary_noise\t"
+            "transparency_jet_grid\n"
+        )
+        for idx, params in enumerate(param_sets):
+            line = (
+                f"{CFG.EXPORT_FILENAME}_sweep{idx:02d}\t"
+                f"{params['BW_THRESHOLD']}\t"
+                f"{params['TARGET_TRANSPARENCY']}\t"
+                f"{params['MIN_VALVE_DURATION']}\t"
+                f"{build_stats_str(results[idx][2])}\t"
+                f"{stats[idx]}\n"
+            )
+            f.write(line)
+            print(line, end="")
+
+    print(f"\nSummary written to '{os.path.abspath(summary_path)}'")
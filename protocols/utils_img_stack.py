@@ -7,14 +7,14 @@ Utility functions that operate on an `img_stack`.
 __author__ = "Dennis van Gils"
 __authoremail__ = "vangils.dennis@gmail.com"
 __url__ = "https://github.com/Dennis-van-Gils/project-TWT-jetting-grid"
-__date__ = "13-09-2024"
-__version__ = "2.0"
+__date__ = "15-10-2026"
+__version__ = "2.1"
 # pylint: disable=invalid-name, missing-function-docstring, pointless-string-statement
 
 from time import perf_counter
+from typing import Tuple
 
 import numpy as np
-from scipy import optimize
 from numba import njit, prange
 from tqdm import trange
 
@@ -116,14 +116,109 @@ def binarize_stack_using_threshold(
             stack_BW[i, true_pxs[0][j], true_pxs[1][j]] = 1
 
 
+@njit(
+    cache=True,
+    nogil=True,
+)
+def _transparency(frame: np.ndarray, threshold: float) -> float:
+    """Fraction of the pixels of `frame` above `threshold`"""
+    N_true = 0
+    for j in range(frame.shape[0]):
+        for k in range(frame.shape[1]):
+            if frame[j, k] > threshold:
+                N_true += 1
+    return N_true / frame.shape[0] / frame.shape[1]
+
+
+@njit(
+    cache=True,
+    nogil=True,
+)
+def _solve_threshold(
+    frame: np.ndarray, target: float, maxiter: int, tol: float
+) -> Tuple[float, bool]:
+    """Solve for the threshold at which `frame` has the `target` transparency.
+
+    First tries the secant method of `scipy.optimize.newton()` without
+    `fprime`, starting at 0. The transparency being a staircase, the secant
+    method fails on a flat step, e.g. when no pixel lies in between its first
+    two guesses on a coarse frame. Then it falls back to bisection over the
+    noise range [-1, 1], which converges as long as the target transparency
+    lies within the frame.
+
+    Returns: (Tuple)
+        threshold (float): The last estimate when failed to converge
+        did_converge (bool)
+    """
+    p0 = 0.0
+    p1 = 1e-4
+    q0 = target - _transparency(frame, p0)
+    q1 = target - _transparency(frame, p1)
+    if abs(q1) < abs(q0):
+        p0, p1, q0, q1 = p1, p0, q1, q0
+
+    for _ in range(maxiter):
+        if q1 == q0:
+            if p1 == p0:
+                return p1, True
+            break  # Flat step
+
+        if abs(q1) > abs(q0):
+            p = (-q0 / q1 * p1 + p0) / (1 - q0 / q1)
+        else:
+            p = (-q1 / q0 * p0 + p1) / (1 - q1 / q0)
+        if abs(p - p1) <= tol:
+            return p, True
+        p0, q0 = p1, q1
+        p1 = p
+        q1 = target - _transparency(frame, p1)
+
+    # Bisection. The transparency decreases with the threshold.
+    lo = -1.0
+    hi = 1.0
+    if (target - _transparency(frame, lo) > 0) or (
+        target - _transparency(frame, hi) < 0
+    ):
+        return p1, False
+
+    while hi - lo > tol:
+        mid = (lo + hi) / 2
+        if target - _transparency(frame, mid) < 0:
+            lo = mid
+        else:
+            hi = mid
+
+    return (lo + hi) / 2, True
+
+
 @njit(
     cache=True,
     parallel=True,
     nogil=True,
 )
-def _newton_fun(x, arr_in, target):
-    true_pxs = np.where(arr_in > x)
-    return target - len(true_pxs[0]) / arr_in.shape[0] / arr_in.shape[1]
+def _binarize_stack_using_secant(
+    stack_in: np.ndarray,
+    target_transparency: float,
+    stack_BW: np.ndarray,
+    alpha: np.ndarray,
+    alpha_did_converge: np.ndarray,
+    threshold_out: np.ndarray,
+):
+    """NOTE: In-place operation on all array arguments except `stack_in`"""
+    for i in prange(stack_in.shape[0]):  # pylint: disable=not-an-iterable
+        threshold, did_converge = _solve_threshold(
+            stack_in[i], target_transparency, 20, 0.02
+        )
+        N_true = 0
+        for j in range(stack_in.shape[1]):
+            for k in range(stack_in.shape[2]):
+                if stack_in[i, j, k] > threshold:
+                    stack_BW[i, j, k] = 1
+                    N_true += 1
+
+        alpha[i] = N_true / stack_in.shape[1] / stack_in.shape[2]
+        alpha_did_converge[i] = did_converge
+        threshold_out[i] = threshold
 
 
 def binarize_stack_using_newton(
@@ -132,31 +227,31 @@ def binarize_stack_using_newton(
     stack_BW: np.ndarray,
     alpha: np.ndarray,
     alpha_did_converge: np.ndarray,
+    threshold_out: np.ndarray = None,
+    first_frame: int = 0,
 ):
-    """Using Newton's method to solve for the given transparency:
+    """Using the secant method of Newton's method to solve for the given
+    transparency, as per
     https://docs.scipy.org/doc/scipy/reference/generated/scipy.optimize.newton.html
-    NOTE: In-place operation on arguments `stack_BW`, `alpha` and
-    `alpha_did_converge`.
+    with a fallback to bisection, see `_solve_threshold()`. The frames get
+    solved in parallel over all cores, each one independently, hence the
+    output does not depend on the number of threads.
+    NOTE: In-place operation on arguments `stack_BW`, `alpha`,
+    `alpha_did_converge` and, when passed, `threshold_out` receiving the
+    threshold of each frame. When `stack_in` is a chunk of a larger stack,
+    `first_frame` is the frame number of its first frame, used in warnings.
     """
-    # NOTE: Can't `njit` on `optimize.newton()`. We use python package
-    # `scipy-numba` to get scipy to make use of numba.
-
-    for i in trange(stack_in.shape[0]):
-        # Solve for transparency
-        try:
-            threshold = optimize.newton(
-                _newton_fun,
-                0,
-                args=(stack_in[i], target_transparency),
-                maxiter=20,
-                tol=0.02,
-            )
-        except:
-            print(f"\nWARNING: Convergence failed @ frame {i}")
-            alpha_did_converge[i] = False
-        else:
-            alpha_did_converge[i] = True
+    if threshold_out is None:
+        threshold_out = np.zeros(stack_in.shape[0])
 
-        true_pxs = np.where(stack_in[i] > threshold)
-        alpha[i] = len(true_pxs[0]) / stack_in.shape[1] / stack_in.shape[2]
-        stack_BW[i][true_pxs] = 1
+    _binarize_stack_using_secant(
+        stack_in,
+        target_transparency,
+        stack_BW,
+        alpha,
+        alpha_did_converge,
+        threshold_out,
+    )
+
+    for i in np.flatnonzero(~alpha_did_converge):
+        print(f"\nWARNING: Convergence failed @ frame {first_frame + i}")
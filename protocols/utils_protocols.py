@@ -7,17 +7,21 @@ Utility functions for generating protocols.
 __author__ = "Dennis van Gils"
 __authoremail__ = "vangils.dennis@gmail.com"
 __url__ = "https://github.com/Dennis-van-Gils/project-TWT-jetting-grid"
-__date__ = "18-09-2024"
-__version__ = "2.0"
+__date__ = "15-10-2026"
+__version__ = "2.1"
 # pylint: disable=invalid-name, missing-function-docstring
 
+import os
+import json
+import hashlib
 from time import perf_counter
 from typing import Tuple
 
 import numpy as np
-from numba import prange
+from numba import njit, prange
 from tqdm import trange
 
+from opensimplex.internals import _init, _noise4
 from opensimplex_loops import looping_animated_2D_image
 from utils_img_stack import (
     add_stack_B_to_A,
@@ -73,6 +77,431 @@ def generate_OpenSimplex_grayscale_img_stack() -> np.ndarray:
     return img_stack_A
 
 
+# ------------------------------------------------------------------------------
+#  sample_looping_animated_2D
+# ------------------------------------------------------------------------------
+
+
+@njit(
+    cache=True,
+    parallel=True,
+    nogil=True,
+)
+def _sample_looping_animated_2D(
+    N_frames: int,
+    first_frame: int,
+    px_x: np.ndarray,
+    px_y: np.ndarray,
+    t_step: float,
+    x_step: float,
+    perm: np.ndarray,
+    out: np.ndarray,
+):
+    """Evaluate the noise of `looping_animated_2D_image()` only at the pixels
+    (`px_y`, `px_x`) of frames `first_frame` onwards out of `N_frames`.
+    NOTE: In-place operation on argument `out` [N_chunk, N_samples].
+    """
+    t_radius = N_frames * t_step / (2 * np.pi)  # Temporal radius of the loop
+    t_factor = 2 * np.pi / N_frames
+    for t_i in prange(out.shape[0]):  # pylint: disable=not-an-iterable
+        t = (first_frame + t_i) * t_factor
+        t_cos = t_radius * np.cos(t)
+        t_sin = t_radius * np.sin(t)
+        for i in range(px_x.size):
+            out[t_i, i] = _noise4(
+                px_x[i] * x_step, px_y[i] * x_step, t_sin, t_cos, perm
+            )
+
+
+def sample_looping_animated_2D(
+    N_frames: int,
+    px_x: np.ndarray,
+    px_y: np.ndarray,
+    t_step: float,
+    x_step: float,
+    seed: int,
+    first_frame: int = 0,
+    N_chunk: int = None,
+) -> np.ndarray:
+    """Same as `looping_animated_2D_image()` with `dtype=np.float32`, but only
+    at the pixels (`px_y`, `px_x`) of each frame. When passed `N_chunk`, only
+    frames `first_frame` up to `first_frame + N_chunk` of the loop get
+    evaluated.
+
+    Returns:
+        samples (np.ndarray):
+            Array shape: [N_chunk, N_samples]
+    """
+    if N_chunk is None:
+        N_chunk = N_frames - first_frame
+
+    perm, _ = _init(seed)
+    out = np.empty((N_chunk, px_x.size), dtype=np.float32)
+    _sample_looping_animated_2D(
+        N_frames, first_frame, px_x, px_y, t_step, x_step, perm, out
+    )
+    return out
+
+
+def _check_sample_looping_animated_2D():
+    """Check `sample_looping_animated_2D()` against the full image stack of
+    `looping_animated_2D_image()` on a small problem, as it reimplements the
+    mapping of the latter onto the 4D OpenSimplex noise. The second half of
+    the frames gets sampled as a separate chunk."""
+    N_frames, N_pixels = 8, 16
+    full = looping_animated_2D_image(
+        N_frames=N_frames,
+        N_pixels_x=N_pixels,
+        t_step=CFG.T_STEP_A,
+        x_step=CFG.X_STEP_A,
+        seed=CFG.SEED_A,
+        dtype=np.float32,
+    )
+    print("")
+
+    grid_x, grid_y = np.meshgrid(np.arange(N_pixels), np.arange(N_pixels))
+    samples = [
+        sample_looping_animated_2D(
+            N_frames,
+            grid_x.ravel(),
+            grid_y.ravel(),
+            CFG.T_STEP_A,
+            CFG.X_STEP_A,
+            CFG.SEED_A,
+            first_frame,
+            N_frames // 2,
+        )
+        for first_frame in (0, N_frames // 2)
+    ]
+    if not np.array_equal(np.vstack(samples), full.reshape(N_frames, -1)):
+        raise RuntimeError(
+            "The sampled noise does not match package `opensimplex-loops`."
+        )
+
+
+# ------------------------------------------------------------------------------
+#  generate_valves_stack_streamed
+# ------------------------------------------------------------------------------
+
+
+def _sample_OpenSimplex(
+    px_x: np.ndarray, px_y: np.ndarray, first_frame: int, N_chunk: int
+) -> np.ndarray:
+    """Sample the noise of `generate_OpenSimplex_grayscale_img_stack()` at the
+    pixels (`px_y`, `px_x`) of frames `first_frame` up to
+    `first_frame + N_chunk`.
+
+    Returns:
+        samples (np.ndarray):
+            Float values within the range [-1, 1].
+            Array shape: [N_chunk, N_samples]
+    """
+    # Range [-1, 1]
+    samples = sample_looping_animated_2D(
+        CFG.N_FRAMES,
+        px_x,
+        px_y,
+        CFG.T_STEP_A,
+        CFG.X_STEP_A,
+        CFG.SEED_A,
+        first_frame,
+        N_chunk,
+    )
+
+    if CFG.SPATIAL_FEATURE_SIZE_B > 0:
+        # Same float32 arithmetic as `generate_OpenSimplex_grayscale_img_stack`
+        samples += sample_looping_animated_2D(
+            CFG.N_FRAMES,
+            px_x,
+            px_y,
+            CFG.T_STEP_B,
+            CFG.X_STEP_B,
+            CFG.SEED_B,
+            first_frame,
+            N_chunk,
+        )  # Range [-2, 2]
+        np.divide(samples, 2, out=samples)  # Range [-1, 1]
+
+    return samples
+
+
+def generate_valves_stack_streamed(
+    frames_path: str = None, frames_as_gray: bool = False
+) -> Tuple[np.ndarray, np.ndarray, np.ndarray, np.ndarray]:
+    """Generate the OpenSimplex noise, binarize it and map it onto the valve
+    locations as specified in `config_proto_OpenSimplex.py`, streaming over
+    chunks of frames. Replaces `generate_OpenSimplex_grayscale_img_stack()`
+    followed by `binarize_img_stack()` and `compute_valves_stack()`, but the
+    noise held in memory at once stays below `CHUNK_MAX_BYTES`, regardless of
+    the number of frames. Only the per-frame results of all frames are kept.
+
+    The thresholding scheme acts on the full image when `VALVE_SAMPLED` is
+    False, else on a coarse grid with a pixel distance of `SOLVER_PX_STRIDE`.
+
+    Args:
+        frames_path (str, optional):
+            When passed, the noise frames get written chunk by chunk to this
+            `.npy` file, to be memory-mapped by the caller for plotting using
+            `np.load(frames_path, mmap_mode="r")`. As grayscale float32 values
+            when `frames_as_gray`, else as binarized bool values.
+            Array shape: [N_frames, N_grid_pixels, N_grid_pixels]
+
+    Returns: (Tuple)
+        valves_stack (np.ndarray):
+            Stack containing the boolean states of all valves as 0's and 1's.
+            Array shape: [N_frames, N_valves]
+
+        alpha_valves (np.ndarray):
+            Transparency of each `valves_stack` frame.
+            Array shape: [N_frames]
+
+        alpha_BW (np.ndarray):
+            Transparency of each binarized noise frame.
+            Array shape: [N_frames]
+
+        alpha_BW_did_converge (np.ndarray):
+            When the Newton solver is used, did it manage to converge to the
+            given target transparency per frame?
+            Array shape: [N_frames]
+    """
+    return generate_valves_stacks_swept(
+        [(CFG.BW_THRESHOLD, CFG.TARGET_TRANSPARENCY)],
+        frames_path,
+        frames_as_gray,
+    )[0]
+
+
+def generate_valves_stacks_swept(
+    binarizations: list, frames_path: str = None, frames_as_gray: bool = False
+) -> list:
+    """Same as `generate_valves_stack_streamed()`, but for several
+    thresholding schemes at once, sharing the noise. Each chunk of noise gets
+    generated once and then binarized per scheme, hence sweeping N schemes
+    costs about one generation of the noise instead of N.
+
+    Args:
+        binarizations (list):
+            Per scheme the tuple (`BW_THRESHOLD`, `TARGET_TRANSPARENCY`), of
+            which exactly one must be None, see `config_proto_opensimplex.py`.
+
+        frames_path (str, optional):
+            See `generate_valves_stack_streamed()`. The binarized noise is that
+            of the first scheme.
+
+    Returns:
+        Per scheme the tuple as returned by `generate_valves_stack_streamed()`.
+    """
+    _check_sample_looping_animated_2D()
+
+    stride = CFG.SOLVER_PX_STRIDE if CFG.VALVE_SAMPLED else 1
+    pxs = np.arange(0, CFG.N_PIXELS, stride)
+    grid_x, grid_y = np.meshgrid(pxs, pxs)
+    grid_x = grid_x.ravel()
+    grid_y = grid_y.ravel()
+
+    # Per frame: Grayscale noise A and B as float32 plus the binarized noise
+    N_chunk = int(
+        np.clip(CFG.CHUNK_MAX_BYTES // (grid_x.size * 9), 1, CFG.N_FRAMES)
+    )
+
+    frames_out = None
+    if frames_path is not None:
+        frames_out = np.lib.format.open_memmap(
+            frames_path,
+            mode="w+",
+            dtype=np.float32 if frames_as_gray else bool,
+            shape=(CFG.N_FRAMES, pxs.size, pxs.size),
+        )
+
+    results = []
+    for bw_threshold, target_transparency in binarizations:
+        if (bw_threshold is None) == (target_transparency is None):
+            raise ValueError(
+                "Specify either `BW_THRESHOLD` or `TARGET_TRANSPARENCY`"
+            )
+        # NOTE: Use `int8` as type, not `bool` because we need `np.diff()`
+        # later.
+        results.append(
+            (
+                np.zeros([CFG.N_FRAMES, C.N_VALVES], dtype=np.int8),
+                np.zeros(CFG.N_FRAMES),  # alpha_BW
+                np.zeros(CFG.N_FRAMES, dtype=bool),  # alpha_BW_did_converge
+                np.zeros(CFG.N_FRAMES),  # threshold
+            )
+        )
+
+    if len(binarizations) > 1:
+        print(f"Generating and binarizing noise {len(binarizations)} ways,")
+    elif binarizations[0][0] is not None:
+        print("Generating and binarizing noise using a constant threshold,")
+    else:
+        print("Generating and binarizing noise solving for a transparency,")
+    print(f"in chunks of {N_chunk} frames...")
+    tick = perf_counter()
+
+    for f0 in trange(0, CFG.N_FRAMES, N_chunk):
+        f1 = min(f0 + N_chunk, CFG.N_FRAMES)
+        chunk_gray = _sample_OpenSimplex(grid_x, grid_y, f0, f1 - f0).reshape(
+            f1 - f0, pxs.size, pxs.size
+        )
+        valves_gray = _sample_OpenSimplex(
+            CFG.valve2px_x, CFG.valve2px_y, f0, f1 - f0
+        )
+        chunk_BW = np.zeros(chunk_gray.shape, dtype=bool)
+
+        for idx, result in enumerate(results):
+            bw_threshold, target_transparency = binarizations[idx]
+            valves_stack, alpha_BW, alpha_BW_did_converge, threshold = result
+            if bw_threshold is not None:
+                binarize_stack_using_threshold(
+                    chunk_gray, bw_threshold, chunk_BW, alpha_BW[f0:f1]
+                )
+                threshold[f0:f1] = bw_threshold
+            else:
+                binarize_stack_using_newton(
+                    chunk_gray,
+                    target_transparency,
+                    chunk_BW,
+                    alpha_BW[f0:f1],
+                    alpha_BW_did_converge[f0:f1],
+                    threshold[f0:f1],
+                    first_frame=f0,
+                )
+
+            valves_stack[f0:f1] = valves_gray > threshold[f0:f1, np.newaxis]
+
+            if frames_out is not None and idx == 0:
+                frames_out[f0:f1] = chunk_gray if frames_as_gray else chunk_BW
+
+    if frames_out is not None:
+        frames_out.flush()
+        del frames_out
+
+    print(f"done in {(perf_counter() - tick):.2f} s\n")
+
+    # Valve transparency
+    return [
+        (
+            valves_stack,
+            valves_stack.sum(1) / C.N_VALVES,
+            alpha_BW,
+            alpha_BW_did_converge,
+        )
+        for valves_stack, alpha_BW, alpha_BW_did_converge, _ in results
+    ]
+
+
+# ------------------------------------------------------------------------------
+#  generate_valves_stack_cached
+# ------------------------------------------------------------------------------
+
+
+def _generation_params() -> dict:
+    """All parameters the noise, its binarization and the valve states depend
+    on, i.e. excluding downstream parameters like `MIN_VALVE_DURATION`."""
+    return {
+        "version": __version__,
+        "N_FRAMES": CFG.N_FRAMES,
+        "N_PIXELS": CFG.N_PIXELS,
+        "X_STEP_A": CFG.X_STEP_A,
+        "T_STEP_A": CFG.T_STEP_A,
+        "SEED_A": CFG.SEED_A,
+        "X_STEP_B": CFG.X_STEP_B,
+        "T_STEP_B": CFG.T_STEP_B,
+        "SEED_B": CFG.SEED_B,
+        "BW_THRESHOLD": CFG.BW_THRESHOLD,
+        "TARGET_TRANSPARENCY": CFG.TARGET_TRANSPARENCY,
+        "VALVE_SAMPLED": CFG.VALVE_SAMPLED,
+        "SOLVER_PX_STRIDE": CFG.SOLVER_PX_STRIDE if CFG.VALVE_SAMPLED else 1,
+        "valve2px_x": CFG.valve2px_x.tolist(),
+        "valve2px_y": CFG.valve2px_y.tolist(),
+    }
+
+
+def generate_valves_stack_cached(
+    noise_stage: str = None,
+) -> Tuple[np.ndarray, np.ndarray, np.ndarray, np.ndarray, np.ndarray]:
+    """Same as `generate_valves_stack_streamed()`, but cached on disk in a
+    subfolder of `CACHE_SUBFOLDER` named after the hash of all generation
+    parameters, see `_generation_params()`. Hence, a changed configuration
+    never hits a stale cache, while changing only downstream parameters like
+    `MIN_VALVE_DURATION` skips generating the noise.
+
+    Each stage gets stored as `.npy` files: `valves_stack.npy`,
+    `alpha_BW.npy` and `alpha_BW_did_converge.npy`, and when asked for,
+    `noise_gray.npy` or `noise_BW.npy`. File `params.json` gets written last,
+    marking the valves stage as complete.
+
+    Args:
+        noise_stage (str, optional):
+            Either "gray" or "BW" to also return the noise frames of that stage,
+            generating them when not yet cached.
+
+    Returns: (Tuple)
+        As `generate_valves_stack_streamed()`, followed by
+
+        img_stack (np.ndarray | None):
+            The memory-mapped noise frames of `noise_stage`, else None.
+            Array shape: [N_frames, N_grid_pixels, N_grid_pixels]
+    """
+    params = _generation_params()
+    key = hashlib.sha256(json.dumps(params, sort_keys=True).encode())
+    cache_dir = os.path.join(CFG.CACHE_SUBFOLDER, key.hexdigest()[:16])
+    params_path = os.path.join(cache_dir, "params.json")
+    noise_path = None
+    if noise_stage is not None:
+        noise_path = os.path.join(cache_dir, f"noise_{noise_stage}.npy")
+
+    if os.path.isfile(params_path) and (
+        noise_path is None or os.path.isfile(noise_path)
+    ):
+        print(f"Reading cache '{cache_dir}'...")
+        tick = perf_counter()
+        valves_stack = np.load(os.path.join(cache_dir, "valves_stack.npy"))
+        alpha_BW = np.load(os.path.join(cache_dir, "alpha_BW.npy"))
+        alpha_BW_did_converge = np.load(
+            os.path.join(cache_dir, "alpha_BW_did_converge.npy")
+        )
+        alpha_valves = valves_stack.sum(1) / C.N_VALVES
+        print(f"done in {(perf_counter() - tick):.2f} s\n")
+
+    else:
+        os.makedirs(cache_dir, exist_ok=True)
+
+        # Renamed once complete, as to never leave a partial stage behind
+        part_path = None if noise_path is None else noise_path + ".part"
+        (
+            valves_stack,
+            alpha_valves,
+            alpha_BW,
+            alpha_BW_did_converge,
+        ) = generate_valves_stack_streamed(part_path, noise_stage == "gray")
+        if part_path is not None:
+            os.replace(part_path, noise_path)
+
+        if not os.path.isfile(params_path):
+            np.save(os.path.join(cache_dir, "valves_stack.npy"), valves_stack)
+            np.save(os.path.join(cache_dir, "alpha_BW.npy"), alpha_BW)
+            np.save(
+                os.path.join(cache_dir, "alpha_BW_did_converge.npy"),
+                alpha_BW_did_converge,
+            )
+            with open(params_path, "w", encoding="utf-8") as f:
+                json.dump(params, f, indent=2)
+
+    img_stack = None
+    if noise_path is not None:
+        img_stack = np.load(noise_path, mmap_mode="r")
+
+    return (
+        valves_stack,
+        alpha_valves,
+        alpha_BW,
+        alpha_BW_did_converge,
+        img_stack,
+    )
+
+
 # ------------------------------------------------------------------------------
 #  binarize_img_stack
 # ------------------------------------------------------------------------------
@@ -80,9 +509,11 @@ def generate_OpenSimplex_grayscale_img_stack() -> np.ndarray:
 
 def binarize_img_stack(
     img_stack_in: np.ndarray,
+    threshold_out: np.ndarray = None,
 ) -> Tuple[np.ndarray, np.ndarray, np.ndarray]:
     """Binarize the passed grayscale image stack `img_stack_in` using a
-    thresholding scheme as specified in `config_proto_OpenSimplex.py`.
+    thresholding scheme as specified in `config_proto_OpenSimplex.py`. When
+    passed, `threshold_out` receives the threshold of each frame.
 
     Returns: (Tuple)
         img_stack_BW (np.ndarray):
@@ -115,6 +546,8 @@ def binarize_img_stack(
             img_stack_BW,
             alpha_BW,
         )
+        if threshold_out is not None:
+            threshold_out[:] = CFG.BW_THRESHOLD
 
     else:
         # Newton solver
@@ -125,6 +558,7 @@ def binarize_img_stack(
             img_stack_BW,
             alpha_BW,
             alpha_BW_did_converge,
+            threshold_out,
         )
 
     print(f"done in {(perf_counter() - tick):.2f} s\n")
@@ -170,7 +604,13 @@ def compute_valves_stack(img_stack_BW: np.ndarray):
 # ------------------------------------------------------------------------------
 
 
-def export_protocol_to_disk(valves_stack: np.ndarray, export_path: str):
+def export_protocol_to_disk(
+    valves_stack: np.ndarray,
+    export_path: str,
+    marker_every: int = 0,
+    header: str = None,
+    verbose: bool = True,
+):
     """Exports the `valves_stack` to a text file on disk, formatted such that it
     can to be send over to the microcontroller.
 
@@ -181,8 +621,23 @@ def export_protocol_to_disk(valves_stack: np.ndarray, export_path: str):
 
         export_path (str):
             Relative or absolute path including filename to write to.
+
+        marker_every (int, optional):
+            Mark every so many frames, starting with the first, to pulse the
+            sync output of the microcontroller when switched to, e.g. to
+            trigger a camera. 0 marks none.
+
+            Default: 0
+
+        header (str, optional):
+            Header info to write instead of `CFG.create_header_string()`, e.g.
+            that of a parameter set of a sweep.
+
+        verbose (bool, optional):
+            Report the progress? Default: True
     """
-    print(f"Exporting protocol to disk as '{export_path}'...")
+    if verbose:
+        print(f"Exporting protocol to disk as '{export_path}'...")
     tick = perf_counter()
 
     valves_stack = np.asarray(valves_stack, dtype=np.int8)
@@ -191,17 +646,105 @@ def export_protocol_to_disk(valves_stack: np.ndarray, export_path: str):
     with open(export_path, "w", encoding="utf-8") as f:
         # Write header info
         f.write("[HEADER]\n")
-        f.write(CFG.create_header_string())
+        f.write(CFG.create_header_string() if header is None else header)
 
         # Write data
         f.write("[DATA]\n")
-        for frame_idx in trange(N_frames):
+        for frame_idx in trange(N_frames, disable=not verbose):
             f.write(f"{CFG.DT_FRAME*1000:.0f}")  # Duration in msec
             for valve_idx, state in enumerate(valves_stack[frame_idx, :]):
                 if state:
                     pcs_x = C.valve2pcs_x[valve_idx]
                     pcs_y = C.valve2pcs_y[valve_idx]
                     f.write(f"\t{pcs_x:d},{pcs_y:d}")
+            if marker_every and frame_idx % marker_every == 0:
+                f.write("\tM")
             f.write("\n")
 
-    print(f"done in {perf_counter() - tick:.2f} s\n")
+    if verbose:
+        print(f"done in {perf_counter() - tick:.2f} s\n")
+
+
+def export_alpha_to_disk(
+    export_path: str,
+    alpha_BW: np.ndarray,
+    alpha_valves: np.ndarray,
+    alpha_BW_did_converge: np.ndarray,
+    used_newton: bool,
+):
+    """Exports the transparencies per frame to a text file on disk.
+
+    Args:
+        used_newton (bool):
+            Was the Newton solver used to solve for a target transparency,
+            instead of a constant threshold?
+    """
+    with open(export_path, "w", encoding="utf-8") as f:
+        if used_newton:
+            f.write(
+                "Newton solver was used to solve for a wanted transparency.\n"
+            )
+            failed_convergences = alpha_BW.size - sum(alpha_BW_did_converge)
+            if failed_convergences > 0:
+                f.write(
+                    f"{failed_convergences:d} frames failed to converge!\n"
+                )
+            else:
+                f.write("All frames did converge.\n")
+        else:
+            f.write("A simple BW threshold was used.\n")
+            f.write("Column `Newton_solver_converged?` can be ignored.\n")
+
+        f.write(
+            "\n"
+            "# frame\t"
+            "transparency_binary_noise\t"
+            "transparency_jet_grid\t"
+            "Newton_solver_converged?\n"
+        )
+        for i in range(alpha_BW.size):
+            f.write(
+                f"{i:d}\t{alpha_BW[i]:.2f}\t"
+                f"{alpha_valves[i]:.2f}\t"
+                f"{alpha_BW_did_converge[i]!s}\n"
+            )
+
+
+def export_pdfs_to_disk(
+    export_path: str,
+    bins: np.ndarray,
+    pdf_on: np.ndarray,
+    pdf_on_adj: np.ndarray,
+    pdf_off: np.ndarray,
+    pdf_off_adj: np.ndarray,
+):
+    """Exports the PDFs of the valve on/off durations, see
+    `valve_on_off_PDFs()`, before and after adjusting the minimum valve
+    durations to a text file on disk, up to the last non-zero bin."""
+    idx_last_nonzero_bin = bins.size - np.min(
+        (
+            np.argmax(np.flipud(pdf_on) > 0),
+            np.argmax(np.flipud(pdf_on_adj) > 0),
+            np.argmax(np.flipud(pdf_off) > 0),
+            np.argmax(np.flipud(pdf_off_adj) > 0),
+        )
+    )
+    pdfs = np.zeros((idx_last_nonzero_bin, 5))
+    pdfs[:, 0] = bins[:idx_last_nonzero_bin]
+    pdfs[:, 1] = pdf_on[:idx_last_nonzero_bin]
+    pdfs[:, 2] = pdf_on_adj[:idx_last_nonzero_bin]
+    pdfs[:, 3] = pdf_off[:idx_last_nonzero_bin]
+    pdfs[:, 4] = pdf_off_adj[:idx_last_nonzero_bin]
+
+    np.savetxt(
+        export_path,
+        pdfs,
+        fmt="%.3f\t%.3e\t%.3e\t%.3e\t%.3e",
+        header=(
+            "duration[s]\t"
+            "open_theoretical_valve\t"
+            "open_jet_grid_valve\t"
+            "closed_theoretical_valve\t"
+            "closed_jet_grid_valve"
+        ),
+    )
@@ -0,0 +1,379 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""utils_valve_render.py
+
+Fast export of the valve animation of a protocol. Instead of going through
+matplotlib, the 15 x 15 valve grid and an optional noise background get drawn
+straight into palette-indexed numpy frame buffers. The frames get rendered in
+chunks by a pool of processes and are streamed to the encoder in order, as
+.gif via Pillow or as .mp4 via `ffmpeg`. Only a few chunks are in flight at any
+time, hence memory use stays bounded regardless of the number of frames.
+"""
+__author__ = "Dennis van Gils"
+__authoremail__ = "vangils.dennis@gmail.com"
+__url__ = "https://github.com/Dennis-van-Gils/project-TWT-jetting-grid"
+__date__ = "15-10-2026"
+__version__ = "1.0"
+# pylint: disable=invalid-name
+
+from collections import deque
+import multiprocessing
+import os
+import subprocess
+
+import numpy as np
+from PIL import Image, ImageDraw, ImageFont, GifImagePlugin
+from tqdm import tqdm
+
+import constants as C
+
+# Palette: A gray ramp from black to white, followed by the colors below
+N_GRAYS = 240
+COLOR_VALVE = N_GRAYS  # Open valve
+COLOR_GRID = N_GRAYS + 1  # Grid lines through the PCS coordinates
+COLOR_TEXT = N_GRAYS + 2  # Caption
+WHITE = N_GRAYS - 1
+
+_ramp = np.linspace(0, 255, N_GRAYS).round().astype(np.uint8)
+PALETTE = np.zeros((256, 3), dtype=np.uint8)
+PALETTE[:N_GRAYS] = _ramp[:, None]
+PALETTE[COLOR_VALVE] = (255, 20, 147)  # "deeppink"
+PALETTE[COLOR_GRID] = (176, 176, 176)
+PALETTE[COLOR_TEXT] = (0, 0, 0)
+
+# Number of chunks being rendered or awaiting the encoder per worker process
+CHUNKS_IN_FLIGHT_PER_WORKER = 2
+
+# ------------------------------------------------------------------------------
+#  ValveRenderer
+# ------------------------------------------------------------------------------
+
+
+class ValveRenderer:
+    """Draws single frames of the valve animation into palette-indexed
+    buffers, see `PALETTE`. The axes span the PCS from `PCS_X_MIN - 1` to
+    `PCS_X_MAX + 1`, just like the matplotlib plot of
+    `make_proto_opensimplex.py`.
+
+    Args:
+        cell_px (int):
+            Pixel distance between the integer PCS coordinates.
+
+        noise_shape (tuple, optional):
+            Shape [y-pixel, x-pixel] of the noise frames to be drawn as
+            background, spanning the same extent as the axes with the origin
+            in the lower left. Sampled down by nearest neighbour.
+
+        noise_range (tuple):
+            Noise values (lo, hi) mapped onto white and black, respectively,
+            such that high noise values show up dark like the open valves.
+    """
+
+    def __init__(
+        self,
+        cell_px: int = 24,
+        noise_shape: tuple = None,
+        noise_range: tuple = (0, 1),
+    ):
+        self.cell_px = cell_px
+        self.N_px = cell_px * (C.NUMEL_PCS_AXIS + 1)
+        self.noise_range = noise_range
+
+        # Background holding the grid lines, copied into each frame
+        self._background = np.full((self.N_px, self.N_px), WHITE, np.uint8)
+        self._grid_px = np.arange(1, C.NUMEL_PCS_AXIS + 1) * cell_px
+        self._background[self._grid_px, :] = COLOR_GRID
+        self._background[:, self._grid_px] = COLOR_GRID
+
+        # Pixel indices of the noise frame sampled by each frame pixel, the
+        # rows flipped as the noise has its origin in the lower left
+        self._noise_rows = self._noise_cols = None
+        if noise_shape is not None:
+            centers = (np.arange(self.N_px) + 0.5) / self.N_px
+            rows = ((1 - centers) * noise_shape[0]).astype(np.intp)
+            self._noise_rows = rows[:, None]
+            self._noise_cols = (centers * noise_shape[1]).astype(np.intp)
+
+        # Disk stamped onto each open valve
+        radius = max(cell_px * 0.3, 1)
+        offsets = np.arange(-int(radius), int(radius) + 1)
+        dy, dx = np.meshgrid(offsets, offsets, indexing="ij")
+        disk = dx**2 + dy**2 <= radius**2
+        self._disk_dy = dy[disk]
+        self._disk_dx = dx[disk]
+
+        # Frame pixel of each valve
+        self._valve_px_x = (C.valve2pcs_x - C.PCS_X_MIN + 1) * cell_px
+        self._valve_px_y = (C.PCS_X_MAX + 1 - C.valve2pcs_y) * cell_px
+
+        self._font = ImageFont.load_default()
+
+    def render(
+        self, valves: np.ndarray, noise: np.ndarray = None, caption: str = ""
+    ) -> np.ndarray:
+        """Draw a single frame.
+
+        Args:
+            valves (np.ndarray):
+                Boolean state of each valve. Array shape: [N_valves]
+
+            noise (np.ndarray, optional):
+                Noise frame to draw as background, of `noise_shape`.
+
+            caption (str, optional):
+                Text to draw in the upper left corner.
+
+        Returns:
+            The frame as palette indices. Array shape: [N_px, N_px]
+        """
+        if noise is None or self._noise_rows is None:
+            frame = self._background.copy()
+        else:
+            lo, hi = self.noise_range
+            sampled = np.asarray(noise)[self._noise_rows, self._noise_cols]
+            level = (hi - sampled.astype(np.float32)) / (hi - lo)
+            frame = np.clip(level * (N_GRAYS - 1) + 0.5, 0, N_GRAYS - 1)
+            frame = frame.astype(np.uint8)
+            frame[self._grid_px, :] = COLOR_GRID
+            frame[:, self._grid_px] = COLOR_GRID
+
+        idx = np.flatnonzero(valves)
+        rows = self._valve_px_y[idx, None] + self._disk_dy[None, :]
+        cols = self._valve_px_x[idx, None] + self._disk_dx[None, :]
+        frame[rows, cols] = COLOR_VALVE
+
+        if caption:
+            img = Image.fromarray(frame)
+            ImageDraw.Draw(img).text(
+                (4, 2), caption, fill=COLOR_TEXT, font=self._font
+            )
+            frame = np.asarray(img)
+
+        return frame
+
+
+# ------------------------------------------------------------------------------
+#  Worker processes
+# ------------------------------------------------------------------------------
+
+# State of each worker process, see `_init_worker()`
+_worker = {}
+
+
+def _init_worker(renderer_kwargs, valves_stack, noise, captions):
+    """Set up a worker process. A memory-mapped noise stack gets passed by
+    its file name and mapped again by each worker, instead of being copied."""
+    if isinstance(noise, str):
+        noise = np.load(noise, mmap_mode="r")
+    _worker["renderer"] = ValveRenderer(**renderer_kwargs)
+    _worker["valves_stack"] = valves_stack
+    _worker["noise"] = noise
+    _worker["captions"] = captions
+
+
+def _render_chunk(first: int, last: int) -> np.ndarray:
+    """Render frames `first` up to but excluding `last` in a worker process.
+    Returns: The frames as palette indices. Array shape: [N, N_px, N_px]
+    """
+    renderer = _worker["renderer"]
+    noise = _worker["noise"]
+    captions = _worker["captions"]
+    return np.stack(
+        [
+            renderer.render(
+                _worker["valves_stack"][j],
+                None if noise is None else noise[j],
+                "" if captions is None else captions[j],
+            )
+            for j in range(first, last)
+        ]
+    )
+
+
+# ------------------------------------------------------------------------------
+#  Encoders
+# ------------------------------------------------------------------------------
+
+
+class _GifStream:
+    """Writes a looping .gif frame by frame, sharing `PALETTE` as global color
+    table. Unlike `Image.save(save_all=True)` it keeps no frames in memory."""
+
+    def __init__(self, path: str, N_px: int, duration_ms: int):
+        self._f = open(path, "wb")  # pylint: disable=consider-using-with
+        self._size = (N_px, N_px)
+        self._duration_ms = duration_ms
+        self._palette = PALETTE.tobytes()
+        self._first = True
+
+    def write(self, frame: np.ndarray):
+        img = Image.frombytes("P", self._size, frame.tobytes())
+        img.putpalette(self._palette)
+        if self._first:
+            self._first = False
+            header, _ = GifImagePlugin.getheader(
+                img, info={"duration": self._duration_ms}
+            )
+            for chunk in header:
+                self._f.write(chunk)
+            # NETSCAPE2.0 application extension: Loop forever
+            self._f.write(b"!\xff\x0bNETSCAPE2.0\x03\x01\x00\x00\x00")
+        for chunk in GifImagePlugin.getdata(img, duration=self._duration_ms):
+            self._f.write(chunk)
+
+    def close(self):
+        self._f.write(b";")  # Trailer
+        self._f.close()
+
+
+class _Mp4Stream:
+    """Pipes the frames as raw RGB video into `ffmpeg`, encoding H.264."""
+
+    def __init__(self, path: str, N_px: int, fps: float):
+        # H.264 with 4:2:0 chroma subsampling needs even dimensions
+        self._pad = N_px % 2
+        self._proc = subprocess.Popen(  # pylint: disable=consider-using-with
+            [
+                "ffmpeg",
+                "-y",
+                "-loglevel",
+                "error",
+                "-f",
+                "rawvideo",
+                "-pix_fmt",
+                "rgb24",
+                "-s",
+                f"{N_px:d}x{N_px:d}",
+                "-r",
+                f"{fps:g}",
+                "-i",
+                "-",
+                "-vf",
+                f"pad={N_px + self._pad:d}:{N_px + self._pad:d}:0:0:white",
+                "-c:v",
+                "libx264",
+                "-pix_fmt",
+                "yuv420p",
+                path,
+            ],
+            stdin=subprocess.PIPE,
+        )
+
+    def write(self, frame: np.ndarray):
+        self._proc.stdin.write(PALETTE[frame].tobytes())
+
+    def close(self):
+        self._proc.stdin.close()
+        if self._proc.wait() != 0:
+            raise RuntimeError("ffmpeg failed to encode the animation")
+
+
+# ------------------------------------------------------------------------------
+#  export_animation
+# ------------------------------------------------------------------------------
+
+
+def export_animation(
+    path: str,
+    valves_stack: np.ndarray,
+    dt_frame: float,
+    noise_stack: np.ndarray = None,
+    noise_range: tuple = (0, 1),
+    captions: list = None,
+    cell_px: int = 24,
+    N_workers: int = None,
+    chunk_frames: int = 32,
+):
+    """Render the valve animation and stream it to disk as .gif or .mp4,
+    depending on the extension of `path`. The .mp4 requires `ffmpeg` on the
+    path.
+
+    Args:
+        path (str):
+            File path ending in ".gif" or ".mp4".
+
+        valves_stack (np.ndarray):
+            Boolean state of each valve per frame.
+            Array shape: [N_frames, N_valves]
+
+        dt_frame (float):
+            Duration of each frame [s].
+
+        noise_stack (np.ndarray, optional):
+            Noise frames to draw as background, see `ValveRenderer`. Pass the
+            memory-mapped stack of `generate_valves_stack_cached()` to have the
+            worker processes map it themselves instead of receiving a copy.
+            Array shape: [N_frames, N_grid_pixels, N_grid_pixels]
+
+        noise_range (tuple):
+            See `ValveRenderer`.
+
+        captions (list, optional):
+            Text drawn onto each frame.
+
+        cell_px (int):
+            See `ValveRenderer`.
+
+        N_workers (int, optional):
+            Number of worker processes, defaulting to the number of CPUs.
+            Only where processes can be forked, as spawned processes would
+            re-run the calling script. Elsewhere, or when 1, the frames get
+            rendered in this process.
+
+        chunk_frames (int):
+            Number of frames rendered per task of a worker.
+    """
+    N_frames = len(valves_stack)
+    N_workers = N_workers or os.cpu_count() or 1
+
+    renderer_kwargs = dict(cell_px=cell_px, noise_range=noise_range)
+    noise = noise_stack
+    if noise_stack is not None:
+        renderer_kwargs["noise_shape"] = noise_stack.shape[1:]
+        if isinstance(noise_stack, np.memmap) and noise_stack.filename:
+            noise = noise_stack.filename
+    N_px = cell_px * (C.NUMEL_PCS_AXIS + 1)
+
+    ext = os.path.splitext(path)[1].lower()
+    if ext == ".gif":
+        stream = _GifStream(path, N_px, round(dt_frame * 1000))
+    elif ext == ".mp4":
+        stream = _Mp4Stream(path, N_px, 1 / dt_frame)
+    else:
+        raise ValueError(f"Unsupported animation format '{ext}'")
+
+    chunks = [
+        (first, min(first + chunk_frames, N_frames))
+        for first in range(0, N_frames, chunk_frames)
+    ]
+    max_in_flight = N_workers * CHUNKS_IN_FLIGHT_PER_WORKER
+
+    initargs = (renderer_kwargs, valves_stack, noise, captions)
+    if "fork" not in multiprocessing.get_all_start_methods():
+        N_workers = 1
+
+    def write_chunk(frames):
+        for frame in frames:
+            stream.write(frame)
+        pbar.update(len(frames))
+
+    try:
+        with tqdm(total=N_frames) as pbar:
+            if N_workers == 1:
+                _init_worker(*initargs)
+                for chunk in chunks:
+                    write_chunk(_render_chunk(*chunk))
+                return
+
+            with multiprocessing.get_context("fork").Pool(
+                N_workers, initializer=_init_worker, initargs=initargs
+            ) as pool:
+                in_flight = deque()
+                for chunk in chunks:
+                    in_flight.append(pool.apply_async(_render_chunk, chunk))
+                    if len(in_flight) >= max_in_flight:
+                        write_chunk(in_flight.popleft().get())
+                while in_flight:
+                    write_chunk(in_flight.popleft().get())
+    finally:
+        stream.close()
@@ -7,11 +7,11 @@ Utility functions that operate on a `valves_stack`.
 __author__ = "Dennis van Gils"
 __authoremail__ = "vangils.dennis@gmail.com"
 __url__ = "https://github.com/Dennis-van-Gils/project-TWT-jetting-grid"
-__date__ = "17-04-2023"
-__version__ = "1.0"
+__date__ = "15-10-2026"
+__version__ = "2.0"
 # pylint: disable=invalid-name, missing-function-docstring
 
-from typing import Tuple
+from typing import NamedTuple, Tuple, Union
 from time import perf_counter
 
 import numpy as np
@@ -20,125 +20,110 @@ from matplotlib import pyplot as plt
 from utils_matplotlib import move_figure
 
 
-class NoFlanksDetectedException(Exception):
-    def __str__(self):
-        return "No flanks detected in timeseries"
-
-
-class MustDebugThisException(Exception):
-    def __str__(self):
-        return "Should not have happened. Algorithm is wrong."
-
-
 # ------------------------------------------------------------------------------
-#  _find_first_downflank
+#  ValveRuns
 # ------------------------------------------------------------------------------
 
 
-# NOTE: Do not @njit()
-def _find_first_downflank(array: np.ndarray):
-    compare_val = array[0]
-    for idx, val in np.ndenumerate(array):
-        if val != compare_val:
-            if compare_val == 1:
-                return idx[0]
-            compare_val = 1
+class ValveRuns(NamedTuple):
+    """Run-length encoding of a `valves_stack`, as returned by
+    `encode_valve_runs()`. A run is a segment of frames in which a single valve
+    keeps its state. The valve timeseries are a closed loop, so the last run of
+    a valve may wrap around the end into the first frames. A valve that never
+    switches has a single run spanning all frames.
 
-    raise NoFlanksDetectedException
+    The runs are sorted by valve and then by start frame. All arrays have
+    shape [N_runs].
+    """
 
+    valve: np.ndarray  # Valve index
+    start: np.ndarray  # First frame of the run
+    length: np.ndarray  # Duration [number of frames]
+    state: np.ndarray  # 0: valve off, 1: valve on
+    N_frames: int
+
+
+def encode_valve_runs(valves_stack: np.ndarray) -> ValveRuns:
+    """Run-length encode the `valves_stack` [N_frames, N_valves], vectorized
+    over all valves at once."""
+    y = np.asarray(valves_stack, dtype=np.int8)
+    N_frames = y.shape[0]
+
+    # The first frame of each run, taking the periodic boundary into account
+    is_start = (y != np.roll(y, 1, axis=0)).T  # [N_valves, N_frames]
+    is_start[~is_start.any(axis=1), 0] = True  # Valves that never switch
+    valve, start = np.nonzero(is_start)
+
+    # Each run lasts until the next run of the same valve. The last run of each
+    # valve lasts until the first run of that valve, one loop later.
+    first = np.flatnonzero(np.diff(valve, prepend=-1))
+    last = np.append(first[1:], valve.size) - 1
+    next_start = np.append(start[1:], 0)
+    next_start[last] = start[first] + N_frames
+
+    return ValveRuns(
+        valve=valve,
+        start=start,
+        length=next_start - start,
+        state=y[start, valve],
+        N_frames=N_frames,
+    )
 
-# ------------------------------------------------------------------------------
-#  _detect_segments
-# ------------------------------------------------------------------------------
 
+def decode_valve_runs(runs: ValveRuns, N_valves: int) -> np.ndarray:
+    """Inverse of `encode_valve_runs()`.
 
-# NOTE: Do not @njit()
-def _detect_segments(
-    y: np.ndarray,
-) -> Tuple[
-    np.ndarray,
-    int,
-    np.ndarray,
-    np.ndarray,
-    np.ndarray,
-    np.ndarray,
-    np.ndarray,
-]:
-    """Detect continuous segments inside the valve timeseries where the valve is
-    either 'on' or 'off'. The valve timeseries are a closed loop, so we must
-    take special care to handle the periodic boundary at the start and end
-    correctly. We do a trick: We find the first downflank and roll the
-    timeseries to start at this downflank. This shifts the timeseries by
-    `t_offset`, but makes analyzing the HIGH and LOW segments way easier.
+    Returns:
+        valves_stack (np.ndarray):
+            Array shape: [N_frames, N_valves]
+    """
+    valves_stack = np.zeros((runs.N_frames, N_valves), dtype=np.int8)
 
-    Args:
-        y (np.ndarray):
-            Timeseries of a single valve as an array of 0's and 1's.
+    on = runs.state == 1
+    length = runs.length[on]
+    # Frame offset within its run of each frame of all runs
+    offset = np.arange(length.sum())
+    offset -= np.repeat(np.cumsum(length) - length, length)
+    t = (np.repeat(runs.start[on], length) + offset) % runs.N_frames
+    valves_stack[t, np.repeat(runs.valve[on], length)] = 1
 
-    Returns: (Tuple)
-        y (np.ndarray):
-            Adjusted timeseries of a single valve, rolled forward by `t_offset`.
+    return valves_stack
 
-        t_offset (int):
-            Index of the first downflank within the input timeseries.
 
-        t_upfl (np.ndarray):
-            Array of indices of detected upflanks, shifted by `t_offset`.
+def _remove_short_runs(
+    runs: ValveRuns, flip: np.ndarray, N_valves: int
+) -> ValveRuns:
+    """Invert the state of the runs marked by `flip`, merging them into their
+    neighbouring runs."""
+    runs = runs._replace(state=np.where(flip, 1 - runs.state, runs.state))
+    return encode_valve_runs(decode_valve_runs(runs, N_valves))
 
-        t_dnfl (np.ndarray):
-            Array of indices of detected downflanks, shifted by `t_offset`.
-            Zero is appended to the start of the array.
 
-        t_dnfl_star (np.ndarray):
-            Array of indices of detected downflanks, shifted by `t_offset`.
-            The 'N_frames' index is appended to the end of the array.
+# ------------------------------------------------------------------------------
+#  adjust_minimum_valve_durations()
+# ------------------------------------------------------------------------------
 
-        durations_lo (np.ndarray):
-            Array containing the duration of each 'valve off' segment. Units are
-            in number of frames.
 
-        durations_hi (np.ndarray):
-            Array containing the duration of each 'valve on' segment. Units are
-            in number of frames.
-    """
-    N_frames = y.size
-    t_offset = _find_first_downflank(y)
-    y = np.roll(y, -t_offset)
-
-    # Calculate the duration of each valve on/off segment
-    # ---------------------------------------------------
-    # upfl: upflank
-    # dnfl: downflank
-    t_upfl = np.where(np.diff(y) == 1)[0] + 1
-    t_dnfl = np.where(np.diff(y) == -1)[0] + 1
-    t_dnfl_star = np.append(t_dnfl, N_frames)
-    t_dnfl = np.append(0, t_dnfl)
-
-    # Sanity check
-    if t_upfl.size != t_dnfl.size:
-        raise MustDebugThisException
-
-    durations_lo = t_upfl - t_dnfl
-    durations_hi = t_dnfl_star - t_upfl
-
-    # Sanity check
-    if np.sum(durations_lo) + np.sum(durations_hi) != N_frames:
-        raise MustDebugThisException
-
-    return (
-        y,
-        t_offset,
-        t_upfl,
-        t_dnfl,
-        t_dnfl_star,
-        durations_lo,
-        durations_hi,
-    )
+def adjust_minimum_valve_runs(
+    runs: ValveRuns, min_valve_duration: int, N_valves: int
+) -> ValveRuns:
+    """Same as `adjust_minimum_valve_durations()`, but acting on the
+    run-length encoding of the `valves_stack`."""
+    if min_valve_duration <= 1:
+        return runs
 
+    # Evenly numbered valves remove their short 'valve on' durations first, so
+    # the merged 'valve off' durations get the final say, and vice versa.
+    for second_pass in (False, True):
+        first_state = (runs.valve % 2 == 0).astype(np.int8)
+        flip = (
+            ((runs.state == first_state) != second_pass)
+            & (runs.length < min_valve_duration)
+            & (runs.length < runs.N_frames)
+        )
+        runs = _remove_short_runs(runs, flip, N_valves)
 
-# ------------------------------------------------------------------------------
-#  adjust_minimum_valve_durations()
-# ------------------------------------------------------------------------------
+    return runs
 
 
 def adjust_minimum_valve_durations(
@@ -150,6 +135,12 @@ def adjust_minimum_valve_durations(
     This ensures that we do not deviate too much from the original transparency
     level.
 
+    Each valve first has all of its too short durations of the non-preferred
+    state removed, merging them into the neighbouring durations, and then all of
+    its remaining too short durations of the preferred state. The valve
+    timeseries are a closed loop. Operates on the run-length encoding of the
+    stack, see `encode_valve_runs()`, vectorized over all valves.
+
     Args:
         valves_stack_in (np.ndarray):
             Stack containing the boolean states of all valves as 0's and 1's.
@@ -161,7 +152,7 @@ def adjust_minimum_valve_durations(
 
         debug (bool, default=False):
             Useful for debugging. When True will show the before and after
-            timeseries plots of each valve highlighting the up- and downflanks.
+            timeseries plots of each valve.
 
     Returns: (Tuple)
         valves_stack_out (np.ndarray):
@@ -182,11 +173,13 @@ def adjust_minimum_valve_durations(
     print("Adjusting minimum valve durations...")
     tick = perf_counter()
 
-    # Allocate valves stack containing adjusted valve on/off durations
-    valves_stack_out = np.zeros(valves_stack_in.shape, dtype=np.int8)
+    runs = adjust_minimum_valve_runs(
+        encode_valve_runs(valves_stack_in), min_valve_duration, N_valves
+    )
+    valves_stack_out = decode_valve_runs(runs, N_valves)
+    alpha_valves_out = valves_stack_out.sum(1) / N_valves
 
-    # Timestamps without taking offset into account
-    t = np.arange(0, N_frames)
+    print(f"done in {perf_counter() - tick:.2f} s\n")
 
     if debug:
         fig_3 = plt.figure(3)
@@ -195,145 +188,32 @@ def adjust_minimum_valve_durations(
         fig_3.set_tight_layout(True)
         move_figure(fig_3, 500, 0)
 
-    # Walk over all valves
-    for valve_idx in np.arange(N_valves):
-        # Retrieve timeseries of single valve
-        y = valves_stack_in[:, valve_idx]
-        y_orig = np.copy(y)
-
-        (
-            y,
-            t_offset_1,
-            t_upfl,
-            t_dnfl,
-            t_dnfl_star,
-            durations_lo,
-            durations_hi,
-        ) = _detect_segments(y)
-
-        if debug:
+        t = np.arange(0, N_frames)
+        for valve_idx in np.arange(N_valves):
             plt.cla()
-            plt.step(t, y, "r", where="post", label="original")
-            plt.plot(t_dnfl, np.zeros(t_dnfl.size), "or")
-            plt.plot(t_upfl, np.ones(t_upfl.size), "or")
-            plt.title(f"A: valve {valve_idx}")
-            plt.xlabel(f"frame # + {t_offset_1}")
-            plt.ylabel("state [0 - 1]")
-            plt.xlim(0, 200)
-
-            plt.show(block=False)
-            plt.pause(0.01)
-
-        # Remove smallest segments
-        # ------------------------
-
-        if (valve_idx % 2) == 0:
-            # Remove too short 'valve on' durations
-            for k, seglen in enumerate(durations_hi):
-                if seglen < min_valve_duration:
-                    y[t_upfl[k] : t_dnfl_star[k]] = 0
-
-            (
-                y,
-                t_offset_2,
-                t_upfl,
-                t_dnfl,
-                t_dnfl_star,
-                durations_lo,
-                durations_hi,
-            ) = _detect_segments(y)
-
-            # Remove too short 'valve off' durations
-            for k, seglen in enumerate(durations_lo):
-                if seglen < min_valve_duration:
-                    y[t_dnfl[k] : t_upfl[k]] = 1
-
-            (
-                y,
-                t_offset_3,
-                t_upfl,
-                t_dnfl,
-                t_dnfl_star,
-                durations_lo,
-                durations_hi,
-            ) = _detect_segments(y)
-        else:
-            # Remove too short 'valve off' durations
-            for k, seglen in enumerate(durations_lo):
-                if seglen < min_valve_duration:
-                    y[t_dnfl[k] : t_upfl[k]] = 1
-
-            (
-                y,
-                t_offset_3,
-                t_upfl,
-                t_dnfl,
-                t_dnfl_star,
-                durations_lo,
-                durations_hi,
-            ) = _detect_segments(y)
-
-            # Remove too short 'valve on' durations
-            for k, seglen in enumerate(durations_hi):
-                if seglen < min_valve_duration:
-                    y[t_upfl[k] : t_dnfl_star[k]] = 0
-
-            (
-                y,
-                t_offset_2,
-                t_upfl,
-                t_dnfl,
-                t_dnfl_star,
-                durations_lo,
-                durations_hi,
-            ) = _detect_segments(y)
-
-        if debug:
-            t_offset = t_offset_3 + t_offset_2
             plt.step(
-                t, np.roll(y, t_offset), "k", where="post", label="adjusted"
+                t,
+                valves_stack_in[:, valve_idx],
+                "r",
+                where="post",
+                label="original",
             )
-
-            plt.show(block=False)
-            plt.pause(0.01)
-            # plt.show()
-            plt.waitforbuttonpress()
-
-        # Sanity check
-        if np.any(durations_lo < min_valve_duration) or np.any(
-            durations_hi < min_valve_duration
-        ):
-            raise MustDebugThisException
-
-        # Roll the timeseries back to its original timings
-        # ------------------------------------------------
-        t_offset = t_offset_3 + t_offset_2 + t_offset_1
-        y = np.roll(y, t_offset)
-        t_dnfl = (t_dnfl + t_offset) % N_frames
-        t_upfl = (t_upfl + t_offset) % N_frames
-
-        if debug:
-            plt.cla()
-            plt.step(t, y_orig, "r", where="post", label="original")
-            plt.step(t, y, "k", where="post", label="adjusted")
-            plt.plot(t_dnfl, np.zeros(t_dnfl.size), "ok")
-            plt.plot(t_upfl, np.ones(t_upfl.size), "ok")
-            plt.title(f"B: valve {valve_idx}")
+            plt.step(
+                t,
+                valves_stack_out[:, valve_idx],
+                "k",
+                where="post",
+                label="adjusted",
+            )
+            plt.title(f"valve {valve_idx}")
             plt.xlabel("frame #")
             plt.ylabel("state [0 - 1]")
             plt.xlim(0, 200)
 
             plt.show(block=False)
             plt.pause(0.01)
-            # plt.show()
             plt.waitforbuttonpress()
 
-        # Store adjusted timeseries
-        valves_stack_out[:, valve_idx] = y
-
-    alpha_valves_out = valves_stack_out.sum(1) / N_valves
-
-    print(f"done in {perf_counter() - tick:.2f} s\n")
     return valves_stack_out, alpha_valves_out
 
 
@@ -344,16 +224,17 @@ def adjust_minimum_valve_durations(
 
 # NOTE: Do not @njit()
 def valve_on_off_PDFs(
-    valves_stack: np.ndarray, dT_frame: float
+    valves_stack: Union[np.ndarray, ValveRuns], dT_frame: float
 ) -> Tuple[np.ndarray, np.ndarray, np.ndarray]:
     """Calculate the cumulative (i.e. taken over all valves) probability
     density functions (PDFs) of the 'valve on' and 'valve off' time durations in
     seconds.
 
     Args:
-        valves_stack (np.ndarray):
+        valves_stack (np.ndarray | ValveRuns):
             Stack containing the boolean states of all valves as 0's and 1's.
-            The array shape should be [N_frames, N_valves].
+            The array shape should be [N_frames, N_valves]. Or its run-length
+            encoding, see `encode_valve_runs()`.
 
         dT_frame (float):
             Time interval between the frames in order to transform the bin units
@@ -372,35 +253,52 @@ def valve_on_off_PDFs(
     # print("Calculating PDFs...")
     # tick = perf_counter()
 
-    N_frames, N_valves = valves_stack.shape
+    runs = valves_stack
+    if not isinstance(runs, ValveRuns):
+        runs = encode_valve_runs(runs)
+
+    N_frames = runs.N_frames
     bins = np.arange(N_frames) * dT_frame  # Bin edges including rightmost edge
 
-    # Allocate cumulative histograms
-    cumul_hist_lo = np.zeros(bins.size - 1)
-    cumul_hist_hi = np.zeros(bins.size - 1)
-
-    # Walk over all valves
-    for valve_idx in np.arange(N_valves):
-        # Retrieve timeseries of single valve
-        y = valves_stack[:, valve_idx]
-
-        (
-            y,
-            _,
-            _,
-            _,
-            _,
-            durations_lo,
-            durations_hi,
-        ) = _detect_segments(y)
-
-        hist_lo, _ = np.histogram(durations_lo * dT_frame, bins)
-        hist_hi, _ = np.histogram(durations_hi * dT_frame, bins)
-        np.add(cumul_hist_lo, hist_lo, out=cumul_hist_lo)
-        np.add(cumul_hist_hi, hist_hi, out=cumul_hist_hi)
+    # Cumulative histograms over all valves, excluding valves that never switch
+    switches = runs.length < N_frames
+    durations_lo = runs.length[switches & (runs.state == 0)]
+    durations_hi = runs.length[switches & (runs.state == 1)]
+    cumul_hist_lo, _ = np.histogram(durations_lo * dT_frame, bins)
+    cumul_hist_hi, _ = np.histogram(durations_hi * dT_frame, bins)
 
     pdf_lo = cumul_hist_lo / np.trapz(cumul_hist_lo, dx=dT_frame)
     pdf_hi = cumul_hist_hi / np.trapz(cumul_hist_hi, dx=dT_frame)
     # print(f"done in {(perf_counter() - tick):.2f} s\n")
 
     return bins[:-1], pdf_lo, pdf_hi
+
+
+# ------------------------------------------------------------------------------
+#  pdf_to_quantiles
+# ------------------------------------------------------------------------------
+
+
+def pdf_to_quantiles(bins: np.ndarray, pdf: np.ndarray, N: int = 16) -> list:
+    """Convert a PDF of valve durations as returned by `valve_on_off_PDFs()`
+    into `N` quantiles in [ms], equally spaced in probability from the shortest
+    duration to the longest. Meant for the `markov_on` and `markov_off` commands
+    of the firmware, see `MarkovGenerator.h`.
+
+    Args:
+        bins (np.ndarray):
+            The bin centers in units of [s].
+
+        pdf (np.ndarray):
+            PDF values at the bin centers.
+
+        N (int, default=16):
+            Number of quantiles, see `MARKOV_TABLE_LEN` of the firmware.
+
+    Returns:
+        List of `N` integer quantiles in [ms], in ascending order.
+    """
+    cdf = np.cumsum(pdf)
+    cdf = cdf / cdf[-1]
+    quantiles = np.interp(np.linspace(0, 1, N), cdf, bins)
+    return [int(round(q * 1e3)) for q in quantiles]
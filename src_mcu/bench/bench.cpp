@@ -0,0 +1,368 @@
+/**
+ * @file    bench.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Benchmark of the protocol hot paths, run on the host PC as the
+ * `native` PlatformIO environment:
+ *
+ *   pio run -e native -t exec
+ *
+ * A random protocol program gets generated, each line opening a random number
+ * of random valves. The following operations get timed over all of its lines,
+ * repeated several runs:
+ *
+ * - `ProtocolManager::add_line()`
+ * - `Line::pack_into()`
+ * - `PackedLine::unpack_into()`
+ * - `ProtocolManager::goto_line()`, to random line numbers
+ * - `ProtocolManager::update()`, playing back the full program
+ * - The same, with the port writes going through `PeripheralSim` at zero
+ *   latency, timing the overhead of the simulation itself
+ *
+ * The Arduino core, FastLED and the Centipede are mocked, see `bench/mock/`.
+ * Hence, the I2C and LED transmission times are not part of the timings. The
+ * absolute numbers only make sense relative to an earlier run on the same PC,
+ * to catch performance regressions before flashing the microcontroller.
+ *
+ * For that, the results can be written to a CSV file and compared against the
+ * CSV file of an earlier run, the baseline:
+ *
+ *   .pio/build/native/program [results.csv] [baseline.csv]
+ *
+ * Each row holds: Name, number of iterations, min and mean duration per line
+ * [ns] and bytes of program memory, or 0. A benchmark slower than its baseline
+ * by more than `BENCH_TOLERANCE_PCT` counts as a regression, making the exit
+ * code 2.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "CentipedeManager.h"
+#include "PeripheralSim.h"
+#include "ProtocolManager.h"
+#include "halt.h"
+#include "translations.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Number of lines of the random protocol program
+const uint16_t N_LINES = 5000;
+
+// Number of lines with a pattern of their own. The remaining lines revisit
+// these patterns, as the dictionary does not fit a fully random program.
+#if PROTOCOL_COMPRESSED == COMPRESSION_DICT
+const uint16_t N_UNIQUE_LINES = 1000;
+#else
+const uint16_t N_UNIQUE_LINES = N_LINES;
+#endif
+
+// Number of times each benchmark gets repeated
+const uint8_t N_RUNS = 20;
+
+// Tolerance [%] on the min duration of a benchmark above its baseline
+const uint8_t BENCH_TOLERANCE_PCT = 10;
+
+// Globals expected by the firmware sources, see `main.cpp`
+const uint8_t BUF_LEN = 128;
+char buf[BUF_LEN]{'\0'};
+const bool NO_PERIPHERALS = true;
+CRGB leds[N_LEDS];
+LEDCompositor led_compositor(leds);
+
+CentipedeManager cp_mgr;
+PeripheralSim peripheral_sim;
+ProtocolManager protocol_mgr(&cp_mgr);
+
+// Stand-in of the free RAM claimed at boot on the target
+static uint8_t arena_mem[128 * 1024];
+MemoryArena mem_arena;
+
+void halt(uint8_t halt_ID, const char *msg) {
+  fflush(stdout);
+  fprintf(stderr, "EXECUTION HALTED, ID: %u\n", halt_ID);
+  if (msg != NULL) {
+    fprintf(stderr, "%s\n", msg);
+  }
+  exit(1);
+}
+
+static Line lines[N_LINES];
+static PackedLine packed_lines[N_LINES];
+static uint16_t goto_line_nos[N_LINES];
+
+// Results of the benchmarks, see `bench()`
+struct BenchResult {
+  std::string name;
+  double min_ns;
+  double mean_ns;
+  uint32_t bytes;
+};
+static std::vector<BenchResult> results;
+
+/*------------------------------------------------------------------------------
+  Helpers
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Fill @p lines with random valves and durations.
+ */
+void generate_program(std::mt19937 &rng) {
+  std::array<uint8_t, N_VALVES> valves;
+  for (uint8_t idx = 0; idx < N_VALVES; ++idx) {
+    valves[idx] = idx + 1;
+  }
+
+  std::uniform_int_distribution<uint16_t> rand_N_points(0, N_VALVES);
+  std::uniform_int_distribution<uint16_t> rand_duration(1, 1000);
+  std::uniform_int_distribution<uint16_t> rand_line_no(0, N_LINES - 1);
+  std::uniform_int_distribution<uint16_t> rand_unique(0, N_UNIQUE_LINES - 1);
+
+  for (uint16_t line_no = 0; line_no < N_LINES; ++line_no) {
+    Line &line = lines[line_no];
+    line.clear_points();
+    if (line_no < N_UNIQUE_LINES) {
+      uint16_t N_points = rand_N_points(rng);
+      std::shuffle(valves.begin(), valves.end(), rng);
+      for (uint16_t idx_P = 0; idx_P < N_points; ++idx_P) {
+        line.add_point(valve2p(valves[idx_P]));
+      }
+    } else {
+      for (const P &p : lines[rand_unique(rng)]) {
+        line.add_point(p);
+      }
+    }
+#if PROTOCOL_COMPRESSED == COMPRESSION_FRAMES
+    line.duration = 50; // Constant rate
+#else
+    line.duration = rand_duration(rng);
+#endif
+
+    goto_line_nos[line_no] = rand_line_no(rng);
+  }
+}
+
+/**
+ * @brief Compare two lines irrespective of the order of their points.
+ */
+bool lines_are_equal(const Line &a, const Line &b) {
+  std::array<bool, N_VALVES + 1> open_a{false};
+  std::array<bool, N_VALVES + 1> open_b{false};
+  for (const P &p : a) {
+    open_a[p2valve(p)] = true;
+  }
+  for (const P &p : b) {
+    open_b[p2valve(p)] = true;
+  }
+  return (a.duration == b.duration) && (open_a == open_b);
+}
+
+/**
+ * @brief Time @p fun over @p N_RUNS runs and report the duration per line.
+ *
+ * @param name Name of the benchmark
+ * @param setup Gets called before each run, not part of the timing
+ * @param fun Operation over all lines to time
+ */
+template <class Setup, class Fun>
+void bench(const char *name, Setup setup, Fun fun) {
+  double min_ns = 1e30;
+  double sum_ns = 0;
+
+  for (uint8_t run = 0; run < N_RUNS; ++run) {
+    setup();
+    auto t0 = std::chrono::steady_clock::now();
+    fun();
+    auto t1 = std::chrono::steady_clock::now();
+
+    double dt_ns =
+        std::chrono::duration<double, std::nano>(t1 - t0).count() / N_LINES;
+    min_ns = std::min(min_ns, dt_ns);
+    sum_ns += dt_ns;
+  }
+
+  printf("%-14s%10.1f%10.1f\n", name, min_ns, sum_ns / N_RUNS);
+  results.push_back({name, min_ns, sum_ns / N_RUNS, 0});
+}
+
+/**
+ * @brief Write `results` as CSV to @p path, see above.
+ */
+bool write_results(const char *path) {
+  std::ofstream file(path);
+  file << "name,iterations,min_ns,mean_ns,bytes\n";
+  for (const BenchResult &result : results) {
+    file << result.name << ',' << (uint32_t)N_RUNS * N_LINES << ','
+         << result.min_ns << ',' << result.mean_ns << ',' << result.bytes
+         << '\n';
+  }
+  return file.good();
+}
+
+/**
+ * @brief Compare `results` against the baseline CSV at @p path and report each
+ * benchmark, flagging the regressions.
+ *
+ * @return The number of regressions, or -1 when the baseline can't be read.
+ */
+int compare_results(const char *path) {
+  std::ifstream file(path);
+  std::string row;
+  if (!std::getline(file, row)) { // Header
+    return -1;
+  }
+
+  printf("\n%-14s%10s%10s\n", "[ns/line]", "min", "baseline");
+  int N_regressions = 0;
+  while (std::getline(file, row)) {
+    std::istringstream fields(row);
+    std::string name, iterations, min_ns;
+    if (!std::getline(fields, name, ',') ||
+        !std::getline(fields, iterations, ',') ||
+        !std::getline(fields, min_ns, ',')) {
+      continue;
+    }
+    double base_ns = std::stod(min_ns);
+    for (const BenchResult &result : results) {
+      if (result.name == name) {
+        bool regressed =
+            result.min_ns > base_ns * (100 + BENCH_TOLERANCE_PCT) / 100;
+        N_regressions += regressed;
+        printf("%-14s%10.1f%10.1f%s\n", name.c_str(), result.min_ns, base_ns,
+               regressed ? "  REGRESSED" : "");
+      }
+    }
+  }
+  return N_regressions;
+}
+
+/*------------------------------------------------------------------------------
+  main
+------------------------------------------------------------------------------*/
+
+int main(int argc, char *argv[]) {
+  cp_mgr.begin();
+  mem_arena.begin(arena_mem, sizeof(arena_mem));
+  protocol_mgr.begin(mem_arena);
+
+  std::mt19937 rng(1);
+  generate_program(rng);
+
+  printf("PROTOCOL_PACKING    %d\n", PROTOCOL_PACKING);
+  printf("PROTOCOL_COMPRESSED %d\n", PROTOCOL_COMPRESSED);
+  printf("%u lines, %u runs\n\n", N_LINES, N_RUNS);
+  printf("%-14s%10s%10s\n", "[ns/line]", "min", "mean");
+
+  auto no_setup = [] {};
+
+  bench("add_line", [] { protocol_mgr.clear(); },
+        [] {
+          for (uint16_t line_no = 0; line_no < N_LINES; ++line_no) {
+            if (!protocol_mgr.add_line(lines[line_no])) {
+              halt(0, "Random protocol does not fit into memory.");
+            }
+          }
+        });
+  results.back().bytes = protocol_mgr.get_program().get_N_image_bytes();
+
+  bench("pack_into", no_setup, [] {
+    for (uint16_t line_no = 0; line_no < N_LINES; ++line_no) {
+      lines[line_no].pack_into(packed_lines[line_no]);
+    }
+  });
+
+  static Line unpacked;
+  bench("unpack_into", no_setup, [] {
+    for (uint16_t line_no = 0; line_no < N_LINES; ++line_no) {
+      packed_lines[line_no].unpack_into(unpacked);
+    }
+  });
+
+  bench("goto_line", no_setup, [] {
+    for (uint16_t line_no = 0; line_no < N_LINES; ++line_no) {
+      protocol_mgr.goto_line(goto_line_nos[line_no]);
+    }
+  });
+
+  // Each call to `update()` fast-forwards past the longest possible line,
+  // hence it switches to the next line every time
+  protocol_mgr.set_drift_free(false);
+  bench("playback", [] { protocol_mgr.prime_start(); },
+        [] {
+          for (uint16_t line_no = 0; line_no < N_LINES; ++line_no) {
+            mock_advance_time_us(65536000);
+            protocol_mgr.update();
+          }
+        });
+
+  // Costs zero, such that only the bookkeeping of the simulation gets timed
+  PeripheralSim::Latency latency;
+  latency.i2c_base_us = 0;
+  latency.i2c_port_us = 0;
+  latency.adc_us = 0;
+  latency.led_us = 0;
+  latency.jitter_us = 0;
+  peripheral_sim.set_latency(latency);
+  cp_mgr.set_sim(&peripheral_sim);
+  bench("playback_sim",
+        [] {
+          peripheral_sim.start(1);
+          protocol_mgr.prime_start();
+        },
+        [] {
+          for (uint16_t line_no = 0; line_no < N_LINES; ++line_no) {
+            mock_advance_time_us(65536000);
+            protocol_mgr.update();
+          }
+        });
+  peripheral_sim.stop();
+
+  // Sanity checks, such that the timings are known to be of working code
+  uint16_t N_errors = 0;
+  for (uint16_t line_no = 0; line_no < N_LINES; ++line_no) {
+    Line line;
+    packed_lines[line_no].unpack_into(line);
+    N_errors += !lines_are_equal(line, lines[line_no]);
+
+    PackedLine stored;
+    protocol_mgr.get_program().get(line_no, stored);
+    stored.unpack_into(line);
+    N_errors += !lines_are_equal(line, lines[line_no]);
+  }
+  N_errors += (protocol_mgr.get_position() != N_LINES - 1);
+
+  // The command counts checked at compile time, see `MAX_COMMANDS`
+  static CommandRegistry registry;
+  protocol_mgr.register_commands(registry);
+  cp_mgr.register_commands(registry);
+  peripheral_sim.register_commands(registry);
+  bool counts_ok = (registry.size() == ProtocolManager::N_COMMANDS +
+                                           CentipedeManager::N_COMMANDS +
+                                           PeripheralSim::N_COMMANDS);
+
+  int N_regressions = 0;
+  if ((argc > 1) && !write_results(argv[1])) {
+    fprintf(stderr, "Can't write results to %s\n", argv[1]);
+  }
+  if (argc > 2) {
+    N_regressions = compare_results(argv[2]);
+    if (N_regressions < 0) {
+      fprintf(stderr, "Can't read baseline from %s\n", argv[2]);
+      N_regressions = 0;
+    }
+  }
+
+  if (!counts_ok) {
+    printf("\nFAILED: N_COMMANDS out of date.\n");
+    return 1;
+  }
+  printf("\n%s\n", N_errors ? "FAILED: Lines got corrupted." : "OK");
+  return N_errors ? 1 : (N_regressions ? 2 : 0);
+}
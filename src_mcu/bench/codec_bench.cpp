@@ -0,0 +1,427 @@
+/**
+ * @file    codec_bench.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Benchmark of the compression format of the protocol program on a
+ * corpus of real protocol files, run on the host PC as one of the `codec_*`
+ * PlatformIO environments:
+ *
+ *   pio run -e codec_none -e codec_soa -e codec_delta -e codec_dict
+ *       -e codec_frames -t exec
+ *
+ * The format is a build flag, see `PROTOCOL_COMPRESSED` and `PROTOCOL_SOA`,
+ * hence each environment builds the benchmark for a single format. Where
+ * `bench.cpp` times a random program, the choice of format rests on how well
+ * it fits the actual protocols. The corpus defaults to all `.proto` files in
+ * `../protocols/protocols/`.
+ *
+ * For each protocol file, after packing its lines, the following get reported:
+ *
+ * - The number of bytes of the program image and per line, see
+ *   `Program::get_N_image_bytes()`
+ * - Encode: `Program::append()` over all lines, from empty [ns/line]
+ * - Decode: `Program::get()` and `PackedLine::get_cp_masks()` over all lines in
+ *   order, as during playback [ns/line]
+ * - Seek: The same, to random line numbers, as `goto_line()` does [ns/line]
+ *
+ * Each line read back gets checked against the line appended. A format unable
+ * to hold a protocol, e.g. `COMPRESSION_FRAMES` with varying line durations,
+ * gets reported as such. Like `bench.cpp`, the timings only make sense
+ * relative to another format or an earlier run on the same PC.
+ *
+ *   .pio/build/codec_delta/program [-o results.csv] [-b baseline.csv]
+ *       [file.proto ...]
+ *
+ * The results get appended to the CSV file of `-o`, such that the runs of all
+ * environments end up in a single table. Each row holds: Format, protocol
+ * file, number of lines, bytes, and min encode, decode and seek durations per
+ * line [ns]. Against the rows of the same format and file in the baseline CSV
+ * of `-b`, a program grown in bytes, or decoding or seeking slower by more than
+ * `CODEC_TOLERANCE_PCT`, counts as a regression, making the exit code 2. A
+ * failed round trip makes it 1.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "CentipedeManager.h"
+#include "PeripheralSim.h"
+#include "ProtocolManager.h"
+#include "halt.h"
+#include "translations.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Folder of the default corpus, relative to the PlatformIO project
+const char *CORPUS_DIR = "../protocols/protocols";
+
+// Number of times each benchmark gets repeated
+const uint8_t N_RUNS = 10;
+
+// Tolerance [%] on the decode and seek durations above their baseline
+const uint8_t CODEC_TOLERANCE_PCT = 10;
+
+// Raw storage of the program, ample for any format to hold the largest
+// protocol, such that the bytes in use get compared instead of the capacity
+const uint32_t POOL_BYTES = 4 * 1024 * 1024;
+
+// Name of the format under test
+#if PROTOCOL_COMPRESSED == COMPRESSION_DELTA
+const char *FORMAT_NAME = "delta";
+#elif PROTOCOL_COMPRESSED == COMPRESSION_DICT
+const char *FORMAT_NAME = "dict";
+#elif PROTOCOL_COMPRESSED == COMPRESSION_FRAMES
+const char *FORMAT_NAME = "frames";
+#elif PROTOCOL_SOA
+const char *FORMAT_NAME = "none_soa";
+#else
+const char *FORMAT_NAME = "none";
+#endif
+
+// Globals expected by the firmware sources, see `main.cpp`
+const uint8_t BUF_LEN = 128;
+char buf[BUF_LEN]{'\0'};
+const bool NO_PERIPHERALS = true;
+CRGB leds[N_LEDS];
+LEDCompositor led_compositor(leds);
+
+CentipedeManager cp_mgr;
+PeripheralSim peripheral_sim;
+ProtocolManager protocol_mgr(&cp_mgr);
+MemoryArena mem_arena;
+
+void halt(uint8_t halt_ID, const char *msg) {
+  fflush(stdout);
+  fprintf(stderr, "EXECUTION HALTED, ID: %u\n", halt_ID);
+  if (msg != NULL) {
+    fprintf(stderr, "%s\n", msg);
+  }
+  exit(1);
+}
+
+// Results of a protocol file, see above
+struct CodecResult {
+  std::string file;
+  uint32_t N_lines;
+  uint32_t bytes;
+  double encode_ns;
+  double decode_ns;
+  double seek_ns;
+};
+static std::vector<CodecResult> results;
+
+// Outcome of `bench_file()`
+enum CodecOutcome : uint8_t { CODEC_OK, CODEC_UNFIT, CODEC_CORRUPT };
+
+// Sink of the lines read back, such that the reads can't be optimized away
+static volatile uint32_t sink;
+
+/*------------------------------------------------------------------------------
+  Helpers
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Read the [DATA] section of the protocol file at @p path into
+ * @p lines, like `JettingGrid_upload.py` does. See `tools/proto_compile.cpp`
+ * to validate a protocol file line by line.
+ *
+ * @return False when it can't be read or holds a point without a valve.
+ */
+bool read_protocol(const std::string &path, std::vector<PackedLine> &lines) {
+  std::ifstream file(path);
+  std::string text;
+  bool in_data = false;
+  Line line;
+
+  lines.clear();
+  while (std::getline(file, text)) {
+    text.erase(text.find_last_not_of(" \t\r\n") + 1);
+    if (!in_data) {
+      in_data = (text == "[DATA]");
+      continue;
+    }
+    if (text.empty()) {
+      continue;
+    }
+
+    std::istringstream fields(text);
+    std::string field;
+    std::getline(fields, field, '\t');
+    line.duration = encode_duration_us(std::stod(field) * 1000 + 0.5);
+    line.clear_points();
+    line.marked = false;
+    while (std::getline(fields, field, '\t')) {
+      if (field == "M") {
+        line.marked = true;
+        continue;
+      }
+      int x, y;
+      if ((sscanf(field.c_str(), "%d,%d", &x, &y) != 2) ||
+          (x < PCS_X_MIN) || (x > PCS_X_MAX) || (y < PCS_Y_MIN) ||
+          (y > PCS_Y_MAX) || (p2valve(P(x, y)) == 0)) {
+        fprintf(stderr, "%s: Invalid point '%s'\n", path.c_str(),
+                field.c_str());
+        return false;
+      }
+      line.add_point(P(x, y));
+    }
+
+    lines.emplace_back();
+    line.pack_into(lines.back());
+  }
+  return in_data && !lines.empty();
+}
+
+/**
+ * @brief Time @p fun over @p N_RUNS runs.
+ *
+ * @param setup Gets called before each run, not part of the timing
+ * @param fun Operation over @p N_lines lines to time
+ * @return The min duration per line [ns]
+ */
+template <class Setup, class Fun>
+double bench(uint32_t N_lines, Setup setup, Fun fun) {
+  double min_ns = 1e30;
+  for (uint8_t run = 0; run < N_RUNS; ++run) {
+    setup();
+    auto t0 = std::chrono::steady_clock::now();
+    fun();
+    auto t1 = std::chrono::steady_clock::now();
+    min_ns = std::min(
+        min_ns,
+        std::chrono::duration<double, std::nano>(t1 - t0).count() / N_lines);
+  }
+  return min_ns;
+}
+
+/**
+ * @brief Benchmark the format on @p lines, see above.
+ */
+CodecOutcome bench_file(Program &program, const std::vector<PackedLine> &lines,
+                        CodecResult &result) {
+  uint16_t N_lines = lines.size();
+  bool fits = true;
+
+  result.encode_ns = bench(
+      N_lines, [&] { program.clear(); },
+      [&] {
+        for (const PackedLine &line : lines) {
+          fits &= program.append(line);
+        }
+      });
+  if (!fits || (program.size() != N_lines)) {
+    return CODEC_UNFIT;
+  }
+  result.bytes = program.get_N_image_bytes();
+
+  static PackedLine packed_line;
+  static CP_Masks masks;
+  uint32_t checksum = 0;
+
+  result.decode_ns = bench(
+      N_lines, [] {},
+      [&] {
+        for (uint16_t idx = 0; idx < N_lines; ++idx) {
+          program.get(idx, packed_line);
+          packed_line.get_cp_masks(masks);
+          checksum += masks[0];
+        }
+      });
+
+  std::vector<uint16_t> seeks(N_lines);
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<uint16_t> rand_line_no(0, N_lines - 1);
+  for (uint16_t &idx : seeks) {
+    idx = rand_line_no(rng);
+  }
+  result.seek_ns = bench(
+      N_lines, [] {},
+      [&] {
+        for (uint16_t idx : seeks) {
+          program.get(idx, packed_line);
+          packed_line.get_cp_masks(masks);
+          checksum += masks[0];
+        }
+      });
+  sink = checksum;
+
+  // Round trip, comparing the bitmasks as sent to the valves
+  CP_Masks expected;
+  for (uint16_t idx = 0; idx < N_lines; ++idx) {
+    program.get(idx, packed_line);
+    packed_line.get_cp_masks(masks);
+    lines[idx].get_cp_masks(expected);
+    if ((masks != expected) || (packed_line.duration != lines[idx].duration)) {
+      fprintf(stderr, "%s: Line %u got corrupted\n", result.file.c_str(), idx);
+      return CODEC_CORRUPT;
+    }
+  }
+  return CODEC_OK;
+}
+
+/**
+ * @brief Append `results` as CSV to @p path, see above.
+ */
+bool write_results(const char *path) {
+  bool is_new = !std::ifstream(path).good();
+  std::ofstream file(path, std::ios::app);
+  if (is_new) {
+    file << "format,file,N_lines,bytes,encode_ns,decode_ns,seek_ns\n";
+  }
+  for (const CodecResult &result : results) {
+    file << FORMAT_NAME << ',' << result.file << ',' << result.N_lines << ','
+         << result.bytes << ',' << result.encode_ns << ',' << result.decode_ns
+         << ',' << result.seek_ns << '\n';
+  }
+  return file.good();
+}
+
+/**
+ * @brief Compare `results` against the rows of the same format in the
+ * baseline CSV at @p path and report each file, flagging the regressions.
+ *
+ * @return The number of regressions, or -1 when the baseline can't be read.
+ */
+int compare_results(const char *path) {
+  std::ifstream file(path);
+  std::string row;
+  if (!std::getline(file, row)) { // Header
+    return -1;
+  }
+
+  printf("\n%-28s%10s%10s%10s%10s\n", "[baseline]", "bytes", "was",
+         "decode", "was");
+  int N_regressions = 0;
+  while (std::getline(file, row)) {
+    std::istringstream fields(row);
+    std::vector<std::string> cols;
+    std::string col;
+    while (std::getline(fields, col, ',')) {
+      cols.push_back(col);
+    }
+    if ((cols.size() < 7) || (cols[0] != FORMAT_NAME)) {
+      continue;
+    }
+
+    uint32_t base_bytes = std::stoul(cols[3]);
+    double base_decode_ns = std::stod(cols[5]);
+    double base_seek_ns = std::stod(cols[6]);
+    for (const CodecResult &result : results) {
+      if (result.file != cols[1]) {
+        continue;
+      }
+      bool regressed =
+          (result.bytes > base_bytes) ||
+          (result.decode_ns >
+           base_decode_ns * (100 + CODEC_TOLERANCE_PCT) / 100) ||
+          (result.seek_ns > base_seek_ns * (100 + CODEC_TOLERANCE_PCT) / 100);
+      N_regressions += regressed;
+      printf("%-28.28s%10lu%10lu%10.1f%10.1f%s\n", result.file.c_str(),
+             (unsigned long)result.bytes, (unsigned long)base_bytes,
+             result.decode_ns, base_decode_ns, regressed ? "  REGRESSED" : "");
+    }
+  }
+  return N_regressions;
+}
+
+/*------------------------------------------------------------------------------
+  main
+------------------------------------------------------------------------------*/
+
+int main(int argc, char *argv[]) {
+  const char *path_results = nullptr;
+  const char *path_baseline = nullptr;
+  std::vector<std::string> paths;
+
+  for (int idx = 1; idx < argc; ++idx) {
+    bool has_value = (idx + 1 < argc);
+    if ((strcmp(argv[idx], "-o") == 0) && has_value) {
+      path_results = argv[++idx];
+    } else if ((strcmp(argv[idx], "-b") == 0) && has_value) {
+      path_baseline = argv[++idx];
+    } else {
+      paths.push_back(argv[idx]);
+    }
+  }
+
+  if (paths.empty()) {
+    std::error_code err;
+    for (const auto &entry :
+         std::filesystem::directory_iterator(CORPUS_DIR, err)) {
+      if (entry.path().extension() == ".proto") {
+        paths.push_back(entry.path().string());
+      }
+    }
+    std::sort(paths.begin(), paths.end());
+  }
+  if (paths.empty()) {
+    fprintf(stderr, "No protocol files found in %s\n", CORPUS_DIR);
+    return 1;
+  }
+
+  static std::vector<uint8_t> pool(POOL_BYTES);
+  static Program program;
+  program.assign(pool.data(), pool.size());
+
+  printf("PROTOCOL_COMPRESSED %d\n", PROTOCOL_COMPRESSED);
+  printf("PROTOCOL_SOA        %d\n", PROTOCOL_SOA);
+  printf("format %s, %u runs\n\n", FORMAT_NAME, N_RUNS);
+  printf("%-28s%8s%10s%8s%10s%10s%10s\n", "[ns/line]", "lines", "bytes",
+         "B/line", "encode", "decode", "seek");
+
+  uint16_t N_errors = 0;
+  std::vector<PackedLine> lines;
+  for (const std::string &path : paths) {
+    CodecResult result{};
+    result.file = std::filesystem::path(path).filename().string();
+    if (!read_protocol(path, lines) || (lines.size() > PROTOCOL_MAX_LINES)) {
+      fprintf(stderr, "%s: Can't read the protocol\n", path.c_str());
+      N_errors++;
+      continue;
+    }
+    result.N_lines = lines.size();
+
+    CodecOutcome outcome = bench_file(program, lines, result);
+    if (outcome != CODEC_OK) {
+      if (outcome == CODEC_UNFIT) {
+        printf("%-28.28s%8lu  only the first %u lines fit this format\n",
+               result.file.c_str(), (unsigned long)result.N_lines,
+               program.size());
+      } else {
+        printf("%-28.28s%8lu  CORRUPTED\n", result.file.c_str(),
+               (unsigned long)result.N_lines);
+      }
+      N_errors += (outcome == CODEC_CORRUPT);
+      continue;
+    }
+    printf("%-28.28s%8lu%10lu%8.2f%10.1f%10.1f%10.1f\n", result.file.c_str(),
+           (unsigned long)result.N_lines, (unsigned long)result.bytes,
+           (double)result.bytes / result.N_lines, result.encode_ns,
+           result.decode_ns, result.seek_ns);
+    results.push_back(result);
+  }
+
+  int N_regressions = 0;
+  if (path_results && !write_results(path_results)) {
+    fprintf(stderr, "Can't write results to %s\n", path_results);
+  }
+  if (path_baseline) {
+    N_regressions = compare_results(path_baseline);
+    if (N_regressions < 0) {
+      fprintf(stderr, "Can't read baseline from %s\n", path_baseline);
+      N_regressions = 0;
+    }
+  }
+
+  printf("\n%s\n", N_errors ? "FAILED" : "OK");
+  return N_errors ? 1 : (N_regressions ? 2 : 0);
+}
@@ -0,0 +1,99 @@
+/**
+ * @file    Arduino.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    14-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "Arduino.h"
+
+#include <chrono>
+#include <thread>
+
+/*------------------------------------------------------------------------------
+  Time
+------------------------------------------------------------------------------*/
+
+static const auto t_start = std::chrono::steady_clock::now();
+static uint64_t time_offset_us = 0;
+
+uint32_t micros() {
+  auto dt = std::chrono::steady_clock::now() - t_start;
+  return (uint32_t)(
+      std::chrono::duration_cast<std::chrono::microseconds>(dt).count() +
+      time_offset_us);
+}
+
+uint32_t millis() {
+  auto dt = std::chrono::steady_clock::now() - t_start;
+  return (uint32_t)(
+      std::chrono::duration_cast<std::chrono::milliseconds>(dt).count() +
+      time_offset_us / 1000);
+}
+
+void delay(uint32_t ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(uint32_t us) {
+  std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+void mock_advance_time_us(uint32_t dt_us) { time_offset_us += dt_us; }
+
+/*------------------------------------------------------------------------------
+  Print
+------------------------------------------------------------------------------*/
+
+size_t Print::write(const uint8_t *data, size_t len) {
+  size_t N = 0;
+  while (N < len) {
+    N += write(data[N]);
+  }
+  return N;
+}
+
+size_t Print::print(const char *str) { return write(str); }
+
+size_t Print::print(char c) { return write((uint8_t)c); }
+
+size_t Print::print(int val, int base) { return print((long)val, base); }
+
+size_t Print::print(unsigned int val, int base) {
+  return print((unsigned long)val, base);
+}
+
+size_t Print::print(long val, int base) {
+  char str[24];
+  snprintf(str, sizeof(str), (base == HEX) ? "%lX" : "%ld", val);
+  return write(str);
+}
+
+size_t Print::print(unsigned long val, int base) {
+  char str[24];
+  snprintf(str, sizeof(str), (base == HEX) ? "%lX" : "%lu", val);
+  return write(str);
+}
+
+size_t Print::print(double val, int digits) {
+  char str[48];
+  snprintf(str, sizeof(str), "%.*f", digits, val);
+  return write(str);
+}
+
+size_t Print::println() { return write("\r\n"); }
+
+/*------------------------------------------------------------------------------
+  Serial
+------------------------------------------------------------------------------*/
+
+size_t Serial_::write(uint8_t c) { return fwrite(&c, 1, 1, stdout); }
+
+size_t Serial_::write(const uint8_t *data, size_t len) {
+  return fwrite(data, 1, len, stdout);
+}
+
+void Serial_::flush() { fflush(stdout); }
+
+Serial_ Serial;
@@ -0,0 +1,141 @@
+/**
+ * @file    Arduino.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    14-10-2026
+ *
+ * @brief   Minimal stand-in of the Arduino core for the `native` environment,
+ * covering only what the protocol code needs. See `bench/bench.cpp`.
+ *
+ * `micros()` and `millis()` follow the wall clock of the host, offset by
+ * `mock_advance_time_us()` to fast-forward through a protocol program. Serial
+ * output goes to stdout. Interrupts do not exist.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef MOCK_ARDUINO_H_
+#define MOCK_ARDUINO_H_
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARDUINO 10819
+
+typedef uint8_t byte;
+
+#define DEC 10
+#define HEX 16
+
+#define PI 3.1415926535897932384626433832795
+
+template <class A, class B> inline auto min(A a, B b) -> decltype(a + b) {
+  return (a < b) ? a : b;
+}
+
+template <class A, class B> inline auto max(A a, B b) -> decltype(a + b) {
+  return (a > b) ? a : b;
+}
+
+template <class T, class L, class H> inline T constrain(T x, L lo, H hi) {
+  return (x < lo) ? lo : ((x > hi) ? hi : x);
+}
+
+/*------------------------------------------------------------------------------
+  Time
+------------------------------------------------------------------------------*/
+
+uint32_t micros();
+uint32_t millis();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+
+/**
+ * @brief Fast-forward the `micros()` and `millis()` time track by @p dt_us.
+ */
+void mock_advance_time_us(uint32_t dt_us);
+
+/*------------------------------------------------------------------------------
+  Digital pins
+------------------------------------------------------------------------------*/
+
+#define LOW 0
+#define HIGH 1
+
+inline void digitalWrite(uint8_t, uint8_t) {}
+
+/*------------------------------------------------------------------------------
+  Interrupts
+------------------------------------------------------------------------------*/
+
+inline void noInterrupts() {}
+inline void interrupts() {}
+inline uint32_t __get_PRIMASK() { return 0; }
+inline void __set_PRIMASK(uint32_t) {}
+inline void __disable_irq() {}
+inline void __enable_irq() {}
+inline void __DMB() { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+
+/*------------------------------------------------------------------------------
+  Print, Stream and Serial
+------------------------------------------------------------------------------*/
+
+class Print {
+public:
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *data, size_t len);
+  inline size_t write(const char *str) {
+    return write((const uint8_t *)str, strlen(str));
+  }
+  inline size_t write(const char *data, size_t len) {
+    return write((const uint8_t *)data, len);
+  }
+  virtual int availableForWrite() { return 0; }
+  virtual void flush() {}
+
+  size_t print(const char *str);
+  size_t print(char c);
+  size_t print(int val, int base = DEC);
+  size_t print(unsigned int val, int base = DEC);
+  size_t print(long val, int base = DEC);
+  size_t print(unsigned long val, int base = DEC);
+  size_t print(double val, int digits = 2);
+
+  size_t println();
+  template <class T> size_t println(T val) { return print(val) + println(); }
+  template <class T> size_t println(T val, int arg) {
+    return print(val, arg) + println();
+  }
+};
+
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+};
+
+/**
+ * @brief Serial port writing to stdout, never receiving anything.
+ */
+class Serial_ : public Stream {
+public:
+  inline void begin(uint32_t) {}
+  inline operator bool() { return true; }
+  inline int available() override { return 0; }
+  inline int read() override { return -1; }
+  inline int peek() override { return -1; }
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *data, size_t len) override;
+  using Print::write;
+  inline int availableForWrite() override { return 4096; }
+  void flush() override;
+};
+
+extern Serial_ Serial;
+
+#endif
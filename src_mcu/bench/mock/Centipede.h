@@ -0,0 +1,70 @@
+/**
+ * @file    Centipede.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    14-10-2026
+ *
+ * @brief   Stand-in of the Centipede library for the `native` environment.
+ * Instead of talking I2C, the port writes are kept in memory, such that the
+ * valve outputs can be inspected.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef MOCK_CENTIPEDE_H_
+#define MOCK_CENTIPEDE_H_
+
+#include <Arduino.h>
+
+struct CSFaults {
+  uint32_t timeouts;
+  uint32_t clears;
+  uint32_t retries;
+};
+
+class Centipede {
+public:
+  inline void initialize() {}
+  inline int initializeOutputs() {
+    for (uint8_t port = 0; port < 8; ++port) {
+      outputs[port] = 0;
+    }
+    return 0;
+  }
+  inline void checkBuses() {}
+  inline void setClock(uint32_t) {}
+  inline const CSFaults &getFaults() { return faults; }
+  inline void resetFaults() { faults = CSFaults{0, 0, 0}; }
+  inline void portMode(int, int) {}
+
+  inline void portWrite(int port, int value) {
+    outputs[port] = value;
+    N_port_writes++;
+  }
+
+  inline int writePorts(const uint16_t *values, uint8_t portmask,
+                        uint32_t *skew_us = nullptr) {
+    for (uint8_t port = 0; port < 8; ++port) {
+      if (portmask & (1 << port)) {
+        portWrite(port, values[port]);
+      }
+    }
+    if (skew_us) {
+      *skew_us = 0;
+    }
+    return 0;
+  }
+
+  inline int writeAllPorts(const uint16_t *values) {
+    return writePorts(values, 0xFF);
+  }
+
+  inline int portLatchRead(int port) { return outputs[port]; }
+  inline bool portTest(int, uint16_t) { return true; }
+
+  uint16_t outputs[8] = {0}; // Last written value of each port
+  uint32_t N_port_writes = 0;
+  CSFaults faults = {0, 0, 0};
+};
+
+#endif
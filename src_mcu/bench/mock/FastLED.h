@@ -0,0 +1,45 @@
+/**
+ * @file    FastLED.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    14-10-2026
+ *
+ * @brief   Minimal stand-in of the FastLED library for the `native`
+ * environment: Only the `CRGB` pixel type, as the LED matrix gets colored but
+ * never shown.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef MOCK_FASTLED_H_
+#define MOCK_FASTLED_H_
+
+#include <Arduino.h>
+
+struct CRGB {
+  enum HTMLColorCode : uint32_t {
+    Black = 0x000000,
+    Blue = 0x0000FF,
+    Green = 0x008000,
+    Orange = 0xFFA500,
+    Red = 0xFF0000,
+    White = 0xFFFFFF,
+    Yellow = 0xFFFF00,
+  };
+
+  inline CRGB() {}
+  inline CRGB(uint8_t r_, uint8_t g_, uint8_t b_) : r(r_), g(g_), b(b_) {}
+  inline CRGB(uint32_t rgb) : r(rgb >> 16), g(rgb >> 8), b(rgb) {}
+  inline CRGB(HTMLColorCode rgb) : CRGB((uint32_t)rgb) {}
+
+  inline bool operator==(const CRGB &rhs) const {
+    return (r == rhs.r) && (g == rhs.g) && (b == rhs.b);
+  }
+  inline bool operator!=(const CRGB &rhs) const { return !(*this == rhs); }
+
+  uint8_t r = 0;
+  uint8_t g = 0;
+  uint8_t b = 0;
+};
+
+#endif
@@ -0,0 +1,18 @@
+/**
+ * @file    SPI.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    14-10-2026
+ *
+ * @brief   Empty stand-in of the SPI library for the `native` environment.
+ * Only needed because `constants.h` pulls in the R Click declarations.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef MOCK_SPI_H_
+#define MOCK_SPI_H_
+
+#include <Arduino.h>
+
+#endif
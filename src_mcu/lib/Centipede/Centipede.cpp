@@ -8,13 +8,157 @@
 #endif
 #include "Centipede.h"
 #include <Wire.h>
+#if defined(__SAMD51__)
+#  include "wiring_private.h"
+#endif
 
 uint8_t CSDataArray[2] = {0};
 
 #define CSAddress 0b0100000
 
+// Time-out of a concurrent write over both buses, after which the ports not
+// written yet count as failed
+#define CSConcurrentTimeout 2000 // [us]
+
+// Time-out of the bus to become idle before a transaction, after which the bus
+// gets cleared. A transaction takes ~60 us at 1 MHz.
+#define CSBusTimeout 200 // [us]
+
+// Number of times a failed port write gets retried
+#define CSMaxRetries 2
+
 Centipede::Centipede() {
-  // no constructor tasks yet
+  _bus[0] = &Wire;
+  _bus[1] = &Wire;
+  _faults = CSFaults{0, 0, 0};
+#if defined(__SAMD51__)
+  for (int idx = 0; idx < 2; idx++) {
+    _hw[idx] = nullptr;
+    _sda[idx] = -1;
+    _scl[idx] = -1;
+    _mux[idx] = PIO_SERCOM;
+  }
+#endif
+}
+
+#if defined(__SAMD51__)
+// Let the SERCOM release the bus and flag a bus error when SCL is held low for
+// 25 to 35 ms, instead of `Wire` waiting for it forever
+static void enableLowTimeout(Sercom *hw) {
+  SercomI2cm &i2c = hw->I2CM;
+  if (i2c.CTRLA.bit.LOWTOUTEN) {
+    return;
+  }
+  i2c.CTRLA.bit.ENABLE = 0;
+  while (i2c.SYNCBUSY.bit.ENABLE) {}
+  i2c.CTRLA.bit.LOWTOUTEN = 1;
+  i2c.CTRLA.bit.ENABLE = 1;
+  while (i2c.SYNCBUSY.bit.ENABLE) {}
+  i2c.STATUS.bit.BUSSTATE = 1; // Force idle
+  while (i2c.SYNCBUSY.bit.SYSOP) {}
+}
+
+void Centipede::setBuses(TwoWire *bus1, TwoWire *bus2, Sercom *hw1,
+                         Sercom *hw2) {
+  _bus[0] = bus1;
+  _bus[1] = bus2;
+  _hw[0] = hw1;
+  _hw[1] = (bus1 != bus2) ? hw2 : hw1;
+  for (int idx = 0; idx < 2; idx++) {
+    if (_hw[idx]) {
+      enableLowTimeout(_hw[idx]);
+    }
+  }
+}
+
+void Centipede::setBusPins(int idx, int sda, int scl, EPioType mux) {
+  _sda[idx] = sda;
+  _scl[idx] = scl;
+  _mux[idx] = mux;
+}
+
+// Free the bus from a chip holding SDA low, e.g. after having been reset
+// halfway a byte: Clock SCL until the chip has shifted out its byte and lets
+// go of SDA, then generate a STOP. Both lines are driven open-drain.
+void Centipede::clearBus(int idx) {
+  SercomI2cm &i2c = _hw[idx]->I2CM;
+  int sda = _sda[idx];
+  int scl = _scl[idx];
+
+  _faults.clears++;
+  if ((sda >= 0) && (scl >= 0)) {
+    ::pinMode(sda, INPUT);
+    ::pinMode(scl, INPUT);
+    ::digitalWrite(sda, LOW);
+    ::digitalWrite(scl, LOW);
+    for (int i = 0; (i < 9) && !::digitalRead(sda); i++) {
+      ::pinMode(scl, OUTPUT); // Low
+      delayMicroseconds(5);
+      ::pinMode(scl, INPUT); // Released high
+      delayMicroseconds(5);
+    }
+    ::pinMode(sda, OUTPUT); // STOP: SDA rising while SCL is high
+    delayMicroseconds(5);
+    ::pinMode(sda, INPUT);
+    delayMicroseconds(5);
+    pinPeripheral(sda, _mux[idx]);
+    pinPeripheral(scl, _mux[idx]);
+  }
+
+  i2c.STATUS.reg = SERCOM_I2CM_STATUS_BUSERR | SERCOM_I2CM_STATUS_ARBLOST |
+                   SERCOM_I2CM_STATUS_LOWTOUT;
+  i2c.STATUS.bit.BUSSTATE = 1; // Force idle
+  while (i2c.SYNCBUSY.bit.SYSOP) {}
+}
+#else
+void Centipede::setBuses(TwoWire *bus1, TwoWire *bus2) {
+  _bus[0] = bus1;
+  _bus[1] = bus2;
+}
+#endif
+
+// Wait for the bus of the port to be idle, or owned by us, and clear it when
+// that takes too long. Returns false when the bus stays unavailable, in which
+// case the transaction must be skipped, because `Wire` would wait for it
+// forever. Always true when the SERCOM registers of the bus are unknown.
+bool Centipede::busReady(int port) {
+#if defined(__SAMD51__)
+  int idx = busIdx(port);
+  if (!_hw[idx]) {
+    return true;
+  }
+
+  SercomI2cm &i2c = _hw[idx]->I2CM;
+  uint32_t t0 = micros();
+  while ((i2c.STATUS.bit.BUSSTATE != 1) && (i2c.STATUS.bit.BUSSTATE != 2)) {
+    if (micros() - t0 > CSBusTimeout) {
+      _faults.timeouts++;
+      clearBus(idx);
+      return (i2c.STATUS.bit.BUSSTATE == 1);
+    }
+  }
+#endif
+  return true;
+}
+
+void Centipede::setClock(uint32_t clock) {
+  for (int idx = 0; idx < 2; idx++) {
+    if ((idx == 1) && (_bus[1] == _bus[0])) {
+      break;
+    }
+    _bus[idx]->setClock(clock);
+#if defined(__SAMD51__)
+    // `setClock()` might have reset the SERCOM
+    if (_hw[idx]) {
+      enableLowTimeout(_hw[idx]);
+    }
+#endif
+  }
+}
+
+void Centipede::checkBuses() {
+  busReady(0);
+  busReady(4);
 }
 
 // Set device to default values
@@ -36,40 +180,79 @@ void Centipede::initialize() {
   }
 }
 
+// Set all chips to their default values, except with all channels set to
+// output LOW. Each chip gets its full configuration block, registers 0x00 to
+// 0x15, in a single transaction with sequential register addressing, instead
+// of a transaction per register pair. The read-only registers INTF and INTCAP
+// ignore the write. Returns the number of chips that failed to be configured.
+int Centipede::initializeOutputs() {
+
+  int failed = 0;
+
+  for (int port = 0; port < 8; port++) {
+    if (!busReady(port)) {
+      failed++;
+      continue;
+    }
+    TwoWire &wire = bus(port);
+    wire.beginTransmission(CSAddress + port);
+    wire.write((byte)0x00); // IODIRA, up to OLATB
+    for (int reg = 0x00; reg <= 0x15; reg++) {
+      wire.write((byte)0x00);
+    }
+    if (wire.endTransmission() != 0) {
+      failed++;
+    }
+  }
+
+  return failed;
+}
+
 void Centipede::WriteRegisters(int port, int startregister, int quantity) {
 
-  Wire.beginTransmission(CSAddress + port);
+  if (!busReady(port)) {
+    return;
+  }
+  TwoWire &wire = bus(port);
+  wire.beginTransmission(CSAddress + port);
 #if defined(ARDUINO) && ARDUINO >= 100
-  Wire.write((byte)startregister);
+  wire.write((byte)startregister);
   for (int i = 0; i < quantity; i++) {
-    Wire.write((byte)CSDataArray[i]);
+    wire.write((byte)CSDataArray[i]);
   }
 #else
-  Wire.send((byte)startregister);
+  wire.send((byte)startregister);
   for (int i = 0; i < quantity; i++) {
-    Wire.send((byte)CSDataArray[i]);
+    wire.send((byte)CSDataArray[i]);
   }
 #endif
 
-  Wire.endTransmission();
+  wire.endTransmission();
 }
 
 void Centipede::ReadRegisters(int port, int startregister, int quantity) {
 
-  Wire.beginTransmission(CSAddress + port);
+  if (!busReady(port)) {
+    for (int i = 0; i < quantity; i++) {
+      CSDataArray[i] = 0;
+    }
+    return;
+  }
+  TwoWire &wire = bus(port);
+  wire.beginTransmission(CSAddress + port);
 #if defined(ARDUINO) && ARDUINO >= 100
-  Wire.write((byte)startregister);
-  Wire.endTransmission();
-  Wire.requestFrom(CSAddress + port, quantity);
+  wire.write((byte)startregister);
+  wire.endTransmission();
+  wire.requestFrom(CSAddress + port, quantity);
   for (int i = 0; i < quantity; i++) {
-    CSDataArray[i] = Wire.read();
+    CSDataArray[i] = wire.read();
   }
 #else
-  Wire.send((byte)startregister);
-  Wire.endTransmission();
-  Wire.requestFrom(CSAddress + port, quantity);
+  wire.send((byte)startregister);
+  wire.endTransmission();
+  wire.requestFrom(CSAddress + port, quantity);
   for (int i = 0; i < quantity; i++) {
-    CSDataArray[i] = Wire.receive();
+    CSDataArray[i] = wire.receive();
   }
 #endif
 }
@@ -147,6 +330,170 @@ void Centipede::portWrite(int port, int value) {
   WriteRegisters(port, 0x12, 2);
 }
 
+// Write the output latches of the port in a single transaction with
+// sequential register addressing: START, address, OLATA, OLATB, STOP. Returns
+// false when the transaction failed or the bus was unavailable.
+bool Centipede::writeLatches(int port, uint16_t value) {
+
+  if (!busReady(port)) {
+    return false;
+  }
+  TwoWire &wire = bus(port);
+  wire.beginTransmission(CSAddress + port);
+  wire.write((byte)0x14); // OLATA, followed by OLATB
+  wire.write((byte)value);
+  wire.write((byte)(value >> 8));
+  return (wire.endTransmission() == 0);
+}
+
+// Write the output latches of the ports selected by the bits of `portmask`,
+// taking `values[port]`. Skips the copy through `CSDataArray`. A failed
+// transaction gets retried at most `CSMaxRetries` times. Returns the number of
+// ports that could not be written. Optionally returns via `skew_us` the time
+// between the completion of the first and the last transaction, i.e. the skew
+// between the ports.
+int Centipede::writePorts(const uint16_t *values, uint8_t portmask,
+                          uint32_t *skew_us) {
+
+  int failed = 0;
+  uint32_t t_first = 0;
+  uint32_t t_last = 0;
+  bool first = true;
+
+#if defined(__SAMD51__)
+  if ((_bus[0] != _bus[1]) && _hw[0] && _hw[1] && (portmask & 0x0F) &&
+      (portmask & 0xF0)) {
+    // A stuck bus would only time out
+    checkBuses();
+    return writePortsConcurrent(values, portmask, skew_us);
+  }
+#endif
+
+  for (int port = 0; port < 8; port++) {
+    if (!((portmask >> port) & 1)) {
+      continue;
+    }
+    for (int attempt = 0; !writeLatches(port, values[port]); attempt++) {
+      if (attempt == CSMaxRetries) {
+        failed++;
+        break;
+      }
+      _faults.retries++;
+    }
+    t_last = micros();
+    if (first) {
+      t_first = t_last;
+      first = false;
+    }
+  }
+
+  if (skew_us) {
+    *skew_us = t_last - t_first;
+  }
+
+  return failed;
+}
+
+int Centipede::writeAllPorts(const uint16_t *values) {
+  return writePorts(values, 0xFF);
+}
+
+#if defined(__SAMD51__)
+// Same as `writePorts()`, but with both boards on their own bus. The byte-level
+// I2C master operations of both SERCOMs get interleaved, such that the
+// transactions of both boards run concurrently. The `TwoWire` instances have
+// set up the SERCOMs as I2C masters already.
+int Centipede::writePortsConcurrent(const uint16_t *values, uint8_t portmask,
+                                    uint32_t *skew_us) {
+
+  struct Lane {
+    Sercom *hw;
+    uint8_t todo;     // Ports still to be written, as bitmask
+    int port;         // Port being written, -1 when none
+    uint8_t bytes[3]; // OLATA register address, OLATA, OLATB
+    uint8_t N_sent;   // Number of data bytes sent
+  } lanes[2] = {{_hw[0], (uint8_t)(portmask & 0x0F), -1, {0}, 0},
+                {_hw[1], (uint8_t)(portmask & 0xF0), -1, {0}, 0}};
+
+  int failed = 0;
+  uint32_t t_first = 0;
+  uint32_t t_last = 0;
+  bool first = true;
+  bool busy = true;
+  uint32_t t_start = micros();
+
+  while (busy) {
+    busy = false;
+    for (Lane &lane : lanes) {
+      SercomI2cm &i2c = lane.hw->I2CM;
+
+      if (lane.port < 0) {
+        if (!lane.todo) {
+          continue;
+        }
+        // Start the next transaction of this bus
+        lane.port = __builtin_ctz(lane.todo);
+        lane.todo &= lane.todo - 1;
+        lane.bytes[0] = 0x14;
+        lane.bytes[1] = values[lane.port];
+        lane.bytes[2] = values[lane.port] >> 8;
+        lane.N_sent = 0;
+        i2c.ADDR.reg = (CSAddress + lane.port) << 1; // Write
+        while (i2c.SYNCBUSY.bit.SYSOP) {}
+        busy = true;
+        continue;
+      }
+
+      busy = true;
+      uint8_t flags = i2c.INTFLAG.reg;
+      bool nack;
+      if (flags & SERCOM_I2CM_INTFLAG_ERROR) {
+        i2c.STATUS.reg = SERCOM_I2CM_STATUS_BUSERR | SERCOM_I2CM_STATUS_ARBLOST;
+        i2c.INTFLAG.reg = SERCOM_I2CM_INTFLAG_ERROR;
+        nack = true;
+      } else if (flags & SERCOM_I2CM_INTFLAG_MB) {
+        nack = i2c.STATUS.bit.RXNACK;
+      } else if (micros() - t_start > CSConcurrentTimeout) {
+        // Give up on this bus
+        _faults.timeouts++;
+        failed += 1 + __builtin_popcount(lane.todo);
+        lane.todo = 0;
+        nack = false;
+        lane.N_sent = sizeof(lane.bytes);
+      } else {
+        continue; // Transfer ongoing
+      }
+
+      if (!nack && (lane.N_sent < sizeof(lane.bytes))) {
+        i2c.DATA.reg = lane.bytes[lane.N_sent++];
+        while (i2c.SYNCBUSY.bit.SYSOP) {}
+        continue;
+      }
+
+      // Transaction done
+      if (nack) {
+        failed++;
+      }
+      i2c.CTRLB.bit.CMD = 3; // Stop
+      while (i2c.SYNCBUSY.bit.SYSOP) {}
+      lane.port = -1;
+
+      t_last = micros();
+      if (first) {
+        t_first = t_last;
+        first = false;
+      }
+    }
+  }
+
+  if (skew_us) {
+    *skew_us = t_last - t_first;
+  }
+
+  return failed;
+}
+#endif
+
 void Centipede::portInterrupts(int port, int gpintval, int defval,
                                int intconval) {
 
@@ -204,3 +551,32 @@ int Centipede::portRead(int port) {
 
   return receivedval;
 }
+
+// Read back the output latches OLATA and OLATB of the port, i.e. the levels
+// last written to its outputs, as opposed to `portRead()` reading the pins.
+int Centipede::portLatchRead(int port) {
+
+  ReadRegisters(port, 0x14, 2);
+
+  int receivedval = CSDataArray[0];
+  receivedval |= CSDataArray[1] << 8;
+
+  return receivedval;
+}
+
+// Write `pattern` to the DEFVAL registers of the port and read it back. Leaves
+// the outputs alone: DEFVAL only serves the interrupt-on-change, which stays
+// disabled. Returns true when the read-back value matches.
+bool Centipede::portTest(int port, uint16_t pattern) {
+
+  CSDataArray[0] = pattern;
+  CSDataArray[1] = pattern >> 8;
+
+  WriteRegisters(port, 0x06, 2);
+  ReadRegisters(port, 0x06, 2);
+
+  int receivedval = CSDataArray[0];
+  receivedval |= CSDataArray[1] << 8;
+
+  return (receivedval == pattern);
+}
@@ -9,12 +9,41 @@
 #else
 #  include "WProgram.h"
 #endif
+#include <Wire.h>
 
 extern uint8_t CSDataArray[2];
 
+// Counters of the I2C bus faults that have been recovered from
+struct CSFaults {
+  uint32_t timeouts; // Bus did not become idle in time
+  uint32_t clears;   // Bus-clear sequences, clocking SCL
+  uint32_t retries;  // Retried port writes
+};
+
 class Centipede {
 public:
   Centipede();
+  // Place the first board, i.e. ports 0 to 3, on I2C bus `bus1` and the
+  // second board, i.e. ports 4 to 7, on `bus2`, which both must have been
+  // started. By default both boards share `Wire`. When also given the SERCOM
+  // registers of the buses, the transactions get bounded in time and, with
+  // two separate buses, `writePorts()` drives both buses concurrently.
+#if defined(__SAMD51__)
+  void setBuses(TwoWire *bus1, TwoWire *bus2, Sercom *hw1 = nullptr,
+                Sercom *hw2 = nullptr);
+  // Allow clearing bus `idx` (0: first board, 1: second board) when a chip
+  // holds SDA low, by clocking SCL via the pins as GPIO. The pins get handed
+  // back to the SERCOM with pin function `mux` afterwards, e.g. PIO_SERCOM.
+  void setBusPins(int idx, int sda, int scl, EPioType mux);
+#else
+  void setBuses(TwoWire *bus1, TwoWire *bus2);
+#endif
+  // Set the clock rate [Hz] of both buses
+  void setClock(uint32_t clock);
+  // Check each bus and clear it when stuck
+  void checkBuses();
+  const CSFaults &getFaults() { return _faults; }
+  void resetFaults() { _faults = CSFaults{0, 0, 0}; }
   void pinMode(int pin, int mode);
   void pinPullup(int pin, int mode);
   void digitalWrite(int pin, int level);
@@ -22,15 +51,40 @@ public:
   void portMode(int port, int value);
   void portPullup(int port, int value);
   void portWrite(int port, int value);
+  int writePorts(const uint16_t *values, uint8_t portmask,
+                 uint32_t *skew_us = nullptr);
+  int writeAllPorts(const uint16_t *values);
   int portRead(int port);
+  int portLatchRead(int port);
+  bool portTest(int port, uint16_t pattern);
   void portInterrupts(int port, int gpintval, int defval, int intconval);
   int portCaptureRead(int port);
   void portIntPinConfig(int port, int drain, int polarity);
   void initialize();
+  int initializeOutputs();
   // private:
   void WriteRegisters(int port, int startregister, int quantity);
   void ReadRegisters(int port, int startregister, int quantity);
   void WriteRegisterPin(int port, int regpin, int subregister, int level);
+
+private:
+  TwoWire *_bus[2]; // I2C bus of each board
+  CSFaults _faults; // Recovered bus faults
+  inline TwoWire &bus(int port) { return *_bus[(port >> 2) & 1]; }
+  bool busReady(int port);
+  bool writeLatches(int port, uint16_t value);
+#if defined(__SAMD51__)
+  Sercom *_hw[2];   // SERCOM registers of each bus, when known
+  int _sda[2];      // SDA pin of each bus, -1 when unknown
+  int _scl[2];      // SCL pin of each bus, -1 when unknown
+  EPioType _mux[2]; // Pin function of the SDA and SCL pins of each bus
+  inline int busIdx(int port) {
+    return (_bus[0] == _bus[1]) ? 0 : (port >> 2) & 1;
+  }
+  void clearBus(int idx);
+  int writePortsConcurrent(const uint16_t *values, uint8_t portmask,
+                           uint32_t *skew_us);
+#endif
 };
 
 #endif
@@ -6,6 +6,12 @@ Edited:
 Dennis van Gils
 18-11-2021
 
+Edited:
+  - Queued transitions and a timeout per state, see the header
+
+Dennis van Gils
+15-10-2026
+
 ||
 || @file FiniteStateMachine.cpp
 || @version 1.7
@@ -106,36 +112,96 @@ const char *State::getName() { return _name; }
 // FINITE STATE MACHINE
 FiniteStateMachine::FiniteStateMachine(State &current) {
   needToTriggerEnter = true;
-  currentState = nextState = &current;
+  currentState = &current;
+  queueHead = 0;
+  queueCount = 0;
   stateChangeTime = 0;
+  timeoutCallback = 0;
+  timeoutPeriod = 0;
+  timeoutStart = 0;
+  timeoutArmed = false;
 }
 
 FiniteStateMachine &FiniteStateMachine::update() {
   // simulate a transition to the first state
   // this only happens the first time update is called
   if (needToTriggerEnter) {
+    stateChangeTime = millis();
     currentState->enter();
     needToTriggerEnter = false;
-  } else {
-    if (currentState != nextState) {
-      immediateTransitionTo(*nextState);
-    }
+    return *this;
+  }
+
+  applyQueuedTransitions();
+
+  if (timeoutArmed && (millis() - timeoutStart >= timeoutPeriod)) {
+    timeoutArmed = false;
+    timeoutCallback();
+    applyQueuedTransitions(); // Don't update a state that has timed out
+  }
+
+  if (currentState->hasUpdate()) {
     currentState->update();
   }
   return *this;
 }
 
+void FiniteStateMachine::applyQueuedTransitions() {
+  // An enter function may queue yet another transition
+  while (queueCount) {
+    State *state = queue[queueHead];
+    queueHead = (queueHead + 1) % FSM_QUEUE_LEN;
+    queueCount--;
+    immediateTransitionTo(*state);
+  }
+}
+
 FiniteStateMachine &FiniteStateMachine::transitionTo(State &state) {
-  nextState = &state;
-  stateChangeTime = millis();
+  // Ignore a request for the state that will be current anyway
+  State *last = queueCount
+                    ? queue[(queueHead + queueCount - 1) % FSM_QUEUE_LEN]
+                    : currentState;
+  if (&state == last) {
+    return *this;
+  }
+
+  if (queueCount == FSM_QUEUE_LEN) {
+    // Full: The latest request replaces the last queued one
+    queue[(queueHead + queueCount - 1) % FSM_QUEUE_LEN] = &state;
+  } else {
+    queue[(queueHead + queueCount) % FSM_QUEUE_LEN] = &state;
+    queueCount++;
+  }
   return *this;
 }
 
 FiniteStateMachine &FiniteStateMachine::immediateTransitionTo(State &state) {
   currentState->exit();
-  currentState = nextState = &state;
-  currentState->enter();
+  timeoutCallback = 0;
+  timeoutArmed = false;
+  currentState = &state;
   stateChangeTime = millis();
+  currentState->enter();
+  return *this;
+}
+
+FiniteStateMachine &FiniteStateMachine::setTimeout(unsigned long ms,
+                                                   void (*onTimeout)()) {
+  timeoutCallback = onTimeout;
+  timeoutPeriod = ms;
+  timeoutStart = millis();
+  timeoutArmed = (onTimeout != 0);
+  return *this;
+}
+
+FiniteStateMachine &FiniteStateMachine::restartTimeout() {
+  timeoutStart = millis();
+  timeoutArmed = (timeoutCallback != 0); // Also after having fired
+  return *this;
+}
+
+FiniteStateMachine &FiniteStateMachine::clearTimeout() {
+  timeoutArmed = false;
   return *this;
 }
 
@@ -151,6 +217,11 @@ boolean FiniteStateMachine::isInState(State &state) const {
   }
 }
 
+// a transition requested by `transitionTo()` awaits the next `update()`
+boolean FiniteStateMachine::isTransitionPending() const {
+  return (queueCount > 0);
+}
+
 const char *FiniteStateMachine::getCurrentStateName() {
   return currentState->_name;
 }
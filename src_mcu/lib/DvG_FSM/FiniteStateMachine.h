@@ -6,6 +6,15 @@ Edited:
 Dennis van Gils
 31-03-2023
 
+Edited:
+  - `transitionTo()` queues the transitions, to be applied in order at the
+    next `update()`. The time in the state starts counting once entered.
+  - Added a timeout per state, fired from within `update()`, see `setTimeout()`
+  - A state without an update function costs no call
+
+Dennis van Gils
+15-10-2026
+
 ||
 || @file FiniteStateMachine.h
 || @version 1.7
@@ -63,6 +72,7 @@ terry@yourduino.com
 
 #  define FSM FiniteStateMachine
 #  define STATE_NAME_LEN 64
+#  define FSM_QUEUE_LEN 4 // Transitions that can be queued per `update()`
 
 // define the functionality of the states
 class State {
@@ -83,6 +93,7 @@ public:
   void update();
   void exit();
   const char *getName();
+  boolean hasUpdate() const { return userUpdate != 0; }
 
 private:
   void (*userEnter)() = 0;
@@ -99,8 +110,16 @@ public:
   FiniteStateMachine &transitionTo(State &state);
   FiniteStateMachine &immediateTransitionTo(State &state);
 
+  // Call `onTimeout()` from within `update()` once `ms` have passed without a
+  // `restartTimeout()`. Cleared by any transition, so a state sets its own
+  // timeout in its enter function. Fires once, unless restarted again.
+  FiniteStateMachine &setTimeout(unsigned long ms, void (*onTimeout)());
+  FiniteStateMachine &restartTimeout();
+  FiniteStateMachine &clearTimeout();
+
   State &getCurrentState();
   boolean isInState(State &state) const;
+  boolean isTransitionPending() const;
   const char *getCurrentStateName();
 
   unsigned long timeInCurrentState();
@@ -108,8 +127,17 @@ public:
 private:
   bool needToTriggerEnter;
   State *currentState;
-  State *nextState;
+  State *queue[FSM_QUEUE_LEN]; // Transitions awaiting `update()`
+  uint8_t queueHead;
+  uint8_t queueCount;
   unsigned long stateChangeTime;
+
+  void (*timeoutCallback)();
+  unsigned long timeoutPeriod;
+  unsigned long timeoutStart;
+  bool timeoutArmed;
+
+  void applyQueuedTransitions();
 };
 
 #endif
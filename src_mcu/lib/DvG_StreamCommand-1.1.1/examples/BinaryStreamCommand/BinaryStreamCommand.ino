@@ -33,15 +33,16 @@ void loop() {
   } else if (bsc_available) {
     // A new command is available --> Get the number of bytes and act upon it
     uint16_t data_len = bsc.getCommandLength();
+    uint8_t *data = bsc.getCommandData();
 
     // Simply print all received bytes back to the terminal
     Serial.println("Received command bytes:");
     for (uint16_t idx = 0; idx < data_len; ++idx) {
-      Serial.print((char)bin_buf[idx]);
+      Serial.print((char)data[idx]);
       Serial.write('\t');
-      Serial.print(bin_buf[idx], DEC);
+      Serial.print(data[idx], DEC);
       Serial.write('\t');
-      Serial.println(bin_buf[idx], HEX);
+      Serial.println(data[idx], HEX);
     }
   }
 }
\ No newline at end of file
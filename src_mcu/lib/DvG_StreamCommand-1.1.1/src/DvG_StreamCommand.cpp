@@ -26,6 +26,9 @@
  * - v1.1.0
  *
  * @section Changelog
+ * - Pull in all available bytes at once in `DvG_StreamCommand::available()`
+ * - Incremental EOL matching, zero-copy hand-off and holding on to several
+ *   commands in `DvG_BinaryStreamCommand`. Added `getCommandData()`.
  * - v1.1.0 - Added method `reset()`
  * - v1.0.0 - Initial commit. This is the improved successor to
  * `DvG_SerialCommand`.
@@ -50,48 +53,60 @@ DvG_StreamCommand::DvG_StreamCommand(Stream &stream, char *buffer,
 }
 
 bool DvG_StreamCommand::available() {
-  char c;
+  if (_fTerminated) {
+    return true; // Still awaiting `getCommand()`
+  }
 
-  // Poll the input buffer of the stream for data
-  if (_stream.available()) {
-    _fTerminated = false;
-    while (_stream.available()) {
-      c = _stream.peek();
-
-      if (c == 13) {
-        // Ignore ASCII 13 (carriage return)
-        _stream.read(); // Remove char from the stream input buffer
-
-      } else if (c == 10) {
-        // Found ASCII 10 (line feed) --> Terminate string
-        _stream.read(); // Remove char from the stream input buffer
-        _buffer[_cur_len] = '\0';
-        _fTerminated = true;
-        break;
-
-      } else if (_cur_len < _max_len - 1) {
-        // Append char to string
-        _stream.read(); // Remove char from the stream input buffer
-        _buffer[_cur_len] = c;
-        _cur_len++;
-
-      } else {
-        // Maximum buffer length is reached. Forcefully terminate the string
-        // in the command buffer now. Leave the char in the stream input buffer.
-        _buffer[_cur_len] = '\0';
-        _fTerminated = true;
-        break;
+  if (_excess_pos) {
+    // Move the bytes received beyond the previous command to the front
+    _cur_len -= _excess_pos;
+    memmove(_buffer, &_buffer[_excess_pos], _cur_len);
+    _excess_pos = 0;
+  }
+
+  // Pull in all available bytes from the stream in one go, as far as they fit
+  uint16_t N_room = _max_len - 1 - _cur_len;
+  int N_avail = _stream.available();
+  if ((N_avail > 0) && (N_room > 0)) {
+    _cur_len += _stream.readBytes(&_buffer[_cur_len], min(N_avail, N_room));
+  }
+
+  // Search for ASCII 10 (line feed) in the bytes not yet scanned
+  char *LF = (char *)memchr(&_buffer[_scan_pos], 10, _cur_len - _scan_pos);
+  uint16_t cmd_len;
+  if (LF) {
+    cmd_len = LF - _buffer;
+    _excess_pos = cmd_len + 1; // Keep any subsequent bytes for the next command
+  } else if (_cur_len == _max_len - 1) {
+    // Maximum buffer length is reached. Forcefully terminate the string in the
+    // command buffer now. Leave the rest in the stream input buffer.
+    cmd_len = _cur_len;
+    _excess_pos = _cur_len;
+  } else {
+    _scan_pos = _cur_len;
+    return false;
+  }
+
+  // Ignore ASCII 13 (carriage return)
+  char *dst = (char *)memchr(_buffer, 13, cmd_len);
+  if (dst) {
+    for (char *src = dst; src < &_buffer[cmd_len]; ++src) {
+      if (*src != 13) {
+        *dst++ = *src;
       }
     }
+    cmd_len = dst - _buffer;
   }
 
-  return _fTerminated;
+  _buffer[cmd_len] = '\0';
+  _scan_pos = 0;
+  _fTerminated = true;
+  return true;
 }
 
 char *DvG_StreamCommand::getCommand() {
   if (_fTerminated) {
     _fTerminated = false;
-    _cur_len = 0;
     return _buffer;
 
   } else {
@@ -113,65 +128,93 @@ DvG_BinaryStreamCommand::DvG_BinaryStreamCommand(Stream &stream,
   _buffer = buffer;
   _max_len = max_len;
   _EOL = EOL;
-  _EOL_len = EOL_len;
+  _EOL_len = min(EOL_len, (uint8_t)DVG_BSC_MAX_EOL_LEN);
+
+  // Knuth-Morris-Pratt failure function of the EOL sentinel
+  uint8_t k = 0;
+  _fail[0] = 0;
+  for (uint8_t i = 1; i < _EOL_len; ++i) {
+    while ((k > 0) && (_EOL[i] != _EOL[k])) {
+      k = _fail[k - 1];
+    }
+    if (_EOL[i] == _EOL[k]) {
+      k++;
+    }
+    _fail[i] = k;
+  }
+
   reset();
 }
 
 int8_t DvG_BinaryStreamCommand::available(bool debug_info) {
-  uint8_t c;
-
-  // Poll the input buffer of the stream for data
-  while (_stream.available()) {
-    c = _stream.read();
-    if (debug_info) {
-      _stream.print(c, HEX);
-      _stream.write('\t');
-    }
+  if ((_N_frames == 0) && (_frame_start > 0)) {
+    // All commands have been taken by the user, so move the command being
+    // received to the front to make room
+    _cur_len -= _frame_start;
+    _scan_pos -= _frame_start;
+    memmove(_buffer, &_buffer[_frame_start], _cur_len);
+    _frame_start = 0;
+  }
+
+  // Pull in all available bytes from the stream in one go, as far as they fit
+  int N_avail = _stream.available();
+  if (N_avail > 0) {
+    uint16_t N_room = _max_len - _cur_len;
+    if (N_room > 0) {
+      uint16_t N_read = _stream.readBytes((char *)&_buffer[_cur_len],
+                                          min(N_avail, N_room));
+      if (debug_info) {
+        for (uint16_t i = _cur_len; i < _cur_len + N_read; ++i) {
+          _stream.print(_buffer[i], HEX);
+          _stream.write('\t');
+        }
+      }
+      _cur_len += N_read;
 
-    if (_cur_len < _max_len) {
-      _buffer[_cur_len] = c;
-      _cur_len++;
-    } else {
-      // Maximum buffer length is reached. Drop the byte and return the special
-      // value of -1 to signal the user.
+    } else if ((_N_frames == 0) && (_scan_pos == _cur_len)) {
+      // Maximum buffer length is reached by a single command. Drop the byte
+      // and return the special value of -1 to signal the user.
+      _stream.read();
       return -1;
     }
+  }
 
-    // Check for EOL at the end
-    if (_cur_len >= _EOL_len) {
-      _found_EOL = true;
-      for (uint8_t i = 0; i < _EOL_len; ++i) {
-        if (_buffer[_cur_len - i - 1] != _EOL[_EOL_len - i - 1]) {
-          _found_EOL = false;
-          break; // Any mismatch will exit early
-        }
-      }
-      if (_found_EOL) {
-        // Wait with reading in more bytes from the stream input buffer to let
-        // the user act upon the currently received command
-        if (debug_info) {
-          _stream.print("EOL\t");
-        }
-        break;
+  // Feed the new bytes to the EOL matcher
+  while ((_scan_pos < _cur_len) && (_N_frames < DVG_BSC_MAX_FRAMES)) {
+    uint8_t c = _buffer[_scan_pos++];
+    while ((_match_len > 0) && (c != _EOL[_match_len])) {
+      _match_len = _fail[_match_len - 1];
+    }
+    if (c == _EOL[_match_len]) {
+      _match_len++;
+    }
+
+    if (_match_len == _EOL_len) {
+      // Found EOL --> Queue the command for the user
+      uint8_t idx = (_idx_frame + _N_frames) % DVG_BSC_MAX_FRAMES;
+      _frame_starts[idx] = _frame_start;
+      _frame_lens[idx] = _scan_pos - _EOL_len - _frame_start;
+      _N_frames++;
+      _frame_start = _scan_pos;
+      _match_len = 0;
+      if (debug_info) {
+        _stream.print("EOL\t");
       }
     }
   }
 
-  return _found_EOL;
+  return (_N_frames > 0);
 }
 
 uint16_t DvG_BinaryStreamCommand::getCommandLength() {
-  uint16_t len;
-
-  if (_found_EOL) {
-    len = _cur_len - _EOL_len;
-    _found_EOL = false;
-    _cur_len = 0;
-
-  } else {
-    len = 0;
+  if (_N_frames == 0) {
+    return 0;
   }
 
+  _cmd_start = _frame_starts[_idx_frame];
+  uint16_t len = _frame_lens[_idx_frame];
+  _idx_frame = (_idx_frame + 1) % DVG_BSC_MAX_FRAMES;
+  _N_frames--;
   return len;
 }
 
@@ -24,6 +24,12 @@
  * exceeded the command buffer size. Carriage return ('\\r', ASCII 13)
  * characters are ignored from the stream.
  *
+ * All available characters are pulled in from the stream at once. Characters
+ * received beyond a complete command are kept in the command buffer for the
+ * next command. Hence, when switching over to a `DvG_BinaryStreamCommand` on
+ * the same stream, the sender must await a reply to the last ASCII command
+ * before sending binary data.
+ *
  * The command buffer is supplied by the user and must be a fixed-size character
  * array (C-string, i.e. '\0' terminated) to store incoming characters into.
  * This keeps the memory usage low and unfragmented, instead of relying on
@@ -45,8 +51,9 @@ public:
   DvG_StreamCommand(Stream &stream, char *buffer, uint16_t max_len);
 
   /**
-   * @brief Poll the stream for incoming characters and append them one-by-one
-   * to the command buffer @p buffer. This method should be called repeatedly.
+   * @brief Poll the stream for incoming characters and append them all at once
+   * to the command buffer @p buffer, as far as they fit. This method should be
+   * called repeatedly.
    *
    * @return True when a complete command has been received and is ready to be
    * returned by @ref getCommand(), false otherwise.
@@ -68,13 +75,17 @@ public:
     _fTerminated = false;
     _buffer[0] = '\0';
     _cur_len = 0;
+    _scan_pos = 0;
+    _excess_pos = 0;
   }
 
 private:
   Stream &_stream;         // Reference to the stream to listen to
   char *_buffer;           // Reference to the command buffer
   uint16_t _max_len;       // Array size of the command buffer
-  uint16_t _cur_len;       // Number of currently received command characters
+  uint16_t _cur_len;       // Number of currently received characters
+  uint16_t _scan_pos;      // Characters up to here contain no line feed
+  uint16_t _excess_pos;    // Start of the characters beyond the last command
   bool _fTerminated;       // Has a complete command been received?
   const char *_empty = ""; // Empty reply, which is just the '\0' character
 };
@@ -83,6 +94,22 @@ private:
   DvG_BinaryStreamCommand
 *******************************************************************************/
 
+/**
+ * @brief Maximum length of the end-of-line sentinel of a
+ * `DvG_BinaryStreamCommand`.
+ */
+#ifndef DVG_BSC_MAX_EOL_LEN
+#  define DVG_BSC_MAX_EOL_LEN 16
+#endif
+
+/**
+ * @brief Maximum number of completely received commands that a
+ * `DvG_BinaryStreamCommand` can hold on to, awaiting the user.
+ */
+#ifndef DVG_BSC_MAX_FRAMES
+#  define DVG_BSC_MAX_FRAMES 8
+#endif
+
 /**
  * @brief Class to manage listening to a stream, such as Serial or Wire, for
  * incoming binary commands (or binary data packets in general) and act upon
@@ -95,7 +122,13 @@ private:
  * packet that it is suffixing.
  *
  * The command buffer is supplied by the user and must be a fixed-size uint8_t
- * array to store incoming bytes into.
+ * array to store incoming bytes into. All available bytes are pulled in from
+ * the stream at once, as far as they fit. The EOL sentinel is searched for by
+ * a Knuth-Morris-Pratt matcher, keeping a constant amount of state per byte,
+ * such that every byte gets inspected only once. Up to `DVG_BSC_MAX_FRAMES`
+ * completely received commands are held on to inside the command buffer,
+ * awaiting the user. They are handed out without copying, see
+ * @ref getCommandData().
  */
 class DvG_BinaryStreamCommand {
 public:
@@ -104,20 +137,23 @@ public:
    *
    * @param stream Reference to a stream to listen to, e.g. Serial, Wire, etc.
    * @param buffer Reference to the command buffer: A fixed-size uint8_t array
-   * which will be managed by this class to hold a single incoming command.
+   * which will be managed by this class to hold the incoming commands. Make it
+   * a multiple of the longest command to be able to hold on to several
+   * commands at once.
    * @param max_len Array size of @p buffer. Do not exceed the maximum size of
    * 2^^16 = 65536 bytes.
    * @param EOL Reference to the end-of-line sentinel: A fixed-size uint8_t
    * array containing a unique sequence of bytes.
    * @param EOL_len Array size of @p EOL. Do not exceed the maximum size of
-   * 2^^8 = 256 bytes.
+   * `DVG_BSC_MAX_EOL_LEN` bytes.
    */
   DvG_BinaryStreamCommand(Stream &stream, uint8_t *buffer, uint16_t max_len,
                           const uint8_t *EOL, uint8_t EOL_len);
 
   /**
-   * @brief Poll the stream for incoming bytes and append them one-by-one to the
-   * command buffer @p buffer. This method should be called repeatedly.
+   * @brief Poll the stream for incoming bytes and append them all at once to
+   * the command buffer @p buffer, as far as they fit. This method should be
+   * called repeatedly.
    *
    * @param debug_info When true it will print debug information to @p stream
    * as a tab-delimited list of all received bytes in HEX format. WARNING:
@@ -127,21 +163,30 @@ public:
    * @return 1 (true) when a complete command has been received and its size is
    * ready to be returned by @ref getCommandLength(). Otherwise 0 (false) when
    * no complete command has been received yet, or -1 (true!) as a special value
-   * to indicate that the command buffer was overrun and that the exceeding byte
-   * got dropped.
+   * to indicate that the command buffer was overrun by a single command and
+   * that the exceeding byte got dropped.
    */
   int8_t available(bool debug_info = false);
 
   /**
-   * @brief Return the length of the command without the EOL sentinel in bytes,
-   * only when a complete command has been received. The received command can be
-   * read from the user-supplied command buffer up to this length. Otherwise, 0
-   * is returned.
+   * @brief Take the oldest completely received command and return its length
+   * without the EOL sentinel in bytes. The command can be read from
+   * @ref getCommandData() up to this length, until the next call to
+   * @ref available(). When no complete command has been received, 0 is
+   * returned.
    *
    * @return uint16_t
    */
   uint16_t getCommandLength();
 
+  /**
+   * @brief Return the pointer to the command taken by the last call to
+   * @ref getCommandLength(), pointing inside of the command buffer.
+   *
+   * @return uint8_t*
+   */
+  inline uint8_t *getCommandData() { return &_buffer[_cmd_start]; }
+
   /**
    * @brief Empty the command buffer.
    */
@@ -149,18 +194,36 @@ public:
     for (uint16_t i = 0; i < _max_len; ++i) {
       _buffer[i] = 0;
     }
-    _found_EOL = false;
     _cur_len = 0;
+    _scan_pos = 0;
+    _frame_start = 0;
+    _match_len = 0;
+    _cmd_start = 0;
+    _N_frames = 0;
+    _idx_frame = 0;
   }
 
 private:
-  Stream &_stream;     // Reference to the stream to listen to
-  uint8_t *_buffer;    // Reference to the command buffer
-  uint16_t _max_len;   // Array size of the command buffer
-  uint16_t _cur_len;   // Number of currently received command bytes
-  const uint8_t *_EOL; // Reference to the end-of-line sentinel
-  uint16_t _EOL_len;   // Array size of the end-of-line sentinel
-  bool _found_EOL;     // Has a complete command been received?
+  Stream &_stream;       // Reference to the stream to listen to
+  uint8_t *_buffer;      // Reference to the command buffer
+  uint16_t _max_len;     // Array size of the command buffer
+  uint16_t _cur_len;     // Number of currently received bytes
+  uint16_t _scan_pos;    // Bytes up to here went through the matcher
+  uint16_t _frame_start; // Start of the command being received
+  const uint8_t *_EOL;   // Reference to the end-of-line sentinel
+  uint8_t _EOL_len;      // Array size of the end-of-line sentinel
+  uint8_t _match_len;    // Number of EOL bytes matched by the latest bytes
+
+  // Knuth-Morris-Pratt failure function: Length of the longest proper prefix of
+  // `EOL[0..i]` that is also a suffix of it
+  uint8_t _fail[DVG_BSC_MAX_EOL_LEN];
+
+  // Ring of the completely received commands awaiting the user
+  uint16_t _frame_starts[DVG_BSC_MAX_FRAMES];
+  uint16_t _frame_lens[DVG_BSC_MAX_FRAMES];
+  uint8_t _N_frames;   // Number of commands awaiting the user
+  uint8_t _idx_frame;  // Ring index of the oldest command awaiting the user
+  uint16_t _cmd_start; // Start of the command taken last
 };
 
 /*******************************************************************************
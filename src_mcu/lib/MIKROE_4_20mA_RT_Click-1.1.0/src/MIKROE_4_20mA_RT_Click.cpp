@@ -43,6 +43,7 @@
  * - v1.1.0
  *
  * @section Changelog
+ * - 15-10-2026 - Added R_Click_Array, reading out several R Clicks at once
  * - v1.1.0 - Fixed SPI settings not getting initialized properly in Arduino IDE
  * - v1.0.0 - Initial release
  *
@@ -228,3 +229,55 @@ float R_Click::get_EMA_bitval() { return EMA_bitval_; }
 float R_Click::get_EMA_mA() { return bitval2mA(EMA_bitval_); }
 
 uint32_t R_Click::get_EMA_obtained_interval() { return EMA_obtained_interval_; }
+
+/*******************************************************************************
+  R_Click_Array
+*******************************************************************************/
+
+R_Click_Array::R_Click_Array(const uint8_t *CS_pins, uint8_t N) {
+  N_ = min(N, R_CLICK_ARRAY_MAX);
+  for (uint8_t i = 0; i < N_; ++i) {
+    CS_pins_[i] = CS_pins[i];
+  }
+}
+
+void R_Click_Array::set_SPI_clock(uint32_t clk_freq_Hz) {
+  SPI_clock_ = clk_freq_Hz;
+}
+
+void R_Click_Array::begin() {
+  SPI.begin();
+  for (uint8_t i = 0; i < N_; ++i) {
+    digitalWrite(CS_pins_[i], HIGH); // Disable the slave SPI device for now
+    pinMode(CS_pins_[i], OUTPUT);
+
+#if defined(ARDUINO_ARCH_SAMD)
+    const PinDescription &pin = g_APinDescription[CS_pins_[i]];
+    CS_set_[i] = &PORT->Group[pin.ulPort].OUTSET.reg;
+    CS_clr_[i] = &PORT->Group[pin.ulPort].OUTCLR.reg;
+    CS_mask_[i] = 1UL << pin.ulPin;
+#endif
+  }
+}
+
+void R_Click_Array::read_bitvals(uint16_t *bitvals) {
+  uint16_t data;
+
+  // The 16-bit transfer clocks in the high byte first, see `R_Click`
+  SPI.beginTransaction(SPISettings(SPI_clock_, MSBFIRST, SPI_MODE0));
+  for (uint8_t i = 0; i < N_; ++i) {
+#if defined(ARDUINO_ARCH_SAMD)
+    *CS_clr_[i] = CS_mask_[i]; // Enable slave device
+    data = SPI.transfer16(0xFFFF);
+    *CS_set_[i] = CS_mask_[i]; // Disable slave device
+#else
+    digitalWrite(CS_pins_[i], LOW);  // Enable slave device
+    data = SPI.transfer16(0xFFFF);
+    digitalWrite(CS_pins_[i], HIGH); // Disable slave device
+#endif
+
+    // Reconstruct bit value, 0x1FFF = b00011111 11111111
+    bitvals[i] = (data & 0x1FFF) >> 1;
+  }
+  SPI.endTransaction();
+}
@@ -267,4 +267,79 @@ private:
   uint32_t EMA_obtained_interval_; // Last obtained oversampling interval [µs]
 };
 
+/*******************************************************************************
+  R_Click_Array
+*******************************************************************************/
+
+/**
+ * @brief Maximum number of R Click Boards that can be read out together by an
+ * @ref R_Click_Array.
+ */
+const uint8_t R_CLICK_ARRAY_MAX = 8;
+
+/**
+ * @brief Class to read out several MIKROE 4-20 mA R Click Boards (MIKROE-1387)
+ * sharing the SPI bus in one go.
+ *
+ * Reading out each board by its own @ref R_Click::read_bitval() costs a full
+ * SPI transaction, two 8-bit transfers and two calls to `digitalWrite()` per
+ * board. Instead, this class reads out all boards within a single SPI
+ * transaction with a single 16-bit transfer each. On SAMD boards the cable
+ * select pins get toggled via the port registers directly. The overhead per
+ * board drops to little more than the 16 bits clocked in, leaving room for
+ * higher oversampling rates.
+ *
+ * The calibration and any averaging are left to the caller, see
+ * @ref R_Click::bitval2mA().
+ */
+class R_Click_Array {
+public:
+  /**
+   * @brief Construct a new R Click array object.
+   *
+   * @param CS_pins Array holding the cable select SPI pin of each board
+   * @param N Number of boards, at most @ref R_CLICK_ARRAY_MAX
+   */
+  R_Click_Array(const uint8_t *CS_pins, uint8_t N);
+
+  /**
+   * @brief Adjust the initially set SPI clock frequency of 1 MHz to another
+   * frequency. See @ref R_Click::set_SPI_clock().
+   *
+   * @param clk_freq_Hz The SPI clock frequency in Hz
+   */
+  void set_SPI_clock(uint32_t clk_freq_Hz);
+
+  /**
+   * @brief Start SPI and set up the cable select pins.
+   */
+  void begin();
+
+  /**
+   * @brief Read out all boards once, in order, within a single SPI
+   * transaction.
+   *
+   * @param bitvals Array to receive the bit value of each board, of at least
+   * @ref size() elements
+   */
+  void read_bitvals(uint16_t *bitvals);
+
+  /**
+   * @brief Return the number of boards.
+   */
+  uint8_t size() const { return N_; }
+
+private:
+  uint32_t SPI_clock_ = DEFAULT_RT_CLICK_SPI_CLOCK; // SPI clock frequency [Hz]
+  uint8_t N_;                                       // Number of boards
+  uint8_t CS_pins_[R_CLICK_ARRAY_MAX];              // Cable select pins
+
+#if defined(ARDUINO_ARCH_SAMD)
+  // Port registers and bit mask of each cable select pin, set in `begin()`
+  volatile uint32_t *CS_set_[R_CLICK_ARRAY_MAX];
+  volatile uint32_t *CS_clr_[R_CLICK_ARRAY_MAX];
+  uint32_t CS_mask_[R_CLICK_ARRAY_MAX];
+#endif
+};
+
 #endif
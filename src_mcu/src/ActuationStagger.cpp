@@ -0,0 +1,78 @@
+/**
+ * @file    ActuationStagger.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "ActuationStagger.h"
+#include "translations.h"
+
+/*------------------------------------------------------------------------------
+  ActuationStagger
+------------------------------------------------------------------------------*/
+
+void ActuationStagger::set(uint8_t N_steps, uint16_t spacing_us,
+                           uint8_t min_changes, StaggerOrder order) {
+  _N_steps = constrain(N_steps, 1, STAGGER_MAX_STEPS);
+  _spacing_us = (_N_steps > 1)
+                    ? min(spacing_us, STAGGER_MAX_WINDOW_US / (_N_steps - 1))
+                    : 0;
+  _min_changes = min_changes;
+  _order = order;
+}
+
+uint8_t ActuationStagger::plan(const CP_Masks &from, const CP_Masks &to,
+                               CP_Masks (&steps)[STAGGER_MAX_STEPS]) {
+  uint8_t N_changes = 0;
+  uint8_t N_ports = 0; // Number of changing ports
+  for (uint8_t port = 0; port < N_CP_PORTS; ++port) {
+    uint16_t changed = from[port] ^ to[port];
+    N_changes += __builtin_popcount(changed);
+    N_ports += (changed != 0);
+  }
+
+  uint8_t N_units = (_order == STAGGER_PORTS) ? N_ports : N_changes;
+  uint8_t N_steps = min(_N_steps, N_units);
+  if ((N_steps < 2) || (N_changes < _min_changes)) {
+    steps[0] = to;
+    return 1;
+  }
+
+  // Deal out the changes round-robin, each step toggling its own share
+  CP_Masks toggle[STAGGER_MAX_STEPS] = {};
+  uint8_t unit = 0;
+  for (uint8_t port = 0; port < N_CP_PORTS; ++port) {
+    uint16_t changed = from[port] ^ to[port];
+    if (_order == STAGGER_PORTS) {
+      if (changed) {
+        toggle[unit++ % N_steps][port] = changed;
+      }
+      continue;
+    }
+    while (changed) {
+      uint16_t lowest = changed & -changed;
+      changed &= changed - 1; // Clear lowest set bit
+      toggle[unit++ % N_steps][port] |= lowest;
+    }
+  }
+
+  // Accumulate
+  CP_Masks masks = from;
+  for (uint8_t step = 0; step < N_steps; ++step) {
+    for (uint8_t port = 0; port < N_CP_PORTS; ++port) {
+      masks[port] ^= toggle[step][port];
+    }
+    steps[step] = masks;
+  }
+
+  _N_staggered++;
+  return N_steps;
+}
+
+void ActuationStagger::print(Stream &mySerial) const {
+  snprintf(buf, BUF_LEN, "%u\t%u\t%u\t%u\t%lu\n", _N_steps, _spacing_us,
+           _min_changes, _order, (unsigned long)_N_staggered);
+  mySerial.print(buf);
+}
@@ -0,0 +1,106 @@
+/**
+ * @file    ActuationStagger.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Staggered actuation of a line switch that toggles many valves at
+ * once, spreading it over a few sub-steps within a window of at most
+ * `STAGGER_MAX_WINDOW_US`, to soften the pressure hit on the manifolds and the
+ * inrush on the solenoids.
+ *
+ * The toggling valves get dealt out round-robin over the sub-steps, either per
+ * Centipede port or per valve, and each sub-step adds its share onto the
+ * previous one, the last sub-step being the full line:
+ *   - Ports: Each sub-step writes only its own ports, costing no I2C traffic
+ *     beyond that of an unstaggered switch.
+ *   - Valves: Each sub-step toggles an equal number of valves, spread over all
+ *     ports and hence over all manifolds, at the cost of writing every
+ *     changing port each sub-step.
+ *
+ * The sub-steps get planned once per line, when staging it ahead of time, see
+ * `ProtocolManager::stage_next_line()`. The playback timer interrupt then
+ * fires them at the deadline of the line plus a multiple of the spacing. The
+ * line starts at its first sub-step on the time track, hence the window comes
+ * out of the duration of the line and does not shift the lines that follow.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef ACTUATION_STAGGER_H_
+#define ACTUATION_STAGGER_H_
+
+#include <Arduino.h>
+
+#include "CentipedeManager.h"
+
+// Largest number of sub-steps of a staggered switch
+const uint8_t STAGGER_MAX_STEPS = 8;
+
+// Largest span [µs] from the first to the last sub-step
+const uint16_t STAGGER_MAX_WINDOW_US = 2000;
+
+/**
+ * @brief How to deal out the toggling valves over the sub-steps, see above.
+ */
+enum StaggerOrder : uint8_t {
+  STAGGER_PORTS, // Per Centipede port
+  STAGGER_BITS,  // Per valve
+};
+
+/*------------------------------------------------------------------------------
+  ActuationStagger
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Class to plan the sub-steps of a staggered line switch.
+ */
+class ActuationStagger {
+public:
+  /**
+   * @brief Spread switches toggling at least @p min_changes valves over
+   * @p N_steps sub-steps, @p spacing_us apart, dealt out in @p order. The
+   * spacing gets limited to fit `STAGGER_MAX_WINDOW_US`. Fewer than 2 steps
+   * disables staggering (default).
+   */
+  void set(uint8_t N_steps, uint16_t spacing_us, uint8_t min_changes,
+           StaggerOrder order);
+
+  inline bool is_enabled() const { return _N_steps > 1; }
+  inline uint16_t get_spacing_us() const { return _spacing_us; }
+
+  /**
+   * @brief Return the largest span [µs] from the first to the last sub-step.
+   */
+  inline uint32_t get_window_us() const {
+    return (uint32_t)(_N_steps - 1) * _spacing_us;
+  }
+
+  /**
+   * @brief Plan the switch from bitmasks @p from to bitmasks @p to into
+   * @p steps, the last one being @p to.
+   *
+   * @return The number of sub-steps, 1 when not staggered.
+   */
+  uint8_t plan(const CP_Masks &from, const CP_Masks &to,
+               CP_Masks (&steps)[STAGGER_MAX_STEPS]);
+
+  /**
+   * @brief Print the settings and statistics, tab delimited:
+   *   1) Number of sub-steps, 0 or 1 when disabled
+   *   2) Spacing between the sub-steps [µs]
+   *   3) Minimum number of toggling valves to stagger
+   *   4) Order, see `StaggerOrder`
+   *   5) Number of switches staggered
+   */
+  void print(Stream &mySerial) const;
+
+private:
+  uint8_t _N_steps = 1;
+  uint16_t _spacing_us = 0;
+  uint8_t _min_changes = 0;
+  StaggerOrder _order = STAGGER_PORTS;
+  uint32_t _N_staggered = 0;
+};
+
+#endif
@@ -0,0 +1,171 @@
+/**
+ * @file    AnomalyCapture.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "AnomalyCapture.h"
+#include "translations.h"
+
+/*------------------------------------------------------------------------------
+  AnomalyCapture
+------------------------------------------------------------------------------*/
+
+void AnomalyCapture::set_window(uint32_t pre_ms, uint32_t post_ms) {
+  uint32_t N_pre = pre_ms * 1000 / _DT_us;
+  uint32_t N_post = post_ms * 1000 / _DT_us;
+
+  // Leave room for the triggering reading itself
+  _N_post = min(N_post, (uint32_t)ANOMALY_RING_LEN - 1);
+  _N_pre = min(N_pre, (uint32_t)ANOMALY_RING_LEN - 1 - _N_post);
+}
+
+void AnomalyCapture::set_triggers(int16_t low_mbar, int16_t high_mbar,
+                                  uint32_t slope_mbar_s, bool on_fault) {
+  _low_mbar = low_mbar;
+  _high_mbar = high_mbar;
+  _slope_mbar_s = slope_mbar_s;
+  _on_fault = on_fault;
+}
+
+void AnomalyCapture::arm() {
+  _head = 0;
+  _N_filled = 0;
+  _N_triggers = 0;
+  _has_prev = false;
+  _tag = AnomalyTag{};
+  _state = ANOMALY_ARMED;
+}
+
+void AnomalyCapture::disarm() {
+  _N_filled = 0;
+  _state = ANOMALY_IDLE;
+}
+
+bool AnomalyCapture::check(uint32_t t_us,
+                           const int16_t (&pres_mbar)[N_R_CLICKS],
+                           AnomalyTag &tag) const {
+  for (uint8_t ch = 0; ch < N_R_CLICKS; ++ch) {
+    int16_t p = pres_mbar[ch];
+    tag.channel = ch;
+    tag.pres_mbar = p;
+    tag.slope_mbar_s = 0;
+
+    if (p == PRESSURE_FAULT) {
+      if (_on_fault) {
+        tag.cause = ANOMALY_FAULT;
+        return true;
+      }
+      continue;
+    }
+    if (_low_mbar && (p < _low_mbar)) {
+      tag.cause = ANOMALY_LOW;
+      return true;
+    }
+    if (_high_mbar && (p > _high_mbar)) {
+      tag.cause = ANOMALY_HIGH;
+      return true;
+    }
+
+    if (_slope_mbar_s && _has_prev && (_prev_mbar[ch] != PRESSURE_FAULT) &&
+        (t_us != _prev_t_us)) {
+      int64_t slope =
+          (int64_t)(p - _prev_mbar[ch]) * 1000000 / (t_us - _prev_t_us);
+      tag.slope_mbar_s = slope;
+      if ((slope >= (int64_t)_slope_mbar_s) ||
+          (slope <= -(int64_t)_slope_mbar_s)) {
+        tag.cause = ANOMALY_SLOPE;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+bool AnomalyCapture::add(uint32_t t_us, const uint16_t (&bitval)[N_R_CLICKS],
+                         uint16_t line_pos) {
+  if (_state == ANOMALY_IDLE) {
+    return false;
+  }
+
+  int16_t pres_mbar[N_R_CLICKS];
+  for (uint8_t ch = 0; ch < N_R_CLICKS; ++ch) {
+    pres_mbar[ch] = _scales[ch].bitval2mbar(bitval[ch] << 4);
+  }
+
+  bool triggered = false;
+  AnomalyTag tag;
+  if (check(t_us, pres_mbar, tag)) {
+    _N_triggers++;
+    if (_state == ANOMALY_ARMED) {
+      tag.t_us = t_us;
+      tag.line_pos = line_pos;
+      _tag = tag;
+      _N_left = _N_post;
+      _state = ANOMALY_TRIGGERED;
+      triggered = true;
+    }
+  }
+  memcpy(_prev_mbar, pres_mbar, sizeof(_prev_mbar));
+  _prev_t_us = t_us;
+  _has_prev = true;
+
+  if (_state == ANOMALY_FROZEN) {
+    return false;
+  }
+
+  DAQ_Sample &sample = _ring[_head];
+  sample.t_us = t_us;
+  memcpy(sample.bitval, bitval, sizeof(sample.bitval));
+  _head = (_head + 1) % ANOMALY_RING_LEN;
+  if (_N_filled < ANOMALY_RING_LEN) {
+    _N_filled++;
+  }
+
+  if (!triggered && (_state == ANOMALY_TRIGGERED)) {
+    _N_left--;
+  }
+  if ((_state == ANOMALY_TRIGGERED) && (_N_left == 0)) {
+    _state = ANOMALY_FROZEN;
+  }
+  return triggered;
+}
+
+uint16_t AnomalyCapture::get_N_captured() const {
+  if (_state != ANOMALY_FROZEN) {
+    return 0;
+  }
+  return min(_N_filled, (uint16_t)(_N_pre + 1 + _N_post));
+}
+
+uint16_t AnomalyCapture::read(uint16_t from, DAQ_Sample *dst,
+                              uint16_t N) const {
+  uint16_t N_captured = get_N_captured();
+  if (from >= N_captured) {
+    return 0;
+  }
+  N = min(N, (uint16_t)(N_captured - from));
+
+  // The capture ends at the newest reading
+  uint16_t idx = (_head + ANOMALY_RING_LEN - N_captured + from) %
+                 ANOMALY_RING_LEN;
+  for (uint16_t i = 0; i < N; ++i) {
+    dst[i] = _ring[idx];
+    idx = (idx + 1) % ANOMALY_RING_LEN;
+  }
+  return N;
+}
+
+void AnomalyCapture::print(Stream &mySerial) const {
+  snprintf(buf, BUF_LEN,
+           "%u\t%lu\t%lu\t%d\t%d\t%lu\t%u\t%u\t%lu\t%u\t%u\t%u\t%d\t%ld\t%lu\n",
+           _state, (unsigned long)(_N_pre * _DT_us / 1000),
+           (unsigned long)(_N_post * _DT_us / 1000), _low_mbar, _high_mbar,
+           (unsigned long)_slope_mbar_s, _on_fault, get_N_captured(),
+           (unsigned long)_N_triggers, _tag.cause, _tag.line_pos,
+           _tag.channel, _tag.pres_mbar, (long)_tag.slope_mbar_s,
+           (unsigned long)_tag.t_us);
+  mySerial.print(buf);
+}
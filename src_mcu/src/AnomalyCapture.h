@@ -0,0 +1,207 @@
+/**
+ * @file    AnomalyCapture.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Event-triggered capture of the raw R Click readings around a
+ * pressure anomaly, e.g. a rare water hammer or a sensor dropping out during
+ * an hours-long run, without streaming the raw readings all along.
+ *
+ * While armed, each reading, as acquired at the oversampling interval
+ * `DAQ_DT`, goes into a pre-trigger ring buffer holding the last
+ * `ANOMALY_RING_LEN` readings. Each reading also gets checked against the
+ * triggers, each of which can be disabled by 0:
+ *   - Level: Any manifold pressure dropping below or rising above a band.
+ *   - Slope: Any manifold pressure changing faster than a rate, in either
+ *     direction, from one reading to the next.
+ *   - Fault: Any sensor reading out of range, see `PRESSURE_FAULT`.
+ *
+ * The first trigger gets tagged with its cause, the manifold, the pressure and
+ * the protocol line being played at the time. The capture keeps on recording
+ * for the post-trigger window and then freezes, holding the readings from the
+ * pre-trigger window up to the post-trigger window. It stays frozen until
+ * drained and re-armed by the PC, counting the further triggers meanwhile.
+ *
+ * The time resolution follows from `DAQ_DT`. For finer detail, follow up with
+ * a burst capture, see `RClickDAQ::start_burst()`.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef ANOMALY_CAPTURE_H_
+#define ANOMALY_CAPTURE_H_
+
+#include <Arduino.h>
+
+#include "PressureScale.h"
+#include "RClickDAQ.h"
+
+// Capacity of the pre-trigger ring buffer [readings]
+const uint16_t ANOMALY_RING_LEN = 512;
+
+/**
+ * @brief Cause of a trigger.
+ */
+enum AnomalyCause : uint8_t {
+  ANOMALY_NONE,  // Not triggered
+  ANOMALY_LOW,   // Pressure below the band
+  ANOMALY_HIGH,  // Pressure above the band
+  ANOMALY_SLOPE, // Pressure changing too fast
+  ANOMALY_FAULT, // Sensor reading out of range
+};
+
+/**
+ * @brief State of the capture.
+ */
+enum AnomalyState : uint8_t {
+  ANOMALY_IDLE,      // Not recording
+  ANOMALY_ARMED,     // Recording, awaiting a trigger
+  ANOMALY_TRIGGERED, // Recording the post-trigger window
+  ANOMALY_FROZEN,    // Holding the capture, awaiting to be drained
+};
+
+/**
+ * @brief The first trigger of a capture.
+ */
+struct AnomalyTag {
+  uint32_t t_us = 0;           // Time of the triggering reading [µs]
+  uint16_t line_pos = 0;       // Protocol line being played
+  AnomalyCause cause = ANOMALY_NONE;
+  uint8_t channel = 0;         // Manifold, starting at index 0
+  int16_t pres_mbar = 0;       // Pressure, or `PRESSURE_FAULT`
+  int32_t slope_mbar_s = 0;    // Rate of change [mbar/s]
+};
+
+/*------------------------------------------------------------------------------
+  AnomalyCapture
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Class to capture the raw R Click readings around a pressure anomaly.
+ */
+class AnomalyCapture {
+public:
+  /**
+   * @param DT_us Oversampling interval of the readings [µs]
+   * @param scales Pressure scale of each R Click
+   */
+  AnomalyCapture(uint32_t DT_us, const PressureScale *scales)
+      : _DT_us(DT_us), _scales(scales) {}
+
+  /**
+   * @brief Change the oversampling interval of the readings to @p DT_us
+   * [µs], e.g. at boot. The windows stay put in readings, hence call
+   * `set_window()` after.
+   */
+  inline void set_interval(uint32_t DT_us) { _DT_us = DT_us; }
+
+  /**
+   * @brief Set the pre- and post-trigger windows [ms]. Together they get
+   * limited to the capacity of the ring buffer, at the expense of the
+   * pre-trigger window. Takes effect when (re-)armed.
+   */
+  void set_window(uint32_t pre_ms, uint32_t post_ms);
+
+  /**
+   * @brief Set the triggers: the level band [@p low_mbar, @p high_mbar], the
+   * rate of change @p slope_mbar_s [mbar/s] and whether to trigger on a
+   * sensor fault. Each level or slope of 0 is disabled.
+   */
+  void set_triggers(int16_t low_mbar, int16_t high_mbar,
+                    uint32_t slope_mbar_s, bool on_fault);
+
+  /**
+   * @brief Discard any capture and start recording, awaiting a trigger.
+   */
+  void arm();
+
+  /**
+   * @brief Discard any capture and stop recording.
+   */
+  void disarm();
+
+  inline AnomalyState get_state() const { return _state; }
+  inline bool is_recording() const {
+    return (_state == ANOMALY_ARMED) || (_state == ANOMALY_TRIGGERED);
+  }
+
+  /**
+   * @brief Add a reading of all R Clicks taken at time @p t_us while playing
+   * protocol line @p line_pos.
+   *
+   * @return True once, when this reading triggered the capture.
+   */
+  bool add(uint32_t t_us, const uint16_t (&bitval)[N_R_CLICKS],
+           uint16_t line_pos);
+
+  inline const AnomalyTag &get_tag() const { return _tag; }
+
+  /**
+   * @brief Number of readings held by the frozen capture, 0 otherwise.
+   */
+  uint16_t get_N_captured() const;
+
+  /**
+   * @brief Copy at most @p N readings of the frozen capture, starting at
+   * reading @p from, oldest first, into @p dst.
+   *
+   * @return The number of copied readings.
+   */
+  uint16_t read(uint16_t from, DAQ_Sample *dst, uint16_t N) const;
+
+  /**
+   * @brief Print the settings and state, tab delimited:
+   *   1) State, see `AnomalyState`
+   *   2) Pre-trigger window [ms]
+   *   3) Post-trigger window [ms]
+   *   4) Low and high level [mbar], 0 when disabled
+   *   6) Slope [mbar/s], 0 when disabled
+   *   7) Trigger on a sensor fault?
+   *   8) Number of readings held by the frozen capture
+   *   9) Number of triggers since armed, including those while frozen
+   *  10) Cause, see `AnomalyCause`
+   *  11) Protocol line being played
+   *  12) Manifold, starting at index 0
+   *  13) Pressure [mbar]
+   *  14) Rate of change [mbar/s]
+   *  15) Time of the triggering reading [µs]
+   */
+  void print(Stream &mySerial) const;
+
+private:
+  uint32_t _DT_us;
+  const PressureScale *_scales;
+
+  // Settings
+  uint16_t _N_pre = 100; // Pre-trigger window [readings]
+  uint16_t _N_post = 50; // Post-trigger window [readings]
+  int16_t _low_mbar = 0;
+  int16_t _high_mbar = 0;
+  uint32_t _slope_mbar_s = 0;
+  bool _on_fault = false;
+
+  // State
+  AnomalyState _state = ANOMALY_IDLE;
+  DAQ_Sample _ring[ANOMALY_RING_LEN];
+  uint16_t _head = 0;     // Next slot to write
+  uint16_t _N_filled = 0; // Number of readings in the ring buffer
+  uint16_t _N_left = 0;   // Readings left to record after the trigger
+  uint32_t _N_triggers = 0;
+  AnomalyTag _tag;
+
+  // Previous reading, for the slope
+  int16_t _prev_mbar[N_R_CLICKS];
+  uint32_t _prev_t_us = 0;
+  bool _has_prev = false;
+
+  /**
+   * @brief Check the reading against the triggers.
+   *
+   * @return True when triggered, with the cause written into @p tag.
+   */
+  bool check(uint32_t t_us, const int16_t (&pres_mbar)[N_R_CLICKS],
+             AnomalyTag &tag) const;
+};
+
+#endif
@@ -0,0 +1,83 @@
+/**
+ * @file    BenchBaseline.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "BenchBaseline.h"
+#include "crc32.h"
+
+#include <stddef.h>
+
+// See `main.cpp`
+extern const uint8_t BUF_LEN; // Common character buffer for string formatting
+extern char buf[];            // Common character buffer for string formatting
+
+// Marks a valid record: "TWTB"
+const uint32_t BENCH_BASELINE_MAGIC = 0x42545754;
+
+/*------------------------------------------------------------------------------
+  BenchBaseline
+------------------------------------------------------------------------------*/
+
+bool BenchBaseline::begin(QSPIFlash *flash, uint32_t used_end) {
+  const uint32_t N_reserved =
+      WEAR_JOURNAL_SIZE + FLASH_LOG_SIZE + BENCH_BASELINE_SIZE;
+
+  _flash = flash;
+  _available = (_flash->size() >= 2 * N_reserved);
+  _start = _flash->size() - N_reserved;
+  _available &= (used_end <= _start);
+  if (!_available) {
+    return false;
+  }
+
+  Record rec;
+  _flash->read(_start, &rec, sizeof(rec));
+  if ((rec.magic == BENCH_BASELINE_MAGIC) &&
+      (rec.crc == crc32(&rec, offsetof(Record, crc))) &&
+      (rec.table.N <= PERF_BENCH_MAX_RESULTS)) {
+    perf_bench_baseline = rec.table;
+  } else {
+    perf_bench_baseline = PerfBenchTable{};
+  }
+  return true;
+}
+
+bool BenchBaseline::save(uint8_t tolerance_pct) {
+  if (!_available || (perf_bench_run.N == 0)) {
+    return false;
+  }
+
+  Record rec;
+  rec.magic = BENCH_BASELINE_MAGIC;
+  rec.table = perf_bench_run;
+  rec.table.tolerance_pct = tolerance_pct;
+  rec.crc = crc32(&rec, offsetof(Record, crc));
+
+  if (!_flash->erase_sector(_start) ||
+      !_flash->write(_start, &rec, sizeof(rec))) {
+    return false;
+  }
+  perf_bench_baseline = rec.table;
+  return true;
+}
+
+bool BenchBaseline::clear() {
+  perf_bench_baseline = PerfBenchTable{};
+  return _available && _flash->erase_sector(_start);
+}
+
+void BenchBaseline::print(Stream &mySerial) {
+  const PerfBenchTable &table = perf_bench_baseline;
+
+  snprintf(buf, BUF_LEN, "%u\t%u\n", table.N, table.tolerance_pct);
+  mySerial.print(buf);
+  for (uint8_t idx = 0; idx < table.N; ++idx) {
+    snprintf(buf, BUF_LEN, "%s\t%lu\n", table.names[idx],
+             (unsigned long)table.cycles[idx]);
+    mySerial.print(buf);
+  }
+}
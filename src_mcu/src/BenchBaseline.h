@@ -0,0 +1,94 @@
+/**
+ * @file    BenchBaseline.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Baseline of the on-target benchmark, persisted across reboots and
+ * firmware updates inside the QSPI flash of the Feather M4. After updating
+ * FastLED, the Centipede library or the compiler flags, the `bench` command
+ * then flags each workload that got slower than before, see
+ * `perf_bench_print()`.
+ *
+ * The baseline gets taken on request from the latest benchmark run, see
+ * `save()`, and loaded into `perf_bench_baseline` by `begin()`.
+ *
+ * @section Flash layout
+ * A single sector right below the `FlashLog`, kept out of reach of the
+ * `ProtocolLibrary`. It holds a single record: A magic number, the
+ * `PerfBenchTable` and a CRC32 checksum.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef BENCH_BASELINE_H_
+#define BENCH_BASELINE_H_
+
+#include "FlashLog.h"
+#include "Perf.h"
+#include "QSPIFlash.h"
+
+#include <Arduino.h>
+
+// Bytes right below the flash log holding the baseline
+const uint32_t BENCH_BASELINE_SIZE = QSPIFlash::SECTOR_SIZE;
+
+/*------------------------------------------------------------------------------
+  BenchBaseline
+------------------------------------------------------------------------------*/
+
+class BenchBaseline {
+public:
+  /**
+   * @brief Load the baseline from flash into `perf_bench_baseline`. Without a
+   * valid baseline stored, `perf_bench_baseline` is left empty.
+   *
+   * @param used_end Flash address past the stored programs, see
+   * `ProtocolLibrary::get_used_end()`. The baseline is not available when they
+   * reach into it.
+   * @return True when the flash is available. False otherwise.
+   */
+  bool begin(QSPIFlash *flash, uint32_t used_end);
+
+  inline bool available() { return _available; }
+
+  /**
+   * @brief Store the latest benchmark run, see `perf_bench_run`, as the new
+   * baseline with a tolerance of @p tolerance_pct [%]. Erasing the sector
+   * blocks for ~50 ms.
+   *
+   * @return True when successful. False otherwise, e.g. when no benchmark has
+   * run yet.
+   */
+  bool save(uint8_t tolerance_pct);
+
+  /**
+   * @brief Erase the baseline, in flash and in `perf_bench_baseline`.
+   *
+   * @return True when successful. False otherwise.
+   */
+  bool clear();
+
+  /**
+   * @brief Print the baseline. The first line holds, tab delimited: The
+   * number of workloads and the tolerance [%]. Then follows a line per
+   * workload, tab delimited: Its name and number of CPU clock cycles.
+   */
+  void print(Stream &mySerial);
+
+private:
+  struct Record {
+    uint32_t magic;
+    PerfBenchTable table;
+    uint32_t crc; // CRC32 of all of the above
+  };
+
+  static_assert(sizeof(Record) <= BENCH_BASELINE_SIZE,
+                "Benchmark baseline must fit inside its sector");
+
+  QSPIFlash *_flash = nullptr;
+  bool _available = false;
+  uint32_t _start = 0; // Flash address of the baseline
+};
+
+#endif
@@ -2,7 +2,7 @@
  * @file    CentipedeManager.cpp
  * @author  Dennis van Gils (vangils.dennis@gmail.com)
  * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
- * @date    28-11-2022
+ * @date    15-10-2026
  * @copyright MIT License. See the LICENSE file for details.
  */
 
@@ -11,7 +11,11 @@
 #pragma GCC diagnostic ignored "-Wformat-truncation"
 
 #include "CentipedeManager.h"
+#include "PeripheralSim.h"
+#include "Perf.h"
+#include "Trace.h"
 #include "halt.h"
+#include "translations.h"
 
 /*******************************************************************************
   CentipedeManager
@@ -19,13 +23,90 @@
 
 CentipedeManager::CentipedeManager() { clear_masks(); }
 
-void CentipedeManager::begin() {
-  _cp.initialize();
+void CentipedeManager::set_backend(OutputBackend *backend) {
+  wait_tx();
+  _backend = backend ? backend : &_mcp;
+  _async = false;
+  _sent_valid = false;
+}
 
-  for (uint8_t port = 0; port < N_CP_PORTS; port++) {
-    _cp.portMode(port, 0);  // Set all channels to output
-    _cp.portWrite(port, 0); // Set all channels LOW
+bool CentipedeManager::begin() {
+  _backend->set_callback(tx_done, this);
+  uint8_t N_failed = _backend->begin();
+
+  _N_tx_issued += N_CP_PORTS;
+  _N_tx_failed += N_failed;
+  _sent_masks.fill(0);
+  _sent_valid = true;
+  _async = _backend->can_write_async();
+  return (N_failed == 0);
+}
+
+#if CP_I2C_DMA && defined(__SAMD51__)
+bool CentipedeManager::begin_async(Sercom *hw1, uint8_t dmac_id1, Sercom *hw2,
+                                   uint8_t dmac_id2) {
+  if (!_mcp.begin_async(hw1, dmac_id1, hw2, dmac_id2)) {
+    return false;
   }
+  _mcp.set_callback(tx_done, this);
+  _async = uses_i2c();
+  return true;
+}
+#endif
+
+void CentipedeManager::set_async_mode(bool async) {
+  wait_tx();
+  _async = async && _backend->can_write_async();
+}
+
+void CentipedeManager::tx_done(uint32_t done_us, uint8_t N_failed,
+                               uint32_t skew_us, void *ctx) {
+  CentipedeManager *self = (CentipedeManager *)ctx;
+  self->_N_tx_failed += N_failed;
+  if (N_failed) {
+    self->_sent_valid = false; // Resend all ports with the next masks
+  }
+  self->_last_skew_us = skew_us;
+  if (skew_us > self->_max_skew_us) {
+    self->_max_skew_us = skew_us;
+  }
+  self->_tx_done_us = done_us;
+  if (self->_done_callback) {
+    self->_done_callback(done_us, self->_done_ctx);
+  }
+}
+
+bool CentipedeManager::is_simulated() const {
+  return (_sim != nullptr) && _sim->is_enabled();
+}
+
+void CentipedeManager::update() {
+  _backend->update();
+
+  if (!_verify || !_sent_valid || is_simulated() ||
+      !_backend->can_read_back() ||
+      (millis() - _tick_verify < CP_VERIFY_INTERVAL)) {
+    return;
+  }
+  _tick_verify = millis();
+
+  // Keep the interrupts from sending out new bitmasks halfway
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  uint16_t latched;
+  uint8_t port = _verify_port;
+  if (!_backend->is_busy() && _backend->read_port(port, latched)) {
+    _verify_port = (port + 1) % N_CP_PORTS;
+    _N_verified++;
+    if (latched != _sent_masks[port]) {
+      _N_mismatches++;
+      trace(TRACE_CP_MISMATCH, port,
+            ((uint32_t)latched << 16) | _sent_masks[port]);
+      _N_tx_issued++;
+      _N_tx_failed += _backend->write_ports(_sent_masks.data(), 1U << port);
+    }
+  }
+  __set_PRIMASK(primask);
 }
 
 void CentipedeManager::add_to_masks(CP_Address cp_addr) {
@@ -36,15 +117,49 @@ void CentipedeManager::add_to_masks(CP_Address cp_addr) {
              cp_addr.port);
     halt(7, buf);
   }
-  _masks[cp_addr.port] |= (1U << cp_addr.bit);
+
+  uint16_t bit = 1U << cp_addr.bit;
+  if (_masks[cp_addr.port] & bit) {
+    return; // Already open
+  }
+
+  _masks[cp_addr.port] |= bit;
+  _N_open++;
+
+  uint8_t valve = CP2VALVE[cp_addr.port][cp_addr.bit];
+  if (valve > 0) {
+    _N_open_manifold[(valve - 1) / (N_VALVES / N_MANIFOLDS)]++;
+  }
+}
+
+void CentipedeManager::clear_masks() {
+  _masks.fill(0);
+  _N_open = 0;
+  for (uint8_t idx = 0; idx < N_MANIFOLDS; idx++) {
+    _N_open_manifold[idx] = 0;
+  }
 }
 
-bool CentipedeManager::all_masks_are_zero() {
-  bool all_zero = true;
+void CentipedeManager::set_masks(CP_Masks in) {
+  _masks = in;
+  count_open();
+}
+
+void CentipedeManager::count_open() {
+  uint8_t N_open = 0;
   for (uint8_t port = 0; port < N_CP_PORTS; port++) {
-    all_zero &= (_masks[port] == 0);
+    N_open += __builtin_popcount(_masks[port]);
+  }
+  _N_open = N_open;
+
+  for (uint8_t idx = 0; idx < N_MANIFOLDS; idx++) {
+    const CP_Masks &manifold = MANIFOLD2CP_MASKS[idx];
+    N_open = 0;
+    for (uint8_t port = 0; port < N_CP_PORTS; port++) {
+      N_open += __builtin_popcount(_masks[port] & manifold[port]);
+    }
+    _N_open_manifold[idx] = N_open;
   }
-  return all_zero;
 }
 
 void CentipedeManager::report_masks(Stream &mySerial) {
@@ -56,8 +171,251 @@ void CentipedeManager::report_masks(Stream &mySerial) {
   mySerial.print(buf);
 }
 
-void CentipedeManager::send_masks() {
+void CentipedeManager::report_tx_stats(Stream &mySerial) {
+  snprintf(buf, BUF_LEN, "%lu\t%lu\t%lu\n", (unsigned long)_N_tx_issued,
+           (unsigned long)_N_tx_skipped, (unsigned long)_N_tx_failed);
+  mySerial.print(buf);
+}
+
+void CentipedeManager::send_masks(bool force) {
+  PERF_SCOPE(perf_in_isr() ? PERF_SEND_MASKS_ISR : PERF_SEND_MASKS);
+  uint8_t portmask = 0; // Ports to be written to
+  uint8_t N_failed = 0;
+  force |= !_sent_valid;
+
+  if (_marker_port >= 0) {
+    // Flip the marker output with respect to what got sent last
+    uint16_t &mask = _masks[_marker_port];
+    mask = (mask & ~_marker_mask) | (~_sent_masks[_marker_port] & _marker_mask);
+  }
+
   for (uint8_t port = 0; port < N_CP_PORTS; port++) {
-    _cp.portWrite(port, _masks[port]);
+    if (force || (_masks[port] != _sent_masks[port])) {
+      portmask |= (1U << port);
+      _N_tx_issued++;
+    } else {
+      _N_tx_skipped++;
+    }
+  }
+
+  if (is_simulated()) {
+    _tx_done_us = _sim->write_ports(_masks.data(), portmask, _last_skew_us);
+    if (_last_skew_us > _max_skew_us) {
+      _max_skew_us = _last_skew_us;
+    }
+  } else if (_async) {
+    // The statistics and completion time follow in `tx_done()`
+    _backend->write_ports_async(_masks.data(), portmask);
+  } else if (portmask) {
+    if (_sync) {
+      // Prevent other interrupts from stretching the burst. Restore the
+      // previous state, because we might be called from an interrupt.
+      uint32_t primask = __get_PRIMASK();
+      __disable_irq();
+      N_failed =
+          _backend->write_ports(_masks.data(), portmask, &_last_skew_us);
+      __set_PRIMASK(primask);
+    } else {
+      N_failed =
+          _backend->write_ports(_masks.data(), portmask, &_last_skew_us);
+    }
+    _N_tx_failed += N_failed;
+    if (_last_skew_us > _max_skew_us) {
+      _max_skew_us = _last_skew_us;
+    }
+  }
+  if (!_backend->is_busy() && !is_simulated()) {
+    _tx_done_us = micros(); // Written already, or nothing to write
   }
+  _sent_masks = _masks;
+  // A NACKed port may hold other outputs than the shadow copy claims. Force
+  // a full resend next time, like `close_all_now()` does.
+  _sent_valid = (N_failed == 0);
+  _valve_stats.update(_masks.data(), millis());
+}
+
+CP_Masks CentipedeManager::get_sent_masks() {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  CP_Masks masks = _sent_masks;
+  __set_PRIMASK(primask);
+  return masks;
+}
+
+bool CentipedeManager::outputs_closed() {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  bool closed = _sent_valid;
+  for (uint8_t port = 0; port < N_CP_PORTS; port++) {
+    closed &= (_sent_masks[port] == 0);
+  }
+  __set_PRIMASK(primask);
+  return closed;
+}
+
+uint8_t CentipedeManager::close_all_now() {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  _backend->abort();
+  clear_masks();
+  uint8_t N_failed = _backend->write_ports(_masks.data(), CP_ALL_PORTS);
+  if (is_simulated()) {
+    uint32_t skew_us;
+    _sim->write_ports(_masks.data(), (1U << N_CP_PORTS) - 1, skew_us);
+  }
+  _N_tx_issued += N_CP_PORTS;
+  _N_tx_failed += N_failed;
+  _sent_masks = _masks;
+  _sent_valid = (N_failed == 0);
+  _valve_stats.update(_masks.data(), millis());
+  __set_PRIMASK(primask);
+  return N_failed;
+}
+
+void CentipedeManager::reset_valve_stats() {
+  // Keep the interrupts from sending out new bitmasks meanwhile
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  _valve_stats.reset(_sent_masks.data(), millis());
+  __set_PRIMASK(primask);
+}
+
+void CentipedeManager::report_skew(Stream &mySerial) {
+  snprintf(buf, BUF_LEN, "%lu\t%lu\n", (unsigned long)_last_skew_us,
+           (unsigned long)_max_skew_us);
+  mySerial.print(buf);
+}
+
+void CentipedeManager::report_verify(Stream &mySerial) {
+  snprintf(buf, BUF_LEN, "%lu\t%lu\n", (unsigned long)_N_verified,
+           (unsigned long)_N_mismatches);
+  mySerial.print(buf);
+}
+
+bool CentipedeManager::calibrate_clock() {
+  if (!uses_i2c()) {
+    return false;
+  }
+  wait_tx();
+  return _mcp.calibrate_clock(_sent_masks.data());
+}
+
+void CentipedeManager::register_commands(CommandRegistry &registry) {
+  // Report the hardware driving the outputs, see `OutputBackend.h`
+  registry.add("output?", this, [](const char *, void *cp_mgr) {
+    Serial.println(((CentipedeManager *)cp_mgr)->get_backend().get_name());
+  });
+
+  // Report the number of Centipede port transactions, tab delimited:
+  //   1) Issued
+  //   2) Skipped, because the port bitmask was unchanged
+  //   3) Failed, i.e. not acknowledged
+  registry.add("i2c?", this, [](const char *, void *cp_mgr) {
+    ((CentipedeManager *)cp_mgr)->report_tx_stats(Serial);
+  });
+
+  // Reset the counters of the Centipede port transactions
+  registry.add("i2c_reset", this, [](const char *, void *cp_mgr) {
+    ((CentipedeManager *)cp_mgr)->reset_tx_stats();
+  });
+
+  // Report the recovered I2C bus faults, tab delimited:
+  //   1) Bus did not become idle in time
+  //   2) Bus got cleared by clocking SCL
+  //   3) Port write got retried
+  registry.add("i2c_faults?", this, [](const char *, void *cp_mgr) {
+    ((CentipedeManager *)cp_mgr)->report_faults(Serial);
+  });
+
+  registry.add("i2c_faults_reset", this, [](const char *, void *cp_mgr) {
+    ((CentipedeManager *)cp_mgr)->reset_faults();
+  });
+
+  // Report the I2C clock rate, tab delimited:
+  //   1) Clock rate [Hz]
+  //   2) Duration of a full update of all ports [µs], 0 when not measured
+  registry.add("i2c_clock?", this, [](const char *, void *cp_mgr) {
+    ((CentipedeManager *)cp_mgr)->report_clock(Serial);
+  });
+
+  // Report the skew between the first and the last changed Centipede port,
+  // tab delimited:
+  //   1) Skew of the last update [µs]
+  //   2) Largest skew encountered [µs]
+  registry.add("skew?", this, [](const char *, void *cp_mgr) {
+    ((CentipedeManager *)cp_mgr)->report_skew(Serial);
+  });
+
+  registry.add("skew_reset", this, [](const char *, void *cp_mgr) {
+    ((CentipedeManager *)cp_mgr)->reset_skew();
+  });
+
+  // Write all Centipede ports in a single burst, interrupts disabled
+  registry.add("sync_on", this, [](const char *, void *cp_mgr) {
+    ((CentipedeManager *)cp_mgr)->set_sync_mode(true);
+  });
+
+  // Write the Centipede ports with interrupts enabled
+  registry.add("sync_off", this, [](const char *, void *cp_mgr) {
+    ((CentipedeManager *)cp_mgr)->set_sync_mode(false);
+  });
+
+  // Report the verification of the output latches, tab delimited:
+  //   1) Number of verified ports
+  //   2) Number of mismatches found, and corrected
+  registry.add("verify?", this, [](const char *, void *cp_mgr) {
+    ((CentipedeManager *)cp_mgr)->report_verify(Serial);
+  });
+
+  registry.add("verify_reset", this, [](const char *, void *cp_mgr) {
+    ((CentipedeManager *)cp_mgr)->reset_verify();
+  });
+
+  // Read back the output latches in the background
+  registry.add("verify_on", this, [](const char *, void *cp_mgr) {
+    ((CentipedeManager *)cp_mgr)->set_verify(true);
+  });
+
+  registry.add("verify_off", this, [](const char *, void *cp_mgr) {
+    ((CentipedeManager *)cp_mgr)->set_verify(false);
+  });
+
+  // Write the Centipede ports in the background via DMA, when available
+  registry.add("async_on", this, [](const char *, void *cp_mgr) {
+    ((CentipedeManager *)cp_mgr)->set_async_mode(true);
+  });
+
+  // Write the Centipede ports with blocking calls, as per `sync_on/off`
+  registry.add("async_off", this, [](const char *, void *cp_mgr) {
+    ((CentipedeManager *)cp_mgr)->set_async_mode(false);
+  });
+
+  // Report the switch count and total open time of each valve, see
+  // `ValveStats::print()`. First line, tab delimited:
+  //   1) Number of valves
+  //   2) Time since boot or the last `valve_stats_reset` [ms]
+  // Followed by a line per valve, tab delimited:
+  //   1) Valve number
+  //   2) Switch count
+  //   3) Total open time [ms]
+  registry.add("valve_stats?", this, [](const char *, void *cp_mgr) {
+    ((CentipedeManager *)cp_mgr)->report_valve_stats(Serial);
+  });
+
+  registry.add("valve_stats_reset", this, [](const char *, void *cp_mgr) {
+    ((CentipedeManager *)cp_mgr)->reset_valve_stats();
+  });
+
+  // Report the histograms of the on and off durations of the valve number
+  // given as argument, each on a line holding the tab-delimited counts of the
+  // log2-spaced bins [ms]: 1) <2, 2) 2-4, 3) 4-8, ..., `VALVE_STATS_BINS`
+  registry.add_with_args("valve_hist", this, [](const char *args,
+                                                void *cp_mgr) {
+    int valve = atoi(args);
+    if ((valve < 1) || (valve > N_VALVES)) {
+      Serial.println("ERROR: Invalid valve number.");
+      return;
+    }
+    ((CentipedeManager *)cp_mgr)->report_valve_hist(Serial, valve);
+  });
 }
@@ -2,11 +2,12 @@
  * @file    CentipedeManager.h
  * @author  Dennis van Gils (vangils.dennis@gmail.com)
  * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
- * @date    28-11-2022
+ * @date    15-10-2026
  *
  * @brief   Manage the output channels of both Centipede boards used by the
  * jetting grid of the Twente Water Tunnel. This class will store and keep track
- * of the bitmasks per port. Each port corresponds to a MCP23017 I/O expander.
+ * of the bitmasks per port. Each port corresponds to a MCP23017 I/O expander,
+ * or to 16 channels of another output backend, see `OutputBackend.h`.
  *
  * @copyright MIT License. See the LICENSE file for details.
  */
@@ -14,7 +15,11 @@
 #ifndef CENTIPEDE_MANAGER_H_
 #define CENTIPEDE_MANAGER_H_
 
-#include "Centipede.h"
+#include "CommandRegistry.h"
+#include "MCP23017Backend.h"
+#include "OutputBackend.h"
+#include "ValveStats.h"
+#include "constants.h"
 #include <Arduino.h>
 #include <array>
 
@@ -23,18 +28,23 @@ extern const uint8_t BUF_LEN;
 extern char buf[];
 
 /**
- * @brief Total number of Centipede ports in use.
- *
- * A single Centipede board has 4 ports for controlling a total of 64 channels.
- * A second Centipede board on another I2C address will add 4 more additional
- * ports, allowing a total of 128 channels to be controlled.
+ * @brief Interval [ms] at which `CentipedeManager::update()` reads back the
+ * output latches of the next port, see `set_verify()`. A full round over all
+ * ports takes `N_CP_PORTS` times as long.
  */
-const uint8_t N_CP_PORTS = 8;
+const uint16_t CP_VERIFY_INTERVAL = 10;
 
 /**
- * @brief Container for the Centipede port bitmasks.
+ * @brief Called from within the DMA interrupt once the bitmasks sent out in
+ * the asynchronous mode have all been written, see
+ * `CentipedeManager::set_done_callback()`.
+ *
+ * @param done_us Time [µs] of completion
+ * @param ctx The context passed to `CentipedeManager::set_done_callback()`
  */
-using CP_Masks = std::array<uint16_t, N_CP_PORTS>;
+typedef void (*SendDoneCallback)(uint32_t done_us, void *ctx);
+
+class PeripheralSim; // See `PeripheralSim.h`
 
 /*******************************************************************************
   CP_Address
@@ -67,15 +77,76 @@ public:
   CentipedeManager();
 
   /**
-   * @brief Initialize the Centipede, set all channels to output and turn the
-   * outputs LOW.
+   * @brief Drive the outputs by @p backend instead of by the Centipede boards
+   * (default), see `OutputBackend.h`. Pass nullptr to return to the Centipede
+   * boards. Must be called before `begin()`.
+   */
+  void set_backend(OutputBackend *backend);
+
+  inline const OutputBackend &get_backend() const { return *_backend; }
+
+  /**
+   * @brief Are the outputs driven by the Centipede boards via I2C? The I2C
+   * calibration and benchmark only apply then.
+   */
+  inline bool uses_i2c() const { return _backend == &_mcp; }
+
+  /**
+   * @brief Initialize the output backend, set all channels to output and turn
+   * the outputs LOW. Takes a single I2C transaction per port on the Centipede
+   * boards. Selects the asynchronous mode when the backend supports it, see
+   * `set_async_mode()`.
+   *
+   * @return True when all ports have been configured, false otherwise.
+   */
+  bool begin();
+
+#if CP_I2C_DMA && defined(__SAMD51__)
+  /**
+   * @brief Hand the port writes over to the DMA-driven `I2CEngine` and switch
+   * to the asynchronous mode, see `set_async_mode()`. Must be called after
+   * `begin()`.
+   *
+   * @return True when successful, false otherwise.
+   */
+  bool begin_async(Sercom *hw1, uint8_t dmac_id1, Sercom *hw2 = nullptr,
+                   uint8_t dmac_id2 = 0);
+#endif
+
+  /**
+   * @brief Get the Centipede object, e.g. to place both boards on separate I2C
+   * buses via `Centipede::setBuses()` before calling `begin()`.
+   */
+  inline Centipede &get_centipede() { return _mcp.get_centipede(); }
+
+  /**
+   * @brief Route all port writes to the simulation @p sim while it is enabled,
+   * instead of to the Centipede, see `PeripheralSim`. Takes precedence over
+   * the asynchronous mode. The verification of the output latches pauses.
+   * Only `close_all_now()` keeps writing the real ports as well.
+   */
+  inline void set_sim(PeripheralSim *sim) { _sim = sim; }
+
+  /**
+   * @brief Are the port writes being simulated, see `set_sim()`?
+   */
+  bool is_simulated() const;
+
+  /**
+   * @brief Toggle the spare output at @p port and @p bit with each write of
+   * the bitmasks, as an electrical marker of the valves having been written,
+   * see `TimingHarness`. The output must not be wired to a valve. Pass a
+   * negative @p port to stop toggling.
    */
-  void begin();
+  inline void set_marker(int8_t port, uint8_t bit) {
+    _marker_port = (port < N_CP_PORTS) ? port : -1;
+    _marker_mask = (1U << bit);
+  }
 
   /**
    * @brief Set all the stored bitmasks to 0, i.e. set all outputs LOW.
    */
-  inline void clear_masks() { _masks.fill(0); }
+  void clear_masks();
 
   /**
    * @brief Add a single Centipede address to the stored bitmasks, turning that
@@ -90,7 +161,7 @@ public:
    *
    * @param in The new bitmask values
    */
-  inline void set_masks(CP_Masks in) { _masks = in; }
+  void set_masks(CP_Masks in);
 
   /**
    * @brief Get all the stored bitmasks.
@@ -99,12 +170,44 @@ public:
    */
   inline CP_Masks get_masks() { return _masks; }
 
+  /**
+   * @brief Get the bitmasks last sent to the ports, i.e. the outputs as
+   * actually applied, whichever source set them. Safe against the playback
+   * interrupt sending out new bitmasks halfway.
+   *
+   * @return The sent bitmask values
+   */
+  CP_Masks get_sent_masks();
+
   /**
    * @brief Check if all masks are zero.
    *
    * @return True if all masks are zero
    */
-  bool all_masks_are_zero();
+  inline bool all_masks_are_zero() { return _N_open == 0; }
+
+  /**
+   * @brief Are all outputs known to be low, i.e. did the last write of all
+   * zero bitmasks get acknowledged by every port?
+   */
+  bool outputs_closed();
+
+  /**
+   * @brief Get the number of output channels set HIGH in the stored bitmasks,
+   * i.e. the number of open valves. Kept up-to-date on every change of the
+   * bitmasks, so it costs no rescan.
+   */
+  inline uint8_t get_N_open() { return _N_open; }
+
+  /**
+   * @brief Get the number of open valves fed by a single manifold, see
+   * `MANIFOLD2CP_MASKS`.
+   *
+   * @param manifold The manifold index, from 0 to `N_MANIFOLDS` - 1
+   */
+  inline uint8_t get_N_open(uint8_t manifold) {
+    return _N_open_manifold[manifold];
+  }
 
   /**
    * @brief Print the stored bitmasks to the serial stream.
@@ -116,12 +219,282 @@ public:
   /**
    * @brief Send out the stored bitmasks to the Centipede, setting each output
    * channel HIGH or LOW as per the bitmasks.
+   *
+   * Only the ports whose bitmask differs from the last sent bitmask will be
+   * written to, unless @p force is true.
+   *
+   * The MCP23017 chips can not be latched simultaneously, hence the ports
+   * change one after the other. In the synchronous mode, see
+   * `set_sync_mode()`, the skew between the first and the last port gets
+   * minimized by writing them back-to-back with interrupts disabled.
+   *
+   * In the asynchronous mode, see `set_async_mode()`, the ports get queued to
+   * be written in the background and this call returns immediately. Check
+   * `tx_busy()` or use `set_done_callback()` to learn about the completion.
+   *
+   * @param force Write to all ports regardless
+   */
+  void send_masks(bool force = false);
+
+  /**
+   * @brief Close all valves in bounded time, e.g. when halting: Abort any
+   * background port writes, clear the stored bitmasks and write all ports
+   * with blocking calls, interrupts disabled. Safe to be called from within
+   * an interrupt. Writes the real ports even while simulated, see `set_sim()`,
+   * such that a halt always closes the real valves.
+   *
+   * @return The number of failed port writes.
+   */
+  uint8_t close_all_now();
+
+  /**
+   * @brief Are port writes of the asynchronous mode queued or ongoing?
+   */
+  inline bool tx_busy() { return _backend->is_busy(); }
+
+  /**
+   * @brief Get the time [µs] at which the most recently sent out bitmasks had
+   * all been written, once `tx_busy()` returns false.
+   */
+  inline uint32_t get_tx_done_us() { return _tx_done_us; }
+
+  /**
+   * @brief Set the function to call once the bitmasks sent out in the
+   * asynchronous mode have all been written, see `SendDoneCallback`.
+   */
+  inline void set_done_callback(SendDoneCallback callback, void *ctx) {
+    _done_callback = callback;
+    _done_ctx = ctx;
+  }
+
+  /**
+   * @brief Do the housekeeping of the output backend, see
+   * `OutputBackend::update()`, e.g. abort hung port writes of the
+   * asynchronous mode and clear the I2C buses when those have failed, and
+   * verify the output latches of the next port, see `set_verify()`. Must be
+   * called repeatedly from within the main loop.
+   */
+  void update();
+
+  /**
+   * @brief Enable the verification of the output latches (default: true).
+   *
+   * Every `CP_VERIFY_INTERVAL` ms the output latches of a single port get read
+   * back, round-robin, and compared against the bitmask last sent to it. On a
+   * mismatch, e.g. due to an I2C glitch, the port gets written again and the
+   * mismatch gets counted and traced. Skipped when the output backend can't
+   * read back, see `OutputBackend::can_read_back()`.
+   *
+   * The read takes ~80 µs at 1 MHz, with interrupts disabled to keep them from
+   * sending out new bitmasks halfway. Hence, a line switch may be delayed by
+   * as much.
+   */
+  inline void set_verify(bool verify) { _verify = verify; }
+
+  /**
+   * @brief Print the number of verified ports and the number of mismatches
+   * found, tab delimited.
+   *
+   * @param mySerial The serial stream to report over.
    */
-  void send_masks();
+  void report_verify(Stream &mySerial);
+
+  inline void reset_verify() {
+    _N_verified = 0;
+    _N_mismatches = 0;
+  }
+
+  /**
+   * @brief Print the number of issued, skipped and failed I2C port
+   * transactions to the serial stream, tab delimited.
+   *
+   * @param mySerial The serial stream to report over.
+   */
+  void report_tx_stats(Stream &mySerial);
+
+  /**
+   * @brief Print the number of recovered I2C bus faults to the serial stream,
+   * tab delimited, see `CSFaults`.
+   *
+   * @param mySerial The serial stream to report over.
+   */
+  inline void report_faults(Stream &mySerial) { _mcp.report_faults(mySerial); }
+
+  inline void reset_faults() { _mcp.reset_faults(); }
+  inline const CSFaults &get_faults() { return _mcp.get_faults(); }
+  inline uint32_t get_N_tx_failed() { return _N_tx_failed; }
+  inline uint32_t get_N_mismatches() { return _N_mismatches; }
+
+  /**
+   * @brief Reset the counters of the issued and skipped I2C port transactions.
+   */
+  inline void reset_tx_stats() {
+    _N_tx_issued = 0;
+    _N_tx_skipped = 0;
+    _N_tx_failed = 0;
+  }
+
+  /**
+   * @brief Select the synchronous actuation mode, in which all ports get
+   * written in a single burst with interrupts disabled (default: true).
+   */
+  inline void set_sync_mode(bool sync) { _sync = sync; }
+  inline bool get_sync_mode() { return _sync; }
+
+  /**
+   * @brief Select the asynchronous actuation mode, in which the ports get
+   * written in the background via DMA. Takes precedence over the synchronous
+   * mode. Only available when the output backend supports it, see
+   * `OutputBackend::can_write_async()`. On the Centipede boards that takes a
+   * successful `begin_async()`, which also selects it.
+   */
+  void set_async_mode(bool async);
+  inline bool get_async_mode() { return _async; }
+
+  /**
+   * @brief Print the skew [µs] between the first and the last port change of
+   * the last update and the largest skew encountered, tab delimited.
+   *
+   * @param mySerial The serial stream to report over.
+   */
+  void report_skew(Stream &mySerial);
+
+  inline void reset_skew() {
+    _last_skew_us = 0;
+    _max_skew_us = 0;
+  }
+
+  /**
+   * @brief Find the fastest reliable I2C clock rate of the buses and keep
+   * running at it.
+   *
+   * Steps up the clock through `CP_CLOCK_STEPS`, validating each rate with
+   * write/readback patterns over all ports, see `verify_clock()`, until a rate
+   * fails. For margin, the rate one step below the fastest passing rate gets
+   * picked. When even the slowest rate fails, the previous rate is kept.
+   * Afterwards, the duration of a full update gets measured at the picked rate.
+   *
+   * The outputs stay unchanged. Must not be called while a protocol is being
+   * played, because a line switch would hit a bus running at a trial rate.
+   *
+   * @return True when successful, false otherwise, also when the outputs are
+   * not driven by the Centipede boards, see `uses_i2c()`.
+   */
+  bool calibrate_clock();
+
+  /**
+   * @brief Print the I2C clock rate [Hz] and the duration [µs] of a full update
+   * of all ports at that rate, tab delimited. The latter is 0 when not measured
+   * yet.
+   *
+   * @param mySerial The serial stream to report over.
+   */
+  inline void report_clock(Stream &mySerial) { _mcp.report_clock(mySerial); }
+
+  /**
+   * @brief Benchmark a full 128-channel update by repeatedly sending out the
+   * stored bitmasks to all ports. Once via 8 separate `portWrite()` calls and
+   * once via a single `writeAllPorts()` call. The outputs stay unchanged.
+   *
+   * The results are printed to the serial stream, tab delimited: The average
+   * duration [µs] of a full update via `portWrite()`, followed by that via
+   * `writeAllPorts()`.
+   *
+   * @param mySerial The serial stream to report over.
+   * @param N_reps Number of repetitions to average over
+   */
+  inline void benchmark(Stream &mySerial, uint16_t N_reps = 100) {
+    wait_tx();
+    _mcp.benchmark(mySerial, _sent_masks.data(), N_reps);
+  }
+
+  /**
+   * @brief Print the switch count and the total open time of each valve,
+   * counted since boot or the last `reset_valve_stats()`, see
+   * `ValveStats::print()`.
+   *
+   * @param mySerial The serial stream to report over.
+   */
+  inline void report_valve_stats(Stream &mySerial) {
+    _valve_stats.print(mySerial, millis());
+  }
+
+  /**
+   * @brief Print the histograms of the on and off durations of valve number
+   * @p valve, see `ValveStats::print_histograms()`.
+   *
+   * @param mySerial The serial stream to report over.
+   */
+  inline void report_valve_hist(Stream &mySerial, uint8_t valve) {
+    _valve_stats.print_histograms(mySerial, valve);
+  }
+
+  inline const ValveStats &get_valve_stats() const { return _valve_stats; }
+
+  /**
+   * @brief Clear the valve statistics, see `ValveStats::reset()`.
+   */
+  void reset_valve_stats();
+
+  // Number of commands registered by `register_commands()`, checked against
+  // `MAX_COMMANDS` at compile time, see `register_commands()` of `main.cpp`
+  static const uint8_t N_COMMANDS = 19;
+
+  /**
+   * @brief Register the serial commands reporting on and configuring the
+   * Centipede port transactions, see `CommandRegistry`.
+   */
+  void register_commands(CommandRegistry &registry);
 
 private:
-  Centipede _cp; // The Centipede object controlling up to two Centipede boards
-  CP_Masks _masks; // Bitmask values for each of the ports in use
+  MCP23017Backend _mcp;               // The Centipede boards
+  OutputBackend *_backend = &_mcp;    // Hardware driving the outputs
+  CP_Masks _masks;      // Bitmask values for each of the ports in use
+  CP_Masks _sent_masks; // Shadow copy of the bitmasks last sent to the ports
+  bool _sent_valid = false; // Does the shadow copy reflect the real outputs?
+  uint8_t _N_open = 0;      // Number of channels set HIGH in `_masks`
+  uint8_t _N_open_manifold[N_MANIFOLDS] = {}; // Idem, per manifold
+  uint32_t _N_tx_issued = 0;  // Number of issued I2C port transactions
+  uint32_t _N_tx_skipped = 0; // Number of skipped I2C port transactions
+  uint32_t _N_tx_failed = 0;  // Number of failed I2C port transactions
+  bool _sync = true;          // Synchronous actuation mode
+  uint32_t _last_skew_us = 0; // Skew between the ports of the last update
+  uint32_t _max_skew_us = 0;  // Largest skew encountered
+  bool _async = false;        // Asynchronous actuation mode
+  volatile uint32_t _tx_done_us = 0; // Time [µs] the writes completed
+  SendDoneCallback _done_callback = nullptr; // See `set_done_callback()`
+  void *_done_ctx = nullptr;                 // Context of `_done_callback`
+  bool _verify = true;        // Verify the output latches?
+  uint8_t _verify_port = 0;   // Next port to verify
+  uint32_t _tick_verify = 0;  // Time [ms] of the last verification
+  uint32_t _N_verified = 0;   // Number of verified ports
+  uint32_t _N_mismatches = 0; // Number of mismatching output latches
+  ValveStats _valve_stats;    // Switch counts and on/off durations per valve
+  PeripheralSim *_sim = nullptr; // See `set_sim()`
+  int8_t _marker_port = -1;      // See `set_marker()`, -1 when not in use
+  uint16_t _marker_mask = 0;     // See `set_marker()`
+
+  /**
+   * @brief Recount the channels set HIGH in the stored bitmasks.
+   */
+  void count_open();
+
+  /**
+   * @brief Wait for the port writes of the asynchronous mode to complete,
+   * because the blocking writes must not interfere with them.
+   */
+  inline void wait_tx() {
+    while (_backend->is_busy()) {
+      _backend->update();
+    }
+  }
+
+  /**
+   * @brief Callback of the output backend, collecting the transaction
+   * statistics.
+   */
+  static void tx_done(uint32_t done_us, uint8_t N_failed, uint32_t skew_us,
+                      void *ctx);
 };
 
 #endif
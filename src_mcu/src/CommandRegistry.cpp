@@ -0,0 +1,111 @@
+/**
+ * @file    CommandRegistry.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "CommandRegistry.h"
+#include "Trace.h"
+#include "halt.h"
+
+/*------------------------------------------------------------------------------
+  CommandRegistry
+------------------------------------------------------------------------------*/
+
+void CommandRegistry::add(const char *name, void *ctx,
+                          CommandHandler handler) {
+  insert(name, ctx, handler, false);
+}
+
+void CommandRegistry::add_with_args(const char *name, void *ctx,
+                                    CommandHandler handler) {
+  insert(name, ctx, handler, true);
+}
+
+void CommandRegistry::insert(const char *name, void *ctx,
+                             CommandHandler handler, bool takes_args) {
+  uint8_t idx = upper_bound(name);
+  if ((_N == MAX_COMMANDS) ||
+      ((idx > 0) && (strcmp(_cmds[idx - 1].name, name) == 0))) {
+    snprintf(buf, BUF_LEN,
+             "CRITICAL: Command table full or duplicate command '%s'", name);
+    halt(14, buf);
+  }
+
+  // Keep the table sorted
+  for (uint8_t i = _N; i > idx; --i) {
+    _cmds[i] = _cmds[i - 1];
+  }
+  _cmds[idx] = {name, ctx, handler, takes_args};
+  _N++;
+}
+
+uint8_t CommandRegistry::upper_bound(const char *str) const {
+  uint8_t lo = 0;
+  uint8_t hi = _N;
+  while (lo < hi) {
+    uint8_t mid = (lo + hi) / 2;
+    if (strcmp(_cmds[mid].name, str) <= 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+/**
+ * @brief Return the first 4 chars of @p str_cmd packed little endian, to
+ * identify the command in the trace.
+ */
+static uint32_t trace_tag(const char *str_cmd) {
+  uint32_t tag = 0;
+  for (uint8_t i = 0; (i < 4) && str_cmd[i]; ++i) {
+    tag |= (uint32_t)(uint8_t)str_cmd[i] << (8 * i);
+  }
+  return tag;
+}
+
+bool CommandRegistry::dispatch(const char *str_cmd) {
+  TRACE_SPAN(TRACE_COMMAND, 0, trace_tag(str_cmd));
+  uint8_t idx = upper_bound(str_cmd);
+
+  // Exact match: The last name not larger than the command is equal to it
+  if ((idx > 0) && (strcmp(_cmds[idx - 1].name, str_cmd) == 0)) {
+    const Command &cmd = _cmds[idx - 1];
+    cmd.handler(str_cmd + strlen(str_cmd), cmd.ctx);
+    return true;
+  }
+
+  // Prefix match: Every prefix of the command sorts before it, the longest
+  // one last. Only names sharing the first character can be a prefix.
+  while (idx > 0) {
+    const Command &cmd = _cmds[--idx];
+    if (cmd.name[0] != str_cmd[0]) {
+      break;
+    }
+
+    size_t len = strlen(cmd.name);
+    if (cmd.takes_args && (strncmp(cmd.name, str_cmd, len) == 0)) {
+      const char *args = str_cmd + len;
+      while (*args == ' ') {
+        args++;
+      }
+      cmd.handler(args, cmd.ctx);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void CommandRegistry::print(Stream &mySerial) {
+  mySerial.println(_N);
+  for (uint8_t idx = 0; idx < _N; ++idx) {
+    mySerial.print(_cmds[idx].name);
+    mySerial.write('\t');
+    mySerial.println(_cmds[idx].takes_args);
+  }
+}
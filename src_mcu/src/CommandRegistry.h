@@ -0,0 +1,114 @@
+/**
+ * @file    CommandRegistry.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Table-driven dispatch of the serial ASCII commands.
+ *
+ * The handlers get registered once at startup, by `main.cpp` and by the classes
+ * owning the functionality, see e.g. `ProtocolManager::register_commands()`.
+ * The table is kept sorted by name, such that dispatching a command takes a
+ * binary search of ~6 string comparisons instead of walking a chain of `if`
+ * statements. The registered command set can be listed via `print()`.
+ *
+ * Commands taking arguments match when their name is a prefix of the received
+ * command string, e.g. `goto12` and `load my_protocol`. The longest matching
+ * name wins. Exact matches always take precedence.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef COMMAND_REGISTRY_H_
+#define COMMAND_REGISTRY_H_
+
+#include <Arduino.h>
+#include <array>
+
+// Common character buffer for string formatting, see `main.cpp`
+extern const uint8_t BUF_LEN;
+extern char buf[];
+
+/**
+ * @brief Maximum number of commands that can be registered. The number of
+ * commands registered at boot gets checked against it at compile time, see
+ * `register_commands()` of `main.cpp`.
+ */
+const uint8_t MAX_COMMANDS = 248;
+
+/**
+ * @brief Handler of a serial command.
+ *
+ * @param args The remainder of the command string following the command name,
+ * with leading spaces skipped. Empty for commands without arguments.
+ * @param ctx The context pointer given at registration
+ */
+typedef void (*CommandHandler)(const char *args, void *ctx);
+
+/*------------------------------------------------------------------------------
+  CommandRegistry
+------------------------------------------------------------------------------*/
+
+class CommandRegistry {
+public:
+  /**
+   * @brief Register command @p name, matching exactly. The name must remain
+   * valid, e.g. a string literal. Halts when the table is full or when the
+   * name got registered already.
+   *
+   * @param name Command name
+   * @param ctx Context pointer passed on to @p handler, e.g. `this`
+   * @param handler Function to call
+   */
+  void add(const char *name, void *ctx, CommandHandler handler);
+  inline void add(const char *name, CommandHandler handler) {
+    add(name, nullptr, handler);
+  }
+
+  /**
+   * @brief Register command @p name, taking arguments. See `add()`.
+   */
+  void add_with_args(const char *name, void *ctx, CommandHandler handler);
+  inline void add_with_args(const char *name, CommandHandler handler) {
+    add_with_args(name, nullptr, handler);
+  }
+
+  /**
+   * @brief Call the handler of the command matching @p str_cmd.
+   *
+   * @return True when a matching command was found, false otherwise.
+   */
+  bool dispatch(const char *str_cmd);
+
+  /**
+   * @brief Print the registered commands: First the number of commands, then
+   * one command per line, tab delimited:
+   *   1) Name
+   *   2) Takes arguments (1) or not (0)
+   */
+  void print(Stream &mySerial);
+
+  inline uint8_t size() const { return _N; }
+
+private:
+  struct Command {
+    const char *name;
+    void *ctx;
+    CommandHandler handler;
+    bool takes_args;
+  };
+
+  std::array<Command, MAX_COMMANDS> _cmds; // Sorted by name
+  uint8_t _N = 0;                          // Number of registered commands
+
+  void insert(const char *name, void *ctx, CommandHandler handler,
+              bool takes_args);
+
+  /**
+   * @brief Return the index of the first command whose name compares larger
+   * than @p str.
+   */
+  uint8_t upper_bound(const char *str) const;
+};
+
+#endif
@@ -0,0 +1,64 @@
+/**
+ * @file    DAQRate.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "DAQRate.h"
+
+/*------------------------------------------------------------------------------
+  DAQRate
+------------------------------------------------------------------------------*/
+
+bool DAQRate::set_max_factor(uint8_t max_factor) {
+  _max_factor = constrain(max_factor, 1, DAQ_OVERSAMPLE_MAX);
+  if (_factor > _max_factor) {
+    _factor = _max_factor;
+    return true;
+  }
+  return false;
+}
+
+uint8_t DAQRate::fitting_factor(uint32_t loop_us) const {
+  // Shortest interval the main loop can keep up with
+  uint32_t min_DT_us = _ring_len ? loop_us * 2 / _ring_len : loop_us * 2;
+  if (min_DT_us == 0) {
+    return _max_factor;
+  }
+  return constrain(_DT_us / min_DT_us, 1UL, (uint32_t)_max_factor);
+}
+
+bool DAQRate::update(uint32_t now_us) {
+  if (!_known) {
+    _known = true;
+    _t_prev_us = now_us;
+    _t_window_us = now_us;
+    _gap_max_us = 0;
+    return false;
+  }
+
+  uint32_t gap_us = now_us - _t_prev_us;
+  _t_prev_us = now_us;
+  if (gap_us > _gap_max_us) {
+    _gap_max_us = gap_us;
+  }
+
+  if (now_us - _t_window_us < DAQ_RATE_WINDOW_MS * 1000) {
+    return false;
+  }
+
+  // End of the window
+  _loop_max_us = _gap_max_us;
+  _gap_max_us = 0;
+  _t_window_us = now_us;
+
+  uint8_t fit = fitting_factor(_loop_max_us);
+  uint8_t factor = (fit < _factor) ? fit : min(fit, (uint8_t)(2 * _factor));
+  if (factor == _factor) {
+    return false;
+  }
+  _factor = factor;
+  return true;
+}
@@ -0,0 +1,127 @@
+/**
+ * @file    DAQRate.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Adaptive oversampling rate of the R Clicks, tied to the headroom of
+ * the main loop.
+ *
+ * The R Clicks get sampled at `DAQ_DT / factor`, the oversampling factor
+ * running from 1 up to a configurable bound. More readings going into the
+ * moving averages means better noise rejection, while the cut-off `DAQ_LP`
+ * stays put, as the smoothing factor follows from the obtained interval, see
+ * `EMAFilter`. The decimated streams and the anomaly capture are designed
+ * around `DAQ_DT` and hence get every `factor`-th reading only.
+ *
+ * The headroom follows from the longest iteration of the main loop, measured
+ * per window of `DAQ_RATE_WINDOW_MS`:
+ *   - Polled from the main loop, a reading can only be taken once per
+ *     iteration. The interval must then be at least twice the longest
+ *     iteration, or else it stretches.
+ *   - Acquired in the background, the readings queue up in the ring buffer of
+ *     `RClickDAQ` while the main loop is busy. The interval must then be long
+ *     enough for the longest iteration to fill at most half of the ring.
+ *
+ * At the end of each window the factor drops right away to the highest one
+ * fitting the headroom, but rises by no more than doubling, such that a single
+ * quiet window does not starve the playback.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef DAQ_RATE_H_
+#define DAQ_RATE_H_
+
+#include <Arduino.h>
+
+// Largest oversampling factor over `DAQ_DT`, see `DAQRate`
+const uint8_t DAQ_OVERSAMPLE_MAX = 8;
+
+// Window [ms] over which the headroom of the main loop gets measured
+const uint32_t DAQ_RATE_WINDOW_MS = 1000;
+
+/*------------------------------------------------------------------------------
+  DAQRate
+------------------------------------------------------------------------------*/
+
+class DAQRate {
+public:
+  /**
+   * @param DT_us Nominal oversampling interval [µs], i.e. at factor 1
+   */
+  DAQRate(uint32_t DT_us) : _DT_us(DT_us) {}
+
+  /**
+   * @brief Change the nominal oversampling interval to @p DT_us [µs]. To be
+   * called at boot, before the acquisition starts.
+   */
+  inline void set_nominal_interval(uint32_t DT_us) { _DT_us = DT_us; }
+
+  /**
+   * @brief Acquiring in the background with a ring buffer of @p ring_len
+   * readings (> 0), or polling from the main loop (0)?
+   */
+  inline void set_ring_len(uint8_t ring_len) { _ring_len = ring_len; }
+
+  /**
+   * @brief Bound the oversampling factor to @p max_factor, clamped to
+   * [1, `DAQ_OVERSAMPLE_MAX`]. A bound of 1 fixes the interval at `DAQ_DT`.
+   *
+   * @return True when the oversampling factor had to drop.
+   */
+  bool set_max_factor(uint8_t max_factor);
+
+  /**
+   * @brief Mark an iteration of the main loop at time @p now_us. Adjusts the
+   * oversampling factor at the end of each window, see above.
+   *
+   * @return True when the oversampling factor has changed.
+   */
+  bool update(uint32_t now_us);
+
+  /**
+   * @brief The main loop has not been calling `update()` on purpose. Do not
+   * count the gap as an iteration.
+   */
+  inline void resume() { _known = false; }
+
+  /**
+   * @brief The main loop has been asleep for @p slept_us [µs] since the last
+   * `update()`, see `TaskScheduler::set_idle()`. That is headroom, not a
+   * longer iteration.
+   */
+  inline void discount(uint32_t slept_us) { _t_prev_us += slept_us; }
+
+  inline uint8_t get_factor() const { return _factor; }
+  inline uint8_t get_max_factor() const { return _max_factor; }
+
+  /**
+   * @brief Return the current oversampling interval [µs].
+   */
+  inline uint32_t get_interval_us() const { return _DT_us / _factor; }
+
+  /**
+   * @brief Return the longest iteration of the main loop [µs] of the last
+   * finished window.
+   */
+  inline uint32_t get_loop_max_us() const { return _loop_max_us; }
+
+private:
+  uint32_t _DT_us;                          // Nominal interval [µs]
+  uint8_t _ring_len = 0;                    // 0: Polled from the main loop
+  uint8_t _factor = 1;                      // Current oversampling factor
+  uint8_t _max_factor = DAQ_OVERSAMPLE_MAX; // Bound on the factor
+  bool _known = false;                      // Is `_t_prev_us` valid?
+  uint32_t _t_prev_us = 0;                  // Previous iteration [µs]
+  uint32_t _t_window_us = 0;                // Start of the window [µs]
+  uint32_t _gap_max_us = 0;                 // Longest iteration so far [µs]
+  uint32_t _loop_max_us = 0;                // Longest of the last window [µs]
+
+  /**
+   * @brief Return the highest factor fitting an iteration of @p loop_us.
+   */
+  uint8_t fitting_factor(uint32_t loop_us) const;
+};
+
+#endif
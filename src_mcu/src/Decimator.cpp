@@ -0,0 +1,231 @@
+/**
+ * @file    Decimator.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "Decimator.h"
+
+// See `main.cpp`
+extern const uint8_t BUF_LEN; // Common character buffer for string formatting
+extern char buf[];            // Common character buffer for string formatting
+
+// Coefficients of the FIR stage in Q15, summing to unity gain. Least-squares
+// design against the inverse response of the CIC stage up to 0.2 of its
+// output rate, with a stopband from 0.3 onwards weighted 20 times heavier.
+static const int16_t FIR_COEFFS[DecimStream::FIR_TAPS] = {
+    238,   369,  -333, -916, 414,  1905, -363, -3937, -376, 10765, 17236,
+    10765, -376, -3937, -363, 1905, 414,  -916, -333,  369,  238};
+
+/*------------------------------------------------------------------------------
+  DecimStream
+------------------------------------------------------------------------------*/
+
+void DecimStream::begin(uint8_t stream, uint8_t R, uint32_t DT_us) {
+  _R = min(R, DECIM_R_MAX);
+  _N_cic = 0;
+  _N_warmup = CIC_ORDER;
+  _hist_pos = 0;
+  _odd = false;
+  _N_packet = 0;
+  memset(_integ, 0, sizeof(_integ));
+  memset(_comb, 0, sizeof(_comb));
+
+  // Half the length of the impulse responses of both stages
+  _delay_us =
+      _R ? (CIC_ORDER * (_R - 1) + (FIR_TAPS - 1) * _R) * DT_us / 2 : 0;
+  _dt_us = 2 * _R * DT_us;
+
+  _packet.marker = DECIM_MARKER;
+  _packet.stream = stream;
+  _packet.seq = 0;
+  _packet.dt_us = _dt_us;
+}
+
+bool DecimStream::add(uint32_t t_us, const uint16_t (&bitval)[N_R_CLICKS],
+                      const PressureScale *scales) {
+  if (_R == 0) {
+    return false;
+  }
+
+  for (uint8_t ch = 0; ch < N_R_CLICKS; ++ch) {
+    uint32_t x = bitval[ch];
+    for (uint8_t stage = 0; stage < CIC_ORDER; ++stage) {
+      _integ[stage][ch] += x;
+      x = _integ[stage][ch];
+    }
+  }
+  if (++_N_cic < _R) {
+    return false;
+  }
+  _N_cic = 0;
+
+  // Comb stages at the decimated rate, normalized by the gain R^3
+  uint32_t gain = (uint32_t)_R * _R * _R;
+  _hist_pos = (_hist_pos + 1) % FIR_TAPS;
+  for (uint8_t ch = 0; ch < N_R_CLICKS; ++ch) {
+    uint32_t y = _integ[CIC_ORDER - 1][ch];
+    for (uint8_t stage = 0; stage < CIC_ORDER; ++stage) {
+      uint32_t prev = _comb[stage][ch];
+      _comb[stage][ch] = y;
+      y -= prev;
+    }
+    _hist[_hist_pos][ch] = ((uint64_t)y << 4) / gain;
+  }
+
+  // The first CIC outputs are still ramping up. Prime the FIR stage with the
+  // first settled one instead.
+  if (_N_warmup > 0) {
+    if (--_N_warmup == 0) {
+      for (uint8_t tap = 0; tap < FIR_TAPS; ++tap) {
+        memcpy(_hist[tap], _hist[_hist_pos], sizeof(_hist[tap]));
+      }
+    }
+    return false;
+  }
+
+  _odd = !_odd;
+  if (_odd) {
+    return false;
+  }
+
+  // FIR stage, exploiting its symmetry
+  const uint8_t M = FIR_TAPS / 2;
+  uint8_t N = _N_packet;
+  for (uint8_t ch = 0; ch < N_R_CLICKS; ++ch) {
+    int64_t acc = (int64_t)FIR_COEFFS[M] *
+                  _hist[(_hist_pos + FIR_TAPS - M) % FIR_TAPS][ch];
+    for (uint8_t k = 0; k < M; ++k) {
+      acc += (int64_t)FIR_COEFFS[k] *
+             (_hist[(_hist_pos + FIR_TAPS - k) % FIR_TAPS][ch] +
+              _hist[(_hist_pos + 1 + k) % FIR_TAPS][ch]);
+    }
+    int32_t q4 = constrain((acc + (1 << 14)) >> 15, 0, UINT16_MAX);
+    _packet.pres_mbar[N][ch] = scales[ch].bitval2mbar(q4);
+  }
+
+  if (N == 0) {
+    _packet.t_us = t_us - _delay_us;
+  }
+  _N_packet++;
+  return (_N_packet == DECIM_SAMPLES_PER_PACKET);
+}
+
+DecimPacket &DecimStream::get_packet() {
+  _N_packet = 0;
+  return _packet;
+}
+
+/*------------------------------------------------------------------------------
+  Decimator
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Append @p value as a zig-zag encoded LEB128 varint to @p dst.
+ *
+ * @return The number of bytes appended, at most 3 for a 17-bit @p value.
+ */
+static uint8_t put_zigzag(int32_t value, uint8_t *dst) {
+  uint32_t zz = ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+  uint8_t len = 0;
+  while (zz >= 0x80) {
+    dst[len++] = (zz & 0x7F) | 0x80;
+    zz >>= 7;
+  }
+  dst[len++] = zz;
+  return len;
+}
+
+uint32_t Decimator::set_period(uint8_t stream, uint32_t period_us,
+                               bool compressed) {
+  uint32_t R = (period_us + _DT_us) / (2 * _DT_us);
+  if (period_us > 0) {
+    R = constrain(R, 1, DECIM_R_MAX);
+  }
+  _streams[stream].begin(stream, R, _DT_us);
+  _N_sent[stream] = 0;
+  _N_bytes[stream] = 0;
+
+  Block &block = _blocks[stream];
+  block.active = compressed;
+  block.seq = 0;
+  block.N = 0;
+  return get_period(stream);
+}
+
+bool Decimator::is_active() const {
+  for (uint8_t stream = 0; stream < DECIM_N_STREAMS; ++stream) {
+    if (_streams[stream].get_R()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void Decimator::add(uint32_t t_us, const uint16_t (&bitval)[N_R_CLICKS],
+                    TxQueue &port) {
+  for (uint8_t stream = 0; stream < DECIM_N_STREAMS; ++stream) {
+    if (_streams[stream].add(t_us, bitval, _scales)) {
+      DecimPacket &packet = _streams[stream].get_packet();
+      if (_blocks[stream].active) {
+        compress(stream, packet, port);
+      } else {
+        push(stream, (const uint8_t *)&packet, sizeof(packet), port);
+      }
+      packet.seq++;
+    }
+  }
+}
+
+void Decimator::compress(uint8_t stream, const DecimPacket &packet,
+                         TxQueue &port) {
+  Block &block = _blocks[stream];
+
+  for (uint8_t idx = 0; idx < DECIM_SAMPLES_PER_PACKET; ++idx) {
+    const int16_t(&sample)[N_R_CLICKS] = packet.pres_mbar[idx];
+
+    if (block.N == 0) {
+      // Key sample
+      DecimBlockHeader header;
+      header.marker = DECIM_Z_MARKER;
+      header.stream = stream;
+      header.seq = block.seq;
+      header.t_us = packet.t_us + idx * packet.dt_us;
+      header.dt_us = packet.dt_us;
+      memcpy(header.key_mbar, sample, sizeof(header.key_mbar));
+      memcpy(block.bytes, &header, sizeof(header));
+      block.len = sizeof(header);
+    } else {
+      for (uint8_t ch = 0; ch < N_R_CLICKS; ++ch) {
+        block.len += put_zigzag((int32_t)sample[ch] - block.prev_mbar[ch],
+                                &block.bytes[block.len]);
+      }
+    }
+    memcpy(block.prev_mbar, sample, sizeof(block.prev_mbar));
+
+    if (++block.N == DECIM_Z_SAMPLES_PER_BLOCK) {
+      push(stream, block.bytes, block.len, port);
+      block.seq++;
+      block.N = 0;
+    }
+  }
+}
+
+void Decimator::push(uint8_t stream, const uint8_t *data, uint16_t len,
+                     TxQueue &port) {
+  port.write_or_drop(_frame, cobs_frame(data, len, _frame));
+  _N_sent[stream]++;
+  _N_bytes[stream] += len;
+}
+
+void Decimator::print(Stream &mySerial) const {
+  for (uint8_t stream = 0; stream < DECIM_N_STREAMS; ++stream) {
+    snprintf(buf, BUF_LEN, "%u\t%lu\t%lu\t%u\t%lu\n", stream,
+             (unsigned long)get_period(stream),
+             (unsigned long)_N_sent[stream], _blocks[stream].active,
+             (unsigned long)_N_bytes[stream]);
+    mySerial.print(buf);
+  }
+}
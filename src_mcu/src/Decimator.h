@@ -0,0 +1,255 @@
+/**
+ * @file    Decimator.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Multi-stage decimation of the raw R Click readings into alias-free
+ * pressure streams at lower rates, pushed to the PC as binary packets.
+ *
+ * Each stream runs the readings, as acquired at the oversampling interval
+ * `DAQ_DT`, through two stages:
+ *   1) A third-order cascaded integrator-comb (CIC) filter, decimating by a
+ *      factor R. Pure integer arithmetic, wrapping around harmlessly, at the
+ *      cost of two additions per stage per reading.
+ *   2) A 21-tap symmetric FIR filter, decimating by a further factor 2 and
+ *      compensating the passband droop of the CIC filter. Combined, the
+ *      passband is flat within 1 dB up to 40 % of the output rate and
+ *      everything from 60 % of the output rate onwards, which would alias
+ *      onto it, is suppressed by 40 dB or more.
+ *
+ * The output interval hence is `2 R DAQ_DT`, with R up to `DECIM_R_MAX`. The
+ * streams run concurrently, e.g. a fast one to resolve transients next to a
+ * slow one for monitoring. The fastest output rate follows from `DAQ_DT`.
+ *
+ * The output samples get converted into pressures and collected into
+ * `DecimPacket`s of `DECIM_SAMPLES_PER_PACKET` samples each, pushed as COBS
+ * frames, see `Telemetry.h`. Their timestamps are corrected for the group
+ * delay of the filters, such that they line up with the raw readings.
+ *
+ * Optionally per stream, the samples get compressed instead into
+ * `DecimBlockHeader` blocks of `DECIM_Z_SAMPLES_PER_BLOCK` samples, for fast
+ * streams sharing the USB link with uploads and commands. Each block opens
+ * with an absolute key sample, such that a dropped block loses no more than
+ * itself. Each next sample follows as the first-order difference per channel,
+ * zig-zag encoded into an unsigned LEB128 varint: Differences within +/-63
+ * mbar take a single byte, within +/-8191 mbar two and the rest three. The
+ * smooth pressure signals hence take 2 to 4 times less bandwidth.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef DECIMATOR_H_
+#define DECIMATOR_H_
+
+#include <Arduino.h>
+
+#include "PressureScale.h"
+#include "RClickDAQ.h"
+#include "Telemetry.h"
+
+// Number of concurrent output streams
+const uint8_t DECIM_N_STREAMS = 2;
+
+// Largest decimation factor of the CIC stage
+const uint8_t DECIM_R_MAX = 64;
+
+// Number of output samples per packet
+const uint8_t DECIM_SAMPLES_PER_PACKET = 8;
+
+// Value of `DecimPacket::marker`, telling the packets apart from other frames
+const uint8_t DECIM_MARKER = 0xDC;
+
+/**
+ * @brief Binary packet of a decimated stream, little endian.
+ */
+struct __attribute__((packed)) DecimPacket {
+  uint8_t marker; // `DECIM_MARKER`
+  uint8_t stream; // Stream number, starting at index 0
+  uint16_t seq;   // Sequence number, per stream
+  uint32_t t_us;  // Timestamp of the first sample [µs]
+  uint32_t dt_us; // Output interval [µs]
+  int16_t pres_mbar[DECIM_SAMPLES_PER_PACKET][N_R_CLICKS]; // [mbar]
+};
+
+static_assert(sizeof(DecimPacket) == 76, "DecimPacket got padded");
+
+// Value of `DecimBlockHeader::marker`
+const uint8_t DECIM_Z_MARKER = 0xDD;
+
+// Number of samples per compressed block, including the key sample
+const uint8_t DECIM_Z_SAMPLES_PER_BLOCK = 4 * DECIM_SAMPLES_PER_PACKET;
+
+/**
+ * @brief Header of a compressed block of a decimated stream, little endian.
+ * It is followed by the varint differences of the other
+ * `DECIM_Z_SAMPLES_PER_BLOCK - 1` samples, all channels of a sample in turn.
+ */
+struct __attribute__((packed)) DecimBlockHeader {
+  uint8_t marker;               // `DECIM_Z_MARKER`
+  uint8_t stream;               // Stream number, starting at index 0
+  uint16_t seq;                 // Sequence number of the blocks, per stream
+  uint32_t t_us;                // Timestamp of the key sample [µs]
+  uint32_t dt_us;               // Output interval [µs]
+  int16_t key_mbar[N_R_CLICKS]; // Key sample [mbar]
+};
+
+static_assert(sizeof(DecimBlockHeader) == 20, "DecimBlockHeader got padded");
+
+// Largest size of a compressed block: a 3-byte varint per difference
+const uint16_t DECIM_Z_MAX_LEN =
+    sizeof(DecimBlockHeader) + (DECIM_Z_SAMPLES_PER_BLOCK - 1) * N_R_CLICKS * 3;
+
+/*------------------------------------------------------------------------------
+  DecimStream
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Class to decimate the readings of all R Clicks into a single stream.
+ */
+class DecimStream {
+public:
+  static const uint8_t CIC_ORDER = 3;
+  static const uint8_t FIR_TAPS = 21;
+
+  /**
+   * @brief Restart decimating by @p R in the CIC stage, or stop when 0.
+   *
+   * @param stream Stream number to stamp onto the packets
+   * @param DT_us Oversampling interval of the readings [µs]
+   */
+  void begin(uint8_t stream, uint8_t R, uint32_t DT_us);
+
+  inline uint8_t get_R() const { return _R; }
+
+  /**
+   * @brief Add a reading of all R Clicks taken at time @p t_us.
+   *
+   * @return True when the packet has filled up, see `get_packet()`.
+   */
+  bool add(uint32_t t_us, const uint16_t (&bitval)[N_R_CLICKS],
+           const PressureScale *scales);
+
+  /**
+   * @brief Return the full packet, after which a new one gets started.
+   */
+  DecimPacket &get_packet();
+
+private:
+  uint8_t _R = 0;         // Decimation factor of the CIC stage, 0 is off
+  uint8_t _N_cic = 0;     // Number of readings into the current CIC output
+  uint8_t _N_warmup = 0;  // Number of CIC outputs still to be discarded
+  uint32_t _delay_us = 0; // Group delay of both stages [µs]
+  uint32_t _dt_us = 0;    // Output interval [µs]
+
+  // CIC integrators and comb delay lines, wrapping around
+  uint32_t _integ[CIC_ORDER][N_R_CLICKS];
+  uint32_t _comb[CIC_ORDER][N_R_CLICKS];
+
+  int32_t _hist[FIR_TAPS][N_R_CLICKS]; // CIC outputs [1/16 bitval], ring
+  uint8_t _hist_pos = 0;               // Slot of the newest CIC output
+  bool _odd = false;                   // Skip the FIR output this time?
+
+  DecimPacket _packet;
+  uint8_t _N_packet = 0; // Number of samples in the packet
+};
+
+/*------------------------------------------------------------------------------
+  Decimator
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Class to run the concurrent decimated streams and push their packets.
+ */
+class Decimator {
+public:
+  /**
+   * @param DT_us Oversampling interval of the readings [µs]
+   * @param scales Pressure scale of each R Click
+   */
+  Decimator(uint32_t DT_us, const PressureScale *scales)
+      : _DT_us(DT_us), _scales(scales) {}
+
+  /**
+   * @brief Change the oversampling interval of the readings to @p DT_us
+   * [µs]. Only to be called while all streams are stopped, e.g. at boot.
+   */
+  inline void set_interval(uint32_t DT_us) { _DT_us = DT_us; }
+
+  /**
+   * @brief Start stream @p stream at the output interval closest to
+   * @p period_us that is attainable, or stop it when 0.
+   *
+   * @param compressed Push compressed blocks instead of `DecimPacket`s?
+   * @return The obtained output interval [µs], 0 when stopped.
+   */
+  uint32_t set_period(uint8_t stream, uint32_t period_us,
+                      bool compressed = false);
+
+  /**
+   * @brief Return the output interval [µs] of stream @p stream, 0 when
+   * stopped.
+   */
+  inline uint32_t get_period(uint8_t stream) const {
+    return 2 * _streams[stream].get_R() * _DT_us;
+  }
+
+  /**
+   * @brief Is any stream running?
+   */
+  bool is_active() const;
+
+  /**
+   * @brief Add a reading of all R Clicks taken at time @p t_us to each
+   * running stream, and push the packets that have filled up to @p port. A
+   * packet gets dropped when the port can not take it in full.
+   */
+  void add(uint32_t t_us, const uint16_t (&bitval)[N_R_CLICKS],
+           TxQueue &port);
+
+  /**
+   * @brief Print a line per stream, tab delimited:
+   *   1) Stream number, starting at index 0
+   *   2) Output interval [µs], 0 when stopped
+   *   3) Number of packets or compressed blocks pushed
+   *   4) Compressed (1) or not (0)
+   *   5) Number of bytes pushed, without the framing
+   */
+  void print(Stream &mySerial) const;
+
+private:
+  /**
+   * @brief Compressed block under construction of a single stream.
+   */
+  struct Block {
+    bool active = false;                // Compress this stream?
+    uint16_t seq = 0;                   // Sequence number of the block
+    uint8_t N = 0;                      // Number of samples so far
+    uint16_t len = 0;                   // Number of bytes so far
+    int16_t prev_mbar[N_R_CLICKS] = {}; // Previous sample [mbar]
+    uint8_t bytes[DECIM_Z_MAX_LEN];
+  };
+
+  uint32_t _DT_us;
+  const PressureScale *_scales;
+  DecimStream _streams[DECIM_N_STREAMS];
+  Block _blocks[DECIM_N_STREAMS];
+  uint32_t _N_sent[DECIM_N_STREAMS] = {};
+  uint32_t _N_bytes[DECIM_N_STREAMS] = {};
+
+  uint8_t _frame[cobs_frame_len(DECIM_Z_MAX_LEN)];
+
+  /**
+   * @brief Add the samples of the full @p packet to the compressed block of
+   * stream @p stream, pushing the block to @p port once full.
+   */
+  void compress(uint8_t stream, const DecimPacket &packet, TxQueue &port);
+
+  /**
+   * @brief Push @p len bytes of @p data of stream @p stream as a COBS frame
+   * to @p port, or drop it when the port can not take it in full.
+   */
+  void push(uint8_t stream, const uint8_t *data, uint16_t len, TxQueue &port);
+};
+
+#endif
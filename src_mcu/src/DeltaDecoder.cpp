@@ -0,0 +1,80 @@
+/**
+ * @file    DeltaDecoder.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "DeltaDecoder.h"
+
+// Number of bit positions spanned by the PCS row bitmasks
+const uint16_t N_PCS_BITS = NUMEL_PCS_AXIS * NUMEL_PCS_AXIS;
+
+// Number of bit positions, including the line marker past the PCS
+const uint16_t N_DELTA_BITS = N_PCS_BITS + 1;
+
+/*------------------------------------------------------------------------------
+  DeltaDecoder
+------------------------------------------------------------------------------*/
+
+void DeltaDecoder::reset() {
+  _rows.fill(0);
+  _duration = 0;
+}
+
+bool DeltaDecoder::read_varint(const uint8_t *&p, const uint8_t *end,
+                               uint32_t &value) {
+  value = 0;
+  for (uint8_t shift = 0; shift < 32; shift += 7) {
+    if (p == end) {
+      return false;
+    }
+    uint8_t byte = *p++;
+    value |= (uint32_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool DeltaDecoder::next_line(const uint8_t *&p, const uint8_t *end) {
+  uint32_t head;
+  if (!read_varint(p, end, head)) {
+    return false;
+  }
+
+  if (head & 1) {
+    uint32_t duration;
+    if (!read_varint(p, end, duration) || (duration > 0xFFFF)) {
+      return false;
+    }
+    _duration = duration;
+  }
+
+  uint32_t N_toggles = head >> 1;
+  if (N_toggles > N_DELTA_BITS) {
+    return false;
+  }
+
+  uint32_t pos = 0;
+  for (uint16_t idx = 0; idx < N_toggles; ++idx) {
+    uint32_t gap;
+    if (!read_varint(p, end, gap)) {
+      return false;
+    }
+    if (gap >= N_DELTA_BITS - pos) {
+      return false;
+    }
+    pos += gap;
+    if (pos == N_PCS_BITS) {
+      _rows[0] ^= PCS_ROW_MARKER;
+    } else {
+      _rows[pos / NUMEL_PCS_AXIS] ^= (1U << (pos % NUMEL_PCS_AXIS));
+    }
+    pos++;
+  }
+
+  return true;
+}
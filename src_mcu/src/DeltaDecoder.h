@@ -0,0 +1,81 @@
+/**
+ * @file    DeltaDecoder.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Streaming decoder of the delta upload format of protocol lines.
+ *
+ * Consecutive lines of a temporally smooth protocol differ in only a few
+ * valves and mostly share their duration. Hence, each line is send as the
+ * PCS points that toggle with respect to the previous line, and its duration
+ * only when it changed. All numbers are unsigned LEB128 varints, i.e. 7 bits
+ * per byte, least significant first, the upper bit flagging another byte:
+ *
+ *   varint      : K << 1 | D, with K the number of toggled PCS points and D
+ *                 set when the duration changed
+ *   varint      : Only when D is set: The encoded time duration, see
+ *                 `encode_duration_us()`
+ *   K x varint  : The toggled PCS points as gaps between their bit positions
+ *                 in ascending order. Bit position `row * NUMEL_PCS_AXIS +
+ *                 col` corresponds to bit `col` of PCS row bitmask `row`, see
+ *                 `PCS_Rows`. The first gap is counted from 0, every next one
+ *                 from one past the previous bit position. The one position
+ *                 past the PCS, `NUMEL_PCS_AXIS^2`, toggles the line marker,
+ *                 see `PCS_ROW_MARKER`.
+ *
+ * A repeated line takes up a single byte. Decoding starts from all valves
+ * closed and a duration of 0. The state carries over from line to line, and
+ * hence from chunk to chunk of the upload, until `reset()`.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef DELTA_DECODER_H_
+#define DELTA_DECODER_H_
+
+#include "ProtocolManager.h"
+
+#include <Arduino.h>
+
+/*------------------------------------------------------------------------------
+  DeltaDecoder
+------------------------------------------------------------------------------*/
+
+class DeltaDecoder {
+public:
+  DeltaDecoder() { reset(); }
+
+  /**
+   * @brief Start over from all valves closed and a duration of 0.
+   */
+  void reset();
+
+  /**
+   * @brief Decode the next line from the bytes starting at @p p, up to but
+   * not including @p end. Advances @p p past the line.
+   *
+   * @return True when successful. False otherwise, because the line is
+   * truncated or refers to a bit position beyond the PCS, leaving the state
+   * undefined.
+   */
+  bool next_line(const uint8_t *&p, const uint8_t *end);
+
+  // The line decoded last
+  inline uint16_t get_duration() const { return _duration; }
+  inline const PCS_Rows &get_rows() const { return _rows; }
+
+private:
+  PCS_Rows _rows;     // PCS row bitmasks of the previous line
+  uint16_t _duration; // Encoded time duration of the previous line
+
+  /**
+   * @brief Read a varint of at most 32 bits into @p value.
+   *
+   * @return False when truncated or too long.
+   */
+  static bool read_varint(const uint8_t *&p, const uint8_t *end,
+                          uint32_t &value);
+};
+
+#endif
@@ -0,0 +1,101 @@
+/**
+ * @file    EMAFilter.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    14-10-2026
+ *
+ * @brief   Exponential moving average (EMA) over multiple channels at once,
+ * acting as a first-order low-pass filter on oversampled readings.
+ *
+ * The smoothing factor `alpha = 1 - exp(-DT * LP)` depends on the obtained
+ * sampling interval DT, which is not guaranteed to be exact. Instead of
+ * evaluating `exp()` in software on every sample, alpha gets looked up from a
+ * table precomputed by `begin()`, keyed on DT quantized in steps of
+ * `ALPHA_STEP_US` and linearly interpolated in between. The interpolation
+ * error is less than 1e-6 for cut-off frequencies up to 5 Hz. Intervals beyond
+ * the table fall back to a single-precision `expf()`.
+ *
+ * All channels share the same alpha and get updated in a single batch, one
+ * fused multiply-add on the FPU each.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef EMA_FILTER_H_
+#define EMA_FILTER_H_
+
+#include <Arduino.h>
+#include <math.h>
+
+/*------------------------------------------------------------------------------
+  EMAFilter
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Class to hold the exponential moving averages of @p N channels.
+ */
+template <uint8_t N> class EMAFilter {
+public:
+  /**
+   * @brief Precompute the smoothing factors and restart the averages.
+   *
+   * @param LP_Hz Low-pass filter cut-off frequency [Hz]
+   */
+  void begin(float LP_Hz) {
+    _LP_per_us = LP_Hz * 1e-6f;
+    for (uint8_t idx = 0; idx < ALPHA_TABLE_LEN; ++idx) {
+      _alpha[idx] = 1.f - expf(-float(idx * ALPHA_STEP_US) * _LP_per_us);
+    }
+    _at_startup = true;
+  }
+
+  /**
+   * @brief Return the smoothing factor belonging to the sampling interval
+   * @p DT_us [µs].
+   */
+  inline float alpha(uint32_t DT_us) const {
+    uint32_t idx = DT_us / ALPHA_STEP_US;
+    if (idx >= ALPHA_TABLE_LEN - 1) {
+      return 1.f - expf(-float(DT_us) * _LP_per_us);
+    }
+    float frac = (DT_us % ALPHA_STEP_US) * (1.f / ALPHA_STEP_US);
+    return _alpha[idx] + frac * (_alpha[idx + 1] - _alpha[idx]);
+  }
+
+  /**
+   * @brief Add a new reading of all channels to the moving averages. The very
+   * first reading after `begin()` initializes the averages instead.
+   *
+   * @param DT_us Time passed since the previous reading [µs]
+   * @param readings The reading of each channel
+   */
+  inline void update(uint32_t DT_us, const uint16_t (&readings)[N]) {
+    if (_at_startup) {
+      _at_startup = false;
+      for (uint8_t ch = 0; ch < N; ++ch) {
+        value[ch] = readings[ch];
+      }
+      return;
+    }
+
+    float a = alpha(DT_us);
+    for (uint8_t ch = 0; ch < N; ++ch) {
+      value[ch] = fmaf(a, float(readings[ch]) - value[ch], value[ch]);
+    }
+  }
+
+  // Public members
+  float value[N] = {0}; // Moving average of each channel
+
+private:
+  // Spacing of the table entries [µs] and their number, covering intervals
+  // up to 32 ms
+  static const uint32_t ALPHA_STEP_US = 512;
+  static const uint8_t ALPHA_TABLE_LEN = 65;
+
+  float _alpha[ALPHA_TABLE_LEN] = {0}; // Smoothing factor per table entry
+  float _LP_per_us = 0;                // Cut-off frequency [1/µs]
+  bool _at_startup = true;
+};
+
+#endif
@@ -0,0 +1,158 @@
+/**
+ * @file    EdgeCapture.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "EdgeCapture.h"
+
+// Timer ticks per µs: 48 MHz GCLK1 with a prescaler of 16
+const uint32_t TICKS_PER_US = 3;
+
+// Event system channel carrying the edges from the EIC to TC0
+const uint8_t CAPTURE_EVSYS_CHANNEL = 0;
+
+// Captured value indicating that the counter overflowed, see the datasheet on
+// the time-stamp capture
+const uint32_t STAMP_OVERFLOW = UINT32_MAX;
+
+static EdgeCapture *instance = nullptr;
+
+/*------------------------------------------------------------------------------
+  EdgeCapture
+------------------------------------------------------------------------------*/
+
+void EdgeCapture::clear() {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  _tail = _head;
+  _N_lost = 0;
+  __set_PRIMASK(primask);
+}
+
+bool EdgeCapture::peek(uint32_t &t_us) const {
+  if (_tail == _head) {
+    return false; // Empty
+  }
+
+  t_us = _ring[_tail];
+  return true;
+}
+
+bool EdgeCapture::pop(uint32_t &t_us) {
+  if (!peek(t_us)) {
+    return false;
+  }
+
+  _tail = (_tail + 1) % RING_LEN;
+  return true;
+}
+
+#if defined(__SAMD51__)
+
+/**
+ * @brief The core wants a callback, but the edges go to the event system.
+ */
+static void no_callback() {}
+
+bool EdgeCapture::begin(uint8_t pin) {
+  instance = this;
+
+  // Let the core configure the pin and have the EIC sense both edges
+  uint8_t extint = g_APinDescription[pin].ulExtInt;
+  pinMode(pin, INPUT);
+  attachInterrupt(digitalPinToInterrupt(pin), no_callback, CHANGE);
+
+  // Send the edges out as events instead of interrupts. The event control is
+  // enable protected.
+  EIC->INTENCLR.reg = (1U << extint);
+  EIC->CTRLA.bit.ENABLE = 0;
+  while (EIC->SYNCBUSY.bit.ENABLE) {}
+  EIC->EVCTRL.reg |= (1U << extint);
+  EIC->CTRLA.bit.ENABLE = 1;
+  while (EIC->SYNCBUSY.bit.ENABLE) {}
+
+  // Route the EIC events to TC0
+  MCLK->APBBMASK.bit.EVSYS_ = 1;
+  EVSYS->USER[EVSYS_ID_USER_TC0_EVU].reg =
+      EVSYS_USER_CHANNEL(CAPTURE_EVSYS_CHANNEL + 1);
+  EVSYS->Channel[CAPTURE_EVSYS_CHANNEL].CHANNEL.reg =
+      EVSYS_CHANNEL_EVGEN(EVSYS_ID_GEN_EIC_EXTINT_0 + extint) |
+      EVSYS_CHANNEL_PATH_ASYNCHRONOUS;
+
+  // Feed TC0 and its 32-bit partner TC1 with the 48 MHz generic clock 1
+  MCLK->APBAMASK.bit.TC0_ = 1;
+  MCLK->APBAMASK.bit.TC1_ = 1;
+  GCLK->PCHCTRL[TC0_GCLK_ID].reg =
+      GCLK_PCHCTRL_GEN_GCLK1_Val | (1 << GCLK_PCHCTRL_CHEN_Pos);
+  while (GCLK->SYNCBUSY.reg) {}
+
+  TC0->COUNT32.CTRLA.bit.ENABLE = 0;
+  while (TC0->COUNT32.SYNCBUSY.bit.ENABLE) {}
+  TC0->COUNT32.CTRLA.reg = TC_CTRLA_SWRST;
+  while (TC0->COUNT32.SYNCBUSY.bit.SWRST) {}
+
+  // Free-running 32-bit counter, stamping its count into CC0 on each event
+  TC0->COUNT32.CTRLA.reg =
+      TC_CTRLA_MODE_COUNT32 | TC_CTRLA_PRESCALER_DIV16 | TC_CTRLA_CAPTEN0;
+  TC0->COUNT32.EVCTRL.reg = TC_EVCTRL_TCEI | TC_EVCTRL_EVACT_STAMP;
+  TC0->COUNT32.INTENSET.reg = TC_INTENSET_MC0 | TC_INTENSET_ERR;
+
+  // Below the playback timer: The time stamp does not depend on the latency
+  NVIC_ClearPendingIRQ(TC0_IRQn);
+  NVIC_SetPriority(TC0_IRQn, 1);
+  NVIC_EnableIRQ(TC0_IRQn);
+
+  TC0->COUNT32.CTRLA.bit.ENABLE = 1;
+  while (TC0->COUNT32.SYNCBUSY.bit.ENABLE) {}
+  return true;
+}
+
+void EdgeCapture::isr() {
+  uint8_t flags = TC0->COUNT32.INTFLAG.reg;
+  if (flags & TC_INTFLAG_ERR) {
+    // A second edge came in before the first got read out
+    TC0->COUNT32.INTFLAG.reg = TC_INTFLAG_ERR;
+    _N_lost++;
+  }
+  if (!(flags & TC_INTFLAG_MC0)) {
+    return;
+  }
+
+  // Reading out CC0 clears the flag. Then age the stamp against the present
+  // count, paired with `micros()`.
+  uint32_t stamp = TC0->COUNT32.CC[0].reg;
+  uint32_t now_us = micros();
+  TC0->COUNT32.CTRLBSET.reg = TC_CTRLBSET_CMD_READSYNC;
+  while (TC0->COUNT32.SYNCBUSY.bit.CTRLB) {}
+  while (TC0->COUNT32.CTRLBSET.bit.CMD) {}
+  uint32_t count = TC0->COUNT32.COUNT.reg;
+
+  uint8_t next = (_head + 1) % RING_LEN;
+  if ((stamp == STAMP_OVERFLOW) || (next == _tail)) {
+    _N_lost++;
+    return;
+  }
+
+  _ring[_head] = now_us - (count - stamp) / TICKS_PER_US;
+  _head = next;
+}
+
+void TC0_Handler() {
+  if (instance) {
+    instance->isr();
+  }
+}
+
+#else
+
+bool EdgeCapture::begin(uint8_t pin) {
+  (void)pin;
+  return false;
+}
+
+void EdgeCapture::isr() {}
+
+#endif
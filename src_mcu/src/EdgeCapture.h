@@ -0,0 +1,108 @@
+/**
+ * @file    EdgeCapture.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Hardware time stamping of the edges on a digital input on the
+ * SAMD51, to measure when the valves actually got switched, see
+ * `TimingHarness`.
+ *
+ * Each edge, rising or falling, on the input pin gets routed by the external
+ * interrupt controller (EIC) over the event system (EVSYS) into the TC0
+ * peripheral, which captures its counter into CC0 at that very moment. The
+ * capture interrupt only converts the captured count onto the `micros()` time
+ * track and pushes it onto a ring buffer, to be drained by the main loop. A
+ * capture interrupt that got held up, e.g. by the playback timer writing out
+ * the valves with the interrupts disabled, does not affect the time stamp.
+ *
+ * TC0 and TC1 run together as a single 32-bit counter at 3 MHz (48 MHz GCLK1
+ * / 16), giving a resolution of 1/3 µs. The counter overflows once per ~24
+ * minutes. An edge arriving right after an overflow gets discarded.
+ *
+ * On boards other than the SAMD51 the capture is not available, see
+ * `EdgeCapture::available()`.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef EDGE_CAPTURE_H_
+#define EDGE_CAPTURE_H_
+
+#include <Arduino.h>
+
+/*------------------------------------------------------------------------------
+  EdgeCapture
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Class to time stamp the edges on a digital input in hardware.
+ *
+ * Only a single instance can exist, because it claims the TC0 and TC1
+ * peripherals, their interrupt handler and event system channel 0.
+ */
+class EdgeCapture {
+public:
+  /**
+   * @brief Configure the pin, the EIC, the event channel and TC0/TC1, and
+   * start capturing.
+   *
+   * @param pin Digital input pin, which must be able to generate an external
+   * interrupt that is not in use by any other pin
+   * @return True when successful. False when not available on this board.
+   */
+  bool begin(uint8_t pin);
+
+  /**
+   * @brief Is the capture available on this board?
+   */
+  static constexpr bool available() {
+#if defined(__SAMD51__)
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  /**
+   * @brief Discard all captured edges and reset the lost count.
+   */
+  void clear();
+
+  /**
+   * @brief Return the time stamp of the oldest captured edge on the `micros()`
+   * time track in @p t_us, leaving it in the ring buffer.
+   *
+   * @return False when there are no captured edges. True otherwise.
+   */
+  bool peek(uint32_t &t_us) const;
+
+  /**
+   * @brief Take the oldest captured edge out of the ring buffer.
+   *
+   * @return False when there are no captured edges. True otherwise.
+   */
+  bool pop(uint32_t &t_us);
+
+  /**
+   * @brief Return the number of edges lost: Because the ring buffer was full,
+   * because a second edge arrived before the first got read out, or because
+   * the counter had just overflowed.
+   */
+  inline uint32_t get_N_lost() const { return _N_lost; }
+
+  /**
+   * @brief To be called exclusively from within the TC0 interrupt handler.
+   */
+  void isr();
+
+private:
+  static const uint8_t RING_LEN = 64; // Capacity of the ring buffer + 1
+
+  volatile uint32_t _ring[RING_LEN]; // Time stamps [µs]
+  volatile uint8_t _head = 0;        // Written by the interrupt
+  volatile uint8_t _tail = 0;        // Written by the main loop
+  volatile uint32_t _N_lost = 0;
+};
+
+#endif
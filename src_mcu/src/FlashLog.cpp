@@ -0,0 +1,289 @@
+/**
+ * @file    FlashLog.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "FlashLog.h"
+#include "PressureScale.h"
+
+// See `main.cpp`
+extern const uint8_t BUF_LEN; // Common character buffer for string formatting
+extern char buf[];            // Common character buffer for string formatting
+
+// Marks a valid sector header: "TWTL"
+const uint32_t FLASH_LOG_MAGIC = 0x4C545754;
+
+// Value of `FlashLogRecord::type` of an erased slot
+const uint8_t FLOG_ERASED = 0xFF;
+
+/*------------------------------------------------------------------------------
+  FlashLog
+------------------------------------------------------------------------------*/
+
+bool FlashLog::begin(QSPIFlash *flash, uint32_t used_end) {
+  _flash = flash;
+  _available = (_flash->size() >= 2 * (WEAR_JOURNAL_SIZE + FLASH_LOG_SIZE));
+  _start = _flash->size() - WEAR_JOURNAL_SIZE - FLASH_LOG_SIZE;
+  _available &= (used_end <= _start);
+  if (!_available) {
+    return false;
+  }
+
+  // Pick the sector with the highest sequence number
+  int16_t best_sec = -1;
+  for (uint8_t sec = 0; sec < FLASH_LOG_SECTORS; ++sec) {
+    Header header;
+    if (read_header(sec, header) &&
+        ((best_sec < 0) || ((int32_t)(header.seq - _seq) > 0))) {
+      best_sec = sec;
+      _seq = header.seq;
+    }
+  }
+
+  if (best_sec < 0) {
+    // Unformatted log: Start out empty
+    _flash->erase_sector(sector_addr(0));
+    Header header = {FLASH_LOG_MAGIC, 0, {0, 0}};
+    _flash->write(sector_addr(0), &header, sizeof(header));
+    _head_sec = 0;
+    _seq = 0;
+    _head_slot = 1;
+  } else {
+    // Find the first erased slot, page by page
+    _head_sec = best_sec;
+    _head_slot = SLOTS_PER_SECTOR;
+    for (uint16_t slot = 0; slot < SLOTS_PER_SECTOR; ++slot) {
+      if (slot % SLOTS_PER_PAGE == 0) {
+        _flash->read(sector_addr(_head_sec) + slot * sizeof(FlashLogRecord),
+                     _page, sizeof(_page));
+      }
+      const FlashLogRecord *rec =
+          (const FlashLogRecord *)_page + slot % SLOTS_PER_PAGE;
+      if ((slot > 0) && (rec->type == FLOG_ERASED)) {
+        _head_slot = slot;
+        break;
+      }
+    }
+  }
+
+  // The sector ahead must be erased, unless blank already
+  uint8_t ahead = (_head_sec + 1) % FLASH_LOG_SECTORS;
+  bool blank = true;
+  for (uint32_t ofs = 0; ofs < QSPIFlash::SECTOR_SIZE && blank;
+       ofs += sizeof(_page)) {
+    _flash->read(sector_addr(ahead) + ofs, _page, sizeof(_page));
+    for (uint16_t idx = 0; idx < sizeof(_page) && blank; ++idx) {
+      blank = (_page[idx] == 0xFF);
+    }
+  }
+  if (!blank) {
+    _flash->erase_sector(sector_addr(ahead));
+  }
+
+  if (_head_slot == SLOTS_PER_SECTOR) {
+    next_sector();
+  } else {
+    // Continue the partially written page
+    uint16_t first = _head_slot - _head_slot % SLOTS_PER_PAGE;
+    _flash->read(sector_addr(_head_sec) + first * sizeof(FlashLogRecord),
+                 _page, sizeof(_page));
+  }
+
+  return true;
+}
+
+bool FlashLog::read_header(uint8_t sec, Header &header) {
+  _flash->read(sector_addr(sec), &header, sizeof(header));
+  return (header.magic == FLASH_LOG_MAGIC);
+}
+
+void FlashLog::set_period(uint16_t period_ms, bool log_lines) {
+  _period_ms = _available ? period_ms : 0;
+  _log_lines = log_lines;
+  _tick_period = millis();
+  _N_samples = 0;
+  _last_state = 0xFF;
+  _last_line = 0xFFFF;
+
+  if (_period_ms == 0) {
+    flush();
+    return;
+  }
+
+  FlashLogRecord rec;
+  rec.time_ms = _tick_period;
+  rec.type = FLOG_START;
+  rec.fsm_state = 0;
+  rec.line_no = 0;
+  memcpy(rec.pres_mbar, _last_mbar, sizeof(rec.pres_mbar));
+  push(rec);
+}
+
+void FlashLog::add_pressure(const int16_t (&pres_mbar)[N_R_CLICKS]) {
+  if (_period_ms == 0) {
+    return;
+  }
+
+  if (_N_samples == 0) {
+    memset(_sum_mbar, 0, sizeof(_sum_mbar));
+    memset(_fault, 0, sizeof(_fault));
+  }
+  for (uint8_t ch = 0; ch < N_R_CLICKS; ++ch) {
+    _sum_mbar[ch] += pres_mbar[ch];
+    _fault[ch] |= (pres_mbar[ch] == PRESSURE_FAULT);
+    _last_mbar[ch] = pres_mbar[ch];
+  }
+  _N_samples++;
+}
+
+void FlashLog::update(uint8_t fsm_state, uint16_t line_no) {
+  if (_period_ms == 0) {
+    return;
+  }
+
+  uint32_t now = millis();
+  FlashLogRecord rec;
+  rec.time_ms = now;
+  rec.fsm_state = fsm_state;
+  rec.line_no = line_no;
+
+  if (_log_lines && ((line_no != _last_line) || (fsm_state != _last_state))) {
+    rec.type = FLOG_LINE;
+    memcpy(rec.pres_mbar, _last_mbar, sizeof(rec.pres_mbar));
+    push(rec);
+  }
+  _last_line = line_no;
+  _last_state = fsm_state;
+
+  if (now - _tick_period >= _period_ms) {
+    _tick_period = now;
+    if (_N_samples > 0) {
+      rec.type = FLOG_PRESSURE;
+      for (uint8_t ch = 0; ch < N_R_CLICKS; ++ch) {
+        rec.pres_mbar[ch] =
+            _fault[ch] ? PRESSURE_FAULT : _sum_mbar[ch] / (int32_t)_N_samples;
+      }
+      _N_samples = 0;
+      push(rec);
+    }
+  }
+
+  if (_dirty && (_page_full || (now - _tick_dirty >= FLASH_LOG_FLUSH_MS)) &&
+      !_flash->is_busy()) {
+    write_page();
+  }
+}
+
+void FlashLog::push(const FlashLogRecord &rec) {
+  if (!_available || _page_full) {
+    _N_dropped++;
+    return;
+  }
+
+  memcpy(_page + (_head_slot % SLOTS_PER_PAGE) * sizeof(rec), &rec,
+         sizeof(rec));
+  if (!_dirty) {
+    _dirty = true;
+    _tick_dirty = millis();
+  }
+  _head_slot++;
+  _page_full = (_head_slot % SLOTS_PER_PAGE == 0);
+  _N_logged++;
+}
+
+void FlashLog::write_page() {
+  // Programming the page again leaves the records already in flash alone and
+  // the erased bytes erased
+  uint16_t first = (_head_slot - 1) - (_head_slot - 1) % SLOTS_PER_PAGE;
+  _flash->write(sector_addr(_head_sec) + first * sizeof(FlashLogRecord), _page,
+                sizeof(_page));
+  _dirty = false;
+
+  if (_page_full) {
+    _page_full = false;
+    memset(_page, 0xFF, sizeof(_page));
+    if (_head_slot == SLOTS_PER_SECTOR) {
+      next_sector();
+    }
+  }
+}
+
+void FlashLog::next_sector() {
+  _head_sec = (_head_sec + 1) % FLASH_LOG_SECTORS;
+  _seq++;
+  _head_slot = 1;
+
+  Header header = {FLASH_LOG_MAGIC, _seq, {0, 0}};
+  memset(_page, 0xFF, sizeof(_page));
+  memcpy(_page, &header, sizeof(header));
+  _flash->write(sector_addr(_head_sec), &header, sizeof(header));
+
+  _flash->start_erase_sector(
+      sector_addr((_head_sec + 1) % FLASH_LOG_SECTORS));
+}
+
+void FlashLog::flush() {
+  if (_dirty) {
+    write_page();
+  }
+}
+
+void FlashLog::rewind() {
+  if (!_available) {
+    _rd_done = true;
+    return;
+  }
+
+  flush();
+  _rd_sec = (_head_sec + 1) % FLASH_LOG_SECTORS;
+  _rd_slot = 1;
+  _rd_done = false;
+}
+
+uint16_t FlashLog::read(FlashLogRecord *out, uint16_t max_N) {
+  uint16_t N = 0;
+  while (!_rd_done && (N < max_N)) {
+    Header header;
+    bool head = (_rd_sec == _head_sec);
+    uint16_t end_slot = head ? _head_slot : SLOTS_PER_SECTOR;
+    uint16_t N_read = 0;
+
+    // The oldest sectors may not have been written yet, or be erased already
+    if (read_header(_rd_sec, header) && (_rd_slot < end_slot)) {
+      N_read = min((uint16_t)(end_slot - _rd_slot), (uint16_t)(max_N - N));
+      _flash->read(sector_addr(_rd_sec) + _rd_slot * sizeof(FlashLogRecord),
+                   &out[N], N_read * sizeof(FlashLogRecord));
+
+      // Records still in RAM read as erased
+      for (uint16_t idx = 0; idx < N_read; ++idx) {
+        if (out[N + idx].type == FLOG_ERASED) {
+          N_read = idx;
+          end_slot = _rd_slot + idx;
+          break;
+        }
+      }
+      N += N_read;
+      _rd_slot += N_read;
+    }
+
+    if ((N_read == 0) || (_rd_slot >= end_slot)) {
+      // Move on to the next sector
+      _rd_done = head;
+      _rd_sec = (_rd_sec + 1) % FLASH_LOG_SECTORS;
+      _rd_slot = 1;
+    }
+  }
+  return N;
+}
+
+void FlashLog::print(Stream &mySerial) const {
+  snprintf(buf, BUF_LEN, "%u\t%u\t%u\t%lu\t%lu\t%lu\t%u\t%u\n", _available,
+           _period_ms, _log_lines, (unsigned long)_N_logged,
+           (unsigned long)_N_dropped,
+           (unsigned long)FLASH_LOG_SECTORS * (SLOTS_PER_SECTOR - 1),
+           _head_sec, _head_slot);
+  mySerial.print(buf);
+}
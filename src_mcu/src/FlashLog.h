@@ -0,0 +1,227 @@
+/**
+ * @file    FlashLog.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Standalone telemetry logger into the QSPI flash of the Feather M4,
+ * for long unattended runs without a PC listening. Logs decimated pressure
+ * samples of the manifolds and, optionally, the protocol line switches, to be
+ * downloaded in bulk afterwards.
+ *
+ * The pressures handed over by `add_pressure()` get averaged over each logging
+ * period, see `set_period()`, into a single `FLOG_PRESSURE` record. Line
+ * switches and state changes get detected by polling the protocol position in
+ * `update()`, hence a line shorter than a main loop iteration may go by
+ * unnoticed, which then shows as a gap in the logged line numbers.
+ *
+ * Records get collected in RAM per flash page and the page gets programmed
+ * once full, or once `FLASH_LOG_FLUSH_MS` has passed. The sector ahead of the
+ * one being written gets erased in the background, see
+ * `QSPIFlash::start_erase_sector()`, such that logging never waits ~50 ms on
+ * an erase. A record arriving while a full page still waits on an erase gets
+ * dropped and counted instead. At most `FLASH_LOG_FLUSH_MS` of records get
+ * lost on power failure.
+ *
+ * @section Flash layout
+ * The `FLASH_LOG_SECTORS` sectors right below the `WearJournal` form a ring,
+ * kept out of reach of the `ProtocolLibrary`. Each sector starts with a header
+ * holding a sequence number, followed by 255 record slots. Once the ring is
+ * full, the oldest sector gets overwritten. An erased slot marks the end of
+ * the log.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef FLASH_LOG_H_
+#define FLASH_LOG_H_
+
+#include <Arduino.h>
+
+#include "QSPIFlash.h"
+#include "RClickDAQ.h"
+#include "WearJournal.h"
+
+// Number of flash sectors holding the log, right below the wear journal
+const uint8_t FLASH_LOG_SECTORS = 64;
+
+// Bytes right below the wear journal holding the log
+const uint32_t FLASH_LOG_SIZE = FLASH_LOG_SECTORS * QSPIFlash::SECTOR_SIZE;
+
+// Maximum time [ms] records may wait in RAM before getting written to flash
+const uint16_t FLASH_LOG_FLUSH_MS = 1000;
+
+/**
+ * @brief Values of `FlashLogRecord::type`.
+ */
+enum FlashLogType : uint8_t {
+  FLOG_START = 1,    // Logging got (re)started
+  FLOG_PRESSURE = 2, // Mean pressures over the logging period
+  FLOG_LINE = 3,     // Protocol line switch or state change
+};
+
+/**
+ * @brief A single log record, little endian.
+ */
+struct __attribute__((packed)) FlashLogRecord {
+  uint32_t time_ms;              // Timestamp [ms] since boot
+  uint8_t type;                  // See `FlashLogType`, 0xFF when erased
+  uint8_t fsm_state;             // See `TelemetryState`
+  uint16_t line_no;              // Protocol position, starting at index 0
+  int16_t pres_mbar[N_R_CLICKS]; // Pressure of each manifold [mbar]
+};
+
+static_assert(sizeof(FlashLogRecord) == 16, "FlashLogRecord got padded");
+
+/*------------------------------------------------------------------------------
+  FlashLog
+------------------------------------------------------------------------------*/
+
+class FlashLog {
+public:
+  /**
+   * @brief Find the end of the log in flash and continue from there. An
+   * unformatted log starts out empty. The flash must have been set up
+   * already, see `QSPIFlash::begin()`.
+   *
+   * @param used_end Flash address past the stored programs, see
+   * `ProtocolLibrary::get_used_end()`. The log is not available when they
+   * reach into it.
+   *
+   * @return True when the log is available. False otherwise.
+   */
+  bool begin(QSPIFlash *flash, uint32_t used_end);
+
+  inline bool available() const { return _available; }
+
+  /**
+   * @brief Start logging the mean pressures every @p period_ms, and the line
+   * switches when @p log_lines is set, or stop logging when @p period_ms is 0.
+   * Starting appends a `FLOG_START` record.
+   */
+  void set_period(uint16_t period_ms, bool log_lines);
+
+  inline uint16_t get_period() const { return _period_ms; }
+
+  /**
+   * @brief Add a reading of all manifolds to the mean of the present logging
+   * period. A sensor in the fault state turns its mean into `PRESSURE_FAULT`.
+   */
+  void add_pressure(const int16_t (&pres_mbar)[N_R_CLICKS]);
+
+  /**
+   * @brief Append the records that are due, given FSM state @p fsm_state and
+   * protocol position @p line_no, and write the page to flash when due and
+   * the flash is not busy erasing. Call from within the main loop.
+   */
+  void update(uint8_t fsm_state, uint16_t line_no);
+
+  /**
+   * @brief Write the records collected in RAM to flash right away, waiting on
+   * an erase in progress.
+   */
+  void flush();
+
+  /**
+   * @brief Flush and start reading the log from its oldest record onwards,
+   * see `read()`.
+   */
+  void rewind();
+
+  /**
+   * @brief Read up to @p max_N records from the log into @p out, continuing
+   * where the previous call left off.
+   *
+   * @return The number of records read, 0 when the end of the log is reached.
+   */
+  uint16_t read(FlashLogRecord *out, uint16_t max_N);
+
+  /**
+   * @brief Print the status, tab delimited:
+   *   1) Is the log available?
+   *   2) Logging period [ms], 0 when stopped
+   *   3) Are the line switches logged?
+   *   4) Number of records logged since boot
+   *   5) Number of records dropped since boot
+   *   6) Capacity of the log [records]
+   *   7) Sector being written, starting at index 0
+   *   8) Slot being written within that sector
+   */
+  void print(Stream &mySerial) const;
+
+private:
+  struct Header {
+    uint32_t magic;
+    uint32_t seq; // Sequence number, incremented per sector
+    uint32_t reserved[2];
+  };
+
+  static_assert(sizeof(Header) == sizeof(FlashLogRecord),
+                "Flash log header must fill a record slot");
+
+  static const uint16_t SLOTS_PER_SECTOR =
+      QSPIFlash::SECTOR_SIZE / sizeof(FlashLogRecord);
+  static const uint16_t SLOTS_PER_PAGE =
+      QSPIFlash::PAGE_SIZE / sizeof(FlashLogRecord);
+
+  QSPIFlash *_flash = nullptr;
+  bool _available = false;
+  uint32_t _start = 0; // Flash address of the log
+
+  // Writing
+  uint8_t _head_sec = 0;    // Sector being written
+  uint16_t _head_slot = 0;  // Next slot to be written within that sector
+  uint32_t _seq = 0;        // Sequence number of that sector
+  bool _dirty = false;      // Does the page hold records not in flash yet?
+  bool _page_full = false;  // Is the page waiting to be written, full?
+  uint32_t _tick_dirty = 0; // Time [ms] the page got dirty
+
+  // Mirror of the flash page being written, erased bytes being 0xFF
+  uint8_t _page[QSPIFlash::PAGE_SIZE];
+
+  // Logging
+  uint16_t _period_ms = 0; // Logging period [ms], 0 when stopped
+  bool _log_lines = false;
+  uint32_t _tick_period = 0; // Start time [ms] of the logging period
+  int32_t _sum_mbar[N_R_CLICKS] = {};
+  bool _fault[N_R_CLICKS] = {};
+  uint32_t _N_samples = 0;
+  int16_t _last_mbar[N_R_CLICKS] = {}; // Most recent reading
+  uint8_t _last_state = 0xFF;
+  uint16_t _last_line = 0xFFFF;
+  uint32_t _N_logged = 0;
+  uint32_t _N_dropped = 0;
+
+  // Reading
+  uint8_t _rd_sec = 0;
+  uint16_t _rd_slot = 0;
+  bool _rd_done = true;
+
+  inline uint32_t sector_addr(uint8_t sec) const {
+    return _start + sec * QSPIFlash::SECTOR_SIZE;
+  }
+
+  /**
+   * @brief Read the header of sector @p sec, returning true when valid.
+   */
+  bool read_header(uint8_t sec, Header &header);
+
+  /**
+   * @brief Append @p rec to the page in RAM, or drop it when the page is full.
+   */
+  void push(const FlashLogRecord &rec);
+
+  /**
+   * @brief Program the page in RAM into flash, and move on to the next page,
+   * or sector, when full.
+   */
+  void write_page();
+
+  /**
+   * @brief Move on to the next sector, which must have been erased, writing
+   * its header, and start erasing the sector after it.
+   */
+  void next_sector();
+};
+
+#endif
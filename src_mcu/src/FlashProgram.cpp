@@ -0,0 +1,245 @@
+/**
+ * @file    FlashProgram.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "FlashProgram.h"
+#include "crc32.h"
+
+#if PROTOCOL_COMPRESSED == COMPRESSION_DELTA
+
+extern const uint8_t BUF_LEN;
+extern char buf[];
+
+/*------------------------------------------------------------------------------
+  FlashProgram
+------------------------------------------------------------------------------*/
+
+bool FlashProgram::open(QSPIFlash *flash, uint32_t addr, uint16_t N_lines,
+                        uint32_t N_bytes, uint32_t crc) {
+  close();
+  if (N_lines > PROTOCOL_MAX_LINES) {
+    return false;
+  }
+
+  // Walk over all records, like `Program::restore()`, to locate the keyframes.
+  // The image gets read chunk by chunk into `_raw`, refilled whenever the
+  // largest record might not fit in the remainder.
+  uint32_t chunk_ofs = 0; // Image offset of the chunk held in `_raw`
+  uint32_t chunk_end = 0; // Image offset past the chunk
+  uint32_t crc_check = 0; // CRC32 of the image up to `chunk_end`
+  uint32_t ofs = 0;       // Image offset of the next record
+  uint8_t run = 0;        // Remaining repeats of the last record
+  PackedLine line;        // Merely to step over the records
+  line.masks.fill(0);
+  for (uint16_t idx = 0; idx < N_lines; ++idx) {
+    bool keyframe = (idx % PROTOCOL_CHECKPOINT_INTERVAL == 0);
+    if (run > 0) {
+      if (keyframe) {
+        return false; // Runs never extend across a keyframe
+      }
+      run--;
+      continue;
+    }
+    if (ofs >= N_bytes) {
+      return false; // Records exhausted before all lines were found
+    }
+    if (keyframe) {
+      _ofs[idx / PROTOCOL_CHECKPOINT_INTERVAL] = ofs;
+    }
+
+    if ((ofs + PROTOCOL_RECORD_MAX_BYTES > chunk_end) &&
+        (chunk_end < N_bytes)) {
+      uint32_t len = min(N_bytes - ofs, (uint32_t)RAW_BYTES);
+      if (!flash->read(addr + ofs, _raw, len)) {
+        return false;
+      }
+      crc_check = crc32(_raw + (chunk_end - ofs), ofs + len - chunk_end,
+                        crc_check);
+      chunk_ofs = ofs;
+      chunk_end = ofs + len;
+    }
+
+    const uint8_t *rec = &_raw[ofs - chunk_ofs];
+    ofs += Program::decode_record(rec, line, run) - rec;
+  }
+
+  if ((ofs != N_bytes) || (run != 0)) {
+    return false;
+  }
+
+  // The records cover the full image, hence all of it got checked
+  if (crc_check != crc) {
+    return false;
+  }
+
+  _N_blocks = (N_lines + PROTOCOL_CHECKPOINT_INTERVAL - 1) /
+              PROTOCOL_CHECKPOINT_INTERVAL;
+  _ofs[_N_blocks] = N_bytes;
+  _addr = addr;
+  _N_bytes = N_bytes;
+  _N_lines = N_lines;
+  _want = 0;
+  for (Block &block : _blocks) {
+    block.seg = -1;
+  }
+  _N_fills = 0;
+  _N_seeks = 0;
+  _N_stalls = 0;
+  _N_errors = 0;
+  _flash = flash;
+  return true;
+}
+
+void FlashProgram::close() {
+  if (_flash && (_fill_slot >= 0)) {
+    while (_flash->is_reading()) {}
+  }
+  _fill_slot = -1;
+  _flash = nullptr;
+  _N_lines = 0;
+  _N_bytes = 0;
+}
+
+int8_t FlashProgram::find(uint16_t seg) const {
+  for (int8_t slot = 0; slot <= FLASH_PREFETCH_BLOCKS; ++slot) {
+    if (_blocks[slot].seg == seg) {
+      return slot;
+    }
+  }
+  return -1;
+}
+
+int8_t FlashProgram::victim() const {
+  for (int8_t slot = 0; slot < FLASH_PREFETCH_BLOCKS; ++slot) {
+    if ((slot != _fill_slot) &&
+        ((_blocks[slot].seg < 0) || !in_window(_blocks[slot].seg))) {
+      return slot;
+    }
+  }
+  // Unreachable, as a block is missing from the window
+  return FLASH_PREFETCH_BLOCKS - 1;
+}
+
+bool FlashProgram::decode(uint16_t seg, Block &block) {
+  const uint8_t *rec = _raw;
+  const uint8_t *end = _raw + block_bytes(seg);
+  PackedLine line;
+  uint8_t run = 0;
+
+  block.seg = -1;
+  line.duration = 0;
+  line.masks.fill(0); // Keyframe
+  for (uint16_t idx = 0; idx < block_lines(seg); ++idx) {
+    if (run > 0) {
+      run--;
+    } else if (rec < end) {
+      rec = Program::decode_record(rec, line, run);
+    } else {
+      return false;
+    }
+    block.lines[idx] = line;
+  }
+  if ((rec != end) || (run != 0)) {
+    return false;
+  }
+
+  block.seg = seg;
+  return true;
+}
+
+void FlashProgram::finish_fill() {
+  if (_fill_slot < 0) {
+    return;
+  }
+  while (_flash->is_reading()) {}
+
+  if (decode(_fill_seg, _blocks[_fill_slot])) {
+    _N_fills++;
+  } else {
+    _N_errors++;
+  }
+  _fill_slot = -1;
+}
+
+void FlashProgram::update() {
+  if ((_flash == nullptr) || (_N_blocks == 0)) {
+    return;
+  }
+  if (_fill_slot >= 0) {
+    if (_flash->is_reading()) {
+      return;
+    }
+    finish_fill();
+  }
+
+  // Start reading the first block missing from the window
+  for (uint16_t i = 0; i < FLASH_PREFETCH_BLOCKS; ++i) {
+    uint16_t seg = (_want + i) % _N_blocks;
+    if (find(seg) >= 0) {
+      continue;
+    }
+    int8_t slot = victim();
+    if (_flash->start_read(_addr + _ofs[seg], _raw, block_bytes(seg))) {
+      _fill_slot = slot;
+      _fill_seg = seg;
+    }
+    return; // Else, retry on the next call
+  }
+}
+
+bool FlashProgram::try_get(uint16_t idx, PackedLine &output) const {
+  int8_t slot = find(idx / PROTOCOL_CHECKPOINT_INTERVAL);
+  if (slot < 0) {
+    return false;
+  }
+  output = _blocks[slot].lines[idx % PROTOCOL_CHECKPOINT_INTERVAL];
+  return true;
+}
+
+void FlashProgram::get(uint16_t idx, PackedLine &output) {
+  if (try_get(idx, output)) {
+    return;
+  }
+
+  // The block might be the one being read in
+  finish_fill();
+  if (try_get(idx, output)) {
+    return;
+  }
+
+  // Read the block right away: Into the window when the playback outran the
+  // prefetch, into the spare block otherwise
+  uint16_t seg = idx / PROTOCOL_CHECKPOINT_INTERVAL;
+  Block *block;
+  if (in_window(seg)) {
+    block = &_blocks[victim()];
+    _N_stalls++;
+  } else {
+    block = &_blocks[FLASH_PREFETCH_BLOCKS];
+    _N_seeks++;
+  }
+
+  if (!_flash->read(_addr + _ofs[seg], _raw, block_bytes(seg)) ||
+      !decode(seg, *block)) {
+    // The image got verified when opened, hence merely close all valves
+    _N_errors++;
+    output.duration = 0;
+    output.masks.fill(0);
+    return;
+  }
+  output = block->lines[idx % PROTOCOL_CHECKPOINT_INTERVAL];
+}
+
+void FlashProgram::print(Stream &mySerial) const {
+  snprintf(buf, BUF_LEN, "%u\t%lu\t%u\t%lu\t%lu\t%lu\t%lu\n", _N_lines,
+           (unsigned long)_N_bytes, is_open() ? _want : 0,
+           (unsigned long)_N_fills, (unsigned long)_N_seeks,
+           (unsigned long)_N_stalls, (unsigned long)_N_errors);
+  mySerial.print(buf);
+}
+
+#endif
@@ -0,0 +1,208 @@
+/**
+ * @file    FlashProgram.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Plays a compressed protocol program in place from the QSPI flash,
+ * see `ProtocolLibrary::play()`, instead of loading it into memory first.
+ * Hence, the length of a program is bound by the flash instead of by the
+ * memory of the program slot.
+ *
+ * The lines get decoded block by block, a block being the lines from one
+ * keyframe up to the next, see `PROTOCOL_CHECKPOINT_INTERVAL`. A window of
+ * `FLASH_PREFETCH_BLOCKS` decoded blocks follows the playback position, as
+ * hinted by `Program::hint()`. The DMA reads the next block missing from the
+ * window in the background, after which the main loop decodes it, see
+ * `FlashProgram::update()`. Random access outside of the window, e.g. by
+ * `goto_line()` or the scrubbing, reads its block right away into a spare
+ * block, leaving the window alone.
+ *
+ * Requires `COMPRESSION_DELTA`.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef FLASH_PROGRAM_H_
+#define FLASH_PROGRAM_H_
+
+#include "ProtocolManager.h"
+#include "QSPIFlash.h"
+
+#include <Arduino.h>
+
+#if PROTOCOL_COMPRESSED == COMPRESSION_DELTA
+
+/**
+ * @brief Number of decoded blocks kept ahead of the playback position. At
+ * least 2, such that one block plays while the next one gets read in.
+ */
+#  ifndef FLASH_PREFETCH_BLOCKS
+#    define FLASH_PREFETCH_BLOCKS 3
+#  endif
+
+#  if FLASH_PREFETCH_BLOCKS < 2
+#    error "FLASH_PREFETCH_BLOCKS must be at least 2"
+#  endif
+
+/*------------------------------------------------------------------------------
+  FlashProgram
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Reader of a compressed program image in the QSPI flash, prefetching
+ * the blocks of lines ahead of the playback position. Attached to a `Program`
+ * via `Program::attach_flash()`, which forwards its accesses.
+ */
+class FlashProgram {
+public:
+  /**
+   * @brief Open the program image of @p N_bytes bytes holding @p N_lines
+   * lines at flash address @p addr, as produced by `Program::image()`. Reads
+   * the full image once to locate its keyframes and to verify it against its
+   * CRC32 checksum @p crc. Takes ~0.2 s for a 600 kB image.
+   *
+   * @return True when successful. False otherwise, because the image is
+   * inconsistent or unreadable, leaving the reader closed.
+   */
+  bool open(QSPIFlash *flash, uint32_t addr, uint16_t N_lines,
+            uint32_t N_bytes, uint32_t crc);
+
+  /**
+   * @brief Close the reader, finishing any read in progress.
+   */
+  void close();
+
+  inline bool is_open() const { return _flash != nullptr; }
+
+  /**
+   * @brief Return the flash address of the open image.
+   */
+  inline uint32_t get_addr() const { return _addr; }
+
+  /**
+   * @brief Return the size of the open image [bytes].
+   */
+  inline uint32_t get_N_bytes() const { return _N_bytes; }
+
+  inline uint16_t size() const { return _N_lines; }
+
+  /**
+   * @brief Retrieve line number @p idx, reading its block from flash right
+   * away when not decoded yet. The line number must be valid.
+   *
+   * @param output Reference to a `PackedLine` to write into.
+   */
+  void get(uint16_t idx, PackedLine &output);
+
+  /**
+   * @brief Retrieve line number @p idx only when its block is decoded
+   * already, without touching the flash.
+   *
+   * @return True when successful. False otherwise.
+   */
+  bool try_get(uint16_t idx, PackedLine &output) const;
+
+  /**
+   * @brief Move the prefetch window to start at the block of line number
+   * @p idx, being the line up next.
+   */
+  inline void hint(uint16_t idx) {
+    _want = idx / PROTOCOL_CHECKPOINT_INTERVAL;
+  }
+
+  /**
+   * @brief Advance the prefetch: decode the block the DMA has read in, if
+   * any, and start reading the next block missing from the window. To be
+   * called repeatedly from within the main loop.
+   */
+  void update();
+
+  /**
+   * @brief Print the state of the reader, tab delimited: Number of lines,
+   * number of bytes, first block of the window, blocks prefetched, reads
+   * outside of the window, reads of the window the prefetch had not finished
+   * yet, i.e. stalls, and read errors. All zero when closed.
+   */
+  void print(Stream &mySerial) const;
+
+private:
+  // Largest number of bytes of a block of records
+  static const uint16_t RAW_BYTES =
+      PROTOCOL_CHECKPOINT_INTERVAL * PROTOCOL_RECORD_MAX_BYTES;
+
+  struct Block {
+    int32_t seg = -1; // Block number, -1 when empty
+    PackedLine lines[PROTOCOL_CHECKPOINT_INTERVAL];
+  };
+
+  QSPIFlash *_flash = nullptr; // Nullptr when closed
+  uint32_t _addr = 0;          // Flash address of the image
+  uint32_t _N_bytes = 0;       // Size of the image [bytes]
+  uint16_t _N_lines = 0;       // Number of lines of the image
+  uint16_t _N_blocks = 0;      // Number of blocks of the image
+
+  // Byte offset into the image of each block, plus the end of the image
+  std::array<uint32_t, PROTOCOL_MAX_LINES / PROTOCOL_CHECKPOINT_INTERVAL + 2>
+      _ofs;
+
+  // The window, followed by the spare block for random access
+  Block _blocks[FLASH_PREFETCH_BLOCKS + 1];
+  uint16_t _want = 0; // First block of the window, see `hint()`
+
+  // Read in progress by the DMA, see `update()`
+  uint8_t _raw[RAW_BYTES]; // Records of the block being read
+  int8_t _fill_slot = -1;  // Destination of the block, -1 when idle
+  uint16_t _fill_seg = 0;  // Block being read
+
+  // Statistics, see `print()`
+  uint32_t _N_fills = 0;
+  uint32_t _N_seeks = 0;
+  uint32_t _N_stalls = 0;
+  uint32_t _N_errors = 0;
+
+  inline uint16_t block_lines(uint16_t seg) const {
+    return min((uint32_t)_N_lines - seg * PROTOCOL_CHECKPOINT_INTERVAL,
+               (uint32_t)PROTOCOL_CHECKPOINT_INTERVAL);
+  }
+
+  inline uint32_t block_bytes(uint16_t seg) const {
+    return _ofs[seg + 1] - _ofs[seg];
+  }
+
+  /**
+   * @brief Is block @p seg part of the prefetch window?
+   */
+  inline bool in_window(uint16_t seg) const {
+    return (uint16_t)((seg + _N_blocks - _want) % _N_blocks) <
+           FLASH_PREFETCH_BLOCKS;
+  }
+
+  /**
+   * @brief Return the slot holding block @p seg, or -1 when none.
+   */
+  int8_t find(uint16_t seg) const;
+
+  /**
+   * @brief Return the slot of the window to read a missing block into: an
+   * empty one, or else one holding a block that left the window.
+   */
+  int8_t victim() const;
+
+  /**
+   * @brief Decode the records of block @p seg held in `_raw` into @p block.
+   *
+   * @return True when successful. False otherwise, because the records are
+   * inconsistent, leaving the block empty.
+   */
+  bool decode(uint16_t seg, Block &block);
+
+  /**
+   * @brief Wait for the read in progress by the DMA, if any, and decode it.
+   */
+  void finish_fill();
+};
+
+#endif
+
+#endif
@@ -0,0 +1,118 @@
+/**
+ * @file    HydrovarPump.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "HydrovarPump.h"
+#include "translations.h"
+
+/*------------------------------------------------------------------------------
+  HydrovarPump
+------------------------------------------------------------------------------*/
+
+void HydrovarPump::begin(uint32_t baudrate, uint8_t slave) {
+  _modbus.begin(baudrate, slave, on_reply, this);
+}
+
+void HydrovarPump::on_reply(const ModbusReply &reply, void *ctx) {
+  HydrovarPump *self = (HydrovarPump *)ctx;
+  self->_reply = reply;
+  if (reply.status != MODBUS_OK) {
+    return;
+  }
+
+  self->_tick_good = millis();
+  if (reply.func == ModbusMaster::FUNC_READ) {
+    if (reply.reg == HVLREG_ACTUAL_VALUE) {
+      self->_pres_mbar = (int16_t)reply.value * 10;
+    } else if (reply.reg == HVLREG_OUTPUT_FREQ) {
+      self->_freq_dHz = (int16_t)reply.value;
+    }
+  } else if (reply.reg == HVLREG_ACTUAT_FREQ_1) {
+    self->_f_written = reply.value;
+  }
+}
+
+void HydrovarPump::set_poll_period(uint16_t period_ms) {
+  _period_ms = period_ms;
+  _tick_poll = millis() - period_ms; // Poll right away
+}
+
+void HydrovarPump::set_pressure(int16_t mbar, int16_t max_mbar) {
+  _mode = PUMP_PRESSURE;
+  _setpoint = constrain(mbar, (int16_t)0, max_mbar);
+  _dirty = true;
+}
+
+void HydrovarPump::set_frequency(uint16_t dHz) {
+  _mode = PUMP_FREQUENCY;
+  _setpoint = min(dHz, (uint16_t)INT16_MAX);
+  _dirty = true;
+}
+
+void HydrovarPump::control_frequency(uint16_t dHz) {
+  _mode = PUMP_CONTROL;
+  _setpoint = min(dHz, (uint16_t)INT16_MAX);
+  if (dHz != _f_written) {
+    _modbus.write(HVLREG_ACTUAT_FREQ_1, dHz);
+  }
+}
+
+bool HydrovarPump::update() {
+  _modbus.update();
+
+  uint32_t now = millis();
+  if (!_period_ms || (now - _tick_poll < _period_ms)) {
+    return false;
+  }
+  _tick_poll = now;
+
+  if (_modbus.pending()) {
+    // The pump lags behind the polling. Skip this period instead of letting
+    // the requests pile up.
+    return false;
+  }
+
+  _modbus.read(HVLREG_ACTUAL_VALUE);
+  _modbus.read(HVLREG_OUTPUT_FREQ);
+
+  if (_dirty) {
+    if (_mode == PUMP_PRESSURE) {
+      _modbus.write(HVLREG_REQ_VAL_1, _setpoint / 10);
+    } else if (_mode == PUMP_FREQUENCY) {
+      _modbus.write(HVLREG_ACTUAT_FREQ_1, _setpoint);
+    }
+    _dirty = false;
+  }
+  return true;
+}
+
+ModbusStatus HydrovarPump::transact(uint16_t reg, bool write,
+                                    uint16_t &value) {
+  // Each request ends by itself, at the latest by timing out
+  while (_modbus.pending()) {
+    _modbus.update();
+  }
+
+  if (write) {
+    _modbus.write(reg, value);
+  } else {
+    _modbus.read(reg);
+  }
+  while (_modbus.pending()) {
+    _modbus.update();
+  }
+
+  value = _reply.value;
+  return _reply.status;
+}
+
+void HydrovarPump::print(Stream &mySerial) const {
+  snprintf(buf, BUF_LEN, "%u\t%u\t%d\t%d\t%d\t%u\t%lu\n", _period_ms, _mode,
+           _setpoint, _pres_mbar, _freq_dHz, _f_written,
+           (unsigned long)(millis() - _tick_good));
+  mySerial.print(buf);
+}
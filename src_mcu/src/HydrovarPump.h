@@ -0,0 +1,163 @@
+/**
+ * @file    HydrovarPump.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Control of the Xylem Hydrovar HVL pump controller straight from the
+ * Arduino over Modbus RTU, see `ModbusMaster`, instead of from the PC via
+ * `XylemHydrovarHVL_protocol_RTU.py`. Saves the USB round trip and the Python
+ * loop on each setpoint change.
+ *
+ * Once polling, the actual pressure and frequency get read from the pump each
+ * polling period. The setpoint can be either of:
+ *   - A pressure, regulated by the PID controller inside of the pump, which
+ *     must be in HVL mode 'controller' (P105 = 0).
+ *   - A frequency, which the pump must be in HVL mode 'actuator' (P105 = 3)
+ *     for.
+ *   - A frequency written each polling period by a controller on the
+ *     Arduino, see `PressureController`. Hence, the loop closes at tens of Hz
+ *     on the very pressures the valves see, instead of on the pressure sensor
+ *     of the pump. Requires HVL mode 'actuator' as well.
+ * A new setpoint gets written during the next polling period, the last one
+ * taking precedence.
+ *
+ * The one-off configuration of the pump, e.g. its HVL mode and starting or
+ * stopping it, goes via `transact()`, giving access to any register.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef HYDROVAR_PUMP_H_
+#define HYDROVAR_PUMP_H_
+
+#include <Arduino.h>
+
+#include "ModbusMaster.h"
+
+// Registers of the Hydrovar HVL, see `XylemHydrovarHVL_protocol_RTU.py`
+const uint16_t HVLREG_ACTUAL_VALUE = 0x0032;  // S16 [0.01 bar], read only
+const uint16_t HVLREG_OUTPUT_FREQ = 0x0033;   // S16 [0.1 Hz], read only
+const uint16_t HVLREG_REQ_VAL_1 = 0x00E8;     // U16 [0.01 bar], P820
+const uint16_t HVLREG_ACTUAT_FREQ_1 = 0x00EA; // U16 [0.1 Hz], P830
+
+/**
+ * @brief Values of `HydrovarPump::get_mode()`.
+ */
+enum PumpMode : uint8_t {
+  PUMP_IDLE,      // No setpoint written by the Arduino
+  PUMP_PRESSURE,  // Pressure setpoint, regulated by the pump
+  PUMP_FREQUENCY, // Frequency setpoint
+  PUMP_CONTROL,   // Frequency written by the controller on the Arduino
+};
+
+/*------------------------------------------------------------------------------
+  HydrovarPump
+------------------------------------------------------------------------------*/
+
+class HydrovarPump {
+public:
+  /**
+   * @param port UART wired to the RS485 transceiver
+   * @param pin_DE Driver enable pin of the transceiver, see `ModbusMaster`
+   */
+  HydrovarPump(HardwareSerial &port, uint8_t pin_DE) : _modbus(port, pin_DE) {}
+
+  /**
+   * @brief Open the UART at @p baudrate to talk to slave address @p slave.
+   * Polling starts out stopped, see `set_poll_period()`.
+   */
+  void begin(uint32_t baudrate, uint8_t slave);
+
+  /**
+   * @brief Poll the pump every @p period_ms, or stop polling when 0. Stopping
+   * also stops writing the setpoint.
+   */
+  void set_poll_period(uint16_t period_ms);
+
+  inline uint16_t get_poll_period() const { return _period_ms; }
+
+  /**
+   * @brief Have the pump regulate pressure @p mbar, limited to
+   * [0, @p max_mbar].
+   */
+  void set_pressure(int16_t mbar, int16_t max_mbar);
+
+  /**
+   * @brief Have the pump run at frequency @p dHz [0.1 Hz].
+   */
+  void set_frequency(uint16_t dHz);
+
+  /**
+   * @brief Have the pump run at frequency @p dHz [0.1 Hz] as computed by the
+   * controller on the Arduino, to be called right after `update()` returned
+   * true. Gets written during that same polling period, unless unchanged.
+   */
+  void control_frequency(uint16_t dHz);
+
+  inline PumpMode get_mode() const { return _mode; }
+
+  /**
+   * @brief Return the actual frequency last read from the pump [0.1 Hz].
+   */
+  inline int16_t get_frequency() const { return _freq_dHz; }
+
+  /**
+   * @brief Advance the Modbus traffic, and queue the polling and the setpoint
+   * when the polling period is due. Call from within the main loop.
+   *
+   * @return True when a polling period just started, i.e. the time for the
+   * controller to compute the next frequency. False otherwise.
+   */
+  bool update();
+
+  /**
+   * @brief Read register @p reg, or write @p value into it when @p write is
+   * set, waiting until done. The requests queued before get handled first.
+   *
+   * @param value Value to write, replaced by the value read or written, or by
+   * the exception code
+   * @return See `ModbusStatus`.
+   */
+  ModbusStatus transact(uint16_t reg, bool write, uint16_t &value);
+
+  /**
+   * @brief Print the status, tab delimited:
+   *   1) Polling period [ms], 0 when stopped
+   *   2) Mode, see `PumpMode`
+   *   3) Setpoint, pressure [mbar] or frequency [0.1 Hz] following the mode
+   *   4) Actual pressure read from the pump [mbar]
+   *   5) Actual frequency read from the pump [0.1 Hz]
+   *   6) Frequency last written [0.1 Hz]
+   *   7) Age of the last valid reply [ms]
+   */
+  void print(Stream &mySerial) const;
+
+  /**
+   * @brief Print the statistics of the Modbus traffic, see
+   * `ModbusMaster::print()`.
+   */
+  inline void print_modbus(Stream &mySerial) const { _modbus.print(mySerial); }
+
+private:
+  ModbusMaster _modbus;
+
+  uint16_t _period_ms = 0; // Polling period [ms], 0 when stopped
+  uint32_t _tick_poll = 0; // Start time [ms] of the polling period
+
+  PumpMode _mode = PUMP_IDLE;
+  int16_t _setpoint = 0;   // [mbar] or [0.1 Hz], following the mode
+  bool _dirty = false;     // Setpoint still to be written?
+  uint16_t _f_written = 0; // Frequency last written [0.1 Hz]
+
+  // Readings
+  int16_t _pres_mbar = 0;  // Actual pressure read from the pump [mbar]
+  int16_t _freq_dHz = 0;   // Actual frequency read from the pump [0.1 Hz]
+  uint32_t _tick_good = 0; // Time [ms] of the last valid reply
+
+  ModbusReply _reply; // Outcome of the last request, see `transact()`
+
+  static void on_reply(const ModbusReply &reply, void *ctx);
+};
+
+#endif
@@ -0,0 +1,231 @@
+/**
+ * @file    I2CEngine.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "I2CEngine.h"
+#include "Trace.h"
+
+/*------------------------------------------------------------------------------
+  I2CEngine
+------------------------------------------------------------------------------*/
+
+#if CP_I2C_DMA && defined(__SAMD51__)
+
+// I2C address of the MCP23017 chip of port 0. Each next port adds 1.
+const uint8_t MCP23017_ADDRESS = 0b0100000;
+
+// Register address of OLATA. OLATB follows by sequential addressing.
+const uint8_t MCP23017_OLATA = 0x14;
+
+// Time-out of a single port write, which normally takes ~40 µs at 1 MHz
+const uint32_t I2C_ENGINE_TIMEOUT = 2000; // [µs]
+
+// Time-out of the last data byte to be sent out, which normally takes ~9 µs
+const uint32_t I2C_ENGINE_BYTE_TIMEOUT = 100; // [µs]
+
+static I2CEngine *instance = nullptr;
+
+bool I2CEngine::begin(Sercom *hw1, uint8_t dmac_id1, Sercom *hw2,
+                      uint8_t dmac_id2) {
+  Sercom *hw[2] = {hw1, hw2};
+  uint8_t dmac_id[2] = {dmac_id1, dmac_id2};
+
+  _N_lanes = (hw2 && (hw2 != hw1)) ? 2 : 1;
+  for (uint8_t idx = 0; idx < _N_lanes; ++idx) {
+    Lane &lane = _lanes[idx];
+    lane.hw = hw[idx];
+
+    // One beat per 'master on bus' flag, i.e. per acknowledged byte
+    lane.dma.setTrigger(dmac_id[idx]);
+    lane.dma.setAction(DMA_TRIGGER_ACTON_BEAT);
+    if (lane.dma.allocate() != DMA_STATUS_OK) {
+      return false;
+    }
+    if (lane.dma.addDescriptor(lane.bytes, (void *)&lane.hw->I2CM.DATA.reg,
+                               sizeof(lane.bytes), DMA_BEAT_SIZE_BYTE, true,
+                               false) == NULL) {
+      return false;
+    }
+    lane.dma.setCallback(dma_callback);
+  }
+
+  instance = this;
+  return true;
+}
+
+void I2CEngine::write_ports(const uint16_t *values, uint8_t portmask) {
+  if (!portmask) {
+    return;
+  }
+
+  // Restore the previous state, because we might be called from an interrupt
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  for (uint8_t port = 0; port < N_PORTS; ++port) {
+    if ((portmask >> port) & 1) {
+      _values[port] = values[port];
+    }
+  }
+
+  if (!_busy) {
+    _busy = true;
+    _N_failed = 0;
+    _first = true;
+  }
+
+  for (uint8_t idx = 0; idx < _N_lanes; ++idx) {
+    Lane &lane = _lanes[idx];
+    lane.todo |= portmask & lane_ports(idx);
+    if (lane.port < 0) {
+      start_next(lane);
+    }
+  }
+
+  __set_PRIMASK(primask);
+}
+
+void I2CEngine::start_next(Lane &lane) {
+  if (!lane.todo) {
+    lane.port = -1;
+    return;
+  }
+
+  uint8_t port = __builtin_ctz(lane.todo);
+  lane.todo &= lane.todo - 1; // Clear lowest set bit
+  lane.port = port;
+  lane.bytes[0] = MCP23017_OLATA;
+  lane.bytes[1] = _values[port];
+  lane.bytes[2] = _values[port] >> 8;
+  lane.t_start = micros();
+  trace_begin(TRACE_I2C_WRITE, port);
+  lane.dma.startJob();
+
+  // The SERCOM sends START and the address, after which the DMA feeds it the
+  // data bytes. STOP follows automatically after the last one.
+  SercomI2cm &i2c = lane.hw->I2CM;
+  i2c.ADDR.reg = SERCOM_I2CM_ADDR_ADDR((MCP23017_ADDRESS + port) << 1) |
+                 SERCOM_I2CM_ADDR_LENEN |
+                 SERCOM_I2CM_ADDR_LEN(sizeof(lane.bytes));
+  while (i2c.SYNCBUSY.bit.SYSOP) {}
+}
+
+void I2CEngine::finish_port(Lane &lane, bool failed) {
+  trace_end(TRACE_I2C_WRITE, lane.port, failed);
+  if (failed) {
+    _N_failed++;
+  }
+  _t_last = micros();
+  if (_first) {
+    _t_first = _t_last;
+    _first = false;
+  }
+
+  start_next(lane);
+  for (uint8_t idx = 0; idx < _N_lanes; ++idx) {
+    if (_lanes[idx].port >= 0) {
+      return;
+    }
+  }
+
+  // All done. Clear the busy flag only after the callback, so that anyone
+  // seeing it cleared also sees the results of the callback.
+  if (_callback) {
+    _callback(_t_last, _N_failed, _t_last - _t_first, _ctx);
+  }
+  _busy = false;
+}
+
+void I2CEngine::dma_done(Lane &lane) {
+  // The DMA has handed the last data byte to the SERCOM, which still has to
+  // send it out
+  SercomI2cm &i2c = lane.hw->I2CM;
+  uint32_t t0 = micros();
+  while (!(i2c.INTFLAG.reg &
+           (SERCOM_I2CM_INTFLAG_MB | SERCOM_I2CM_INTFLAG_ERROR))) {
+    if (micros() - t0 > I2C_ENGINE_BYTE_TIMEOUT) {
+      break;
+    }
+  }
+
+  bool failed = i2c.STATUS.bit.RXNACK || i2c.STATUS.bit.LENERR ||
+                (i2c.INTFLAG.reg & SERCOM_I2CM_INTFLAG_ERROR);
+  if (i2c.STATUS.bit.BUSSTATE == 2) {
+    // Still owning the bus, so end the transaction ourselves
+    i2c.CTRLB.bit.CMD = 3; // Stop
+    while (i2c.SYNCBUSY.bit.SYSOP) {}
+  }
+  i2c.STATUS.reg = SERCOM_I2CM_STATUS_LENERR | SERCOM_I2CM_STATUS_BUSERR |
+                   SERCOM_I2CM_STATUS_ARBLOST;
+  i2c.INTFLAG.reg = SERCOM_I2CM_INTFLAG_ERROR;
+
+  finish_port(lane, failed);
+}
+
+void I2CEngine::update() {
+  for (uint8_t idx = 0; idx < _N_lanes; ++idx) {
+    Lane &lane = _lanes[idx];
+    if ((lane.port < 0) || (micros() - lane.t_start <= I2C_ENGINE_TIMEOUT)) {
+      continue;
+    }
+
+    // Keep the DMA interrupt from finishing the same port write
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (lane.port >= 0) {
+      SercomI2cm &i2c = lane.hw->I2CM;
+      lane.dma.abort();
+      i2c.CTRLB.bit.CMD = 3; // Stop
+      while (i2c.SYNCBUSY.bit.SYSOP) {}
+      i2c.STATUS.reg = SERCOM_I2CM_STATUS_LENERR | SERCOM_I2CM_STATUS_BUSERR |
+                       SERCOM_I2CM_STATUS_ARBLOST;
+      i2c.INTFLAG.reg = SERCOM_I2CM_INTFLAG_ERROR;
+      finish_port(lane, true);
+    }
+    __set_PRIMASK(primask);
+  }
+}
+
+void I2CEngine::abort() {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  for (uint8_t idx = 0; idx < _N_lanes; ++idx) {
+    Lane &lane = _lanes[idx];
+    lane.todo = 0;
+    if (lane.port >= 0) {
+      SercomI2cm &i2c = lane.hw->I2CM;
+      lane.dma.abort();
+      i2c.CTRLB.bit.CMD = 3; // Stop
+      while (i2c.SYNCBUSY.bit.SYSOP) {}
+      i2c.STATUS.reg = SERCOM_I2CM_STATUS_LENERR | SERCOM_I2CM_STATUS_BUSERR |
+                       SERCOM_I2CM_STATUS_ARBLOST;
+      i2c.INTFLAG.reg = SERCOM_I2CM_INTFLAG_ERROR;
+      lane.port = -1;
+    }
+  }
+  _busy = false;
+  __set_PRIMASK(primask);
+}
+
+void I2CEngine::dma_callback(Adafruit_ZeroDMA *dma) {
+  if (!instance) {
+    return;
+  }
+  for (uint8_t idx = 0; idx < instance->_N_lanes; ++idx) {
+    if (dma == &instance->_lanes[idx].dma) {
+      instance->dma_done(instance->_lanes[idx]);
+    }
+  }
+}
+
+#else
+
+void I2CEngine::write_ports(const uint16_t *, uint8_t) {}
+void I2CEngine::update() {}
+void I2CEngine::abort() {}
+
+#endif
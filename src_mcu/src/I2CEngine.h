@@ -0,0 +1,187 @@
+/**
+ * @file    I2CEngine.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Non-blocking writes to the output latches of the MCP23017 chips on
+ * the Centipede boards via I2C and DMA on the SAMD51.
+ *
+ * `Centipede::writePorts()` blocks in `Wire.endTransmission()` for ~57 µs per
+ * port at 1 MHz. Instead, this class queues the port writes and lets the DMA
+ * controller feed the data bytes to the I2C master SERCOM in the background.
+ * The SERCOM sends the address by itself and ends the transaction after the
+ * last data byte, thanks to its automatic transfer length (ADDR.LENEN). The
+ * DMA interrupt then chains the next queued port, and a completion callback
+ * fires once all queued ports have been written.
+ *
+ * Each I2C bus forms a lane with its own DMA channel. With both Centipede
+ * boards on separate buses, see `CP_SPLIT_BUS`, both lanes run concurrently.
+ *
+ * A port that gets queued again while still waiting in line is written only
+ * once, taking its latest value.
+ *
+ * The blocking `Wire` calls must not be used while the engine is busy.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef I2C_ENGINE_H_
+#define I2C_ENGINE_H_
+
+#include <Arduino.h>
+
+/**
+ * @brief Write the Centipede ports via DMA instead of via the blocking `Wire`
+ * calls? Only takes effect on the SAMD51.
+ */
+#ifndef CP_I2C_DMA
+#  define CP_I2C_DMA 1
+#endif
+
+#if CP_I2C_DMA && defined(__SAMD51__)
+#  include "Adafruit_ZeroDMA.h"
+#endif
+
+/**
+ * @brief Called from within the DMA interrupt once all queued port writes
+ * have completed.
+ *
+ * @param done_us Time [µs] of completion
+ * @param N_failed Number of failed, i.e. not acknowledged, port writes
+ * @param skew_us Time [µs] between the completion of the first and the last
+ * port write
+ * @param ctx The context passed to `I2CEngine::set_callback()`
+ */
+typedef void (*I2CDoneCallback)(uint32_t done_us, uint8_t N_failed,
+                                uint32_t skew_us, void *ctx);
+
+/*------------------------------------------------------------------------------
+  I2CEngine
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Class to write the Centipede ports in the background via I2C and DMA.
+ *
+ * Only a single instance can exist, because the DMA callback has to find its
+ * way back to it.
+ */
+class I2CEngine {
+public:
+  /**
+   * @brief Is the DMA backend available on this board and enabled?
+   */
+  static constexpr bool available() {
+#if CP_I2C_DMA && defined(__SAMD51__)
+    return true;
+#else
+    return false;
+#endif
+  }
+
+#if CP_I2C_DMA && defined(__SAMD51__)
+  /**
+   * @brief Take over the I2C master SERCOM of each bus and allocate a DMA
+   * channel per bus. The buses must have been started by `TwoWire::begin()`.
+   *
+   * Ports 0 to 3 go over @p hw1 and ports 4 to 7 over @p hw2. Pass nullptr as
+   * @p hw2 when both Centipede boards share the bus of @p hw1.
+   *
+   * @param hw1 SERCOM of the first bus
+   * @param dmac_id1 DMA trigger of the first bus, e.g. `SERCOM2_DMAC_ID_TX`
+   * @param hw2 SERCOM of the second bus
+   * @param dmac_id2 DMA trigger of the second bus
+   * @return True when successful, false otherwise.
+   */
+  bool begin(Sercom *hw1, uint8_t dmac_id1, Sercom *hw2 = nullptr,
+             uint8_t dmac_id2 = 0);
+#endif
+
+  /**
+   * @brief Set the function to call once all queued port writes have
+   * completed, see `I2CDoneCallback`.
+   */
+  inline void set_callback(I2CDoneCallback callback, void *ctx) {
+    _callback = callback;
+    _ctx = ctx;
+  }
+
+  /**
+   * @brief Queue writing the output latches of the ports selected by the bits
+   * of @p portmask, taking `values[port]`, and return immediately. Safe to be
+   * called from within an interrupt.
+   */
+  void write_ports(const uint16_t *values, uint8_t portmask);
+
+  /**
+   * @brief Are port writes queued or ongoing?
+   */
+  inline bool is_busy() const { return _busy; }
+
+  /**
+   * @brief Abort the ongoing and queued port writes right away, without
+   * invoking the callback, e.g. to take over the buses when halting. Safe to
+   * be called from within an interrupt.
+   */
+  void abort();
+
+  /**
+   * @brief Abort a port write taking longer than `I2C_ENGINE_TIMEOUT`, e.g.
+   * because of a hung bus, and carry on with the next queued port. Must be
+   * called repeatedly from within the main loop.
+   */
+  void update();
+
+private:
+  I2CDoneCallback _callback = nullptr;
+  void *_ctx = nullptr;
+  volatile bool _busy = false; // Are port writes queued or ongoing?
+
+#if CP_I2C_DMA && defined(__SAMD51__)
+  static const uint8_t N_PORTS = 8; // Ports of both Centipede boards
+
+  struct Lane {
+    Sercom *hw = nullptr;
+    Adafruit_ZeroDMA dma;
+    volatile uint8_t todo = 0; // Queued ports, as bitmask
+    volatile int8_t port = -1; // Port being written, -1 when idle
+    uint8_t bytes[3];          // OLATA register address, OLATA, OLATB
+    uint32_t t_start = 0;      // Start of the port write [µs]
+  };
+
+  Lane _lanes[2];
+  uint8_t _N_lanes = 0;
+  uint16_t _values[N_PORTS]; // Latest queued value per port
+  uint8_t _N_failed = 0;     // Failed port writes since being idle
+  bool _first = true;        // No port write completed since being idle?
+  uint32_t _t_first = 0;     // Completion of the first port write [µs]
+  uint32_t _t_last = 0;      // Completion of the last port write [µs]
+
+  /**
+   * @brief Return the bitmask of the ports going over lane @p idx.
+   */
+  inline uint8_t lane_ports(uint8_t idx) {
+    return (_N_lanes == 1) ? 0xFF : (idx == 0 ? 0x0F : 0xF0);
+  }
+
+  /**
+   * @brief Start writing the next queued port of the lane, if any.
+   */
+  void start_next(Lane &lane);
+
+  /**
+   * @brief Wrap up the port write of the lane and carry on with the next one.
+   * Fires the callback once all lanes have gone idle.
+   */
+  void finish_port(Lane &lane, bool failed);
+
+  /**
+   * @brief Wait for the last data byte of the lane to have been sent out.
+   */
+  void dma_done(Lane &lane);
+
+  static void dma_callback(Adafruit_ZeroDMA *dma);
+#endif
+};
+
+#endif
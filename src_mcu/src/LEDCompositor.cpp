@@ -0,0 +1,188 @@
+/**
+ * @file    LEDCompositor.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "LEDCompositor.h"
+
+/*------------------------------------------------------------------------------
+  Fixed layer contents, generated at compile time
+------------------------------------------------------------------------------*/
+
+// The LED of PCS point (x, y), see `P2LED`
+static constexpr uint8_t led_at(int8_t x, int8_t y) {
+  return P2LED[PCS_Y_MAX - y][x + PCS_X_MAX + 1];
+}
+
+const uint8_t LED_CENTER = led_at(0, 0);   // Center of the PCS
+const uint8_t LED_STATUS = led_at(-8, -8); // Alive blinker
+
+static constexpr LEDMask build_grid_mask() {
+  LEDMask out{};
+  for (int8_t y = PCS_Y_MIN; y <= PCS_Y_MAX; y++) {
+    for (int8_t x = PCS_X_MIN; x <= PCS_X_MAX; x++) {
+      if ((x + y) % 2 == 0) {
+        uint8_t idx_led = led_at(x, y);
+        out[idx_led >> 5] |= 1UL << (idx_led & 31);
+      }
+    }
+  }
+  return out;
+}
+
+// PCS points without a valve
+constexpr LEDMask GRID_MASK = build_grid_mask();
+
+// clang-format off
+// Palette of the pressure VU meter, top-down
+const CRGB VU_COLORS[VU_N_LEDS] = {
+  CRGB(255, 0  , 0), CRGB(255, 51 , 0), CRGB(255, 91 , 0),
+  CRGB(255, 128, 0), CRGB(255, 163, 0), CRGB(255, 199, 0),
+  CRGB(255, 235, 0), CRGB(238, 255, 0), CRGB(201, 255, 0),
+  CRGB(164, 255, 0), CRGB(129, 255, 0), CRGB(93 , 255, 0),
+  CRGB(51 , 255, 0), CRGB(0  , 255, 0)};
+// clang-format on
+
+const uint8_t FADE_START_LEVEL = 128; // Blue level of a just closed valve
+const uint8_t FADE_SCALE = 255 - 10;  // Dimming per `fade()`
+
+static inline bool test(const LEDMask &mask, uint8_t idx_led) {
+  return (mask[idx_led >> 5] >> (idx_led & 31)) & 1;
+}
+
+/*------------------------------------------------------------------------------
+  LEDCompositor
+------------------------------------------------------------------------------*/
+
+void LEDCompositor::set_visible(LEDLayer layer, bool visible) {
+  if (is_visible(layer) == visible) {
+    return;
+  }
+  _visible ^= 1U << layer;
+
+  switch (layer) {
+    case LAYER_GRID:
+      for (uint8_t word = 0; word < _dirty.size(); ++word) {
+        _dirty[word] |= GRID_MASK[word];
+      }
+      break;
+    case LAYER_FADING:
+    case LAYER_VALVES:
+      for (uint8_t word = 0; word < _dirty.size(); ++word) {
+        _dirty[word] |= _open[word] | _fading[word];
+      }
+      break;
+    case LAYER_PRESSURE:
+      for (uint8_t idx = 0; idx < VU_N_LEDS; ++idx) {
+        mark_dirty(VU_LED_TOP + idx);
+      }
+      break;
+    default:
+      mark_dirty(LED_STATUS);
+      break;
+  }
+}
+
+void LEDCompositor::open_valve(uint8_t idx_led) {
+  _open[idx_led >> 5] |= 1UL << (idx_led & 31);
+  _fading[idx_led >> 5] &= ~(1UL << (idx_led & 31));
+  mark_dirty(idx_led);
+}
+
+void LEDCompositor::close_valve(uint8_t idx_led) {
+  _open[idx_led >> 5] &= ~(1UL << (idx_led & 31));
+  _fading[idx_led >> 5] |= 1UL << (idx_led & 31);
+  _fade_level[idx_led] = FADE_START_LEVEL;
+  mark_dirty(idx_led);
+}
+
+void LEDCompositor::clear_valves() {
+  for (uint8_t word = 0; word < _dirty.size(); ++word) {
+    _dirty[word] |= _open[word] | _fading[word];
+  }
+  _open.fill(0);
+  _fading.fill(0);
+}
+
+void LEDCompositor::fade() {
+  for (uint8_t word = 0; word < _fading.size(); ++word) {
+    uint32_t bits = _fading[word];
+    while (bits) {
+      uint8_t bit = __builtin_ctz(bits);
+      bits &= bits - 1; // Clear lowest set bit
+
+      uint8_t idx_led = (word << 5) + bit;
+      uint8_t &level = _fade_level[idx_led];
+      level = ((uint16_t)level * (1 + FADE_SCALE)) >> 8;
+      // ↑ equivalent to `CRGB::nscale8(FADE_SCALE)` on the blue channel
+      if (level == 0) {
+        _fading[word] &= ~(1UL << bit); // Faded out
+      }
+      mark_dirty(idx_led);
+    }
+  }
+}
+
+void LEDCompositor::set_pressure(uint8_t N_lit) {
+  N_lit = min(N_lit, VU_N_LEDS);
+  uint8_t lo = min(N_lit, _N_lit);
+  uint8_t hi = max(N_lit, _N_lit);
+  for (uint8_t N = lo; N < hi; ++N) {
+    mark_dirty(VU_LED_TOP + VU_N_LEDS - 1 - N); // The LEDs light up bottom-up
+  }
+  _N_lit = N_lit;
+}
+
+void LEDCompositor::set_status(const CRGB &color) {
+  if (color != _status) {
+    _status = color;
+    mark_dirty(LED_STATUS);
+  }
+}
+
+void LEDCompositor::invalidate() { _dirty.fill(0xFFFFFFFF); }
+
+bool LEDCompositor::flatten() {
+  bool changed = false;
+  for (uint8_t word = 0; word < _dirty.size(); ++word) {
+    uint32_t bits = _dirty[word];
+    _dirty[word] = 0;
+    changed |= (bits != 0);
+    while (bits) {
+      uint8_t bit = __builtin_ctz(bits);
+      bits &= bits - 1; // Clear lowest set bit
+      uint8_t idx_led = (word << 5) + bit;
+      _frame[idx_led] = compose(idx_led);
+    }
+  }
+  return changed;
+}
+
+CRGB LEDCompositor::compose(uint8_t idx_led) const {
+  if (is_visible(LAYER_STATUS) && (idx_led == LED_STATUS)) {
+    return _status;
+  }
+
+  if (is_visible(LAYER_PRESSURE) && (idx_led >= VU_LED_TOP) &&
+      (idx_led < VU_LED_TOP + VU_N_LEDS)) {
+    uint8_t idx = idx_led - VU_LED_TOP;
+    return (VU_N_LEDS - 1 - idx < _N_lit) ? VU_COLORS[idx] : CRGB(0);
+  }
+
+  if (is_visible(LAYER_VALVES) && test(_open, idx_led)) {
+    return CRGB::Red;
+  }
+
+  if (is_visible(LAYER_FADING) && test(_fading, idx_led)) {
+    return CRGB(0, 0, _fade_level[idx_led]);
+  }
+
+  if (is_visible(LAYER_GRID) && test(GRID_MASK, idx_led)) {
+    return (idx_led == LED_CENTER) ? CRGB(0, 64, 0) : CRGB(12, 12, 12);
+  }
+
+  return CRGB(0);
+}
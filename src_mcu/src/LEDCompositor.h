@@ -0,0 +1,147 @@
+/**
+ * @file    LEDCompositor.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Composes the LED matrix out of layers, each stored compactly as
+ * bitmasks or palette indices.
+ *
+ * Layers, from bottom to top:
+ *   - Grid    : The PCS points without a valve, hidden by default
+ *   - Fading  : The valves that closed, fading out from blue to black
+ *   - Valves  : The open valves, in red
+ *   - Pressure: The pressure VU meter on the left column
+ *   - Status  : The alive blinker in the bottom-left corner
+ *
+ * Each LED takes the color of the top-most visible layer that covers it, or
+ * black otherwise. Changing a layer only marks the LEDs it touches as dirty,
+ * and `flatten()` recomposes just those into the frame buffer. Hence, the LED
+ * matrix costs no CPU time between changes.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef LED_COMPOSITOR_H_
+#define LED_COMPOSITOR_H_
+
+#include "FastLED.h"
+#include "constants.h"
+
+#include <Arduino.h>
+#include <array>
+
+/**
+ * @brief The layers of the LED matrix, from bottom to top.
+ */
+enum LEDLayer : uint8_t {
+  LAYER_GRID,
+  LAYER_FADING,
+  LAYER_VALVES,
+  LAYER_PRESSURE,
+  LAYER_STATUS,
+  N_LED_LAYERS
+};
+
+/**
+ * @brief Bitset over all LEDs of the matrix: Bit `idx_led & 31` of element
+ * `idx_led >> 5`.
+ */
+using LEDMask = std::array<uint32_t, (N_LEDS + 31) / 32>;
+
+// The pressure VU meter takes up the left column of the LED matrix, top-down
+const uint8_t VU_N_LEDS = 14;
+const uint8_t VU_LED_TOP = 240; // LED index of the top of the VU meter
+
+/*------------------------------------------------------------------------------
+  LEDCompositor
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Class to compose the LED matrix out of layers, see above.
+ */
+class LEDCompositor {
+public:
+  /**
+   * @param frame The frame buffer of `N_LEDS` LEDs to flatten the layers into
+   */
+  LEDCompositor(CRGB *frame) : _frame(frame) {}
+
+  /**
+   * @brief Show or hide a whole layer, e.g. per FSM state. Only the LEDs
+   * covered by the layer get recomposed.
+   */
+  void set_visible(LEDLayer layer, bool visible);
+  inline bool is_visible(LEDLayer layer) const {
+    return (_visible >> layer) & 1;
+  }
+
+  /**
+   * @brief Valves layer: Light up the LED of an opened valve, taking it out
+   * of the fading layer.
+   */
+  void open_valve(uint8_t idx_led);
+
+  /**
+   * @brief Valves layer: Turn the LED of a closed valve blue, after which it
+   * fades out, see `fade()`.
+   */
+  void close_valve(uint8_t idx_led);
+
+  /**
+   * @brief Clear the valves and the fading layer at once, without fading.
+   */
+  void clear_valves();
+
+  /**
+   * @brief Fading layer: Dim all fading LEDs a step. Meant to be called at a
+   * fixed interval. Next to free once all have faded out.
+   */
+  void fade();
+
+  /**
+   * @brief Pressure layer: Light up the bottom @p N_lit LEDs of the VU meter.
+   * Only the LEDs between the previous and the new level get recomposed.
+   */
+  void set_pressure(uint8_t N_lit);
+
+  /**
+   * @brief Status layer: Color the alive blinker.
+   */
+  void set_status(const CRGB &color);
+
+  /**
+   * @brief Recompose all LEDs at the next `flatten()`, e.g. after the frame
+   * buffer got overwritten from outside of the compositor.
+   */
+  void invalidate();
+
+  /**
+   * @brief Recompose the dirty LEDs into the frame buffer.
+   *
+   * @return True when any LED got recomposed, false otherwise.
+   */
+  bool flatten();
+
+private:
+  CRGB *_frame;
+  uint8_t _visible = (uint8_t)~(1U << LAYER_GRID); // Visible layers, bitmask
+  LEDMask _dirty{};  // LEDs to recompose
+  LEDMask _open{};   // Valves layer
+  LEDMask _fading{}; // Fading layer
+  std::array<uint8_t, N_LEDS> _fade_level{}; // Blue level of each fading LED
+  uint8_t _N_lit = 0;                        // Pressure layer
+  CRGB _status;                              // Status layer
+
+  /**
+   * @brief Return the color of LED @p idx_led, i.e. that of the top-most
+   * visible layer covering it.
+   */
+  CRGB compose(uint8_t idx_led) const;
+
+  inline void mark_dirty(uint8_t idx_led) {
+    _dirty[idx_led >> 5] |= 1UL << (idx_led & 31);
+  }
+};
+
+#endif
@@ -0,0 +1,64 @@
+/**
+ * @file    LEDGovernor.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "LEDGovernor.h"
+
+// See `main.cpp`
+extern const uint8_t BUF_LEN; // Common character buffer for string formatting
+extern char buf[];            // Common character buffer for string formatting
+
+/*------------------------------------------------------------------------------
+  LEDGovernor
+------------------------------------------------------------------------------*/
+
+void LEDGovernor::begin(uint32_t cost_us) {
+  _cost_us = cost_us;
+  reset_stats();
+}
+
+bool LEDGovernor::may_show(uint32_t gap_us) {
+  if ((gap_us == UINT32_MAX) ||
+      (gap_us >= _cost_us + LED_GOVERNOR_MARGIN_US)) {
+    return true;
+  }
+
+  _N_skipped++;
+  if (!_skipping) {
+    _skipping = true;
+    _t_first_skip = millis();
+  }
+  return false;
+}
+
+void LEDGovernor::shown(uint32_t cost_us) {
+  // Fast attack, slow decay
+  if (cost_us >= _cost_us) {
+    _cost_us = cost_us;
+  } else {
+    _cost_us -= (_cost_us - cost_us) >> 4;
+  }
+
+  _N_shown++;
+  _skipping = false;
+}
+
+bool LEDGovernor::starved() const {
+  return _skipping && (millis() - _t_first_skip >= LED_GOVERNOR_STARVED_MS);
+}
+
+void LEDGovernor::reset_stats() {
+  _N_shown = 0;
+  _N_skipped = 0;
+  _skipping = false;
+}
+
+void LEDGovernor::print_stats(Stream &mySerial) {
+  snprintf(buf, BUF_LEN, "%lu\t%lu\t%lu\t%d\n", (unsigned long)_cost_us,
+           (unsigned long)_N_shown, (unsigned long)_N_skipped, starved());
+  mySerial.print(buf);
+}
@@ -0,0 +1,95 @@
+/**
+ * @file    LEDGovernor.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Schedules the refreshes of the LED matrix in between the line
+ * switches of the protocol program.
+ *
+ * Sending out the LED matrix via FastLED bit-banging takes 8 ms with the
+ * interrupts disabled, which is longer than a protocol line of 5 to 20 ms.
+ * A refresh that overlaps a line switch delays that switch. Hence, the
+ * governor only lets a refresh through when the time left until the next line
+ * switch exceeds the measured cost of a refresh plus a safety margin. Else the
+ * frame is skipped and retried in the next gap. The valve timing is thus
+ * guaranteed and the LED matrix becomes best-effort.
+ *
+ * When the lines are too short to ever leave a large enough gap, no frame gets
+ * through and the governor reports being starved. The LED matrix then stays
+ * frozen on its last frame and only the onboard LED, cheap enough to fit in
+ * any gap, keeps summarizing the state.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef LED_GOVERNOR_H_
+#define LED_GOVERNOR_H_
+
+#include <Arduino.h>
+
+// Safety margin [µs] between the end of a refresh and the next line switch
+const uint32_t LED_GOVERNOR_MARGIN_US = 500;
+
+// Time [ms] without any frame getting through, while frames were pending,
+// after which the governor is considered starved
+const uint16_t LED_GOVERNOR_STARVED_MS = 500;
+
+/*------------------------------------------------------------------------------
+  LEDGovernor
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Class to schedule the refreshes of the LED matrix in the gaps between
+ * line switches, see above.
+ */
+class LEDGovernor {
+public:
+  /**
+   * @param cost_us Initial estimate of the duration [µs] of a single refresh,
+   * to be replaced by measurements, see `shown()`.
+   */
+  void begin(uint32_t cost_us);
+
+  /**
+   * @brief May the LED matrix be refreshed now? Counts a skipped frame when
+   * not.
+   *
+   * @param gap_us Time left [µs] until the next line switch, `UINT32_MAX`
+   * when no switch is pending.
+   */
+  bool may_show(uint32_t gap_us);
+
+  /**
+   * @brief Report the measured duration [µs] of the refresh that just took
+   * place. The cost estimate follows an increase immediately and decays
+   * slowly towards a decrease, such that a slow refresh is never
+   * underestimated.
+   */
+  void shown(uint32_t cost_us);
+
+  /**
+   * @brief Has no frame got through during the last `LED_GOVERNOR_STARVED_MS`
+   * ms while frames were pending?
+   */
+  bool starved() const;
+
+  inline uint32_t get_cost_us() const { return _cost_us; }
+
+  void reset_stats();
+
+  /**
+   * @brief Print the statistics as a tab-delimited line:
+   *   cost [µs], frames shown, frames skipped, starved (0/1)
+   */
+  void print_stats(Stream &mySerial);
+
+private:
+  uint32_t _cost_us = 0;      // Estimated duration [µs] of a refresh
+  uint32_t _N_shown = 0;      // Number of frames that got through
+  uint32_t _N_skipped = 0;    // Number of frames skipped for lack of a gap
+  bool _skipping = false;     // Skipped a frame since the last one shown?
+  uint32_t _t_first_skip = 0; // Time [ms] of the first of those skips
+};
+
+#endif
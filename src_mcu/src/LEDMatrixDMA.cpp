@@ -0,0 +1,152 @@
+/**
+ * @file    LEDMatrixDMA.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "LEDMatrixDMA.h"
+
+#if LED_MATRIX_DMA && defined(__SAMD51__)
+#  include "wiring_private.h"
+#endif
+
+volatile bool LEDMatrixDMA::_busy = false;
+volatile bool LEDMatrixDMA::_pending = false;
+volatile bool LEDMatrixDMA::_dropped = false;
+
+#if LED_MATRIX_DMA && defined(__SAMD51__)
+// The single instance, for the DMA callback to find its way back to
+static LEDMatrixDMA *instance = nullptr;
+#endif
+
+/*------------------------------------------------------------------------------
+  LEDMatrixDMA
+------------------------------------------------------------------------------*/
+
+#if LED_MATRIX_DMA && defined(__SAMD51__)
+
+/**
+ * @brief Encode a single color byte into 3 SPI bytes.
+ */
+static inline void encode(uint8_t value, uint8_t *out) {
+  uint32_t bits = 0;
+  for (uint8_t i = 0; i < 8; ++i) {
+    bits = (bits << 3) | ((value & 0x80) ? 0b110 : 0b100);
+    value <<= 1;
+  }
+  out[0] = bits >> 16;
+  out[1] = bits >> 8;
+  out[2] = bits;
+}
+
+bool LEDMatrixDMA::begin() {
+  // Feed SERCOM3 with the 48 MHz generic clock 1
+  MCLK->APBBMASK.bit.SERCOM3_ = 1;
+  GCLK->PCHCTRL[SERCOM3_GCLK_ID_CORE].reg =
+      GCLK_PCHCTRL_GEN_GCLK1_Val | (1 << GCLK_PCHCTRL_CHEN_Pos);
+  while (!GCLK->PCHCTRL[SERCOM3_GCLK_ID_CORE].bit.CHEN) {}
+
+  SERCOM3->SPI.CTRLA.bit.ENABLE = 0;
+  while (SERCOM3->SPI.SYNCBUSY.bit.ENABLE) {}
+  SERCOM3->SPI.CTRLA.bit.SWRST = 1;
+  while (SERCOM3->SPI.SYNCBUSY.bit.SWRST) {}
+
+  // SPI master, MSB first, data out on PAD[3], transmit only
+  SERCOM3->SPI.CTRLA.reg =
+      SERCOM_SPI_CTRLA_MODE(0x3) | SERCOM_SPI_CTRLA_DOPO(0x2);
+  SERCOM3->SPI.CTRLB.reg = 0;
+  while (SERCOM3->SPI.SYNCBUSY.bit.CTRLB) {}
+  SERCOM3->SPI.BAUD.reg = 48000000 / (2 * 2400000) - 1; // 2.4 MHz
+
+  SERCOM3->SPI.CTRLA.bit.ENABLE = 1;
+  while (SERCOM3->SPI.SYNCBUSY.bit.ENABLE) {}
+
+  // Only mux the data-out pin
+  pinPeripheral(PIN_LED_MATRIX, PIO_SERCOM_ALT);
+
+  _dma.setTrigger(SERCOM3_DMAC_ID_TX);
+  _dma.setAction(DMA_TRIGGER_ACTON_BEAT);
+  if (_dma.allocate() != DMA_STATUS_OK) {
+    return false;
+  }
+  _desc = _dma.addDescriptor(_bufs[0], (void *)&SERCOM3->SPI.DATA.reg,
+                             SPI_BUF_LEN, DMA_BEAT_SIZE_BYTE, true, false);
+  if (_desc == NULL) {
+    return false;
+  }
+  _dma.setCallback(dma_callback);
+
+  instance = this;
+  return true;
+}
+
+bool LEDMatrixDMA::show(const CRGB *leds, uint8_t brightness) {
+  // Withdraw a queued frame, so that the DMA callback leaves the back buffer
+  // alone while it gets encoded
+  _pending = false;
+
+  // WS2812 expects the color order GRB
+  uint8_t *out = _bufs[_front ^ 1];
+  uint16_t scale = (uint16_t)brightness + 1;
+  for (uint16_t idx = 0; idx < N_LEDS; ++idx) {
+    encode((leds[idx].g * scale) >> 8, out);
+    encode((leds[idx].r * scale) >> 8, out + 3);
+    encode((leds[idx].b * scale) >> 8, out + 6);
+    out += 9;
+  }
+
+  bool success = true;
+  __disable_irq();
+  if (_busy) {
+    _pending = true; // Started by the DMA callback
+  } else {
+    success = start_back();
+  }
+  __enable_irq();
+
+  return success;
+}
+
+bool LEDMatrixDMA::start_back() {
+  _front ^= 1;
+  _dma.changeDescriptor(_desc, _bufs[_front]);
+  _busy = true;
+  if (_dma.startJob() != DMA_STATUS_OK) {
+    _busy = false;
+    return false;
+  }
+  return true;
+}
+
+void LEDMatrixDMA::dma_callback(Adafruit_ZeroDMA *dma) {
+  (void)dma;
+  _busy = false;
+  if (_pending && instance) {
+    _pending = false;
+    if (!instance->start_back()) {
+      _dropped = true;
+    }
+  }
+}
+
+#else
+
+bool LEDMatrixDMA::begin() { return false; }
+
+bool LEDMatrixDMA::show(const CRGB *leds, uint8_t brightness) {
+  (void)leds;
+  (void)brightness;
+  return false;
+}
+
+#endif
+
+bool LEDMatrixDMA::take_dropped() {
+  __disable_irq();
+  bool dropped = _dropped;
+  _dropped = false;
+  __enable_irq();
+  return dropped;
+}
@@ -0,0 +1,128 @@
+/**
+ * @file    LEDMatrixDMA.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Non-blocking output of the 16x16 WS2812 RGB NeoPixel LED matrix via
+ * SPI and DMA on the SAMD51.
+ *
+ * `FastLED.show()` bit-bangs the LED data and blocks the main loop for 8 ms per
+ * frame. Instead, this class encodes each NeoPixel bit into 3 SPI bits (1 ->
+ * 0b110, 0 -> 0b100) and lets the DMA controller stream the encoded frame out
+ * over SERCOM3 at 2.4 MHz in the background. The call to `show()` returns
+ * within ~100 µs.
+ *
+ * The encoded frame is double buffered: `show()` always encodes into the back
+ * buffer, while the DMA streams out the front buffer. A frame shown during
+ * the ~8 ms of streaming gets queued and the buffers get swapped at DMA
+ * completion, after which the queued frame starts right away. A newer frame
+ * replaces a queued one that has not started yet. Hence, composing the next
+ * frame into `leds[]` fully overlaps with the streaming, without ever having
+ * to wait nor to skip a frame, and without tearing.
+ *
+ * Only pin 11 (PA21, SERCOM3 PAD[3] on the Adafruit Feather M4) is supported.
+ * Only the data-out pin gets muxed to the SERCOM, leaving the pins of the other
+ * SERCOM3 pads untouched.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef LED_MATRIX_DMA_H_
+#define LED_MATRIX_DMA_H_
+
+#include "FastLED.h"
+#include "constants.h"
+
+#include <Arduino.h>
+
+/**
+ * @brief Drive the LED matrix via SPI and DMA instead of via `FastLED.show()`?
+ * Only takes effect on the SAMD51, otherwise FastLED will be used.
+ */
+#ifndef LED_MATRIX_DMA
+#  define LED_MATRIX_DMA 1
+#endif
+
+#if LED_MATRIX_DMA && defined(__SAMD51__)
+#  include "Adafruit_ZeroDMA.h"
+#endif
+
+/*------------------------------------------------------------------------------
+  LEDMatrixDMA
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Class to stream out the LED matrix data in the background via SPI and
+ * DMA.
+ */
+class LEDMatrixDMA {
+public:
+  /**
+   * @brief Is the DMA backend available on this board and enabled?
+   */
+  static constexpr bool available() {
+#if LED_MATRIX_DMA && defined(__SAMD51__)
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  /**
+   * @brief Set up SERCOM3 as SPI master on pin 11 and allocate a DMA channel.
+   *
+   * @return True when successful, false otherwise.
+   */
+  bool begin();
+
+  /**
+   * @brief Encode the LED data into the back buffer and start streaming it
+   * out in the background, or queue it when the previous frame is still
+   * being streamed out.
+   *
+   * @param leds The LED colors of the full matrix
+   * @param brightness Global brightness scaling [0 - 255]
+   * @return True when the frame got started or queued. False when the DMA
+   * failed to start, in which case this frame is skipped.
+   */
+  bool show(const CRGB *leds, uint8_t brightness);
+
+  /**
+   * @brief Is a frame still being streamed out or queued?
+   */
+  inline bool is_busy() { return _busy || _pending; }
+
+  /**
+   * @brief Did a queued frame fail to start from the DMA callback since the
+   * previous call? That frame never got shown and has to be shown again.
+   */
+  bool take_dropped();
+
+private:
+  // 3 SPI bytes per color byte, 3 color bytes per LED, followed by > 280 µs of
+  // low signal to latch the frame: 90 bytes @ 2.4 MHz = 300 µs
+  static const uint16_t N_RESET_BYTES = 90;
+  static const uint16_t SPI_BUF_LEN = N_LEDS * 9 + N_RESET_BYTES;
+
+  static volatile bool _busy;    // Is the DMA transfer in progress?
+  static volatile bool _pending; // Is the back buffer queued?
+  static volatile bool _dropped; // Did a queued frame fail to start?
+
+#if LED_MATRIX_DMA && defined(__SAMD51__)
+  uint8_t _bufs[2][SPI_BUF_LEN] = {}; // Encoded SPI bit streams
+  volatile uint8_t _front = 0;        // Buffer being streamed out
+  Adafruit_ZeroDMA _dma;
+  DmacDescriptor *_desc = nullptr;
+
+  /**
+   * @brief Swap the buffers and start streaming out the new front buffer.
+   * Must be called with interrupts disabled or from the DMA callback.
+   */
+  bool start_back();
+
+  static void dma_callback(Adafruit_ZeroDMA *dma);
+#endif
+};
+
+#endif
@@ -0,0 +1,134 @@
+/**
+ * @file    LEDMatrixPreempt.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "LEDMatrixPreempt.h"
+#include "Perf.h"
+
+extern const uint8_t BUF_LEN;
+extern char buf[];
+
+#if LED_MATRIX_PREEMPT && defined(__SAMD51__)
+const uint32_t CYCLES_PER_US = F_CPU / 1000000;
+#else
+const uint32_t CYCLES_PER_US = 1; // Unused, the statistics stay zero
+#endif
+
+/*------------------------------------------------------------------------------
+  LEDMatrixPreempt
+------------------------------------------------------------------------------*/
+
+#if LED_MATRIX_PREEMPT && defined(__SAMD51__)
+
+// WS2812 bit timing at 800 kHz [CPU cycles]
+const uint32_t CYCLES_BIT = F_CPU / 800000;  // 1.25 µs
+const uint32_t CYCLES_T0H = F_CPU / 2500000; // 0.4 µs high of a 0 bit
+const uint32_t CYCLES_T1H = F_CPU / 1250000; // 0.8 µs high of a 1 bit
+const uint32_t CYCLES_MAX_GAP = CYCLES_PER_US * LED_PREEMPT_MAX_GAP_US;
+
+/**
+ * @brief Send out the 24 bits of a single pixel, MSB first, timed by the DWT
+ * cycle counter. To be called with the interrupts disabled.
+ *
+ * @return Cycle count at the end of the last bit
+ */
+static inline uint32_t send_pixel(uint32_t grb, volatile uint32_t *set,
+                                  volatile uint32_t *clr, uint32_t pin_mask) {
+  uint32_t t0 = perf_cycles();
+  for (uint32_t bit = 1UL << 23; bit; bit >>= 1) {
+    uint32_t t_high = (grb & bit) ? CYCLES_T1H : CYCLES_T0H;
+    *set = pin_mask;
+    while (perf_cycles() - t0 < t_high) {}
+    *clr = pin_mask;
+    while (perf_cycles() - t0 < CYCLES_BIT) {}
+    t0 += CYCLES_BIT;
+  }
+  return t0;
+}
+
+bool LEDMatrixPreempt::begin(uint8_t pin) {
+  perf_cycles_begin();
+  pinMode(pin, OUTPUT);
+  digitalWrite(pin, LOW);
+
+  uint8_t port = g_APinDescription[pin].ulPort;
+  _pin_mask = 1UL << g_APinDescription[pin].ulPin;
+  _set = &PORT->Group[port].OUTSET.reg;
+  _clr = &PORT->Group[port].OUTCLR.reg;
+  return true;
+}
+
+bool LEDMatrixPreempt::send_frame(const CRGB *leds, uint16_t scale) {
+  uint32_t t_end = 0; // Cycle count at the end of the previous pixel
+  for (uint16_t idx = 0; idx < N_LEDS; ++idx) {
+    // WS2812 expects the color order GRB
+    uint32_t grb = ((leds[idx].g * scale) >> 8) << 16 |
+                   ((leds[idx].r * scale) >> 8) << 8 |
+                   ((leds[idx].b * scale) >> 8);
+
+    __disable_irq();
+    if (idx > 0) {
+      uint32_t gap = perf_cycles() - t_end;
+      _max_gap_cycles = max(_max_gap_cycles, gap);
+      if (gap > CYCLES_MAX_GAP) {
+        __enable_irq();
+        return false;
+      }
+    }
+    t_end = send_pixel(grb, _set, _clr, _pin_mask);
+    __enable_irq(); // Pending interrupts get serviced here
+  }
+  return true;
+}
+
+bool LEDMatrixPreempt::show(const CRGB *leds, uint8_t brightness) {
+  uint16_t scale = (uint16_t)brightness + 1;
+  for (uint8_t attempt = 0; attempt <= LED_PREEMPT_MAX_RETRIES; ++attempt) {
+    if (send_frame(leds, scale)) {
+      _N_shown++;
+      return true;
+    }
+
+    // Let the LEDs latch the truncated frame, such that the next attempt
+    // starts at the first pixel again
+    delayMicroseconds(LED_PREEMPT_LATCH_US);
+    if (attempt < LED_PREEMPT_MAX_RETRIES) {
+      _N_retried++;
+    }
+  }
+  _N_aborted++;
+  return false;
+}
+
+#else
+
+bool LEDMatrixPreempt::begin(uint8_t pin) {
+  (void)pin;
+  return false;
+}
+
+bool LEDMatrixPreempt::show(const CRGB *leds, uint8_t brightness) {
+  (void)leds;
+  (void)brightness;
+  return false;
+}
+
+#endif
+
+void LEDMatrixPreempt::print_stats(Stream &mySerial) const {
+  snprintf(buf, BUF_LEN, "%lu\t%lu\t%lu\t%lu\n", (unsigned long)_N_shown,
+           (unsigned long)_N_retried, (unsigned long)_N_aborted,
+           (unsigned long)(_max_gap_cycles / CYCLES_PER_US));
+  mySerial.print(buf);
+}
+
+void LEDMatrixPreempt::reset_stats() {
+  _N_shown = 0;
+  _N_retried = 0;
+  _N_aborted = 0;
+  _max_gap_cycles = 0;
+}
@@ -0,0 +1,129 @@
+/**
+ * @file    LEDMatrixPreempt.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Preemptible bit-banged output of the 16x16 WS2812 RGB NeoPixel LED
+ * matrix, the fallback for when the SPI/DMA backend of `LEDMatrixDMA` can't
+ * be used.
+ *
+ * FastLED disables the interrupts during each LED and silently drops the rest
+ * of the frame when an interrupt kept it waiting for too long in between. This
+ * class also sends out a single pixel of 30 µs at a time with the interrupts
+ * disabled, but enables them in between the pixels. Hence, the timer ISR of
+ * the playback gets delayed by at most one pixel instead of by a full frame of
+ * 8 ms.
+ *
+ * An interrupt that keeps the data line low for longer than
+ * `LED_PREEMPT_MAX_GAP_US` lets the LEDs latch the pixels sent so far. The
+ * frame then gets truncated cleanly: after the LEDs have latched, it restarts
+ * from the first pixel, up to `LED_PREEMPT_MAX_RETRIES` times. A frame that
+ * still fails gets aborted and is left to be shown again later, see
+ * `flush_leds()` of `main.cpp`. The truncated, retried and aborted frames get
+ * counted, see `print_stats()`.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef LED_MATRIX_PREEMPT_H_
+#define LED_MATRIX_PREEMPT_H_
+
+#include "FastLED.h"
+#include "constants.h"
+
+#include <Arduino.h>
+
+/**
+ * @brief Drive the LED matrix via the preemptible bit-banging when the DMA
+ * backend is not in use, instead of via `FastLED.show()`? Only takes effect
+ * on the SAMD51, otherwise FastLED will be used.
+ */
+#ifndef LED_MATRIX_PREEMPT
+#  define LED_MATRIX_PREEMPT 1
+#endif
+
+/**
+ * @brief Longest time [µs] the data line may stay low in between two pixels.
+ * Beyond, the LEDs might latch the partial frame: The WS2812 latches after
+ * 50 µs, the WS2812B after 280 µs.
+ */
+#ifndef LED_PREEMPT_MAX_GAP_US
+#  define LED_PREEMPT_MAX_GAP_US 40
+#endif
+
+// Number of restarts of a truncated frame, before it gets aborted
+#ifndef LED_PREEMPT_MAX_RETRIES
+#  define LED_PREEMPT_MAX_RETRIES 2
+#endif
+
+// Time [µs] the data line is held low to make sure the LEDs have latched
+const uint16_t LED_PREEMPT_LATCH_US = 300;
+
+/*------------------------------------------------------------------------------
+  LEDMatrixPreempt
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Class to bit-bang the LED matrix pixel by pixel, interruptible in
+ * between the pixels.
+ */
+class LEDMatrixPreempt {
+public:
+  /**
+   * @brief Is the preemptible backend available on this board and enabled?
+   */
+  static constexpr bool available() {
+#if LED_MATRIX_PREEMPT && defined(__SAMD51__)
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  /**
+   * @brief Configure pin @p pin as the data output.
+   *
+   * @return True when successful, false otherwise.
+   */
+  bool begin(uint8_t pin);
+
+  /**
+   * @brief Send out the LED data, blocking for ~8 ms, retrying a truncated
+   * frame up to `LED_PREEMPT_MAX_RETRIES` times.
+   *
+   * @param leds The LED colors of the full matrix
+   * @param brightness Global brightness scaling [0 - 255]
+   * @return True when the full frame got through. False when it got aborted,
+   * in which case the LEDs show it only partially.
+   */
+  bool show(const CRGB *leds, uint8_t brightness);
+
+  /**
+   * @brief Print the statistics, tab delimited: Frames shown in full, frames
+   * restarted after a truncation, frames aborted and the longest gap [µs] in
+   * between two pixels.
+   */
+  void print_stats(Stream &mySerial) const;
+
+  void reset_stats();
+
+private:
+  volatile uint32_t *_set = nullptr; // Port register setting the pin high
+  volatile uint32_t *_clr = nullptr; // Port register setting the pin low
+  uint32_t _pin_mask = 0;
+
+  uint32_t _N_shown = 0;
+  uint32_t _N_retried = 0;
+  uint32_t _N_aborted = 0;
+  uint32_t _max_gap_cycles = 0; // Longest gap in between two pixels
+
+  /**
+   * @brief Send out a single frame.
+   *
+   * @return True when successful. False when an interrupt truncated it.
+   */
+  bool send_frame(const CRGB *leds, uint16_t scale);
+};
+
+#endif
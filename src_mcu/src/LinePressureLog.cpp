@@ -0,0 +1,81 @@
+/**
+ * @file    LinePressureLog.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    14-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "LinePressureLog.h"
+
+/*------------------------------------------------------------------------------
+  LinePressureLog
+------------------------------------------------------------------------------*/
+
+void LinePressureLog::add(uint16_t line_no,
+                          const int16_t (&pres_mbar)[N_R_CLICKS]) {
+  if (!_active) {
+    return;
+  }
+
+  if (_acc.N_samples && (line_no != _acc.line_no)) {
+    push_acc();
+  }
+
+  if (_acc.N_samples == 0) {
+    _acc.line_no = line_no;
+    for (uint8_t ch = 0; ch < N_R_CLICKS; ++ch) {
+      _sum_mbar[ch] = pres_mbar[ch];
+      _acc.min_mbar[ch] = pres_mbar[ch];
+      _acc.max_mbar[ch] = pres_mbar[ch];
+    }
+    _acc.N_samples = 1;
+    return;
+  }
+
+  if (_acc.N_samples == 0xFFFF) {
+    return; // Saturated
+  }
+
+  for (uint8_t ch = 0; ch < N_R_CLICKS; ++ch) {
+    _sum_mbar[ch] += pres_mbar[ch];
+    if (pres_mbar[ch] < _acc.min_mbar[ch]) {
+      _acc.min_mbar[ch] = pres_mbar[ch];
+    }
+    if (pres_mbar[ch] > _acc.max_mbar[ch]) {
+      _acc.max_mbar[ch] = pres_mbar[ch];
+    }
+  }
+  _acc.N_samples++;
+}
+
+void LinePressureLog::push_acc() {
+  for (uint8_t ch = 0; ch < N_R_CLICKS; ++ch) {
+    _acc.mean_mbar[ch] = _sum_mbar[ch] / _acc.N_samples;
+  }
+
+  uint16_t idx = _head + _count;
+  if (idx >= LINE_PRESSURE_LOG_LEN) {
+    idx -= LINE_PRESSURE_LOG_LEN;
+  }
+  _records[idx] = _acc;
+  _acc.N_samples = 0;
+
+  if (_count == LINE_PRESSURE_LOG_LEN) {
+    // Full: The oldest record got overwritten
+    _head = (_head + 1 == LINE_PRESSURE_LOG_LEN) ? 0 : _head + 1;
+    _N_lost++;
+  } else {
+    _count++;
+  }
+}
+
+uint16_t LinePressureLog::drain(LinePressure *out, uint16_t max_count) {
+  uint16_t N = min(_count, max_count);
+  for (uint16_t i = 0; i < N; ++i) {
+    out[i] = _records[_head];
+    _head = (_head + 1 == LINE_PRESSURE_LOG_LEN) ? 0 : _head + 1;
+  }
+  _count -= N;
+  return N;
+}
@@ -0,0 +1,124 @@
+/**
+ * @file    LinePressureLog.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    14-10-2026
+ *
+ * @brief   Pressure statistics of each manifold per played protocol line,
+ * accumulated on the microcontroller. Replaces polling the PC-side `?` and
+ * `pos?` commands and aligning their samples afterwards.
+ *
+ * Every raw R Click reading gets attributed to the protocol line that is
+ * playing at the time it gets taken into account by the main loop. Once the
+ * protocol position changes, the mean, minimum and maximum pressure of each
+ * manifold over the finished line get pushed as a single `LinePressure` record
+ * onto a ring buffer, to be drained by the PC in binary. Hence, samples near a
+ * line switch may get attributed to the wrong line by up to one main loop
+ * iteration. A sensor in the fault state drags the minimum down to
+ * `PRESSURE_FAULT`, see `PressureScale`.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef LINE_PRESSURE_LOG_H_
+#define LINE_PRESSURE_LOG_H_
+
+#include <Arduino.h>
+#include <array>
+
+#include "RClickDAQ.h"
+
+/**
+ * @brief Number of finished lines the log can hold before the oldest ones get
+ * overwritten. A record takes up 28 bytes.
+ */
+const uint16_t LINE_PRESSURE_LOG_LEN = 64;
+
+/**
+ * @brief The pressure statistics of a single played protocol line, little
+ * endian.
+ */
+struct __attribute__((packed)) LinePressure {
+  uint16_t line_no;              // Line number, starting at index 0
+  uint16_t N_samples;            // Number of readings taken during the line
+  int16_t mean_mbar[N_R_CLICKS]; // Mean pressure of each manifold [mbar]
+  int16_t min_mbar[N_R_CLICKS];  // Minimum pressure of each manifold [mbar]
+  int16_t max_mbar[N_R_CLICKS];  // Maximum pressure of each manifold [mbar]
+};
+
+static_assert(sizeof(LinePressure) == 28, "LinePressure got padded");
+
+/*------------------------------------------------------------------------------
+  LinePressureLog
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Ring buffer of the pressure statistics of the most recently played
+ * protocol lines. When full, the oldest records get overwritten.
+ */
+class LinePressureLog {
+public:
+  /**
+   * @brief Start accumulating, beginning at the next reading.
+   */
+  inline void start() {
+    _active = true;
+    _acc.N_samples = 0;
+  }
+
+  /**
+   * @brief Stop accumulating, discarding the statistics of the line that is
+   * still being played.
+   */
+  inline void stop() { _active = false; }
+
+  inline bool is_active() const { return _active; }
+
+  /**
+   * @brief Add a reading of all manifolds taken during line number
+   * @p line_no. A change in line number finishes the previous line. Ignored
+   * when not started.
+   *
+   * @param line_no Protocol position starting at index 0
+   * @param pres_mbar The pressure of each manifold [mbar]
+   */
+  void add(uint16_t line_no, const int16_t (&pres_mbar)[N_R_CLICKS]);
+
+  inline void clear() {
+    _head = 0;
+    _count = 0;
+    _N_lost = 0;
+  }
+
+  /**
+   * @brief Take at most @p max_count of the oldest records out of the log.
+   *
+   * @return The number of records copied into @p out.
+   */
+  uint16_t drain(LinePressure *out, uint16_t max_count);
+
+  inline uint16_t size() const { return _count; }
+
+  /**
+   * @brief Return the number of records that got overwritten before having
+   * been drained.
+   */
+  inline uint32_t get_N_lost() const { return _N_lost; }
+
+private:
+  std::array<LinePressure, LINE_PRESSURE_LOG_LEN> _records;
+  uint16_t _head = 0;   // Index of the oldest record
+  uint16_t _count = 0;  // Number of records in the log
+  uint32_t _N_lost = 0; // Number of overwritten records
+
+  bool _active = false;            // Is accumulating?
+  LinePressure _acc{};             // Statistics of the line being played
+  int32_t _sum_mbar[N_R_CLICKS]{}; // Sum of the readings of that line [mbar]
+
+  /**
+   * @brief Finish the line being played and push its record onto the log.
+   */
+  void push_acc();
+};
+
+#endif
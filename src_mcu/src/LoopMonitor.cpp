@@ -0,0 +1,109 @@
+/**
+ * @file    LoopMonitor.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "LoopMonitor.h"
+#include "Trace.h"
+
+// See `main.cpp`
+extern const uint8_t BUF_LEN; // Common character buffer for string formatting
+extern char buf[];            // Common character buffer for string formatting
+
+// Marks a valid record: "TWTM"
+const uint32_t LOOP_MAGIC = 0x4D545754;
+
+static const char *const LOOP_STAGE_NAMES[LOOP_N_STAGES] = {
+    "idle", "tx",    "i2c",   "daq",       "commands", "dump",
+    "fsm",  "upload", "flash", "telemetry", "leds",     "safety"};
+
+#if !defined(__SAMD51__)
+static uint8_t bkupram[64]; // Stand-in for the backup RAM
+#  define BKUPRAM_ADDR bkupram
+#endif
+
+const char *loop_stage_name(uint8_t stage) {
+  return (stage < LOOP_N_STAGES) ? LOOP_STAGE_NAMES[stage] : "?";
+}
+
+/*------------------------------------------------------------------------------
+  LoopMonitor
+------------------------------------------------------------------------------*/
+
+void LoopMonitor::begin() {
+  _rec = (Record *)BKUPRAM_ADDR;
+
+  // The backup RAM holds garbage after a power cycle
+  _last = *_rec;
+  _last_valid = (_last.magic == LOOP_MAGIC) && (_last.stage < LOOP_N_STAGES) &&
+                (_last.worst_stage < LOOP_N_STAGES);
+
+  _rec->magic = LOOP_MAGIC;
+  _rec->uptime_ms = millis();
+  _rec->stage = LOOP_IDLE;
+  _rec->halted = false;
+  reset();
+}
+
+void LoopMonitor::reset() {
+  _rec->N_slow = 0;
+  _rec->worst_us = 0;
+  _rec->worst_stage = LOOP_IDLE;
+  _N_iters = 0;
+}
+
+void LoopMonitor::next_iteration() {
+  stage(LOOP_IDLE);
+
+  uint32_t now = _t_stage;
+  uint32_t dt = now - _t_iter;
+  if (_N_iters++) {
+    if (dt > _rec->worst_us) {
+      _rec->worst_us = dt;
+      _rec->worst_stage = _iter_longest;
+    }
+    if (dt > _threshold_us) {
+      _rec->N_slow++;
+      trace(TRACE_LOOP_SLOW, _iter_longest, dt);
+    }
+  }
+
+  _t_iter = now;
+  _iter_longest_us = 0;
+  _iter_longest = LOOP_IDLE;
+  _rec->uptime_ms = millis();
+}
+
+void LoopMonitor::print(Stream &mySerial) {
+  snprintf(buf, BUF_LEN, "%lu\t%lu\t%lu\t%lu\t%s\n",
+           (unsigned long)_threshold_us, (unsigned long)_N_iters,
+           (unsigned long)_rec->N_slow, (unsigned long)_rec->worst_us,
+           loop_stage_name(_rec->worst_stage));
+  mySerial.print(buf);
+}
+
+void LoopMonitor::print_last(Stream &mySerial) {
+  if (!_last_valid) {
+    mySerial.println("none");
+    return;
+  }
+  snprintf(buf, BUF_LEN, "%s\t%lu\t%lu\t%lu\t%s\t",
+           loop_stage_name(_last.stage), (unsigned long)_last.uptime_ms,
+           (unsigned long)_last.N_slow, (unsigned long)_last.worst_us,
+           loop_stage_name(_last.worst_stage));
+  mySerial.print(buf);
+  if (_last.halted) {
+    snprintf(buf, BUF_LEN, "%u\t%lu\n", _last.halt_ID,
+             (unsigned long)_last.safe_us);
+  } else {
+    snprintf(buf, BUF_LEN, "-\t-\n");
+  }
+  mySerial.print(buf);
+}
+
+const char *LoopMonitor::get_last_stage_name() {
+  return _last_valid ? loop_stage_name(_last.stage) : "-";
+}
@@ -0,0 +1,160 @@
+/**
+ * @file    LoopMonitor.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Latency monitor of the main loop, telling what stalled it.
+ *
+ * The main loop marks each subsystem it enters by `LoopMonitor::stage()`,
+ * costing a `micros()` call and a few stores. Per iteration, the monitor takes
+ * the total duration and the stage that took the longest, and flags the
+ * iterations exceeding a threshold, see `TRACE_LOOP_SLOW`. That catches the
+ * stalls threatening the line timing and the safety pulses to the pump well
+ * before the watchdog bites.
+ *
+ * When the watchdog does bite, a reset gives no clue by itself. Hence, the
+ * active stage and the worst iteration are kept in the backup RAM of the
+ * SAMD51, which survives a reset other than a power cycle. The record of the
+ * previous run gets picked up at boot, see `LoopMonitor::print_last()`.
+ * Elsewhere, the record lives in ordinary RAM and does not survive a reset.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef LOOP_MONITOR_H_
+#define LOOP_MONITOR_H_
+
+#include <Arduino.h>
+
+/**
+ * @brief The subsystems run by the main loop.
+ */
+enum LoopStage : uint8_t {
+  LOOP_IDLE,      // In between iterations
+  LOOP_TX,        // Draining the transmit queue
+  LOOP_I2C,       // Background writes to the Centipede ports
+  LOOP_DAQ,       // Reading out the pressure sensors
+  LOOP_COMMANDS,  // Handling serial commands
+  LOOP_DUMP,      // Dumping the protocol program
+  LOOP_FSM,       // Finite state machine, other than uploading
+  LOOP_UPLOAD,    // Uploading a protocol program
+  LOOP_FLASH,     // Writing the wear journal to flash
+  LOOP_TELEMETRY, // Pushing telemetry
+  LOOP_LEDS,      // Composing and sending out the LED data
+  LOOP_SAFETY,    // Safety checks and pulses
+  LOOP_N_STAGES
+};
+
+// Default duration [µs] of an iteration above which it gets flagged as slow
+const uint32_t LOOP_SLOW_US = 20000;
+
+/*------------------------------------------------------------------------------
+  LoopMonitor
+------------------------------------------------------------------------------*/
+
+class LoopMonitor {
+public:
+  /**
+   * @brief Pick up the record left behind by the previous run, if any, and
+   * start a fresh one. Call once at boot.
+   */
+  void begin();
+
+  /**
+   * @brief Mark the start of the next iteration of the main loop, closing the
+   * previous one.
+   */
+  void next_iteration();
+
+  /**
+   * @brief Mark that the main loop enters subsystem @p stage.
+   */
+  inline void stage(LoopStage stage) {
+    uint32_t now = micros();
+    uint32_t dt = now - _t_stage;
+    if (dt > _iter_longest_us) {
+      _iter_longest_us = dt;
+      _iter_longest = _rec->stage;
+    }
+    _t_stage = now;
+    _rec->stage = stage;
+  }
+
+  inline void set_threshold(uint32_t threshold_us) {
+    _threshold_us = threshold_us;
+  }
+
+  /**
+   * @brief Reset the worst iteration and the slow-iteration count.
+   */
+  void reset();
+
+  /**
+   * @brief Record that `halt()` got called with @p halt_ID, having reached
+   * the safe state after @p safe_us µs. Safe to be called from within an
+   * interrupt.
+   */
+  inline void record_halt(uint8_t halt_ID, uint32_t safe_us) {
+    if (_rec == nullptr) {
+      return; // Halted before `begin()`
+    }
+    _rec->halt_ID = halt_ID;
+    _rec->safe_us = safe_us;
+    _rec->halted = true;
+  }
+
+  /**
+   * @brief Print, tab delimited: Threshold [µs], number of iterations, number
+   * of slow iterations, duration of the worst iteration [µs] and its stage
+   * that took the longest.
+   */
+  void print(Stream &mySerial);
+
+  /**
+   * @brief Print the record left behind by the previous run, tab delimited:
+   * The stage active when it ended, its uptime [ms] at the last iteration,
+   * number of slow iterations, duration of the worst iteration [µs], its
+   * stage that took the longest, the halt ID and the time it took `halt()` to
+   * reach the safe state [µs]. The latter two read "-" when it did not halt.
+   * Prints "none" when no record was found.
+   */
+  void print_last(Stream &mySerial);
+
+  /**
+   * @brief Return the name of the stage active when the previous run ended,
+   * or "-" when unknown.
+   */
+  const char *get_last_stage_name();
+
+private:
+  // Kept across resets, hence no initializers
+  struct Record {
+    uint32_t magic;
+    uint32_t uptime_ms;  // `millis()` at the start of the last iteration
+    uint32_t N_slow;     // Number of slow iterations
+    uint32_t worst_us;   // Duration of the worst iteration [µs]
+    uint32_t safe_us;    // Time `halt()` took to reach the safe state [µs]
+    uint8_t worst_stage; // Stage taking the longest in the worst iteration
+    uint8_t stage;       // Stage active right now
+    uint8_t halted;      // Did `halt()` get called?
+    uint8_t halt_ID;     // ID passed to `halt()`
+  };
+
+  Record *_rec = nullptr; // Live record, inside the backup RAM when available
+  Record _last;           // Copy of the record of the previous run
+  bool _last_valid = false;
+  uint32_t _threshold_us = LOOP_SLOW_US;
+  uint32_t _N_iters = 0;         // Number of iterations since the reset
+  uint32_t _t_iter = 0;          // Start of the current iteration [µs]
+  uint32_t _t_stage = 0;         // Start of the current stage [µs]
+  uint32_t _iter_longest_us = 0; // Longest stage of the current iteration [µs]
+  uint8_t _iter_longest = 0;     // Idem, which one
+};
+
+/**
+ * @brief Return the name of stage @p stage.
+ */
+const char *loop_stage_name(uint8_t stage);
+
+#endif
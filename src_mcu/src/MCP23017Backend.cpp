@@ -0,0 +1,153 @@
+/**
+ * @file    MCP23017Backend.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "MCP23017Backend.h"
+
+// Common character buffer for string formatting, see `main.cpp`
+extern const uint8_t BUF_LEN;
+extern char buf[];
+
+/*------------------------------------------------------------------------------
+  MCP23017Backend
+------------------------------------------------------------------------------*/
+
+#if CP_I2C_DMA && defined(__SAMD51__)
+bool MCP23017Backend::begin_async(Sercom *hw1, uint8_t dmac_id1, Sercom *hw2,
+                                  uint8_t dmac_id2) {
+  if (!_engine.begin(hw1, dmac_id1, hw2, dmac_id2)) {
+    return false;
+  }
+  _engine.set_callback(tx_done, this);
+  _async_ready = true;
+  return true;
+}
+#endif
+
+void MCP23017Backend::tx_done(uint32_t done_us, uint8_t N_failed,
+                              uint32_t skew_us, void *ctx) {
+  MCP23017Backend *self = (MCP23017Backend *)ctx;
+  if (N_failed) {
+    self->_check_buses = true; // See `update()`
+  }
+  if (self->_callback) {
+    self->_callback(done_us, N_failed, skew_us, self->_ctx);
+  }
+}
+
+void MCP23017Backend::update() {
+  _engine.update();
+
+  if (_check_buses && !_engine.is_busy()) {
+    // Keep the interrupts from sending out new bitmasks meanwhile
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (!_engine.is_busy()) {
+      _check_buses = false;
+      _cp.checkBuses();
+    }
+    __set_PRIMASK(primask);
+  }
+}
+
+void MCP23017Backend::report_faults(Stream &mySerial) {
+  const CSFaults &faults = _cp.getFaults();
+  snprintf(buf, BUF_LEN, "%lu\t%lu\t%lu\n", (unsigned long)faults.timeouts,
+           (unsigned long)faults.clears, (unsigned long)faults.retries);
+  mySerial.print(buf);
+}
+
+bool MCP23017Backend::calibrate_clock(const uint16_t *sent) {
+  const uint8_t N_steps = sizeof(CP_CLOCK_STEPS) / sizeof(CP_CLOCK_STEPS[0]);
+  int8_t fastest = -1; // Index of the fastest passing clock rate
+
+  for (uint8_t idx = 0; idx < N_steps; ++idx) {
+    _cp.setClock(CP_CLOCK_STEPS[idx]);
+    if (!verify_clock(sent)) {
+      break;
+    }
+    fastest = idx;
+  }
+
+  bool success = (fastest >= 0);
+  if (success) {
+    _clock_hz = CP_CLOCK_STEPS[(fastest > 0) ? fastest - 1 : 0];
+  }
+  _cp.setClock(_clock_hz);
+  _update_us = time_full_update(sent);
+
+  return success;
+}
+
+bool MCP23017Backend::verify_clock(const uint16_t *sent) {
+  const uint16_t patterns[] = {0xFFFF, 0xAAAA, 0x5555, 0x0000}; // 0: Default
+  const uint8_t N_reps = 4;
+  CSFaults faults = _cp.getFaults();
+  bool pass = true;
+
+  // No early exit, such that DEFVAL always ends up at its default value
+  for (uint8_t rep = 0; rep < N_reps; ++rep) {
+    for (uint16_t pattern : patterns) {
+      for (uint8_t port = 0; port < N_CP_PORTS; ++port) {
+        pass &= _cp.portTest(port, pattern ^ (port << 4));
+      }
+    }
+    pass &= (_cp.writePorts(sent, CP_ALL_PORTS) == 0);
+    for (uint8_t port = 0; port < N_CP_PORTS; ++port) {
+      pass &= (_cp.portLatchRead(port) == sent[port]);
+    }
+  }
+  for (uint8_t port = 0; port < N_CP_PORTS; ++port) {
+    _cp.portTest(port, 0);
+  }
+
+  const CSFaults &now = _cp.getFaults();
+  return pass && (now.timeouts == faults.timeouts) &&
+         (now.clears == faults.clears) && (now.retries == faults.retries);
+}
+
+uint32_t MCP23017Backend::time_full_update(const uint16_t *sent) {
+  const uint8_t N_reps = 10;
+  uint32_t tick = micros();
+  for (uint8_t rep = 0; rep < N_reps; ++rep) {
+    _cp.writePorts(sent, CP_ALL_PORTS);
+  }
+  return (micros() - tick) / N_reps;
+}
+
+void MCP23017Backend::report_clock(Stream &mySerial) {
+  snprintf(buf, BUF_LEN, "%lu\t%lu\n", (unsigned long)_clock_hz,
+           (unsigned long)_update_us);
+  mySerial.print(buf);
+}
+
+void MCP23017Backend::benchmark(Stream &mySerial, const uint16_t *sent,
+                                uint16_t N_reps) {
+  uint32_t tick;
+  uint32_t T_port_write;
+  uint32_t T_write_all;
+  uint16_t rep;
+  uint8_t port;
+
+  tick = micros();
+  for (rep = 0; rep < N_reps; rep++) {
+    for (port = 0; port < N_CP_PORTS; port++) {
+      _cp.portWrite(port, sent[port]);
+    }
+  }
+  T_port_write = micros() - tick;
+
+  tick = micros();
+  for (rep = 0; rep < N_reps; rep++) {
+    _cp.writeAllPorts(sent);
+  }
+  T_write_all = micros() - tick;
+
+  snprintf(buf, BUF_LEN, "%lu\t%lu\n", (unsigned long)(T_port_write / N_reps),
+           (unsigned long)(T_write_all / N_reps));
+  mySerial.print(buf);
+}
@@ -0,0 +1,138 @@
+/**
+ * @file    MCP23017Backend.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Output backend driving the Centipede boards, one MCP23017 I/O
+ * expander per port via I2C, see `OutputBackend.h`.
+ *
+ * The blocking writes go through the `Centipede` library. After
+ * `begin_async()` the ports can also be written in the background via the
+ * DMA-driven `I2CEngine`. Besides, it takes care of recovering the buses and
+ * of calibrating their clock rate.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef MCP23017_BACKEND_H_
+#define MCP23017_BACKEND_H_
+
+#include "Centipede.h"
+#include "I2CEngine.h"
+#include "OutputBackend.h"
+#include <Arduino.h>
+
+/*------------------------------------------------------------------------------
+  MCP23017Backend
+------------------------------------------------------------------------------*/
+
+class MCP23017Backend : public OutputBackend {
+public:
+  const char *get_name() const override { return "MCP23017"; }
+
+  uint8_t begin() override { return _cp.initializeOutputs(); }
+
+#if CP_I2C_DMA && defined(__SAMD51__)
+  /**
+   * @brief Hand the background port writes over to the DMA-driven
+   * `I2CEngine`, see `I2CEngine::begin()`. Must be called after `begin()`.
+   *
+   * @return True when successful, false otherwise.
+   */
+  bool begin_async(Sercom *hw1, uint8_t dmac_id1, Sercom *hw2 = nullptr,
+                   uint8_t dmac_id2 = 0);
+#endif
+
+  /**
+   * @brief Get the Centipede object, e.g. to place both boards on separate I2C
+   * buses via `Centipede::setBuses()` before calling `begin()`.
+   */
+  inline Centipede &get_centipede() { return _cp; }
+
+  uint8_t write_ports(const uint16_t *values, uint8_t portmask,
+                      uint32_t *skew_us = nullptr) override {
+    return _cp.writePorts(values, portmask, skew_us);
+  }
+
+  bool can_write_async() const override { return _async_ready; }
+
+  void write_ports_async(const uint16_t *values, uint8_t portmask) override {
+    _engine.write_ports(values, portmask);
+  }
+
+  bool is_busy() const override { return _engine.is_busy(); }
+  void abort() override { _engine.abort(); }
+
+  /**
+   * @brief Abort hung background writes, see `I2CEngine::update()`, and
+   * clear the buses when those have failed.
+   */
+  void update() override;
+
+  bool can_read_back() const override { return true; }
+
+  bool read_port(uint8_t port, uint16_t &latched) override {
+    latched = _cp.portLatchRead(port);
+    return true;
+  }
+
+  /**
+   * @brief Find the fastest reliable I2C clock rate of the buses and keep
+   * running at it, see `CentipedeManager::calibrate_clock()`.
+   *
+   * @param sent The bitmasks last sent to the ports, to be rewritten
+   * @return True when successful, false otherwise.
+   */
+  bool calibrate_clock(const uint16_t *sent);
+
+  /**
+   * @brief See `CentipedeManager::report_clock()`.
+   */
+  void report_clock(Stream &mySerial);
+
+  /**
+   * @brief See `CentipedeManager::benchmark()`.
+   *
+   * @param sent The bitmasks last sent to the ports, to be rewritten
+   */
+  void benchmark(Stream &mySerial, const uint16_t *sent, uint16_t N_reps);
+
+  /**
+   * @brief See `CentipedeManager::report_faults()`.
+   */
+  void report_faults(Stream &mySerial);
+
+  inline void reset_faults() { _cp.resetFaults(); }
+  inline const CSFaults &get_faults() { return _cp.getFaults(); }
+
+private:
+  Centipede _cp; // The Centipede object controlling up to two Centipede boards
+  I2CEngine _engine;         // Background port writes via DMA
+  bool _async_ready = false; // Has `_engine` been set up?
+  volatile bool _check_buses = false;    // Have background writes failed?
+  uint32_t _clock_hz = CP_CLOCK_DEFAULT; // I2C clock rate [Hz]
+  uint32_t _update_us = 0; // Duration [µs] of a full update at `_clock_hz`
+
+  /**
+   * @brief Validate the I2C clock rate in use: Write and read back a few bit
+   * patterns to the harmless DEFVAL registers of all ports, and rewrite the
+   * output latches with the bitmasks @p sent and read them back. Fails on
+   * any mismatch, failed write or recovered bus fault.
+   */
+  bool verify_clock(const uint16_t *sent);
+
+  /**
+   * @brief Measure the average duration [µs] of a full update of all ports by
+   * rewriting the bitmasks @p sent.
+   */
+  uint32_t time_full_update(const uint16_t *sent);
+
+  /**
+   * @brief Callback of `_engine`, flagging failed writes for `update()`.
+   */
+  static void tx_done(uint32_t done_us, uint8_t N_failed, uint32_t skew_us,
+                      void *ctx);
+};
+
+#endif
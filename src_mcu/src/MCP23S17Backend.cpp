@@ -0,0 +1,101 @@
+/**
+ * @file    MCP23S17Backend.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "MCP23S17Backend.h"
+
+// SPI opcode: 0100, the hardware address A2..A0 and the read (1) / write (0)
+// bit
+const uint8_t MCP23S17_OPCODE = 0x40;
+
+// Register addresses, IOCON.BANK = 0. Each A register is followed by its B
+// register, reached by sequential addressing.
+const uint8_t MCP23S17_IODIRA = 0x00;
+const uint8_t MCP23S17_IOCON = 0x0A;
+const uint8_t MCP23S17_OLATA = 0x14;
+
+// IOCON: Hardware address enable
+const uint8_t MCP23S17_IOCON_HAEN = 0x08;
+
+/*------------------------------------------------------------------------------
+  MCP23S17Backend
+------------------------------------------------------------------------------*/
+
+MCP23S17Backend::MCP23S17Backend(SPIClass *spi, uint8_t pin_cs,
+                                 uint32_t SPI_clock)
+    : _spi(spi), _pin_cs(pin_cs),
+      _settings(SPI_clock, MSBFIRST, SPI_MODE0) {}
+
+uint8_t MCP23S17Backend::begin() {
+  pinMode(_pin_cs, OUTPUT);
+  digitalWrite(_pin_cs, HIGH);
+
+  // Before HAEN, all chips listen to address 0. Hence, this reaches them all.
+  uint16_t iocon = MCP23S17_IOCON_HAEN | (MCP23S17_IOCON_HAEN << 8);
+  write_pair(0, MCP23S17_IOCON, iocon);
+
+  uint8_t N_failed = 0;
+  for (uint8_t port = 0; port < N_CP_PORTS; ++port) {
+    write_pair(port, MCP23S17_OLATA, 0);
+    write_pair(port, MCP23S17_IODIRA, 0); // All outputs
+    N_failed += (read_pair(port, MCP23S17_IOCON) != iocon) ||
+                (read_pair(port, MCP23S17_IODIRA) != 0);
+  }
+  return N_failed;
+}
+
+uint8_t MCP23S17Backend::write_ports(const uint16_t *values, uint8_t portmask,
+                                     uint32_t *skew_us) {
+  uint32_t t_first = 0;
+  uint32_t t_last = 0;
+  bool first = true;
+
+  for (uint8_t port = 0; port < N_CP_PORTS; ++port) {
+    if (!((portmask >> port) & 1)) {
+      continue;
+    }
+    write_pair(port, MCP23S17_OLATA, values[port]);
+    t_last = micros();
+    if (first) {
+      t_first = t_last;
+      first = false;
+    }
+  }
+
+  if (skew_us) {
+    *skew_us = t_last - t_first;
+  }
+  return 0;
+}
+
+bool MCP23S17Backend::read_port(uint8_t port, uint16_t &latched) {
+  latched = read_pair(port, MCP23S17_OLATA);
+  return true;
+}
+
+void MCP23S17Backend::write_pair(uint8_t addr, uint8_t reg, uint16_t value) {
+  _spi->beginTransaction(_settings);
+  digitalWrite(_pin_cs, LOW);
+  _spi->transfer(MCP23S17_OPCODE | (addr << 1));
+  _spi->transfer(reg);
+  _spi->transfer(value & 0xFF);
+  _spi->transfer(value >> 8);
+  digitalWrite(_pin_cs, HIGH);
+  _spi->endTransaction();
+}
+
+uint16_t MCP23S17Backend::read_pair(uint8_t addr, uint8_t reg) {
+  _spi->beginTransaction(_settings);
+  digitalWrite(_pin_cs, LOW);
+  _spi->transfer(MCP23S17_OPCODE | (addr << 1) | 1);
+  _spi->transfer(reg);
+  uint16_t value = _spi->transfer(0);
+  value |= (uint16_t)_spi->transfer(0) << 8;
+  digitalWrite(_pin_cs, HIGH);
+  _spi->endTransaction();
+  return value;
+}
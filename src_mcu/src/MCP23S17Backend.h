@@ -0,0 +1,79 @@
+/**
+ * @file    MCP23S17Backend.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Output backend driving one MCP23S17 I/O expander per port via SPI,
+ * see `OutputBackend.h`.
+ *
+ * The MCP23S17 is the SPI sibling of the MCP23017 on the Centipede boards,
+ * with the same registers. All chips share a single chip select and tell
+ * their messages apart by hardware addressing (IOCON.HAEN): the chip of port
+ * `p` must have its address pins A2..A0 strapped to `p`. Hence, up to 8 ports.
+ *
+ * A port write takes a single 4-byte transaction, the opcode, the register
+ * address of OLATA and both output latches, i.e. ~4 µs at 10 MHz. All ports
+ * get written back-to-back with blocking calls, fast enough to do without
+ * DMA. SPI has no acknowledge, hence a port write can't fail. Instead, the
+ * output latches can be read back, see `CentipedeManager::set_verify()`.
+ *
+ * The SPI bus must have been started and must be used by this backend only.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef MCP23S17_BACKEND_H_
+#define MCP23S17_BACKEND_H_
+
+#include "OutputBackend.h"
+#include <Arduino.h>
+#include <SPI.h>
+
+/*------------------------------------------------------------------------------
+  MCP23S17Backend
+------------------------------------------------------------------------------*/
+
+class MCP23S17Backend : public OutputBackend {
+public:
+  /**
+   * @param spi The SPI bus, started already
+   * @param pin_cs Chip select shared by all chips
+   * @param SPI_clock SPI clock frequency [Hz], at most 10 MHz
+   */
+  MCP23S17Backend(SPIClass *spi, uint8_t pin_cs, uint32_t SPI_clock);
+
+  const char *get_name() const override { return "MCP23S17"; }
+
+  /**
+   * @brief Enable the hardware addressing of all chips, set all channels to
+   * output and turn them LOW. A chip not reading back its configuration
+   * counts as failed.
+   */
+  uint8_t begin() override;
+
+  uint8_t write_ports(const uint16_t *values, uint8_t portmask,
+                      uint32_t *skew_us = nullptr) override;
+
+  bool can_read_back() const override { return true; }
+  bool read_port(uint8_t port, uint16_t &latched) override;
+
+private:
+  SPIClass *_spi;
+  uint8_t _pin_cs;
+  SPISettings _settings;
+
+  /**
+   * @brief Write @p value into the register pair starting at @p reg of the
+   * chip at hardware address @p addr, low byte first.
+   */
+  void write_pair(uint8_t addr, uint8_t reg, uint16_t value);
+
+  /**
+   * @brief Read the register pair starting at @p reg of the chip at hardware
+   * address @p addr, low byte first.
+   */
+  uint16_t read_pair(uint8_t addr, uint8_t reg);
+};
+
+#endif
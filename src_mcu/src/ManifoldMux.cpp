@@ -0,0 +1,129 @@
+/**
+ * @file    ManifoldMux.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "ManifoldMux.h"
+#include "translations.h"
+
+// Number of valves fed by each manifold
+static const uint8_t VALVES_PER_MANIFOLD = N_VALVES / N_MANIFOLDS;
+
+/*------------------------------------------------------------------------------
+  ManifoldMux
+------------------------------------------------------------------------------*/
+
+bool ManifoldMux::begin(ProtocolManager *protocol_mgr,
+                        const std::array<uint16_t, N_MANIFOLDS> &N_lines) {
+  uint32_t first = 0;
+  for (uint16_t N : N_lines) {
+    first += N;
+  }
+  if ((first == 0) || (first > protocol_mgr->get_program().size())) {
+    return false;
+  }
+
+  _protocol_mgr = protocol_mgr;
+  first = 0;
+  for (uint8_t idx = 0; idx < N_MANIFOLDS; ++idx) {
+    _subs[idx].first = first;
+    _subs[idx].N_lines = N_lines[idx];
+    first += N_lines[idx];
+  }
+  rewind();
+  return true;
+}
+
+void ManifoldMux::rewind() { _primed = false; }
+
+bool ManifoldMux::advance(Sub &sub, bool first) {
+  Program &program = _protocol_mgr->get_program();
+  if (sub.first + sub.N_lines > program.size()) {
+    return false;
+  }
+
+  // Skip lines without duration, but not endlessly
+  for (uint16_t N_tries = 0; N_tries < sub.N_lines; ++N_tries) {
+    if (first && (N_tries == 0)) {
+      sub.pos = 0;
+    } else {
+      sub.pos = (sub.pos + 1 == sub.N_lines) ? 0 : sub.pos + 1;
+    }
+    program.get(sub.first + sub.pos, sub.line);
+    uint32_t duration_us = decode_duration_us(sub.line.duration);
+    if (duration_us > 0) {
+      sub.remaining += duration_us;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ManifoldMux::next_line(Line &line) {
+  if (_protocol_mgr == nullptr) {
+    return false;
+  }
+
+  if (!_primed) {
+    for (Sub &sub : _subs) {
+      sub.remaining = 0;
+      if (sub.N_lines && !advance(sub, true)) {
+        return false;
+      }
+    }
+    _primed = true;
+  }
+
+  // The merged line lasts until the first of the sub-programs switches lines.
+  // With only four timelines, a linear search beats keeping a heap.
+  int32_t dt = INT32_MAX;
+  for (const Sub &sub : _subs) {
+    if (sub.N_lines) {
+      dt = min(dt, sub.remaining);
+    }
+  }
+
+  // Merge the valves of each manifold as opened by its own sub-program
+  Line sub_line;
+  line.clear_points();
+  for (uint8_t idx = 0; idx < N_MANIFOLDS; ++idx) {
+    const Sub &sub = _subs[idx];
+    if (sub.N_lines == 0) {
+      continue;
+    }
+    sub.line.unpack_into(sub_line);
+    for (const P &p : sub_line) {
+      Grid::valve_t valve = P2ADDR[p.pack_into_byte()].valve;
+      if (valve && ((valve - 1) / VALVES_PER_MANIFOLD == idx)) {
+        line.add_point(p);
+      }
+    }
+  }
+
+  // The encoded duration might be off by a rounding error. It gets carried
+  // over into the remaining time of each sub-program, keeping them exact.
+  line.duration = encode_duration_us(dt);
+  int32_t played = decode_duration_us(line.duration);
+  for (Sub &sub : _subs) {
+    if (sub.N_lines == 0) {
+      continue;
+    }
+    sub.remaining -= played;
+    while (sub.remaining <= 0) {
+      if (!advance(sub, false)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+void ManifoldMux::print(Stream &mySerial) const {
+  for (const Sub &sub : _subs) {
+    snprintf(buf, BUF_LEN, "%u\t%u\t%u\n", sub.first, sub.N_lines, sub.pos);
+    mySerial.print(buf);
+  }
+}
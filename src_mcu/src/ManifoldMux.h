@@ -0,0 +1,96 @@
+/**
+ * @file    ManifoldMux.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Independent sub-programs per manifold, each running on its own
+ * timeline, merged into a single protocol on the fly.
+ *
+ * The four manifolds, i.e. valves 1-28, 29-56, 57-84 and 85-112, each have
+ * their own pressure sensor and vessel. Instead of storing the cross product
+ * of four timelines as one huge flat program, the protocol program in memory
+ * holds the sub-programs back to back: Manifold 1 takes the first `N_lines[0]`
+ * lines, manifold 2 the next `N_lines[1]` lines, et cetera. Each sub-program
+ * only steers the valves of its own manifold and repeats endlessly at its own
+ * period. A manifold without lines stays closed.
+ *
+ * Whenever one or more of the sub-programs switch lines, a merged line gets
+ * produced holding the open valves of all four, lasting until the next switch
+ * of any of them. The merged lines get played like any other `LineSource`.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef MANIFOLD_MUX_H_
+#define MANIFOLD_MUX_H_
+
+#include <Arduino.h>
+#include <array>
+
+#include "ProtocolManager.h"
+
+/*------------------------------------------------------------------------------
+  ManifoldMux
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Class to merge the sub-programs of the manifolds into a single stream
+ * of lines, see above.
+ */
+class ManifoldMux : public LineSource {
+public:
+  /**
+   * @brief Split the protocol program in memory of @p protocol_mgr into
+   * sub-programs of @p N_lines lines per manifold, back to back, starting
+   * from their first line.
+   *
+   * @return False when the lines exceed the program, true otherwise.
+   */
+  bool begin(ProtocolManager *protocol_mgr,
+             const std::array<uint16_t, N_MANIFOLDS> &N_lines);
+
+  /**
+   * @brief Start all sub-programs from their first line.
+   */
+  void rewind() override;
+
+  /**
+   * @brief Produce the next merged line into @p line.
+   *
+   * @return False when the program in memory no longer holds the
+   * sub-programs, e.g. after it got replaced, true otherwise.
+   */
+  bool next_line(Line &line) override;
+
+  /**
+   * @brief Print the sub-programs, one line per manifold, tab delimited: First
+   * line number, number of lines and the current line number within the
+   * sub-program.
+   */
+  void print(Stream &mySerial) const;
+
+private:
+  struct Sub {
+    uint16_t first = 0;     // Line number of its first line in the program
+    uint16_t N_lines = 0;   // Number of lines, 0 to keep the manifold closed
+    uint16_t pos = 0;       // Current line number within the sub-program
+    int32_t remaining = 0;  // Time [µs] left of the current line
+    PackedLine line;        // Current line
+  };
+
+  ProtocolManager *_protocol_mgr = nullptr;
+  std::array<Sub, N_MANIFOLDS> _subs;
+  bool _primed = false; // Do the subs hold their current line?
+
+  /**
+   * @brief Advance sub-program @p sub to its next line with a nonzero
+   * duration, adding the duration to its remaining time.
+   *
+   * @return False when the program no longer holds the sub-program, or when
+   * none of its lines last, true otherwise.
+   */
+  bool advance(Sub &sub, bool first);
+};
+
+#endif
@@ -0,0 +1,121 @@
+/**
+ * @file    MarkovGenerator.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "MarkovGenerator.h"
+#include "translations.h"
+
+#include <algorithm>
+
+/*------------------------------------------------------------------------------
+  MarkovGenerator
+------------------------------------------------------------------------------*/
+
+void MarkovGenerator::begin(const MarkovParams &params) {
+  _params = params;
+  _params.quantum = constrain(_params.quantum, 1, MARKOV_QUANTUM_MAX);
+  std::sort(_params.on_ms.begin(), _params.on_ms.end());
+  std::sort(_params.off_ms.begin(), _params.off_ms.end());
+
+  _mean_on_ms = mean_of(_params.on_ms);
+  _mean_off_ms = mean_of(_params.off_ms);
+  rewind();
+}
+
+void MarkovGenerator::rewind() {
+  _rng = _params.seed ? _params.seed : 1;
+  _now = 0;
+  _N_generated = 0;
+  _N_switches = 0;
+
+  // Open with the probability of the expected transparency
+  uint32_t mean_sum_ms = _mean_on_ms + _mean_off_ms;
+  for (uint8_t idx = 0; idx < N_VALVES; ++idx) {
+    _open[idx] = (mean_sum_ms > 0) &&
+                 ((uint64_t)(random32() >> 16) * mean_sum_ms <
+                  ((uint64_t)_mean_on_ms << 16));
+    uint32_t duration = draw(_open[idx] ? _params.on_ms : _params.off_ms);
+    _due[idx] = 1 + (((uint64_t)duration * (random32() >> 16)) >> 16);
+    _heap[idx] = idx;
+  }
+
+  for (int16_t pos = N_VALVES / 2 - 1; pos >= 0; --pos) {
+    sift_down(pos);
+  }
+}
+
+uint32_t MarkovGenerator::random32() {
+  _rng ^= _rng << 13;
+  _rng ^= _rng >> 17;
+  _rng ^= _rng << 5;
+  return _rng;
+}
+
+uint32_t MarkovGenerator::draw(const MarkovTable &table) {
+  uint32_t r = random32();
+  uint8_t seg = ((r >> 16) * (MARKOV_TABLE_LEN - 1)) >> 16;
+  uint32_t frac = r & 0xFFFF;
+  uint32_t ms = table[seg] + (((table[seg + 1] - table[seg]) * frac) >> 16);
+  uint32_t quanta = (ms + _params.quantum / 2) / _params.quantum;
+  return max(quanta, (uint32_t)1);
+}
+
+uint32_t MarkovGenerator::mean_of(const MarkovTable &table) {
+  // Each segment between neighbouring quantiles is equally likely
+  uint32_t sum = 0;
+  for (uint8_t seg = 0; seg < MARKOV_TABLE_LEN - 1; ++seg) {
+    sum += table[seg] + table[seg + 1];
+  }
+  return sum / (2 * (MARKOV_TABLE_LEN - 1));
+}
+
+void MarkovGenerator::sift_down(uint8_t pos) {
+  uint8_t idx = _heap[pos];
+  while (true) {
+    uint8_t child = 2 * pos + 1;
+    if (child >= N_VALVES) {
+      break;
+    }
+    if ((child + 1 < N_VALVES) &&
+        ((int32_t)(_due[_heap[child + 1]] - _due[_heap[child]]) < 0)) {
+      child++;
+    }
+    if ((int32_t)(_due[_heap[child]] - _due[idx]) >= 0) {
+      break;
+    }
+    _heap[pos] = _heap[child];
+    pos = child;
+  }
+  _heap[pos] = idx;
+}
+
+bool MarkovGenerator::next_valves(uint16_t &duration, ValveSet &valves) {
+  // Switch the valves that are due, rescheduling each
+  while ((int32_t)(_due[_heap[0]] - _now) <= 0) {
+    uint8_t idx = _heap[0];
+    _open[idx] = !_open[idx];
+    _due[idx] = _now + draw(_open[idx] ? _params.on_ms : _params.off_ms);
+    sift_down(0);
+    _N_switches++;
+  }
+
+  valves.clear();
+  for (uint8_t idx = 0; idx < N_VALVES; ++idx) {
+    if (_open[idx]) {
+      valves.set(idx + 1);
+    }
+  }
+
+  // Last until the next valve is due
+  uint32_t quanta = _due[_heap[0]] - _now;
+  quanta =
+      min(quanta, (uint32_t)(DURATION_MANTISSA_MASK / _params.quantum));
+  duration = encode_duration_us(quanta * _params.quantum * 1000);
+  _now += quanta;
+  _N_generated++;
+  return true;
+}
@@ -0,0 +1,163 @@
+/**
+ * @file    MarkovGenerator.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Stochastic generation of an endless jetting protocol on the fly, in
+ * which each valve switches independently with controlled statistics of its
+ * on and off durations, as characterized by `valve_on_off_PDFs()` of
+ * `protocols/utils_valves_stack.py`.
+ *
+ * Each valve is a two-state renewal process: Every time it switches, the time
+ * it stays in its new state gets drawn from the distribution of the on or of
+ * the off durations. A distribution is given as a table of
+ * `MARKOV_TABLE_LEN` quantiles, equally spaced in probability from the
+ * shortest duration to the longest, see `pdf_to_quantiles()` of
+ * `utils_valves_stack.py`. Sampling picks a random segment between two
+ * neighbouring quantiles and interpolates linearly within it, i.e. a
+ * piecewise-linear inverse cumulative distribution. The random numbers come
+ * from an xorshift32 generator. The resulting transparency follows from the
+ * mean on and off durations.
+ *
+ * The times at which the valves switch next are kept in a binary min-heap. A
+ * line lasts until the earliest of them, hence producing a line only touches
+ * the valves that switch, at O(log N_VALVES) each. Durations get rounded to a
+ * multiple of the time quantum, such that valves due at about the same time
+ * switch together and the line rate stays bounded.
+ *
+ * The valves are uncoupled: There is no spatial correlation between them.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef MARKOV_GENERATOR_H_
+#define MARKOV_GENERATOR_H_
+
+#include <Arduino.h>
+#include <array>
+
+#include "ProtocolManager.h"
+
+/**
+ * @brief Number of quantiles describing a distribution of durations.
+ */
+const uint8_t MARKOV_TABLE_LEN = 16;
+
+/**
+ * @brief Coarsest time quantum [ms].
+ */
+const uint16_t MARKOV_QUANTUM_MAX = 1000;
+
+// Quantiles [ms] of a distribution of durations, in ascending order
+typedef std::array<uint16_t, MARKOV_TABLE_LEN> MarkovTable;
+
+/**
+ * @brief Parameters of the generated protocol. The default distributions are
+ * uniform, from 50 to 800 ms on and from 75 to 1200 ms off, giving a
+ * transparency of 40 % like `config_proto_opensimplex.py`.
+ */
+struct MarkovParams {
+  uint16_t seed = 1;     // Seed of the random numbers
+  uint16_t quantum = 10; // Time resolution [ms], i.e. the shortest line
+  MarkovTable on_ms = {50,  100, 150, 200, 250, 300, 350, 400,
+                       450, 500, 550, 600, 650, 700, 750, 800};
+  MarkovTable off_ms = {75,  150, 225, 300, 375,  450,  525,  600,
+                        675, 750, 825, 900, 975, 1050, 1125, 1200};
+};
+
+/*------------------------------------------------------------------------------
+  MarkovGenerator
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Class to generate the lines of an endless jetting protocol of
+ * independently switching valves, one by one.
+ */
+class MarkovGenerator : public LineSource {
+public:
+  /**
+   * @brief Start generating from line 0 onwards, using @p params. The tables
+   * get sorted and the quantum gets constrained to [1, `MARKOV_QUANTUM_MAX`].
+   */
+  void begin(const MarkovParams &params);
+
+  /**
+   * @brief Start generating from line 0 onwards, using the same parameters
+   * and seed. Each valve starts in a random state, drawn with the expected
+   * transparency, and with a random part of a drawn duration left.
+   */
+  void rewind() override;
+
+  /**
+   * @brief Switch the valves that are due, and produce the line lasting until
+   * the next valve is due into @p valves. Lines get capped at
+   * `DURATION_MANTISSA_MASK` ms to be encoded exactly.
+   *
+   * @return Always true, as the generated protocol is endless.
+   */
+  bool next_valves(uint16_t &duration, ValveSet &valves) override;
+
+  inline const MarkovParams &get_params() const { return _params; }
+
+  /**
+   * @brief Return the mean on duration [ms] of the distribution.
+   */
+  inline uint32_t get_mean_on_ms() const { return _mean_on_ms; }
+
+  /**
+   * @brief Return the mean off duration [ms] of the distribution.
+   */
+  inline uint32_t get_mean_off_ms() const { return _mean_off_ms; }
+
+  /**
+   * @brief Return the number of lines generated since `begin()`.
+   */
+  inline uint32_t get_N_generated() const { return _N_generated; }
+
+  /**
+   * @brief Return the number of valve switches since `begin()`.
+   */
+  inline uint32_t get_N_switches() const { return _N_switches; }
+
+private:
+  MarkovParams _params;
+  uint32_t _mean_on_ms = 0;
+  uint32_t _mean_off_ms = 0;
+
+  uint32_t _rng = 1; // State of the xorshift32 generator, never 0
+  uint32_t _now = 0; // Start time of the next line [quanta]
+
+  // Per valve, index = valve - 1
+  std::array<uint32_t, N_VALVES> _due{}; // Time of the next switch [quanta]
+  std::array<bool, N_VALVES> _open{};    // Present state
+
+  // Valve indices, ordered as a min-heap on `_due`
+  std::array<uint8_t, N_VALVES> _heap{};
+
+  uint32_t _N_generated = 0;
+  uint32_t _N_switches = 0;
+
+  /**
+   * @brief Return the next random number of the xorshift32 generator.
+   */
+  uint32_t random32();
+
+  /**
+   * @brief Draw a duration [quanta] from @p table, at least 1.
+   */
+  uint32_t draw(const MarkovTable &table);
+
+  /**
+   * @brief Return the mean [ms] of the distribution of @p table.
+   */
+  static uint32_t mean_of(const MarkovTable &table);
+
+  /**
+   * @brief Restore the heap order below position @p pos, after the valve at
+   * @p pos got rescheduled to a later time.
+   */
+  void sift_down(uint8_t pos);
+};
+
+#endif
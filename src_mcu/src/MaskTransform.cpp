@@ -0,0 +1,129 @@
+/**
+ * @file    MaskTransform.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "MaskTransform.h"
+#include "translations.h"
+
+/**
+ * @brief Wrap PCS coordinate @p c shifted by @p d around with a period of
+ * `NUMEL_PCS_AXIS + 1`, see `MaskTransform.h`.
+ *
+ * @return The index along the PCS axis, `NUMEL_PCS_AXIS` for the border.
+ */
+static uint8_t wrap_index(int8_t c, int8_t d) {
+  const int16_t period = NUMEL_PCS_AXIS + 1;
+  int16_t idx = ((int16_t)c - Grid::PCS_MIN + d) % period;
+  return (idx < 0) ? idx + period : idx;
+}
+
+/*------------------------------------------------------------------------------
+  MaskTransform
+------------------------------------------------------------------------------*/
+
+bool MaskTransform::set(uint8_t orientation, int8_t dx, int8_t dy,
+                        bool invert) {
+  if ((orientation >= N_ORIENTATIONS) || ((dx + dy) & 1)) {
+    return false;
+  }
+
+  std::array<uint8_t, N_CHANNELS> map;
+  CP_Masks wired{};
+  map.fill(DROPPED);
+
+  for (uint8_t valve = 1; valve <= N_VALVES; ++valve) {
+    int8_t x = VALVE2P[valve][0];
+    int8_t y = VALVE2P[valve][1];
+    int8_t u, v; // Reoriented PCS point
+    switch (orientation) {
+      case 1:
+        u = -x, v = y;
+        break;
+      case 2:
+        u = x, v = -y;
+        break;
+      case 3:
+        u = -y, v = x;
+        break;
+      case 4:
+        u = -x, v = -y;
+        break;
+      case 5:
+        u = y, v = -x;
+        break;
+      case 6:
+        u = y, v = x;
+        break;
+      case 7:
+        u = -y, v = -x;
+        break;
+      default:
+        u = x, v = y;
+        break;
+    }
+
+    const ValveAddress &src = VALVE2ADDR[valve - 1];
+    wired[src.cp_port] |= 1U << src.cp_bit;
+
+    uint8_t idx_x = wrap_index(u, dx);
+    uint8_t idx_y = wrap_index(v, dy);
+    if ((idx_x == NUMEL_PCS_AXIS) || (idx_y == NUMEL_PCS_AXIS)) {
+      continue; // Shifted onto the border
+    }
+
+    // `P2VALVE` runs from the top row down
+    Grid::valve_t dst_valve = P2VALVE[NUMEL_PCS_AXIS - 1 - idx_y][idx_x];
+    if (dst_valve == 0) {
+      continue;
+    }
+    const ValveAddress &dst = VALVE2ADDR[dst_valve - 1];
+    map[src.cp_port * 16 + src.cp_bit] = dst.cp_port * 16 + dst.cp_bit;
+  }
+
+  // `apply()` might get called from within the playback timer interrupt
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  _orientation = orientation;
+  _dx = dx;
+  _dy = dy;
+  _invert = invert;
+  _identity = (orientation == 0) && (dx == 0) && (dy == 0) && !invert;
+  _map = map;
+  _wired = wired;
+  __set_PRIMASK(primask);
+  return true;
+}
+
+void MaskTransform::apply(CP_Masks &masks) const {
+  if (_identity) {
+    return;
+  }
+
+  CP_Masks out{};
+  for (uint8_t port = 0; port < N_CP_PORTS; ++port) {
+    uint16_t bits = masks[port];
+    while (bits) {
+      uint8_t dst = _map[port * 16 + __builtin_ctz(bits)];
+      bits &= bits - 1; // Clear lowest set bit
+      if (dst != DROPPED) {
+        out[dst >> 4] |= 1U << (dst & 0x0F);
+      }
+    }
+  }
+
+  if (_invert) {
+    for (uint8_t port = 0; port < N_CP_PORTS; ++port) {
+      out[port] ^= _wired[port];
+    }
+  }
+  masks = out;
+}
+
+void MaskTransform::print(Stream &mySerial) const {
+  snprintf(buf, BUF_LEN, "%u\t%d\t%d\t%u\n", _orientation, _dx, _dy, _invert);
+  mySerial.print(buf);
+}
@@ -0,0 +1,101 @@
+/**
+ * @file    MaskTransform.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Geometric transforms of the lines being played, such that a single
+ * uploaded protocol serves its mirrored, rotated or shifted variants as well.
+ *
+ * A transform consists of an orientation, i.e. one of the 8 symmetries of the
+ * square PCS, followed by a translation and an optional inversion of all
+ * valves. It gets compiled once into a permutation table over the Centipede
+ * channels, after which transforming the Centipede port bitmasks of a line
+ * takes a table look-up per open valve, whatever the packing of the protocol.
+ *
+ * The valves sit at every other PCS point. Hence, a translation must be over
+ * an even `dx + dy` to land the valves onto valves again. A translation wraps
+ * around with a period of `NUMEL_PCS_AXIS + 1`, i.e. as if the PCS were
+ * bordered by a row and a column without valves, because an odd period would
+ * break the checkerboard of the valves. Valves shifted onto that border get
+ * dropped.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef MASK_TRANSFORM_H_
+#define MASK_TRANSFORM_H_
+
+#include <Arduino.h>
+#include <array>
+
+#include "CentipedeManager.h"
+
+/**
+ * @brief The orientations, applied to PCS point (x, y) before the translation:
+ *   0: Identity        (x, y)
+ *   1: Mirror x        (-x, y)
+ *   2: Mirror y        (x, -y)
+ *   3: Rotate 90°      (-y, x), counter-clockwise
+ *   4: Rotate 180°     (-x, -y)
+ *   5: Rotate 270°     (y, -x)
+ *   6: Transpose       (y, x)
+ *   7: Anti-transpose  (-y, -x)
+ */
+const uint8_t N_ORIENTATIONS = 8;
+
+/*------------------------------------------------------------------------------
+  MaskTransform
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Class to apply a geometric transform onto Centipede port bitmasks.
+ */
+class MaskTransform {
+public:
+  /**
+   * @brief Compile the transform, see above. Orientation 0 without translation
+   * and inversion restores the identity.
+   *
+   * @param orientation See `N_ORIENTATIONS`
+   * @param dx Translation along the x-axis
+   * @param dy Translation along the y-axis
+   * @param invert Swap open and closed valves?
+   * @return False when the transform is invalid, leaving the present one as
+   * is, true otherwise.
+   */
+  bool set(uint8_t orientation, int8_t dx = 0, int8_t dy = 0,
+           bool invert = false);
+
+  /**
+   * @brief Transform the Centipede port bitmasks @p masks in place.
+   */
+  void apply(CP_Masks &masks) const;
+
+  inline bool is_identity() const { return _identity; }
+  inline uint8_t get_orientation() const { return _orientation; }
+  inline int8_t get_dx() const { return _dx; }
+  inline int8_t get_dy() const { return _dy; }
+  inline bool get_invert() const { return _invert; }
+
+  /**
+   * @brief Print the transform, tab delimited: Orientation, dx, dy, invert.
+   */
+  void print(Stream &mySerial) const;
+
+private:
+  static const uint8_t N_CHANNELS = N_CP_PORTS * 16;
+  static const uint8_t DROPPED = 0xFF; // Channel without destination
+
+  uint8_t _orientation = 0;
+  int8_t _dx = 0;
+  int8_t _dy = 0;
+  bool _invert = false;
+  bool _identity = true; // Skip `apply()` altogether?
+
+  // Destination channel `port * 16 + bit` per source channel
+  std::array<uint8_t, N_CHANNELS> _map{};
+  CP_Masks _wired{}; // Channels wired to a valve, see `_invert`
+};
+
+#endif
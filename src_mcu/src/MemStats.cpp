@@ -0,0 +1,88 @@
+/**
+ * @file    MemStats.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "MemStats.h"
+
+// See `main.cpp`
+extern const uint8_t BUF_LEN; // Common character buffer for string formatting
+extern char buf[];            // Common character buffer for string formatting
+
+#if defined(__SAMD51__)
+
+// See the linker script and `MemoryFree.cpp`
+extern "C" char *sbrk(int incr);
+extern "C" char end;         // Start of the heap
+extern "C" char __StackTop;  // Start of the stack, growing downwards
+
+static uint32_t *paint_lo = nullptr; // Lowest painted word
+static uint32_t *paint_hi = nullptr; // One past the highest painted word
+
+/**
+ * @brief Return the lowest painted word that got overwritten since
+ * `mem_paint()`, searching upwards from the present heap end.
+ */
+static uint32_t *lowest_touched() {
+  uint32_t *word = (uint32_t *)(((uintptr_t)sbrk(0) + 3) & ~(uintptr_t)3);
+  if (word < paint_lo) {
+    word = paint_lo;
+  }
+  while ((word < paint_hi) && (*word == MEM_PAINT_PATTERN)) {
+    word++;
+  }
+  return word;
+}
+
+void mem_paint() {
+  uint32_t sp = __get_MSP();
+  paint_lo = (uint32_t *)(((uintptr_t)sbrk(0) + 3) & ~(uintptr_t)3);
+  paint_hi = (uint32_t *)((sp - MEM_PAINT_GUARD) & ~(uintptr_t)3);
+  for (uint32_t *word = paint_lo; word < paint_hi; ++word) {
+    *word = MEM_PAINT_PATTERN;
+  }
+}
+
+uint32_t mem_stack_high_water() {
+  if (paint_lo == nullptr) {
+    return 0;
+  }
+  return (uintptr_t)&__StackTop - (uintptr_t)lowest_touched();
+}
+
+uint32_t mem_min_headroom() {
+  if (paint_lo == nullptr) {
+    return 0;
+  }
+  uint32_t *heap_end = (uint32_t *)sbrk(0);
+  uint32_t *touched = lowest_touched();
+  return (touched > heap_end) ? (uintptr_t)touched - (uintptr_t)heap_end : 0;
+}
+
+static uint32_t heap_size() { return (uintptr_t)sbrk(0) - (uintptr_t)&end; }
+
+static uint32_t headroom() {
+  char top;
+  return (uintptr_t)&top - (uintptr_t)sbrk(0);
+}
+
+#else
+
+void mem_paint() {}
+uint32_t mem_stack_high_water() { return 0; }
+uint32_t mem_min_headroom() { return 0; }
+static uint32_t heap_size() { return 0; }
+static uint32_t headroom() { return 0; }
+
+#endif
+
+void mem_print_watermarks(Stream &mySerial) {
+  snprintf(buf, BUF_LEN, "%lu\t%lu\t%lu\t%lu\n",
+           (unsigned long)mem_stack_high_water(),
+           (unsigned long)mem_min_headroom(), (unsigned long)heap_size(),
+           (unsigned long)headroom());
+  mySerial.print(buf);
+}
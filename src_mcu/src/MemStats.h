@@ -0,0 +1,57 @@
+/**
+ * @file    MemStats.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   High-water marks of the stack and the heap.
+ *
+ * `freeMemory()` only tells the present gap between the heap and the stack,
+ * whereas large stack objects, like a `Line` of 454 bytes, are short-lived.
+ * Hence, the gap gets painted with a known pattern once at boot by
+ * `mem_paint()`. Whatever the stack or the heap grows into afterwards gets
+ * overwritten, such that `mem_print_watermarks()` can tell the deepest stack
+ * ever reached and the smallest gap ever left over.
+ *
+ * Only available on the SAMD51, elsewhere all numbers read 0.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef MEM_STATS_H_
+#define MEM_STATS_H_
+
+#include <Arduino.h>
+
+// Pattern painted onto the gap between the heap and the stack
+const uint32_t MEM_PAINT_PATTERN = 0xA5C3A5C3;
+
+// Bytes below the present stack pointer to leave unpainted, covering the stack
+// frame of `mem_paint()` itself
+const uint16_t MEM_PAINT_GUARD = 64;
+
+/**
+ * @brief Paint the present gap between the heap and the stack, see above. Call
+ * once at boot, after the large heap allocations.
+ */
+void mem_paint();
+
+/**
+ * @brief Return the deepest the stack has ever been [bytes].
+ */
+uint32_t mem_stack_high_water();
+
+/**
+ * @brief Return the smallest gap ever left between the heap and the stack
+ * since `mem_paint()` [bytes].
+ */
+uint32_t mem_min_headroom();
+
+/**
+ * @brief Print the high-water marks, tab delimited: Deepest stack [bytes],
+ * smallest headroom [bytes], present heap size [bytes], present headroom
+ * [bytes], i.e. `freeMemory()`.
+ */
+void mem_print_watermarks(Stream &mySerial);
+
+#endif
@@ -0,0 +1,55 @@
+/**
+ * @file    MemoryArena.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "MemoryArena.h"
+
+// See `main.cpp`
+extern const uint8_t BUF_LEN; // Common character buffer for string formatting
+extern char buf[];            // Common character buffer for string formatting
+
+/*------------------------------------------------------------------------------
+  MemoryArena
+------------------------------------------------------------------------------*/
+
+void MemoryArena::begin(uint8_t *base, uint32_t N_bytes) {
+  if (base == nullptr) {
+    N_bytes = 0;
+  }
+
+  // Align the start to 4 bytes
+  uintptr_t ofs = (4 - ((uintptr_t)base & 3)) & 3;
+  _base = base + ofs;
+  _N_bytes = (N_bytes > ofs) ? N_bytes - ofs : 0;
+  _used = 0;
+  _N_allocs = 0;
+}
+
+uint8_t *MemoryArena::alloc(uint32_t N_bytes, const char *name) {
+  uint32_t N_aligned = (N_bytes + 3) & ~3UL;
+  if ((N_aligned > _N_bytes - _used) || (_N_allocs == ARENA_MAX_ALLOCATIONS)) {
+    return nullptr;
+  }
+
+  uint8_t *ptr = _base + _used;
+  _used += N_aligned;
+  _allocs[_N_allocs++] = {name, N_bytes};
+  return ptr;
+}
+
+uint32_t MemoryArena::get_N_free() const { return _N_bytes - _used; }
+
+void MemoryArena::print(Stream &mySerial) {
+  snprintf(buf, BUF_LEN, "%lu\t%lu\t%u\n", (unsigned long)_N_bytes,
+           (unsigned long)get_N_free(), _N_allocs);
+  mySerial.print(buf);
+  for (uint8_t idx = 0; idx < _N_allocs; ++idx) {
+    snprintf(buf, BUF_LEN, "%s\t%lu\n", _allocs[idx].name,
+             (unsigned long)_allocs[idx].N_bytes);
+    mySerial.print(buf);
+  }
+}
@@ -0,0 +1,80 @@
+/**
+ * @file    MemoryArena.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   A single block of memory, sized at boot from the free RAM, out of
+ * which the large buffers get carved by bump allocation.
+ *
+ * Instead of sizing the protocol program storage at compile time from a hand
+ * calculation, all RAM that is free at boot, minus a reserve for the stack and
+ * for the heap use of the libraries, gets claimed as one arena. The valve-event
+ * log takes its fixed share and the protocol program slots split the
+ * remainder. The burst capture in turn borrows the unused tail of the program
+ * storage, see `ProtocolManager::lend_spare_memory()`. Allocations are never
+ * freed.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef MEMORY_ARENA_H_
+#define MEMORY_ARENA_H_
+
+#include <Arduino.h>
+#include <array>
+
+// Maximum number of allocations kept track of for reporting
+const uint8_t ARENA_MAX_ALLOCATIONS = 8;
+
+/*------------------------------------------------------------------------------
+  MemoryArena
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Class to carve buffers out of a single block of memory, see above.
+ */
+class MemoryArena {
+public:
+  /**
+   * @brief Take over the block of @p N_bytes bytes at @p base.
+   */
+  void begin(uint8_t *base, uint32_t N_bytes);
+
+  /**
+   * @brief Allocate @p N_bytes bytes, 4-byte aligned.
+   *
+   * @param name Name to report the allocation by, see `print()`
+   * @return Pointer to the allocated memory, or nullptr when the arena lacks
+   * the room.
+   */
+  uint8_t *alloc(uint32_t N_bytes, const char *name);
+
+  /**
+   * @brief Return the number of bytes left to allocate, 4-byte aligned.
+   */
+  uint32_t get_N_free() const;
+
+  inline uint32_t get_N_bytes() const { return _N_bytes; }
+
+  /**
+   * @brief Print the split of the arena, tab delimited. First a header line:
+   * Total bytes, free bytes, number of allocations. Then one line per
+   * allocation: Name, bytes.
+   */
+  void print(Stream &mySerial);
+
+private:
+  struct Allocation {
+    const char *name;
+    uint32_t N_bytes;
+  };
+
+  uint8_t *_base = nullptr;
+  uint32_t _N_bytes = 0; // Size of the arena
+  uint32_t _used = 0;    // Bytes allocated so far, including alignment
+  std::array<Allocation, ARENA_MAX_ALLOCATIONS> _allocs;
+  uint8_t _N_allocs = 0;
+};
+
+#endif
@@ -0,0 +1,170 @@
+/**
+ * @file    ModbusMaster.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "ModbusMaster.h"
+#include "crc16.h"
+#include "translations.h"
+
+/*------------------------------------------------------------------------------
+  ModbusMaster
+------------------------------------------------------------------------------*/
+
+void ModbusMaster::begin(uint32_t baudrate, uint8_t slave,
+                         void (*callback)(const ModbusReply &reply, void *ctx),
+                         void *ctx) {
+  _slave = slave;
+  _callback = callback;
+  _ctx = ctx;
+  _char_us = 11000000UL / baudrate + 1; // Start, 8 data, parity/stop, stop
+
+  pinMode(_pin_DE, OUTPUT);
+  digitalWrite(_pin_DE, LOW);
+  _port.begin(baudrate);
+
+  _head = 0;
+  _N_queued = 0;
+  _state = IDLE;
+  _t_idle = micros();
+}
+
+bool ModbusMaster::push(uint8_t func, uint16_t reg, uint16_t value) {
+  if (_N_queued == MODBUS_QUEUE_LEN) {
+    _N_dropped++;
+    return false;
+  }
+
+  uint8_t slot = (_head + _N_queued) % MODBUS_QUEUE_LEN;
+  _queue[slot] = {func, reg, value};
+  _N_queued++;
+  return true;
+}
+
+uint8_t ModbusMaster::reply_len() const {
+  if (_N_rx < 3) {
+    return 0;
+  }
+  if (_frame[1] & 0x80) {
+    return 5; // Address, function, exception code, CRC
+  }
+  if (_frame[1] == FUNC_READ) {
+    return 5 + _frame[2]; // Address, function, byte count, data, CRC
+  }
+  return 8; // Echo of the write request
+}
+
+void ModbusMaster::finish(ModbusStatus status, uint16_t value) {
+  switch (status) {
+    case MODBUS_TIMEOUT:
+      _N_timeout++;
+      break;
+    case MODBUS_CRC:
+      _N_crc++;
+      break;
+    case MODBUS_EXCEPTION:
+      _N_exception++;
+      break;
+    default:
+      _rtt_us = micros() - _t_send;
+      break;
+  }
+
+  _state = IDLE;
+  _t_idle = micros();
+  if (_callback) {
+    _callback({_current.func, _current.reg, value, status}, _ctx);
+  }
+}
+
+void ModbusMaster::update() {
+  uint32_t now = micros();
+
+  switch (_state) {
+    case IDLE: {
+      if (!_N_queued || (now - _t_idle < MODBUS_SILENCE_US)) {
+        return;
+      }
+
+      _current = _queue[_head];
+      _head = (_head + 1) % MODBUS_QUEUE_LEN;
+      _N_queued--;
+
+      _frame[0] = _slave;
+      _frame[1] = _current.func;
+      _frame[2] = _current.reg >> 8;
+      _frame[3] = _current.reg & 0xFF;
+      _frame[4] = _current.value >> 8;
+      _frame[5] = _current.value & 0xFF;
+      uint16_t crc = crc16_modbus(_frame, 6);
+      _frame[6] = crc & 0xFF;
+      _frame[7] = crc >> 8;
+
+      // Discard any stray bytes, e.g. a late reply to a timed-out request
+      while (_port.available()) {
+        _port.read();
+      }
+
+      digitalWrite(_pin_DE, HIGH);
+      _port.write(_frame, sizeof(_frame));
+      _t_send = now;
+      _N_sent++;
+      _N_rx = 0;
+      _state = SENDING;
+      return;
+    }
+
+    case SENDING:
+      // The UART sends from its own buffer. Only wait on it for the tail end
+      // of the last character, i.e. once it should have been sent in full.
+      if (now - _t_send < (uint32_t)_char_us * sizeof(_frame)) {
+        return;
+      }
+      _port.flush();
+      digitalWrite(_pin_DE, LOW);
+      _state = AWAITING;
+      return;
+
+    case AWAITING:
+      while (_port.available()) {
+        _frame[_N_rx++] = _port.read();
+
+        uint8_t len = reply_len();
+        if (len && (_frame[1] == FUNC_READ) && (len != 7)) {
+          finish(MODBUS_CRC, 0); // Bogus byte count, a register being 2
+          return;
+        }
+        if (len && (_N_rx == len)) {
+          uint16_t crc = crc16_modbus(_frame, len - 2);
+          if ((_frame[len - 2] != (crc & 0xFF)) ||
+              (_frame[len - 1] != (crc >> 8)) || (_frame[0] != _slave) ||
+              ((_frame[1] & 0x7F) != _current.func)) {
+            finish(MODBUS_CRC, 0);
+          } else if (_frame[1] & 0x80) {
+            finish(MODBUS_EXCEPTION, _frame[2]);
+          } else if (_current.func == FUNC_READ) {
+            finish(MODBUS_OK, (_frame[3] << 8) | _frame[4]);
+          } else {
+            finish(MODBUS_OK, (_frame[4] << 8) | _frame[5]);
+          }
+          return;
+        }
+      }
+
+      if (now - _t_send > MODBUS_TIMEOUT_MS * 1000UL) {
+        finish(MODBUS_TIMEOUT, 0);
+      }
+      return;
+  }
+}
+
+void ModbusMaster::print(Stream &mySerial) const {
+  snprintf(buf, BUF_LEN, "%lu\t%lu\t%lu\t%lu\t%lu\t%lu\n",
+           (unsigned long)_N_sent, (unsigned long)_N_timeout,
+           (unsigned long)_N_crc, (unsigned long)_N_exception,
+           (unsigned long)_N_dropped, (unsigned long)_rtt_us);
+  mySerial.print(buf);
+}
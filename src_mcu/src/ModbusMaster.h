@@ -0,0 +1,175 @@
+/**
+ * @file    ModbusMaster.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Minimal, non-blocking Modbus RTU master over a hardware UART and
+ * an RS485 transceiver, to talk to the Xylem Hydrovar HVL pump controller, see
+ * `HydrovarPump`.
+ *
+ * Only the subset the pump needs is supported: Reading a single holding
+ * register (function 0x03) and writing a single register (function 0x06),
+ * addressed to a single slave. Requests get queued and sent one at a time by
+ * `update()`, which never waits on the bus:
+ *   1) Once the bus has been silent for `MODBUS_SILENCE_US`, the request gets
+ *      handed to the UART with the driver enable (DE) pin of the transceiver
+ *      raised.
+ *   2) Once the UART is done sending, DE gets lowered to listen for the reply.
+ *   3) The reply is complete once its length, following from the function
+ *      code, has arrived. Its CRC gets checked and the outcome gets handed to
+ *      the callback, see `ModbusReply`. No reply within `MODBUS_TIMEOUT_MS`
+ *      counts as a time-out.
+ * A failed request is not retried: The pump gets polled periodically anyhow.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef MODBUS_MASTER_H_
+#define MODBUS_MASTER_H_
+
+#include <Arduino.h>
+
+// Number of requests that can be queued
+const uint8_t MODBUS_QUEUE_LEN = 8;
+
+// Minimum silent time [µs] between frames. Fixed by the Modbus standard for
+// baud rates above 19200, where 3.5 character times would be shorter.
+const uint16_t MODBUS_SILENCE_US = 1750;
+
+// Time [ms] to wait on a reply
+const uint16_t MODBUS_TIMEOUT_MS = 50;
+
+/**
+ * @brief Values of `ModbusReply::status`.
+ */
+enum ModbusStatus : uint8_t {
+  MODBUS_OK,        // Valid reply
+  MODBUS_TIMEOUT,   // No, or an incomplete, reply in time
+  MODBUS_CRC,       // Reply got corrupted
+  MODBUS_EXCEPTION, // Slave replied with an exception, see `value`
+};
+
+/**
+ * @brief Outcome of a request, handed to the callback.
+ */
+struct ModbusReply {
+  uint8_t func;        // Function code of the request
+  uint16_t reg;        // Register address of the request
+  uint16_t value;      // Value read or written, or the exception code
+  ModbusStatus status; // See `ModbusStatus`
+};
+
+/*------------------------------------------------------------------------------
+  ModbusMaster
+------------------------------------------------------------------------------*/
+
+class ModbusMaster {
+public:
+  static const uint8_t FUNC_READ = 0x03;  // Read holding registers
+  static const uint8_t FUNC_WRITE = 0x06; // Write single register
+
+  /**
+   * @param port UART wired to the RS485 transceiver
+   * @param pin_DE Driver enable pin of the transceiver, active high. Its
+   * receiver enable pin should be wired to it too, being active low.
+   */
+  ModbusMaster(HardwareSerial &port, uint8_t pin_DE)
+      : _port(port), _pin_DE(pin_DE) {}
+
+  /**
+   * @brief Open the UART at @p baudrate, 8N1, to talk to slave address
+   * @p slave, handing the outcome of each request to @p callback along with
+   * @p ctx.
+   */
+  void begin(uint32_t baudrate, uint8_t slave,
+             void (*callback)(const ModbusReply &reply, void *ctx),
+             void *ctx = nullptr);
+
+  /**
+   * @brief Queue reading holding register @p reg.
+   * @return False when the queue is full. True otherwise.
+   */
+  inline bool read(uint16_t reg) { return push(FUNC_READ, reg, 1); }
+
+  /**
+   * @brief Queue writing @p value into register @p reg.
+   * @return False when the queue is full. True otherwise.
+   */
+  inline bool write(uint16_t reg, uint16_t value) {
+    return push(FUNC_WRITE, reg, value);
+  }
+
+  /**
+   * @brief Number of requests queued or underway.
+   */
+  inline uint8_t pending() const { return _N_queued + (_state != IDLE); }
+
+  /**
+   * @brief Advance the request underway, or start the next one. Call from
+   * within the main loop.
+   */
+  void update();
+
+  /**
+   * @brief Print the statistics, tab delimited:
+   *   1) Number of requests sent
+   *   2) Number of time-outs
+   *   3) Number of corrupted replies
+   *   4) Number of exception replies
+   *   5) Number of requests dropped, the queue being full
+   *   6) Round-trip time of the last valid reply [µs]
+   */
+  void print(Stream &mySerial) const;
+
+private:
+  struct Request {
+    uint8_t func;
+    uint16_t reg;
+    uint16_t value; // Value to write, or the number of registers to read
+  };
+
+  enum State : uint8_t { IDLE, SENDING, AWAITING };
+
+  HardwareSerial &_port;
+  uint8_t _pin_DE;
+  uint8_t _slave = 1;
+  uint16_t _char_us = 0; // Time [µs] to send a single character
+  void (*_callback)(const ModbusReply &reply, void *ctx) = nullptr;
+  void *_ctx = nullptr;
+
+  Request _queue[MODBUS_QUEUE_LEN];
+  uint8_t _head = 0; // Slot of the oldest queued request
+  uint8_t _N_queued = 0;
+
+  State _state = IDLE;
+  Request _current;
+  uint8_t _frame[8];    // Request underway, and reply being received
+  uint8_t _N_rx = 0;    // Number of reply bytes received
+  uint32_t _t_send = 0; // Time [µs] the request got handed to the UART
+  uint32_t _t_idle = 0; // Time [µs] the bus went silent
+
+  // Statistics
+  uint32_t _N_sent = 0;
+  uint32_t _N_timeout = 0;
+  uint32_t _N_crc = 0;
+  uint32_t _N_exception = 0;
+  uint32_t _N_dropped = 0;
+  uint32_t _rtt_us = 0;
+
+  bool push(uint8_t func, uint16_t reg, uint16_t value);
+
+  /**
+   * @brief Expected length of the reply, given the bytes received so far, or
+   * 0 when not known yet.
+   */
+  uint8_t reply_len() const;
+
+  /**
+   * @brief Hand the outcome of the request underway to the callback and go
+   * idle.
+   */
+  void finish(ModbusStatus status, uint16_t value);
+};
+
+#endif
@@ -0,0 +1,101 @@
+/**
+ * @file    MorphGenerator.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "MorphGenerator.h"
+#include "translations.h"
+
+/*------------------------------------------------------------------------------
+  MorphGenerator
+------------------------------------------------------------------------------*/
+
+void MorphGenerator::read_pattern(ProtocolManager *protocol_mgr,
+                                  uint16_t line_no,
+                                  std::array<bool, N_VALVES> &pattern) {
+  PackedLine packed_line;
+  Line line;
+  protocol_mgr->get_program().get(line_no, packed_line);
+  packed_line.unpack_into(line);
+
+  pattern.fill(false);
+  for (const P &p : line) {
+    Grid::valve_t valve = P2ADDR[p.pack_into_byte()].valve;
+    if (valve) {
+      pattern[valve - 1] = true;
+    }
+  }
+}
+
+bool MorphGenerator::begin(ProtocolManager *protocol_mgr, uint16_t line_A,
+                           uint16_t line_B, uint32_t T_ms, uint16_t step_ms,
+                           uint16_t seed) {
+  uint16_t N_lines = protocol_mgr->get_program().size();
+  if ((line_A >= N_lines) || (line_B >= N_lines)) {
+    return false;
+  }
+
+  std::array<bool, N_VALVES> B;
+  read_pattern(protocol_mgr, line_A, _A);
+  read_pattern(protocol_mgr, line_B, B);
+
+  _N_diff = 0;
+  for (uint8_t idx = 0; idx < N_VALVES; ++idx) {
+    if (_A[idx] != B[idx]) {
+      _order[_N_diff++] = idx;
+    }
+  }
+
+  // Fisher-Yates shuffle, drawing from an xorshift32 generator
+  uint32_t rng = seed ? seed : 1;
+  for (uint8_t idx = _N_diff; idx > 1; --idx) {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    uint8_t pick = ((rng >> 16) * idx) >> 16;
+    std::swap(_order[idx - 1], _order[pick]);
+  }
+
+  _step_ms = max(step_ms, (uint16_t)1);
+  _N_steps = max(T_ms / _step_ms, (uint32_t)1);
+  rewind();
+  return true;
+}
+
+void MorphGenerator::rewind() {
+  _state = _A;
+  _N_swapped = 0;
+  _step = 0;
+}
+
+bool MorphGenerator::next_valves(uint16_t &duration, ValveSet &valves) {
+  if (_step > _N_steps) {
+    return false;
+  }
+
+  // Swap the valves falling due up to this step
+  uint8_t N_target = (uint64_t)_N_diff * _step / _N_steps;
+  for (; _N_swapped < N_target; ++_N_swapped) {
+    uint8_t idx = _order[_N_swapped];
+    _state[idx] = !_state[idx];
+  }
+
+  valves.clear();
+  for (uint8_t idx = 0; idx < N_VALVES; ++idx) {
+    if (_state[idx]) {
+      valves.set(idx + 1);
+    }
+  }
+  duration = encode_duration_us((uint32_t)_step_ms * 1000);
+  _step++;
+  return true;
+}
+
+void MorphGenerator::print(Stream &mySerial) const {
+  snprintf(buf, BUF_LEN, "%u\t%lu\t%u\t%u\n", _N_diff,
+           (unsigned long)_N_steps, _step_ms, _N_swapped);
+  mySerial.print(buf);
+}
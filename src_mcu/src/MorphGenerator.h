@@ -0,0 +1,91 @@
+/**
+ * @file    MorphGenerator.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Gradual morphing from one valve pattern into another, produced on
+ * the fly, for transition studies.
+ *
+ * The two patterns A and B are taken from two lines of the protocol program
+ * in memory. The valves in which they differ get shuffled once into a random
+ * order. The morph starts with pattern A and then swaps the differing valves
+ * one after the other in that order, spread evenly over the morphing time,
+ * until pattern B is reached. Each produced line lasts one time step, and
+ * swaps the valves falling due within that step. Hence, only the intermediate
+ * patterns get produced that actually get played, instead of uploading
+ * thousands of them.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef MORPH_GENERATOR_H_
+#define MORPH_GENERATOR_H_
+
+#include <Arduino.h>
+#include <array>
+
+#include "ProtocolManager.h"
+
+/*------------------------------------------------------------------------------
+  MorphGenerator
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Class to produce the lines morphing pattern A into pattern B, see
+ * above.
+ */
+class MorphGenerator : public LineSource {
+public:
+  /**
+   * @brief Take patterns A and B from line numbers @p line_A and @p line_B,
+   * starting at index 0, of the protocol program in memory of
+   * @p protocol_mgr, and shuffle the differing valves using @p seed.
+   *
+   * @param T_ms Morphing time [ms] from pattern A to pattern B
+   * @param step_ms Duration [ms] of each produced line, at least 1
+   * @return False when a line exceeds the program, true otherwise.
+   */
+  bool begin(ProtocolManager *protocol_mgr, uint16_t line_A, uint16_t line_B,
+             uint32_t T_ms, uint16_t step_ms, uint16_t seed);
+
+  /**
+   * @brief Start over from pattern A, in the same order of swaps.
+   */
+  void rewind() override;
+
+  /**
+   * @brief Swap the valves falling due within the next time step, and produce
+   * the resulting pattern into @p valves. The first line holds pattern A, the
+   * last line pattern B.
+   *
+   * @return False when the morph has ended. True otherwise.
+   */
+  bool next_valves(uint16_t &duration, ValveSet &valves) override;
+
+  /**
+   * @brief Print the morph, tab delimited: Number of differing valves, number
+   * of time steps, time step [ms] and the number of valves swapped so far.
+   */
+  void print(Stream &mySerial) const;
+
+private:
+  std::array<bool, N_VALVES> _A{};        // Pattern A, index = valve - 1
+  std::array<bool, N_VALVES> _state{};    // Pattern being produced
+  std::array<uint8_t, N_VALVES> _order{}; // Differing valves, in swap order
+
+  uint8_t _N_diff = 0;     // Number of differing valves
+  uint8_t _N_swapped = 0;  // Number of valves swapped so far
+  uint32_t _N_steps = 0;   // Number of time steps from A to B
+  uint32_t _step = 0;      // Next time step to produce
+  uint16_t _step_ms = 100; // Duration of each time step [ms]
+
+  /**
+   * @brief Unpack the valves opened by line number @p line_no of the protocol
+   * program in memory of @p protocol_mgr into @p pattern.
+   */
+  static void read_pattern(ProtocolManager *protocol_mgr, uint16_t line_no,
+                           std::array<bool, N_VALVES> &pattern);
+};
+
+#endif
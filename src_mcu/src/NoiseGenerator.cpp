@@ -0,0 +1,135 @@
+/**
+ * @file    NoiseGenerator.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "NoiseGenerator.h"
+#include "constants.h"
+#include "translations.h"
+
+#include "FastLED.h"
+
+/*------------------------------------------------------------------------------
+  NoiseGenerator
+------------------------------------------------------------------------------*/
+
+void NoiseGenerator::begin(const NoiseParams &params) {
+  _params = params;
+  if (_params.A.spatial_feature_size == 0) {
+    _params.A.spatial_feature_size = 1;
+  }
+  if (_params.A.temporal_feature_size == 0) {
+    _params.A.temporal_feature_size = 1;
+  }
+  if (_params.B.temporal_feature_size == 0) {
+    _params.B.temporal_feature_size = 1;
+  }
+  if (_params.open_percent > 100) {
+    _params.open_percent = 100;
+  }
+
+  _A = steps_of(_params.A);
+  _use_B = (_params.B.spatial_feature_size > 0);
+  if (_use_B) {
+    _B = steps_of(_params.B);
+  }
+  rewind();
+}
+
+void NoiseGenerator::rewind() {
+  _threshold = 0x8000;
+  _N_generated = 0;
+  _N_unconverged = 0;
+}
+
+NoiseGenerator::Steps NoiseGenerator::steps_of(const NoiseLayer &layer) {
+  Steps steps;
+
+  // A feature size corresponds to one unit of noise coordinate
+  steps.x_step = ((uint32_t)NOISE_PCS_PIXEL_DIST << 16) /
+                 layer.spatial_feature_size;
+  steps.t_step = ((uint32_t)1 << 16) / layer.temporal_feature_size;
+
+  // Different seeds sample different regions of the noise field. The noise
+  // repeats every 256 units, which the coordinates wrap around at as well.
+  steps.x_seed = layer.seed * 0x9E3779B9UL;
+  steps.y_seed = layer.seed * 0x7F4A7C15UL;
+
+  return steps;
+}
+
+uint8_t NoiseGenerator::count_above(uint16_t threshold) const {
+  uint8_t N = 0;
+  for (uint16_t value : _values) {
+    N += (value > threshold);
+  }
+  return N;
+}
+
+bool NoiseGenerator::next_valves(uint16_t &duration, ValveSet &valves) {
+  uint32_t t_A = _N_generated * _A.t_step;
+  uint32_t t_B = _N_generated * _B.t_step;
+
+  for (uint8_t valve = 1; valve <= N_VALVES; ++valve) {
+    uint32_t dx = VALVE2P[valve][0] - PCS_X_MIN;
+    uint32_t dy = PCS_Y_MAX - VALVE2P[valve][1];
+    uint16_t value = inoise16(_A.x_seed + dx * _A.x_step,
+                              _A.y_seed + dy * _A.x_step, t_A);
+    if (_use_B) {
+      // Average of both sets, like `add_stack_B_to_A()` followed by halving
+      value = ((uint32_t)value + inoise16(_B.x_seed + dx * _B.x_step,
+                                          _B.y_seed + dy * _B.x_step, t_B)) >>
+              1;
+    }
+    _values[valve - 1] = value;
+  }
+
+  // Solve for the threshold meeting the target number of open valves
+  uint8_t N_target = ((uint16_t)_params.open_percent * N_VALVES + 50) / 100;
+  uint8_t N_open = 0;
+  if (N_target == 0) {
+    _threshold = 0xFFFF;
+  } else if (N_target == N_VALVES) {
+    _threshold = 0;
+    N_open = count_above(0);
+  } else {
+    // Bisection within [lo, hi], with the number of open valves decreasing
+    // for an increasing threshold. The first guess is the previous threshold.
+    uint32_t lo = 0;
+    uint32_t hi = 0xFFFF;
+    uint8_t iter = 0;
+    while (true) {
+      N_open = count_above(_threshold);
+      if (abs(N_open - N_target) <= NOISE_THRESHOLD_TOL) {
+        break;
+      }
+      if (++iter == NOISE_THRESHOLD_MAX_ITER || hi - lo <= 1) {
+        _N_unconverged++;
+        break;
+      }
+
+      if (N_open > N_target) {
+        lo = _threshold;
+      } else {
+        hi = _threshold;
+      }
+      _threshold = (lo + hi) / 2;
+    }
+  }
+
+  duration = encode_duration_us((uint32_t)_params.duration * 1000);
+  valves.clear();
+  if (N_open > 0) {
+    for (uint8_t valve = 1; valve <= N_VALVES; ++valve) {
+      if (_values[valve - 1] > _threshold) {
+        valves.set(valve);
+      }
+    }
+  }
+
+  _N_generated++;
+  return true;
+}
@@ -0,0 +1,155 @@
+/**
+ * @file    NoiseGenerator.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Procedural generation of an endless jetting protocol on the fly,
+ * from a 3D noise field (x, y, t), as an alternative to uploading a protocol
+ * made by `protocols/make_proto_opensimplex.py`.
+ *
+ * Like `config_proto_opensimplex.py`, two sets of noise A and B get mixed
+ * together by averaging them. Set B gets ignored when its spatial feature size
+ * is 0. Each line evaluates FastLED's Perlin noise `inoise16()` at the PCS
+ * point of every valve for the current time step. The valves with a noise
+ * value above a threshold get opened. The threshold gets solved for per line,
+ * such that the target open fraction, a.k.a. the transparency, is met, see
+ * `next_valves()`.
+ *
+ * The feature sizes are in the same units as in `config_proto_opensimplex.py`.
+ * The noise does differ from OpenSimplex noise though, so the same parameters
+ * result in a statistically similar protocol, not in the same one.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef NOISE_GENERATOR_H_
+#define NOISE_GENERATOR_H_
+
+#include <Arduino.h>
+#include <array>
+
+#include "ProtocolManager.h"
+
+/**
+ * @brief Pixel distance between the integer PCS coordinates, in which the
+ * spatial feature size is expressed. Equals `PCS_PIXEL_DIST` of
+ * `config_proto_opensimplex.py`.
+ */
+const uint16_t NOISE_PCS_PIXEL_DIST = 32;
+
+/**
+ * @brief Maximum number of threshold evaluations per line, bounding the time
+ * spent in `NoiseGenerator::next_valves()`. A bisection of the 16-bit noise
+ * range needs at most 17.
+ */
+const uint8_t NOISE_THRESHOLD_MAX_ITER = 17;
+
+/**
+ * @brief Number of valves the threshold search is allowed to be off from the
+ * target number of open valves, i.e. 1.8 % transparency. Comparable to the
+ * tolerance of `binarize_stack_using_newton()`.
+ */
+const uint8_t NOISE_THRESHOLD_TOL = 2;
+
+/**
+ * @brief Parameters of a single set of noise.
+ */
+struct NoiseLayer {
+  uint16_t seed;                  // Noise seed
+  uint16_t spatial_feature_size;  // [px], see `NOISE_PCS_PIXEL_DIST`
+  uint16_t temporal_feature_size; // [number of lines]
+};
+
+/**
+ * @brief Parameters of the generated protocol. Defaults as in
+ * `config_proto_opensimplex.py`.
+ */
+struct NoiseParams {
+  NoiseLayer A = {1, 50, 10};  // Set A
+  NoiseLayer B = {13, 100, 10}; // Set B, ignored when its spatial size is 0
+  uint8_t open_percent = 40;    // Target transparency [%]
+  uint16_t duration = 50;       // Duration of each line [ms]
+};
+
+/*------------------------------------------------------------------------------
+  NoiseGenerator
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Class to generate the lines of an endless jetting protocol from noise,
+ * one by one.
+ */
+class NoiseGenerator : public LineSource {
+public:
+  /**
+   * @brief Start generating from line 0 onwards, using @p params. Feature sizes
+   * of 0 get raised to 1, except for the spatial feature size of set B.
+   */
+  void begin(const NoiseParams &params);
+
+  /**
+   * @brief Start generating from line 0 onwards, using the same parameters.
+   */
+  void rewind() override;
+
+  /**
+   * @brief Generate the next line into @p line.
+   *
+   * Takes 112 evaluations of the 3D noise per set, followed by a search for the
+   * threshold. The search starts from the threshold of the previous line, which
+   * typically already meets the target because the noise evolves smoothly.
+   * Otherwise it bisects the noise range, giving up after
+   * `NOISE_THRESHOLD_MAX_ITER` evaluations. The last evaluated threshold then
+   * gets applied nonetheless, see `get_N_unconverged()`.
+   *
+   * @return Always true, as the generated protocol is endless.
+   */
+  bool next_valves(uint16_t &duration, ValveSet &valves) override;
+
+  inline const NoiseParams &get_params() const { return _params; }
+
+  /**
+   * @brief Return the number of lines generated since `begin()`.
+   */
+  inline uint32_t get_N_generated() const { return _N_generated; }
+
+  /**
+   * @brief Return the number of lines since `begin()` for which the threshold
+   * search failed to meet the target within `NOISE_THRESHOLD_TOL`.
+   */
+  inline uint32_t get_N_unconverged() const { return _N_unconverged; }
+
+private:
+  /**
+   * @brief Noise coordinate steps of a set of noise, 16.16 fixed point.
+   */
+  struct Steps {
+    uint32_t x_step; // Per PCS unit
+    uint32_t t_step; // Per line
+    uint32_t x_seed; // Offsets by the seed
+    uint32_t y_seed;
+  };
+
+  NoiseParams _params;
+  Steps _A;
+  Steps _B;
+  bool _use_B = false;
+
+  std::array<uint16_t, N_VALVES> _values; // Mixed noise, index = valve - 1
+  uint16_t _threshold = 0x8000;           // Values above get opened
+  uint32_t _N_generated = 0;
+  uint32_t _N_unconverged = 0;
+
+  /**
+   * @brief Return the coordinate steps of @p layer.
+   */
+  static Steps steps_of(const NoiseLayer &layer);
+
+  /**
+   * @brief Return the number of valves with a value above @p threshold.
+   */
+  uint8_t count_above(uint16_t threshold) const;
+};
+
+#endif
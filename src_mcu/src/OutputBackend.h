@@ -0,0 +1,167 @@
+/**
+ * @file    OutputBackend.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Interface of the hardware driving the valve outputs, on which
+ * `CentipedeManager` sends out its port bitmasks, see
+ * `CentipedeManager::set_backend()`.
+ *
+ * Whatever the hardware, the outputs are addressed as up to 8 ports of 16
+ * channels each, i.e. the Centipede ports, so that the wiring tables in
+ * `constants.h` and the playback engine stay the same. Implementations:
+ *
+ * - `MCP23017Backend`: The Centipede boards, one MCP23017 I/O expander per
+ *   port via I2C at ~1 MHz, optionally in the background via DMA. A full
+ *   update takes ~460 µs. Default.
+ * - `MCP23S17Backend`: Their SPI sibling, one MCP23S17 per port, all sharing a
+ *   single chip select by hardware addressing. A full update takes ~35 µs at
+ *   10 MHz.
+ * - `ShiftRegisterBackend`: A daisy chain of 74HC595 shift registers fed by
+ *   SPI and DMA, latching all outputs at once. A full update takes ~12 µs at
+ *   12 MHz, without any skew between the ports.
+ *
+ * The backend gets selected at build time by `OUTPUT_BACKEND`, as it follows
+ * the hardware revision.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef OUTPUT_BACKEND_H_
+#define OUTPUT_BACKEND_H_
+
+#include "constants.h"
+#include <Arduino.h>
+#include <array>
+
+#define OUTPUT_MCP23017 0       // See `MCP23017Backend`
+#define OUTPUT_MCP23S17 1       // See `MCP23S17Backend`
+#define OUTPUT_SHIFT_REGISTER 2 // See `ShiftRegisterBackend`
+
+/**
+ * @brief Hardware driving the valve outputs, see above.
+ */
+#ifndef OUTPUT_BACKEND
+#  define OUTPUT_BACKEND OUTPUT_MCP23017
+#endif
+
+/**
+ * @brief Total number of Centipede ports in use, see `GridGeometry`.
+ *
+ * A single Centipede board has 4 ports for controlling a total of 64 channels.
+ * A second Centipede board on another I2C address will add 4 more additional
+ * ports, allowing a total of 128 channels to be controlled.
+ */
+const uint8_t N_CP_PORTS = Grid::N_CP_PORTS;
+
+/**
+ * @brief Port bitmask selecting all Centipede ports in use.
+ */
+const uint8_t CP_ALL_PORTS = (1U << N_CP_PORTS) - 1;
+
+/**
+ * @brief Container for the Centipede port bitmasks.
+ */
+using CP_Masks = std::array<uint16_t, N_CP_PORTS>;
+
+/**
+ * @brief Called from within an interrupt once the port writes queued by
+ * `OutputBackend::write_ports_async()` have all completed.
+ *
+ * @param done_us Time [µs] of completion
+ * @param N_failed Number of failed port writes
+ * @param skew_us Time [µs] between the first and the last port change
+ * @param ctx The context passed to `OutputBackend::set_callback()`
+ */
+typedef void (*OutputDoneCallback)(uint32_t done_us, uint8_t N_failed,
+                                   uint32_t skew_us, void *ctx);
+
+/*------------------------------------------------------------------------------
+  OutputBackend
+------------------------------------------------------------------------------*/
+
+class OutputBackend {
+public:
+  /**
+   * @brief Short name of the hardware, e.g. for reporting.
+   */
+  virtual const char *get_name() const = 0;
+
+  /**
+   * @brief Configure all channels as outputs and turn them LOW.
+   *
+   * @return The number of ports that failed to be configured.
+   */
+  virtual uint8_t begin() = 0;
+
+  /**
+   * @brief Write the outputs of the ports selected by the bits of
+   * @p portmask, taking `values[port]`, with blocking calls. Safe to be
+   * called from within an interrupt, but not while `is_busy()`.
+   *
+   * @param skew_us Optional: Time [µs] between the first and the last port
+   * change
+   * @return The number of failed port writes.
+   */
+  virtual uint8_t write_ports(const uint16_t *values, uint8_t portmask,
+                              uint32_t *skew_us = nullptr) = 0;
+
+  /**
+   * @brief Can the ports be written in the background, see
+   * `write_ports_async()`?
+   */
+  virtual bool can_write_async() const { return false; }
+
+  /**
+   * @brief Queue writing the outputs like `write_ports()` and return
+   * immediately. The callback fires once done, see `set_callback()`. Safe to
+   * be called from within an interrupt. Only when `can_write_async()`.
+   */
+  virtual void write_ports_async(const uint16_t *, uint8_t) {}
+
+  /**
+   * @brief Are port writes queued by `write_ports_async()` ongoing?
+   */
+  virtual bool is_busy() const { return false; }
+
+  /**
+   * @brief Abort the queued port writes right away, without invoking the
+   * callback, e.g. when halting. Safe to be called from within an interrupt.
+   */
+  virtual void abort() {}
+
+  /**
+   * @brief Housekeeping, e.g. aborting hung writes. Must be called
+   * repeatedly from within the main loop.
+   */
+  virtual void update() {}
+
+  /**
+   * @brief Can the output latches be read back, see `read_port()`?
+   */
+  virtual bool can_read_back() const { return false; }
+
+  /**
+   * @brief Read back the output latches of @p port into @p latched, with a
+   * blocking call. Not while `is_busy()`.
+   *
+   * @return True when successful. False otherwise.
+   */
+  virtual bool read_port(uint8_t, uint16_t &) { return false; }
+
+  /**
+   * @brief Set the function to call once the port writes queued by
+   * `write_ports_async()` have all completed, see `OutputDoneCallback`.
+   */
+  inline void set_callback(OutputDoneCallback callback, void *ctx) {
+    _callback = callback;
+    _ctx = ctx;
+  }
+
+protected:
+  OutputDoneCallback _callback = nullptr;
+  void *_ctx = nullptr;
+};
+
+#endif
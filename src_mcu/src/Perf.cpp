@@ -0,0 +1,151 @@
+/**
+ * @file    Perf.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    14-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "Perf.h"
+
+// See `main.cpp`
+extern const uint8_t BUF_LEN; // Common character buffer for string formatting
+extern char buf[];            // Common character buffer for string formatting
+
+/*------------------------------------------------------------------------------
+  PerfProbe
+------------------------------------------------------------------------------*/
+
+void PerfProbe::record(uint32_t dt_us) {
+  N++;
+  sum_us += dt_us;
+  if (dt_us < min_us) {
+    min_us = dt_us;
+  }
+  if (dt_us > max_us) {
+    max_us = dt_us;
+  }
+
+  // Bin k holds [2^k, 2^(k+1)) µs
+  uint8_t bin = (dt_us == 0) ? 0 : 31 - __builtin_clz(dt_us);
+  bins[min(bin, (uint8_t)(PERF_N_BINS - 1))]++;
+}
+
+/*------------------------------------------------------------------------------
+  Probes
+------------------------------------------------------------------------------*/
+
+#if PERF_ENABLED
+
+PerfProbe perf_probes[PERF_N_PROBES];
+
+static const char *const PERF_NAMES[PERF_N_PROBES] = {
+    "loop",    "flush_leds", "send_masks",    "send_masks_isr",
+    "R_click", "commands",   "activate_buffer"};
+
+void perf_print(Stream &port) {
+  for (uint8_t id = 0; id < PERF_N_PROBES; ++id) {
+    const PerfProbe &probe = perf_probes[id];
+    snprintf(buf, BUF_LEN, "%s\t%lu\t%lu\t%lu\t%lu", PERF_NAMES[id],
+             (unsigned long)probe.N,
+             (unsigned long)(probe.N ? probe.min_us : 0),
+             (unsigned long)(probe.N ? probe.sum_us / probe.N : 0),
+             (unsigned long)probe.max_us);
+    port.print(buf);
+    for (uint8_t bin = 0; bin < PERF_N_BINS; ++bin) {
+      port.write('\t');
+      port.print(probe.bins[bin]);
+    }
+    port.write('\n');
+  }
+}
+
+void perf_reset() {
+  // Interrupts also record into the probes
+  noInterrupts();
+  for (uint8_t id = 0; id < PERF_N_PROBES; ++id) {
+    perf_probes[id] = PerfProbe{};
+  }
+  interrupts();
+}
+
+#else
+
+void perf_print(Stream &port) {
+  port.println("ERROR: Timing instrumentation has been compiled out.");
+}
+
+void perf_reset() {}
+
+#endif
+
+/*------------------------------------------------------------------------------
+  Cycle counter
+------------------------------------------------------------------------------*/
+
+void perf_cycles_begin() {
+#if defined(__arm__)
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+}
+
+/*------------------------------------------------------------------------------
+  Benchmark results
+------------------------------------------------------------------------------*/
+
+PerfBenchTable perf_bench_run;
+PerfBenchTable perf_bench_baseline;
+
+// Regression counts of the ongoing run, see `perf_bench_end()`
+static uint8_t perf_bench_N_compared = 0;
+static uint8_t perf_bench_N_regressed = 0;
+
+int8_t PerfBenchTable::find(const char *name) const {
+  for (uint8_t idx = 0; idx < N; ++idx) {
+    if (strncmp(names[idx], name, PERF_BENCH_NAME_LEN) == 0) {
+      return idx;
+    }
+  }
+  return -1;
+}
+
+void perf_bench_begin() {
+  perf_bench_run.N = 0;
+  perf_bench_N_compared = 0;
+  perf_bench_N_regressed = 0;
+}
+
+void perf_bench_print(Stream &port, const char *name, uint32_t cycles,
+                      uint32_t bytes) {
+  if (perf_bench_run.N < PERF_BENCH_MAX_RESULTS) {
+    uint8_t idx = perf_bench_run.N++;
+    strncpy(perf_bench_run.names[idx], name, PERF_BENCH_NAME_LEN - 1);
+    perf_bench_run.names[idx][PERF_BENCH_NAME_LEN - 1] = '\0';
+    perf_bench_run.cycles[idx] = cycles;
+  }
+
+  uint32_t base = 0;
+  bool regressed = false;
+  int8_t idx = perf_bench_baseline.find(name);
+  if (idx >= 0) {
+    base = perf_bench_baseline.cycles[idx];
+    regressed = ((uint64_t)cycles * 100 >
+                 (uint64_t)base * (100 + perf_bench_baseline.tolerance_pct));
+    perf_bench_N_compared++;
+    perf_bench_N_regressed += regressed;
+  }
+
+  snprintf(buf, BUF_LEN, "%s\t%u\t%lu\t%.2f\t%lu\t%lu\t%u\n", name,
+           PERF_BENCH_N_REPS, (unsigned long)cycles,
+           (float)cycles / perf_cycles_per_us(), (unsigned long)bytes,
+           (unsigned long)base, regressed);
+  port.print(buf);
+}
+
+uint8_t perf_bench_end(Stream &port) {
+  snprintf(buf, BUF_LEN, "regressions\t%u\t%u\t%u\n", perf_bench_N_regressed,
+           perf_bench_N_compared, perf_bench_baseline.tolerance_pct);
+  port.print(buf);
+  return perf_bench_N_regressed;
+}
@@ -0,0 +1,239 @@
+/**
+ * @file    Perf.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    14-10-2026
+ *
+ * @brief   Built-in timing instrumentation of the hot paths of the firmware.
+ *
+ * Each instrumented code section is a probe, keeping track of the number of
+ * calls and the minimum, mean and maximum duration, together with a histogram
+ * of power-of-2 bins: Bin k counts the durations of [2^k, 2^(k+1)) µs, bin 0
+ * also counts 0 µs and the last bin counts everything longer.
+ *
+ * Measure a section by placing `PERF_SCOPE(<PerfProbeID>);` at its start. The
+ * duration is taken until the end of the enclosing scope. See the `perf?` and
+ * `perf_reset` commands in `main.cpp`. Set `PERF_ENABLED` to 0 to compile all
+ * instrumentation out.
+ *
+ * Independent of that, fixed workloads can be timed to the CPU clock cycle by
+ * the DWT cycle counter of the Cortex-M4, see `perf_bench_cycles()` and the
+ * `bench` command in `main.cpp`. The results of a run can be compared against
+ * a baseline to flag regressions, see `perf_bench_print()`.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef PERF_H_
+#define PERF_H_
+
+#include <Arduino.h>
+
+/**
+ * @brief Compile the timing instrumentation in? Costs two `micros()` calls
+ * per instrumented section.
+ */
+#ifndef PERF_ENABLED
+#  define PERF_ENABLED 1
+#endif
+
+/**
+ * @brief The instrumented code sections.
+ */
+enum PerfProbeID : uint8_t {
+  PERF_LOOP,            // A full iteration of `loop()`
+  PERF_FLUSH_LEDS,      // `flush_leds()`, i.e. the dirty LED controllers
+  PERF_SEND_MASKS,      // `CentipedeManager::send_masks()` from the loop
+  PERF_SEND_MASKS_ISR,  // `CentipedeManager::send_masks()` from an interrupt
+  PERF_R_CLICK,         // `R_click_poll_EMA_collectively()`, when sampling
+  PERF_COMMANDS,        // Dispatch of a single serial command in `loop()`
+  PERF_ACTIVATE_BUFFER, // `ProtocolManager::activate_buffer()`
+  PERF_N_PROBES
+};
+
+// Number of histogram bins per probe
+const uint8_t PERF_N_BINS = 16;
+
+/**
+ * @brief Timing statistics of a single instrumented code section.
+ */
+struct PerfProbe {
+  uint32_t N = 0;                // Number of calls
+  uint32_t min_us = UINT32_MAX;  // Shortest duration [µs]
+  uint32_t max_us = 0;           // Longest duration [µs]
+  uint64_t sum_us = 0;           // Sum of all durations [µs]
+  uint32_t bins[PERF_N_BINS]{0}; // Histogram, see `Perf.h`
+
+  void record(uint32_t dt_us);
+};
+
+#if PERF_ENABLED
+extern PerfProbe perf_probes[PERF_N_PROBES];
+
+/**
+ * @brief Measures the time spent until it goes out of scope into a probe.
+ */
+class PerfScope {
+public:
+  inline PerfScope(PerfProbeID id) : _id(id), _t0(micros()) {}
+  inline ~PerfScope() { perf_probes[_id].record(micros() - _t0); }
+
+private:
+  PerfProbeID _id;
+  uint32_t _t0;
+};
+
+#  define PERF_CONCAT_(a, b) a##b
+#  define PERF_CONCAT(a, b) PERF_CONCAT_(a, b)
+#  define PERF_SCOPE(id) PerfScope PERF_CONCAT(perf_scope_, __LINE__)(id)
+#else
+#  define PERF_SCOPE(id)
+#endif
+
+/**
+ * @brief Is the code running from within an interrupt handler?
+ */
+inline bool perf_in_isr() {
+#if defined(__arm__)
+  return __get_IPSR() != 0;
+#else
+  return false;
+#endif
+}
+
+/**
+ * @brief Print the statistics of all probes, one probe per line, tab
+ * delimited: Name, number of calls, min, mean and max duration [µs], followed
+ * by the `PERF_N_BINS` histogram bins.
+ */
+void perf_print(Stream &port);
+
+/**
+ * @brief Reset the statistics of all probes.
+ */
+void perf_reset();
+
+/*------------------------------------------------------------------------------
+  Cycle counter
+------------------------------------------------------------------------------*/
+
+// Number of repetitions of each workload in `perf_bench_cycles()`
+const uint8_t PERF_BENCH_N_REPS = 10;
+
+/**
+ * @brief Enable the DWT cycle counter of the Cortex-M4. It counts the CPU clock
+ * cycles and wraps around after 2^32 cycles, i.e. 35.8 s at 120 MHz.
+ */
+void perf_cycles_begin();
+
+/**
+ * @brief Return the current count of the DWT cycle counter. Falls back to
+ * `micros()` on other architectures.
+ */
+inline uint32_t perf_cycles() {
+#if defined(__arm__)
+  return DWT->CYCCNT;
+#else
+  return micros();
+#endif
+}
+
+/**
+ * @brief Return the number of `perf_cycles()` per µs.
+ */
+inline uint32_t perf_cycles_per_us() {
+#if defined(__arm__)
+  return SystemCoreClock / 1000000;
+#else
+  return 1;
+#endif
+}
+
+/**
+ * @brief Run @p fun `PERF_BENCH_N_REPS` times, each time preceded by @p setup,
+ * and return the fewest CPU clock cycles a single run of @p fun took. Taking
+ * the minimum keeps interrupts firing in between out of the result.
+ */
+template <class Setup, class Fun>
+uint32_t perf_bench_cycles(Setup setup, Fun fun) {
+  uint32_t best = UINT32_MAX;
+  for (uint8_t rep = 0; rep < PERF_BENCH_N_REPS; ++rep) {
+    setup();
+    uint32_t t0 = perf_cycles();
+    fun();
+    best = min(best, perf_cycles() - t0);
+  }
+  return best;
+}
+
+template <class Fun> uint32_t perf_bench_cycles(Fun fun) {
+  return perf_bench_cycles([] {}, fun);
+}
+
+/*------------------------------------------------------------------------------
+  Benchmark results
+------------------------------------------------------------------------------*/
+
+// Maximum number of workloads of a benchmark run
+const uint8_t PERF_BENCH_MAX_RESULTS = 32;
+
+// Maximum length of the name of a workload, including the terminating '\0'
+const uint8_t PERF_BENCH_NAME_LEN = 20;
+
+// Default tolerance [%] on the cycles of a workload above its baseline
+const uint8_t PERF_BENCH_TOLERANCE_PCT = 10;
+
+/**
+ * @brief The fewest CPU clock cycles of each workload of a benchmark run,
+ * either the latest run or the baseline to compare against. Kept flat, such
+ * that the baseline can be stored to flash as is, see `BenchBaseline.h`.
+ */
+struct PerfBenchTable {
+  uint8_t N = 0; // Number of workloads
+  uint8_t tolerance_pct = PERF_BENCH_TOLERANCE_PCT; // Allowed excess [%]
+  uint16_t reserved = 0;
+  char names[PERF_BENCH_MAX_RESULTS][PERF_BENCH_NAME_LEN]{};
+  uint32_t cycles[PERF_BENCH_MAX_RESULTS]{};
+
+  /**
+   * @brief Return the index of the workload named @p name, or -1 when absent.
+   */
+  int8_t find(const char *name) const;
+};
+
+// Results of the latest benchmark run, see `perf_bench_begin()`
+extern PerfBenchTable perf_bench_run;
+
+// Baseline to compare the benchmark runs against. No workloads: No baseline.
+extern PerfBenchTable perf_bench_baseline;
+
+/**
+ * @brief Start a new benchmark run: Clear `perf_bench_run`.
+ */
+void perf_bench_begin();
+
+/**
+ * @brief Print the result of a single benchmark as a line and add it to
+ * `perf_bench_run`. Tab delimited:
+ *   1) Name of the workload
+ *   2) Number of repetitions, see `PERF_BENCH_N_REPS`
+ *   3) Fewest number of CPU clock cycles of a repetition
+ *   4) Duration [µs] of that repetition
+ *   5) Bytes moved per repetition, e.g. over I2C or to the LEDs, or 0
+ *   6) Cycles of the baseline, or 0 when not in the baseline
+ *   7) Regressed (1), i.e. more cycles than the baseline plus its tolerance,
+ *      or not (0)
+ */
+void perf_bench_print(Stream &port, const char *name, uint32_t cycles,
+                      uint32_t bytes = 0);
+
+/**
+ * @brief Close the benchmark run by printing a line, tab delimited: The word
+ * "regressions", the number of regressed workloads, the number of workloads
+ * compared against the baseline and the tolerance [%] of the baseline.
+ *
+ * @return The number of regressed workloads.
+ */
+uint8_t perf_bench_end(Stream &port);
+
+#endif
@@ -0,0 +1,189 @@
+/**
+ * @file    PeripheralSim.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "PeripheralSim.h"
+
+/*------------------------------------------------------------------------------
+  PeripheralSim
+------------------------------------------------------------------------------*/
+
+void PeripheralSim::start(uint32_t seed) {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  _seed = seed;
+  _rng = seed ? seed : 1; // Xorshift gets stuck at 0
+  _stats = Stats();
+  _head = 0;
+  _N_events = 0;
+  _N_lost = 0;
+  _enabled = true;
+  __set_PRIMASK(primask);
+}
+
+uint32_t PeripheralSim::spend(uint32_t cost_us) {
+  // The interrupt simulates port writes as well
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  if (_latency.jitter_us) {
+    // Xorshift32
+    _rng ^= _rng << 13;
+    _rng ^= _rng >> 17;
+    _rng ^= _rng << 5;
+    cost_us += _rng % (_latency.jitter_us + 1);
+  }
+  _stats.busy_us += cost_us;
+  __set_PRIMASK(primask);
+
+  delayMicroseconds(cost_us);
+  return cost_us;
+}
+
+uint32_t PeripheralSim::write_ports(const uint16_t *masks, uint8_t portmask,
+                                    uint32_t &skew_us) {
+  // Might get called from within the playback timer interrupt
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  uint8_t N_ports = __builtin_popcount(portmask);
+  spend(_latency.i2c_base_us + N_ports * _latency.i2c_port_us);
+  uint32_t done_us = micros();
+  skew_us = N_ports ? (N_ports - 1) * _latency.i2c_port_us : 0;
+
+  for (uint8_t port = 0; port < N_CP_PORTS; ++port) {
+    if (portmask & (1U << port)) {
+      _outputs[port] = masks[port];
+    }
+  }
+  _stats.N_i2c++;
+  _stats.N_ports += N_ports;
+
+  if (portmask) {
+    _timeline[_head] = Event{done_us, _outputs};
+    _head = (_head + 1) % SIM_TIMELINE_LEN;
+    if (_N_events < SIM_TIMELINE_LEN) {
+      _N_events++;
+    } else {
+      _N_lost++;
+    }
+  }
+
+  __set_PRIMASK(primask);
+  return done_us;
+}
+
+uint16_t PeripheralSim::read_adc(uint8_t ch, uint32_t t_us) {
+  spend(_latency.adc_us);
+  _stats.N_adc++;
+  return 3180.f + 200.f * sin(2.f * PI * .1f * t_us / 1.e6f) + 100.f * ch;
+}
+
+void PeripheralSim::show_leds() {
+  spend(_latency.led_us);
+  _stats.N_leds++;
+}
+
+void PeripheralSim::print_stats(Stream &mySerial) {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  Stats s = _stats;
+  __set_PRIMASK(primask);
+
+  snprintf(buf, BUF_LEN, "%u\t%lu\t%u\t%u\t%u\t%u\t%u\t", _enabled,
+           (unsigned long)_seed, _latency.i2c_base_us, _latency.i2c_port_us,
+           _latency.adc_us, _latency.led_us, _latency.jitter_us);
+  mySerial.print(buf);
+  snprintf(buf, BUF_LEN, "%lu\t%lu\t%lu\t%lu\t%llu\n", (unsigned long)s.N_i2c,
+           (unsigned long)s.N_ports, (unsigned long)s.N_adc,
+           (unsigned long)s.N_leds, (unsigned long long)s.busy_us);
+  mySerial.print(buf);
+}
+
+void PeripheralSim::print_timeline(Stream &mySerial) {
+  mySerial.println(_N_lost);
+  mySerial.println(_N_events);
+
+  uint16_t idx = (_head + SIM_TIMELINE_LEN - _N_events) % SIM_TIMELINE_LEN;
+  for (uint16_t N = _N_events; N > 0; --N) {
+    // Copy, as the interrupt might overwrite it meanwhile
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    Event event = _timeline[idx];
+    __set_PRIMASK(primask);
+
+    mySerial.print(event.t_us);
+    for (uint16_t mask : event.masks) {
+      snprintf(buf, BUF_LEN, "\t%04x", mask);
+      mySerial.print(buf);
+    }
+    mySerial.print('\n');
+    idx = (idx + 1) % SIM_TIMELINE_LEN;
+  }
+}
+
+void PeripheralSim::register_commands(CommandRegistry &registry) {
+  // Start simulating the peripherals, seeding the jitter with the optional
+  // argument (default: 1). Clears the statistics and the valve timeline.
+  // Refused when the start guard objects, see `set_start_guard()`.
+  registry.add_with_args("sim_on", this, [](const char *args, void *sim) {
+    PeripheralSim *self = (PeripheralSim *)sim;
+    const char *reason =
+        self->_guard ? self->_guard(self->_guard_ctx) : nullptr;
+    if (reason) {
+      Serial.print("ERROR: ");
+      Serial.println(reason);
+      return;
+    }
+
+    long seed = 1;
+    char *end;
+    long parsed = strtol(args, &end, 10);
+    if (end != args) {
+      seed = parsed;
+    }
+    self->start(seed);
+  });
+
+  // Stop simulating the peripherals, handing back to the real drivers
+  registry.add("sim_off", this, [](const char *, void *sim) {
+    ((PeripheralSim *)sim)->stop();
+  });
+
+  // Set the latency model, `sim_lat <i2c_base> <i2c_port> <adc> <led>
+  // <jitter>` in [µs]. Trailing parameters can be left out, keeping their
+  // previous values. Echoes the state back, see `sim?`.
+  registry.add_with_args("sim_lat", this, [](const char *args, void *sim) {
+    PeripheralSim *self = (PeripheralSim *)sim;
+    Latency latency = self->get_latency();
+    uint16_t *fields[] = {&latency.i2c_base_us, &latency.i2c_port_us,
+                          &latency.adc_us, &latency.led_us,
+                          &latency.jitter_us};
+    char *end;
+    for (uint16_t *field : fields) {
+      long parsed = strtol(args, &end, 10);
+      if (end == args) {
+        break;
+      }
+      *field = constrain(parsed, 0, 60000);
+      args = end;
+    }
+    self->set_latency(latency);
+    self->print_stats(Serial);
+  });
+
+  // Report the state, the latency model and the statistics, see
+  // `PeripheralSim::print_stats()`
+  registry.add("sim?", this, [](const char *, void *sim) {
+    ((PeripheralSim *)sim)->print_stats(Serial);
+  });
+
+  // Report the recorded valve timeline, see
+  // `PeripheralSim::print_timeline()`
+  registry.add("sim_timeline?", this, [](const char *, void *sim) {
+    ((PeripheralSim *)sim)->print_timeline(Serial);
+  });
+}
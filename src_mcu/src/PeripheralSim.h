@@ -0,0 +1,184 @@
+/**
+ * @file    PeripheralSim.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Runtime simulation of the peripherals with a latency model, to
+ * benchmark the scheduling on a bare Feather M4 or on the host PC.
+ *
+ * Where `NO_PERIPHERALS` merely skips the I2C writes at compile time, the
+ * simulation takes the place of the real drivers at runtime and costs what the
+ * real hardware would have cost:
+ *
+ * - Centipede port writes, see `CentipedeManager::set_sim()`: A fixed cost per
+ *   transaction plus a cost per port written.
+ * - R Click ADC reads over SPI: A cost per channel, returning a sine wave.
+ * - LED matrix refresh, i.e. `FastLED.show()`: A cost per frame.
+ *
+ * Each cost gets spent busy-waiting, with the interrupts left as they are, so
+ * the timing of the main loop and of the playback timer interrupt is as on the
+ * real hardware. On top of each cost comes a random jitter from a seeded
+ * generator, so a run can be repeated exactly.
+ *
+ * The port writes get recorded as the emitted valve timeline: The time at
+ * which each write would have completed, together with the resulting port
+ * bitmasks. The default costs are those measured on the jetting grid at an
+ * I2C clock of 1 MHz, with the LED matrix bit-banged by FastLED.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef PERIPHERAL_SIM_H_
+#define PERIPHERAL_SIM_H_
+
+#include <Arduino.h>
+
+#include "CentipedeManager.h"
+#include "CommandRegistry.h"
+
+const uint16_t SIM_I2C_BASE_US = 10; // Default cost per I2C transaction [µs]
+const uint16_t SIM_I2C_PORT_US = 40; // Default cost per port written [µs]
+const uint16_t SIM_ADC_US = 20;      // Default cost per ADC channel read [µs]
+const uint16_t SIM_LED_US = 7700;    // Default cost per LED refresh [µs]
+const uint16_t SIM_JITTER_US = 5;    // Default maximum jitter [µs]
+
+/**
+ * @brief Number of port writes the valve timeline holds. Older ones get
+ * overwritten.
+ */
+const uint16_t SIM_TIMELINE_LEN = 128;
+
+/*------------------------------------------------------------------------------
+  PeripheralSim
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Class to simulate the peripherals, see above.
+ */
+class PeripheralSim {
+public:
+  /**
+   * @brief Latency model, each in [µs].
+   */
+  struct Latency {
+    uint16_t i2c_base_us = SIM_I2C_BASE_US;
+    uint16_t i2c_port_us = SIM_I2C_PORT_US;
+    uint16_t adc_us = SIM_ADC_US;
+    uint16_t led_us = SIM_LED_US;
+    uint16_t jitter_us = SIM_JITTER_US;
+  };
+
+  /**
+   * @brief Start simulating, seeding the jitter with @p seed. Clears the
+   * statistics and the valve timeline, such that a run can be repeated.
+   */
+  void start(uint32_t seed);
+
+  inline void stop() { _enabled = false; }
+  inline bool is_enabled() const { return _enabled; }
+
+  /**
+   * @brief Decides whether `sim_on` may start the simulation: Returns nullptr
+   * when it may, else the reason why not.
+   */
+  typedef const char *(*StartGuard)(void *ctx);
+
+  /**
+   * @brief Have `sim_on` consult @p guard before starting, passing @p ctx.
+   * The port writes get diverted into the simulation, so starting halfway a
+   * protocol would leave the real valves as they were.
+   */
+  inline void set_start_guard(StartGuard guard, void *ctx = nullptr) {
+    _guard = guard;
+    _guard_ctx = ctx;
+  }
+
+  inline void set_latency(const Latency &latency) { _latency = latency; }
+  inline const Latency &get_latency() const { return _latency; }
+
+  /**
+   * @brief Simulate writing the bitmasks @p masks to the ports selected by
+   * @p portmask in a single burst. Safe to be called from within an interrupt.
+   *
+   * @param skew_us Set to the time [µs] between the first and the last port
+   * @return The time [µs] at which the burst completed
+   */
+  uint32_t write_ports(const uint16_t *masks, uint8_t portmask,
+                       uint32_t &skew_us);
+
+  /**
+   * @brief Simulate reading ADC channel @p ch at time @p t_us.
+   *
+   * @return The bit value: ~16 mA plus 0.5 mA per channel, modulated by a
+   * 0.1 Hz sine wave, like the fake pressure data without peripherals.
+   */
+  uint16_t read_adc(uint8_t ch, uint32_t t_us);
+
+  /**
+   * @brief Simulate a refresh of the LED matrix.
+   */
+  void show_leds();
+
+  /**
+   * @brief Print the state, the latency model and the statistics, tab
+   * delimited: Enabled, seed, I2C base, I2C per port, ADC, LED and jitter
+   * latencies [µs], number of I2C transactions, number of ports written,
+   * number of ADC reads, number of LED refreshes and the total time [µs] spent
+   * waiting on the simulated peripherals.
+   */
+  void print_stats(Stream &mySerial);
+
+  /**
+   * @brief Print the recorded valve timeline, oldest first. First the number
+   * of port writes that got overwritten, then the number of entries N,
+   * followed by N lines, tab delimited: The time [µs] the write completed,
+   * followed by the bitmasks of all ports in hex.
+   */
+  void print_timeline(Stream &mySerial);
+
+  // Number of commands registered by `register_commands()`, checked against
+  // `MAX_COMMANDS` at compile time, see `register_commands()` of `main.cpp`
+  static const uint8_t N_COMMANDS = 5;
+
+  /**
+   * @brief Register the serial commands configuring and reporting on the
+   * simulation, see `CommandRegistry`.
+   */
+  void register_commands(CommandRegistry &registry);
+
+private:
+  volatile bool _enabled = false;
+  Latency _latency;
+  uint32_t _seed = 1;
+  uint32_t _rng = 1; // State of the jitter generator
+  StartGuard _guard = nullptr; // See `set_start_guard()`
+  void *_guard_ctx = nullptr;
+
+  struct Stats {
+    uint32_t N_i2c = 0;   // I2C transactions
+    uint32_t N_ports = 0; // Ports written
+    uint32_t N_adc = 0;   // ADC channel reads
+    uint32_t N_leds = 0;  // LED refreshes
+    uint64_t busy_us = 0; // Time spent waiting
+  } _stats;
+
+  struct Event {
+    uint32_t t_us;  // Time [µs] the write completed
+    CP_Masks masks; // Resulting port bitmasks
+  };
+  Event _timeline[SIM_TIMELINE_LEN];
+  uint16_t _head = 0;    // Index of the next event to write
+  uint16_t _N_events = 0;
+  uint32_t _N_lost = 0;  // Overwritten events
+  CP_Masks _outputs{};   // Simulated port outputs
+
+  /**
+   * @brief Spend @p cost_us plus jitter busy-waiting.
+   *
+   * @return The time spent [µs]
+   */
+  uint32_t spend(uint32_t cost_us);
+};
+
+#endif
@@ -0,0 +1,99 @@
+/**
+ * @file    PhaseAverager.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "PhaseAverager.h"
+
+extern const uint8_t BUF_LEN;
+extern char buf[];
+
+/*------------------------------------------------------------------------------
+  PhaseAverager
+------------------------------------------------------------------------------*/
+
+bool PhaseAverager::configure(uint16_t first_line, uint16_t N_lines,
+                              uint16_t N_bins, uint32_t bin_us) {
+  if ((N_lines == 0) || (N_bins == 0) || (bin_us == 0) ||
+      ((uint32_t)N_lines * N_bins > PHASE_MAX_CELLS)) {
+    return false;
+  }
+
+  _first_line = first_line;
+  _N_lines = N_lines;
+  _N_bins = N_bins;
+  _bin_us = bin_us;
+  clear();
+  _enabled = true;
+  return true;
+}
+
+void PhaseAverager::clear() {
+  memset(_sum_mbar, 0, sizeof(_sum_mbar));
+  memset(_N, 0, sizeof(_N));
+  _prev_line = -1;
+  _N_passes = 0;
+  _N_added = 0;
+  _N_skipped = 0;
+  _read_pos = 0;
+}
+
+void PhaseAverager::add(int16_t line_no, int32_t us_into_line,
+                        const int16_t (&pres_mbar)[N_R_CLICKS],
+                        uint32_t program_gen) {
+  if (!is_active()) {
+    return;
+  }
+  if (program_gen != _gen) {
+    clear();
+    _gen = program_gen;
+  }
+
+  if ((line_no == _first_line) && (_prev_line != _first_line)) {
+    _N_passes++;
+  }
+  _prev_line = line_no;
+
+  uint16_t line_idx = line_no - _first_line; // Wraps when before the block
+  if ((line_no < 0) || (line_idx >= _N_lines) || (us_into_line < 0)) {
+    _N_skipped++;
+    return;
+  }
+  uint32_t bin = (uint32_t)us_into_line / _bin_us;
+  uint16_t cell = line_idx * _N_bins + bin;
+  if ((bin >= _N_bins) || (_N[cell] == 0xFFFF)) {
+    _N_skipped++;
+    return;
+  }
+
+  for (uint8_t ch = 0; ch < N_R_CLICKS; ++ch) {
+    _sum_mbar[cell][ch] += pres_mbar[ch];
+  }
+  _N[cell]++;
+  _N_added++;
+}
+
+uint16_t PhaseAverager::read(PhaseCell *out, uint16_t max_count) {
+  uint16_t N_cells = _N_lines * _N_bins;
+  uint16_t N = 0;
+  for (; (N < max_count) && (_read_pos < N_cells); ++N, ++_read_pos) {
+    PhaseCell &rec = out[N];
+    rec.N_samples = _N[_read_pos];
+    for (uint8_t ch = 0; ch < N_R_CLICKS; ++ch) {
+      rec.mean_mbar[ch] =
+          rec.N_samples ? _sum_mbar[_read_pos][ch] / rec.N_samples : 0;
+    }
+  }
+  return N;
+}
+
+void PhaseAverager::print(Stream &mySerial) const {
+  snprintf(buf, BUF_LEN, "%d\t%u\t%u\t%u\t%lu\t%lu\t%lu\t%lu\n", _enabled,
+           _first_line, _N_lines, _N_bins, (unsigned long)_bin_us,
+           (unsigned long)_N_passes, (unsigned long)_N_added,
+           (unsigned long)_N_skipped);
+  mySerial.print(buf);
+}
@@ -0,0 +1,149 @@
+/**
+ * @file    PhaseAverager.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Phase-locked averaging of the manifold pressures over the
+ * repetitions of a block of protocol lines, accumulated on the
+ * microcontroller.
+ *
+ * Many protocols loop, or repeat a block of lines. Averaging the pressure
+ * response aligned to the protocol phase, i.e. the line and the time within
+ * that line, over many repetitions reveals the systematic transients that the
+ * sensor noise hides. Rather than logging hours of raw data and aligning it
+ * afterwards, the PC downloads the ensemble average in one go.
+ *
+ * The block spans `N_lines` lines starting at `first_line`, each divided into
+ * `N_bins` time bins of `bin_us` each, counting from the start of the line.
+ * The grid of lines times bins holds at most `PHASE_MAX_CELLS` cells, each
+ * summing the raw readings of every manifold. Readings outside of the block,
+ * beyond the last time bin, or preceding the line they are attributed to,
+ * e.g. taken just before a line switch, get counted but left out. So do the
+ * readings of a cell that has saturated at 65535 readings.
+ *
+ * Accumulating takes place only while the protocol is running, see `resume()`
+ * and `pause()`. A change of protocol program clears the grid, as its phases
+ * no longer match.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef PHASE_AVERAGER_H_
+#define PHASE_AVERAGER_H_
+
+#include <Arduino.h>
+
+#include "RClickDAQ.h"
+
+/**
+ * @brief Maximum number of cells of the grid, i.e. lines times time bins. A
+ * cell takes up 18 bytes.
+ */
+const uint16_t PHASE_MAX_CELLS = 512;
+
+/**
+ * @brief The ensemble average of a single cell, little endian.
+ */
+struct __attribute__((packed)) PhaseCell {
+  uint16_t N_samples;            // Number of readings averaged
+  int16_t mean_mbar[N_R_CLICKS]; // Mean pressure of each manifold [mbar]
+};
+
+static_assert(sizeof(PhaseCell) == 10, "PhaseCell got padded");
+
+/*------------------------------------------------------------------------------
+  PhaseAverager
+------------------------------------------------------------------------------*/
+
+class PhaseAverager {
+public:
+  /**
+   * @brief Set up the grid and clear it, see above. Accumulating starts at
+   * the next reading while running.
+   *
+   * @return True when successful. False when the grid would exceed
+   * `PHASE_MAX_CELLS` or is empty.
+   */
+  bool configure(uint16_t first_line, uint16_t N_lines, uint16_t N_bins,
+                 uint32_t bin_us);
+
+  /**
+   * @brief Stop accumulating, keeping the grid.
+   */
+  inline void disable() { _enabled = false; }
+
+  /**
+   * @brief Empty the grid and reset the counters, keeping the configuration.
+   */
+  void clear();
+
+  /**
+   * @brief The protocol has started or continues running. Accumulate again,
+   * when configured.
+   */
+  inline void resume() { _running = true; }
+
+  /**
+   * @brief The protocol has stopped running.
+   */
+  inline void pause() {
+    _running = false;
+    _prev_line = -1; // Playback may continue elsewhere
+  }
+
+  inline bool is_active() const { return _enabled && _running; }
+
+  /**
+   * @brief Add a reading of all manifolds. Ignored when not active.
+   *
+   * @param line_no Protocol position starting at index 0
+   * @param us_into_line Time of the reading [µs] since the start of that line,
+   * see `ProtocolManager::get_phase()`
+   * @param pres_mbar The pressure of each manifold [mbar]
+   * @param program_gen Generation of the protocol program, see
+   * `ProtocolManager::get_program_gen()`
+   */
+  void add(int16_t line_no, int32_t us_into_line,
+           const int16_t (&pres_mbar)[N_R_CLICKS], uint32_t program_gen);
+
+  /**
+   * @brief Start reading out the grid from its first cell onwards.
+   */
+  inline void rewind() { _read_pos = 0; }
+
+  /**
+   * @brief Read out the next at most @p max_count cells, ordered by line
+   * first, then by time bin.
+   *
+   * @return The number of cells copied into @p out, 0 past the last one.
+   */
+  uint16_t read(PhaseCell *out, uint16_t max_count);
+
+  /**
+   * @brief Print the configuration and the counters, tab delimited: Enabled,
+   * first line, number of lines, number of time bins, bin width [µs],
+   * number of repetitions of the block, number of readings averaged and
+   * number of readings left out.
+   */
+  void print(Stream &mySerial) const;
+
+private:
+  int32_t _sum_mbar[PHASE_MAX_CELLS][N_R_CLICKS]; // Sums of the readings
+  uint16_t _N[PHASE_MAX_CELLS];                   // Readings per cell
+
+  bool _enabled = false;
+  bool _running = false;
+  uint16_t _first_line = 0;
+  uint16_t _N_lines = 0;
+  uint16_t _N_bins = 0;
+  uint32_t _bin_us = 0;
+  uint32_t _gen = 0;        // Program generation the grid applies to
+  int16_t _prev_line = -1;  // Line of the previous reading, -1 when unknown
+  uint32_t _N_passes = 0;   // Number of times the block got entered
+  uint32_t _N_added = 0;    // Number of readings averaged
+  uint32_t _N_skipped = 0;  // Number of readings left out
+  uint16_t _read_pos = 0;   // Next cell to read out
+};
+
+#endif
@@ -0,0 +1,132 @@
+/**
+ * @file    PlaybackTimer.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    14-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "PlaybackTimer.h"
+
+// Timer ticks per µs: 48 MHz GCLK1 with a prescaler of 16
+const uint32_t TICKS_PER_US = 3;
+
+// Longest single shot [µs], keeping the 16-bit counter in range
+const uint32_t MAX_SHOT_US = 65535 / TICKS_PER_US;
+
+// Remaining time [µs] below which the callback is fired directly instead of
+// starting another shot. Covers the interrupt entry overhead.
+const uint32_t MIN_SHOT_US = 4;
+
+static PlaybackTimer *instance = nullptr;
+
+/*------------------------------------------------------------------------------
+  PlaybackTimer
+------------------------------------------------------------------------------*/
+
+#if defined(__SAMD51__)
+
+void PlaybackTimer::begin(void (*callback)()) {
+  _callback = callback;
+  instance = this;
+
+  // Feed TC3 with the 48 MHz generic clock 1
+  GCLK->PCHCTRL[TC3_GCLK_ID].reg =
+      GCLK_PCHCTRL_GEN_GCLK1_Val | (1 << GCLK_PCHCTRL_CHEN_Pos);
+  while (GCLK->SYNCBUSY.reg) {}
+
+  TC3->COUNT16.CTRLA.bit.ENABLE = 0;
+  while (TC3->COUNT16.SYNCBUSY.bit.ENABLE) {}
+  TC3->COUNT16.CTRLA.reg = TC_CTRLA_SWRST;
+  while (TC3->COUNT16.SYNCBUSY.bit.SWRST) {}
+
+  // 16-bit one-shot counter with TOP = CC0, overflowing once per shot
+  TC3->COUNT16.CTRLA.reg = TC_CTRLA_MODE_COUNT16 | TC_CTRLA_PRESCALER_DIV16;
+  TC3->COUNT16.WAVE.reg = TC_WAVE_WAVEGEN_MFRQ;
+  TC3->COUNT16.CTRLBSET.reg = TC_CTRLBSET_ONESHOT;
+  while (TC3->COUNT16.SYNCBUSY.bit.CTRLB) {}
+  TC3->COUNT16.INTENSET.reg = TC_INTENSET_OVF;
+
+  // Highest priority: The valve switching should not wait on anything else
+  NVIC_ClearPendingIRQ(TC3_IRQn);
+  NVIC_SetPriority(TC3_IRQn, 0);
+  NVIC_EnableIRQ(TC3_IRQn);
+
+  TC3->COUNT16.CTRLA.bit.ENABLE = 1;
+  while (TC3->COUNT16.SYNCBUSY.bit.ENABLE) {}
+
+  // Stop the counter that got started by enabling the peripheral
+  TC3->COUNT16.CTRLBSET.reg = TC_CTRLBSET_CMD_STOP;
+  while (TC3->COUNT16.SYNCBUSY.bit.CTRLB) {}
+}
+
+void PlaybackTimer::arm(uint32_t deadline_us) {
+  NVIC_DisableIRQ(TC3_IRQn);
+  _deadline_us = deadline_us;
+  _armed = true;
+  shoot();
+  NVIC_EnableIRQ(TC3_IRQn);
+}
+
+void PlaybackTimer::disarm() {
+  NVIC_DisableIRQ(TC3_IRQn);
+  _armed = false;
+  TC3->COUNT16.CTRLBSET.reg = TC_CTRLBSET_CMD_STOP;
+  while (TC3->COUNT16.SYNCBUSY.bit.CTRLB) {}
+  TC3->COUNT16.INTFLAG.reg = TC_INTFLAG_OVF;
+  NVIC_ClearPendingIRQ(TC3_IRQn);
+  NVIC_EnableIRQ(TC3_IRQn);
+}
+
+void PlaybackTimer::shoot() {
+  int32_t remaining_us = (int32_t)(_deadline_us - micros());
+  uint32_t shot_us;
+
+  if (remaining_us < (int32_t)MIN_SHOT_US) {
+    shot_us = 1; // Fire as soon as possible
+  } else {
+    shot_us = min((uint32_t)remaining_us, MAX_SHOT_US);
+  }
+
+  TC3->COUNT16.CC[0].reg = shot_us * TICKS_PER_US;
+  while (TC3->COUNT16.SYNCBUSY.bit.CC0) {}
+  TC3->COUNT16.CTRLBSET.reg = TC_CTRLBSET_CMD_RETRIGGER;
+  while (TC3->COUNT16.SYNCBUSY.bit.CTRLB) {}
+}
+
+void PlaybackTimer::isr() {
+  TC3->COUNT16.INTFLAG.reg = TC_INTFLAG_OVF;
+  if (!_armed) {
+    return;
+  }
+
+  if ((int32_t)(_deadline_us - micros()) >= (int32_t)MIN_SHOT_US) {
+    shoot(); // Deadline lies beyond a single shot
+    return;
+  }
+
+  _armed = false;
+  if (_callback) {
+    _callback();
+  }
+}
+
+void TC3_Handler() {
+  if (instance) {
+    instance->isr();
+  }
+}
+
+#else
+
+void PlaybackTimer::begin(void (*callback)()) {
+  _callback = callback;
+  instance = this;
+}
+
+void PlaybackTimer::arm(uint32_t deadline_us) { _deadline_us = deadline_us; }
+void PlaybackTimer::disarm() { _armed = false; }
+void PlaybackTimer::shoot() {}
+void PlaybackTimer::isr() {}
+
+#endif
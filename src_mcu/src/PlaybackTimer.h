@@ -0,0 +1,90 @@
+/**
+ * @file    PlaybackTimer.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    14-10-2026
+ *
+ * @brief   One-shot hardware timer on the SAMD51 TC3 peripheral, used to fire
+ * the protocol line transitions at their exact deadlines independent of the
+ * main loop.
+ *
+ * The timer runs at 3 MHz (48 MHz GCLK1 / 16) in 16-bit mode, so a single shot
+ * reaches at most ~21 ms. Longer delays are bridged by re-arming the timer
+ * inside the interrupt until the deadline is reached. The deadline is
+ * expressed on the `micros()` time track.
+ *
+ * On boards other than the SAMD51 the timer is not available and all methods
+ * are no-ops, see `PlaybackTimer::available()`.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef PLAYBACK_TIMER_H_
+#define PLAYBACK_TIMER_H_
+
+#include <Arduino.h>
+
+/*------------------------------------------------------------------------------
+  PlaybackTimer
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Class to fire a callback function from within an interrupt at a given
+ * deadline on the `micros()` time track.
+ *
+ * Only a single instance can exist, because it claims the TC3 peripheral and
+ * its interrupt handler.
+ */
+class PlaybackTimer {
+public:
+  /**
+   * @brief Configure the TC3 peripheral and its interrupt.
+   *
+   * @param callback Function to be called from within the interrupt once the
+   * deadline is reached. Keep it short.
+   */
+  void begin(void (*callback)());
+
+  /**
+   * @brief Is the hardware timer available on this board?
+   */
+  static constexpr bool available() {
+#if defined(__SAMD51__)
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  /**
+   * @brief Arm the timer to fire the callback at @p deadline_us. When the
+   * deadline has already passed, the callback will fire as soon as possible.
+   * Re-arming an already armed timer replaces its deadline.
+   */
+  void arm(uint32_t deadline_us);
+
+  /**
+   * @brief Disarm the timer. The callback is guaranteed not to fire anymore
+   * once this method returns.
+   */
+  void disarm();
+
+  inline bool is_armed() { return _armed; }
+
+  /**
+   * @brief To be called exclusively from within the TC3 interrupt handler.
+   */
+  void isr();
+
+private:
+  void (*_callback)() = nullptr;
+  volatile uint32_t _deadline_us = 0;
+  volatile bool _armed = false;
+
+  /**
+   * @brief Start a single shot of at most ~21 ms towards the deadline.
+   */
+  void shoot();
+};
+
+#endif
@@ -0,0 +1,157 @@
+/**
+ * @file    Playlist.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "Playlist.h"
+#include "TxQueue.h"
+
+// See `main.cpp`
+extern const uint8_t BUF_LEN; // Common character buffer for string formatting
+extern char buf[];            // Common character buffer for string formatting
+
+/*------------------------------------------------------------------------------
+  Playlist
+------------------------------------------------------------------------------*/
+
+void Playlist::clear() {
+  stop();
+  _N_entries = 0;
+}
+
+bool Playlist::add(const char *name, uint16_t repeats, uint32_t duration_s) {
+  if ((_N_entries >= PLAYLIST_MAX_ENTRIES) || (name[0] == '\0') ||
+      ((repeats == 0) && (duration_s == 0))) {
+    return false;
+  }
+
+  Entry &entry = _entries[_N_entries];
+  strncpy(entry.name, name, sizeof(entry.name) - 1);
+  entry.name[sizeof(entry.name) - 1] = '\0';
+  entry.repeats = repeats;
+  entry.duration_s = duration_s;
+  _N_entries++;
+  return true;
+}
+
+bool Playlist::start() {
+  stop();
+  if (_N_entries == 0) {
+    tx.println("ERROR: Playlist is empty.");
+    return false;
+  }
+  if (!_protocol_lib->load(_entries[0].name, *_protocol_mgr)) {
+    return false;
+  }
+
+  begin_entry(0);
+  _playing = true;
+  return true;
+}
+
+void Playlist::stop() {
+  if (_playing && _protocol_lib->prefetch_busy()) {
+    _protocol_lib->cancel_prefetch();
+  }
+  _playing = false;
+}
+
+void Playlist::begin_entry(uint8_t idx) {
+  _idx = idx;
+  _next_ready = false;
+  _next_requested = false;
+  _wraps_ref = _protocol_mgr->get_N_wraps();
+  _elapsed_ms = 0;
+  _t_last_ms = millis();
+}
+
+PlaylistStatus Playlist::update() {
+  if (!_playing) {
+    return PLAYLIST_IDLE;
+  }
+
+  // The entry starts at its first switch onto line 0
+  uint32_t now_ms = millis();
+  uint32_t N_passes = _protocol_mgr->get_N_wraps() - _wraps_ref;
+  if (N_passes > 0) {
+    _elapsed_ms += now_ms - _t_last_ms;
+  }
+  _t_last_ms = now_ms;
+
+  bool has_next = (_idx + 1 < _N_entries);
+  bool can_stage = ProtocolManager::has_staging_slot();
+
+  // Prefetch the next entry once the staging slot is free again
+  if (has_next && can_stage && !_next_requested &&
+      !_protocol_mgr->swap_pending()) {
+    _next_requested = true;
+    if (!_protocol_lib->prefetch(_entries[_idx + 1].name, *_protocol_mgr)) {
+      _playing = false;
+      return PLAYLIST_FAILED;
+    }
+  }
+  switch (_protocol_lib->update_prefetch(*_protocol_mgr)) {
+    case PREFETCH_DONE:
+      _next_ready = true;
+      break;
+    case PREFETCH_FAILED:
+      _playing = false;
+      return PLAYLIST_FAILED;
+    default:
+      break;
+  }
+
+  if ((N_passes == 0) || _protocol_mgr->swap_pending()) {
+    return PLAYLIST_PLAYING;
+  }
+
+  const Entry &entry = _entries[_idx];
+  bool ended = (entry.duration_s &&
+                (_elapsed_ms >= entry.duration_s * 1000)) ||
+               (entry.repeats && (N_passes > entry.repeats));
+
+  if (!has_next) {
+    if (ended) {
+      _playing = false;
+      return PLAYLIST_DONE;
+    }
+
+  } else if (can_stage) {
+    // Swap in the next program right after the last line of the last pass
+    bool last_line = entry.repeats && (N_passes == entry.repeats) &&
+                     (_protocol_mgr->get_position() + 1 ==
+                      _protocol_mgr->get_N_lines());
+    if ((ended || last_line) && _next_ready && _protocol_mgr->swap(true)) {
+      begin_entry(_idx + 1);
+    }
+
+  } else if (ended) {
+    // No staging slot: Load the next program in one go
+    if (!_protocol_lib->load(_entries[_idx + 1].name, *_protocol_mgr)) {
+      _playing = false;
+      return PLAYLIST_FAILED;
+    }
+    begin_entry(_idx + 1);
+  }
+
+  return PLAYLIST_PLAYING;
+}
+
+void Playlist::print(Stream &mySerial) const {
+  snprintf(buf, BUF_LEN, "%u\t%d\t%lu\t%lu\n", _N_entries,
+           _playing ? _idx : -1,
+           (unsigned long)(_playing
+                               ? _protocol_mgr->get_N_wraps() - _wraps_ref
+                               : 0),
+           (unsigned long)(_playing ? _elapsed_ms / 1000 : 0));
+  mySerial.print(buf);
+  for (uint8_t idx = 0; idx < _N_entries; ++idx) {
+    const Entry &entry = _entries[idx];
+    snprintf(buf, BUF_LEN, "%u\t%lu\t%s\n", entry.repeats,
+             (unsigned long)entry.duration_s, entry.name);
+    mySerial.print(buf);
+  }
+}
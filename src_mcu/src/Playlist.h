@@ -0,0 +1,139 @@
+/**
+ * @file    Playlist.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Sequence of protocol programs stored in the protocol library, played
+ * back to back, see `ProtocolLibrary`.
+ *
+ * Each entry plays its program for a number of passes, for a duration, or for
+ * whichever of the two is reached first. The time spent paused does not count.
+ *
+ * While an entry plays, the program of the next entry gets prefetched from
+ * flash into the staging slot in chunks, see `ProtocolLibrary::prefetch()`.
+ * At the end of the entry, it gets swapped in at the next line boundary, see
+ * `ProtocolManager::swap()`, such that the valves don't skip a beat. An entry
+ * ending on its number of passes does so at the end of its last line, an entry
+ * ending on its duration at the end of the line being played by then.
+ *
+ * Without a staging slot, see `PROTOCOL_SLOTS`, the next program gets loaded
+ * only once the entry has ended, stalling the main loop for the duration of
+ * the flash read, after which it plays from its start.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef PLAYLIST_H_
+#define PLAYLIST_H_
+
+#include <Arduino.h>
+
+#include "ProtocolLibrary.h"
+#include "ProtocolManager.h"
+
+const uint8_t PLAYLIST_MAX_ENTRIES = 16;
+
+/**
+ * @brief Progress of the playlist, see `Playlist::update()`.
+ */
+enum PlaylistStatus : uint8_t { PLAYLIST_IDLE, PLAYLIST_PLAYING, PLAYLIST_DONE,
+                                PLAYLIST_FAILED };
+
+/*------------------------------------------------------------------------------
+  Playlist
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Class to play a sequence of stored protocol programs, see above.
+ */
+class Playlist {
+public:
+  Playlist(ProtocolManager *protocol_mgr, ProtocolLibrary *protocol_lib)
+      : _protocol_mgr(protocol_mgr), _protocol_lib(protocol_lib) {}
+
+  /**
+   * @brief Remove all entries. Stops playing.
+   */
+  void clear();
+
+  /**
+   * @brief Append an entry playing the stored program @p name for @p repeats
+   * passes or for @p duration_s seconds, whichever comes first. Pass 0 to not
+   * limit by that measure.
+   *
+   * @return False when the playlist is full, the name is empty or both limits
+   * are 0, true otherwise. A program missing from the library shows when
+   * playing.
+   */
+  bool add(const char *name, uint16_t repeats, uint32_t duration_s);
+
+  /**
+   * @brief Load the program of the first entry and start prefetching the next
+   * one. The protocol playback itself has to be started by the caller.
+   *
+   * Errors are reported over serial.
+   *
+   * @return True when successful. False otherwise.
+   */
+  bool start();
+
+  /**
+   * @brief Stop sequencing, leaving the program in memory as it is.
+   */
+  void stop();
+
+  /**
+   * @brief Exclude the time passed since the last `update()` from the
+   * duration of the entry, e.g. after having been paused.
+   */
+  inline void resume() { _t_last_ms = millis(); }
+
+  inline bool is_playing() const { return _playing; }
+
+  /**
+   * @brief Advance the prefetch and switch to the next entry when it is time.
+   * To be called repeatedly from within the main loop while the protocol
+   * plays, right after `ProtocolManager::update()`.
+   *
+   * @return `PLAYLIST_DONE` once the last entry has ended, `PLAYLIST_FAILED`
+   * when a program could not be loaded, after which the playlist stops.
+   */
+  PlaylistStatus update();
+
+  /**
+   * @brief Print the playlist. First the number of entries and the index of
+   * the entry playing, -1 when idle, the number of passes started and the
+   * seconds played of it. Then one entry per line, tab delimited: Repeats,
+   * duration [s], protocol name.
+   */
+  void print(Stream &mySerial) const;
+
+private:
+  struct Entry {
+    char name[64];       // Name of the stored protocol program
+    uint16_t repeats;    // Number of passes, 0 for unlimited
+    uint32_t duration_s; // Duration [s], 0 for unlimited
+  };
+
+  ProtocolManager *_protocol_mgr;
+  ProtocolLibrary *_protocol_lib;
+  Entry _entries[PLAYLIST_MAX_ENTRIES];
+  uint8_t _N_entries = 0;
+
+  bool _playing = false;
+  uint8_t _idx = 0;             // Index of the entry playing
+  bool _next_requested = false; // Has the prefetch of the next entry begun?
+  bool _next_ready = false;     // Is the next entry staged?
+  uint32_t _wraps_ref = 0;      // `get_N_wraps()` when the entry got queued
+  uint32_t _elapsed_ms = 0;     // Time [ms] played of the entry
+  uint32_t _t_last_ms = 0;      // Time [ms] of the last `update()`
+
+  /**
+   * @brief Make entry @p idx the one playing, from the next switch onto line 0
+   * onwards. The entry following it gets prefetched by `update()`.
+   */
+  void begin_entry(uint8_t idx);
+};
+
+#endif
@@ -0,0 +1,139 @@
+/**
+ * @file    PressureController.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "PressureController.h"
+#include "PressureScale.h"
+#include "ProtocolManager.h"
+#include "translations.h"
+
+// Smoothing factor of the derivative term per period
+const float PID_D_ALPHA = 1.f / 3.f;
+
+/*------------------------------------------------------------------------------
+  PressureController
+------------------------------------------------------------------------------*/
+
+void PressureController::begin(int16_t mbar, uint8_t channel, float f_Hz) {
+  _setpoint = mbar;
+  _channel = min(channel, N_R_CLICKS);
+  _out = constrain(f_Hz, _f_min, _f_max);
+  _I = _out - _f_0 - _K_ff * _N_open;
+  _D = 0;
+  _has_prev = false;
+  _active = true;
+}
+
+void PressureController::set_gains(float Kp, float Ki, float Kd) {
+  // Keep the output continuous when the proportional gain changes midway
+  _I += (_Kp - Kp) * (_setpoint - _pv_mbar) / 1000.f;
+  _Kp = Kp;
+  _Ki = Ki;
+  _Kd = Kd;
+}
+
+void PressureController::set_feedforward(float f_0, float K_ff) {
+  _I += (_f_0 - f_0) + (_K_ff - K_ff) * _N_open;
+  _f_0 = f_0;
+  _K_ff = K_ff;
+}
+
+void PressureController::set_limits(float f_min, float f_max, float rate) {
+  _f_min = max(f_min, 0.f);
+  _f_max = max(f_max, _f_min);
+  _rate = max(rate, 0.f);
+}
+
+int16_t PressureController::process_value(
+    const int16_t (&pres_mbar)[N_R_CLICKS]) const {
+  if (_channel) {
+    return pres_mbar[_channel - 1];
+  }
+
+  int32_t sum = 0;
+  for (uint8_t ch = 0; ch < N_R_CLICKS; ++ch) {
+    if (pres_mbar[ch] == PRESSURE_FAULT) {
+      return PRESSURE_FAULT;
+    }
+    sum += pres_mbar[ch];
+  }
+  return sum / N_R_CLICKS;
+}
+
+float PressureController::step(const int16_t (&pres_mbar)[N_R_CLICKS],
+                               uint8_t N_open, float dt_s, bool hold) {
+  int16_t pv = process_value(pres_mbar);
+  if (N_open != N_OPEN_UNKNOWN) {
+    _N_open = N_open;
+  }
+
+  if (hold || (pv == PRESSURE_FAULT) || (dt_s <= 0)) {
+    _has_prev = false;
+    _limited = 3;
+    return _out;
+  }
+
+  float error = (_setpoint - pv) / 1000.f; // [bar]
+  if (_has_prev) {
+    float dpdt = (pv - _prev_mbar) / 1000.f / dt_s; // [bar/s]
+    _D += PID_D_ALPHA * (-_Kd * dpdt - _D);
+  }
+  _prev_mbar = pv;
+  _has_prev = true;
+
+  _pv_mbar = pv;
+  _FF = _f_0 + _K_ff * _N_open;
+  _P = _Kp * error;
+  float I_next = _I + _Ki * error * dt_s;
+  float f = _FF + _P + I_next + _D;
+
+  // Limit the range, then the rate of change
+  _limited = 0;
+  if (f > _f_max) {
+    f = _f_max;
+    _limited = 1;
+  } else if (f < _f_min) {
+    f = _f_min;
+    _limited = 1;
+  }
+  if (_rate > 0) {
+    float max_step = _rate * dt_s;
+    if (f > _out + max_step) {
+      f = _out + max_step;
+      _limited = 2;
+    } else if (f < _out - max_step) {
+      f = _out - max_step;
+      _limited = 2;
+    }
+  }
+
+  // Conditional integration: Freeze the integral when limited in the
+  // direction the error pushes
+  bool pushing_up = (error > 0) && (f < _FF + _P + I_next + _D);
+  bool pushing_down = (error < 0) && (f > _FF + _P + I_next + _D);
+  if (!_limited || !(pushing_up || pushing_down)) {
+    _I = I_next;
+  }
+
+  _out = f;
+  return _out;
+}
+
+void PressureController::print_settings(Stream &mySerial) const {
+  snprintf(buf, BUF_LEN,
+           "%u\t%d\t%u\t%.3f\t%.3f\t%.3f\t%.2f\t%.3f\t%.1f\t%.1f\t%.1f\n",
+           _active, _setpoint, _channel, _Kp, _Ki, _Kd, _f_0, _K_ff, _f_min,
+           _f_max, _rate);
+  mySerial.print(buf);
+}
+
+void PressureController::print_terms(Stream &mySerial) const {
+  snprintf(buf, BUF_LEN, "%d\t%d\t%u\t%.2f\t%.2f\t%.2f\t%.2f\t%.2f\t%u\n",
+           _pv_mbar, _setpoint - _pv_mbar, _N_open, _FF, _P, _I, _D, _out,
+           _limited);
+  mySerial.print(buf);
+}
@@ -0,0 +1,142 @@
+/**
+ * @file    PressureController.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   PID controller on the Arduino regulating the manifold pressure by
+ * the frequency of the pump, see `HydrovarPump`. Closes the loop on the
+ * filtered R Click readings at the polling rate of the pump, without the USB
+ * latency of regulating from the PC.
+ *
+ * The frequency [Hz] is the sum of the terms:
+ *   - Feed-forward: `f_0 + K_ff * N_open`, with N_open the number of valves
+ *     opened by the upcoming protocol line, see command `lookahead`. Gets the
+ *     pump going before the pressure drops on a line switch, leaving the
+ *     feedback to correct for the remainder.
+ *   - Proportional: `K_p * e`, with e the pressure error [bar].
+ *   - Integral: The sum of `K_i * e * dt`.
+ *   - Derivative: `-K_d * d(pressure)/dt`, on the pressure instead of on the
+ *     error to not kick on setpoint changes, low-passed over ~3 periods.
+ *
+ * The sum gets limited to [f_min, f_max] and its change per period to
+ * `rate * dt`, sparing the motor. While limited in the direction the error
+ * pushes, the integral is frozen, i.e. conditional integration against
+ * windup. The integral is frozen as well while holding, e.g. while the pump
+ * is not allowed to run, or while the pressure reading is at fault.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef PRESSURE_CONTROLLER_H_
+#define PRESSURE_CONTROLLER_H_
+
+#include <Arduino.h>
+
+#include "RClickDAQ.h"
+
+/*------------------------------------------------------------------------------
+  PressureController
+------------------------------------------------------------------------------*/
+
+class PressureController {
+public:
+  /**
+   * @brief Start regulating pressure @p mbar on manifold @p channel, 1 to
+   * `N_R_CLICKS`, or on the mean over all manifolds when 0. Starts bumpless
+   * from frequency @p f_Hz, i.e. the integral takes up what the other terms
+   * leave.
+   */
+  void begin(int16_t mbar, uint8_t channel, float f_Hz);
+
+  inline void stop() { _active = false; }
+  inline bool is_active() const { return _active; }
+
+  /**
+   * @brief Set the feedback gains: @p Kp [Hz/bar], @p Ki [Hz/(bar s)] and
+   * @p Kd [Hz s/bar].
+   */
+  void set_gains(float Kp, float Ki, float Kd);
+
+  /**
+   * @brief Set the feed-forward: @p f_0 [Hz] plus @p K_ff [Hz] per open
+   * valve.
+   */
+  void set_feedforward(float f_0, float K_ff);
+
+  /**
+   * @brief Limit the frequency to [@p f_min, @p f_max] [Hz] and its rate of
+   * change to @p rate [Hz/s], or not at all when 0.
+   */
+  void set_limits(float f_min, float f_max, float rate);
+
+  /**
+   * @brief Compute the frequency [Hz] for the next period.
+   *
+   * @param pres_mbar Pressure of each manifold [mbar], or `PRESSURE_FAULT`
+   * @param N_open Number of valves opened by the upcoming line, or
+   * `N_OPEN_UNKNOWN` to keep using the last known count
+   * @param dt_s Time [s] since the previous call
+   * @param hold Freeze the integral and keep the output as is?
+   */
+  float step(const int16_t (&pres_mbar)[N_R_CLICKS], uint8_t N_open,
+             float dt_s, bool hold);
+
+  /**
+   * @brief Print the settings, tab delimited:
+   *   1) Is regulating?
+   *   2) Setpoint [mbar]
+   *   3) Manifold, 0 for the mean over all
+   *   4) K_p [Hz/bar], K_i [Hz/(bar s)] and K_d [Hz s/bar]
+   *   7) f_0 [Hz] and K_ff [Hz/valve]
+   *   9) f_min [Hz], f_max [Hz] and rate [Hz/s]
+   */
+  void print_settings(Stream &mySerial) const;
+
+  /**
+   * @brief Print the terms of the last period, tab delimited:
+   *   1) Pressure [mbar]
+   *   2) Error [mbar]
+   *   3) Number of open valves used by the feed-forward
+   *   4) Feed-forward, proportional, integral and derivative term [Hz]
+   *   8) Frequency [Hz], after limiting
+   *   9) Was the frequency limited? 0: no, 1: range, 2: rate, 3: holding
+   */
+  void print_terms(Stream &mySerial) const;
+
+private:
+  bool _active = false;
+  int16_t _setpoint = 0; // [mbar]
+  uint8_t _channel = 0;  // Manifold, 0 for the mean over all
+
+  // Settings
+  float _Kp = 0;       // [Hz/bar]
+  float _Ki = 0;       // [Hz/(bar s)]
+  float _Kd = 0;       // [Hz s/bar]
+  float _f_0 = 0;      // [Hz]
+  float _K_ff = 0;     // [Hz/valve]
+  float _f_min = 0;    // [Hz]
+  float _f_max = 50;   // [Hz]
+  float _rate = 0;     // [Hz/s], 0 for unlimited
+
+  // State
+  float _I = 0;              // Integral term [Hz]
+  float _D = 0;              // Derivative term, low-passed [Hz]
+  float _out = 0;            // Frequency [Hz]
+  int16_t _prev_mbar = 0;    // Pressure of the previous period [mbar]
+  bool _has_prev = false;    // Is `_prev_mbar` valid?
+  uint8_t _N_open = 0;       // Last known open-valve count
+
+  // Terms of the last period, see `print_terms()`
+  int16_t _pv_mbar = 0;
+  float _FF = 0;
+  float _P = 0;
+  uint8_t _limited = 0;
+
+  /**
+   * @brief Return the pressure to regulate, or `PRESSURE_FAULT`.
+   */
+  int16_t process_value(const int16_t (&pres_mbar)[N_R_CLICKS]) const;
+};
+
+#endif
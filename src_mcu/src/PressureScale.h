@@ -0,0 +1,117 @@
+/**
+ * @file    PressureScale.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    14-10-2026
+ *
+ * @brief   Fixed-point conversion of the R Click bit values into the current
+ * and the pressure of the OMEGA pressure sensors.
+ *
+ * The chain `R_Click::bitval2mA()` followed by `mA2bar()` is linear in the bit
+ * value. Hence, the R Click calibration and the OMEGA calibration get folded
+ * into a single precomputed scale and offset per channel, once at startup. Each
+ * conversion then takes a single integer multiply-add:
+ *
+ *   out = (bitval_q4 * scale + offset + 2^15) >> 16
+ *
+ * with `bitval_q4` the bit value in units of 1/16 bitval, which retains the
+ * fractional part of the moving averages. The outputs are integer currents in
+ * [µA] and pressures in [mbar], also on the serial interface, leaving the
+ * conversion into physical units to the PC.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef PRESSURE_SCALE_H_
+#define PRESSURE_SCALE_H_
+
+#include <Arduino.h>
+#include <math.h>
+
+#include "constants.h"
+
+/**
+ * @brief Value of a current or pressure when the sensor is in a fault state,
+ * i.e. the current is not larger than `R_CLICK_FAULT_mA`.
+ */
+const int16_t PRESSURE_FAULT = INT16_MIN;
+
+/**
+ * @brief Convert a fractional bit value, e.g. a moving average, into units of
+ * 1/16 bitval.
+ */
+inline uint16_t bitval2q4(float bitval) {
+  return (bitval <= 0) ? 0 : (uint16_t)(bitval * 16.f + .5f);
+}
+
+/*------------------------------------------------------------------------------
+  PressureScale
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Class to convert the bit values of a single R Click into the current
+ * and pressure of the OMEGA pressure sensor attached to it.
+ */
+class PressureScale {
+public:
+  /**
+   * @brief Fold the calibration parameters into the fixed-point scales and
+   * offsets.
+   *
+   * @param R_calib Calibration of the R Click, [bitval] to [mA]
+   * @param omega_calib Calibration of the OMEGA pressure sensor, [mA] to [bar]
+   */
+  PressureScale(const RT_Click_Calibration &R_calib,
+                const Omega_Calib &omega_calib) {
+    // mA = mA_gain * bitval + mA_bias
+    float mA_gain = (R_calib.p2_mA - R_calib.p1_mA) /
+                    float(R_calib.p2_bitval - R_calib.p1_bitval);
+    float mA_bias = R_calib.p1_mA - mA_gain * R_calib.p1_bitval;
+
+    // bar = bar_gain * bitval + bar_bias
+    float bar_per_mA = omega_calib.full_range_bar / omega_calib.sensitivity_mA;
+    float bar_gain = mA_gain * bar_per_mA;
+    float bar_bias = (mA_bias - omega_calib.balance_mA) * bar_per_mA;
+
+    // Per 1/16 bitval into Q16 fixed point, times 1000 for [µA] and [mbar]
+    _uA_scale = lroundf(mA_gain * 1e3f * 4096.f);
+    _uA_offset = lroundf(mA_bias * 1e3f * 65536.f) + (1 << 15);
+    _mbar_scale = lroundf(bar_gain * 1e3f * 4096.f);
+    _mbar_offset = lroundf(bar_bias * 1e3f * 65536.f) + (1 << 15);
+
+    // Largest bit value at which the current is in the fault state
+    float fault_q4 = (R_CLICK_FAULT_mA - mA_bias) / mA_gain * 16.f;
+    _fault_q4 = (fault_q4 < 0) ? -1 : (int32_t)floorf(fault_q4);
+  }
+
+  /**
+   * @brief Return the current [µA] belonging to bit value @p bitval_q4 in
+   * units of 1/16 bitval, or `PRESSURE_FAULT`.
+   */
+  inline int16_t bitval2uA(uint16_t bitval_q4) const {
+    if ((int32_t)bitval_q4 <= _fault_q4) {
+      return PRESSURE_FAULT;
+    }
+    return (int16_t)(((int32_t)bitval_q4 * _uA_scale + _uA_offset) >> 16);
+  }
+
+  /**
+   * @brief Return the pressure [mbar] belonging to bit value @p bitval_q4 in
+   * units of 1/16 bitval, or `PRESSURE_FAULT`.
+   */
+  inline int16_t bitval2mbar(uint16_t bitval_q4) const {
+    if ((int32_t)bitval_q4 <= _fault_q4) {
+      return PRESSURE_FAULT;
+    }
+    return (int16_t)(((int32_t)bitval_q4 * _mbar_scale + _mbar_offset) >> 16);
+  }
+
+private:
+  int32_t _uA_scale;    // [µA] per 1/16 bitval, Q16
+  int32_t _uA_offset;   // [µA] at bitval 0, Q16, including rounding
+  int32_t _mbar_scale;  // [mbar] per 1/16 bitval, Q16
+  int32_t _mbar_offset; // [mbar] at bitval 0, Q16, including rounding
+  int32_t _fault_q4;    // Largest bit value in the fault state [1/16 bitval]
+};
+
+#endif
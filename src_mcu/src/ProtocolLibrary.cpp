@@ -0,0 +1,492 @@
+/**
+ * @file    ProtocolLibrary.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "ProtocolLibrary.h"
+#include "TxQueue.h"
+
+#include "Adafruit_SleepyDog.h"
+
+#include <stddef.h>
+
+// Marks a valid directory: "TWTL"
+const uint32_t LIB_MAGIC = 0x4C545754;
+
+// Programs get stored after the two directory sectors
+const uint32_t LIB_DATA_START = 2 * QSPIFlash::SECTOR_SIZE;
+
+// Build flags the program images are stored with, see `ProtocolLibrary.h`
+const uint16_t LIB_FORMAT = PROGRAM_IMAGE_FORMAT;
+
+/**
+ * @brief Round @p N_bytes up to a whole number of flash sectors.
+ */
+static inline uint32_t sector_ceil(uint32_t N_bytes) {
+  return (N_bytes + QSPIFlash::SECTOR_SIZE - 1) / QSPIFlash::SECTOR_SIZE *
+         QSPIFlash::SECTOR_SIZE;
+}
+
+/*------------------------------------------------------------------------------
+  ProtocolLibrary
+------------------------------------------------------------------------------*/
+
+bool ProtocolLibrary::begin(QSPIFlash *flash, uint32_t N_reserved) {
+  _flash = flash;
+  _available = _flash->begin();
+  _end = (_flash->size() > N_reserved) ? _flash->size() - N_reserved : 0;
+
+  // Pick the valid directory copy with the highest sequence number
+  int8_t best_sec = -1;
+  uint32_t best_seq = 0;
+  for (uint8_t sec = 0; sec < 2 && _available; ++sec) {
+    _flash->read(sec * QSPIFlash::SECTOR_SIZE, &_dir, sizeof(_dir));
+    if ((_dir.magic == LIB_MAGIC) &&
+        (_dir.crc == crc32(&_dir, offsetof(Directory, crc))) &&
+        (_dir.N_entries <= LIB_MAX_ENTRIES) &&
+        ((best_sec < 0) || (_dir.seq > best_seq))) {
+      best_sec = sec;
+      best_seq = _dir.seq;
+    }
+  }
+
+  if (best_sec < 0) {
+    // Unformatted flash: Start with an empty library
+    memset(&_dir, 0, sizeof(_dir));
+    _dir_sec = 1; // Such that the first write goes to sector 0
+  } else {
+    _flash->read(best_sec * QSPIFlash::SECTOR_SIZE, &_dir, sizeof(_dir));
+    _dir_sec = best_sec;
+    if (_dir.program_crcs_crc !=
+        crc32(_dir.program_crcs, sizeof(_dir.program_crcs))) {
+      // Written by older firmware
+      memset(_dir.program_crcs, 0, sizeof(_dir.program_crcs));
+    }
+  }
+
+  return _available;
+}
+
+bool ProtocolLibrary::write_directory() {
+  _dir.magic = LIB_MAGIC;
+  _dir.seq++;
+  _dir.crc = crc32(&_dir, offsetof(Directory, crc));
+  _dir.program_crcs_crc = crc32(_dir.program_crcs, sizeof(_dir.program_crcs));
+
+  uint8_t sec = _dir_sec ^ 1;
+  if (!_flash->erase_sector(sec * QSPIFlash::SECTOR_SIZE) ||
+      !_flash->write(sec * QSPIFlash::SECTOR_SIZE, &_dir, sizeof(_dir))) {
+    return false;
+  }
+  _dir_sec = sec;
+  return true;
+}
+
+int16_t ProtocolLibrary::find(const char *name) {
+  for (uint8_t idx = 0; idx < _dir.N_entries; ++idx) {
+    if (strncmp(_dir.entries[idx].name, name, sizeof(Entry::name)) == 0) {
+      return idx;
+    }
+  }
+  return -1;
+}
+
+uint32_t ProtocolLibrary::allocate(uint32_t N_bytes) {
+  uint32_t size = sector_ceil(N_bytes);
+  uint32_t best_addr = 0;
+
+  // Free space can only start at the data start or directly after a program
+  for (int16_t cand = -1; cand < _dir.N_entries; ++cand) {
+    uint32_t addr = (cand < 0) ? LIB_DATA_START
+                               : _dir.entries[cand].addr +
+                                     sector_ceil(_dir.entries[cand].N_bytes);
+    if ((addr + size > _end) ||
+        ((best_addr != 0) && (addr >= best_addr))) {
+      continue;
+    }
+
+    bool overlaps = false;
+    for (uint8_t idx = 0; idx < _dir.N_entries; ++idx) {
+      const Entry &entry = _dir.entries[idx];
+      if ((addr < entry.addr + sector_ceil(entry.N_bytes)) &&
+          (entry.addr < addr + size)) {
+        overlaps = true;
+        break;
+      }
+    }
+    if (!overlaps && !reader_overlaps(addr, size)) {
+      best_addr = addr;
+    }
+  }
+
+  return best_addr;
+}
+
+bool ProtocolLibrary::reader_overlaps(uint32_t addr, uint32_t N_bytes) {
+#if PROTOCOL_COMPRESSED == COMPRESSION_DELTA
+  // A program playing from flash might have been replaced under its name
+  // since, leaving its image to be overwritten otherwise
+  if (!_reader.is_open()) {
+    return false;
+  }
+  uint32_t begin = _reader.get_addr();
+  uint32_t end = begin + sector_ceil(_reader.get_N_bytes());
+  return (N_bytes > 0) && (addr < end) && (begin < addr + N_bytes);
+#else
+  (void)addr;
+  (void)N_bytes;
+  return false;
+#endif
+}
+
+bool ProtocolLibrary::save(ProtocolManager &protocol_mgr) {
+  if (!_available) {
+    tx.println("ERROR: Protocol library not available.");
+    return false;
+  }
+
+  if (protocol_mgr.get_program().is_flash_resident()) {
+    tx.println("ERROR: Protocol program plays from the library already.");
+    return false;
+  }
+
+  const char *name = protocol_mgr.get_name();
+  int16_t idx = find(name);
+  if ((idx < 0) && (_dir.N_entries == LIB_MAX_ENTRIES)) {
+    snprintf(buf, BUF_LEN,
+             "ERROR: Protocol library is full. The maximum is %d programs.",
+             LIB_MAX_ENTRIES);
+    tx.println(buf);
+    return false;
+  }
+
+  // Any program stored under the same name is kept until the new one has
+  // been written successfully
+  Program &program = protocol_mgr.get_program();
+  uint32_t N_bytes = program.get_N_image_bytes();
+  uint32_t addr = allocate(N_bytes);
+  if (addr == 0) {
+    tx.println("ERROR: Not enough free space in the protocol library.");
+    return false;
+  }
+
+  bool success = true;
+  for (uint32_t ofs = 0; ofs < N_bytes; ofs += QSPIFlash::SECTOR_SIZE) {
+    Watchdog.reset();
+    success &= _flash->erase_sector(addr + ofs);
+  }
+  success &= _flash->write(addr, program.image(), N_bytes);
+
+  // Verify by reading back
+  uint32_t crc = crc32(program.image(), N_bytes);
+  uint32_t crc_check = 0;
+  uint8_t chunk[QSPIFlash::PAGE_SIZE];
+  for (uint32_t ofs = 0; ofs < N_bytes; ofs += sizeof(chunk)) {
+    uint32_t len = min(N_bytes - ofs, (uint32_t)sizeof(chunk));
+    success &= _flash->read(addr + ofs, chunk, len);
+    crc_check = crc32(chunk, len, crc_check);
+  }
+  if (!success || (crc_check != crc)) {
+    tx.println("ERROR: Failed to write to the protocol library.");
+    return false;
+  }
+
+  if (idx < 0) {
+    idx = _dir.N_entries++;
+  }
+  Entry &entry = _dir.entries[idx];
+  memset(&entry, 0, sizeof(entry));
+  strncpy(entry.name, name, sizeof(entry.name) - 1);
+  entry.addr = addr;
+  entry.N_bytes = N_bytes;
+  entry.N_lines = program.size();
+  entry.format = LIB_FORMAT;
+  entry.crc = crc;
+  _dir.program_crcs[idx] =
+      protocol_mgr.is_program_crc_known() ? protocol_mgr.get_program_crc() : 0;
+  _dir.last = idx;
+
+  if (!write_directory()) {
+    tx.println("ERROR: Failed to write to the protocol library.");
+    return false;
+  }
+  return true;
+}
+
+bool ProtocolLibrary::load(const char *name, ProtocolManager &protocol_mgr) {
+  if (!_available) {
+    tx.println("ERROR: Protocol library not available.");
+    return false;
+  }
+
+  int16_t idx = find(name);
+  if (idx < 0) {
+    tx.println("ERROR: Protocol program not found in library.");
+    return false;
+  }
+
+  const Entry &entry = _dir.entries[idx];
+  Program &program = protocol_mgr.get_program();
+  if (program.is_embedded()) {
+    protocol_mgr.clear(); // The attached image is read-only
+  }
+  if ((entry.format != LIB_FORMAT) ||
+      (entry.N_bytes > program.get_max_image_bytes())) {
+    tx.println("ERROR: Protocol program got stored by an incompatible "
+               "firmware build.");
+    return false;
+  }
+
+  protocol_mgr.stop_timer();
+  if (!_flash->read(entry.addr, program.image(), entry.N_bytes) ||
+      (crc32(program.image(), entry.N_bytes) != entry.crc) ||
+      !program.restore(entry.N_lines, entry.N_bytes)) {
+    protocol_mgr.clear();
+    tx.println("ERROR: Protocol program in library is corrupt.");
+    return false;
+  }
+  protocol_mgr.set_name(entry.name);
+  protocol_mgr.program_replaced();
+  if (_dir.program_crcs[idx]) {
+    protocol_mgr.adopt_program_crc(_dir.program_crcs[idx]);
+  }
+
+  if (_dir.last != idx) {
+    _dir.last = idx;
+    write_directory();
+  }
+  return true;
+}
+
+bool ProtocolLibrary::play(const char *name, ProtocolManager &protocol_mgr) {
+#if PROTOCOL_COMPRESSED == COMPRESSION_DELTA
+  if (!_available) {
+    tx.println("ERROR: Protocol library not available.");
+    return false;
+  }
+
+  int16_t idx = find(name);
+  if (idx < 0) {
+    tx.println("ERROR: Protocol program not found in library.");
+    return false;
+  }
+
+  const Entry &entry = _dir.entries[idx];
+  if (entry.format != LIB_FORMAT) {
+    tx.println("ERROR: Protocol program got stored by an incompatible "
+               "firmware build.");
+    return false;
+  }
+
+  // Releases the reader when the active program plays from flash
+  protocol_mgr.clear();
+  if (_reader.is_open()) {
+    tx.println("ERROR: The staged protocol program plays from flash.");
+    return false;
+  }
+
+  if (!_reader.open(_flash, entry.addr, entry.N_lines, entry.N_bytes,
+                    entry.crc)) {
+    tx.println("ERROR: Protocol program in library is corrupt.");
+    return false;
+  }
+  protocol_mgr.attach_flash_program(entry.name, _reader);
+  if (_dir.program_crcs[idx]) {
+    protocol_mgr.adopt_program_crc(_dir.program_crcs[idx]);
+  }
+
+  if (_dir.last != idx) {
+    _dir.last = idx;
+    write_directory();
+  }
+  return true;
+#else
+  (void)name;
+  (void)protocol_mgr;
+  tx.println("ERROR: Playing from flash requires COMPRESSION_DELTA.");
+  return false;
+#endif
+}
+
+void ProtocolLibrary::print_reader() {
+#if PROTOCOL_COMPRESSED == COMPRESSION_DELTA
+  _reader.print(tx);
+#else
+  tx.println("ERROR: Playing from flash requires COMPRESSION_DELTA.");
+#endif
+}
+
+bool ProtocolLibrary::prefetch(const char *name,
+                               ProtocolManager &protocol_mgr) {
+  if (!_available) {
+    tx.println("ERROR: Protocol library not available.");
+    return false;
+  }
+  if (!ProtocolManager::has_staging_slot()) {
+    tx.println("ERROR: No staging slot to prefetch into.");
+    return false;
+  }
+
+  int16_t idx = find(name);
+  if (idx < 0) {
+    tx.println("ERROR: Protocol program not found in library.");
+    return false;
+  }
+
+  const Entry &entry = _dir.entries[idx];
+  protocol_mgr.open_staging();
+  Program &program = protocol_mgr.get_edit_program();
+  if ((entry.format != LIB_FORMAT) ||
+      (entry.N_bytes > program.get_max_image_bytes())) {
+    protocol_mgr.close_staging(false);
+    tx.println("ERROR: Protocol program got stored by an incompatible "
+               "firmware build.");
+    return false;
+  }
+
+  _pf_busy = true;
+  _pf_entry = entry;
+  _pf_ofs = 0;
+  _pf_crc = 0;
+  _pf_image = program.image();
+
+  // Leave the active program open to edits in the meantime
+  protocol_mgr.close_staging(false);
+  return true;
+}
+
+PrefetchStatus ProtocolLibrary::update_prefetch(ProtocolManager &protocol_mgr) {
+  if (!_pf_busy) {
+    return PREFETCH_IDLE;
+  }
+
+  const Entry &entry = _pf_entry;
+  uint32_t N = min(entry.N_bytes - _pf_ofs, LIB_PREFETCH_CHUNK);
+  if (N > 0) {
+    if (!_flash->read(entry.addr + _pf_ofs, _pf_image + _pf_ofs, N)) {
+      _pf_busy = false;
+      tx.println("ERROR: Failed to read the protocol library.");
+      return PREFETCH_FAILED;
+    }
+    _pf_crc = crc32(_pf_image + _pf_ofs, N, _pf_crc);
+    _pf_ofs += N;
+    return PREFETCH_BUSY;
+  }
+
+  // All read in
+  _pf_busy = false;
+  protocol_mgr.reopen_staging();
+  Program &program = protocol_mgr.get_edit_program();
+  if ((_pf_crc != entry.crc) ||
+      !program.restore(entry.N_lines, entry.N_bytes)) {
+    protocol_mgr.close_staging(false);
+    tx.println("ERROR: Protocol program in library is corrupt.");
+    return PREFETCH_FAILED;
+  }
+  protocol_mgr.set_name(entry.name);
+  protocol_mgr.edit_replaced();
+  protocol_mgr.close_staging(true);
+  return PREFETCH_DONE;
+}
+
+bool ProtocolLibrary::load_last(ProtocolManager &protocol_mgr) {
+  if (!_available || (_dir.N_entries == 0)) {
+    return false;
+  }
+  return load(_dir.entries[_dir.last].name, protocol_mgr);
+}
+
+uint32_t ProtocolLibrary::get_used_end() {
+  uint32_t used_end = LIB_DATA_START;
+  for (uint8_t idx = 0; idx < _dir.N_entries && _available; ++idx) {
+    const Entry &entry = _dir.entries[idx];
+    used_end = max(used_end, entry.addr + sector_ceil(entry.N_bytes));
+  }
+  return used_end;
+}
+
+const char *ProtocolLibrary::find_crc(uint32_t crc) {
+  if (!_available) {
+    return nullptr;
+  }
+  for (uint8_t idx = 0; idx < _dir.N_entries; ++idx) {
+    if ((_dir.entries[idx].crc == crc) &&
+        (_dir.entries[idx].format == LIB_FORMAT)) {
+      return _dir.entries[idx].name;
+    }
+  }
+  return nullptr;
+}
+
+const char *ProtocolLibrary::find_program_crc(uint32_t crc) {
+  if (!_available || (crc == 0)) {
+    return nullptr;
+  }
+  for (uint8_t idx = 0; idx < _dir.N_entries; ++idx) {
+    if ((_dir.program_crcs[idx] == crc) &&
+        (_dir.entries[idx].format == LIB_FORMAT)) {
+      return _dir.entries[idx].name;
+    }
+  }
+  return nullptr;
+}
+
+bool ProtocolLibrary::remove(const char *name) {
+  int16_t idx = find(name);
+  if (idx < 0) {
+    tx.println("ERROR: Protocol program not found in library.");
+    return false;
+  }
+  const Entry &entry = _dir.entries[idx];
+  if (reader_overlaps(entry.addr, sector_ceil(entry.N_bytes))) {
+    tx.println("ERROR: Protocol program plays from the library.");
+    return false;
+  }
+
+  for (uint8_t i = idx; i + 1 < _dir.N_entries; ++i) {
+    _dir.entries[i] = _dir.entries[i + 1];
+    _dir.program_crcs[i] = _dir.program_crcs[i + 1];
+  }
+  _dir.N_entries--;
+  if (_dir.last == idx) {
+    _dir.last = 0;
+  } else if (_dir.last > idx) {
+    _dir.last--;
+  }
+
+  return write_directory();
+}
+
+void ProtocolLibrary::format() {
+  if (!_available) {
+    return;
+  }
+  if (reader_overlaps(LIB_DATA_START, _end - LIB_DATA_START)) {
+    tx.println("ERROR: A protocol program plays from the library.");
+    return;
+  }
+
+  memset(&_dir.entries, 0, sizeof(_dir.entries));
+  memset(&_dir.program_crcs, 0, sizeof(_dir.program_crcs));
+  _dir.N_entries = 0;
+  _dir.last = 0;
+  write_directory();
+}
+
+void ProtocolLibrary::print_directory() {
+  if (!_available) {
+    tx.println("ERROR: Protocol library not available.");
+    return;
+  }
+
+  tx.println(_dir.N_entries);
+  for (uint8_t idx = 0; idx < _dir.N_entries; ++idx) {
+    const Entry &entry = _dir.entries[idx];
+    snprintf(buf, BUF_LEN, "%s\t%u\t%lu%s", entry.name, entry.N_lines,
+             (unsigned long)entry.N_bytes, (idx == _dir.last) ? "\t*" : "");
+    tx.println(buf);
+  }
+}
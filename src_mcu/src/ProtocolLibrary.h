@@ -0,0 +1,287 @@
+/**
+ * @file    ProtocolLibrary.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Persistent library of named protocol programs, stored inside the
+ * QSPI flash of the Feather M4.
+ *
+ * Each program is stored as the raw image of the `Program` class, guarded by a
+ * CRC32 checksum, such that loading it back is a plain copy instead of a full
+ * re-upload. The image format depends on the build flags `PROTOCOL_PACKING`,
+ * `PROTOCOL_COMPRESSED` and `PROTOCOL_CHECKPOINT_INTERVAL`. Programs stored
+ * under different build flags are refused when loading. With
+ * `COMPRESSION_DELTA`, a program can also play in place from flash without
+ * being loaded, see `play()`, lifting the limit of the memory of the program
+ * slot.
+ *
+ * @section Flash layout
+ * - Sectors 0 and 1: Two copies of the directory, written alternately. The
+ *   copy with the highest valid sequence number is in effect, which keeps the
+ *   library intact when power fails while writing the directory. The CRC32 of
+ *   the lines of each program, see `find_program_crc()`, trails the directory
+ *   under a checksum of its own. Hence, directories written by older firmware
+ *   remain valid, merely lacking these.
+ * - Sectors 2 and up: Program images, each starting on a sector boundary,
+ *   leaving the reserved bytes at the end of the flash alone, see `begin()`.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef PROTOCOL_LIBRARY_H_
+#define PROTOCOL_LIBRARY_H_
+
+#include "FlashProgram.h"
+#include "ProtocolManager.h"
+#include "QSPIFlash.h"
+#include "crc32.h"
+
+#include <Arduino.h>
+
+/**
+ * @brief Maximum number of programs the library can hold, limited by the
+ * directory having to fit inside a single flash sector.
+ */
+const uint8_t LIB_MAX_ENTRIES = 48;
+
+/**
+ * @brief Number of bytes read from flash per `update_prefetch()` call, bounding
+ * the time spent per main loop iteration while prefetching.
+ */
+const uint32_t LIB_PREFETCH_CHUNK = 4096;
+
+/**
+ * @brief Progress of a prefetch, see `ProtocolLibrary::update_prefetch()`.
+ */
+enum PrefetchStatus : uint8_t { PREFETCH_IDLE, PREFETCH_BUSY, PREFETCH_DONE,
+                                PREFETCH_FAILED };
+
+/*------------------------------------------------------------------------------
+  ProtocolLibrary
+------------------------------------------------------------------------------*/
+
+class ProtocolLibrary {
+public:
+  /**
+   * @brief Read in the directory from flash. An unformatted flash results in
+   * an empty library.
+   *
+   * @param N_reserved Bytes at the end of the flash to keep programs out of
+   *
+   * @return True when the flash is available. False otherwise.
+   */
+  bool begin(QSPIFlash *flash, uint32_t N_reserved = 0);
+
+  inline bool available() { return _available; }
+
+  /**
+   * @brief Store the protocol program currently in memory under its current
+   * name, replacing any program stored under the same name. Takes up to ~2 s
+   * for a full program.
+   *
+   * Errors are reported over serial. A program playing from flash, see
+   * `play()`, is stored already and gets refused.
+   *
+   * @return True when successful. False otherwise.
+   */
+  bool save(ProtocolManager &protocol_mgr);
+
+  /**
+   * @brief Load the program stored under @p name into memory and prime its
+   * start. Also marks it as the program to be loaded at start-up.
+   *
+   * Errors are reported over serial. On failure, the program in memory will
+   * be left empty when it had already been overwritten.
+   *
+   * @return True when successful. False otherwise.
+   */
+  bool load(const char *name, ProtocolManager &protocol_mgr);
+
+  /**
+   * @brief Play the program stored under @p name in place from flash, without
+   * loading it into memory, see `FlashProgram`. Hence, it may exceed the
+   * memory of the program slot. Reads the program once to verify it. Requires
+   * `COMPRESSION_DELTA` and the reader to be free, i.e. no program playing
+   * from flash left in the staging slot. The program stays protected from
+   * `remove()` and `format()` until replaced.
+   *
+   * Errors are reported over serial. On failure, the program in memory will
+   * be left empty when it had already been overwritten.
+   *
+   * @return True when successful. False otherwise.
+   */
+  bool play(const char *name, ProtocolManager &protocol_mgr);
+
+  /**
+   * @brief Continue reading ahead the program playing from flash, see
+   * `FlashProgram::update()`. To be called repeatedly from within the main
+   * loop.
+   */
+  inline void update_reader() {
+#if PROTOCOL_COMPRESSED == COMPRESSION_DELTA
+    _reader.update();
+#endif
+  }
+
+  /**
+   * @brief Print the state of the reader of the program playing from flash,
+   * see `FlashProgram::print()`.
+   */
+  void print_reader();
+
+  /**
+   * @brief Start loading the program stored under @p name into the staging
+   * slot of @p protocol_mgr in the background, chunk by chunk, see
+   * `update_prefetch()`. The active program continues playing undisturbed
+   * and stays the target of the edits meanwhile. Requires a staging slot, see
+   * `PROTOCOL_SLOTS`, which must be left alone until done.
+   *
+   * Errors are reported over serial.
+   *
+   * @return True when started. False otherwise.
+   */
+  bool prefetch(const char *name, ProtocolManager &protocol_mgr);
+
+  /**
+   * @brief Continue the prefetch, reading the next `LIB_PREFETCH_CHUNK` bytes.
+   * To be called repeatedly from within the main loop.
+   *
+   * @return `PREFETCH_DONE` once the program is staged and ready to be swapped
+   * in, see `ProtocolManager::swap()`, after which the status returns to
+   * `PREFETCH_IDLE`. `PREFETCH_FAILED` when the stored program is corrupt.
+   */
+  PrefetchStatus update_prefetch(ProtocolManager &protocol_mgr);
+
+  inline bool prefetch_busy() { return _pf_busy; }
+
+  /**
+   * @brief Abandon the prefetch in progress, if any.
+   */
+  inline void cancel_prefetch() { _pf_busy = false; }
+
+  /**
+   * @brief Load the program that got saved or loaded last.
+   *
+   * @return True when successful. False otherwise.
+   */
+  bool load_last(ProtocolManager &protocol_mgr);
+
+  /**
+   * @brief Return the name of the stored program whose image has CRC32
+   * checksum @p crc, or nullptr when not found.
+   */
+  const char *find_crc(uint32_t crc);
+
+  /**
+   * @brief Return the name of the stored program whose lines have CRC32
+   * checksum @p crc, see `ProtocolManager::get_program_crc()`, or nullptr
+   * when not found. Unlike the image checksum of `find_crc()`, the PC can
+   * compute it from the protocol file, to select a stored program by content
+   * instead of uploading it again.
+   */
+  const char *find_program_crc(uint32_t crc);
+
+  /**
+   * @brief Return the flash address past the last stored program image.
+   * Programs stored before the reserved bytes grew may reach into them.
+   */
+  uint32_t get_used_end();
+
+  /**
+   * @brief Remove the program stored under @p name from the library. Refused
+   * while it plays from flash, see `play()`.
+   *
+   * Errors are reported over serial.
+   *
+   * @return True when successful. False otherwise.
+   */
+  bool remove(const char *name);
+
+  /**
+   * @brief Remove all programs from the library. Refused while a program
+   * plays from flash, see `play()`.
+   *
+   * Errors are reported over serial.
+   */
+  void format();
+
+  /**
+   * @brief Print the directory, one program per line, tab delimited: Name,
+   * number of lines, number of bytes. The program that got saved or loaded
+   * last is marked with an asterisk.
+   */
+  void print_directory();
+
+private:
+  struct Entry {
+    char name[64];    // Name of the protocol program
+    uint32_t addr;    // Flash address of the program image
+    uint32_t N_bytes; // Size of the program image [bytes]
+    uint16_t N_lines; // Number of lines in the program
+    uint16_t format;  // Build flags the image was stored with
+    uint32_t crc;     // CRC32 of the program image
+  };
+
+  struct Directory {
+    uint32_t magic;
+    uint32_t seq;      // Sequence number, incremented on each write
+    uint8_t N_entries; // Number of programs in the library
+    uint8_t last;      // Index of the program saved or loaded last
+    uint16_t reserved;
+    Entry entries[LIB_MAX_ENTRIES];
+    uint32_t crc; // CRC32 of all of the above
+
+    // CRC32 of the lines of each program, 0 when unknown. Added later, hence
+    // outside of `crc`.
+    uint32_t program_crcs[LIB_MAX_ENTRIES];
+    uint32_t program_crcs_crc; // CRC32 of `program_crcs`
+  };
+
+  static_assert(sizeof(Directory) <= QSPIFlash::SECTOR_SIZE,
+                "Protocol library directory must fit inside a flash sector");
+
+  QSPIFlash *_flash = nullptr;
+  bool _available = false;
+  uint32_t _end = 0; // Flash address past the space for program images
+  Directory _dir;    // Copy of the directory in effect
+  uint8_t _dir_sec;  // Flash sector holding the directory in effect
+
+  // Prefetch into the staging slot, see `prefetch()`
+  bool _pf_busy = false; // Is a prefetch in progress?
+  Entry _pf_entry;       // Copy, as the directory might change meanwhile
+  uint32_t _pf_ofs = 0;  // Bytes read so far
+  uint32_t _pf_crc = 0;  // CRC32 of the bytes read so far
+  uint8_t *_pf_image;    // Raw storage of the staged program
+
+#if PROTOCOL_COMPRESSED == COMPRESSION_DELTA
+  FlashProgram _reader; // Reader of the program playing from flash
+#endif
+
+  /**
+   * @brief Is the reader open on a program image overlapping @p N_bytes bytes
+   * at flash address @p addr?
+   */
+  bool reader_overlaps(uint32_t addr, uint32_t N_bytes);
+
+  /**
+   * @brief Write the directory to the other directory sector, making it the
+   * one in effect.
+   */
+  bool write_directory();
+
+  /**
+   * @brief Return the index of the entry named @p name, or -1 when not found.
+   */
+  int16_t find(const char *name);
+
+  /**
+   * @brief Find free flash space for an image of @p N_bytes, not overlapping
+   * with any stored program.
+   *
+   * @return Flash address, or 0 when the library is full.
+   */
+  uint32_t allocate(uint32_t N_bytes);
+};
+
+#endif
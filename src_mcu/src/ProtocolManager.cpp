@@ -2,11 +2,16 @@
  * @file    ProtocolManager.cpp
  * @author  Dennis van Gils (vangils.dennis@gmail.com)
  * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
- * @date    14-04-2023
+ * @date    15-10-2026
  * @copyright MIT License. See the LICENSE file for details.
  */
 
 #include "ProtocolManager.h"
+#include "FlashProgram.h"
+#include "Perf.h"
+#include "Telemetry.h"
+#include "TxQueue.h"
+#include "crc32.h"
 #include "halt.h"
 #include "translations.h"
 
@@ -14,9 +19,31 @@
   P "Point in the Protocol Coordinate System (PCS)"
 ------------------------------------------------------------------------------*/
 
-void P::print() {
+void P::print() const {
   snprintf(buf, BUF_LEN, "(%d, %d)", x, y);
-  Serial.print(buf);
+  tx.print(buf);
+}
+
+/*------------------------------------------------------------------------------
+  Line duration
+------------------------------------------------------------------------------*/
+
+uint16_t encode_duration_us(uint32_t duration_us) {
+  if ((duration_us % 1000 == 0) &&
+      (duration_us / 1000 <= DURATION_MANTISSA_MASK)) {
+    return duration_us / 1000; // Unit 0, see `DURATION_UNIT_SHIFT`
+  }
+
+  // From the finest unit to the coarsest
+  const uint8_t units[] = {1, 0, 2, 3};
+  for (uint8_t unit : units) {
+    uint32_t tick_us = DURATION_UNIT_US[unit];
+    uint32_t mantissa = (duration_us + tick_us / 2) / tick_us;
+    if (mantissa <= DURATION_MANTISSA_MASK) {
+      return unit << DURATION_UNIT_SHIFT | mantissa;
+    }
+  }
+  return 3 << DURATION_UNIT_SHIFT | DURATION_MANTISSA_MASK; // Saturate
 }
 
 /*------------------------------------------------------------------------------
@@ -24,36 +51,48 @@ void P::print() {
 ------------------------------------------------------------------------------*/
 
 void Line::pack_into(PackedLine &output) const {
-  // Pack array of PCS points into bitmasks
-  for (auto p = points.begin(); p != points.end(); ++p) {
-    if (p->is_null()) {
-      break; // Reached the end sentinel
-    }
+  output.duration = duration;
+  output.masks.fill(0);
 
-    int8_t tmp_x = p->x - PCS_X_MIN;
-    int8_t tmp_y = PCS_Y_MAX - p->y;
-    if ((tmp_x < 0) || (tmp_x >= NUMEL_PCS_AXIS) || //
-        (tmp_y < 0) || (tmp_y >= NUMEL_PCS_AXIS)) {
-      snprintf(buf, BUF_LEN, "CRITICAL: Out-of-bounds index (%d, %d)", p->x,
-               p->y);
-      halt(2, buf);
-    }
-    output.masks[tmp_y] |= (1U << tmp_x);
-    output.duration = duration;
+  // The validity of each PCS point gets checked only here, once on entry.
+  // Afterwards, the fused look-up tables can be indexed unchecked.
+  for (const P *p = begin(); p != end(); ++p) {
+    const ValveAddress &addr = p2addr(*p); // Halts when there is no valve
+#if PROTOCOL_PACKING == PACKING_CP_MASKS
+    // Translate into Centipede port bitmasks
+    output.masks[addr.cp_port] |= (1U << addr.cp_bit);
+#elif PROTOCOL_PACKING == PACKING_VALVE_BITS
+    // Translate into the valve bitset
+    output.masks[(addr.valve - 1) >> 4] |= (1U << ((addr.valve - 1) & 0xF));
+#else
+    // Pack into PCS row bitmasks
+    output.masks[PCS_Y_MAX - p->y] |= (1U << (p->x - PCS_X_MIN));
+#endif
   }
+  output.set_marked(marked);
 }
 
-void Line::print() {
-  snprintf(buf, BUF_LEN, "%d ms\n", duration);
-  Serial.print(buf);
+void Line::unpack_points(const uint8_t *bytes, uint16_t N_bytes) {
+  N_points = min(N_bytes, MAX_POINTS_PER_LINE);
+  marked = false; // The points format can't carry the marker
+  for (uint16_t idx_P = 0; idx_P < N_points; ++idx_P) {
+    points[idx_P].unpack_byte(bytes[idx_P]);
+  }
+}
 
-  for (auto &p : points) {
-    if (p.is_null()) {
-      break; // Reached the end sentinel
-    }
+void Line::print() const {
+  uint32_t duration_us = decode_duration_us(duration);
+  if (duration_us % 1000) {
+    snprintf(buf, BUF_LEN, "%lu us\n", (unsigned long)duration_us);
+  } else {
+    snprintf(buf, BUF_LEN, "%lu ms\n", (unsigned long)(duration_us / 1000));
+  }
+  tx.print(buf);
+
+  for (const P &p : *this) {
     p.print();
   }
-  Serial.write('\n');
+  tx.write('\n');
 }
 
 /*------------------------------------------------------------------------------
@@ -62,170 +101,2923 @@ void Line::print() {
 
 void PackedLine::unpack_into(Line &output) const {
   uint16_t idx_P = 0; // Index of newly unpacked point
-  P p;                // Unpacked point
 
-  // Unpack array of PCS points from bitmasks
-  for (uint8_t row = 0; row < NUMEL_PCS_AXIS; ++row) {
-    if (masks[row]) {
-      // There is a mask > 0, so there must be at least one PCS point to unpack
-      p.y = PCS_Y_MAX - row;
-      for (uint8_t bit = 0; bit < NUMEL_PCS_AXIS; ++bit) {
-        if ((masks[row] >> (bit)) & 0x01) {
-          p.x = PCS_X_MIN + bit;
-          output.points[idx_P] = p;
-          idx_P++;
-        }
+  // Only the set bits get visited, lowest first, by counting trailing zeros.
+  // Hence, unpacking takes time proportional to the number of open valves.
+  // The bitmasks hold valid valves only, as they got checked when packing.
+  // Hence, the look-up tables can be indexed unchecked.
+  for (uint8_t word = 0; word < masks.size(); ++word) {
+    uint16_t bits = masks[word];
+    while (bits) {
+      uint8_t bit = __builtin_ctz(bits);
+      bits &= bits - 1; // Clear lowest set bit
+
+#if PROTOCOL_PACKING == PACKING_CP_MASKS
+      // Centipede port bitmasks. Unwired bits hold no valve.
+      uint8_t valve = CP2VALVE[word][bit];
+      if (valve == 0) {
+        continue;
+      }
+      output.points[idx_P].set(VALVE2P[valve][0], VALVE2P[valve][1]);
+#elif PROTOCOL_PACKING == PACKING_VALVE_BITS
+      // Valve bitset
+      uint8_t valve = (word << 4) + bit + 1;
+      output.points[idx_P].set(VALVE2P[valve][0], VALVE2P[valve][1]);
+#else
+      // PCS row bitmasks. Bits beyond the PCS hold the marker, not a valve.
+      if (bit >= NUMEL_PCS_AXIS) {
+        continue;
       }
+      output.points[idx_P].set(PCS_X_MIN + bit, PCS_Y_MAX - word);
+#endif
+      idx_P++;
     }
   }
-  output.points[idx_P].set_null(); // Add end sentinel
+
+  output.N_points = idx_P;
   output.duration = duration;
+  output.marked = is_marked();
+}
+
+void PackedLine::pack_pcs_rows(const PCS_Rows &rows) {
+  // Check each row at once. Columns beyond the PCS hold no valve either,
+  // except for the line marker.
+  for (uint8_t row = 0; row < NUMEL_PCS_AXIS; ++row) {
+    Grid::row_t stray = rows[row] & ~PCS_ROW_VALVES[row];
+    if (row == 0) {
+      stray &= ~PCS_ROW_MARKER;
+    }
+    if (stray) {
+      snprintf(buf, BUF_LEN,
+               "CRITICAL: No valve exists at PCS point (%d, %d)",
+               __builtin_ctz(stray) + PCS_X_MIN, PCS_Y_MAX - row);
+      halt(5, buf);
+    }
+  }
+
+#if PROTOCOL_PACKING == PACKING_CP_MASKS
+  pcs_rows2cp_masks(rows, masks); // Ignores the columns beyond the PCS
+  set_marked(rows[0] & PCS_ROW_MARKER);
+#elif PROTOCOL_PACKING == PACKING_VALVE_BITS
+  CP_Masks cp_masks;
+  pcs_rows2cp_masks(rows, cp_masks);
+  pack_valves(ValveSet::from_cp_masks(cp_masks));
+#else
+  masks = rows;
+#endif
+}
+
+void PackedLine::get_cp_masks(CP_Masks &output) const {
+#if PROTOCOL_PACKING == PACKING_CP_MASKS
+  output = masks;
+  output[LINE_MARKER_WORD] &= ~LINE_MARKER_MASK; // Not to be sent
+
+#elif PROTOCOL_PACKING == PACKING_VALVE_BITS
+  output.fill(0);
+  for (uint8_t word = 0; word < masks.size(); ++word) {
+    uint16_t bits = masks[word];
+    while (bits) {
+      uint8_t bit = __builtin_ctz(bits);
+      bits &= bits - 1; // Clear lowest set bit
+      const ValveAddress &addr = VALVE2ADDR[(word << 4) + bit];
+      output[addr.cp_port] |= (1U << addr.cp_bit);
+    }
+  }
+
+#else
+  pcs_rows2cp_masks(masks, output);
+#endif
+}
+
+void PackedLine::pack_valves(const ValveSet &valves) {
+#if PROTOCOL_PACKING == PACKING_CP_MASKS
+  masks = valves.to_cp_masks();
+
+#elif PROTOCOL_PACKING == PACKING_VALVE_BITS
+  // Same bit order, merely split into 16-bit words
+  const ValveSet::Words &words = valves.words();
+  for (uint8_t word = 0; word < masks.size(); ++word) {
+    masks[word] = words[word >> 1] >> ((word & 1) << 4);
+  }
+
+#else
+  masks.fill(0);
+  valves.for_each([this](uint8_t valve) {
+    masks[PCS_Y_MAX - VALVE2P[valve][1]] |=
+        (1U << (VALVE2P[valve][0] - PCS_X_MIN));
+  });
+#endif
 }
 
 /*------------------------------------------------------------------------------
-  ProtocolManager
+  Program
 ------------------------------------------------------------------------------*/
 
-ProtocolManager::ProtocolManager(CentipedeManager *cp_mgr) {
-  _cp_mgr = cp_mgr;
-  clear();
+#if PROTOCOL_COMPRESSED == COMPRESSION_DELTA
+// Record layout inside the byte pool:
+//   1 byte : Control byte
+//            bit 7   : A new duration follows
+//            bit 6-0 : Number of repeats of this line, i.e. run length - 1
+//   1 byte : Bitmap of the Centipede ports whose bitmask changed
+//  [2 bytes: Duration [ms], little-endian, only when bit 7 is set]
+//   N x 2 bytes: XOR-delta of each changed port bitmask, little-endian
+// A keyframe record is encoded against all valves closed and always carries
+// the duration.
+const uint8_t REC_HAS_DURATION = 0x80;
+const uint8_t REC_MAX_REPEATS = 0x7F;
+
+void Program::use_storage(uint8_t *pool, uint32_t N_bytes) {
+  _pool = pool;
+  _pool_bytes = pool ? N_bytes : 0;
+  reset();
 }
 
-void ProtocolManager::clear() {
-  for (auto packed_line = _program.begin(); packed_line != _program.end();
-       ++packed_line) {
-    packed_line->duration = 0;
-    packed_line->masks.fill(0);
-  }
-  set_name("cleared");
+void Program::reset() {
+  _N_bytes = 0;
   _N_lines = 0;
-  _pos = 0;
+  _dec_valid = false;
 }
 
-bool ProtocolManager::add_line(const Line &line) {
-  if (_N_lines == PROTOCOL_MAX_LINES) {
+bool Program::append(const PackedLine &line) {
+  if (_embedded || (_N_lines == PROTOCOL_MAX_LINES)) {
     return false;
   }
 
-  line.pack_into(_program[_N_lines]);
+  bool keyframe = (_N_lines % PROTOCOL_CHECKPOINT_INTERVAL == 0);
+  _dec_valid = false; // The open run might change
+
+  if (!keyframe && (line.duration == _enc_line.duration) &&
+      (line.masks == _enc_line.masks) &&
+      ((_pool[_enc_ofs] & REC_MAX_REPEATS) < REC_MAX_REPEATS)) {
+    // Identical to the previous line: Extend the run
+    _pool[_enc_ofs]++;
+    _N_lines++;
+    return true;
+  }
+
+  if (keyframe) {
+    _enc_line.masks.fill(0);
+  }
+
+  // Determine the record size
+  bool has_duration = keyframe || (line.duration != _enc_line.duration);
+  uint8_t portmap = 0;
+  uint32_t rec_len = 2 + (has_duration ? 2 : 0);
+  for (uint8_t port = 0; port < N_CP_PORTS; ++port) {
+    if (line.masks[port] != _enc_line.masks[port]) {
+      portmap |= (1U << port);
+      rec_len += 2;
+    }
+  }
+
+  if (_N_bytes + rec_len > _pool_bytes) {
+    return false; // Pool is full
+  }
+
+  // Write the record
+  uint8_t *rec = &_pool[_N_bytes];
+  *rec++ = has_duration ? REC_HAS_DURATION : 0;
+  *rec++ = portmap;
+  if (has_duration) {
+    *rec++ = line.duration & 0xFF;
+    *rec++ = line.duration >> 8;
+  }
+  for (uint8_t port = 0; port < N_CP_PORTS; ++port) {
+    if ((portmap >> port) & 0x01) {
+      uint16_t delta = line.masks[port] ^ _enc_line.masks[port];
+      *rec++ = delta & 0xFF;
+      *rec++ = delta >> 8;
+    }
+  }
+
+  if (keyframe) {
+    _checkpoints[_N_lines / PROTOCOL_CHECKPOINT_INTERVAL] = _N_bytes;
+  }
+  _enc_ofs = _N_bytes;
+  _N_bytes += rec_len;
+  _enc_line = line;
   _N_lines++;
+
   return true;
 }
 
-bool ProtocolManager::add_line(const uint16_t duration,
-                               const PointsArray &points) {
-  Line line(duration, points);
-  return add_line(line);
+const uint8_t *Program::decode_record(const uint8_t *rec, PackedLine &line,
+                                      uint8_t &run) {
+  uint8_t ctrl = *rec++;
+  uint8_t portmap = *rec++;
+
+  if (ctrl & REC_HAS_DURATION) {
+    line.duration = rec[0] | (uint16_t)rec[1] << 8;
+    rec += 2;
+  }
+  for (uint8_t port = 0; port < N_CP_PORTS; ++port) {
+    if ((portmap >> port) & 0x01) {
+      line.masks[port] ^= rec[0] | (uint16_t)rec[1] << 8;
+      rec += 2;
+    }
+  }
+
+  run = ctrl & REC_MAX_REPEATS;
+  return rec;
 }
 
-void ProtocolManager::prime_start() {
-  _last_activated_line.duration = 0; // [ms]
-  if (_N_lines > 0) {
-    _pos = _N_lines - 1;
-  } else {
-    _pos = 0;
+void Program::step() {
+  _dec_idx++;
+
+  if (_dec_run > 0) {
+    // Repeat of the same line
+    _dec_run--;
+    return;
+  }
+
+  // Decode the next record
+  if (_dec_idx % PROTOCOL_CHECKPOINT_INTERVAL == 0) {
+    _dec_line.masks.fill(0); // Keyframe
   }
+  _dec_ofs = decode_record(&_pool[_dec_ofs], _dec_line, _dec_run) - _pool;
 }
 
-void ProtocolManager::goto_line(uint16_t line_no) {
-  if (_N_lines > 0) {
-    _pos = min(line_no, _N_lines - 1);
-    _program[_pos].unpack_into(_line_buffer);
+void Program::get(uint16_t idx, PackedLine &output) {
+  if (idx >= _N_lines) {
+    snprintf(buf, BUF_LEN,
+             "CRITICAL: Out-of-bounds line number %d in `Program::get()`", idx);
+    halt(13, buf);
   }
-  activate_buffer();
+
+  if (_flash) {
+    _flash->get(idx, output);
+    return;
+  }
+
+  if (!_dec_valid || (idx < _dec_idx) ||
+      (idx / PROTOCOL_CHECKPOINT_INTERVAL !=
+       _dec_idx / PROTOCOL_CHECKPOINT_INTERVAL)) {
+    // Seek to the keyframe at or before the requested line
+    uint16_t checkpoint = idx / PROTOCOL_CHECKPOINT_INTERVAL;
+    _dec_ofs = _checkpoints[checkpoint];
+    _dec_idx = checkpoint * PROTOCOL_CHECKPOINT_INTERVAL - 1; // May wrap
+    _dec_run = 0;
+    _dec_valid = true;
+  }
+
+  // Decode forward until the requested line
+  while (_dec_idx != idx) {
+    step();
+  }
+
+  output = _dec_line;
 }
 
-void ProtocolManager::goto_next_line() {
-  if (_N_lines > 0) {
-    if (_pos == _N_lines - 1) {
-      _pos = 0;
-    } else {
-      _pos++;
-    }
-    goto_line(_pos);
+uint16_t Program::get_duration(uint16_t idx) {
+  // The durations are interleaved with the deltas, hence decode the line
+  PackedLine line;
+  get(idx, line);
+  return line.duration;
+}
+
+uint8_t *Program::image() { return _pool; }
+
+uint32_t Program::get_N_image_bytes() const { return _N_bytes; }
+
+uint8_t *Program::spare(uint32_t &N_bytes) {
+  if (_embedded) {
+    N_bytes = _own_bytes & ~3UL; // All of the own storage is unused
+    return _own_pool;
   }
+  uint32_t ofs = (_N_bytes + 3) & ~3UL;
+  N_bytes = (ofs < _pool_bytes) ? _pool_bytes - ofs : 0;
+  return _pool + ofs;
 }
 
-void ProtocolManager::goto_prev_line() {
-  if (_N_lines > 0) {
-    if (_pos == 0) {
-      _pos = _N_lines - 1;
-    } else {
-      _pos--;
+bool Program::restore(uint16_t N_lines, uint32_t N_bytes) {
+  reset();
+  if ((N_lines > PROTOCOL_MAX_LINES) || (N_bytes > _pool_bytes)) {
+    return false;
+  }
+
+  // Walk over all records to rebuild the keyframe offsets and encoder state
+  _dec_idx = 0xFFFF; // Such that the first step lands on line 0
+  _dec_ofs = 0;
+  _dec_run = 0;
+  _enc_ofs = 0;
+  for (uint16_t idx = 0; idx < N_lines; ++idx) {
+    bool keyframe = (idx % PROTOCOL_CHECKPOINT_INTERVAL == 0);
+    if (_dec_run == 0) {
+      if (_dec_ofs >= N_bytes) {
+        return false; // Records exhausted before all lines were found
+      }
+      if (keyframe) {
+        _checkpoints[idx / PROTOCOL_CHECKPOINT_INTERVAL] = _dec_ofs;
+      }
+      _enc_ofs = _dec_ofs;
+    } else if (keyframe) {
+      return false; // Runs never extend across a keyframe
     }
-    goto_line(_pos);
+    step();
   }
+
+  if ((_dec_ofs != N_bytes) || (_dec_run != 0)) {
+    return false;
+  }
+
+  _enc_line = _dec_line;
+  _dec_valid = (N_lines > 0); // Cursor is left at the last line
+  _N_bytes = N_bytes;
+  _N_lines = N_lines;
+  return true;
 }
 
-void ProtocolManager::activate_buffer() {
-  _tick = millis();
+void Program::attach_flash(FlashProgram &reader) {
+  clear();
+  use_storage(nullptr, 0);
+  _embedded = true;
+  _flash = &reader;
+  _N_lines = reader.size();
+}
+
+#elif PROTOCOL_COMPRESSED == COMPRESSION_DICT
+
+std::array<uint16_t, PROTOCOL_DICT_BUCKETS> Program::_buckets;
+const Program *Program::_buckets_owner = nullptr;
+
+void Program::use_storage(uint8_t *pool, uint32_t N_bytes) {
+  _pool = pool;
+  _pool_bytes = pool ? N_bytes & ~3UL : 0; // Keeps the dictionary aligned
+  reset();
+}
 
-  // Recolor the LEDs of previously active valves from red to blue
-  for (auto &p : _last_activated_line.points) {
-    if (p.is_null()) {
-      break; // Reached the end sentinel
+void Program::reset() {
+  _dict_end = _pool_bytes;
+  _N_lines = 0;
+  _N_patterns = 0;
+  if (_buckets_owner == this) {
+    _buckets_owner = nullptr; // Stale
+  }
+}
+
+uint16_t Program::find_bucket(const CP_Masks &masks) {
+  uint32_t hash = 0;
+  for (uint16_t mask : masks) {
+    hash = (hash ^ mask) * 0x9E3779B1UL;
+  }
+
+  // Linear probing. The table is never more than half full, so an empty
+  // bucket always exists.
+  uint16_t bucket = (hash >> 16) & (PROTOCOL_DICT_BUCKETS - 1);
+  while (_buckets[bucket] && (*pattern(_buckets[bucket] - 1) != masks)) {
+    bucket = (bucket + 1) & (PROTOCOL_DICT_BUCKETS - 1);
+  }
+  return bucket;
+}
+
+void Program::move_dictionary(uint32_t dict_end) {
+  if (dict_end != _dict_end) {
+    uint32_t len = _N_patterns * sizeof(CP_Masks);
+    memmove(_pool + dict_end - len, _pool + _dict_end - len, len);
+    _dict_end = dict_end;
+  }
+}
+
+bool Program::append(const PackedLine &line) {
+  if (_embedded || (_N_lines == PROTOCOL_MAX_LINES)) {
+    return false;
+  }
+
+  move_dictionary(_pool_bytes);
+  if (_buckets_owner != this) {
+    // Rebuild the hash table from the dictionary
+    _buckets.fill(0);
+    for (uint16_t idx = 0; idx < _N_patterns; ++idx) {
+      _buckets[find_bucket(*pattern(idx))] = idx + 1;
+    }
+    _buckets_owner = this;
+  }
+
+  uint16_t bucket = find_bucket(line.masks);
+  uint32_t N_bytes = get_N_bytes() + sizeof(DictLine);
+  if (_buckets[bucket] == 0) {
+    // New pattern
+    if ((_N_patterns == PROTOCOL_DICT_PATTERNS) ||
+        (N_bytes + sizeof(CP_Masks) > _pool_bytes)) {
+      return false; // Dictionary or pool is full
     }
-    leds[p2led(p)] = CRGB(0, 0, 128);
+    *pattern(_N_patterns) = line.masks;
+    _buckets[bucket] = ++_N_patterns;
+  } else if (N_bytes > _pool_bytes) {
+    return false; // Pool is full
+  }
+
+  lines()[_N_lines] = {line.duration, (uint16_t)(_buckets[bucket] - 1)};
+  _N_lines++;
+  return true;
+}
+
+void Program::get(uint16_t idx, PackedLine &output) {
+  if (idx >= _N_lines) {
+    snprintf(buf, BUF_LEN,
+             "CRITICAL: Out-of-bounds line number %d in `Program::get()`", idx);
+    halt(13, buf);
+  }
+
+  const DictLine &line = lines()[idx];
+  output.duration = line.duration;
+  output.masks = *pattern(line.pattern);
+}
+
+uint16_t Program::get_duration(uint16_t idx) {
+  if (idx >= _N_lines) {
+    snprintf(buf, BUF_LEN,
+             "CRITICAL: Out-of-bounds line number %d in "
+             "`Program::get_duration()`",
+             idx);
+    halt(13, buf);
+  }
+
+  return lines()[idx].duration;
+}
+
+uint8_t *Program::image() {
+  move_dictionary(get_N_bytes());
+  return _pool;
+}
+
+uint32_t Program::get_N_image_bytes() const { return get_N_bytes(); }
+
+uint8_t *Program::spare(uint32_t &N_bytes) {
+  if (_embedded) {
+    N_bytes = _own_bytes & ~3UL; // All of the own storage is unused
+    return _own_pool;
   }
+  // The lines end 4-byte aligned
+  move_dictionary(_pool_bytes);
+  N_bytes = _pool_bytes - get_N_bytes();
+  return _pool + _N_lines * sizeof(DictLine);
+}
 
-  // Backup the current line buffer
-  _last_activated_line.duration = _line_buffer.duration;
-  _last_activated_line.points = _line_buffer.points;
+bool Program::restore(uint16_t N_lines, uint32_t N_bytes) {
+  // The image holds the lines followed by the dictionary, see `image()`
+  reset();
+  uint32_t N_line_bytes = N_lines * sizeof(DictLine);
+  if ((N_lines > PROTOCOL_MAX_LINES) || (N_bytes > _pool_bytes) ||
+      (N_bytes < N_line_bytes) ||
+      ((N_bytes - N_line_bytes) % sizeof(CP_Masks) != 0) ||
+      ((N_bytes - N_line_bytes) / sizeof(CP_Masks) > PROTOCOL_DICT_PATTERNS)) {
+    return false;
+  }
 
-  // Parse the line
-  _cp_mgr->clear_masks();
-  for (auto &p : _line_buffer.points) {
-    if (p.is_null()) {
-      break; // Reached the end sentinel
+  uint16_t N_patterns = (N_bytes - N_line_bytes) / sizeof(CP_Masks);
+  for (uint16_t idx = 0; idx < N_lines; ++idx) {
+    if (lines()[idx].pattern >= N_patterns) {
+      return false;
     }
+  }
+
+  _dict_end = N_bytes;
+  _N_lines = N_lines;
+  _N_patterns = N_patterns;
+  return true;
+}
+
+#elif PROTOCOL_COMPRESSED == COMPRESSION_FRAMES
+
+void Program::use_storage(uint8_t *pool, uint32_t N_bytes) {
+  _pool = pool;
+  _pool_bytes = pool ? N_bytes : 0;
+  _max_lines = (_pool_bytes > PROTOCOL_FRAME_HEADER_BYTES)
+                   ? min((_pool_bytes - PROTOCOL_FRAME_HEADER_BYTES) /
+                             PROTOCOL_FRAME_BYTES,
+                         (uint32_t)PROTOCOL_MAX_LINES)
+                   : 0;
+  reset();
+}
 
-    // Add valve to be opened to the Centipede masks
-    _cp_mgr->add_to_masks(valve2cp(p2valve(p)));
+void Program::reset() {
+  // Stale frames never get read and each appended frame gets written in full
+  _N_lines = 0;
+  _tick = 0;
+}
 
-    // Color all active valve LEDs in red
-    leds[p2led(p)] = CRGB::Red;
+bool Program::append(const PackedLine &line) {
+  if (_embedded || (_N_lines == _max_lines)) {
+    return false;
   }
 
-  if (!NO_PERIPHERALS) {
-    _cp_mgr->send_masks(); // Activate the valves
+  if (_N_lines == 0) {
+    _tick = line.duration;
+    _pool[0] = _tick & 0xFF;
+    _pool[1] = _tick >> 8;
+    _pool[2] = 0;
+    _pool[3] = 0;
+  } else if (line.duration != _tick) {
+    return false; // Not a constant-rate protocol
   }
 
-  if (DEBUG) {
-    print_buffer();
+  ValveSet::from_cp_masks(line.masks)
+      .pack_bytes(frame(_N_lines), PROTOCOL_FRAME_BYTES);
+  _N_lines++;
+  return true;
+}
+
+void Program::get(uint16_t idx, PackedLine &output) {
+  if (idx >= _N_lines) {
+    snprintf(buf, BUF_LEN,
+             "CRITICAL: Out-of-bounds line number %d in `Program::get()`", idx);
+    halt(13, buf);
   }
+
+  ValveSet valves;
+  valves.unpack_bytes(frame(idx), PROTOCOL_FRAME_BYTES);
+  output.duration = _tick;
+  output.pack_valves(valves);
 }
 
-void ProtocolManager::update() {
-  if (millis() - _tick >= _last_activated_line.duration) {
-    goto_next_line();
+uint16_t Program::get_duration(uint16_t idx) {
+  if (idx >= _N_lines) {
+    snprintf(buf, BUF_LEN,
+             "CRITICAL: Out-of-bounds line number %d in "
+             "`Program::get_duration()`",
+             idx);
+    halt(13, buf);
   }
+
+  return _tick;
 }
 
-void ProtocolManager::print_program() {
-  Serial.print(_name);
-  Serial.write('\t');
-  Serial.println(_N_lines);
+uint8_t *Program::image() { return _pool; }
+
+uint32_t Program::get_N_image_bytes() const {
+  return _N_lines ? PROTOCOL_FRAME_HEADER_BYTES +
+                        (uint32_t)_N_lines * PROTOCOL_FRAME_BYTES
+                  : 0;
 }
 
-void ProtocolManager::print_full_program() {
-  Serial.print(_name);
-  Serial.write('\t');
-  Serial.println(_N_lines);
+uint8_t *Program::spare(uint32_t &N_bytes) {
+  if (_embedded) {
+    N_bytes = _own_bytes & ~3UL; // All of the own storage is unused
+    return _own_pool;
+  }
+  uint32_t ofs = (get_N_image_bytes() + 3) & ~3UL;
+  N_bytes = (ofs < _pool_bytes) ? _pool_bytes - ofs : 0;
+  return _pool + ofs;
+}
 
-  Line line;
-  Serial.write('\n');
-  for (uint16_t i = 0; i < _N_lines; ++i) {
-    snprintf(buf, BUF_LEN, "#%d\t", i);
-    Serial.print(buf);
-    _program[i].unpack_into(line);
-    line.print();
+bool Program::restore(uint16_t N_lines, uint32_t N_bytes) {
+  reset();
+  uint32_t N_expected =
+      N_lines ? PROTOCOL_FRAME_HEADER_BYTES +
+                    (uint32_t)N_lines * PROTOCOL_FRAME_BYTES
+              : 0;
+  if ((N_lines > _max_lines) || (N_bytes != N_expected)) {
+    return false;
+  }
+
+  if (N_lines) {
+    _tick = _pool[0] | (uint16_t)_pool[1] << 8;
   }
-  Serial.write('\n');
+  _N_lines = N_lines;
+  return true;
 }
 
-void ProtocolManager::print_buffer() {
-  snprintf(buf, BUF_LEN, "#%d\t", _pos);
-  Serial.print(buf);
-  _line_buffer.print();
-  Serial.write('\n');
-}
\ No newline at end of file
+#elif PROTOCOL_SOA
+
+void Program::use_storage(uint8_t *pool, uint32_t N_bytes) {
+  _pool = pool;
+  _max_lines = pool ? min(N_bytes / (sizeof(uint16_t) + sizeof(Masks)),
+                          (uint32_t)PROTOCOL_MAX_LINES)
+                    : 0;
+  while (masks_offset(_max_lines) + _max_lines * sizeof(Masks) > N_bytes) {
+    _max_lines--; // Lost to the alignment of the bitmasks
+  }
+  _pool_bytes = masks_offset(_max_lines) + _max_lines * sizeof(Masks);
+  reset();
+}
+
+void Program::reset() {
+  // Lines at and beyond `_N_lines` never get read and each newly appended line
+  // gets written in full. Hence, the stale lines can be left as is.
+  _N_lines = 0;
+  _masks = (Masks *)(_pool + masks_offset(_max_lines));
+}
+
+void Program::move_masks(uint32_t ofs) {
+  Masks *masks = (Masks *)(_pool + ofs);
+  if (masks != _masks) {
+    memmove(masks, _masks, _N_lines * sizeof(Masks));
+    _masks = masks;
+  }
+}
+
+bool Program::append(const PackedLine &line) {
+  if (_embedded || (_N_lines == _max_lines)) {
+    return false;
+  }
+
+  move_masks(masks_offset(_max_lines));
+  durations()[_N_lines] = line.duration;
+  _masks[_N_lines] = line.masks;
+  _N_lines++;
+  return true;
+}
+
+void Program::get(uint16_t idx, PackedLine &output) {
+  if (idx >= _N_lines) {
+    snprintf(buf, BUF_LEN,
+             "CRITICAL: Out-of-bounds line number %d in `Program::get()`", idx);
+    halt(13, buf);
+  }
+
+  output.duration = durations()[idx];
+  output.masks = _masks[idx];
+}
+
+uint16_t Program::get_duration(uint16_t idx) {
+  if (idx >= _N_lines) {
+    snprintf(buf, BUF_LEN,
+             "CRITICAL: Out-of-bounds line number %d in "
+             "`Program::get_duration()`",
+             idx);
+    halt(13, buf);
+  }
+
+  return durations()[idx];
+}
+
+uint8_t *Program::image() {
+  move_masks(masks_offset(_N_lines));
+  return _pool;
+}
+
+uint32_t Program::get_N_image_bytes() const {
+  return _N_lines ? masks_offset(_N_lines) + _N_lines * sizeof(Masks) : 0;
+}
+
+uint8_t *Program::spare(uint32_t &N_bytes) {
+  if (_embedded) {
+    N_bytes = _own_bytes & ~3UL; // All of the own storage is unused
+    return _own_pool;
+  }
+  // The bitmasks end 2-byte aligned, wherever they are
+  uintptr_t begin = (uintptr_t)(_masks + _N_lines);
+  uintptr_t end = (uintptr_t)(_pool + _pool_bytes);
+  uintptr_t ofs = (begin + 3) & ~(uintptr_t)3;
+  N_bytes = (ofs < end) ? end - ofs : 0;
+  return (uint8_t *)ofs;
+}
+
+bool Program::restore(uint16_t N_lines, uint32_t N_bytes) {
+  // The image holds the durations followed by the bitmasks, see `image()`
+  reset();
+  if ((N_lines > _max_lines) ||
+      (N_bytes != (N_lines ? masks_offset(N_lines) + N_lines * sizeof(Masks)
+                           : 0))) {
+    return false;
+  }
+
+  _N_lines = N_lines;
+  _masks = (Masks *)(_pool + masks_offset(N_lines));
+  return true;
+}
+
+#else
+
+void Program::use_storage(uint8_t *pool, uint32_t N_bytes) {
+  _lines = (PackedLine *)pool;
+  _max_lines = pool ? min(N_bytes / sizeof(PackedLine),
+                          (uint32_t)PROTOCOL_MAX_LINES)
+                    : 0;
+  _pool_bytes = _max_lines * sizeof(PackedLine);
+  reset();
+}
+
+void Program::reset() {
+  // Lines at and beyond `_N_lines` never get read and each newly appended line
+  // gets written in full. Hence, the stale lines can be left as is.
+  _N_lines = 0;
+}
+
+bool Program::append(const PackedLine &line) {
+  if (_embedded || (_N_lines == _max_lines)) {
+    return false;
+  }
+
+  _lines[_N_lines] = line;
+  _N_lines++;
+  return true;
+}
+
+void Program::get(uint16_t idx, PackedLine &output) {
+  if (idx >= _N_lines) {
+    snprintf(buf, BUF_LEN,
+             "CRITICAL: Out-of-bounds line number %d in `Program::get()`", idx);
+    halt(13, buf);
+  }
+
+  output = _lines[idx];
+}
+
+uint16_t Program::get_duration(uint16_t idx) {
+  if (idx >= _N_lines) {
+    snprintf(buf, BUF_LEN,
+             "CRITICAL: Out-of-bounds line number %d in "
+             "`Program::get_duration()`",
+             idx);
+    halt(13, buf);
+  }
+
+  return _lines[idx].duration;
+}
+
+uint8_t *Program::image() { return (uint8_t *)_lines; }
+
+uint32_t Program::get_N_image_bytes() const {
+  return _N_lines * sizeof(PackedLine);
+}
+
+uint8_t *Program::spare(uint32_t &N_bytes) {
+  if (_embedded) {
+    N_bytes = _own_bytes & ~3UL; // All of the own storage is unused
+    return _own_pool;
+  }
+  uintptr_t begin = (uintptr_t)(_lines + _N_lines);
+  uintptr_t end = (uintptr_t)(_lines + _max_lines);
+  uintptr_t ofs = (begin + 3) & ~(uintptr_t)3;
+  N_bytes = (ofs < end) ? end - ofs : 0;
+  return (uint8_t *)ofs;
+}
+
+bool Program::restore(uint16_t N_lines, uint32_t N_bytes) {
+  if ((N_lines > _max_lines) || (N_bytes != N_lines * sizeof(PackedLine))) {
+    reset();
+    return false;
+  }
+
+  _N_lines = N_lines;
+  return true;
+}
+
+#endif
+
+/*------------------------------------------------------------------------------
+  Program, regardless of the storage format
+------------------------------------------------------------------------------*/
+
+void Program::assign(uint8_t *pool, uint32_t N_bytes) {
+  _own_pool = pool;
+  _own_bytes = N_bytes;
+  _embedded = false;
+  use_storage(pool, N_bytes);
+}
+
+void Program::clear() {
+  if (_embedded) {
+    // Return to the own storage
+#if PROTOCOL_COMPRESSED == COMPRESSION_DELTA
+    if (_flash) {
+      _flash->close();
+      _flash = nullptr;
+    }
+#endif
+    _embedded = false;
+    use_storage(_own_pool, _own_bytes);
+  } else {
+    reset();
+  }
+}
+
+bool Program::attach(const uint8_t *image, uint16_t N_lines,
+                     uint32_t N_bytes) {
+  // The image never gets written to, as `append()` refuses and `clear()`
+  // returns to the own storage first
+  clear();
+  use_storage((uint8_t *)image, N_bytes);
+  _embedded = true;
+  if (!restore(N_lines, N_bytes)) {
+    clear();
+    return false;
+  }
+  return true;
+}
+
+void Program::flash_hint(uint16_t idx) {
+#if PROTOCOL_COMPRESSED == COMPRESSION_DELTA
+  _flash->hint(idx);
+#else
+  (void)idx;
+#endif
+}
+
+bool Program::flash_try_get(uint16_t idx, PackedLine &output) {
+#if PROTOCOL_COMPRESSED == COMPRESSION_DELTA
+  return _flash->try_get(idx, output);
+#else
+  (void)idx;
+  (void)output;
+  return false;
+#endif
+}
+
+/*------------------------------------------------------------------------------
+  TimeIndex
+------------------------------------------------------------------------------*/
+
+void TimeIndex::append(uint16_t duration) {
+  if (_N_lines % PROTOCOL_TIME_INTERVAL == 0) {
+    _starts[_N_lines / PROTOCOL_TIME_INTERVAL] = _total_us;
+  }
+  _total_us += decode_duration_us(duration);
+  _N_lines++;
+}
+
+void TimeIndex::rebuild(Program &program) {
+  clear();
+  for (uint16_t line_no = 0; line_no < program.size(); ++line_no) {
+    append(program.get_duration(line_no));
+  }
+}
+
+uint16_t TimeIndex::find(Program &program, uint64_t t_us,
+                         uint64_t &start_us) const {
+  // Binary search for the last checkpoint starting at or before `t_us`
+  uint16_t lo = 0;
+  uint16_t hi = (_N_lines > 0) ? (_N_lines - 1) / PROTOCOL_TIME_INTERVAL : 0;
+  while (lo < hi) {
+    uint16_t mid = (lo + hi + 1) / 2;
+    if (_starts[mid] <= t_us) {
+      lo = mid;
+    } else {
+      hi = mid - 1;
+    }
+  }
+
+  // Walk over the lines following the checkpoint
+  uint16_t line_no = lo * PROTOCOL_TIME_INTERVAL;
+  start_us = _starts[lo];
+  while (line_no + 1 < _N_lines) {
+    uint32_t duration_us = decode_duration_us(program.get_duration(line_no));
+    if (start_us + duration_us > t_us) {
+      break;
+    }
+    start_us += duration_us;
+    line_no++;
+  }
+  return line_no;
+}
+
+/*------------------------------------------------------------------------------
+  ProgramStats
+------------------------------------------------------------------------------*/
+
+void ProgramStats::clear() { *this = ProgramStats(); }
+
+void ProgramStats::append(const PackedLine &line) {
+  CP_Masks masks;
+  line.get_cp_masks(masks);
+
+  uint8_t N_open = 0;
+  for (uint8_t idx = 0; idx < N_MANIFOLDS; ++idx) {
+    uint8_t N_open_manifold = 0;
+    for (uint8_t port = 0; port < N_CP_PORTS; ++port) {
+      N_open_manifold +=
+          __builtin_popcount(masks[port] & MANIFOLD2CP_MASKS[idx][port]);
+    }
+    _sum_open_manifold[idx] += N_open_manifold;
+    N_open += N_open_manifold;
+  }
+
+  uint32_t duration_ms = decode_duration_us(line.duration) / 1000;
+  uint8_t bin = (duration_ms > 0) ? 31 - __builtin_clz(duration_ms) : 0;
+  bin = min(bin, (uint8_t)(PROGRAM_STATS_BINS - 1));
+  if (_hist[bin] < UINT16_MAX) {
+    _hist[bin]++;
+  }
+
+  _min_open = (_N_lines == 0) ? N_open : min(_min_open, N_open);
+  _max_open = max(_max_open, N_open);
+  _sum_open += N_open;
+  _sum_open_ms += (uint64_t)N_open * duration_ms;
+  _total_ms += duration_ms;
+  _N_lines++;
+}
+
+void ProgramStats::rebuild(Program &program) {
+  PackedLine line;
+
+  clear();
+  for (uint16_t line_no = 0; line_no < program.size(); ++line_no) {
+    program.get(line_no, line);
+    append(line);
+  }
+}
+
+void ProgramStats::print(Stream &mySerial) const {
+  float N_lines = max(_N_lines, (uint16_t)1);
+  snprintf(buf, BUF_LEN, "\t%.4f\t%.4f\t%.4f\t%.4f",
+           _sum_open / N_lines / N_VALVES,
+           _total_ms ? (float)_sum_open_ms / _total_ms / N_VALVES : 0.f,
+           (float)_min_open / N_VALVES, (float)_max_open / N_VALVES);
+  mySerial.print(buf);
+  for (uint8_t idx = 0; idx < N_MANIFOLDS; ++idx) {
+    snprintf(buf, BUF_LEN, "\t%.2f", _sum_open_manifold[idx] / N_lines);
+    mySerial.print(buf);
+  }
+  for (uint8_t bin = 0; bin < PROGRAM_STATS_BINS; ++bin) {
+    snprintf(buf, BUF_LEN, "\t%u", _hist[bin]);
+    mySerial.print(buf);
+  }
+}
+
+/*------------------------------------------------------------------------------
+  Feasibility
+------------------------------------------------------------------------------*/
+
+void Feasibility::clear() { *this = Feasibility(); }
+
+void Feasibility::append(const PackedLine &line, const ActuationCost &cost) {
+  CP_Masks masks;
+  line.get_cp_masks(masks);
+
+  uint8_t N_ports = 0;
+  for (uint8_t port = 0; port < N_CP_PORTS; ++port) {
+    N_ports += (masks[port] != _prev_masks[port]);
+  }
+  _prev_masks = masks;
+
+  uint32_t cost_us = cost.predict(N_ports);
+  if ((_N_lines == 0) || (cost_us > _max_cost_us)) {
+    _max_cost_us = cost_us;
+    _max_cost_line = _N_lines;
+  }
+
+  if (cost_us > decode_duration_us(line.duration)) {
+    if (!_in_range) {
+      if (_N_ranges < FEASIBILITY_MAX_RANGES) {
+        _ranges[_N_ranges].first = _N_lines;
+      }
+      _N_ranges++;
+    }
+    if (_N_ranges <= FEASIBILITY_MAX_RANGES) {
+      _ranges[_N_ranges - 1].last = _N_lines;
+    }
+    _N_infeasible++;
+    _in_range = true;
+  } else {
+    _in_range = false;
+  }
+  _N_lines++;
+}
+
+void Feasibility::rebuild(Program &program, const ActuationCost &cost) {
+  PackedLine line;
+
+  clear();
+  for (uint16_t line_no = 0; line_no < program.size(); ++line_no) {
+    program.get(line_no, line);
+    append(line, cost);
+  }
+}
+
+void Feasibility::print(Stream &mySerial) const {
+  snprintf(buf, BUF_LEN, "%u\t%u\t%u\t%lu\t%u\n", _N_lines, _N_infeasible,
+           _N_ranges, (unsigned long)_max_cost_us, _max_cost_line);
+  mySerial.print(buf);
+  uint8_t N_listed = min(_N_ranges, (uint16_t)FEASIBILITY_MAX_RANGES);
+  for (uint8_t idx = 0; idx < N_listed; ++idx) {
+    snprintf(buf, BUF_LEN, "%u\t%u\n", _ranges[idx].first, _ranges[idx].last);
+    mySerial.print(buf);
+  }
+}
+
+/*------------------------------------------------------------------------------
+  LineRingBuffer
+------------------------------------------------------------------------------*/
+
+bool LineRingBuffer::push(const PackedLine &line) {
+  if (_count == STREAM_BUFFER_LINES) {
+    return false;
+  }
+
+  uint16_t idx = _head + _count;
+  if (idx >= STREAM_BUFFER_LINES) {
+    idx -= STREAM_BUFFER_LINES;
+  }
+  _lines[idx] = line;
+  _count++;
+  return true;
+}
+
+bool LineRingBuffer::pop(PackedLine &line) {
+  if (_count == 0) {
+    return false;
+  }
+
+  line = _lines[_head];
+  _head = (_head + 1 == STREAM_BUFFER_LINES) ? 0 : _head + 1;
+  _count--;
+  return true;
+}
+
+bool LineRingBuffer::peek(uint16_t idx, PackedLine &line) const {
+  if (idx >= _count) {
+    return false;
+  }
+
+  idx += _head;
+  if (idx >= STREAM_BUFFER_LINES) {
+    idx -= STREAM_BUFFER_LINES;
+  }
+  line = _lines[idx];
+  return true;
+}
+
+/*------------------------------------------------------------------------------
+  LineSource
+------------------------------------------------------------------------------*/
+
+bool LineSource::next_line(Line &line) {
+  ValveSet valves;
+  if (!next_valves(line.duration, valves)) {
+    return false;
+  }
+
+  line.clear_points();
+  valves.for_each([&line](uint8_t valve) {
+    line.add_point(P(VALVE2P[valve][0], VALVE2P[valve][1]));
+  });
+  return true;
+}
+
+bool LineSource::next_valves(uint16_t &duration, ValveSet &valves) {
+  Line line;
+  if (!next_line(line)) {
+    return false;
+  }
+
+  duration = line.duration;
+  valves.clear();
+  for (const P &p : line) {
+    valves.set(p2addr(p).valve); // Halts when there is no valve
+  }
+  return true;
+}
+
+/*------------------------------------------------------------------------------
+  ProtocolManager
+------------------------------------------------------------------------------*/
+
+// A line as dumped in binary, see `start_dump()`
+struct __attribute__((packed)) DumpedRows {
+  uint16_t duration; // Encoded, see `decode_duration_us()`
+  PCS_Rows rows;
+};
+
+/**
+ * @brief Convert @p line into the format of the binary dump.
+ */
+static void to_dumped_rows(const Line &line, DumpedRows &out) {
+  out.duration = line.duration;
+  out.rows.fill(0);
+  for (const P &p : line) {
+    out.rows[PCS_Y_MAX - p.y] |= (1U << (p.x - PCS_X_MIN));
+  }
+  if (line.marked) {
+    out.rows[0] |= PCS_ROW_MARKER;
+  }
+}
+
+// A line as read back in binary, see `start_masks_dump()`
+struct __attribute__((packed)) DumpedMasks {
+  uint16_t duration; // Encoded, see `decode_duration_us()`
+  CP_Masks masks;
+};
+
+/**
+ * @brief Continue the CRC32 checksum @p crc over @p line in the format of the
+ * binary dump, see `ProtocolManager::get_program_crc()`.
+ */
+static uint32_t crc32_line(const Line &line, uint32_t crc) {
+  DumpedRows out;
+  to_dumped_rows(line, out);
+  return crc32(&out, sizeof(out), crc);
+}
+
+ProtocolManager::ProtocolManager(CentipedeManager *cp_mgr) {
+  _cp_mgr = cp_mgr;
+  _cp_mgr->set_done_callback(i2c_done_callback, this);
+  clear();
+}
+
+void ProtocolManager::begin(MemoryArena &arena) {
+  _arena = &arena;
+  // One spare slot tells a full queue from an empty one
+  _events.assign((ValveEvent *)arena.alloc(
+                     (VALVE_EVENT_LOG_LEN + 1) * sizeof(ValveEvent),
+                     "event_log"),
+                 VALVE_EVENT_LOG_LEN + 1);
+
+  static const char *const SLOT_NAMES[] = {"slot_0", "slot_1"};
+  uint32_t N_bytes = (arena.get_N_free() / PROTOCOL_SLOTS) & ~3UL;
+  for (uint8_t idx = 0; idx < PROTOCOL_SLOTS; ++idx) {
+    _slots[idx].program.assign(arena.alloc(N_bytes, SLOT_NAMES[idx]),
+                               N_bytes);
+  }
+  clear();
+}
+
+void ProtocolManager::clear() {
+  _edit->times.clear();
+  _edit->stats.clear();
+  _edit->feasibility.clear();
+  _edit->crc = 0;
+  _edit->crc_known = true;
+  _edit->header_len = 0;
+  if (_edit != _active) {
+    // Staging: Playback of the active program continues undisturbed
+    _edit->program.clear();
+    set_name("cleared");
+    return;
+  }
+
+  stop_timer();
+  _active->program.clear();
+  set_name("cleared");
+  _program_gen++;
+  _N_lines = 0;
+  _pos = 0;
+  _next_staged = false;
+}
+
+bool ProtocolManager::append(const PackedLine &packed_line) {
+  Line line;
+  packed_line.unpack_into(line);
+  line.duration = packed_line.duration;
+  line.marked &= LINE_MARKER_STORED; // Checksum what gets read back
+
+  if (_edit != _active) {
+    // Staging: Playback of the active program continues undisturbed
+    if (!_edit->program.append(packed_line)) {
+      return false;
+    }
+    _edit->times.append(packed_line.duration);
+    _edit->stats.append(packed_line);
+    _edit->feasibility.append(packed_line, _cost);
+    _edit->crc = crc32_line(line, _edit->crc);
+    return true;
+  }
+
+  stop_timer();
+  if (_N_lines == PROTOCOL_MAX_LINES) {
+    return false;
+  }
+
+  if (!_active->program.append(packed_line)) {
+    return false;
+  }
+  _active->times.append(packed_line.duration);
+  _active->stats.append(packed_line);
+  _active->feasibility.append(packed_line, _cost);
+  _active->crc = crc32_line(line, _active->crc);
+  _program_gen++;
+  _N_lines++;
+  _next_staged = false; // Line count changed, so the look-ahead might be stale
+  return true;
+}
+
+bool ProtocolManager::add_line(const Line &line) {
+  PackedLine packed_line;
+  line.pack_into(packed_line);
+  return append(packed_line);
+}
+
+bool ProtocolManager::add_line(uint16_t duration, const PCS_Rows &rows) {
+  PackedLine packed_line;
+  packed_line.duration = duration;
+  packed_line.pack_pcs_rows(rows);
+  return append(packed_line);
+}
+
+bool ProtocolManager::copy_active_lines(uint16_t first, uint16_t last) {
+  if ((_edit == _active) || (first > last) || (last > _N_lines)) {
+    return false;
+  }
+
+  PackedLine packed_line;
+  for (uint16_t line_no = first; line_no < last; ++line_no) {
+    _active->program.get(line_no, packed_line);
+    if (!append(packed_line)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ProtocolManager::attach_program(const char *name, const uint8_t *image,
+                                     uint16_t N_lines, uint32_t N_bytes) {
+  stop_timer();
+  bool success = _active->program.attach(image, N_lines, N_bytes);
+  strncpy(_active->name, success ? name : "cleared",
+          sizeof(_active->name) - 1);
+  _active->name[sizeof(_active->name) - 1] = '\0';
+  program_replaced();
+  return success;
+}
+
+#if PROTOCOL_COMPRESSED == COMPRESSION_DELTA
+void ProtocolManager::attach_flash_program(const char *name,
+                                           FlashProgram &reader) {
+  stop_timer();
+  _active->program.attach_flash(reader);
+  strncpy(_active->name, name, sizeof(_active->name) - 1);
+  _active->name[sizeof(_active->name) - 1] = '\0';
+  program_replaced();
+}
+#endif
+
+void ProtocolManager::program_replaced() {
+  _active->crc_known = false; // Adopted from the first scrub pass
+  _program_gen++;
+  _N_lines = _active->program.size();
+  _active->times.rebuild(_active->program);
+  _active->stats.rebuild(_active->program);
+  _active->feasibility.rebuild(_active->program, _cost);
+  prime_start();
+}
+
+void ProtocolManager::edit_replaced() {
+  if (_edit == _active) {
+    program_replaced();
+  } else {
+    _edit->times.rebuild(_edit->program);
+    _edit->stats.rebuild(_edit->program);
+    _edit->feasibility.rebuild(_edit->program, _cost);
+    _edit->crc_known = false; // Adopted once swapped in and scrubbed
+  }
+}
+
+void ProtocolManager::open_staging() {
+  _staged_ready = false;
+  _swap_pending = false;
+  _edit = _staging;
+  clear();
+
+  // Attach the pending header
+  memcpy(_edit->header, _header_pending, _header_pending_len);
+  _edit->header_len = _header_pending_len;
+  _header_pending_len = 0;
+}
+
+bool ProtocolManager::add_header(const char *hex) {
+  uint16_t len = _header_pending_len;
+  while (hex[0] && hex[1]) {
+    char pair[3] = {hex[0], hex[1], '\0'};
+    char *end;
+    uint8_t value = strtoul(pair, &end, 16);
+    if ((end != pair + 2) || (len == PROTOCOL_HEADER_MAX)) {
+      return false;
+    }
+    _header_pending[len++] = value;
+    hex += 2;
+  }
+  if (*hex) {
+    return false; // Odd number of hex digits
+  }
+
+  _header_pending_len = len;
+  return true;
+}
+
+void ProtocolManager::dump_header() {
+  static uint8_t frame[cobs_frame_len(PROTOCOL_HEADER_MAX)];
+
+  tx.println(_active->header_len);
+  tx.write(frame, cobs_frame(_active->header, _active->header_len, frame));
+}
+
+void ProtocolManager::reopen_staging() {
+  if (!has_staging_slot()) {
+    return;
+  }
+  _staged_ready = false;
+  _swap_pending = false;
+  _edit = _staging;
+}
+
+void ProtocolManager::close_staging(bool keep) {
+  _staged_ready = keep && (_staging != _active);
+  _edit = _active;
+}
+
+bool ProtocolManager::swap(bool at_line_boundary) {
+  if (!_staged_ready) {
+    return false;
+  }
+
+  if (at_line_boundary) {
+    // Let `stage_next_line()` pick line 0 of the staged program as the line
+    // following the current one
+    stop_timer();
+    _swap_pending = true;
+    _next_staged = false;
+  } else {
+    swap_slots();
+    prime_start();
+  }
+  return true;
+}
+
+uint8_t *ProtocolManager::lend_spare_memory(uint32_t &N_bytes) {
+  uint8_t *ptr = _active->program.spare(N_bytes);
+  if (has_staging_slot() && (_edit != _staging)) {
+    uint32_t N_staging;
+    uint8_t *ptr_staging = _staging->program.spare(N_staging);
+    if (N_staging > N_bytes) {
+      ptr = ptr_staging;
+      N_bytes = N_staging;
+    }
+  }
+  return ptr;
+}
+
+void ProtocolManager::swap_slots() {
+  Slot *slot = _active;
+  _active = _staging;
+  _staging = slot;
+  _edit = _active;
+  _program_gen++;
+  _N_lines = _active->program.size();
+  _staged_ready = true; // The previous program can be swapped back in
+  _swap_pending = false;
+}
+
+void ProtocolManager::prime_start() {
+  stop_timer();
+  _line_buffer.duration = 0; // [ms]
+  if (_N_lines > 0) {
+    _pos = _N_lines - 1;
+  } else {
+    _pos = 0;
+  }
+  _next_staged = false;
+  _single_step = false;
+  resync();
+  reset_timing_stats();
+}
+
+void ProtocolManager::goto_line(uint16_t line_no) {
+  stop_timer();
+  if (_N_lines > 0) {
+    _pos = min(line_no, _N_lines - 1);
+    RAMSource(_active->program).seek(_pos, _line_buffer);
+  }
+  _next_staged = false;
+  activate_buffer();
+}
+
+void ProtocolManager::goto_time(uint64_t t_us) {
+  const TimeIndex &times = _active->times;
+  if (times.get_total_us() == 0) {
+    goto_line(0);
+    return;
+  }
+
+  uint64_t start_us;
+  t_us %= times.get_total_us();
+  goto_line(times.find(_active->program, t_us, start_us));
+
+  // Expire the line as if it had been playing since its start time
+  _deadline_us -= ((t_us - start_us) << 16) / _speed_q16;
+}
+
+void ProtocolManager::goto_next_line() {
+  stop_timer();
+  if (_N_lines > 0) {
+    if (_pos == _N_lines - 1) {
+      _pos = 0;
+    } else {
+      _pos++;
+    }
+    goto_line(_pos);
+  }
+}
+
+void ProtocolManager::goto_prev_line() {
+  stop_timer();
+  if (_N_lines > 0) {
+    if (_pos == 0) {
+      _pos = _N_lines - 1;
+    } else {
+      _pos--;
+    }
+    goto_line(_pos);
+  }
+}
+
+template <class Source>
+bool ProtocolManager::stage(Source src, uint16_t pos) {
+  if (!src.next(pos, _next_pos, _next_line)) {
+    return false;
+  }
+
+  if (_overload == OVERLOAD_DROP) {
+    // Skip the lines too short to keep up with, holding the current line for
+    // their duration instead
+    PackedLine line;
+    uint16_t line_pos;
+    uint16_t N_dropped = 0;
+    while (!_single_step && (N_dropped < OVERLOAD_MAX_SKIP) &&
+           (scaled_duration_us(_next_line) < _overload_min_us) &&
+           src.next(_next_pos, line_pos, line)) {
+      _deadline_us += scaled_duration_us(_next_line);
+      _N_streamed += _streaming;
+      _N_wraps += (!_streaming && (_next_pos == 0));
+      _next_pos = line_pos;
+      _next_line = line;
+      N_dropped++;
+    }
+    _overload_stats.N_dropped += N_dropped;
+  }
+
+  _next_line.get_cp_masks(_next_masks);
+  _xform.apply(_next_masks);
+  _guard.apply(_next_masks);
+  plan_stagger();
+  _next_staged = true;
+  return true;
+}
+
+void ProtocolManager::stage_next_line() {
+  if (_streaming) {
+    if (!_stream_dry) {
+      stage(StreamSource(_ring), _pos);
+    }
+    return;
+  }
+
+  if (_swap_pending) {
+    // Continue with line 0 of the staged program once the current line has
+    // expired, i.e. as if following its last line
+    swap_slots();
+    stage(RAMSource(_active->program), _N_lines - 1);
+    return;
+  }
+  stage(RAMSource(_active->program), _pos);
+}
+
+void ProtocolManager::plan_stagger() {
+  _N_stagger = 1;
+  _stagger_offsets_us[0] = 0;
+  if (!_use_timer || _follower) {
+    return;
+  }
+
+  if (_latency.is_enabled()) {
+    _N_stagger = _latency.plan(_cp_mgr->get_masks(), _next_masks,
+                               _stagger_masks, _stagger_offsets_us);
+    return;
+  }
+  if (!_stagger.is_enabled()) {
+    return;
+  }
+
+  // The sub-steps must all fit within the next line
+  uint64_t duration_us = decode_duration_us(_next_line.duration);
+  if (((duration_us << 16) / _speed_q16) <= _stagger.get_window_us()) {
+    return;
+  }
+  _N_stagger = _stagger.plan(_cp_mgr->get_masks(), _next_masks,
+                             _stagger_masks);
+  for (uint8_t step = 0; step < _N_stagger; ++step) {
+    _stagger_offsets_us[step] = (int32_t)step * _stagger.get_spacing_us();
+  }
+}
+
+template <class Source>
+uint8_t ProtocolManager::N_open_ahead(Source src, uint16_t N_ahead) {
+  PackedLine line;
+  CP_Masks masks;
+
+  // The staged line, if any, is the last line yielded by the source
+  uint16_t pos = _next_staged ? _next_pos : _pos;
+  N_ahead -= _next_staged;
+  if (N_ahead == 0) {
+    line = _next_line;
+  } else if (!src.peek(pos, N_ahead, line)) {
+    return N_OPEN_UNKNOWN;
+  }
+
+  uint8_t N_open = 0;
+  line.get_cp_masks(masks);
+  _xform.apply(masks);
+  for (uint8_t port = 0; port < N_CP_PORTS; port++) {
+    N_open += __builtin_popcount(masks[port]);
+  }
+  return N_open;
+}
+
+uint8_t ProtocolManager::get_N_open_ahead(uint16_t N_ahead) {
+  if (N_ahead == 0) {
+    return _cp_mgr->get_N_open();
+  }
+  if (_streaming) {
+    return N_open_ahead(StreamSource(_ring), N_ahead);
+  }
+  return N_open_ahead(RAMSource(_active->program), N_ahead);
+}
+
+void ProtocolManager::activate_buffer() {
+  PERF_SCOPE(PERF_ACTIVATE_BUFFER);
+  CP_Masks masks;
+
+  // Manual activation: Re-anchor the time track to the present
+  uint32_t now_us = micros();
+  _deadline_us = now_us + scaled_duration_us();
+
+  // The line starts playing its full duration once the playback resumes
+  _frozen = true;
+  _frozen_us = now_us;
+
+  // Get the Centipede port bitmasks of the valves to be opened
+  _line_buffer.get_cp_masks(masks);
+  _xform.apply(masks);
+  _guard.reset(masks);
+  uint32_t done_us = activate_masks(masks, _line_buffer.is_marked());
+  log_event(now_us, now_us, done_us);
+}
+
+uint32_t ProtocolManager::activate_masks(const CP_Masks &masks, bool marked) {
+  _cp_mgr->set_masks(masks);
+
+  if (!NO_PERIPHERALS || _cp_mgr->is_simulated()) {
+    _cp_mgr->send_masks(); // Activate the valves
+  }
+  toggle_sync(marked);
+  uint32_t done_us = micros();
+
+  color_leds(masks);
+  return done_us;
+}
+
+/**
+ * @brief Return the time [µs] it took the valves of @p event to be sent their
+ * new states.
+ */
+static inline uint32_t send_us(const ValveEvent &event) {
+  int32_t dt_us = (int32_t)(event.i2c_done_us - event.actual_us);
+  return (dt_us > 0) ? dt_us : 0;
+}
+
+void ProtocolManager::log_event(uint32_t planned_us, uint32_t actual_us,
+                                uint32_t i2c_done_us) {
+  ValveEvent event{_pos, planned_us, actual_us, i2c_done_us};
+
+  // Keep `i2c_done_callback()` out while deciding
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  if (_event_pending) {
+    // Superseded before the valves of the previous line had been written
+    _events.push(_pending_event);
+    _event_pending = false;
+  }
+  if (!NO_PERIPHERALS && _cp_mgr->get_async_mode()) {
+    if (_cp_mgr->tx_busy()) {
+      event.i2c_done_us = 0;
+      _pending_event = event;
+      _event_pending = true;
+    } else {
+      event.i2c_done_us = _cp_mgr->get_tx_done_us();
+    }
+  }
+  if (!_event_pending) {
+    _events.push(event);
+    _qos.add_send(send_us(event));
+  }
+  __set_PRIMASK(primask);
+
+  trace(TRACE_LINE_ACTIVATED, _pos, _line_buffer.duration);
+}
+
+void ProtocolManager::i2c_done_callback(uint32_t done_us, void *ctx) {
+  ProtocolManager *self = (ProtocolManager *)ctx;
+  if (self->_event_pending) {
+    self->_pending_event.i2c_done_us = done_us;
+    self->_events.push(self->_pending_event);
+    self->_qos.add_send(send_us(self->_pending_event));
+    self->_event_pending = false;
+  }
+}
+
+void ProtocolManager::color_leds(const CP_Masks &masks) {
+  // Only the LEDs of the valves that changed state get touched: Newly opened
+  // valves turn red, newly closed valves turn blue and fade out
+  for (uint8_t port = 0; port < N_CP_PORTS; ++port) {
+    uint16_t changed = _last_masks[port] ^ masks[port];
+    while (changed) {
+      uint8_t bit = __builtin_ctz(changed);
+      changed &= changed - 1; // Clear lowest set bit
+      if ((masks[port] >> bit) & 0x01) {
+        led_compositor.open_valve(CP2LED[port][bit]);
+      } else {
+        led_compositor.close_valve(CP2LED[port][bit]);
+      }
+    }
+  }
+
+  // Backup the activated bitmasks
+  _last_masks = masks;
+}
+
+void ProtocolManager::update() {
+  _qos.update(micros());
+
+  if (_follower) {
+    update_follower();
+    return;
+  }
+
+  if (_use_timer) {
+    if (_timer->is_armed()) {
+      return; // The interrupt will take care of the upcoming switch
+    }
+
+    finish_isr_switch();
+  }
+
+  if (_step_done) {
+    return; // Hold at the start of the new line, see `set_single_step()`
+  }
+
+  if (_streaming && _stream_dry) {
+    if (_stream_eos && (_ring.size() == 0)) {
+      // Ended without any lines left to play
+      _stream_done = true;
+      return;
+    }
+
+    // Wait for the stream buffer to fill up
+    if ((_ring.size() < STREAM_PREFILL_LINES) &&
+        !(_stream_eos && _ring.size() > 0)) {
+      return;
+    }
+    _stream_dry = false;
+    resync();
+  }
+
+  if (!_next_staged) {
+    // Prepare the next line ahead of time, so that only the I2C transmission
+    // remains to be done once the current line has expired
+    stage_next_line();
+  }
+
+  uint32_t now_us = micros();
+  if ((int32_t)(now_us - _deadline_us) < 0) {
+    // Current line has not yet expired
+    if (_use_timer && _next_staged) {
+      _timer->arm(_deadline_us + _stagger_offsets_us[0]);
+    }
+    return;
+  }
+
+  if ((_overload == OVERLOAD_COALESCE) && _next_staged) {
+    coalesce_expired(now_us);
+  }
+
+  if (!_next_staged && _streaming) {
+    if (_stream_eos) {
+      _stream_done = true;
+      return;
+    }
+
+    // Underrun: Close all valves and wait for the buffer to refill
+    CP_Masks closed;
+    closed.fill(0);
+    _guard.reset(closed);
+    activate_masks(closed);
+    _stream_dry = true;
+    _N_underruns++;
+    return;
+  }
+
+  if (!_next_staged) {
+    // Empty program
+    goto_next_line();
+    return;
+  }
+
+  // Deadline has passed without the interrupt, so switch from within the loop
+  _pos = _next_pos;
+  _line_buffer = _next_line;
+  _next_staged = false;
+  _N_streamed += _streaming;
+  uint32_t done_us = activate_masks(_next_masks, _line_buffer.is_marked());
+  log_event(_deadline_us, now_us, done_us);
+  advance_time_track(now_us);
+}
+
+uint32_t ProtocolManager::scaled_duration_us() {
+  uint32_t duration_us = decode_duration_us(_line_buffer.duration);
+  if (_speed_q16 == SPEED_Q16_ONE) {
+    return duration_us;
+  }
+
+  // Exact division, carrying the remainder over to the next line
+  uint64_t scaled = ((uint64_t)duration_us << 16) + _speed_residue;
+  _speed_residue = scaled % _speed_q16;
+  scaled /= _speed_q16;
+  if (scaled > INT32_MAX) {
+    // Beyond the range of the deadline comparisons
+    _speed_residue = 0;
+    return INT32_MAX;
+  }
+  return scaled;
+}
+
+uint32_t ProtocolManager::scaled_duration_us(const PackedLine &line) const {
+  uint64_t duration_us = decode_duration_us(line.duration);
+  return min((duration_us << 16) / _speed_q16, (uint64_t)INT32_MAX);
+}
+
+void ProtocolManager::coalesce_expired(uint32_t now_us) {
+  uint16_t N_folded = 0;
+  while (_next_staged && !_single_step && (N_folded < OVERLOAD_MAX_SKIP)) {
+    uint32_t end_us = _deadline_us + scaled_duration_us(_next_line);
+    if ((int32_t)(now_us - end_us) < 0) {
+      break; // Still current on the timeline
+    }
+
+    // Pass over the staged line without sending out its valve states
+    _pos = _next_pos;
+    _line_buffer = _next_line;
+    _next_staged = false;
+    _N_streamed += _streaming;
+    _N_wraps += (!_streaming && (_pos == 0));
+    _deadline_us = end_us;
+    N_folded++;
+    stage_next_line();
+  }
+
+  if (N_folded) {
+    _overload_stats.N_coalesced++;
+    _overload_stats.N_folded += N_folded;
+  }
+}
+
+void ProtocolManager::advance_time_track(uint32_t switch_us) {
+  int32_t lag_us = (int32_t)(switch_us - _deadline_us);
+  uint32_t duration_us = scaled_duration_us();
+  uint32_t start_us; // Start of the new line on the time track
+
+  // Had the new line expired already before it got switched to?
+  bool overrun = (lag_us > 0) && ((uint32_t)lag_us >= duration_us);
+  bool stretch = overrun && _drift_free && (_overload == OVERLOAD_STRETCH);
+  _overload_stats.N_overruns += overrun;
+  if (stretch) {
+    _overload_stats.N_stretched++;
+    _overload_stats.stretched_us += lag_us;
+  }
+
+  if (_drift_free && !stretch) {
+    // Absolute deadline: Lateness of this switch does not accumulate
+    start_us = _deadline_us;
+    _deadline_us += duration_us;
+  } else {
+    // Relative deadline: Lateness of this switch gets carried over
+    start_us = switch_us;
+    _deadline_us = switch_us + duration_us;
+  }
+
+  if (_single_step) {
+    // Freeze right at the start of the new line
+    _single_step = false;
+    _step_done = true;
+    _frozen = true;
+    _frozen_us = start_us;
+  }
+
+  // Keep track of the gap between the planned and actual switch times
+  if (lag_us < 0) {
+    lag_us = 0; // Interrupt fired a few µs early
+  }
+  _timing.last_lag_us = lag_us;
+  if ((uint32_t)lag_us > _timing.max_lag_us) {
+    _timing.max_lag_us = lag_us;
+  }
+  _timing.sum_lag_us += lag_us;
+  _timing.N_switches++;
+  _qos.add_switch(lag_us, _drift_free);
+  _N_wraps += (!_streaming && (_pos == 0));
+}
+
+void ProtocolManager::isr_switch() {
+  if (!_next_staged) {
+    // The loop has not yet staged the next line. Leave the switch to the loop.
+    return;
+  }
+
+  uint8_t step = _stagger_next;
+  if (step == 0) {
+    // The switch of the jets, when compensating the valve latencies
+    _isr_switch_us = micros() - _stagger_offsets_us[0];
+    toggle_sync(_next_line.is_marked());
+  }
+  _cp_mgr->set_masks(_N_stagger > 1 ? _stagger_masks[step] : _next_masks);
+  if (!NO_PERIPHERALS || _cp_mgr->is_simulated()) {
+    _cp_mgr->send_masks(); // Activate the valves
+  }
+
+  if (++step < _N_stagger) {
+    // Staggered switch: Fire the next sub-step, anchored on the deadline
+    _stagger_next = step;
+    _timer->arm(_deadline_us + _stagger_offsets_us[step]);
+    return;
+  }
+  _stagger_next = 0;
+  _isr_done_us = micros();
+  _isr_fired = true;
+}
+
+void ProtocolManager::toggle_sync(bool marked) {
+  if (_sync_pin < 0) {
+    return;
+  }
+
+  if (_sync_pulse_us == 0) {
+    _sync_level = !_sync_level;
+    digitalWrite(_sync_pin, _sync_level ? HIGH : LOW);
+  } else if (marked) {
+    // Busy-wait for a pulse width independent of the loop
+    digitalWrite(_sync_pin, HIGH);
+    delayMicroseconds(_sync_pulse_us);
+    digitalWrite(_sync_pin, LOW);
+  }
+}
+
+void ProtocolManager::set_sync_marked(uint16_t pulse_us) {
+  _sync_pulse_us = min(pulse_us, SYNC_PULSE_MAX_US);
+  _sync_level = false;
+  if (_sync_pin >= 0) {
+    digitalWrite(_sync_pin, LOW);
+  }
+}
+
+void ProtocolManager::arm_trigger() {
+  prime_start();
+  if (!_streaming) {
+    stage_next_line();
+  }
+  _triggered = false;
+  _trigger_armed = _next_staged;
+}
+
+void ProtocolManager::isr_trigger() {
+  uint32_t edge_us = micros();
+  if (!_trigger_armed) {
+    if (_follower) {
+      isr_follow(edge_us);
+    }
+    return;
+  }
+
+  // Anchor the time track at the trigger, so that the lateness of the first
+  // switch equals the trigger latency
+  _trigger_armed = false;
+  _deadline_us = edge_us;
+  isr_switch();
+  _triggered = true;
+
+  if (_follower) {
+    _follow.N_edges++;
+    add_follow_skew(_isr_done_us - edge_us);
+  }
+}
+
+void ProtocolManager::isr_follow(uint32_t edge_us) {
+  _follow.N_edges++;
+  if (!_edges.empty() || _isr_fired || !_next_staged) {
+    // The main loop has not yet caught up with the previous switch
+    if (!_edges.push(edge_us)) {
+      _follow.N_dropped++;
+    }
+    return;
+  }
+
+  // The edge marks the deadline, so the lag equals the interrupt latency
+  _deadline_us = edge_us;
+  isr_switch();
+  add_follow_skew(_isr_done_us - edge_us);
+}
+
+void ProtocolManager::update_follower() {
+  finish_isr_switch();
+  if (!_next_staged) {
+    stage_next_line();
+  }
+  uint32_t edge_us;
+  if (!_next_staged || !_edges.peek(edge_us)) {
+    return;
+  }
+
+  // Catch up on the oldest pending edge. The interrupt leaves the staged line
+  // alone as long as any edge is pending, so unstage it before popping.
+  _next_staged = false;
+  _edges.pop(edge_us);
+
+  uint32_t now_us = micros();
+  _pos = _next_pos;
+  _line_buffer = _next_line;
+  uint32_t done_us = activate_masks(_next_masks, _line_buffer.is_marked());
+  _deadline_us = edge_us;
+  log_event(edge_us, now_us, done_us);
+  advance_time_track(now_us);
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  _follow.N_late++;
+  add_follow_skew(done_us - edge_us);
+  __set_PRIMASK(primask);
+}
+
+void ProtocolManager::add_follow_skew(uint32_t skew_us) {
+  _follow.last_skew_us = skew_us;
+  if (skew_us > _follow.max_skew_us) {
+    _follow.max_skew_us = skew_us;
+  }
+  _follow.sum_skew_us += skew_us;
+}
+
+void ProtocolManager::set_follower(bool follower) {
+  _follower = follower;
+  stop_timer();
+  _edges.clear();
+}
+
+void ProtocolManager::reset_follow_stats() {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  _follow = FollowStats{};
+  __set_PRIMASK(primask);
+}
+
+void ProtocolManager::print_follow_stats() {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  FollowStats stats = _follow;
+  __set_PRIMASK(primask);
+
+  // Tab delimited: N_edges, N_late, last skew, max skew, average skew [µs],
+  // N_dropped
+  snprintf(buf, BUF_LEN, "%lu\t%lu\t%lu\t%lu\t%lu\t%lu\n",
+           (unsigned long)stats.N_edges, (unsigned long)stats.N_late,
+           (unsigned long)stats.last_skew_us, (unsigned long)stats.max_skew_us,
+           (unsigned long)(stats.N_edges ? stats.sum_skew_us / stats.N_edges
+                                         : 0),
+           (unsigned long)stats.N_dropped);
+  tx.print(buf);
+}
+
+void ProtocolManager::attach_timer(PlaybackTimer *timer) { _timer = timer; }
+
+void ProtocolManager::set_use_timer(bool use_timer) {
+  stop_timer();
+  _use_timer = use_timer && (_timer != nullptr) && PlaybackTimer::available();
+}
+
+void ProtocolManager::stop_timer() {
+  _trigger_armed = false;
+  if (_timer) {
+    _timer->disarm();
+  }
+
+  if (_stagger_next) {
+    // Cut a staggered switch short by going straight to its full line
+    _stagger_next = 0;
+    _cp_mgr->set_masks(_next_masks);
+    if (!NO_PERIPHERALS || _cp_mgr->is_simulated()) {
+      _cp_mgr->send_masks();
+    }
+    _isr_done_us = micros();
+    _isr_fired = true;
+  }
+  finish_isr_switch();
+}
+
+void ProtocolManager::finish_isr_switch() {
+  if (!_isr_fired) {
+    return;
+  }
+
+  // The interrupt has switched the valves, now do the bookkeeping. Unstage
+  // first, so that a sync edge in between can't switch to the line again.
+  _next_staged = false;
+  _isr_fired = false;
+  _pos = _next_pos;
+  _line_buffer = _next_line;
+  _N_streamed += _streaming;
+  color_leds(_next_masks);
+  log_event(_deadline_us, _isr_switch_us, _isr_done_us);
+  advance_time_track(_isr_switch_us);
+}
+
+void ProtocolManager::start_stream() {
+  stop_timer();
+  _ring.clear();
+  _streaming = true;
+  _stream_eos = false;
+  _stream_dry = true;
+  _stream_done = false;
+  _N_underruns = 0;
+  _N_streamed = 0;
+  _next_staged = false;
+  _single_step = false;
+  _pos = 0xFFFF; // Such that the first streamed line will be at position 0
+  _line_buffer.duration = 0;
+}
+
+void ProtocolManager::stop_stream() {
+  stop_timer();
+  _streaming = false;
+  _next_staged = false;
+  prime_start();
+}
+
+bool ProtocolManager::push_stream_line(const Line &line) {
+  PackedLine packed_line;
+  line.pack_into(packed_line);
+  return _ring.push(packed_line);
+}
+
+bool ProtocolManager::push_stream_valves(uint16_t duration,
+                                         const ValveSet &valves) {
+  PackedLine packed_line;
+  packed_line.duration = duration;
+  packed_line.pack_valves(valves);
+  return _ring.push(packed_line);
+}
+
+uint32_t ProtocolManager::get_us_until_switch() const {
+  if (_trigger_armed) {
+    return 0;
+  }
+  if (_frozen) {
+    return UINT32_MAX;
+  }
+  int32_t left_us = (int32_t)(_deadline_us - micros());
+  return (left_us > 0) ? left_us : 0;
+}
+
+uint32_t ProtocolManager::get_us_left_in_line() const {
+  int32_t left_us = (int32_t)(_deadline_us - (_frozen ? _frozen_us : micros()));
+  return (left_us > 0) ? left_us : 0;
+}
+
+void ProtocolManager::set_us_left_in_line(uint32_t left_us) {
+  if (_frozen) {
+    _deadline_us = _frozen_us + left_us;
+  }
+}
+
+int32_t ProtocolManager::get_phase(uint32_t t_us, int16_t &pos) const {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  pos = _pos;
+  uint32_t deadline_us = _deadline_us;
+  uint16_t duration = _line_buffer.duration;
+  __set_PRIMASK(primask);
+
+  // The line started its scaled duration before the deadline
+  uint64_t duration_us = decode_duration_us(duration);
+  duration_us = min((duration_us << 16) / _speed_q16, (uint64_t)INT32_MAX);
+  return (int32_t)(t_us - deadline_us) + (int32_t)duration_us;
+}
+
+void ProtocolManager::resync() {
+  _deadline_us = micros();
+  _frozen = false;
+  _step_done = false;
+  _triggered = false;
+}
+
+void ProtocolManager::freeze() {
+  stop_timer();
+  if (_step_done) {
+    // Already frozen at the switch to the new line
+    _step_done = false;
+    return;
+  }
+
+  uint32_t now_us = micros();
+  if ((int32_t)(_deadline_us - now_us) < 0) {
+    _deadline_us = now_us; // Don't carry over an overdue line
+  }
+  _frozen = true;
+  _frozen_us = now_us;
+  _single_step = false;
+}
+
+void ProtocolManager::resume() {
+  _qos.resume();
+
+  if (_triggered) {
+    // Already anchored at the trigger
+    _triggered = false;
+    return;
+  }
+
+  if (!_frozen) {
+    resync();
+    return;
+  }
+
+  _deadline_us += micros() - _frozen_us;
+  _frozen = false;
+  _step_done = false;
+}
+
+void ProtocolManager::set_speed(uint32_t speed_q16) {
+  _speed_q16 = constrain(speed_q16, SPEED_Q16_MIN, SPEED_Q16_MAX);
+  _speed_residue = 0;
+}
+
+void ProtocolManager::print_speed() {
+  snprintf(buf, BUF_LEN, "%.4f", (double)_speed_q16 / SPEED_Q16_ONE);
+  tx.println(buf);
+}
+
+void ProtocolManager::reset_timing_stats() {
+  _timing = TimingStats{};
+  _overload_stats = OverloadStats{};
+}
+
+void ProtocolManager::print_timing_stats() {
+  // Tab delimited: N_switches, last lag, max lag, average lag [µs]
+  snprintf(buf, BUF_LEN, "%lu\t%lu\t%lu\t%lu\n",
+           (unsigned long)_timing.N_switches,
+           (unsigned long)_timing.last_lag_us,
+           (unsigned long)_timing.max_lag_us,
+           (unsigned long)(_timing.N_switches
+                               ? _timing.sum_lag_us / _timing.N_switches
+                               : 0));
+  tx.print(buf);
+}
+
+void ProtocolManager::print_overload(Stream &mySerial) const {
+  snprintf(buf, BUF_LEN, "%u\t%lu\t%lu\t%lu\t%lu\t%lu\t%lu\t%llu\n",
+           _overload, (unsigned long)_overload_min_us,
+           (unsigned long)_overload_stats.N_overruns,
+           (unsigned long)_overload_stats.N_coalesced,
+           (unsigned long)_overload_stats.N_folded,
+           (unsigned long)_overload_stats.N_dropped,
+           (unsigned long)_overload_stats.N_stretched,
+           (unsigned long long)_overload_stats.stretched_us);
+  mySerial.print(buf);
+}
+
+void ProtocolManager::benchmark(Stream &mySerial) {
+  Line line;
+  PackedLine packed_line;
+  CP_Masks masks;
+  CP_Masks closed;
+  CP_Masks current = _last_masks;
+
+  for (uint8_t valve = 1; valve <= N_VALVES; ++valve) {
+    line.add_point(valve2p(valve));
+  }
+  line.duration = 0;
+  line.pack_into(packed_line);
+  closed.fill(0);
+
+  auto unpack = [&] { packed_line.unpack_into(line); };
+  auto close_all = [&] { activate_masks(closed); };
+  auto activate = [&] {
+    packed_line.get_cp_masks(masks);
+    activate_masks(masks);
+  };
+
+  auto transcode = [&] { pcs_rows2cp_masks(PCS_ROW_VALVES, masks); };
+
+  perf_bench_print(mySerial, "unpack_112", perf_bench_cycles(unpack));
+  perf_bench_print(mySerial, "pcs2cp_112", perf_bench_cycles(transcode));
+  perf_bench_print(mySerial, "activate_112",
+                   perf_bench_cycles(close_all, activate), sizeof(CP_Masks));
+
+  // Restore the valves of the current line
+  activate_masks(current);
+}
+
+void ProtocolManager::print_program() {
+  tx.print(_active->name);
+  tx.write('\t');
+  tx.println(_N_lines);
+}
+
+void ProtocolManager::print_program_info() {
+  uint64_t total_ms = _active->times.get_total_us() / 1000;
+  snprintf(buf, BUF_LEN, "%s\t%u\t%lu\t%08lx\t%u", _active->name, _N_lines,
+           (unsigned long)total_ms, (unsigned long)_active->crc,
+           _active->crc_known);
+  tx.print(buf);
+  _active->stats.print(tx);
+  tx.write('\n');
+}
+
+void ProtocolManager::set_actuation_cost(const ActuationCost &cost) {
+  _cost = cost;
+  for (Slot &slot : _slots) {
+    slot.feasibility.rebuild(slot.program, _cost);
+  }
+}
+
+void ProtocolManager::print_feasibility() {
+  snprintf(buf, BUF_LEN, "%u\t%u\t%u\t", _cost.i2c_base_us, _cost.i2c_port_us,
+           _cost.led_us);
+  tx.print(buf);
+  _active->feasibility.print(tx);
+}
+
+void ProtocolManager::print_slots() {
+  snprintf(buf, BUF_LEN, "%s\t%u\t%s\t%u\t%u\n", _active->name, _N_lines,
+           has_staging_slot() ? _staging->name : "",
+           has_staging_slot() ? _staging->program.size() : 0,
+           _swap_pending ? 2 : _staged_ready);
+  tx.print(buf);
+}
+
+void ProtocolManager::print_memory() {
+  Program &program = _active->program;
+  snprintf(buf, BUF_LEN, "%u\t%lu\t%lu\n", _N_lines,
+           (unsigned long)program.get_N_image_bytes(),
+           (unsigned long)program.get_max_image_bytes());
+  tx.print(buf);
+  if (_arena) {
+    _arena->print(tx);
+  }
+}
+
+bool ProtocolManager::update_scrub() {
+  if (_program_gen != _scrub_gen) {
+    // Program changed: Restart the pass
+    _scrub_gen = _program_gen;
+    _scrub_pos = 0;
+    _scrub_crc = 0;
+  }
+  if (_N_lines == 0) {
+    return true;
+  }
+
+  uint16_t last = min((uint16_t)(_scrub_pos + SCRUB_LINES_PER_UPDATE),
+                      _N_lines);
+  unpack_range(_scrub_pos, last, [this](uint16_t, const Line &line) {
+    _scrub_crc = crc32_line(line, _scrub_crc);
+  });
+  _scrub_pos = last;
+  if (_scrub_pos < _N_lines) {
+    return true;
+  }
+
+  // Pass complete
+  bool ok = true;
+  if (!_active->crc_known) {
+    _active->crc = _scrub_crc;
+    _active->crc_known = true;
+  } else if (_scrub_crc != _active->crc) {
+    _scrub_N_mismatches++;
+    trace(TRACE_PROGRAM_CORRUPT, _N_lines, _scrub_crc);
+    ok = false;
+  }
+  _scrub_N_passes++;
+  _scrub_pos = 0;
+  _scrub_crc = 0;
+  return ok;
+}
+
+void ProtocolManager::print_scrub() {
+  snprintf(buf, BUF_LEN, "%08lx\t%u\t%u\t%lu\t%lu\n",
+           (unsigned long)_active->crc, _N_lines, _active->crc_known,
+           (unsigned long)_scrub_N_passes, (unsigned long)_scrub_N_mismatches);
+  tx.print(buf);
+}
+
+// Maximum number of lines to dump per call to `update_dump()`
+const uint16_t DUMP_LINES_PER_UPDATE = 16;
+
+// Worst-case length of a pretty printed line: "#65535\t", "1638300 ms\n", 112
+// points of "(-7, -7)" and "\n"
+const uint16_t DUMP_LINE_MAX_LEN = 7 + 11 + N_VALVES * 8 + 1;
+
+const uint16_t DUMP_ROWS_PER_FRAME = 16;
+static uint8_t dump_frame[cobs_frame_len(DUMP_ROWS_PER_FRAME *
+                                         sizeof(DumpedRows))];
+
+// Lines per frame of the binary readback, see `start_masks_dump()`. Each
+// frame gets followed by its CRC32 and fits `dump_frame`.
+const uint16_t DUMP_MASKS_PER_FRAME = 16;
+const uint16_t DUMP_MASKS_FRAME_LEN =
+    DUMP_MASKS_PER_FRAME * sizeof(DumpedMasks) + 4;
+static_assert(cobs_frame_len(DUMP_MASKS_FRAME_LEN) <= sizeof(dump_frame),
+              "DUMP_MASKS_PER_FRAME too large");
+
+// Maximum number of frames of the binary readback per call to `update_dump()`
+const uint8_t DUMP_MASKS_FRAMES_PER_UPDATE = 4;
+
+// Maximum number of lines to hash per call to `update_dump()`
+const uint16_t DUMP_HASH_LINES_PER_UPDATE = 64;
+
+// Length of a dumped hash: "ffffffff\n"
+const uint8_t DUMP_HASH_LINE_LEN = 9;
+
+bool ProtocolManager::start_dump(bool rows) {
+  if (_dump_slot) {
+    return false;
+  }
+
+  _dump_slot = _active;
+  _dump_N_lines = _N_lines;
+  _dump_pos = 0;
+  _dump_rows = rows;
+
+  tx.print(_active->name);
+  tx.write('\t');
+  tx.println(_N_lines);
+  if (!rows) {
+    tx.write('\n');
+  }
+  return true;
+}
+
+bool ProtocolManager::start_hash_dump(uint16_t block_len) {
+  if (_dump_slot) {
+    return false;
+  }
+
+  _dump_slot = _active;
+  _dump_N_lines = _N_lines;
+  _dump_pos = 0;
+  _dump_block_len = max(block_len, (uint16_t)1);
+  _dump_crc = 0;
+
+  snprintf(buf, BUF_LEN, "%u\t%u\t%u\n", _N_lines, _dump_block_len,
+           has_staging_slot());
+  tx.print(buf);
+  return true;
+}
+
+bool ProtocolManager::start_masks_dump(uint16_t first, uint16_t last) {
+  if (_dump_slot) {
+    return false;
+  }
+
+  _dump_slot = _active;
+  _dump_N_lines = _N_lines;
+  _dump_end = min(last, _N_lines);
+  _dump_pos = min(first, _dump_end);
+  _dump_masks = true;
+  _dump_crc = 0;
+
+  snprintf(buf, BUF_LEN, "%u\t%u\t%u\n", _dump_pos, _dump_end - _dump_pos,
+           N_CP_PORTS);
+  tx.print(buf);
+  return true;
+}
+
+void ProtocolManager::update_dump_masks() {
+  for (uint8_t idx = 0; idx < DUMP_MASKS_FRAMES_PER_UPDATE; ++idx) {
+    if (tx.availableForWrite() < (int)cobs_frame_len(DUMP_MASKS_FRAME_LEN)) {
+      return;
+    }
+
+    if (_dump_pos >= _dump_end) {
+      // Closing frame holding the CRC32 over all lines
+      tx.write(dump_frame,
+               cobs_frame((const uint8_t *)&_dump_crc, 4, dump_frame));
+      _dump_slot = nullptr; // Done
+      _dump_masks = false;
+      return;
+    }
+
+    // Straight from the program store, skipping the PCS points
+    uint8_t payload[DUMP_MASKS_FRAME_LEN];
+    DumpedMasks *lines = (DumpedMasks *)payload;
+    PackedLine packed_line;
+    CP_Masks masks;
+    uint16_t N = min((uint16_t)(_dump_end - _dump_pos), DUMP_MASKS_PER_FRAME);
+    for (uint16_t line = 0; line < N; ++line) {
+      _dump_slot->program.get(_dump_pos + line, packed_line);
+      packed_line.get_cp_masks(masks);
+      lines[line].duration = packed_line.duration;
+      memcpy(&lines[line].masks, &masks, sizeof(masks));
+    }
+
+    uint16_t len = N * sizeof(DumpedMasks);
+    _dump_crc = crc32(payload, len, _dump_crc);
+    uint32_t crc = crc32(payload, len);
+    memcpy(&payload[len], &crc, 4);
+    tx.write(dump_frame, cobs_frame(payload, len + 4, dump_frame));
+    _dump_pos += N;
+  }
+}
+
+void ProtocolManager::update_dump() {
+  if (!_dump_slot) {
+    return;
+  }
+
+  if ((_dump_slot != _active) || (_dump_N_lines != _N_lines)) {
+    _dump_pos = _dump_N_lines; // Program got replaced: Cut short
+    _dump_end = _dump_N_lines;
+    _dump_slot = _active; // Never read from a replaced slot
+    _dump_N_lines = _N_lines;
+  }
+
+  if (_dump_masks) {
+    update_dump_masks();
+    return;
+  }
+
+  uint16_t N_left = _dump_N_lines - _dump_pos;
+  if (_dump_block_len) {
+    // Room for every block that can complete, and for the closing empty line
+    uint16_t N = min(N_left, DUMP_HASH_LINES_PER_UPDATE);
+    if (tx.availableForWrite() <
+        (N / _dump_block_len + 2) * DUMP_HASH_LINE_LEN) {
+      return;
+    }
+
+    unpack_range(_dump_pos, _dump_pos + N,
+                 [this](uint16_t line_no, const Line &line) {
+                   _dump_crc = crc32_line(line, _dump_crc);
+                   if (((line_no + 1) % _dump_block_len == 0) ||
+                       (line_no + 1 == _dump_N_lines)) {
+                     snprintf(buf, BUF_LEN, "%08lx\n",
+                              (unsigned long)_dump_crc);
+                     tx.print(buf);
+                     _dump_crc = 0;
+                   }
+                 });
+    _dump_pos += N;
+
+    if (_dump_pos == _dump_N_lines) {
+      tx.write('\n');
+      _dump_slot = nullptr; // Done
+      _dump_block_len = 0;
+    }
+    return;
+  }
+
+  if (_dump_rows) {
+    if (tx.availableForWrite() < (int)sizeof(dump_frame)) {
+      return;
+    }
+
+    // A single frame per call, ending with an empty one
+    DumpedRows lines[DUMP_ROWS_PER_FRAME];
+    uint16_t N = min(N_left, DUMP_ROWS_PER_FRAME);
+    unpack_range(_dump_pos, _dump_pos + N,
+                 [&lines, this](uint16_t line_no, const Line &line) {
+                   to_dumped_rows(line, lines[line_no - _dump_pos]);
+                 });
+    tx.write(dump_frame, cobs_frame((const uint8_t *)lines,
+                                    N * sizeof(DumpedRows), dump_frame));
+    _dump_pos += N;
+    if (N == 0) {
+      _dump_slot = nullptr; // Done
+    }
+    return;
+  }
+
+  // Only as many lines as are guaranteed to fit in the transmit queue
+  uint16_t N = min(min(N_left, DUMP_LINES_PER_UPDATE),
+                   (uint16_t)(tx.availableForWrite() / DUMP_LINE_MAX_LEN));
+  unpack_range(_dump_pos, _dump_pos + N,
+               [](uint16_t line_no, const Line &line) {
+                 snprintf(buf, BUF_LEN, "#%d\t", line_no);
+                 tx.print(buf);
+                 line.print();
+               });
+  _dump_pos += N;
+
+  if (_dump_pos == _dump_N_lines) {
+    tx.write('\n');
+    _dump_slot = nullptr; // Done
+  }
+}
+
+void ProtocolManager::print_buffer() {
+  Line line;
+
+  snprintf(buf, BUF_LEN, "#%d\t", _pos);
+  tx.print(buf);
+  _line_buffer.unpack_into(line);
+  line.print();
+  tx.write('\n');
+}
+void ProtocolManager::register_commands(CommandRegistry &registry) {
+  // Report current protocol information, tab delimited:
+  //   1) Protocol name
+  //   2) N_lines
+  registry.add("p?", this, [](const char *, void *protocol_mgr) {
+    ((ProtocolManager *)protocol_mgr)->print_program();
+  });
+
+  // Report the statistics of the protocol program, precomputed while
+  // uploading, see `print_program_info()`
+  registry.add("pinfo?", this, [](const char *, void *protocol_mgr) {
+    ((ProtocolManager *)protocol_mgr)->print_program_info();
+  });
+
+  // Report the predicted timing of the protocol program, evaluated while
+  // uploading. See `print_feasibility()` for the tab-delimited fields.
+  registry.add("feas?", this, [](const char *, void *protocol_mgr) {
+    ((ProtocolManager *)protocol_mgr)->print_feasibility();
+  });
+
+  // Set the cost model the feasibility gets evaluated with, see
+  // `ActuationCost`, and reevaluate the loaded programs:
+  //   feas_cost <I2C transaction us> <port us> <LED refresh us>
+  // Trailing parameters can be left out, keeping their value. Echoes back as
+  // `feas?`.
+  registry.add_with_args(
+      "feas_cost", this, [](const char *args, void *protocol_mgr) {
+        ProtocolManager *mgr = (ProtocolManager *)protocol_mgr;
+        ActuationCost cost = mgr->get_actuation_cost();
+        uint16_t *fields[] = {&cost.i2c_base_us, &cost.i2c_port_us,
+                              &cost.led_us};
+        char *end;
+        for (uint16_t *field : fields) {
+          long parsed = strtol(args, &end, 10);
+          if (end == args) {
+            break;
+          }
+          *field = constrain(parsed, 0L, (long)UINT16_MAX);
+          args = end;
+        }
+        mgr->set_actuation_cost(cost);
+        mgr->print_feasibility();
+      });
+
+  // "hdr <hex>": Append bytes to the header to be attached to the next
+  // uploaded protocol program, see `add_header()`. Echoes the size of the
+  // pending header [bytes] back.
+  registry.add_with_args("hdr", this, [](const char *args, void *protocol_mgr) {
+    ProtocolManager *mgr = (ProtocolManager *)protocol_mgr;
+    if (!mgr->add_header(args)) {
+      tx.println("ERROR: Invalid hex or header too large.");
+      return;
+    }
+    tx.println(mgr->get_pending_header_len());
+  });
+
+  // Discard the pending header
+  registry.add("hdr_clear", this, [](const char *, void *protocol_mgr) {
+    ((ProtocolManager *)protocol_mgr)->clear_pending_header();
+  });
+
+  // Report the header of the protocol program in binary, see `dump_header()`
+  registry.add("hdr?", this, [](const char *, void *protocol_mgr) {
+    ((ProtocolManager *)protocol_mgr)->dump_header();
+  });
+
+  // Report memory usage of the protocol program, tab delimited:
+  //   1) N_lines
+  //   2) Used bytes
+  //   3) Available bytes
+  // Followed by the split of the memory arena: A line holding the total
+  // bytes, free bytes and number of allocations N, then N lines holding the
+  // name and bytes of each allocation.
+  registry.add("mem?", this, [](const char *, void *protocol_mgr) {
+    ((ProtocolManager *)protocol_mgr)->print_memory();
+  });
+
+  // Report the program slots, tab delimited:
+  //   1) Active protocol name
+  //   2) Active N_lines
+  //   3) Staged protocol name
+  //   4) Staged N_lines
+  //   5) Staged program ready to be swapped in (1), pending (2) or not
+  registry.add("slots?", this, [](const char *, void *protocol_mgr) {
+    ((ProtocolManager *)protocol_mgr)->print_slots();
+  });
+
+  // Pretty print the current line buffer contents
+  registry.add("b?", this, [](const char *, void *protocol_mgr) {
+    ((ProtocolManager *)protocol_mgr)->print_buffer();
+  });
+
+  // Pretty print the full protocol program, line by line, see `start_dump()`
+  registry.add("proto?", this, [](const char *, void *protocol_mgr) {
+    if (!((ProtocolManager *)protocol_mgr)->start_dump(false)) {
+      tx.println("ERROR: Dump already ongoing.");
+    }
+  });
+
+  // Dump the full protocol program as binary PCS row bitmasks, see
+  // `start_dump()`
+  registry.add("proto_rows?", this, [](const char *, void *protocol_mgr) {
+    if (!((ProtocolManager *)protocol_mgr)->start_dump(true)) {
+      tx.println("ERROR: Dump already ongoing.");
+    }
+  });
+
+  // "proto_masks? <first> <last>": Read back lines <first> up to but
+  // excluding <last> in binary, as compiled into the program store, see
+  // `start_masks_dump()`. Without arguments: The full program.
+  registry.add_with_args(
+      "proto_masks?", this, [](const char *args, void *protocol_mgr) {
+        char *end;
+        long first = strtol(args, &end, 10);
+        long last = (end == args) ? 0xFFFF : strtol(end, nullptr, 10);
+        if (!((ProtocolManager *)protocol_mgr)
+                 ->start_masks_dump(constrain(first, 0L, 0xFFFFL),
+                                    constrain(last, 0L, 0xFFFFL))) {
+          tx.println("ERROR: Dump already ongoing.");
+        }
+      });
+
+  // Dump the hashes of the full protocol program per block of <block_len>
+  // lines, 32 by default, see `start_hash_dump()`
+  registry.add_with_args(
+      "proto_hash", this, [](const char *args, void *protocol_mgr) {
+        uint16_t block_len = constrain(atoi(args), 0, 1024);
+        if (!((ProtocolManager *)protocol_mgr)
+                 ->start_hash_dump(block_len ? block_len : 32)) {
+          tx.println("ERROR: Dump already ongoing.");
+        }
+      });
+
+  // Report the background scrubbing of the protocol program, tab delimited:
+  //   1) CRC32 of the program in hex, over the lines as sent in a bulk upload
+  //   2) N_lines
+  //   3) CRC32 known (1) or awaiting the first scrub pass (0)
+  //   4) Number of completed scrub passes
+  //   5) Number of passes that failed the CRC32, i.e. corrupt memory
+  registry.add("proto_crc?", this, [](const char *, void *protocol_mgr) {
+    ((ProtocolManager *)protocol_mgr)->print_scrub();
+  });
+
+  // Fire the protocol line switches from a hardware timer interrupt
+  registry.add("isr_on", this, [](const char *, void *protocol_mgr) {
+    ((ProtocolManager *)protocol_mgr)->set_use_timer(true);
+    tx.println(((ProtocolManager *)protocol_mgr)->get_use_timer());
+  });
+
+  // Fire the protocol line switches from within the main loop
+  registry.add("isr_off", this, [](const char *, void *protocol_mgr) {
+    ((ProtocolManager *)protocol_mgr)->set_use_timer(false);
+    tx.println(((ProtocolManager *)protocol_mgr)->get_use_timer());
+  });
+
+  // Report the lateness of the protocol line switches, tab delimited:
+  //   1) Number of switches
+  //   2) Last lag [µs]
+  //   3) Max lag [µs]
+  //   4) Average lag [µs]
+  registry.add("timing?", this, [](const char *, void *protocol_mgr) {
+    ((ProtocolManager *)protocol_mgr)->print_timing_stats();
+  });
+
+  // Reset the statistics on the lateness of the line switches
+  registry.add("timing_reset", this, [](const char *, void *protocol_mgr) {
+    ((ProtocolManager *)protocol_mgr)->reset_timing_stats();
+  });
+
+  // Report the timing summary of the run, reset on `play`. See
+  // `TimingQoS::print()` for the tab-delimited fields.
+  registry.add("qos?", this, [](const char *, void *protocol_mgr) {
+    ((ProtocolManager *)protocol_mgr)->get_qos().print(tx);
+  });
+
+  // Set the lateness [us] above which a line switch counts as late in `qos?`
+  registry.add_with_args("qos_late", this, [](const char *args, void *mgr) {
+    long late_us = strtol(args, nullptr, 10);
+    ((ProtocolManager *)mgr)->get_qos().set_late_threshold(max(late_us, 0L));
+    ((ProtocolManager *)mgr)->get_qos().print(tx);
+  });
+
+  // Report the statistics on following a leader MCU, see `set_follower()`,
+  // tab delimited:
+  //   1) Number of sync edges received
+  //   2) Number of edges caught up by the main loop
+  //   3) Last skew [µs]
+  //   4) Max skew [µs]
+  //   5) Average skew [µs]
+  //   6) Number of edges dropped, see `FOLLOW_EDGES_LEN`
+  registry.add("follow?", this, [](const char *, void *protocol_mgr) {
+    ((ProtocolManager *)protocol_mgr)->print_follow_stats();
+  });
+
+  // Reset the statistics on following a leader MCU
+  registry.add("follow_reset", this, [](const char *, void *protocol_mgr) {
+    ((ProtocolManager *)protocol_mgr)->reset_follow_stats();
+  });
+
+  // Pulse the sync output for <pulse us> on the marked lines only, or toggle
+  // it on every line switch when 0 (default). Replies the pulse width in use.
+  registry.add_with_args("sync_marked", this, [](const char *args, void *mgr) {
+    long pulse_us = strtol(args, nullptr, 10);
+    ((ProtocolManager *)mgr)->set_sync_marked(constrain(pulse_us, 0L, 65535L));
+    tx.println(((ProtocolManager *)mgr)->get_sync_marked());
+  });
+
+  // Drift-free scheduler: `deadline += duration` (default)
+  registry.add("sched_abs", this, [](const char *, void *protocol_mgr) {
+    ((ProtocolManager *)protocol_mgr)->set_drift_free(true);
+  });
+
+  // Legacy scheduler: `deadline = now + duration`
+  registry.add("sched_rel", this, [](const char *, void *protocol_mgr) {
+    ((ProtocolManager *)protocol_mgr)->set_drift_free(false);
+  });
+
+  // Scale all line durations at playback time by 1 / <factor>, e.g. `speed 2`
+  // plays twice as fast. Echoes the factor back.
+  registry.add_with_args(
+      "speed", this, [](const char *args, void *protocol_mgr) {
+        ProtocolManager *mgr = (ProtocolManager *)protocol_mgr;
+        double speed_q16 = atof(args) * SPEED_Q16_ONE + 0.5;
+        mgr->set_speed(constrain(speed_q16, 0., (double)SPEED_Q16_MAX));
+        mgr->print_speed();
+      });
+
+  // Select what to do with the lines too short to keep up with, see
+  // `OverloadPolicy`:
+  //   overload <policy> [min us]
+  // with <min us> the minimum line duration under `OVERLOAD_DROP`. Echoes the
+  // policy back as `overload?`.
+  registry.add_with_args(
+      "overload", this, [](const char *args, void *protocol_mgr) {
+        ProtocolManager *mgr = (ProtocolManager *)protocol_mgr;
+        char *end;
+        long policy = strtol(args, &end, 10);
+        long min_us = strtol(end, &end, 10);
+        if ((policy >= 0) && (policy < N_OVERLOAD_POLICIES)) {
+          mgr->set_overload((OverloadPolicy)policy,
+                            (min_us > 0) ? min_us : OVERLOAD_MIN_US);
+        }
+        mgr->print_overload(tx);
+      });
+
+  // Report the overload policy and its counters, reset on `play` and by
+  // `timing_reset`. See `print_overload()` for the tab-delimited fields.
+  registry.add("overload?", this, [](const char *, void *protocol_mgr) {
+    ((ProtocolManager *)protocol_mgr)->print_overload(tx);
+  });
+
+  // Report the playback speed factor
+  registry.add("speed?", this, [](const char *, void *protocol_mgr) {
+    ((ProtocolManager *)protocol_mgr)->print_speed();
+  });
+
+  // Enforce a minimum valve on/off duration [number of lines] on the
+  // lines being played, see `ValveGuard.h`. 0 or 1 disables it. Echoes
+  // the minimum duration back.
+  registry.add_with_args(
+      "min_lines", this, [](const char *args, void *protocol_mgr) {
+        ProtocolManager *mgr = (ProtocolManager *)protocol_mgr;
+        mgr->set_min_valve_lines(constrain(atoi(args), 0, 255));
+        tx.println(mgr->get_valve_guard().get_min_lines());
+      });
+
+  // Report the minimum valve on/off duration, tab delimited:
+  //   1) Minimum duration [number of lines]
+  //   2) Number of times a valve got held against the protocol
+  registry.add("min_lines?", this, [](const char *, void *protocol_mgr) {
+    const ValveGuard &guard =
+        ((ProtocolManager *)protocol_mgr)->get_valve_guard();
+    snprintf(buf, BUF_LEN, "%u\t%lu", guard.get_min_lines(),
+             (unsigned long)guard.get_N_held());
+    tx.println(buf);
+  });
+
+  // Transform the lines at playback time, see `MaskTransform.h`:
+  //   xform <orientation> <dx> <dy> <invert>
+  // Trailing parameters can be left out, defaulting to 0. `xform` by itself
+  // restores the identity. Echoes the transform back as `xform?`.
+  registry.add_with_args(
+      "xform", this, [](const char *args, void *protocol_mgr) {
+        ProtocolManager *mgr = (ProtocolManager *)protocol_mgr;
+        long values[4] = {0, 0, 0, 0};
+        char *end;
+        for (long &value : values) {
+          long parsed = strtol(args, &end, 10);
+          if (end == args) {
+            break;
+          }
+          value = parsed;
+          args = end;
+        }
+        const long span = NUMEL_PCS_AXIS;
+        if (!mgr->set_transform(constrain(values[0], 0, 255),
+                                constrain(values[1], -span, span),
+                                constrain(values[2], -span, span),
+                                values[3] != 0)) {
+          tx.println("ERROR: Invalid transform, dx + dy must be even.");
+          return;
+        }
+        mgr->get_transform().print(tx);
+      });
+
+  // Report the transform of the lines, tab delimited:
+  //   1) Orientation, see `N_ORIENTATIONS`
+  //   2) dx
+  //   3) dy
+  //   4) Inverted (1) or not (0)
+  registry.add("xform?", this, [](const char *, void *protocol_mgr) {
+    ((ProtocolManager *)protocol_mgr)->get_transform().print(tx);
+  });
+
+  // Stagger the line switches toggling many valves over sub-steps, see
+  // `ActuationStagger.h`. Only when firing the switches from the timer:
+  //   stagger <N steps> <spacing [us]> <min changes> <order>
+  // Order 0 deals out per Centipede port, 1 per valve. Fewer than 2 steps
+  // disables it. Echoes the settings back as `stagger?`.
+  registry.add_with_args(
+      "stagger", this, [](const char *args, void *protocol_mgr) {
+        ProtocolManager *mgr = (ProtocolManager *)protocol_mgr;
+        long values[4] = {0, 0, 0, 0};
+        char *end;
+        for (long &value : values) {
+          long parsed = strtol(args, &end, 10);
+          if (end == args) {
+            break;
+          }
+          value = parsed;
+          args = end;
+        }
+        mgr->set_stagger(constrain(values[0], 0, 255),
+                         constrain(values[1], 0, 65535),
+                         constrain(values[2], 0, 255),
+                         values[3] ? STAGGER_BITS : STAGGER_PORTS);
+        mgr->get_stagger().print(tx);
+      });
+
+  // Report the staggering of the line switches, tab delimited:
+  //   1) Number of sub-steps, 0 or 1 when disabled
+  //   2) Spacing between the sub-steps [us]
+  //   3) Minimum number of toggling valves to stagger
+  //   4) Order, 0: per port, 1: per valve
+  //   5) Number of switches staggered
+  registry.add("stagger?", this, [](const char *, void *protocol_mgr) {
+    ((ProtocolManager *)protocol_mgr)->get_stagger().print(tx);
+  });
+
+  // Compensate the opening and closing latency of each valve, see
+  // `ValveLatency.h`. Only when firing the switches from the timer:
+  //   latency <enable> <slot width [us]>
+  // Takes precedence over `stagger`. Echoes the settings back as `latency?`.
+  registry.add_with_args(
+      "latency", this, [](const char *args, void *protocol_mgr) {
+        ProtocolManager *mgr = (ProtocolManager *)protocol_mgr;
+        char *end;
+        long enable = strtol(args, &end, 10);
+        long slot_us = strtol(end, &end, 10);
+        if (slot_us <= 0) {
+          slot_us = VALVE_LATENCY_SLOT_US;
+        }
+        mgr->get_latency().set(enable != 0, min(slot_us, 65535L));
+        mgr->get_latency().print(tx);
+      });
+
+  // Report the latency compensation, tab delimited:
+  //   1) Enabled (1) or not (0)
+  //   2) Width of the time slots [us]
+  //   3) Largest latency in the table [us]
+  //   4) Number of switches compensated
+  //   5) Number of switches that needed wider slots
+  registry.add("latency?", this, [](const char *, void *protocol_mgr) {
+    ((ProtocolManager *)protocol_mgr)->get_latency().print(tx);
+  });
+
+  // Set the calibrated latencies of a valve, 0 meaning all valves:
+  //   latency_valve <valve> <opening [us]> <closing [us]>
+  // Echoes the valve back as a line of `latency_table?`.
+  registry.add_with_args(
+      "latency_valve", this, [](const char *args, void *protocol_mgr) {
+        ValveLatency &latency =
+            ((ProtocolManager *)protocol_mgr)->get_latency();
+        long values[3] = {-1, 0, 0};
+        char *end;
+        for (long &value : values) {
+          long parsed = strtol(args, &end, 10);
+          if (end == args) {
+            break;
+          }
+          value = parsed;
+          args = end;
+        }
+        if ((values[0] < 0) ||
+            !latency.set_valve(values[0], constrain(values[1], 0, 65535),
+                               constrain(values[2], 0, 65535))) {
+          tx.println("ERROR: Invalid valve number.");
+          return;
+        }
+        uint8_t valve = values[0] ? values[0] : 1;
+        snprintf(buf, BUF_LEN, "%u\t%u\t%u", (uint8_t)values[0],
+                 latency.get_open_us(valve), latency.get_close_us(valve));
+        tx.println(buf);
+      });
+
+  // Report the calibrated latencies, one valve per line, tab delimited:
+  //   1) Valve number
+  //   2) Opening latency [us]
+  //   3) Closing latency [us]
+  registry.add("latency_table?", this, [](const char *, void *protocol_mgr) {
+    ((ProtocolManager *)protocol_mgr)->get_latency().print_table(tx);
+  });
+}
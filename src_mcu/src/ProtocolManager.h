@@ -2,7 +2,7 @@
  * @file    ProtocolManager.h
  * @author  Dennis van Gils (vangils.dennis@gmail.com)
  * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
- * @date    14-04-2023
+ * @date    15-10-2026
  *
  * @brief   Provides classes `P`, `Line`, `PackedLine` and `ProtocolManager`,
  * needed for reading in and playing back a protocol program for the jetting
@@ -18,8 +18,21 @@
 #ifndef PROTOCOL_MANAGER_H_
 #define PROTOCOL_MANAGER_H_
 
+#include "ActuationStagger.h"
 #include "CentipedeManager.h"
+#include "CommandRegistry.h"
 #include "FastLED.h"
+#include "MemoryArena.h"
+#include "LEDCompositor.h"
+#include "MaskTransform.h"
+#include "PeripheralSim.h"
+#include "PlaybackTimer.h"
+#include "SpscQueue.h"
+#include "TimingQoS.h"
+#include "Trace.h"
+#include "ValveGuard.h"
+#include "ValveLatency.h"
+#include "ValveSet.h"
 #include "constants.h"
 
 #include <Arduino.h>
@@ -28,16 +41,194 @@
 // See `main.cpp`
 extern const uint8_t BUF_LEN; // Common character buffer for string formatting
 extern char buf[];            // Common character buffer for string formatting
-extern CRGB leds[256];        // LED matrix
-extern const bool DEBUG;      // Print debug info over serial?
+extern LEDCompositor led_compositor; // Layers of the LED matrix
 extern const bool NO_PERIPHERALS; // Allows developing code on a bare Arduino
                                   // without sensors & actuators attached
 
+// Packing formats of a protocol line, see `PROTOCOL_PACKING`
+#define PACKING_PCS_ROWS 0   // PCS row bitmasks, 32 bytes per line
+#define PACKING_CP_MASKS 1   // Centipede port bitmasks, 18 bytes per line
+#define PACKING_VALVE_BITS 2 // Valve bitset, 16 bytes per line
+
+/**
+ * @brief Packing format of each protocol line in memory.
+ *
+ * `PACKING_CP_MASKS` (default): Each protocol line gets 'compiled' only once,
+ * inside of `ProtocolManager::add_line()`, into its final Centipede port
+ * bitmasks. The validity of each PCS point gets checked at that moment too.
+ * Activating a line then boils down to a 16-byte copy followed by
+ * `send_masks()`. The LEDs to recolor follow directly from the bits that
+ * changed with respect to the previous line. This takes the CPU jitter out of
+ * protocols with short line durations. A line takes up 18 bytes.
+ *
+ * `PACKING_VALVE_BITS`: Only 112 of the 225 PCS points can hold a valve, so
+ * each protocol line gets stored as a 112-bit valve bitset, bit `valve - 1`
+ * per valve, taking up 16 bytes. Activating a line walks over the set bits
+ * only, translating each via the look-up table `VALVE2ADDR`. Allows for the
+ * most lines to be stored uncompressed.
+ *
+ * `PACKING_PCS_ROWS`: Each protocol line gets stored as PCS row bitmasks,
+ * which have to be unpacked and translated point-by-point via the look-up
+ * table `P2ADDR` at every line transition. A line takes up 32 bytes.
+ *
+ * In all formats, the validity of each PCS point gets checked only once, when
+ * the line gets added.
+ */
+#ifndef PROTOCOL_PACKING
+#  define PROTOCOL_PACKING PACKING_CP_MASKS
+#endif
+
+// Compression formats of a protocol program, see `PROTOCOL_COMPRESSED`
+#define COMPRESSION_NONE 0  // Fixed-size `PackedLine` per line
+#define COMPRESSION_DELTA 1 // XOR-deltas against the previous line
+#define COMPRESSION_DICT 2  // Dictionary of unique valve patterns
+#define COMPRESSION_FRAMES 3 // Constant-rate frames, a valve bitset each
+
+/**
+ * @brief Store the protocol program in compressed form?
+ *
+ * `COMPRESSION_DELTA` (default): The protocol lines get stored into a byte
+ * pool as XOR-deltas of the Centipede port bitmasks against the previous line.
+ * Only the changed ports are stored, the duration only when it changed and
+ * consecutive identical lines are merged into a single run. The capacity then
+ * scales with the entropy of the protocol instead of with its number of lines.
+ * A keyframe every `PROTOCOL_CHECKPOINT_INTERVAL` lines keeps random access,
+ * e.g. by `goto_line()`, fast.
+ *
+ * `COMPRESSION_DICT`: Each unique set of opened valves, i.e. pattern, gets
+ * stored only once into a dictionary inside the byte pool, as its final
+ * Centipede port bitmasks. Each line then takes up 4 bytes: Its duration and
+ * the index of its pattern. Suits thresholded noise protocols, which revisit
+ * the same patterns often, in non-consecutive lines. A new pattern costs an
+ * additional 16 bytes. Random access is a plain table look-up.
+ *
+ * `COMPRESSION_FRAMES`: For constant-rate protocols, like the generated ones
+ * with their fixed `DT_FRAME`. The line duration gets stored only once, as the
+ * frame tick shared by all lines, and each line as a frame: a 112-bit valve
+ * bitset of 14 bytes. Appending a line of another duration than the first one
+ * fails. Any access is a look-up at a fixed offset without any duration to
+ * decode, after which the frame gets translated like `ValveSet`. Suits
+ * protocols that hardly repeat themselves, where the other formats gain
+ * little.
+ *
+ * `COMPRESSION_NONE`: Each protocol line takes up a fixed-size `PackedLine`.
+ *
+ * Compression requires `PACKING_CP_MASKS`.
+ */
+#ifndef PROTOCOL_COMPRESSED
+#  define PROTOCOL_COMPRESSED COMPRESSION_DELTA
+#endif
+
+#if PROTOCOL_COMPRESSED && (PROTOCOL_PACKING != PACKING_CP_MASKS)
+#  error "PROTOCOL_COMPRESSED requires PACKING_CP_MASKS"
+#endif
+
+#if (PROTOCOL_COMPRESSED < 0) || (PROTOCOL_COMPRESSED > COMPRESSION_FRAMES)
+#  error "PROTOCOL_COMPRESSED must be COMPRESSION_NONE, _DELTA, _DICT, _FRAMES"
+#endif
+
+/**
+ * @brief Store an uncompressed program as a structure of arrays?
+ *
+ * 0 (default): An array of `PackedLine`, the duration of each line
+ * interleaved with its bitmasks.
+ *
+ * 1: Two arrays: the durations of all lines, followed by the bitmasks of all
+ * lines. Passes that only need the durations, like rebuilding the `TimeIndex`,
+ * then stride through 2 bytes per line instead of a full `PackedLine`, and
+ * passes that only need the bitmasks don't drag the durations along. Playback
+ * is unaffected.
+ *
+ * Requires `COMPRESSION_NONE`.
+ */
+#ifndef PROTOCOL_SOA
+#  define PROTOCOL_SOA 0
+#endif
+
+#if PROTOCOL_SOA && PROTOCOL_COMPRESSED
+#  error "PROTOCOL_SOA requires COMPRESSION_NONE"
+#endif
+
+/**
+ * @brief Number of protocol programs held in memory: An active one that is
+ * being played back and, when set to 2, a staging one. A new program gets
+ * uploaded into the staging slot while the active program keeps on playing,
+ * after which both get swapped at a line boundary, see
+ * `ProtocolManager::swap()`. Two slots only fit inside RAM when the programs
+ * are stored compressed.
+ */
+#ifndef PROTOCOL_SLOTS
+#  if PROTOCOL_COMPRESSED
+#    define PROTOCOL_SLOTS 2
+#  else
+#    define PROTOCOL_SLOTS 1
+#  endif
+#endif
+
+#if (PROTOCOL_SLOTS < 1) || (PROTOCOL_SLOTS > 2)
+#  error "PROTOCOL_SLOTS must be 1 or 2"
+#endif
+
+#if (PROTOCOL_SLOTS > 1) && !PROTOCOL_COMPRESSED
+#  error "PROTOCOL_SLOTS 2 requires PROTOCOL_COMPRESSED to fit inside RAM"
+#endif
+
 /**
  * @brief The maximum number of protocol lines that a protocol program can
- * contain. Make it as large as free RAM allows.
+ * contain, bounding the line indices. The memory assigned to the program slot
+ * at boot, see `ProtocolManager::begin()`, might fill up before. Uncompressed,
+ * a line takes up a fixed-size `PackedLine`. With `COMPRESSION_DELTA`, a line
+ * costs at most 20 bytes, a line of which only a single port changed costs 4
+ * bytes and a repeated line is free. With `COMPRESSION_DICT`, a line costs 4
+ * bytes plus 16 bytes for a new pattern. With `COMPRESSION_FRAMES`, a line
+ * costs 14 bytes.
+ */
+const uint16_t PROTOCOL_MAX_LINES = 30000;
+
+/**
+ * @brief The maximum size [bytes] of the header stored alongside a protocol
+ * program, see `ProtocolManager::add_header()`. The `[HEADER]` section of a
+ * `.proto` file, holding its generation parameters, fits easily once
+ * compressed by the PC.
+ */
+const uint16_t PROTOCOL_HEADER_MAX = 512;
+
+#if PROTOCOL_COMPRESSED == COMPRESSION_DELTA
+/**
+ * @brief Every so many lines a keyframe is stored, i.e. a line encoded
+ * against all valves closed, to allow for fast random access.
+ */
+const uint16_t PROTOCOL_CHECKPOINT_INTERVAL = 64;
+
+/**
+ * @brief The maximum size [bytes] of the record of a single line: control
+ * byte, port bitmap, duration and the delta of each port.
+ */
+const uint8_t PROTOCOL_RECORD_MAX_BYTES = 4 + 2 * N_CP_PORTS;
+#elif PROTOCOL_COMPRESSED == COMPRESSION_DICT
+/**
+ * @brief The maximum number of unique patterns in the dictionary.
+ */
+const uint16_t PROTOCOL_DICT_PATTERNS = 4096;
+
+/**
+ * @brief Number of buckets of the hash table that finds the duplicate
+ * patterns when appending lines. A power of 2, at least twice
+ * `PROTOCOL_DICT_PATTERNS` to keep the probe sequences short.
+ */
+const uint16_t PROTOCOL_DICT_BUCKETS = 2 * PROTOCOL_DICT_PATTERNS;
+#elif PROTOCOL_COMPRESSED == COMPRESSION_FRAMES
+/**
+ * @brief Size [bytes] of a frame, i.e. the valve bitset of a line.
  */
-const uint16_t PROTOCOL_MAX_LINES = 5000;
+const uint8_t PROTOCOL_FRAME_BYTES = (N_VALVES + 7) / 8;
+
+/**
+ * @brief Size [bytes] of the header preceding the frames, holding the frame
+ * tick. Keeps the frames 4-byte aligned at the start.
+ */
+const uint8_t PROTOCOL_FRAME_HEADER_BYTES = 4;
+#endif
 
 /**
  * @brief The maximum number of PCS points that a single protocol line can
@@ -49,14 +240,58 @@ const uint16_t PROTOCOL_MAX_LINES = 5000;
  */
 const uint16_t MAX_POINTS_PER_LINE = NUMEL_PCS_AXIS * NUMEL_PCS_AXIS;
 
+/*------------------------------------------------------------------------------
+  Line duration
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief The time duration of a protocol line is encoded into 16 bits: A 2-bit
+ * unit in the upper bits, followed by a 14-bit mantissa:
+ *
+ *   Unit 0:   1 ms, up to 16.383 s
+ *   Unit 1:   1 µs, up to 16.383 ms
+ *   Unit 2:  10 ms, up to 163.83 s
+ *   Unit 3: 100 ms, up to 27.3 min
+ *
+ * Unit 0 makes durations below 16384 ms identical to the plain milliseconds of
+ * the original upload formats. See `decode_duration_us()` and
+ * `encode_duration_us()`.
+ */
+const uint8_t DURATION_UNIT_SHIFT = 14;
+const uint16_t DURATION_MANTISSA_MASK = (1U << DURATION_UNIT_SHIFT) - 1;
+
+/**
+ * @brief Tick size [µs] of each duration unit.
+ */
+const uint32_t DURATION_UNIT_US[4] = {1000, 1, 10000, 100000};
+
+/**
+ * @brief Longest line duration that can be encoded [µs].
+ */
+const uint32_t DURATION_MAX_US = DURATION_MANTISSA_MASK * DURATION_UNIT_US[3];
+
+/**
+ * @brief Decode the encoded line duration @p duration into [µs].
+ */
+inline uint32_t decode_duration_us(uint16_t duration) {
+  return (duration & DURATION_MANTISSA_MASK) *
+         DURATION_UNIT_US[duration >> DURATION_UNIT_SHIFT];
+}
+
+/**
+ * @brief Encode @p duration_us into a line duration, using the finest unit
+ * that can hold it and rounding to the nearest tick. Whole milliseconds below
+ * 16384 ms always get encoded in unit 0. Durations beyond `DURATION_MAX_US`
+ * get saturated.
+ */
+uint16_t encode_duration_us(uint32_t duration_us);
+
 /*------------------------------------------------------------------------------
   P "Point in the Protocol Coordinate System (PCS)"
 ------------------------------------------------------------------------------*/
 
 /**
  * @brief Special value denoting an uninitialized point in the PCS.
- *
- * Also used as a sentinel to signal the end of a @p PointsArray.
  */
 const int8_t P_NULL_VAL = -128;
 
@@ -89,11 +324,23 @@ public:
    * The upper 4 bits decode the PCS x-coordinate.
    * The lower 4 bits decode the PCS y-coordinate.
    *
+   * Larger grids take `Grid::P_BITS` bits per coordinate, packed into a
+   * `Grid::packed_p_t`.
+   *
    * @return The byte-encoded PCS point
    */
-  inline uint8_t pack_into_byte() {
-    return (uint8_t)((x - PCS_X_MIN) << 4) | //
-           (uint8_t)((y - PCS_Y_MIN) & 0xF);
+  inline Grid::packed_p_t pack_into_byte() const {
+    return pack_indices(x - PCS_X_MIN, y - PCS_Y_MIN);
+  }
+
+  /**
+   * @brief Pack the zero-based PCS indices @p idx_x, i.e. `x - PCS_X_MIN`, and
+   * @p idx_y, i.e. `y - PCS_Y_MIN`, like `pack_into_byte()` does.
+   */
+  static constexpr Grid::packed_p_t pack_indices(uint8_t idx_x,
+                                                 uint8_t idx_y) {
+    return (Grid::packed_p_t)(idx_x << Grid::P_BITS) |
+           (Grid::packed_p_t)(idx_y & P_MASK);
   }
 
   /**
@@ -104,19 +351,22 @@ public:
    *
    * @param c The byte-encoded PCS point
    */
-  inline void unpack_byte(uint8_t c) {
-    x = (c >> 4) + PCS_X_MIN;
-    y = (c & 0xF) + PCS_Y_MIN;
+  inline void unpack_byte(Grid::packed_p_t c) {
+    x = (c >> Grid::P_BITS) + PCS_X_MIN;
+    y = (c & P_MASK) + PCS_Y_MIN;
   }
 
   /**
    * @brief Pretty print the PCS point as "(x, y)", useful for debugging.
    */
-  void print();
+  void print() const;
 
   // Public members
   int8_t x; // x-coordinate
   int8_t y; // y-coordinate
+
+private:
+  static const uint8_t P_MASK = (1U << Grid::P_BITS) - 1; // Per coordinate
 };
 
 /*------------------------------------------------------------------------------
@@ -124,25 +374,16 @@ public:
 ------------------------------------------------------------------------------*/
 
 /**
- * @brief List of PCS points (objects of class `P`).
+ * @brief Fixed-capacity storage of PCS points (objects of class `P`).
  *
  * The coordinates of each point `P` should correspond to a valve that needs to
  * be turned open. All unmentioned valves will remain/be set closed. The maximum
  * number of points must not exceed `MAX_POINTS_PER_LINE`.
  *
- * After the last point a sentinel must be placed to indicate the end of the
- * list. This end sentinel takes the form of a special value for `P`, namely
- * `P{P_NULL_VAL, P_NULL_VAL}`. You can also call the method `set_null()` on the
- * `P` object.
- *
- * https://cplusplus.com/reference/array/array/array:
- * An `std::array` for elements of a class type calls their default constructor.
- *
- * Hence, the default initialization here is an array full with special valued
- * `P` objects: `P{P_NULL_VAL, P_NULL_VAL}`.
+ * Only the first `Line::N_points` elements are in use. There is no end
+ * sentinel: All loops over the points are bounded by that count instead.
  */
-using PointsArray = std::array<P, MAX_POINTS_PER_LINE + 1>;
-// +1 for the end sentinel
+using PointsArray = std::array<P, MAX_POINTS_PER_LINE>;
 
 /*------------------------------------------------------------------------------
   Line
@@ -155,40 +396,111 @@ class PackedLine;
  * @brief Class to manage a duration-timed list of PCS points, corresponding to
  * valves that need to be turned open all at once for the specified duration.
  *
+ * A `Line` is large (over 450 bytes), so pass it around by reference. Fill it
+ * with `clear_points()` and `add_point()`, or `unpack_points()` directly from
+ * the byte-encoded serial format.
+ *
  * See @p PointsArray for more details.
  */
 class Line {
 public:
   Line() {}
-  Line(uint16_t duration_, PointsArray points_)
-      : duration(duration_), points(points_) {}
+
+  // Copying a `Line` is never needed and costly
+  Line(const Line &) = delete;
+  Line &operator=(const Line &) = delete;
+
+  /**
+   * @brief Remove all PCS points, leaving the duration as is.
+   */
+  inline void clear_points() { N_points = 0; }
+
+  /**
+   * @brief Append a PCS point. Points beyond `MAX_POINTS_PER_LINE` get
+   * ignored.
+   */
+  inline void add_point(const P &p) {
+    if (N_points < MAX_POINTS_PER_LINE) {
+      points[N_points] = p;
+      N_points++;
+    }
+  }
+
+  /**
+   * @brief Replace the PCS points by the given byte-encoded PCS points, see
+   * `P::unpack_byte()`. Points beyond `MAX_POINTS_PER_LINE` get ignored.
+   *
+   * @param bytes Array of byte-encoded PCS points
+   * @param N_bytes Number of byte-encoded PCS points
+   */
+  void unpack_points(const uint8_t *bytes, uint16_t N_bytes);
 
   /**
    * @brief Pack the list of PCS points into 16-bit bitmasks.
    *
-   * @param output Reference to a `PackedLine` to pack into.
+   * @param output Reference to a `PackedLine` to pack into. It gets overwritten
+   * in full, so it needs no prior initialization.
    */
   void pack_into(PackedLine &output) const;
 
   /**
    * @brief Pretty print the list of PCS points.
    */
-  void print();
+  void print() const;
+
+  inline const P *begin() const { return points.data(); }
+  inline const P *end() const { return points.data() + N_points; }
 
   // Public members
-  uint16_t duration;  // Time duration in [ms]
-  PointsArray points; // List of PCS points
+  uint16_t duration = 0; // Encoded time duration, see `decode_duration_us()`
+  uint16_t N_points = 0; // Number of PCS points in use
+  PointsArray points;    // List of PCS points
+  bool marked = false;   // See `PackedLine::is_marked()`
 };
 
 /*------------------------------------------------------------------------------
   PackedLine
 ------------------------------------------------------------------------------*/
 
+/**
+ * @brief Bitmasks of the PCS rows: Bit `x - PCS_X_MIN` of element
+ * `PCS_Y_MAX - y` is set when the valve at PCS point (x, y) is to be opened.
+ * This is the format in which the PC sends the lines in a bulk upload.
+ */
+using PCS_Rows = std::array<Grid::row_t, NUMEL_PCS_AXIS>;
+
+/**
+ * @brief Bit of PCS row 0 marking the line, see `PackedLine::is_marked()`. The
+ * PCS rows span fewer bits than their type holds, hence it holds no valve.
+ */
+const Grid::row_t PCS_ROW_MARKER = 1U << NUMEL_PCS_AXIS;
+static_assert(NUMEL_PCS_AXIS < 8 * sizeof(Grid::row_t),
+              "No spare bit left in the PCS rows for the line marker");
+
+// Word and bit of `PackedLine::masks` holding the line marker
+#if PROTOCOL_PACKING == PACKING_CP_MASKS
+const uint8_t LINE_MARKER_WORD = LINE_MARKER_CP_PORT;
+const uint16_t LINE_MARKER_MASK = 1U << LINE_MARKER_CP_BIT;
+#elif PROTOCOL_PACKING == PACKING_VALVE_BITS
+const uint8_t LINE_MARKER_WORD = 0;
+const uint16_t LINE_MARKER_MASK = 0; // The valve bitset has no spare bit
+#else
+const uint8_t LINE_MARKER_WORD = 0;
+const uint16_t LINE_MARKER_MASK = PCS_ROW_MARKER;
+#endif
+
+// Does the protocol program store the line marker? See
+// `PackedLine::is_marked()`.
+const bool LINE_MARKER_STORED =
+    (LINE_MARKER_MASK != 0) && (PROTOCOL_COMPRESSED != COMPRESSION_FRAMES);
+
 /**
  * @brief Class to manage a packed version of a @p Line object.
  *
  * Packing a `Line` means that the full list of PCS points that make up that
- * line will get encoded into 16-bit bitmasks, one for each PCS row.
+ * line will get encoded into 16-bit bitmasks, depending on `PROTOCOL_PACKING`:
+ * The final Centipede port bitmasks, one for each port, a valve bitset, or
+ * bitmasks in the PCS, one for each PCS row.
  *
  * Benefit to packing is the constant array dimension and less memory footprint
  * than using `Line` when using a large number of points `P`. This allows for
@@ -213,11 +525,67 @@ public:
    */
   void unpack_into(Line &output) const;
 
+  /**
+   * @brief Translate the bitmasks into the Centipede port bitmasks that will
+   * open the valves of this line.
+   *
+   * When packed as `PACKING_CP_MASKS`, this is a plain copy.
+   *
+   * @param output Reference to the Centipede port bitmasks to write into.
+   */
+  void get_cp_masks(CP_Masks &output) const;
+
+  /**
+   * @brief Pack the PCS row bitmasks @p rows into this line, overwriting all
+   * of its bitmasks. The duration is left as is.
+   *
+   * When packed as `PACKING_PCS_ROWS`, this is a plain copy after validation.
+   */
+  void pack_pcs_rows(const PCS_Rows &rows);
+
+  /**
+   * @brief Pack the open valves @p valves into this line, overwriting all of
+   * its bitmasks. The duration is left as is.
+   *
+   * A `ValveSet` holds valid valves only, so nothing needs checking. When
+   * packed as `PACKING_CP_MASKS` or `PACKING_VALVE_BITS`, this takes a fixed
+   * number of word operations regardless of the number of open valves.
+   */
+  void pack_valves(const ValveSet &valves);
+
+  /**
+   * @brief Is this line marked? A marked line pulses the sync output when
+   * switched to, e.g. to trigger a camera, see
+   * `ProtocolManager::set_sync_marked()`. The PC marks a line by setting
+   * `PCS_ROW_MARKER` in its PCS rows.
+   *
+   * The marker occupies a bit of the bitmasks that holds no valve, hence it
+   * gets stored by every compression format keeping the Centipede port
+   * bitmasks. Not so by `PACKING_VALVE_BITS` and `COMPRESSION_FRAMES`, whose
+   * valve bitsets lack a spare bit: Their lines are never marked.
+   */
+  inline bool is_marked() const {
+    return masks[LINE_MARKER_WORD] & LINE_MARKER_MASK;
+  }
+
+  inline void set_marked(bool marked) {
+    masks[LINE_MARKER_WORD] = (masks[LINE_MARKER_WORD] & ~LINE_MARKER_MASK) |
+                              (marked ? LINE_MARKER_MASK : 0);
+  }
+
   // Public members
-  uint16_t duration; // Time duration in [ms]
+  uint16_t duration; // Encoded time duration, see `decode_duration_us()`
 
+#if PROTOCOL_PACKING == PACKING_CP_MASKS
+  // Valves to be opened, packed into Centipede port bitmasks
+  CP_Masks masks;
+#elif PROTOCOL_PACKING == PACKING_VALVE_BITS
+  // Valves to be opened, packed into a bitset: bit `valve - 1`
+  std::array<uint16_t, (N_VALVES + 15) / 16> masks;
+#else
   // List of PCS points packed into bitmasks
-  std::array<uint16_t, NUMEL_PCS_AXIS> masks;
+  PCS_Rows masks;
+#endif
 };
 
 /*------------------------------------------------------------------------------
@@ -225,140 +593,1996 @@ public:
 ------------------------------------------------------------------------------*/
 
 /**
- * @brief The protocol program fully stored in memory.
- *
- * It is an array containing timed protocol lines, each line containing the
- * valves to be opened for the time duration as specified. Each protocol line
- * is actually packed into a bitmask to save on memory. Method @p unpack_into()
- * must be called on the @p PackedLine object to get the list of PCS points
- * (which we then loop over in @p main.cpp to 1: finally open the referred
- * valves and close the others and 2: to light up the appropiate LEDs of the
- * 16x16 LED matrix).
+ * @brief Build flags a raw program image depends on, see `Program::image()`.
+ * Images produced under a different format can not be restored.
  */
-using Program = std::array<PackedLine, PROTOCOL_MAX_LINES>;
-
-/*------------------------------------------------------------------------------
-  ProtocolManager
-------------------------------------------------------------------------------*/
+#if PROTOCOL_COMPRESSED == COMPRESSION_DELTA
+const uint16_t PROGRAM_IMAGE_FORMAT =
+    PROTOCOL_PACKING | COMPRESSION_DELTA << 2 |
+    (PROTOCOL_CHECKPOINT_INTERVAL & 0xFF) << 8;
+#elif PROTOCOL_COMPRESSED == COMPRESSION_DICT
+const uint16_t PROGRAM_IMAGE_FORMAT = PROTOCOL_PACKING | COMPRESSION_DICT << 2;
+#elif PROTOCOL_COMPRESSED == COMPRESSION_FRAMES
+const uint16_t PROGRAM_IMAGE_FORMAT =
+    PROTOCOL_PACKING | COMPRESSION_FRAMES << 2 | PROTOCOL_FRAME_BYTES << 8;
+#else
+const uint16_t PROGRAM_IMAGE_FORMAT = PROTOCOL_PACKING | PROTOCOL_SOA << 4;
+#endif
 
 /**
- * @brief Class to manage reading in and playing back a protocol program. Only
- * one protocol program can be in memory at a time.
+ * @brief The protocol program fully stored in memory.
+ *
+ * It holds timed protocol lines, each line containing the valves to be opened
+ * for the time duration as specified. Each protocol line is handed out as a
+ * @p PackedLine via method @p get(). Method @p get_cp_masks() must be called on
+ * that `PackedLine` object to get the Centipede port bitmasks that 1: finally
+ * open the referred valves and close the others and 2: tell which LEDs of the
+ * 16x16 LED matrix to light up. Method @p unpack_into() can be called to get
+ * the list of PCS points instead.
+ *
+ * When `PROTOCOL_COMPRESSED` is set the lines are stored compressed, see
+ * there. With `COMPRESSION_DELTA`, sequential access via `get()` decodes a
+ * single record. Random access decodes at most `PROTOCOL_CHECKPOINT_INTERVAL`
+ * records. With `COMPRESSION_DICT`, any access is a look-up of the line
+ * followed by a look-up of its pattern. With `COMPRESSION_FRAMES`, any access
+ * is a look-up of the frame. With `PROTOCOL_SOA`, any access is a look-up in
+ * both arrays.
  */
-class ProtocolManager {
+class FlashProgram;
+
+class Program {
 public:
-  ProtocolManager(CentipedeManager *cp_mgr);
+  Program() { clear(); }
 
   /**
-   * @brief Clear the protocol program.
-   *
-   * Operation takes less than 3 ms to complete.
+   * @brief Assign the raw storage of @p N_bytes bytes at @p pool, 4-byte
+   * aligned, to the program, e.g. carved out of the `MemoryArena` at boot.
+   * Removes all lines. Without storage, each `append()` fails.
+   */
+  void assign(uint8_t *pool, uint32_t N_bytes);
+
+  /**
+   * @brief Remove all lines. An attached image gets released, returning to
+   * the raw storage of `assign()`.
    */
   void clear();
 
   /**
-   * @brief Add a new Line to the protocol program.
+   * @brief Play the raw program image @p image of @p N_bytes bytes holding
+   * @p N_lines lines in place, as produced by `image()`, e.g. an embedded
+   * protocol in internal flash, see `embedded_protocols.h`. Nothing gets
+   * copied. The image is read-only: `append()` fails until `clear()`.
    *
-   * @param duration Time duration in ms
-   * @param points List of PCS points of which the corresponding valves will be
-   * set open for the given duration. All other valves will be set closed.
-   * @return True when the new line is successfully added. False otherwise,
-   * because the maximum number of lines has been reached.
+   * @return True when successful. False otherwise, because the image is
+   * inconsistent, leaving the program empty.
    */
-  bool add_line(uint16_t duration, const PointsArray &points);
-  bool add_line(const Line &line);
+  bool attach(const uint8_t *image, uint16_t N_lines, uint32_t N_bytes);
 
   /**
-   * @brief Prime the start of the protocol program such that `update()` will
-   * start the program directly at line position 0 wihout any delay.
-   *
-   * Note: Calling this method will /not/ activate any solenoid valves just yet.
-   * `update()` must be called subsequently to trigger activation of line 0.
+   * @brief Is an image attached, see `attach()`?
    */
-  void prime_start();
+  inline bool is_embedded() const { return _embedded; }
 
+#if PROTOCOL_COMPRESSED == COMPRESSION_DELTA
   /**
-   * @brief Go to Line number @p line_no of the protocol program (index starts
-   * at 0) and immediately activate the solenoid valves and color the LED
-   * matrix.
+   * @brief Play the program image opened by @p reader in place from the QSPI
+   * flash, see `FlashProgram`. Nothing gets copied and each access gets
+   * forwarded to the reader. Like `attach()`, `append()` fails until
+   * `clear()`, which closes the reader.
    */
-  void goto_line(uint16_t line_no);
+  void attach_flash(FlashProgram &reader);
+#endif
 
   /**
-   * @brief Go to the next Line of the protocol program and
-   * immediately activate the solenoid valves and color the LED matrix.
+   * @brief Does the program play from the QSPI flash, see `attach_flash()`?
    */
-  void goto_next_line();
+  inline bool is_flash_resident() const { return _flash != nullptr; }
 
   /**
-   * @brief Go to the previous Line of the protocol program and
-   * immediately activate the solenoid valves and color the LED matrix.
+   * @brief Prefetch hint: line number @p idx is up next in the playback. Only
+   * of use when playing from the QSPI flash, see `FlashProgram::hint()`.
    */
-  void goto_prev_line();
+  inline void hint(uint16_t idx) {
+    if (_flash) {
+      flash_hint(idx);
+    }
+  }
 
   /**
-   * @brief Immediately activate the solenoid valves and color the LED matrix,
-   * based on the current @p _line_buffer contents.
+   * @brief Append a line to the end of the program.
+   *
+   * @return True when successful. False otherwise, because the program is
+   * full or an attached image.
    */
-  void activate_buffer();
+  bool append(const PackedLine &line);
 
   /**
-   * @brief Run the timer of the protocol program.
+   * @brief Retrieve line number @p idx (index starts at 0).
    *
-   * It will automatically activate the solenoid valves and color the LED matrix
-   * accordingly, going line for line through the protocol program on its
-   * specified time track.
+   * @param output Reference to a `PackedLine` to write into.
    */
-  void update();
+  void get(uint16_t idx, PackedLine &output);
 
   /**
-   * @brief Print the protocol program name and total number of lines.
+   * @brief Retrieve line number @p idx like `get()`, but only when at hand.
+   * When playing from the QSPI flash, its block must have been read in
+   * already, see `FlashProgram::try_get()`.
+   *
+   * @return True when successful. False otherwise.
    */
-  void print_program();
+  inline bool try_get(uint16_t idx, PackedLine &output) {
+    if (_flash) {
+      return flash_try_get(idx, output);
+    }
+    get(idx, output);
+    return true;
+  }
 
   /**
-   * @brief Pretty print the full protocol program, line by line.
+   * @brief Return the encoded time duration of line number @p idx, see
+   * `decode_duration_us()`. For the passes over the durations only: Except
+   * with `COMPRESSION_DELTA`, the bitmasks don't get read.
    */
-  void print_full_program();
+  uint16_t get_duration(uint16_t idx);
+
+  inline uint16_t size() const { return _N_lines; }
 
   /**
-   * @brief Pretty print the current line buffer, useful for debugging.
+   * @brief Raw storage of the program, used for saving it to and restoring it
+   * from the protocol library in flash. Only the first `get_N_image_bytes()`
+   * bytes are in use, out of at most `get_max_image_bytes()`.
+   *
+   * With `COMPRESSION_DICT`, the dictionary gets moved adjacent to the lines
+   * first, and back on the next `append()`.
    */
-  void print_buffer();
+  uint8_t *image();
+  uint32_t get_N_image_bytes() const;
 
-  inline void set_name(const char *name) { strncpy(_name, name, 64); }
-  inline char *get_name() { return _name; }
-  inline uint16_t get_N_lines() { return _N_lines; }
+  /**
+   * @brief Rebuild the program after its raw storage got overwritten via
+   * `image()` with @p N_bytes bytes holding @p N_lines lines.
+   *
+   * @return True when successful. False otherwise, because the image is
+   * inconsistent, leaving the program empty.
+   */
+  bool restore(uint16_t N_lines, uint32_t N_bytes);
 
   /**
-   * @brief Return the current protocol position starting at index 0. I.e. the
-   * playback position / current line number.
+   * @brief Return the unused tail of the raw storage as scratch memory, 4-byte
+   * aligned. It remains valid only until the program gets modified.
+   *
+   * @param N_bytes Reference to write the size of the scratch memory into
    */
-  inline int16_t get_position() { return _pos; }
+  uint8_t *spare(uint32_t &N_bytes);
+
+  /**
+   * @brief Return the size of the raw storage, see `assign()`.
+   */
+  inline uint32_t get_max_image_bytes() const { return _pool_bytes; }
 
 private:
-  Program _program;        // Protocol program currently loaded into memory
-  char _name[64] = {'\0'}; // Name of the protocol program
-  uint16_t _N_lines;       // Total number of lines in the protocol program
-  uint16_t _pos; // Playback position; current line number starting at index 0
-  uint32_t _tick = 0;        // Timestamp [ms] of last activated protocol line
-  Line _last_activated_line; // The Line data that was last activated
+  // Raw storage of `assign()`, left untouched while an image is attached
+  uint8_t *_own_pool = nullptr;
+  uint32_t _own_bytes = 0;
+  bool _embedded = false; // Is an image attached, see `attach()`?
+  FlashProgram *_flash = nullptr; // See `attach_flash()`
+
+  void flash_hint(uint16_t idx);
+  bool flash_try_get(uint16_t idx, PackedLine &output);
+
+  /**
+   * @brief Point the program at the raw storage of @p N_bytes bytes at
+   * @p pool and remove all lines.
+   */
+  void use_storage(uint8_t *pool, uint32_t N_bytes);
+
+  /**
+   * @brief Remove all lines of the storage in use.
+   */
+  void reset();
+
+public:
 
+#if PROTOCOL_COMPRESSED == COMPRESSION_DELTA
   /**
-   * @brief Buffer containing the current @p Line to be activated.
+   * @brief Return the number of bytes in use of the compressed byte pool.
+   */
+  inline uint32_t get_N_bytes() const { return _N_bytes; }
+
+  /**
+   * @brief Decode the record at @p rec onto @p line, holding the previous
+   * line, or all valves closed at a keyframe. See the record layout in
+   * `ProtocolManager.cpp`.
    *
-   * One can go through each PCS point of the Line object as follows:
+   * @param run Reference to write the number of repeats of the line into
    *
-   * @code{.cpp}
-   * for (auto &p : _line_buffer.points) {
-   *   if (p.is_null()) {
-   *     break; // Reached the end sentinel
-   *   }
-   *   // Code goes here to handle each PCS point `p`
-   * }
-   * @endcode
+   * @return Pointer past the record
+   */
+  static const uint8_t *decode_record(const uint8_t *rec, PackedLine &line,
+                                      uint8_t &run);
+
+private:
+  uint8_t *_pool = nullptr; // Compressed records
+  uint32_t _pool_bytes = 0; // Size of the pool
+  uint32_t _N_bytes;        // Number of bytes in use of the pool
+  uint16_t _N_lines; // Number of lines stored
+
+  // Byte offset into the pool of each keyframe record
+  std::array<uint32_t, PROTOCOL_MAX_LINES / PROTOCOL_CHECKPOINT_INTERVAL + 1>
+      _checkpoints;
+
+  // Encoder state
+  PackedLine _enc_line; // Last appended line
+  uint32_t _enc_ofs;    // Byte offset of the last record, i.e. the open run
+
+  // Decoder cursor
+  PackedLine _dec_line; // Decoded line at cursor position `_dec_idx`
+  uint16_t _dec_idx;    // Cursor position
+  uint32_t _dec_ofs;    // Byte offset of the record following the cursor
+  uint8_t _dec_run;     // Remaining repeats of the record at the cursor
+  bool _dec_valid;      // Is the cursor valid?
+
+  /**
+   * @brief Advance the decoder cursor by one line.
+   */
+  void step();
+#elif PROTOCOL_COMPRESSED == COMPRESSION_DICT
+  /**
+   * @brief Return the number of bytes in use of the byte pool.
+   */
+  inline uint32_t get_N_bytes() const {
+    return _N_lines * sizeof(DictLine) + _N_patterns * sizeof(CP_Masks);
+  }
+
+  /**
+   * @brief Return the number of unique patterns in the dictionary.
+   */
+  inline uint16_t get_N_patterns() const { return _N_patterns; }
+
+private:
+  struct DictLine {
+    uint16_t duration; // Encoded time duration
+    uint16_t pattern;  // Index into the dictionary
+  };
+
+  // Lines grow upwards from the start of the pool, each a `DictLine`. The
+  // dictionary grows downwards from `_dict_end`, holding pattern `i` at
+  // `_dict_end - (i + 1) * sizeof(CP_Masks)`. `_dict_end` is the end of the
+  // pool, except after `image()` moved the dictionary adjacent to the lines.
+  uint8_t *_pool = nullptr;
+  uint32_t _pool_bytes = 0; // Size of the pool
+  uint32_t _dict_end;       // Byte offset of the end of the dictionary
+  uint16_t _N_lines;    // Number of lines stored
+  uint16_t _N_patterns; // Number of patterns in the dictionary
+
+  // Hash table of pattern index + 1 per bucket, 0 being empty. Shared by all
+  // slots, hence rebuilt whenever a different program appends lines.
+  static std::array<uint16_t, PROTOCOL_DICT_BUCKETS> _buckets;
+  static const Program *_buckets_owner;
+
+  inline DictLine *lines() { return (DictLine *)_pool; }
+
+  inline CP_Masks *pattern(uint16_t idx) {
+    return (CP_Masks *)(_pool + _dict_end) - (idx + 1);
+  }
+
+  /**
+   * @brief Return the hash table bucket holding @p masks, or the empty bucket
+   * to insert it into.
+   */
+  uint16_t find_bucket(const CP_Masks &masks);
+
+  /**
+   * @brief Move the dictionary to end at byte offset @p dict_end.
+   */
+  void move_dictionary(uint32_t dict_end);
+#elif PROTOCOL_COMPRESSED == COMPRESSION_FRAMES
+  /**
+   * @brief Return the encoded time duration shared by all lines, see
+   * `decode_duration_us()`. Only valid when the program holds lines.
+   */
+  inline uint16_t get_tick() const { return _tick; }
+
+private:
+  // The header, holding the frame tick little endian, followed by a frame of
+  // `PROTOCOL_FRAME_BYTES` bytes per line. Empty programs have no header.
+  uint8_t *_pool = nullptr;
+  uint32_t _pool_bytes = 0; // Size of the pool
+  uint16_t _max_lines = 0;  // Number of lines fitting the pool
+  uint16_t _N_lines;        // Number of lines stored
+  uint16_t _tick;           // Encoded time duration of each line
+
+  inline uint8_t *frame(uint16_t idx) {
+    return _pool + PROTOCOL_FRAME_HEADER_BYTES + idx * PROTOCOL_FRAME_BYTES;
+  }
+#elif PROTOCOL_SOA
+private:
+  using Masks = decltype(PackedLine::masks);
+
+  // The durations of all lines from the start of the pool, followed by the
+  // bitmasks of all lines from `_masks`, 4-byte aligned. The bitmasks follow
+  // the room for `_max_lines` durations, except after `image()` moved them
+  // adjacent to the durations of the lines stored.
+  uint8_t *_pool = nullptr;
+  uint32_t _pool_bytes = 0; // Size of the pool in use
+  uint16_t _max_lines = 0;  // Number of lines fitting the pool
+  uint16_t _N_lines;        // Number of lines stored
+  Masks *_masks = nullptr;  // Bitmasks of line 0
+
+  inline uint16_t *durations() { return (uint16_t *)_pool; }
+
+  /**
+   * @brief Return the byte offset of the bitmasks following @p N_lines
+   * durations.
+   */
+  static inline uint32_t masks_offset(uint16_t N_lines) {
+    return ((uint32_t)N_lines * sizeof(uint16_t) + 3) & ~3UL;
+  }
+
+  /**
+   * @brief Move the bitmasks to byte offset @p ofs.
+   */
+  void move_masks(uint32_t ofs);
+#else
+private:
+  PackedLine *_lines = nullptr; // Raw storage, see `assign()`
+  uint32_t _pool_bytes = 0;     // Size of the raw storage
+  uint16_t _max_lines = 0;      // Number of lines fitting the raw storage
+  uint16_t _N_lines;            // Number of lines stored
+#endif
+};
+
+/*------------------------------------------------------------------------------
+  TimeIndex
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Every so many lines the start time of the line is indexed, see
+ * `TimeIndex`.
+ */
+const uint16_t PROTOCOL_TIME_INTERVAL = 64;
+
+/**
+ * @brief Index of the start times of the lines of a protocol program, allowing
+ * to seek by elapsed protocol time, see `ProtocolManager::goto_time()`.
+ *
+ * Only the start time of every `PROTOCOL_TIME_INTERVAL`-th line gets stored,
+ * being a prefix sum of the line durations. A seek does a binary search over
+ * these checkpoints, followed by a walk over at most `PROTOCOL_TIME_INTERVAL`
+ * lines, which is a sequential decode in any of the storage formats.
+ */
+class TimeIndex {
+public:
+  /**
+   * @brief Remove all lines.
+   */
+  inline void clear() {
+    _total_us = 0;
+    _N_lines = 0;
+  }
+
+  /**
+   * @brief Append a line of encoded time duration @p duration.
+   */
+  void append(uint16_t duration);
+
+  /**
+   * @brief Rebuild the index from all lines of @p program.
+   */
+  void rebuild(Program &program);
+
+  /**
+   * @brief Find the line of @p program being played at @p t_us [µs] since the
+   * start of the program, which must lie within `get_total_us()`.
+   *
+   * @param start_us Reference to write the start time [µs] of the line into
+   * @return The line number (index starts at 0)
+   */
+  uint16_t find(Program &program, uint64_t t_us, uint64_t &start_us) const;
+
+  /**
+   * @brief Return the summed duration of all lines [µs].
+   */
+  inline uint64_t get_total_us() const { return _total_us; }
+
+private:
+  std::array<uint64_t, PROTOCOL_MAX_LINES / PROTOCOL_TIME_INTERVAL + 1>
+      _starts;            // Start time [µs] of every indexed line
+  uint64_t _total_us = 0; // Summed duration of all lines [µs]
+  uint16_t _N_lines = 0;  // Number of lines indexed
+};
+
+/*------------------------------------------------------------------------------
+  ProgramStats
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Number of log2-spaced bins of the line-duration histogram. Bin `b`
+ * counts the durations of [2^b, 2^(b + 1)) ms, bin 0 including those below
+ * 1 ms and the last bin those beyond.
+ */
+const uint8_t PROGRAM_STATS_BINS = 16;
+
+/**
+ * @brief Statistics of the lines of a protocol program, accumulated line by
+ * line while uploading, such that the PC can query them at once instead of
+ * rederiving them from the `.proto` file. Taken over the program as stored,
+ * i.e. before any transform or minimum valve on/off duration. The total
+ * duration is kept by `TimeIndex`.
+ */
+class ProgramStats {
+public:
+  /**
+   * @brief Remove all lines.
+   */
+  void clear();
+
+  /**
+   * @brief Account for appending @p line.
+   */
+  void append(const PackedLine &line);
+
+  /**
+   * @brief Rebuild the statistics from all lines of @p program.
+   */
+  void rebuild(Program &program);
+
+  /**
+   * @brief Print the statistics, tab delimited, continuing a line:
+   *   1) Open fraction: Mean over the lines, mean over time, min and max
+   *   5) Mean number of open valves of each manifold, over the lines
+   *   9) Line-duration histogram, see `PROGRAM_STATS_BINS`
+   */
+  void print(Stream &mySerial) const;
+
+private:
+  uint16_t _N_lines = 0;
+  uint32_t _sum_open = 0;    // Summed number of open valves over the lines
+  uint64_t _sum_open_ms = 0; // Summed number of open valves x duration [ms]
+  uint64_t _total_ms = 0;    // Summed duration [ms]
+  uint8_t _min_open = 0;     // Least number of open valves of any line
+  uint8_t _max_open = 0;     // Most number of open valves of any line
+  uint32_t _sum_open_manifold[N_MANIFOLDS] = {};
+  uint16_t _hist[PROGRAM_STATS_BINS] = {}; // Saturating at 65535
+};
+
+/*------------------------------------------------------------------------------
+  Feasibility
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Model of the time [µs] it takes the hardware to play a line: A cost
+ * per I2C transaction and per Centipede port whose bitmask changed, plus the
+ * cost of refreshing the LED matrix once within the line, see `LEDGovernor`.
+ * The defaults are the costs measured on the jetting grid, see
+ * `PeripheralSim.h`.
+ */
+struct ActuationCost {
+  uint16_t i2c_base_us = SIM_I2C_BASE_US;
+  uint16_t i2c_port_us = SIM_I2C_PORT_US;
+  uint16_t led_us = SIM_LED_US;
+
+  /**
+   * @brief Return the predicted cost [µs] of a line changing @p N_ports ports.
+   */
+  inline uint32_t predict(uint8_t N_ports) const {
+    return (N_ports ? i2c_base_us + (uint32_t)N_ports * i2c_port_us : 0) +
+           led_us;
+  }
+};
+
+/**
+ * @brief Number of infeasible line ranges `Feasibility` lists. Any further
+ * ranges only get counted.
+ */
+const uint8_t FEASIBILITY_MAX_RANGES = 16;
+
+/**
+ * @brief Feasibility of the timing of a protocol program, accumulated line by
+ * line while uploading like `ProgramStats`: The predicted cost of each line,
+ * see `ActuationCost`, against its duration. A line costing more than its
+ * duration is infeasible, i.e. playing it will run late, see
+ * `ProtocolManager::set_overload()`.
+ *
+ * Taken over the program as stored, at the playback speed of 1 and before any
+ * transform or minimum valve on/off duration. Line 0 counts the ports opened
+ * from all valves closed, not the wrap-around from the last line.
+ */
+class Feasibility {
+public:
+  /**
+   * @brief Remove all lines.
+   */
+  void clear();
+
+  /**
+   * @brief Account for appending @p line, played at the cost of @p cost.
+   */
+  void append(const PackedLine &line, const ActuationCost &cost);
+
+  /**
+   * @brief Rebuild the feasibility from all lines of @p program.
+   */
+  void rebuild(Program &program, const ActuationCost &cost);
+
+  /**
+   * @brief Print the feasibility. First a line, tab delimited:
+   *   1) Number of lines
+   *   2) Number of infeasible lines
+   *   3) Number of infeasible line ranges N
+   *   4) Minimum achievable line duration [µs], i.e. the largest cost
+   *   5) Line number of the largest cost
+   * followed by min(N, `FEASIBILITY_MAX_RANGES`) lines: The first and last
+   * line number of each infeasible range.
+   */
+  void print(Stream &mySerial) const;
+
+  inline uint16_t get_N_infeasible() const { return _N_infeasible; }
+
+private:
+  struct Range {
+    uint16_t first; // First infeasible line
+    uint16_t last;  // Last infeasible line
+  };
+
+  CP_Masks _prev_masks{};     // Centipede port bitmasks of the previous line
+  uint16_t _N_lines = 0;
+  uint16_t _N_infeasible = 0; // Number of infeasible lines
+  uint16_t _N_ranges = 0;     // Number of infeasible ranges, also unlisted
+  bool _in_range = false;     // Was the previous line infeasible?
+  uint32_t _max_cost_us = 0;  // Largest cost of any line
+  uint16_t _max_cost_line = 0;
+  Range _ranges[FEASIBILITY_MAX_RANGES];
+};
+
+/*------------------------------------------------------------------------------
+  LineRingBuffer
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Number of protocol lines the stream buffer can hold.
+ */
+const uint16_t STREAM_BUFFER_LINES = 512;
+
+/**
+ * @brief Playback of a stream starts, or resumes after running dry, once the
+ * stream buffer holds this many lines.
+ */
+const uint16_t STREAM_PREFILL_LINES = STREAM_BUFFER_LINES / 2;
+
+/**
+ * @brief First-in first-out ring buffer of protocol lines, used for streaming
+ * playback. See `ProtocolManager::start_stream()`.
+ */
+class LineRingBuffer {
+public:
+  inline void clear() {
+    _head = 0;
+    _count = 0;
+  }
+
+  /**
+   * @brief Add a line to the back of the buffer.
+   *
+   * @return True when successful. False otherwise, because the buffer is full.
+   */
+  bool push(const PackedLine &line);
+
+  /**
+   * @brief Take the line from the front of the buffer.
+   *
+   * @return True when successful. False otherwise, because the buffer is
+   * empty.
+   */
+  bool pop(PackedLine &line);
+
+  /**
+   * @brief Copy line @p idx counted from the front of the buffer, leaving it
+   * in the buffer.
+   *
+   * @return True when successful. False otherwise, because the buffer holds
+   * too few lines.
+   */
+  bool peek(uint16_t idx, PackedLine &line) const;
+
+  inline uint16_t size() const { return _count; }
+  inline uint16_t room() const { return STREAM_BUFFER_LINES - _count; }
+
+private:
+  std::array<PackedLine, STREAM_BUFFER_LINES> _lines;
+  uint16_t _head = 0;  // Index of the front line
+  uint16_t _count = 0; // Number of lines in the buffer
+};
+
+/*------------------------------------------------------------------------------
+  LineSource
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Interface of a source producing protocol lines on the fly, to be fed
+ * into the stream buffer, e.g. `NoiseGenerator` and `ProtocolScript`.
+ */
+class LineSource {
+public:
+  /**
+   * @brief Restart from the first line.
+   */
+  virtual void rewind() = 0;
+
+  /**
+   * @brief Produce the next line into @p line. Defaults to `next_valves()`.
+   *
+   * @return True when successful. False otherwise, because the source has
+   * ended.
+   */
+  virtual bool next_line(Line &line);
+
+  /**
+   * @brief Produce the next line as the set of open valves @p valves, lasting
+   * the encoded @p duration, see `encode_duration_us()`. This is how the
+   * stream buffer gets fed. Defaults to `next_line()`.
+   *
+   * Sources that decide per valve, like the generators, override this one
+   * instead of `next_line()` to skip the list of PCS points altogether. Each
+   * source must override at least one of both.
+   *
+   * @return True when successful. False otherwise, because the source has
+   * ended.
+   */
+  virtual bool next_valves(uint16_t &duration, ValveSet &valves);
+};
+
+/*------------------------------------------------------------------------------
+  ProgramSource
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Sources of the lines played back by `ProtocolManager`: the protocol
+ * program in RAM and the stream buffer.
+ *
+ * Each source provides the same methods, called by the template methods of
+ * `ProtocolManager`, e.g. `stage()`. The dispatch is static: the hot path gets
+ * compiled and inlined per source, with a single branch per line on which
+ * source is playing instead of a virtual call per method. The playback
+ * position stays with `ProtocolManager`, so the scheduler, the valve guard,
+ * the LED matrix and the statistics act alike regardless of the source.
+ *
+ *   - `uint16_t length()`: Number of lines of a looping source, or 0 when
+ *     playing once without a known end.
+ *   - `bool next(uint16_t pos, uint16_t &next_pos, PackedLine &line)`: Yield
+ *     the line following line @p pos, and its line number.
+ *   - `bool seek(uint16_t pos, PackedLine &line)`: Yield line @p pos. False
+ *     when the source can't seek.
+ *   - `bool peek(uint16_t pos, uint16_t N_ahead, PackedLine &line)`: Prefetch
+ *     hint. Copy the line @p N_ahead > 0 lines after line @p pos, being the
+ *     last line yielded, without consuming it. False when not yet known.
+ *
+ * The `LineSource` generators and live input play through the `StreamSource`.
+ * Protocols stored in the QSPI flash get loaded into RAM first, see
+ * `ProtocolLibrary`, or play through the `RAMSource` in place, read ahead by
+ * `FlashProgram` as hinted by `next()`. Protocols embedded in the internal
+ * flash play through the `RAMSource` in place, their image attached to the
+ * program of the slot, see `Program::attach()`.
+ */
+class RAMSource {
+public:
+  explicit RAMSource(Program &program) : _program(program) {}
+
+  inline uint16_t length() const { return _program.size(); }
+
+  inline bool next(uint16_t pos, uint16_t &next_pos, PackedLine &line) {
+    uint16_t N_lines = _program.size();
+    if (N_lines == 0) {
+      return false;
+    }
+    next_pos = (pos + 1 >= N_lines) ? 0 : pos + 1;
+    _program.hint(next_pos);
+    _program.get(next_pos, line);
+    return true;
+  }
+
+  inline bool seek(uint16_t pos, PackedLine &line) {
+    if (pos >= _program.size()) {
+      return false;
+    }
+    _program.get(pos, line);
+    return true;
+  }
+
+  inline bool peek(uint16_t pos, uint16_t N_ahead, PackedLine &line) {
+    uint16_t N_lines = _program.size();
+    if (N_lines == 0) {
+      // An empty program keeps all valves closed
+      line.duration = 0;
+      line.masks.fill(0);
+      return true;
+    }
+    return _program.try_get(((uint32_t)pos + N_ahead) % N_lines, line);
+  }
+
+private:
+  Program &_program;
+};
+
+class StreamSource {
+public:
+  explicit StreamSource(LineRingBuffer &ring) : _ring(ring) {}
+
+  inline uint16_t length() const { return 0; }
+
+  inline bool next(uint16_t pos, uint16_t &next_pos, PackedLine &line) {
+    if (!_ring.pop(line)) {
+      return false;
+    }
+    next_pos = pos + 1; // Simply counts up, wrapping around at 2^16
+    return true;
+  }
+
+  inline bool seek(uint16_t, PackedLine &) { return false; }
+
+  inline bool peek(uint16_t, uint16_t N_ahead, PackedLine &line) {
+    // The front of the buffer follows the last line yielded
+    return _ring.peek(N_ahead - 1, line);
+  }
+
+private:
+  LineRingBuffer &_ring;
+};
+
+/*------------------------------------------------------------------------------
+  TimingStats
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Statistics on the gap between the planned and the actual switch times
+ * of the protocol lines, as collected by `ProtocolManager::update()`.
+ */
+struct TimingStats {
+  uint32_t N_switches = 0;  // Number of timed line switches
+  uint32_t last_lag_us = 0; // Lag of the last switch [µs]
+  uint32_t max_lag_us = 0;  // Largest lag encountered [µs]
+  uint64_t sum_lag_us = 0;  // Sum of all lags [µs]
+};
+
+/*------------------------------------------------------------------------------
+  OverloadPolicy
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief What the scheduler does with lines too short for the hardware to keep
+ * up with, i.e. shorter than it takes to unpack a line, to send the valves
+ * their new states and to color the LEDs. See
+ * `ProtocolManager::set_overload()`.
+ */
+enum OverloadPolicy : uint8_t {
+  // Play every line, late. With absolute deadlines the lines following get
+  // cut short to catch up, with relative deadlines the timeline drifts.
+  OVERLOAD_LAG = 0,
+  // Fold the lines that have expired before they could be switched to into a
+  // single switch to their net valve states, staying on the timeline
+  OVERLOAD_COALESCE,
+  // Skip the lines shorter than a minimum duration ahead of time, holding the
+  // valves of the line before. The timeline stays intact.
+  OVERLOAD_DROP,
+  // Play a line that has expired before it could be switched to for its full
+  // duration, shifting the timeline by the lag
+  OVERLOAD_STRETCH,
+  N_OVERLOAD_POLICIES
+};
+
+// Default minimum duration [µs] of a line under `OVERLOAD_DROP`
+const uint32_t OVERLOAD_MIN_US = 2000;
+
+// Maximum number of consecutive lines skipped at once, bounding the time spent
+// inside of `ProtocolManager::update()`
+const uint16_t OVERLOAD_MAX_SKIP = 64;
+
+/**
+ * @brief Counters of the overload policy, reset along with `TimingStats`.
+ */
+struct OverloadStats {
+  uint32_t N_overruns = 0;   // Lines that had expired when switched to
+  uint32_t N_coalesced = 0;  // Switches folding expired lines
+  uint32_t N_folded = 0;     // Lines folded into another switch
+  uint32_t N_dropped = 0;    // Lines dropped for being too short
+  uint32_t N_stretched = 0;  // Switches shifting the timeline
+  uint64_t stretched_us = 0; // Total shift of the timeline [µs]
+};
+
+// Maximum width [µs] of the sync pulse on marked lines, see
+// `ProtocolManager::set_sync_marked()`. It gets busy-waited within the switch.
+const uint16_t SYNC_PULSE_MAX_US = 500;
+
+/**
+ * @brief Number of sync edges of the leader MCU that can await the main loop,
+ * when it lags behind the interrupt. Any further edges get dropped.
+ */
+const uint16_t FOLLOW_EDGES_LEN = 16;
+
+/**
+ * @brief Statistics on following the line switches of a leader MCU, see
+ * `ProtocolManager::set_follower()`. The skew is the time between the sync
+ * edge of the leader and the valves of the follower being sent out.
+ */
+struct FollowStats {
+  uint32_t N_edges = 0;      // Number of sync edges received
+  uint32_t N_late = 0;       // Edges switched by the main loop, not the ISR
+  uint32_t last_skew_us = 0; // Skew of the last switch [µs]
+  uint32_t max_skew_us = 0;  // Largest skew encountered [µs]
+  uint64_t sum_skew_us = 0;  // Sum of all skews [µs]
+  uint32_t N_dropped = 0;    // Edges dropped, see `FOLLOW_EDGES_LEN`
+};
+
+/*------------------------------------------------------------------------------
+  ValveEventLog
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Number of line switches the valve-event log can hold before new ones
+ * get dropped. An event takes up 14 bytes, carved out of the
+ * `MemoryArena` at boot.
+ */
+const uint16_t VALVE_EVENT_LOG_LEN = 256;
+
+/**
+ * @brief The measured timing of a single line switch, on the `micros()` time
+ * track.
+ */
+struct __attribute__((packed)) ValveEvent {
+  uint16_t line_no;     // Line number that got activated, starting at index 0
+  uint32_t planned_us;  // Planned switch time [µs]
+  uint32_t actual_us;   // Start of the switch [µs]
+  uint32_t i2c_done_us; // Valves have been sent their new states [µs], or 0
+                        // when superseded by the next switch before that
+};
+
+/**
+ * @brief Queue of the line switches, to be drained by the PC for
+ * post-processing. When full, new events get dropped and counted, see
+ * `SpscQueue::get_N_overflows()`.
+ *
+ * Events get pushed from within an interrupt, see
+ * `ProtocolManager::i2c_done_callback()`, as well as by the main loop with the
+ * interrupts disabled, see `ProtocolManager::log_event()`. Draining is
+ * lock-free.
+ */
+using ValveEventLog = SpscQueue<ValveEvent>;
+
+/*------------------------------------------------------------------------------
+  ProtocolManager
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Playback speed factor of 1 in unsigned Q16.16 fixed point, see
+ * `ProtocolManager::set_speed()`.
+ */
+const uint32_t SPEED_Q16_ONE = 1UL << 16;
+
+/**
+ * @brief Slowest and fastest playback speed factor in Q16.16. Scaled line
+ * durations beyond the range of the deadline comparisons, of about 35 minutes,
+ * get clamped.
+ */
+const uint32_t SPEED_Q16_MIN = SPEED_Q16_ONE / 32;
+const uint32_t SPEED_Q16_MAX = SPEED_Q16_ONE * 64;
+
+/**
+ * @brief Returned by `ProtocolManager::get_N_open_ahead()` when the line to
+ * look ahead to is not known yet.
+ */
+const uint8_t N_OPEN_UNKNOWN = 0xFF;
+
+/**
+ * @brief Number of lines re-checksummed per `ProtocolManager::update_scrub()`
+ * call. A full pass over a program of 30,000 lines takes ~940 calls.
+ */
+const uint16_t SCRUB_LINES_PER_UPDATE = 32;
+
+/**
+ * @brief Class to manage reading in and playing back a protocol program. Next
+ * to the active program, a second one can be staged in memory to be swapped
+ * in without interrupting playback, see `PROTOCOL_SLOTS`.
+ */
+class ProtocolManager {
+public:
+  ProtocolManager(CentipedeManager *cp_mgr);
+
+  /**
+   * @brief Carve the storage of the valve-event log and of the program slots
+   * out of @p arena, to be called once at boot. The event log takes its
+   * `VALVE_EVENT_LOG_LEN` events, after which the program slots split the
+   * remainder of the arena evenly.
+   */
+  void begin(MemoryArena &arena);
+
+  /**
+   * @brief Clear the protocol program.
+   *
+   * Takes constant time, as only the line count gets reset.
+   */
+  void clear();
+
+  /**
+   * @brief Add a new Line to the protocol program.
+   *
+   * @param line Line of which the corresponding valves of its PCS points will
+   * be set open for the given duration. All other valves will be set closed.
+   * Alternatively given as encoded time duration @p duration and PCS row
+   * bitmasks @p rows.
+   * @return True when the new line is successfully added. False otherwise,
+   * because the maximum number of lines has been reached.
+   */
+  bool add_line(const Line &line);
+  bool add_line(uint16_t duration, const PCS_Rows &rows);
+
+  /**
+   * @brief Direct access to the active protocol program in memory, used by
+   * the protocol library in flash. Call `stop_timer()` before modifying it and
+   * `program_replaced()` afterwards.
+   */
+  inline Program &get_program() { return _active->program; }
+
+  /**
+   * @brief Replace the active protocol program by the raw program image
+   * @p image, played in place without copying it into the memory of the
+   * program slot, see `Program::attach()`. Meant for the protocols embedded
+   * in internal flash, see `embedded_protocols.h`.
+   *
+   * @return True when successful. False otherwise, because the image is
+   * inconsistent, leaving the program cleared.
+   */
+  bool attach_program(const char *name, const uint8_t *image,
+                      uint16_t N_lines, uint32_t N_bytes);
+
+#if PROTOCOL_COMPRESSED == COMPRESSION_DELTA
+  /**
+   * @brief Replace the active protocol program by the program image opened
+   * by @p reader, played in place from the QSPI flash, see
+   * `Program::attach_flash()`. Meant for `ProtocolLibrary::play()`.
+   */
+  void attach_flash_program(const char *name, FlashProgram &reader);
+#endif
+
+  /**
+   * @brief Unpack line numbers @p first up to, but not including, @p last of
+   * the active protocol program in a single sequential pass. Each line gets
+   * handed to @p fun as `fun(uint16_t line_no, const Line &line)`. Meant for
+   * printing and exporting the full program.
+   *
+   * A run of consecutive lines opening the same valves gets unpacked only
+   * once. Line numbers beyond the program get ignored.
+   */
+  template <class Fun>
+  void unpack_range(uint16_t first, uint16_t last, Fun fun) {
+    Line line;
+    PackedLine packed_line;
+    decltype(PackedLine::masks) prev_masks;
+
+    last = min(last, _N_lines);
+    for (uint16_t line_no = first; line_no < last; ++line_no) {
+      _active->program.get(line_no, packed_line);
+      if ((line_no == first) || (packed_line.masks != prev_masks)) {
+        packed_line.unpack_into(line);
+        prev_masks = packed_line.masks;
+      }
+      line.duration = packed_line.duration;
+      fun(line_no, line);
+    }
+  }
+
+  /**
+   * @brief Append line numbers @p first up to, but not including, @p last of
+   * the active protocol program to the staged one. Lets a patch upload reuse
+   * the lines that did not change, see `start_hash_dump()`.
+   *
+   * @return True when successful. False otherwise, because no staging slot is
+   * open, the lines lie beyond the active program or the staged program is
+   * full.
+   */
+  bool copy_active_lines(uint16_t first, uint16_t last);
+
+  /**
+   * @brief Adopt the protocol program after it got replaced as a whole via
+   * `get_program()`, and prime its start.
+   */
+  void program_replaced();
+
+  /**
+   * @brief Direct access to the protocol program targeted by the edits, i.e.
+   * the staged program while staging, see `open_staging()`. Call
+   * `edit_replaced()` after having replaced it as a whole.
+   */
+  inline Program &get_edit_program() { return _edit->program; }
+
+  /**
+   * @brief Adopt the protocol program targeted by the edits after it got
+   * replaced as a whole via `get_edit_program()`. The active program gets its
+   * start primed, see `program_replaced()`.
+   */
+  void edit_replaced();
+
+  /**
+   * @brief Route all subsequent edits, i.e. `clear()`, `add_line()` and
+   * `set_name()`, to a cleared staging slot, leaving the active protocol
+   * program untouched and playing. Without a staging slot, see
+   * `PROTOCOL_SLOTS`, the active program gets cleared instead.
+   */
+  void open_staging();
+
+  /**
+   * @brief Append the bytes encoded by the hex string @p hex to the pending
+   * header. The pending header gets attached to the protocol program of the
+   * next `open_staging()`, i.e. of the next upload, and is cleared after.
+   *
+   * The header is an opaque blob to the firmware. The PC stores the
+   * compressed `[HEADER]` section of the `.proto` file in it, such that a run
+   * can be attributed to the exact generation parameters of its program.
+   *
+   * @return False when @p hex is invalid or the header would exceed
+   * `PROTOCOL_HEADER_MAX`, true otherwise.
+   */
+  bool add_header(const char *hex);
+
+  inline void clear_pending_header() { _header_pending_len = 0; }
+  inline uint16_t get_pending_header_len() { return _header_pending_len; }
+
+  /**
+   * @brief Reply with the size N [bytes] of the header of the active protocol
+   * program as ASCII line, followed by a single frame holding the N bytes, see
+   * `Telemetry.h`.
+   */
+  void dump_header();
+
+  /**
+   * @brief Route all subsequent edits to the staging slot again, like
+   * `open_staging()`, but keeping the lines it holds, e.g. to resume an
+   * interrupted upload. Without a staging slot, nothing happens.
+   */
+  void reopen_staging();
+
+  /**
+   * @brief Stop routing the edits to the staging slot. When @p keep is true,
+   * the staged program is ready to be swapped in by `swap()`. Otherwise it
+   * gets discarded.
+   */
+  void close_staging(bool keep);
+
+  /**
+   * @brief Make the staged protocol program the active one and keep the
+   * previously active program as the staging one.
+   *
+   * @param at_line_boundary When true, the swap takes effect once the current
+   * line has expired, such that playback continues seamlessly at line 0 of
+   * the new program. Else, the swap is immediate and the start gets primed.
+   * @return True when successful. False otherwise, because no program is
+   * staged.
+   */
+  bool swap(bool at_line_boundary);
+
+  /**
+   * @brief Is there a staging slot, see `PROTOCOL_SLOTS`?
+   */
+  static constexpr bool has_staging_slot() { return PROTOCOL_SLOTS > 1; }
+
+  /**
+   * @brief Is a swap waiting for the current line to expire, see `swap()`?
+   */
+  inline bool swap_pending() const { return _swap_pending; }
+
+  /**
+   * @brief Lend out the largest unused tail of the program storage of either
+   * the active or the staging slot as scratch memory, 4-byte aligned, see
+   * `Program::spare()`. It remains valid only until the next edit, upload or
+   * library access.
+   *
+   * @param N_bytes Reference to write the size of the scratch memory into
+   */
+  uint8_t *lend_spare_memory(uint32_t &N_bytes);
+
+  /**
+   * @brief Prime the start of the protocol program such that `update()` will
+   * start the program directly at line position 0 wihout any delay.
+   *
+   * Note: Calling this method will /not/ activate any solenoid valves just yet.
+   * `update()` must be called subsequently to trigger activation of line 0.
+   */
+  void prime_start();
+
+  /**
+   * @brief Go to Line number @p line_no of the protocol program (index starts
+   * at 0) and immediately activate the solenoid valves and color the LED
+   * matrix.
+   */
+  void goto_line(uint16_t line_no);
+
+  /**
+   * @brief Go to the line of the protocol program being played at @p t_us
+   * [µs] since its start, see `TimeIndex`, and immediately activate the
+   * solenoid valves and color the LED matrix. The line expires as if it had
+   * been playing since its start time. Times beyond the total duration of the
+   * program wrap around, like the playback does.
+   */
+  void goto_time(uint64_t t_us);
+
+  /**
+   * @brief Go to the next Line of the protocol program and
+   * immediately activate the solenoid valves and color the LED matrix.
+   */
+  void goto_next_line();
+
+  /**
+   * @brief Go to the previous Line of the protocol program and
+   * immediately activate the solenoid valves and color the LED matrix.
+   */
+  void goto_prev_line();
+
+  /**
+   * @brief Immediately activate the solenoid valves and color the LED matrix,
+   * based on the current @p _line_buffer contents.
+   *
+   * The LEDs of valves that were opened by the previously activated line and
+   * are now closed will be colored blue. The LEDs of the currently opened
+   * valves will be colored red.
+   */
+  void activate_buffer();
+
+  /**
+   * @brief Forget the valve states that the LED matrix currently shows, such
+   * that the next activation colors all of its open valves red. Must be called
+   * whenever the valve LEDs got overwritten outside of the protocol manager.
+   */
+  inline void invalidate_leds() { _last_masks.fill(0); }
+
+  /**
+   * @brief Run the timer of the protocol program.
+   *
+   * It will automatically activate the solenoid valves and color the LED matrix
+   * accordingly, going line for line through the protocol program on its
+   * specified time track.
+   *
+   * The time track is kept in microseconds. In drift-free mode (default) the
+   * deadline of each line is advanced by exactly its duration, i.e.
+   * `deadline += duration`, such that the lateness of a single switch, e.g.
+   * due to a blocking `FastLED.show()`, does not accumulate. The full program
+   * will then take exactly the sum of its line durations. See
+   * `print_timing_stats()` for the obtained lateness.
+   *
+   * The next line is staged ahead of time while the current line is still
+   * playing, i.e. its Centipede port bitmasks are already resolved. Once the
+   * current line expires only the I2C transmission and the LED recoloring
+   * remain to be done.
+   *
+   * When the hardware timer is in use, see `set_use_timer()`, the I2C
+   * transmission is fired from within the timer interrupt exactly at the
+   * deadline, and this method only takes care of the bookkeeping afterwards:
+   * LED recoloring, staging the next line and re-arming the timer. Should the
+   * loop fail to stage the next line in time, the switch falls back to the
+   * loop.
+   */
+  void update();
+
+  /**
+   * @brief Re-anchor the time track to the present, making the current line
+   * expire immediately. Must be called when (re)starting playback after the
+   * valves got closed, to prevent a rapid catch-up of all the lines that were
+   * missed. Discards any frozen time track, see `freeze()`.
+   */
+  void resync();
+
+  /**
+   * @brief Freeze the time track at the present, keeping the valves as they
+   * are. The elapsed time within the current line is retained, such that
+   * `resume()` continues exactly where it left off.
+   *
+   * A manual activation of a line, e.g. by `goto_line()`, freezes the time
+   * track at the start of that line as well. When the single step has just
+   * completed, see `set_single_step()`, the time track is already frozen at
+   * the switch to the new line and stays so.
+   */
+  void freeze();
+
+  /**
+   * @brief Resume playback on the frozen time track, shifting the deadline of
+   * the current line by the time spent frozen. Without a frozen time track
+   * this is identical to `resync()`.
+   */
+  void resume();
+
+  /**
+   * @brief Play only up to the next line switch: Once it happens, the time
+   * track gets frozen exactly at the start of the new line and `step_done()`
+   * turns true. Resuming from the start of a line hence plays exactly that
+   * one line with its real duration, including the precise switch to the
+   * next line, e.g. for inspecting the valve waveforms line by line.
+   */
+  inline void set_single_step(bool single_step) {
+    _single_step = single_step;
+  }
+
+  /**
+   * @brief Has the single step completed? See `set_single_step()`.
+   */
+  inline bool step_done() const { return _step_done; }
+
+  /**
+   * @brief Return the time left [µs] until the next line switch is due, or 0
+   * when overdue. Returns `UINT32_MAX` when the time track is frozen. When
+   * awaiting the trigger input the switch can come at any moment, hence 0 is
+   * returned. Used to schedule slow tasks in between the line switches.
+   */
+  uint32_t get_us_until_switch() const;
+
+  /**
+   * @brief Return the time left [µs] within the current line, or 0 when
+   * overdue. Unlike `get_us_until_switch()`, a frozen time track returns the
+   * time left at the moment it got frozen.
+   */
+  uint32_t get_us_left_in_line() const;
+
+  /**
+   * @brief Shorten the current line to @p left_us [µs], counting from the
+   * moment the time track got frozen, e.g. right after `goto_line()`. Used to
+   * resume a line cut short by a reset. No effect when not frozen.
+   */
+  void set_us_left_in_line(uint32_t left_us);
+
+  /**
+   * @brief Return the time [µs] into the current line at @p t_us and store its
+   * protocol position in @p pos, both taken at once in case the playback
+   * interrupt switches lines meanwhile. Negative when @p t_us precedes the
+   * current line, e.g. for a reading that queued up during the previous one.
+   * Used to bin readings by protocol phase, see `PhaseAverager`.
+   */
+  int32_t get_phase(uint32_t t_us, int16_t &pos) const;
+
+  /**
+   * @brief Select the scheduler mode.
+   *
+   * @param drift_free True: Absolute deadlines, `deadline += duration`. False:
+   * Deadlines relative to the actual switch time, `deadline = now + duration`.
+   */
+  inline void set_drift_free(bool drift_free) { _drift_free = drift_free; }
+  inline bool get_drift_free() { return _drift_free; }
+
+  /**
+   * @brief Select what to do with the lines that are too short to keep up
+   * with, see `OverloadPolicy`. Takes effect from the next line switch onwards.
+   *
+   * @param min_us Minimum duration [µs] of a line, scaled by the playback
+   * speed, under `OVERLOAD_DROP`.
+   */
+  inline void set_overload(OverloadPolicy policy,
+                           uint32_t min_us = OVERLOAD_MIN_US) {
+    _overload = policy;
+    _overload_min_us = min_us;
+  }
+  inline OverloadPolicy get_overload() const { return _overload; }
+
+  /**
+   * @brief Predict the cost of playing the lines with @p cost from now on and
+   * reevaluate the feasibility of the loaded programs, see `Feasibility`.
+   * E.g. with the refresh time of the LED matrix as measured by the
+   * `LEDGovernor`.
+   */
+  void set_actuation_cost(const ActuationCost &cost);
+  inline const ActuationCost &get_actuation_cost() const { return _cost; }
+
+  /**
+   * @brief Print the feasibility of the active program, see
+   * `Feasibility::print()`, prefixed on its first line by the fields of the
+   * `ActuationCost`: The cost per I2C transaction, per port and of a LED
+   * refresh [µs].
+   */
+  void print_feasibility();
+
+  /**
+   * @brief Print the overload policy and its counters, tab delimited:
+   *   1) Policy, see `OverloadPolicy`
+   *   2) Minimum line duration under `OVERLOAD_DROP` [µs]
+   *   3) Number of lines that had expired when switched to
+   *   4) Number of switches folding expired lines
+   *   5) Number of lines folded
+   *   6) Number of lines dropped
+   *   7) Number of switches shifting the timeline
+   *   8) Total shift of the timeline [µs]
+   */
+  void print_overload(Stream &mySerial) const;
+
+  /**
+   * @brief Scale all line durations at playback time by 1 / speed factor,
+   * without altering the stored program. The factor is given in Q16.16 fixed
+   * point, see `SPEED_Q16_ONE`, and gets constrained to [`SPEED_Q16_MIN`,
+   * `SPEED_Q16_MAX`]. Takes effect from the next line switch onwards.
+   *
+   * The fractional microseconds of each scaled duration get carried over to
+   * the next one, such that the scaled timeline stays exact.
+   */
+  void set_speed(uint32_t speed_q16);
+  inline uint32_t get_speed() const { return _speed_q16; }
+
+  /**
+   * @brief Print the playback speed factor, see `set_speed()`.
+   */
+  void print_speed();
+
+  /**
+   * @brief Enforce a minimum valve on/off duration of @p N_lines on the lines
+   * being played, see `ValveGuard.h`. 0 or 1 disables it (default).
+   */
+  inline void set_min_valve_lines(uint8_t N_lines) {
+    _guard.set_min_lines(N_lines);
+  }
+  inline const ValveGuard &get_valve_guard() { return _guard; }
+
+  /**
+   * @brief Mirror, rotate, shift and/or invert the lines at playback time, see
+   * `MaskTransform.h`. Takes effect from the next line being staged onwards.
+   *
+   * @return False when the transform is invalid, true otherwise.
+   */
+  inline bool set_transform(uint8_t orientation, int8_t dx, int8_t dy,
+                            bool invert) {
+    return _xform.set(orientation, dx, dy, invert);
+  }
+  inline const MaskTransform &get_transform() { return _xform; }
+
+  /**
+   * @brief Spread the line switches toggling many valves over sub-steps, see
+   * `ActuationStagger.h`. Takes effect from the next line being staged
+   * onwards, and only when firing the switches from the timer, see
+   * `set_use_timer()`. Lines not outlasting the window switch at once.
+   */
+  inline void set_stagger(uint8_t N_steps, uint16_t spacing_us,
+                          uint8_t min_changes, StaggerOrder order) {
+    _stagger.set(N_steps, spacing_us, min_changes, order);
+  }
+  inline const ActuationStagger &get_stagger() { return _stagger; }
+
+  /**
+   * @brief Send each toggling valve its new state early by its own opening or
+   * closing latency, see `ValveLatency.h`. Takes effect from the next line
+   * being staged onwards, and only when firing the switches from the timer,
+   * see `set_use_timer()`. Takes precedence over `set_stagger()`.
+   *
+   * The switch times on the time track and in the valve-event log are then
+   * those of the jets, i.e. of the valve with the largest latency having been
+   * sent its state plus that latency.
+   */
+  inline ValveLatency &get_latency() { return _latency; }
+
+  /**
+   * @brief Attach the hardware timer to be used for firing the line switches
+   * from within an interrupt. Its callback must call `isr_switch()`.
+   */
+  void attach_timer(PlaybackTimer *timer);
+
+  /**
+   * @brief Fire the line switches from within the hardware timer interrupt
+   * (true), or from within `update()` in the main loop (false, default).
+   *
+   * Only takes effect when a timer has been attached and the hardware timer is
+   * available on this board.
+   */
+  void set_use_timer(bool use_timer);
+  inline bool get_use_timer() { return _use_timer; }
+
+  /**
+   * @brief Disarm the hardware timer and the trigger input, see
+   * `arm_trigger()`, and finish the bookkeeping of any switch either has
+   * already done. Must be called before the valves get accessed from outside
+   * of the protocol manager, e.g. when leaving the Running state.
+   */
+  void stop_timer();
+
+  /**
+   * @brief To be called exclusively by the hardware timer callback: Send out
+   * the staged Centipede port bitmasks. A staggered or latency-compensated
+   * switch re-arms the timer for each of its sub-steps, see `set_stagger()`
+   * and `get_latency()`, and only counts as done after the last one.
+   */
+  void isr_switch();
+
+  /**
+   * @brief Rewind the protocol program and stage its first line, such that
+   * the next `isr_trigger()` starts the playback with a deterministic latency:
+   * Only the I2C transmission of the first line remains to be done. The time
+   * track gets anchored at the trigger, see `triggered()`.
+   */
+  void arm_trigger();
+
+  /**
+   * @brief To be called exclusively by the trigger input interrupt: Start the
+   * playback when armed, see `arm_trigger()`.
+   */
+  void isr_trigger();
+
+  /**
+   * @brief Has the playback been started by the trigger input? The flag gets
+   * cleared by `resume()` and `resync()`.
+   */
+  inline bool triggered() const { return _triggered; }
+
+  /**
+   * @brief Toggle digital output pin @p pin each time the valves have been
+   * switched, right after the I2C transmission has completed. This provides an
+   * electrical marker of the line transitions for external instruments.
+   * Negative disables it (default). The pin must be configured as output.
+   */
+  inline void set_sync_pin(int16_t pin) { _sync_pin = pin; }
+
+  /**
+   * @brief Pulse the sync pin high for @p pulse_us on switching to a marked
+   * line only, see `PackedLine::is_marked()`, e.g. to trigger a camera on
+   * selected frames of the protocol. The unmarked lines leave the pin low.
+   * The pulse gets busy-waited for a fixed width, capped at
+   * `SYNC_PULSE_MAX_US`.
+   *
+   * 0 toggles the pin on every switch instead (default), which the followers
+   * of `set_follower()` rely on.
+   */
+  void set_sync_marked(uint16_t pulse_us);
+
+  inline uint16_t get_sync_marked() const { return _sync_pulse_us; }
+
+  /**
+   * @brief Play as follower of a leader MCU (true), or on our own time track
+   * (false, default).
+   *
+   * Several MCUs, each driving a slice of a segmented grid, can play their
+   * own protocol program in lockstep: The sync output of the leader gets
+   * wired to the trigger input of each follower. The first edge starts the
+   * playback of the follower, see `arm_trigger()`, and each next edge, rising
+   * or falling, switches it to its next line. The line durations of the
+   * follower are then ignored. A follower must hold as many lines as the
+   * leader and plays from its protocol program only, not from a stream.
+   *
+   * An edge arriving before the main loop has staged the next line gets
+   * caught up by `update()` instead, such that no line gets skipped.
+   */
+  void set_follower(bool follower);
+  inline bool is_follower() const { return _follower; }
+
+  /**
+   * @brief Reset the statistics on following the leader, see `FollowStats`.
+   */
+  void reset_follow_stats();
+
+  /**
+   * @brief Print the statistics on following the leader, tab delimited: Number
+   * of edges, number of late edges, last skew, max skew, average skew in [µs].
+   */
+  void print_follow_stats();
+
+  /**
+   * @brief Reset the statistics on the lateness of the line switches.
+   */
+  void reset_timing_stats();
+
+  /**
+   * @brief Print the statistics on the lateness of the line switches, tab
+   * delimited: Number of switches, last lag, max lag, average lag in [µs].
+   */
+  void print_timing_stats();
+
+  /**
+   * @brief Return the timing summary of the current run, see `TimingQoS`.
+   * Reset it at the start of a run via `TimingQoS::reset()`.
+   */
+  inline TimingQoS &get_qos() { return _qos; }
+
+  /**
+   * @brief Time the unpacking and the activation of a full line, opening all
+   * valves, with the DWT cycle counter. The activation starts from all valves
+   * closed each time, such that every port gets sent out. Afterwards, the
+   * valves of the current line get restored.
+   *
+   * The results are printed via `perf_bench_print()`, one line per workload.
+   *
+   * @param mySerial The serial stream to report over.
+   */
+  void benchmark(Stream &mySerial);
+
+  /**
+   * @brief The measured timing of the most recent line switches.
+   */
+  inline ValveEventLog &get_event_log() { return _events; }
+
+  /**
+   * @brief Start streaming playback: Instead of from the protocol program in
+   * memory, lines are played from a ring buffer that is continuously being fed
+   * via `push_stream_line()`. The protocol program in memory is left intact.
+   *
+   * Playback starts once the buffer holds `STREAM_PREFILL_LINES` lines. When
+   * the buffer runs dry, all valves will be closed and playback resumes as
+   * soon as the buffer got refilled again. Each occurrence is counted as an
+   * underrun.
+   */
+  void start_stream();
+
+  /**
+   * @brief Signal that no more lines will be pushed. The stream will finish
+   * once the buffer has been played out.
+   */
+  inline void end_stream() { _stream_eos = true; }
+
+  /**
+   * @brief Leave streaming playback and return to the protocol program in
+   * memory.
+   */
+  void stop_stream();
+
+  /**
+   * @brief Add a line to the back of the stream buffer.
+   *
+   * @return True when successful. False otherwise, because the buffer is full.
+   */
+  bool push_stream_line(const Line &line);
+
+  /**
+   * @brief Add a line opening @p valves for the encoded @p duration to the
+   * back of the stream buffer, see `LineSource::next_valves()`.
+   *
+   * @return True when successful. False otherwise, because the buffer is full.
+   */
+  bool push_stream_valves(uint16_t duration, const ValveSet &valves);
+
+  inline uint16_t get_stream_room() { return _ring.room(); }
+  inline uint32_t get_N_underruns() { return _N_underruns; }
+  inline uint32_t get_N_streamed() { return _N_streamed; }
+
+  /**
+   * @brief Has the stream been fully played out after `end_stream()`?
+   */
+  inline bool stream_finished() { return _stream_done; }
+
+  /**
+   * @brief Is playback halted, waiting for the stream buffer to fill up?
+   */
+  inline bool stream_dry() { return _stream_dry && !_stream_eos; }
+
+  /**
+   * @brief Print the protocol program name and total number of lines.
+   */
+  void print_program();
+
+  /**
+   * @brief Print the statistics of the protocol program, tab delimited:
+   *   1) Protocol name
+   *   2) N_lines
+   *   3) Total duration [ms]
+   *   4) CRC32 checksum in hex, see `get_program_crc()`
+   *   5) Is the checksum known?
+   * Followed by the fields of `ProgramStats::print()`.
+   */
+  void print_program_info();
+
+  /**
+   * @brief Print the state of the program slots, tab delimited: Active
+   * program name, its number of lines, staged program name, its number of
+   * lines, and whether the staged program is ready to be swapped in (1),
+   * pending to be swapped in at the next line boundary (2) or not (0).
+   */
+  void print_slots();
+
+  /**
+   * @brief Start a dump of the full protocol program, which gets continued by
+   * `update_dump()` over the next loop iterations. The PC should not send
+   * other commands until the dump has finished.
+   *
+   * The ASCII dump pretty prints the program name and number of lines, an
+   * empty line, all lines, and a closing empty line. The binary dump, when
+   * @p rows is set, starts with the same ASCII header line. Then follow COBS
+   * frames holding up to `DUMP_ROWS_PER_FRAME` lines each, every line made of
+   * the `uint16_t` encoded duration and 15 `uint16_t` PCS row bitmasks like the
+   * `upload_rows` format, little endian. An empty frame closes the dump.
+   *
+   * @return False when a dump is already ongoing.
+   */
+  bool start_dump(bool rows);
+
+  /**
+   * @brief Start a dump of the hashes of the full protocol program, which gets
+   * continued by `update_dump()` like `start_dump()`. Used by the PC to find
+   * out which lines differ from the program it is about to upload, such that
+   * a patch upload only has to send those.
+   *
+   * Starts with an ASCII header line, tab delimited: The number of lines, the
+   * number of lines per block @p block_len and whether a patch upload is
+   * possible (1) or not (0), see `has_staging_slot()`. Then follows one line
+   * per block holding its CRC32 in hex, the last block possibly being shorter.
+   * An empty line closes the dump. The CRC32 runs over the lines in the format
+   * of `proto_rows?`, i.e. exactly the bytes the PC sends per line in a bulk
+   * upload.
+   *
+   * @return False when a dump is already ongoing.
+   */
+  bool start_hash_dump(uint16_t block_len);
+
+  /**
+   * @brief Start a binary readback of lines @p first up to but excluding
+   * @p last of the active protocol program, as compiled into the program
+   * store. It gets continued by `update_dump()` like `start_dump()`. Used by
+   * the PC to verify an upload bit for bit, without the cost of unpacking the
+   * lines into PCS points and back.
+   *
+   * Starts with an ASCII header line, tab delimited: The first line number,
+   * the number of lines to follow, @p last being clamped to the program, and
+   * `N_CP_PORTS`. Then follow COBS frames holding up to `DUMP_MASKS_PER_FRAME`
+   * lines each, every line made of the `uint16_t` encoded duration and the
+   * `N_CP_PORTS` `uint16_t` Centipede port bitmasks, little endian. Each frame
+   * ends with the CRC32 over its lines. A closing frame holds only the CRC32
+   * over all lines read back.
+   *
+   * @return False when a dump is already ongoing.
+   */
+  bool start_masks_dump(uint16_t first, uint16_t last);
+
+  /**
+   * @brief Continue the ongoing dump by a bounded number of lines, as far as
+   * the transmit queue can take them without waiting. Call repeatedly from
+   * the main loop. The dump gets cut short when the active protocol program
+   * gets replaced in the meantime.
+   */
+  void update_dump();
+
+  inline bool is_dumping() const { return _dump_slot != nullptr; }
+
+  /**
+   * @brief Return the CRC32 checksum of the active protocol program, running
+   * over its lines in the format of `proto_rows?` like `start_hash_dump()`.
+   * The PC can hence compute it straight from the protocol file. It gets
+   * updated line by line while uploading. A program replaced as a whole, e.g.
+   * loaded from the protocol library, adopts the checksum of the first scrub
+   * pass, see `update_scrub()`.
+   */
+  inline uint32_t get_program_crc() const { return _active->crc; }
+
+  /**
+   * @brief Is `get_program_crc()` valid? Not so after the program got
+   * replaced as a whole, until the first scrub pass has completed.
+   */
+  inline bool is_program_crc_known() const { return _active->crc_known; }
+
+  /**
+   * @brief Take @p crc as the checksum of the program just replaced as a
+   * whole, known from elsewhere, e.g. the protocol library. The scrubbing
+   * then verifies it instead of adopting its own.
+   */
+  inline void adopt_program_crc(uint32_t crc) {
+    _active->crc = crc;
+    _active->crc_known = true;
+  }
+
+  /**
+   * @brief Re-checksum the next `SCRUB_LINES_PER_UPDATE` lines of the active
+   * protocol program in memory, decoded like the playback does, and compare
+   * against `get_program_crc()` once a full pass completes. Catches the
+   * program getting corrupted in RAM after the upload, e.g. by a stray write.
+   * A pass restarts whenever the program changes. Call repeatedly from the
+   * main loop.
+   *
+   * @return False when a pass just completed with a mismatch, raising
+   * `TRACE_PROGRAM_CORRUPT`. True otherwise.
+   */
+  bool update_scrub();
+
+  /**
+   * @brief Print the scrubber state, tab delimited: CRC32 checksum of the
+   * active protocol program in hex, see `get_program_crc()`, its number of
+   * lines, whether the checksum is known (1) or awaits the first scrub pass
+   * (0), the number of completed passes and the number of mismatches.
+   */
+  void print_scrub();
+
+  /**
+   * @brief Pretty print the current line buffer, useful for debugging.
+   */
+  void print_buffer();
+
+  // Operate on the staging slot while it is open, else on the active slot
+  inline void set_name(const char *name) {
+    strncpy(_edit->name, name, sizeof(_edit->name) - 1);
+    _edit->name[sizeof(_edit->name) - 1] = '\0';
+  }
+  inline char *get_name() { return _edit->name; }
+  inline uint16_t get_N_lines() { return _edit->program.size(); }
+
+  // Operate on the active slot, regardless of the staging slot
+  inline uint16_t get_active_N_lines() const { return _N_lines; }
+
+  /**
+   * @brief Print the memory usage of the protocol program, tab delimited:
+   * Number of lines, used bytes, available bytes. Followed by the split of
+   * the memory arena, see `MemoryArena::print()`.
+   */
+  void print_memory();
+
+  // Number of commands registered by `register_commands()`, checked against
+  // `MAX_COMMANDS` at compile time, see `register_commands()` of `main.cpp`
+  static const uint8_t N_COMMANDS = 40;
+
+  /**
+   * @brief Register the serial commands reporting on and configuring the
+   * protocol playback, see `CommandRegistry`.
+   */
+  void register_commands(CommandRegistry &registry);
+
+  /**
+   * @brief Return the current protocol position starting at index 0. I.e. the
+   * playback position / current line number.
+   */
+  inline int16_t get_position() { return _pos; }
+
+  /**
+   * @brief Return the number of timed switches onto line 0 of the protocol
+   * program in memory since boot, i.e. the number of passes started, e.g. to
+   * count repeats, see `Playlist`. Not counting while streaming.
+   */
+  inline uint32_t get_N_wraps() { return _N_wraps; }
+
+  /**
+   * @brief Return the generation of the active protocol program, changing
+   * whenever its contents change or another program gets swapped in.
+   */
+  inline uint32_t get_program_gen() const { return _program_gen; }
+
+  /**
+   * @brief Return the number of valves opened by the line @p N_ahead lines
+   * ahead of the playback position, wrapping around the end of the protocol
+   * program, for feed-forward control of the pump. Pass 0 for the current
+   * line. While streaming, the line gets looked up in the stream buffer.
+   *
+   * The line gets decoded on demand, because a precomputed count per line
+   * would not fit in RAM next to the compressed programs. This moves the
+   * decoder cursor away from the playback position, costing a re-seek of at
+   * at most a keyframe interval of lines when staging the next line.
+   * Hence, call it at a low rate only, e.g. once per telemetry packet.
+   *
+   * @return The number of open valves, or `N_OPEN_UNKNOWN` when the line is
+   * not known yet, because it has not been streamed in yet.
+   */
+  uint8_t get_N_open_ahead(uint16_t N_ahead);
+
+  /**
+   * @brief Color the valves layer of the LED matrix based on the passed
+   * Centipede port bitmasks, see `LEDCompositor`. Only the LEDs of the valves
+   * that changed state since the last activation get touched, see
+   * `invalidate_leds()`.
+   */
+  void color_leds(const CP_Masks &masks);
+
+private:
+  struct Slot {
+    Program program;        // Protocol program loaded into memory
+    TimeIndex times;        // Start times of the lines of the program
+    ProgramStats stats;     // Statistics of the lines of the program
+    Feasibility feasibility; // Predicted timing of the lines of the program
+    uint8_t header[PROTOCOL_HEADER_MAX]; // See `add_header()`
+    uint16_t header_len = 0;             // Size of the header [bytes]
+    char name[64] = {'\0'}; // Name of the protocol program
+    uint32_t crc = 0;        // See `get_program_crc()`
+    bool crc_known = true;   // False once replaced as a whole, until scrubbed
+  };
+
+  Slot _slots[PROTOCOL_SLOTS];
+  MemoryArena *_arena = nullptr; // See `begin()`
+  Slot *_active = &_slots[0];                   // Slot being played back
+  Slot *_staging = &_slots[PROTOCOL_SLOTS - 1]; // Slot to upload into
+  Slot *_edit = &_slots[0];                     // Slot targeted by the edits
+  bool _staged_ready = false;                   // Is the staged program ready?
+  uint8_t _header_pending[PROTOCOL_HEADER_MAX]; // See `add_header()`
+  uint16_t _header_pending_len = 0;             // Size of the pending header
+  volatile bool _swap_pending = false; // Swap at the next line boundary?
+  uint16_t _N_lines;       // Total number of lines in the active program
+  uint16_t _pos; // Playback position; current line number starting at index 0
+  uint32_t _deadline_us = 0; // Planned expiry time [µs] of the current line
+  bool _drift_free = true;   // Scheduler mode, see `set_drift_free()`
+  bool _frozen = false;      // Is the time track frozen? See `freeze()`
+  uint32_t _frozen_us = 0;   // Time [µs] at which the time track got frozen
+  bool _single_step = false; // See `set_single_step()`
+  bool _step_done = false;   // Has the single step completed?
+  uint32_t _speed_q16 = SPEED_Q16_ONE; // See `set_speed()`
+  uint32_t _speed_residue = 0; // Carried-over remainder of the scaled duration
+  TimingStats _timing;       // Lateness of the line switches
+  ActuationCost _cost;                         // See `set_actuation_cost()`
+  OverloadPolicy _overload = OVERLOAD_LAG;     // See `set_overload()`
+  uint32_t _overload_min_us = OVERLOAD_MIN_US; // See `set_overload()`
+  OverloadStats _overload_stats;
+  TimingQoS _qos;            // Timing summary of the run
+  ValveEventLog _events;     // Measured timing of the line switches
+  ValveEvent _pending_event; // Event awaiting its valves to be written
+  volatile bool _event_pending = false; // Is `_pending_event` in use?
+  CP_Masks _last_masks{}; // Centipede port bitmasks that were last activated
+  ValveGuard _guard;      // Minimum valve on/off duration
+  MaskTransform _xform;   // Geometric transform of the lines
+
+  // Staggered switch to the staged next line, see `set_stagger()`
+  ActuationStagger _stagger;
+  ValveLatency _latency; // Compensation of the valve latencies, if enabled
+  CP_Masks _stagger_masks[STAGGER_MAX_STEPS]; // Planned sub-steps
+  int32_t _stagger_offsets_us[STAGGER_MAX_STEPS] = {}; // Relative to deadline
+  uint8_t _N_stagger = 1;             // Number of planned sub-steps
+  volatile uint8_t _stagger_next = 0; // Sub-step the interrupt fires next
+
+  // Dump of the full protocol program, see `start_dump()`
+  Slot *_dump_slot = nullptr;   // Slot being dumped, nullptr when not dumping
+  uint16_t _dump_N_lines = 0;   // Number of lines of the program being dumped
+  uint16_t _dump_pos = 0;       // Next line number to dump
+  bool _dump_rows = false;      // Dump as binary PCS row bitmasks?
+  uint16_t _dump_block_len = 0; // Lines per hash, 0 when not dumping hashes
+  uint32_t _dump_crc = 0;       // Hash of the block being dumped so far
+  bool _dump_masks = false;     // Binary readback of the compiled lines?
+  uint16_t _dump_end = 0;       // Line number to stop the readback at
+
+  /**
+   * @brief Continue the binary readback of `start_masks_dump()`.
+   */
+  void update_dump_masks();
+
+  // Background scrubbing, see `update_scrub()`
+  uint32_t _scrub_gen = UINT32_MAX; // Program generation being scrubbed
+  uint16_t _scrub_pos = 0;          // Next line number to scrub
+  uint32_t _scrub_crc = 0;          // Checksum of the pass so far
+  uint32_t _scrub_N_passes = 0;     // Number of completed passes
+  uint32_t _scrub_N_mismatches = 0; // Number of passes failing the checksum
+
+  /**
+   * @brief Buffer containing the current @p PackedLine to be activated.
+   *
+   * Method `unpack_into()` can be called on it to get the list of PCS points,
+   * e.g. for printing.
+   */
+  PackedLine _line_buffer;
+
+  // Look-ahead stage: the next line to be activated by `update()`
+  PackedLine _next_line;     // The staged next line
+  CP_Masks _next_masks{};    // Resolved Centipede port bitmasks of next line
+  uint16_t _next_pos = 0;    // Line number of the staged next line
+  volatile bool _next_staged = false; // Is the look-ahead stage valid?
+
+  // Streaming playback
+  LineRingBuffer _ring;      // Stream buffer
+  bool _streaming = false;   // Playing from the stream buffer?
+  bool _stream_eos = false;  // No more lines will be pushed
+  bool _stream_dry = false;  // Waiting for the stream buffer to fill up
+  bool _stream_done = false; // Stream has been fully played out
+  uint32_t _N_underruns = 0; // Number of times the stream buffer ran dry
+  uint32_t _N_streamed = 0;  // Number of lines played from the stream
+  uint32_t _N_wraps = 0;     // Switches onto line 0, see `get_N_wraps()`
+  uint32_t _program_gen = 0; // See `get_program_gen()`
+
+  // Hardware timer
+  PlaybackTimer *_timer = nullptr; // Hardware timer, see `attach_timer()`
+  bool _use_timer = false;         // Fire the switches from the interrupt?
+  volatile bool _isr_fired = false;     // Has the interrupt done a switch?
+  volatile uint32_t _isr_switch_us = 0; // Time [µs] of the interrupt switch
+  volatile uint32_t _isr_done_us = 0;   // Time [µs] the interrupt sent masks
+  volatile bool _trigger_armed = false; // Await the trigger input?
+  volatile bool _triggered = false;     // Started by the trigger input?
+  int16_t _sync_pin = -1;               // See `set_sync_pin()`
+  bool _sync_level = false;             // Present level of the sync pin
+  uint16_t _sync_pulse_us = 0;          // See `set_sync_marked()`
+
+  // Following a leader MCU, see `set_follower()`
+  bool _follower = false;                 // Switch lines on the sync edges?
+  SpscBuffer<uint32_t, FOLLOW_EDGES_LEN> _edges; // Edges [µs] left to loop
+  FollowStats _follow;
+
+  /**
+   * @brief Append @p packed_line to the protocol program targeted by the
+   * edits.
+   */
+  bool append(const PackedLine &packed_line);
+
+  /**
+   * @brief Exchange the active and the staging slot.
+   */
+  void swap_slots();
+
+  /**
+   * @brief Resolve the Centipede port bitmasks of the line following the
+   * current playback position into the look-ahead stage.
+   */
+  void stage_next_line();
+
+  /**
+   * @brief Stage the line following line @p pos as yielded by @p src, see
+   * `ProgramSource`.
+   *
+   * @return True when successful. False otherwise, because @p src has no line
+   * available.
+   */
+  template <class Source> bool stage(Source src, uint16_t pos);
+
+  /**
+   * @brief See `get_N_open_ahead()`, taking the lines from @p src.
+   */
+  template <class Source> uint8_t N_open_ahead(Source src, uint16_t N_ahead);
+
+  /**
+   * @brief Plan the sub-steps of the switch to the staged next line, see
+   * `get_latency()` and `set_stagger()`.
+   */
+  void plan_stagger();
+
+  /**
+   * @brief Immediately activate the solenoid valves and color the LED matrix
+   * based on the passed Centipede port bitmasks.
+   *
+   * @param marked Is the line marked? See `set_sync_marked()`.
+   * @return The time [µs] the valves have been sent their new states.
+   */
+  uint32_t activate_masks(const CP_Masks &masks, bool marked = false);
+
+  /**
+   * @brief Append the switch to the current line position to the valve-event
+   * log and to the trace.
+   *
+   * When the valves are still being written in the background, see
+   * `CentipedeManager::set_async_mode()`, the event waits for
+   * `i2c_done_callback()` to complete it.
+   */
+  void log_event(uint32_t planned_us, uint32_t actual_us,
+                 uint32_t i2c_done_us);
+
+  /**
+   * @brief Completes the pending valve event, see `log_event()`. Called from
+   * within the DMA interrupt once the valves have been written.
+   */
+  static void i2c_done_callback(uint32_t done_us, void *ctx);
+
+  /**
+   * @brief Return the duration [µs] of the current line, scaled by the
+   * playback speed, see `set_speed()`.
+   */
+  uint32_t scaled_duration_us();
+
+  /**
+   * @brief Return the duration [µs] of @p line, scaled by the playback speed,
+   * without carrying over the fractional microseconds.
+   */
+  uint32_t scaled_duration_us(const PackedLine &line) const;
+
+  /**
+   * @brief Pass over the staged lines that have expired at @p now_us without
+   * switching to them, see `OVERLOAD_COALESCE`.
+   */
+  void coalesce_expired(uint32_t now_us);
+
+  /**
+   * @brief Advance the deadline after a line switch that took place at
+   * @p switch_us and keep track of its lateness.
+   */
+  void advance_time_track(uint32_t switch_us);
+
+  /**
+   * @brief Do the bookkeeping of a line switch done by the interrupt, if any.
+   */
+  void finish_isr_switch();
+
+  /**
+   * @brief Toggle the sync pin, if enabled, see `set_sync_pin()`. Or pulse it
+   * when switching to a marked line, see `set_sync_marked()`.
+   */
+  void toggle_sync(bool marked);
+
+  /**
+   * @brief To be called from within the trigger input interrupt when
+   * following: Switch to the staged line, or leave it to `update_follower()`.
+   */
+  void isr_follow(uint32_t edge_us);
+
+  /**
+   * @brief `update()` when following: Finish the bookkeeping of the switches
+   * done by the interrupt, stage the next line and catch up on the edges left
+   * to the main loop.
+   */
+  void update_follower();
+
+  /**
+   * @brief Add @p skew_us to the statistics on following the leader.
    */
-  Line _line_buffer;
+  void add_follow_skew(uint32_t skew_us);
 
   CentipedeManager *_cp_mgr;
 };
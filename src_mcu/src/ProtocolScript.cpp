@@ -0,0 +1,198 @@
+/**
+ * @file    ProtocolScript.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    14-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "ProtocolScript.h"
+#include "TxQueue.h"
+#include "translations.h"
+
+#include <bitset>
+
+/*------------------------------------------------------------------------------
+  ProtocolScript
+------------------------------------------------------------------------------*/
+
+uint16_t ProtocolScript::instruction_length(uint16_t addr) const {
+  uint16_t len;
+  switch (_code[addr]) {
+    case SCRIPT_END:
+    case SCRIPT_NEXT:
+    case SCRIPT_RET:
+      len = 1;
+      break;
+    case SCRIPT_WAIT:
+    case SCRIPT_REPEAT:
+    case SCRIPT_CALL:
+    case SCRIPT_SPEED:
+      len = 3;
+      break;
+    case SCRIPT_LINE:
+      if (addr + 4 > _N_bytes) {
+        return 0;
+      }
+      len = 4 + _code[addr + 3];
+      break;
+    default:
+      return 0; // Unknown opcode
+  }
+  return (addr + len <= _N_bytes) ? len : 0;
+}
+
+bool ProtocolScript::adopt(uint16_t N_bytes) {
+  // Start of each instruction, to check the CALL addresses against. Static to
+  // keep it off the stack.
+  static std::bitset<SCRIPT_MAX_BYTES> is_start;
+
+  _N_bytes = min(N_bytes, SCRIPT_MAX_BYTES);
+  _error = nullptr;
+  is_start.reset();
+
+  // Pass 1: Decode each instruction and check its operands
+  int16_t N_blocks = 0; // Number of open REPEAT blocks
+  for (uint16_t addr = 0; addr < _N_bytes;) {
+    uint16_t len = instruction_length(addr);
+    if (len == 0) {
+      _error = "ERROR: Script holds an invalid or truncated instruction.";
+      break;
+    }
+    is_start[addr] = true;
+
+    if (_code[addr] == SCRIPT_LINE) {
+      for (uint16_t idx = addr + 4; idx < addr + len; ++idx) {
+        if (P2ADDR[_code[idx]].valve == 0) {
+          _error = "ERROR: Script holds a PCS point without a valve.";
+        }
+      }
+    } else if (_code[addr] == SCRIPT_REPEAT) {
+      N_blocks++;
+    } else if ((_code[addr] == SCRIPT_NEXT) && (--N_blocks < 0)) {
+      _error = "ERROR: Script holds a NEXT without a REPEAT.";
+    } else if ((_code[addr] == SCRIPT_SPEED) && (read_u16(addr + 1) == 0)) {
+      _error = "ERROR: Script holds a SPEED of 0.";
+    }
+
+    if (_error) {
+      break;
+    }
+    addr += len;
+  }
+
+  // Pass 2: Each CALL must land on the start of an instruction
+  for (uint16_t addr = 0; !_error && (addr < _N_bytes);
+       addr += instruction_length(addr)) {
+    if ((_code[addr] == SCRIPT_CALL) && ((read_u16(addr + 1) >= _N_bytes) ||
+                                         !is_start[read_u16(addr + 1)])) {
+      _error = "ERROR: Script holds a CALL to an invalid address.";
+    }
+  }
+
+  if (_error) {
+    _N_bytes = 0;
+  }
+  rewind();
+  return (_error == nullptr);
+}
+
+void ProtocolScript::rewind() {
+  _depth = 0;
+  _pc = 0;
+  _N_points = 0;
+  _speed = 100;
+  _N_lines = 0;
+  _ended = false;
+  if (_N_bytes > 0) {
+    _error = nullptr;
+  }
+}
+
+bool ProtocolScript::fail(const char *error) {
+  _error = error;
+  _ended = true;
+  return false;
+}
+
+bool ProtocolScript::next_line(Line &line) {
+  if (_ended) {
+    return false;
+  }
+
+  for (uint8_t N_ops = 0; N_ops < SCRIPT_MAX_OPS_PER_LINE; ++N_ops) {
+    if (_pc >= _N_bytes) {
+      _ended = true;
+      return false;
+    }
+
+    uint16_t addr = _pc;
+    _pc += instruction_length(addr);
+
+    switch (_code[addr]) {
+      case SCRIPT_LINE:
+        _points_pc = addr + 4;
+        _N_points = _code[addr + 3];
+        // Fall through
+
+      case SCRIPT_WAIT: {
+        uint64_t duration_us =
+            (uint64_t)decode_duration_us(read_u16(addr + 1)) * 100 / _speed;
+        line.duration =
+            encode_duration_us(min(duration_us, (uint64_t)DURATION_MAX_US));
+        line.unpack_points(&_code[_points_pc], _N_points);
+        _N_lines++;
+        return true;
+      }
+
+      case SCRIPT_REPEAT:
+      case SCRIPT_CALL:
+        if (_depth == SCRIPT_STACK_DEPTH) {
+          return fail("ERROR: Script exceeds the maximum nesting depth.");
+        }
+        if (_code[addr] == SCRIPT_REPEAT) {
+          _stack[_depth++] = {_pc, read_u16(addr + 1), false};
+        } else {
+          _stack[_depth++] = {_pc, 0, true};
+          _pc = read_u16(addr + 1);
+        }
+        break;
+
+      case SCRIPT_NEXT: {
+        if ((_depth == 0) || _stack[_depth - 1].is_call) {
+          return fail("ERROR: Script executes a NEXT outside of its REPEAT.");
+        }
+        Frame &frame = _stack[_depth - 1];
+        if (frame.count == 0 || --frame.count > 0) {
+          _pc = frame.addr; // Play the block once more
+        } else {
+          _depth--;
+        }
+        break;
+      }
+
+      case SCRIPT_RET:
+        if ((_depth == 0) || !_stack[_depth - 1].is_call) {
+          return fail("ERROR: Script executes a RET outside of a CALL.");
+        }
+        _pc = _stack[--_depth].addr;
+        break;
+
+      case SCRIPT_SPEED:
+        _speed = read_u16(addr + 1);
+        break;
+
+      default: // SCRIPT_END
+        _ended = true;
+        return false;
+    }
+  }
+
+  return fail("ERROR: Script executes too many instructions without a line.");
+}
+
+void ProtocolScript::print_status() {
+  snprintf(buf, BUF_LEN, "%u\t%lu\t%s", _N_bytes, (unsigned long)_N_lines,
+           _error ? _error : "");
+  tx.println(buf);
+}
@@ -0,0 +1,174 @@
+/**
+ * @file    ProtocolScript.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    14-10-2026
+ *
+ * @brief   Compact bytecode format of a jetting protocol, with loops and
+ * subroutines, interpreted on the fly while playing.
+ *
+ * Repetitive protocols, e.g. a pattern block repeated many times with varied
+ * durations, need only a few hundred bytes instead of being stored in full
+ * line by line. The script gets uploaded by command `upload_script` and played
+ * by command `script`, feeding the stream buffer line by line, see `main.cpp`.
+ * The protocol program in memory is left intact.
+ *
+ * Instruction set, each being an opcode byte followed by its operands. Multi-
+ * byte values are little endian. Durations are encoded, see
+ * `encode_duration_us()`:
+ *
+ *   LINE    u16 duration, u8 N, N x byte-encoded PCS points
+ *           Open the given valves for the given duration, see
+ *           `P::pack_into_byte()`.
+ *   WAIT    u16 duration
+ *           Keep the valves of the last LINE for the given duration.
+ *   REPEAT  u16 count
+ *           Start a block that gets played `count` times, 0 meaning forever.
+ *   NEXT    Close the innermost REPEAT block.
+ *   CALL    u16 address
+ *           Call the subroutine starting at the given byte offset.
+ *   RET     Return from the subroutine.
+ *   SPEED   u16 percent
+ *           Play all subsequent durations at the given speed, i.e. scaled by
+ *           100 / percent. Defaults to 100 at the start of the script.
+ *   END     End the script. Running past the last instruction does the same.
+ *
+ * A script gets validated once, on upload. The interpreter takes a bounded
+ * number of instructions per line, see `SCRIPT_MAX_OPS_PER_LINE`.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef PROTOCOL_SCRIPT_H_
+#define PROTOCOL_SCRIPT_H_
+
+#include <Arduino.h>
+#include <array>
+
+#include "ProtocolManager.h"
+
+/**
+ * @brief Maximum size of a script [bytes].
+ */
+const uint16_t SCRIPT_MAX_BYTES = 4096;
+
+/**
+ * @brief Maximum nesting depth of REPEAT blocks and CALLs combined.
+ */
+const uint8_t SCRIPT_STACK_DEPTH = 16;
+
+/**
+ * @brief Maximum number of instructions to execute for a single line. Exceeding
+ * it, e.g. by a REPEAT block without any LINE or WAIT, is an error.
+ */
+const uint8_t SCRIPT_MAX_OPS_PER_LINE = 32;
+
+/**
+ * @brief Opcodes of the script instructions.
+ */
+enum ScriptOpcode : uint8_t {
+  SCRIPT_END,
+  SCRIPT_LINE,
+  SCRIPT_WAIT,
+  SCRIPT_REPEAT,
+  SCRIPT_NEXT,
+  SCRIPT_CALL,
+  SCRIPT_RET,
+  SCRIPT_SPEED,
+};
+
+/*------------------------------------------------------------------------------
+  ProtocolScript
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Class to hold and interpret a protocol script.
+ */
+class ProtocolScript : public LineSource {
+public:
+  /**
+   * @brief Raw storage of the script, to receive an upload into. Holds at most
+   * `SCRIPT_MAX_BYTES` bytes. Call `adopt()` afterwards.
+   */
+  inline uint8_t *buffer() { return _code.data(); }
+
+  /**
+   * @brief Validate and adopt the @p N_bytes bytes written into `buffer()`.
+   *
+   * @return True when successful. False otherwise, leaving the script empty,
+   * see `get_error()`.
+   */
+  bool adopt(uint16_t N_bytes);
+
+  /**
+   * @brief Restart at the first instruction.
+   */
+  void rewind() override;
+
+  /**
+   * @brief Execute the instructions up to and including the next LINE or
+   * WAIT, producing it into @p line.
+   *
+   * @return True when successful. False otherwise, because the script has
+   * ended, or failed, see `get_error()`.
+   */
+  bool next_line(Line &line) override;
+
+  inline uint16_t size() const { return _N_bytes; }
+
+  /**
+   * @brief Return the number of lines produced since `rewind()`.
+   */
+  inline uint32_t get_N_lines() const { return _N_lines; }
+
+  /**
+   * @brief Return the reason the last validation or execution failed, or
+   * nullptr.
+   */
+  inline const char *get_error() const { return _error; }
+
+  /**
+   * @brief Print the script size, the number of lines produced and the error,
+   * if any, tab delimited.
+   */
+  void print_status();
+
+private:
+  std::array<uint8_t, SCRIPT_MAX_BYTES> _code;
+  uint16_t _N_bytes = 0;
+
+  // Interpreter state
+  struct Frame {
+    uint16_t addr;  // Address to return to, or of the start of the block
+    uint16_t count; // Remaining passes of the REPEAT block, 0 = forever
+    bool is_call;   // CALL or REPEAT?
+  };
+  std::array<Frame, SCRIPT_STACK_DEPTH> _stack;
+  uint8_t _depth = 0;           // Number of frames on the stack
+  uint16_t _pc = 0;             // Address of the next instruction
+  uint16_t _points_pc = 0;      // Address of the PCS points of the last LINE
+  uint8_t _N_points = 0;        // Number of PCS points of the last LINE
+  uint16_t _speed = 100;        // [%], see SPEED
+  uint32_t _N_lines = 0;        // Number of lines produced
+  bool _ended = false;          // Has the script ended, or failed?
+  const char *_error = nullptr; // See `get_error()`
+
+  /**
+   * @brief Return the length of the instruction at @p addr [bytes], or 0 when
+   * it is invalid or truncated.
+   */
+  uint16_t instruction_length(uint16_t addr) const;
+
+  inline uint16_t read_u16(uint16_t addr) const {
+    return _code[addr] | (uint16_t)_code[addr + 1] << 8;
+  }
+
+  /**
+   * @brief Stop executing because of @p error.
+   *
+   * @return False, for convenience.
+   */
+  bool fail(const char *error);
+};
+
+#endif
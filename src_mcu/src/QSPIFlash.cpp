@@ -0,0 +1,304 @@
+/**
+ * @file    QSPIFlash.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "QSPIFlash.h"
+
+// Serial flash commands, common to all supported chips
+const uint8_t CMD_READ_JEDEC_ID = 0x9F;
+const uint8_t CMD_READ_STATUS = 0x05;
+const uint8_t CMD_WRITE_ENABLE = 0x06;
+const uint8_t CMD_PAGE_PROGRAM = 0x02;
+const uint8_t CMD_SECTOR_ERASE = 0x20;
+const uint8_t CMD_FAST_READ = 0x0B;
+
+// SPI clock during operation [Hz]
+const uint32_t QSPI_CLOCK = 24000000;
+
+/*------------------------------------------------------------------------------
+  QSPIFlash
+------------------------------------------------------------------------------*/
+
+#if defined(__SAMD51__)
+
+#  include "wiring_private.h"
+
+// Instruction frame of the fast-read command in memory mode
+const uint32_t FAST_READ_IFRAME =
+    QSPI_INSTRFRAME_WIDTH_SINGLE_BIT_SPI | QSPI_INSTRFRAME_ADDRLEN_24BITS |
+    QSPI_INSTRFRAME_TFRTYPE_READMEMORY | QSPI_INSTRFRAME_INSTREN |
+    QSPI_INSTRFRAME_ADDREN | QSPI_INSTRFRAME_DATAEN |
+    QSPI_INSTRFRAME_DUMMYLEN(8);
+
+volatile bool QSPIFlash::_dma_done = true;
+
+/**
+ * @brief End the instruction in progress, releasing the chip select.
+ */
+static void end_instruction() {
+  QSPI->CTRLA.reg = QSPI_CTRLA_ENABLE | QSPI_CTRLA_LASTXFER;
+  while (!QSPI->INTFLAG.bit.INSTREND) {}
+  QSPI->INTFLAG.reg = QSPI_INTFLAG_INSTREND;
+}
+
+/**
+ * @brief Run a single instruction on the QSPI peripheral, transferring the
+ * optional data via the memory-mapped AHB window.
+ */
+static void run_instruction(uint8_t command, uint32_t iframe, uint32_t addr,
+                            uint8_t *data, uint32_t len) {
+  // The data transfers are memory mapped and must bypass the cache
+  bool cache_on = CMCC->SR.bit.CSTS;
+  if (cache_on) {
+    CMCC->CTRL.bit.CEN = 0;
+    while (CMCC->SR.bit.CSTS) {}
+    CMCC->MAINT0.bit.INVALL = 1;
+  }
+
+  if (command == CMD_SECTOR_ERASE) {
+    QSPI->INSTRADDR.reg = addr;
+  }
+  QSPI->INSTRCTRL.bit.INSTR = command;
+  QSPI->INSTRFRAME.reg = iframe;
+  (void)QSPI->INSTRFRAME.reg; // Dummy read needed to synchronize
+
+  if (data && len) {
+    uint8_t *qspi_mem = (uint8_t *)(QSPI_AHB + addr);
+    uint32_t tfr_type = iframe & QSPI_INSTRFRAME_TFRTYPE_Msk;
+    if ((tfr_type == QSPI_INSTRFRAME_TFRTYPE_READ) ||
+        (tfr_type == QSPI_INSTRFRAME_TFRTYPE_READMEMORY)) {
+      memcpy(data, qspi_mem, len);
+    } else {
+      memcpy(qspi_mem, data, len);
+    }
+  }
+
+  end_instruction();
+
+  if (cache_on) {
+    CMCC->MAINT0.bit.INVALL = 1;
+    CMCC->CTRL.bit.CEN = 1;
+  }
+}
+
+static void read_register(uint8_t command, uint8_t *data, uint32_t len) {
+  run_instruction(command,
+                  QSPI_INSTRFRAME_WIDTH_SINGLE_BIT_SPI |
+                      QSPI_INSTRFRAME_ADDRLEN_24BITS |
+                      QSPI_INSTRFRAME_TFRTYPE_READ | QSPI_INSTRFRAME_INSTREN |
+                      QSPI_INSTRFRAME_DATAEN,
+                  0, data, len);
+}
+
+bool QSPIFlash::begin() {
+  MCLK->APBCMASK.bit.QSPI_ = 1;
+  MCLK->AHBMASK.bit.QSPI_ = 1;
+  MCLK->AHBMASK.bit.QSPI_2X_ = 0;
+
+  QSPI->CTRLA.bit.SWRST = 1;
+  delay(1);
+
+  pinPeripheral(PIN_QSPI_SCK, PIO_COM);
+  pinPeripheral(PIN_QSPI_CS, PIO_COM);
+  pinPeripheral(PIN_QSPI_IO0, PIO_COM);
+  pinPeripheral(PIN_QSPI_IO1, PIO_COM);
+  pinPeripheral(PIN_QSPI_IO2, PIO_COM);
+  pinPeripheral(PIN_QSPI_IO3, PIO_COM);
+
+  // SPI mode 0
+  QSPI->BAUD.reg = QSPI_BAUD_BAUD(VARIANT_MCK / QSPI_CLOCK);
+  QSPI->CTRLB.reg = QSPI_CTRLB_MODE_MEMORY | QSPI_CTRLB_DATALEN_8BITS |
+                    QSPI_CTRLB_CSMODE_LASTXFER;
+  QSPI->CTRLA.reg = QSPI_CTRLA_ENABLE;
+
+  // The third byte of the JEDEC ID encodes the capacity as a power of 2
+  uint8_t jedec_id[3] = {0};
+  read_register(CMD_READ_JEDEC_ID, jedec_id, 3);
+  if ((jedec_id[2] < 0x10) || (jedec_id[2] > 0x18)) {
+    _size = 0;
+    return false;
+  }
+  _size = 1UL << jedec_id[2];
+
+  // Memory-to-memory transfers out of the AHB window, triggered by software.
+  // Without, `start_read()` simply fails.
+  if (_dma.allocate() == DMA_STATUS_OK) {
+    _desc = _dma.addDescriptor((void *)QSPI_AHB, nullptr, 1,
+                               DMA_BEAT_SIZE_BYTE, true, true);
+    _dma.setCallback(dma_callback);
+  }
+
+  return true;
+}
+
+void QSPIFlash::dma_callback(Adafruit_ZeroDMA *dma) {
+  (void)dma;
+  _dma_done = true;
+}
+
+bool QSPIFlash::start_read(uint32_t addr, void *dest, uint32_t len) {
+  if ((_desc == nullptr) || (len == 0) || (addr + len > _size)) {
+    return false;
+  }
+  if (_reading) {
+    finish_read();
+  }
+  if (is_busy()) {
+    return false;
+  }
+
+  // As `run_instruction()`, but leaving the data transfer to the DMA. It
+  // bypasses the cache of the CPU.
+  QSPI->INSTRCTRL.bit.INSTR = CMD_FAST_READ;
+  QSPI->INSTRFRAME.reg = FAST_READ_IFRAME;
+  (void)QSPI->INSTRFRAME.reg; // Dummy read needed to synchronize
+
+  _dma.changeDescriptor(_desc, (void *)(QSPI_AHB + addr), dest, len);
+  _dma_done = false;
+  if (_dma.startJob() != DMA_STATUS_OK) {
+    _dma_done = true;
+    end_instruction();
+    return false;
+  }
+  _dma.trigger();
+  _reading = true;
+
+  return true;
+}
+
+bool QSPIFlash::is_reading() {
+  if (_reading && _dma_done) {
+    end_instruction();
+    _reading = false;
+  }
+  return _reading;
+}
+
+void QSPIFlash::finish_read() {
+  while (!_dma_done) {}
+  end_instruction();
+  _reading = false;
+}
+
+void QSPIFlash::wait_until_ready() {
+  if (_reading) {
+    finish_read();
+  }
+  uint8_t status;
+  do {
+    read_register(CMD_READ_STATUS, &status, 1);
+  } while (status & 0x01); // Write-in-progress bit
+  _busy = false;
+}
+
+bool QSPIFlash::is_busy() {
+  if (_reading) {
+    finish_read();
+  }
+  if (_busy) {
+    uint8_t status;
+    read_register(CMD_READ_STATUS, &status, 1);
+    _busy = (status & 0x01); // Write-in-progress bit
+  }
+  return _busy;
+}
+
+void QSPIFlash::write_enable() {
+  run_instruction(CMD_WRITE_ENABLE,
+                  QSPI_INSTRFRAME_WIDTH_SINGLE_BIT_SPI |
+                      QSPI_INSTRFRAME_ADDRLEN_24BITS |
+                      QSPI_INSTRFRAME_TFRTYPE_READ | QSPI_INSTRFRAME_INSTREN,
+                  0, nullptr, 0);
+}
+
+bool QSPIFlash::read(uint32_t addr, void *dest, uint32_t len) {
+  if ((_size == 0) || (addr + len > _size)) {
+    return false;
+  }
+  if (_busy || _reading) {
+    wait_until_ready();
+  }
+
+  run_instruction(CMD_FAST_READ, FAST_READ_IFRAME, addr, (uint8_t *)dest, len);
+  return true;
+}
+
+bool QSPIFlash::write(uint32_t addr, const void *src, uint32_t len) {
+  if ((_size == 0) || (addr + len > _size)) {
+    return false;
+  }
+  if (_busy || _reading) {
+    wait_until_ready();
+  }
+
+  const uint8_t *data = (const uint8_t *)src;
+  while (len > 0) {
+    // A single program command must not cross a page boundary
+    uint32_t chunk = min(len, PAGE_SIZE - (addr % PAGE_SIZE));
+
+    write_enable();
+    run_instruction(CMD_PAGE_PROGRAM,
+                    QSPI_INSTRFRAME_WIDTH_SINGLE_BIT_SPI |
+                        QSPI_INSTRFRAME_ADDRLEN_24BITS |
+                        QSPI_INSTRFRAME_TFRTYPE_WRITEMEMORY |
+                        QSPI_INSTRFRAME_INSTREN | QSPI_INSTRFRAME_ADDREN |
+                        QSPI_INSTRFRAME_DATAEN,
+                    addr, (uint8_t *)data, chunk);
+    wait_until_ready();
+
+    addr += chunk;
+    data += chunk;
+    len -= chunk;
+  }
+
+  return true;
+}
+
+bool QSPIFlash::erase_sector(uint32_t addr) {
+  if (!start_erase_sector(addr)) {
+    return false;
+  }
+  wait_until_ready();
+
+  return true;
+}
+
+bool QSPIFlash::start_erase_sector(uint32_t addr) {
+  if ((_size == 0) || (addr >= _size)) {
+    return false;
+  }
+  if (_busy || _reading) {
+    wait_until_ready();
+  }
+
+  write_enable();
+  run_instruction(CMD_SECTOR_ERASE,
+                  QSPI_INSTRFRAME_WIDTH_SINGLE_BIT_SPI |
+                      QSPI_INSTRFRAME_ADDRLEN_24BITS |
+                      QSPI_INSTRFRAME_TFRTYPE_WRITE | QSPI_INSTRFRAME_INSTREN |
+                      QSPI_INSTRFRAME_ADDREN,
+                  addr - (addr % SECTOR_SIZE), nullptr, 0);
+  _busy = true;
+
+  return true;
+}
+
+#else
+
+bool QSPIFlash::begin() { return false; }
+bool QSPIFlash::read(uint32_t, void *, uint32_t) { return false; }
+bool QSPIFlash::write(uint32_t, const void *, uint32_t) { return false; }
+bool QSPIFlash::erase_sector(uint32_t) { return false; }
+bool QSPIFlash::start_erase_sector(uint32_t) { return false; }
+bool QSPIFlash::is_busy() { return false; }
+bool QSPIFlash::start_read(uint32_t, void *, uint32_t) { return false; }
+bool QSPIFlash::is_reading() { return false; }
+void QSPIFlash::finish_read() {}
+void QSPIFlash::wait_until_ready() {}
+void QSPIFlash::write_enable() {}
+
+#endif
@@ -0,0 +1,144 @@
+/**
+ * @file    QSPIFlash.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Minimal driver for the 2 MB QSPI flash chip on board of the Adafruit
+ * Feather M4 Express, talking directly to the SAMD51 QSPI peripheral.
+ *
+ * Only single-bit SPI commands are used, which are supported by every flash
+ * chip the Feather M4 has been shipped with, without having to configure the
+ * quad-enable bit. Reading is done in memory mode via fast-read commands,
+ * either by the CPU or in the background by DMA, see `QSPIFlash::start_read()`.
+ *
+ * On boards other than the SAMD51 the flash is not available and all methods
+ * fail, see `QSPIFlash::available()`.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef QSPI_FLASH_H_
+#define QSPI_FLASH_H_
+
+#include <Arduino.h>
+
+#if defined(__SAMD51__)
+#  include "Adafruit_ZeroDMA.h"
+#endif
+
+/*------------------------------------------------------------------------------
+  QSPIFlash
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Class to read, program and erase the external QSPI flash chip.
+ *
+ * Programming can only clear bits, so the sectors to be written must have been
+ * erased beforehand.
+ */
+class QSPIFlash {
+public:
+  static const uint32_t SECTOR_SIZE = 4096; // Smallest erasable unit [bytes]
+  static const uint32_t PAGE_SIZE = 256;    // Largest programmable unit [bytes]
+
+  /**
+   * @brief Configure the QSPI peripheral and identify the flash chip.
+   *
+   * @return True when a flash chip got detected. False otherwise.
+   */
+  bool begin();
+
+  /**
+   * @brief Is the QSPI peripheral available on this board?
+   */
+  static constexpr bool available() {
+#if defined(__SAMD51__)
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  /**
+   * @brief Return the capacity of the detected flash chip [bytes], or 0 when
+   * none got detected.
+   */
+  inline uint32_t size() { return _size; }
+
+  /**
+   * @brief Read @p len bytes starting at flash address @p addr into @p dest.
+   */
+  bool read(uint32_t addr, void *dest, uint32_t len);
+
+  /**
+   * @brief Program @p len bytes from @p src starting at flash address
+   * @p addr. The area must have been erased beforehand.
+   */
+  bool write(uint32_t addr, const void *src, uint32_t len);
+
+  /**
+   * @brief Erase the sector containing flash address @p addr. Takes ~50 ms.
+   */
+  bool erase_sector(uint32_t addr);
+
+  /**
+   * @brief Start erasing the sector containing flash address @p addr, without
+   * waiting for it to finish, see `is_busy()`. Any other access waits for the
+   * erase to finish first.
+   */
+  bool start_erase_sector(uint32_t addr);
+
+  /**
+   * @brief Is an erase started by `start_erase_sector()` still ongoing?
+   */
+  bool is_busy();
+
+  /**
+   * @brief Start reading @p len bytes starting at flash address @p addr into
+   * @p dest by DMA, without waiting for it to finish, see `is_reading()`.
+   * @p dest must stay untouched meanwhile. Any other access waits for the
+   * read to finish first.
+   *
+   * @return True when started. False otherwise, e.g. because an erase is
+   * still ongoing, see `is_busy()`. Then simply try again later.
+   */
+  bool start_read(uint32_t addr, void *dest, uint32_t len);
+
+  /**
+   * @brief Is a read started by `start_read()` still ongoing? Once false, the
+   * data is in place.
+   */
+  bool is_reading();
+
+private:
+  uint32_t _size = 0;    // Capacity of the detected flash chip [bytes]
+  bool _busy = false;    // Erase started by `start_erase_sector()` ongoing?
+  bool _reading = false; // Read started by `start_read()` ongoing?
+
+#if defined(__SAMD51__)
+  static volatile bool _dma_done; // Has the DMA transfer completed?
+  Adafruit_ZeroDMA _dma;
+  DmacDescriptor *_desc = nullptr; // Nullptr when the DMA is not available
+
+  static void dma_callback(Adafruit_ZeroDMA *dma);
+#endif
+
+  /**
+   * @brief Block until the read started by `start_read()` has finished and
+   * end its instruction.
+   */
+  void finish_read();
+
+  /**
+   * @brief Block until the flash chip has finished its write or erase cycle.
+   */
+  void wait_until_ready();
+
+  /**
+   * @brief Enable writing for the upcoming program or erase command.
+   */
+  void write_enable();
+};
+
+#endif
@@ -0,0 +1,279 @@
+/**
+ * @file    RClickDAQ.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    14-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "RClickDAQ.h"
+
+#include <SPI.h>
+
+/*------------------------------------------------------------------------------
+  RClickDAQ
+------------------------------------------------------------------------------*/
+
+bool RClickDAQ::pop(DAQ_Sample &sample) {
+  if (_tail == _head) {
+    return false; // Empty
+  }
+
+  sample = _ring[_tail];
+  _tail = (_tail + 1) % RING_LEN;
+  return true;
+}
+
+#if R_CLICK_DAQ_DMA && defined(__SAMD51__)
+
+// Timer ticks per 16 µs: 48 MHz GCLK1 with a prescaler of 256
+const uint32_t TICKS_PER_16_US = 3;
+
+static RClickDAQ *instance = nullptr;
+
+/**
+ * @brief Return the number of timer ticks of interval @p DT_us [µs], or 0 when
+ * out of range.
+ */
+static uint32_t interval_ticks(uint32_t DT_us) {
+  uint32_t ticks = DT_us * TICKS_PER_16_US / 16;
+  return ((ticks < 2) || (ticks > 65536)) ? 0 : ticks;
+}
+
+bool RClickDAQ::begin(const uint8_t (&CS_pins)[N_R_CLICKS], uint32_t DT_us,
+                      uint32_t SPI_clock) {
+  uint32_t ticks = interval_ticks(DT_us);
+  if (!ticks) {
+    return false; // Interval out of range
+  }
+
+  for (uint8_t ch = 0; ch < N_R_CLICKS; ++ch) {
+    _CS_pins[ch] = CS_pins[ch];
+    digitalWrite(_CS_pins[ch], HIGH);
+  }
+
+  // MCP3201: 2 bytes per conversion, clocked in while sending out dummy bytes
+  _dma_rx.setTrigger(SPI.getDMAC_ID_RX());
+  _dma_rx.setAction(DMA_TRIGGER_ACTON_BEAT);
+  if (_dma_rx.allocate() != DMA_STATUS_OK) {
+    return false;
+  }
+  if (_dma_rx.addDescriptor(SPI.getDataRegister(), _rx_buf, sizeof(_rx_buf),
+                            DMA_BEAT_SIZE_BYTE, false, true) == NULL) {
+    return false;
+  }
+  _dma_rx.setCallback(dma_callback);
+
+  _dma_tx.setTrigger(SPI.getDMAC_ID_TX());
+  _dma_tx.setAction(DMA_TRIGGER_ACTON_BEAT);
+  if (_dma_tx.allocate() != DMA_STATUS_OK) {
+    return false;
+  }
+  if (_dma_tx.addDescriptor(_tx_buf, SPI.getDataRegister(), sizeof(_tx_buf),
+                            DMA_BEAT_SIZE_BYTE, true, false) == NULL) {
+    return false;
+  }
+
+  // Claim the SPI bus for good
+  _SPI_clock = SPI_clock;
+  SPI.beginTransaction(SPISettings(SPI_clock, MSBFIRST, SPI_MODE0));
+  instance = this;
+
+  // Feed TC2 with the 48 MHz generic clock 1
+  MCLK->APBBMASK.bit.TC2_ = 1;
+  GCLK->PCHCTRL[TC2_GCLK_ID].reg =
+      GCLK_PCHCTRL_GEN_GCLK1_Val | (1 << GCLK_PCHCTRL_CHEN_Pos);
+  while (GCLK->SYNCBUSY.reg) {}
+
+  TC2->COUNT16.CTRLA.bit.ENABLE = 0;
+  while (TC2->COUNT16.SYNCBUSY.bit.ENABLE) {}
+  TC2->COUNT16.CTRLA.reg = TC_CTRLA_SWRST;
+  while (TC2->COUNT16.SYNCBUSY.bit.SWRST) {}
+
+  // 16-bit periodic counter with TOP = CC0, overflowing once per interval
+  TC2->COUNT16.CTRLA.reg = TC_CTRLA_MODE_COUNT16 | TC_CTRLA_PRESCALER_DIV256;
+  TC2->COUNT16.WAVE.reg = TC_WAVE_WAVEGEN_MFRQ;
+  TC2->COUNT16.CC[0].reg = ticks - 1;
+  while (TC2->COUNT16.SYNCBUSY.bit.CC0) {}
+  TC2->COUNT16.INTENSET.reg = TC_INTENSET_OVF;
+
+  // Below the protocol playback timer, which must not wait on the sampling
+  NVIC_ClearPendingIRQ(TC2_IRQn);
+  NVIC_SetPriority(TC2_IRQn, 1);
+  NVIC_EnableIRQ(TC2_IRQn);
+
+  TC2->COUNT16.CTRLA.bit.ENABLE = 1;
+  while (TC2->COUNT16.SYNCBUSY.bit.ENABLE) {}
+
+  return true;
+}
+
+bool RClickDAQ::set_interval(uint32_t DT_us) {
+  uint32_t ticks = interval_ticks(DT_us);
+  if ((instance != this) || !ticks) {
+    return false;
+  }
+
+  // Restart the count, as it may already be past the new TOP
+  TC2->COUNT16.CC[0].reg = ticks - 1;
+  while (TC2->COUNT16.SYNCBUSY.bit.CC0) {}
+  TC2->COUNT16.CTRLBSET.reg = TC_CTRLBSET_CMD_RETRIGGER;
+  while (TC2->COUNT16.SYNCBUSY.bit.CTRLB) {}
+  return true;
+}
+
+void RClickDAQ::start_transfer() {
+  digitalWrite(_CS_pins[_idx_ch], LOW); // Enable slave device
+  _dma_rx.startJob();
+  _dma_tx.startJob();
+}
+
+bool RClickDAQ::start_burst(BurstSample *buf, uint32_t max_N_samples,
+                            uint32_t duration_us, uint32_t SPI_clock) {
+  if ((instance != this) || _bursting || (max_N_samples == 0)) {
+    return false;
+  }
+
+  // Pause the periodic sampling and let its ongoing transfers finish
+  NVIC_DisableIRQ(TC2_IRQn);
+  while (_busy) {}
+
+  SPI.endTransaction();
+  SPI.beginTransaction(SPISettings(SPI_clock, MSBFIRST, SPI_MODE0));
+
+  _burst_buf = buf;
+  _burst_max_N = max_N_samples;
+  _burst_duration_us = duration_us;
+  _N_burst = 0;
+  _burst_span_us = 0;
+  _burst_done = false;
+  _bursting = true;
+
+  _busy = true;
+  _burst_t0 = micros();
+  _acq.t_us = _burst_t0;
+  _idx_ch = 0;
+  start_transfer();
+  return true;
+}
+
+bool RClickDAQ::update_burst() {
+  if (!_bursting || !_burst_done) {
+    return false;
+  }
+
+  SPI.endTransaction();
+  SPI.beginTransaction(SPISettings(_SPI_clock, MSBFIRST, SPI_MODE0));
+  _bursting = false;
+
+  // Resume the periodic sampling
+  TC2->COUNT16.INTFLAG.reg = TC_INTFLAG_OVF;
+  NVIC_ClearPendingIRQ(TC2_IRQn);
+  NVIC_EnableIRQ(TC2_IRQn);
+  return true;
+}
+
+void RClickDAQ::burst_sample_done() {
+  uint32_t t_us = _acq.t_us - _burst_t0;
+  BurstSample &out = _burst_buf[_N_burst];
+  out.t_us = (uint16_t)t_us;
+  for (uint8_t ch = 0; ch < N_R_CLICKS; ++ch) {
+    out.bitval[ch] = _acq.bitval[ch];
+  }
+  _N_burst++;
+  _burst_span_us = t_us;
+
+  uint32_t now_us = micros();
+  if ((_N_burst >= _burst_max_N) ||
+      (now_us - _burst_t0 >= _burst_duration_us)) {
+    _burst_done = true;
+    _busy = false;
+    return;
+  }
+
+  // Start the next sample right away
+  _acq.t_us = now_us;
+  _idx_ch = 0;
+  start_transfer();
+}
+
+void RClickDAQ::isr() {
+  TC2->COUNT16.INTFLAG.reg = TC_INTFLAG_OVF;
+  if (_busy) {
+    _N_overruns++;
+    return;
+  }
+
+  _busy = true;
+  _acq.t_us = micros();
+  _idx_ch = 0;
+  start_transfer();
+}
+
+void RClickDAQ::dma_callback(Adafruit_ZeroDMA *dma) {
+  (void)dma;
+  RClickDAQ &self = *instance;
+
+  digitalWrite(self._CS_pins[self._idx_ch], HIGH); // Disable slave device
+
+  // Reconstruct bit value, see `R_Click::read_bitval()`
+  self._acq.bitval[self._idx_ch] =
+      (uint16_t)(((self._rx_buf[0] & 0x1F) << 8) | self._rx_buf[1]) >> 1;
+
+  self._idx_ch++;
+  if (self._idx_ch < N_R_CLICKS) {
+    self.start_transfer();
+    return;
+  }
+
+  // All R Clicks have been read out
+  if (self._bursting) {
+    self.burst_sample_done();
+    return;
+  }
+
+  uint8_t next = (self._head + 1) % RING_LEN;
+  if (next == self._tail) {
+    self._N_dropped++; // Full
+  } else {
+    self._ring[self._head] = self._acq;
+    self._head = next;
+  }
+  self._busy = false;
+}
+
+void TC2_Handler() {
+  if (instance) {
+    instance->isr();
+  }
+}
+
+#else
+
+bool RClickDAQ::begin(const uint8_t (&CS_pins)[N_R_CLICKS], uint32_t DT_us,
+                      uint32_t SPI_clock) {
+  (void)CS_pins;
+  (void)DT_us;
+  (void)SPI_clock;
+  return false;
+}
+
+bool RClickDAQ::set_interval(uint32_t DT_us) {
+  (void)DT_us;
+  return false;
+}
+
+bool RClickDAQ::start_burst(BurstSample *buf, uint32_t max_N_samples,
+                            uint32_t duration_us, uint32_t SPI_clock) {
+  (void)buf;
+  (void)max_N_samples;
+  (void)duration_us;
+  (void)SPI_clock;
+  return false;
+}
+
+bool RClickDAQ::update_burst() { return false; }
+
+void RClickDAQ::isr() {}
+
+#endif
@@ -0,0 +1,245 @@
+/**
+ * @file    RClickDAQ.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    14-10-2026
+ *
+ * @brief   Background data acquisition of the four MIKROE 4-20 mA R Click
+ * boards via a hardware timer, SPI and DMA on the SAMD51.
+ *
+ * Reading out the R Clicks from within `loop()` blocks the main loop and only
+ * samples when the loop comes round, so the oversampling interval stretches
+ * whenever a slow task like `FastLED.show()` runs. Instead, the SAMD51 TC2
+ * peripheral fires at a fixed rate. Each tick starts a chain of four SPI DMA
+ * transfers, one per MCP3201 ADC, toggling the cable select pins in between
+ * from within the DMA completion interrupt. Each completed set of four readings
+ * gets time stamped and pushed onto a ring buffer, to be drained by the main
+ * loop at its own pace.
+ *
+ * The timer runs at 187.5 kHz (48 MHz GCLK1 / 256) in 16-bit mode, allowing
+ * for sampling intervals up to ~349 ms.
+ *
+ * Next to this periodic sampling, a burst capture can sample all R Clicks
+ * back-to-back at a higher SPI clock into a caller-supplied buffer for a short
+ * while, e.g. to resolve water-hammer transients, see `start_burst()`.
+ *
+ * The SPI bus is claimed exclusively: `R_Click_Array::read_bitvals()` must not
+ * be called anymore after `begin()` has succeeded.
+ *
+ * On boards other than the SAMD51 the acquisition is not available, see
+ * `RClickDAQ::available()`.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef R_CLICK_DAQ_H_
+#define R_CLICK_DAQ_H_
+
+#include <Arduino.h>
+
+/**
+ * @brief Acquire the R Clicks in the background via a timer and DMA instead of
+ * polling them from the main loop? Only takes effect on the SAMD51.
+ */
+#ifndef R_CLICK_DAQ_DMA
+#  define R_CLICK_DAQ_DMA 1
+#endif
+
+#if R_CLICK_DAQ_DMA && defined(__SAMD51__)
+#  include "Adafruit_ZeroDMA.h"
+#endif
+
+// Number of R Click boards
+const uint8_t N_R_CLICKS = 4;
+
+/*------------------------------------------------------------------------------
+  DAQ_Sample
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Structure to hold a single reading of all R Clicks, acquired at the
+ * same timer tick.
+ */
+struct DAQ_Sample {
+  uint32_t t_us;               // Timer tick on the `micros()` time track
+  uint16_t bitval[N_R_CLICKS]; // Reading of each R Click [bitval]
+};
+
+/**
+ * @brief Structure to hold a single reading of all R Clicks during a burst
+ * capture, little endian.
+ */
+struct __attribute__((packed)) BurstSample {
+  uint16_t t_us;               // Time since the start of the burst [µs], wraps
+  uint16_t bitval[N_R_CLICKS]; // Reading of each R Click [bitval]
+};
+
+/*------------------------------------------------------------------------------
+  RClickDAQ
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Class to acquire the R Clicks at a fixed rate in the background.
+ *
+ * Only a single instance can exist, because it claims the TC2 peripheral and
+ * its interrupt handler.
+ */
+class RClickDAQ {
+public:
+  /**
+   * @brief Is the background acquisition available on this board and enabled?
+   */
+  static constexpr bool available() {
+#if R_CLICK_DAQ_DMA && defined(__SAMD51__)
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  /**
+   * @brief Claim the SPI bus, allocate the DMA channels and start sampling.
+   * The SPI bus must have been started already, e.g. by `R_Click::begin()`.
+   *
+   * @param CS_pins The cable select pin of each R Click
+   * @param DT_us Sampling interval [µs]
+   * @param SPI_clock SPI clock frequency [Hz], at most 1.6 MHz for the MCP3201
+   * @return True when successful, false otherwise.
+   */
+  bool begin(const uint8_t (&CS_pins)[N_R_CLICKS], uint32_t DT_us,
+             uint32_t SPI_clock);
+
+  /**
+   * @brief Change the sampling interval to @p DT_us [µs] on the fly. The
+   * next tick follows @p DT_us after the call.
+   *
+   * @return True when successful. False when `begin()` did not succeed or
+   * when the interval is out of range.
+   */
+  bool set_interval(uint32_t DT_us);
+
+  /**
+   * @brief Number of samples the ring buffer can hold before the main loop
+   * has to drain it.
+   */
+  static constexpr uint8_t get_capacity() { return RING_LEN - 1; }
+
+  /**
+   * @brief Retrieve the oldest acquired sample from the ring buffer.
+   *
+   * @param sample Reference to a `DAQ_Sample` to write into
+   * @return True when a sample got retrieved. False when the ring buffer is
+   * empty.
+   */
+  bool pop(DAQ_Sample &sample);
+
+  /**
+   * @brief Number of timer ticks that got skipped, because the acquisition of
+   * the previous tick was still ongoing.
+   */
+  inline uint32_t get_N_overruns() { return _N_overruns; }
+
+  /**
+   * @brief Number of samples that got discarded, because the ring buffer was
+   * full, i.e. the main loop did not drain it in time.
+   */
+  inline uint32_t get_N_dropped() { return _N_dropped; }
+
+  inline void reset_stats() {
+    _N_overruns = 0;
+    _N_dropped = 0;
+  }
+
+  /**
+   * @brief Start a burst capture: Pause the periodic sampling and sample all R
+   * Clicks back-to-back into @p buf, until @p duration_us has passed or @p buf
+   * is full. Call `update_burst()` repeatedly from the main loop afterwards.
+   *
+   * @param buf Buffer to capture into, which must remain valid until the
+   * burst capture has finished
+   * @param max_N_samples Capacity of @p buf
+   * @param duration_us Duration of the burst capture [µs]
+   * @param SPI_clock SPI clock frequency [Hz] during the burst capture
+   * @return True when the burst capture got started. False when `begin()` did
+   * not succeed or when a burst capture is already ongoing.
+   */
+  bool start_burst(BurstSample *buf, uint32_t max_N_samples,
+                   uint32_t duration_us, uint32_t SPI_clock);
+
+  /**
+   * @brief Resume the periodic sampling once the burst capture has finished.
+   * To be called repeatedly from the main loop.
+   *
+   * @return True once, directly after the burst capture has finished.
+   */
+  bool update_burst();
+
+  inline bool is_bursting() { return _bursting; }
+
+  /**
+   * @brief Number of samples of the last burst capture so far.
+   */
+  inline uint32_t get_N_burst_samples() { return _N_burst; }
+
+  /**
+   * @brief Obtained duration [µs] of the last finished burst capture, from
+   * its first to its last sample.
+   */
+  inline uint32_t get_burst_span_us() { return _burst_span_us; }
+
+  /**
+   * @brief To be called exclusively from within the TC2 interrupt handler.
+   */
+  void isr();
+
+private:
+  // Capacity of the ring buffer. At the default 10 ms interval the main loop
+  // may stall for 0.3 s before samples get dropped.
+  static const uint8_t RING_LEN = 32;
+
+  DAQ_Sample _ring[RING_LEN];
+  volatile uint8_t _head = 0; // Next slot to write, owned by the interrupt
+  volatile uint8_t _tail = 0; // Next slot to read, owned by the main loop
+
+  volatile uint32_t _N_overruns = 0;
+  volatile uint32_t _N_dropped = 0;
+
+  // Burst capture
+  volatile bool _bursting = false;      // Is a burst capture ongoing?
+  volatile bool _burst_done = false;    // Has the burst capture finished?
+  volatile uint32_t _N_burst = 0;       // Number of captured samples
+  volatile uint32_t _burst_span_us = 0; // Obtained burst duration [µs]
+
+#if R_CLICK_DAQ_DMA && defined(__SAMD51__)
+  uint8_t _CS_pins[N_R_CLICKS];
+  uint32_t _SPI_clock;          // SPI clock of the periodic sampling [Hz]
+  DAQ_Sample _acq;              // Sample under acquisition
+  volatile uint8_t _idx_ch = 0; // R Click under acquisition
+  volatile bool _busy = false;  // Is the chain of transfers ongoing?
+
+  BurstSample *_burst_buf = nullptr; // Buffer of the burst capture
+  uint32_t _burst_max_N = 0;         // Capacity of the burst buffer
+  uint32_t _burst_t0 = 0;            // Start of the burst capture [µs]
+  uint32_t _burst_duration_us = 0;   // Requested duration of the burst [µs]
+
+  uint8_t _tx_buf[2] = {0xFF, 0xFF};
+  uint8_t _rx_buf[2] = {0};
+  Adafruit_ZeroDMA _dma_tx;
+  Adafruit_ZeroDMA _dma_rx;
+
+  /**
+   * @brief Start the SPI transfer of R Click @p _idx_ch.
+   */
+  void start_transfer();
+
+  /**
+   * @brief Store the completed sample into the burst buffer and start the
+   * next one, unless the burst capture has finished.
+   */
+  void burst_sample_done();
+
+  static void dma_callback(Adafruit_ZeroDMA *dma);
+#endif
+};
+
+#endif
@@ -0,0 +1,228 @@
+/**
+ * @file    SafetyPulser.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "SafetyPulser.h"
+
+#if defined(__SAMD51__)
+#  include "wiring_private.h"
+#endif
+
+// Number of frame bits following the START symbol
+const uint8_t N_FRAME_BITS = 6;
+
+/**
+ * @brief Convert milliseconds into timer ticks: 48 MHz GCLK1 with a prescaler
+ * of 1024.
+ */
+constexpr uint16_t ms2ticks(uint16_t ms) {
+  return 48000000UL / 1024 * ms / 1000;
+}
+
+static SafetyPulser *instance = nullptr;
+
+/*------------------------------------------------------------------------------
+  SafetyPulser
+------------------------------------------------------------------------------*/
+
+#if defined(__SAMD51__)
+
+void SafetyPulser::begin() {
+  instance = this;
+
+  // Feed TC4 with the 48 MHz generic clock 1
+  MCLK->APBCMASK.bit.TC4_ = 1;
+  GCLK->PCHCTRL[TC4_GCLK_ID].reg =
+      GCLK_PCHCTRL_GEN_GCLK1_Val | (1 << GCLK_PCHCTRL_CHEN_Pos);
+  while (GCLK->SYNCBUSY.reg) {}
+
+  TC4->COUNT16.CTRLA.bit.ENABLE = 0;
+  while (TC4->COUNT16.SYNCBUSY.bit.ENABLE) {}
+  TC4->COUNT16.CTRLA.reg = TC_CTRLA_SWRST;
+  while (TC4->COUNT16.SYNCBUSY.bit.SWRST) {}
+
+  // 16-bit one-shot counter with TOP = CC0, toggling WO[0] once per shot
+  TC4->COUNT16.CTRLA.reg = TC_CTRLA_MODE_COUNT16 | TC_CTRLA_PRESCALER_DIV1024;
+  TC4->COUNT16.WAVE.reg = TC_WAVE_WAVEGEN_MFRQ;
+  TC4->COUNT16.CTRLBSET.reg = TC_CTRLBSET_ONESHOT;
+  while (TC4->COUNT16.SYNCBUSY.bit.CTRLB) {}
+  TC4->COUNT16.INTENSET.reg = TC_INTENSET_OVF;
+
+  // Below the playback timer: A pulse edge may well wait a few µs
+  NVIC_ClearPendingIRQ(TC4_IRQn);
+  NVIC_SetPriority(TC4_IRQn, 2);
+  NVIC_EnableIRQ(TC4_IRQn);
+
+  TC4->COUNT16.CTRLA.bit.ENABLE = 1;
+  while (TC4->COUNT16.SYNCBUSY.bit.ENABLE) {}
+
+  // Stop the counter that got started by enabling the peripheral
+  TC4->COUNT16.CTRLBSET.reg = TC_CTRLBSET_CMD_STOP;
+  while (TC4->COUNT16.SYNCBUSY.bit.CTRLB) {}
+
+  // Hand the pin over to WO[0] of TC4
+  pinPeripheral(PIN_SAFETY_PULSE_OUT, PIO_TIMER);
+}
+
+void SafetyPulser::allow(bool allowed) {
+  uint32_t now_us = micros();
+  uint32_t loop_us = now_us - _tick_loop_us;
+
+  NVIC_DisableIRQ(TC4_IRQn);
+  _tick_loop_us = now_us;
+  if (loop_us > _max_loop_us) {
+    _max_loop_us = loop_us;
+  }
+
+  _tick_allow = millis();
+  _allowed = allowed;
+  if (allowed && !_running) {
+    if (_tripped) {
+      // Hand the pin back over to WO[0] of TC4, still at `_level`
+      _tripped = false;
+      pinPeripheral(PIN_SAFETY_PULSE_OUT, PIO_TIMER);
+    }
+
+    // Finish the current level in half a period, then start a new frame
+    _running = true;
+    _bit_idx = 0;
+    _low_ticks = ms2ticks(_period_ms) / 2;
+    retrigger(ms2ticks(_period_ms) / 2);
+  }
+  NVIC_EnableIRQ(TC4_IRQn);
+}
+
+void SafetyPulser::set_health(SafetyState state, bool valves_open) {
+  _health = (state & 0b11) | (valves_open << 4);
+}
+
+void SafetyPulser::trip() {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  TC4->COUNT16.CTRLBSET.reg = TC_CTRLBSET_CMD_STOP;
+  while (TC4->COUNT16.SYNCBUSY.bit.CTRLB) {}
+  if (TC4->COUNT16.INTFLAG.bit.OVF) {
+    // WO[0] has toggled without the interrupt having caught up
+    TC4->COUNT16.INTFLAG.reg = TC_INTFLAG_OVF;
+    _level = !_level;
+  }
+  NVIC_ClearPendingIRQ(TC4_IRQn);
+  _allowed = false;
+  _running = false;
+  _stopping = false;
+  _tripped = true;
+
+  // Take the pin over from TC4. The low level before the pulse ends a high
+  // symbol that might have been ongoing.
+  pinMode(PIN_SAFETY_PULSE_OUT, OUTPUT);
+  digitalWrite(PIN_SAFETY_PULSE_OUT, LOW);
+  delayMicroseconds(SAFETY_TRIP_PULSE_US);
+  digitalWrite(PIN_SAFETY_PULSE_OUT, HIGH);
+  delayMicroseconds(SAFETY_TRIP_PULSE_US);
+  digitalWrite(PIN_SAFETY_PULSE_OUT, LOW);
+  __set_PRIMASK(primask);
+}
+
+void SafetyPulser::retrigger(uint16_t ticks) {
+  TC4->COUNT16.CC[0].reg = ticks - 1;
+  while (TC4->COUNT16.SYNCBUSY.bit.CC0) {}
+  TC4->COUNT16.CTRLBSET.reg = TC_CTRLBSET_CMD_RETRIGGER;
+  while (TC4->COUNT16.SYNCBUSY.bit.CTRLB) {}
+}
+
+uint8_t SafetyPulser::latch_frame() {
+  uint32_t loop_us = _max_loop_us;
+  uint8_t bucket = (loop_us < 1000)     ? 0
+                   : (loop_us < 10000)  ? 1
+                   : (loop_us < 100000) ? 2
+                                        : 3;
+  uint8_t frame = (_health & 0b10011) | (bucket << 2);
+
+  _max_loop_us = 0;
+  return frame | (__builtin_parity(frame) << 5);
+}
+
+void SafetyPulser::isr() {
+  TC4->COUNT16.INTFLAG.reg = TC_INTFLAG_OVF;
+
+  // The output has just toggled. Only continue when recently allowed.
+  _level = !_level;
+  if (millis() - _tick_allow > SAFETY_ALLOW_DEADLINE) {
+    _running = false;
+    return;
+  }
+
+  if (!_level) {
+    // Low half following a symbol, unless it was the final STOP symbol
+    if (_stopping) {
+      _stopping = false;
+      _running = false;
+    } else {
+      retrigger(_low_ticks);
+    }
+    return;
+  }
+
+  // High half, carrying the next symbol
+  uint8_t width;
+  if (!_allowed) {
+    width = SAFETY_SYMBOL_STOP;
+    _stopping = true;
+  } else if (_bit_idx == 0) {
+    width = SAFETY_SYMBOL_START;
+    _frame = latch_frame();
+    _bit_idx = 1;
+  } else {
+    width = (_frame >> (_bit_idx - 1)) & 1 ? SAFETY_SYMBOL_1 : SAFETY_SYMBOL_0;
+    if (++_bit_idx > N_FRAME_BITS) {
+      _bit_idx = 0;
+    }
+  }
+
+  _low_ticks = ms2ticks(_period_ms) - ms2ticks(width);
+  retrigger(ms2ticks(width));
+}
+
+void TC4_Handler() {
+  if (instance) {
+    instance->isr();
+  }
+}
+
+#else
+
+void SafetyPulser::begin() { instance = this; }
+
+void SafetyPulser::allow(bool allowed) {
+  // Toggle in software instead, as part of the main loop
+  _allowed = allowed;
+  if (allowed && (millis() - _tick_toggle >= _period_ms / 2)) {
+    _tick_toggle = millis();
+    _level = !_level;
+    digitalWrite(PIN_SAFETY_PULSE_OUT, _level);
+  }
+}
+
+void SafetyPulser::set_health(SafetyState state, bool valves_open) {
+  _health = (state & 0b11) | (valves_open << 4);
+}
+
+void SafetyPulser::trip() {
+  _allowed = false;
+  digitalWrite(PIN_SAFETY_PULSE_OUT, LOW);
+  delayMicroseconds(SAFETY_TRIP_PULSE_US);
+  digitalWrite(PIN_SAFETY_PULSE_OUT, HIGH);
+  delayMicroseconds(SAFETY_TRIP_PULSE_US);
+  digitalWrite(PIN_SAFETY_PULSE_OUT, LOW);
+  _level = false;
+}
+
+void SafetyPulser::retrigger(uint16_t ticks) {}
+uint8_t SafetyPulser::latch_frame() { return 0; }
+void SafetyPulser::isr() {}
+
+#endif
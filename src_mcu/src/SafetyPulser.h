@@ -0,0 +1,164 @@
+/**
+ * @file    SafetyPulser.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Hardware-timed generation of the safety pulses to the safety MCU on
+ * the SAMD51 TC4 peripheral, see `PIN_SAFETY_PULSE_OUT`.
+ *
+ * The pulse train used to be toggled from within the main loop, so that any
+ * long blocking call could starve it and trip the pump relay spuriously.
+ * Instead, TC4 toggles its waveform output WO[0] on pin 12 (PA22) in hardware.
+ *
+ * The fail-safe semantics are kept: The timer runs in one-shot mode and has to
+ * be retriggered from within its interrupt after every half period. The
+ * interrupt only does so as long as the main loop has allowed it, see
+ * `allow()`, within the last `SAFETY_ALLOW_DEADLINE` ms. Otherwise, the output
+ * goes static and the safety MCU drops the relay. The same happens when the
+ * interrupts stop being serviced altogether.
+ *
+ * Encoded heartbeat:
+ *   Every period of `PERIOD_SAFETY_PULSES` ms carries a single symbol, encoded
+ *   in the time that the pulse stays high, see `SAFETY_SYMBOL_...`. A frame
+ *   consists of a START symbol followed by 6 bit symbols, LSB first:
+ *
+ *     bits 0-1: FSM state, see `SafetyState`
+ *     bits 2-3: Loop-latency bucket, worst case over the previous frame:
+ *               0: < 1 ms, 1: < 10 ms, 2: < 100 ms, 3: >= 100 ms
+ *     bit  4  : Any valve open? Also set while the pump safety is overridden,
+ *               see command `override_safety`
+ *     bit  5  : Even parity over bits 0-4
+ *
+ *   Once disallowed, the train gets ended gracefully by a STOP symbol, after
+ *   which the output stays low. The safety MCU drops the relay on receiving
+ *   it, without having to wait for its timeout. When even the STOP symbol
+ *   would take too long, e.g. when halting, `trip()` ends the train by an
+ *   invalid symbol right away.
+ *
+ * On boards other than the SAMD51 a plain square wave gets toggled in software
+ * from within `allow()` instead, without the encoded heartbeat.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef SAFETY_PULSER_H_
+#define SAFETY_PULSER_H_
+
+#include "constants.h"
+
+#include <Arduino.h>
+
+/*------------------------------------------------------------------------------
+  SafetyState
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief FSM state of the main MCU as reported in the heartbeat frame.
+ */
+enum SafetyState : uint8_t {
+  SAFETY_STATE_IDLE,    // Off
+  SAFETY_STATE_PLAYING, // Running, armed, streaming or generating
+  SAFETY_STATE_PAUSED,  // Paused
+  SAFETY_STATE_LOADING, // Uploading a protocol program or script
+};
+
+/*------------------------------------------------------------------------------
+  SafetyPulser
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Class to generate the safety pulses in hardware, gated by a single
+ * 'allowed' flag that must be refreshed by the main loop within a deadline.
+ *
+ * Only a single instance can exist, because it claims the TC4 peripheral and
+ * its interrupt handler.
+ */
+class SafetyPulser {
+public:
+  /**
+   * @brief Configure the TC4 peripheral, its interrupt and the output pin. The
+   * pulses stay off until `allow()` gets called.
+   */
+  void begin();
+
+  /**
+   * @brief Are the pulses generated in hardware on this board?
+   */
+  static constexpr bool available() {
+#if defined(__SAMD51__)
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  /**
+   * @brief Allow the pulses to continue for another `SAFETY_ALLOW_DEADLINE`
+   * ms (true), or end them with a STOP symbol (false). Must be called
+   * repeatedly from within the main loop, because the time between calls gets
+   * reported as the loop latency.
+   */
+  void allow(bool allowed);
+
+  /**
+   * @brief Set the health of the main MCU to report in the next frame.
+   *
+   * @param state FSM state, see `SafetyState`
+   * @param valves_open Is any valve open? Pass true as well while the pump
+   * safety is overridden, as the safety MCU drops the relay otherwise.
+   */
+  void set_health(SafetyState state, bool valves_open);
+
+  /**
+   * @brief Set the period [ms] of the pulses, `PERIOD_SAFETY_PULSES` by
+   * default, taking effect from the next symbol on. Must stay within the band
+   * accepted by the safety MCU and exceed the widest symbol, see
+   * `TuningStore`.
+   */
+  inline void set_period(uint16_t period_ms) { _period_ms = period_ms; }
+
+  /**
+   * @brief End the pulse train right away by a pulse too short to be a valid
+   * symbol, see `SAFETY_TRIP_PULSE_US`, upon which the safety MCU drops the
+   * relay straight away. Blocks for twice that width, also with interrupts
+   * disabled. Safe to be called from within an interrupt. A later
+   * `allow(true)` starts a new pulse train.
+   */
+  void trip();
+
+  /**
+   * @brief To be called exclusively from within the TC4 interrupt handler.
+   */
+  void isr();
+
+private:
+  volatile bool _allowed = false;     // Has the main loop allowed the pulses?
+  volatile uint32_t _tick_allow = 0;  // Time [ms] of the last allowance
+  volatile bool _running = false;     // Is the pulse train ongoing?
+  bool _tripped = false;              // Has the pin been taken from TC4?
+  bool _level = false;                // Output level after the last toggle
+  bool _stopping = false;             // Is the STOP symbol being sent?
+  uint16_t _low_ticks = 0;            // Timer ticks of the upcoming low half
+  uint8_t _bit_idx = 0;               // Next frame bit to send, 0: START
+  uint8_t _frame = 0;                 // Frame being sent
+  volatile uint8_t _health = 0;       // Frame bits 0-4 as set by the main loop
+  uint32_t _tick_loop_us = 0;         // Time [µs] of the previous `allow()`
+  volatile uint32_t _max_loop_us = 0; // Worst loop latency [µs] this frame
+  uint32_t _tick_toggle = 0;          // Time [ms] of the last software toggle
+  volatile uint16_t _period_ms = PERIOD_SAFETY_PULSES; // See `set_period()`
+
+  /**
+   * @brief Start the next half period of the pulse train, lasting the given
+   * number of timer ticks.
+   */
+  void retrigger(uint16_t ticks);
+
+  /**
+   * @brief Return the frame to send next, containing the latest health and
+   * the loop-latency bucket, and start a new latency measurement.
+   */
+  uint8_t latch_frame();
+};
+
+#endif
@@ -0,0 +1,153 @@
+/**
+ * @file    SamplingProfiler.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "SamplingProfiler.h"
+
+// See `main.cpp`
+extern const uint8_t BUF_LEN; // Common character buffer for string formatting
+extern char buf[];            // Common character buffer for string formatting
+
+/*------------------------------------------------------------------------------
+  SamplingProfiler
+------------------------------------------------------------------------------*/
+
+#if defined(__SAMD51__)
+
+// Timer ticks per µs: 48 MHz GCLK1 with a prescaler of 16
+const uint32_t PROF_TICKS_PER_US = 3;
+
+// End of the code in flash, set by the linker script
+extern uint32_t __etext;
+
+static SamplingProfiler *instance = nullptr;
+
+bool SamplingProfiler::start(uint32_t period_us, uint32_t lo, uint32_t hi) {
+  lo = lo ? lo : SCB->VTOR; // The vector table heads the firmware image
+  hi = hi ? hi : (uint32_t)&__etext;
+  if ((period_us < PROF_PERIOD_MIN_US) || (period_us > PROF_PERIOD_MAX_US) ||
+      (hi <= lo)) {
+    return false;
+  }
+
+  stop();
+  instance = this;
+  _lo = lo;
+  _span = hi - lo;
+  _shift = 0;
+  while ((_span - 1) >> _shift >= PROF_N_BINS) {
+    _shift++;
+  }
+  _period_us = period_us;
+  _N = 0;
+  _N_outside = 0;
+  _N_isr = 0;
+  memset(_bins, 0, sizeof(_bins));
+
+  // Feed TC5 with the 48 MHz generic clock 1
+  MCLK->APBCMASK.bit.TC5_ = 1;
+  GCLK->PCHCTRL[TC5_GCLK_ID].reg =
+      GCLK_PCHCTRL_GEN_GCLK1_Val | (1 << GCLK_PCHCTRL_CHEN_Pos);
+  while (GCLK->SYNCBUSY.reg) {}
+
+  TC5->COUNT16.CTRLA.bit.ENABLE = 0;
+  while (TC5->COUNT16.SYNCBUSY.bit.ENABLE) {}
+  TC5->COUNT16.CTRLA.reg = TC_CTRLA_SWRST;
+  while (TC5->COUNT16.SYNCBUSY.bit.SWRST) {}
+
+  // 16-bit counter with TOP = CC0, overflowing once per sampling period
+  TC5->COUNT16.CTRLA.reg = TC_CTRLA_MODE_COUNT16 | TC_CTRLA_PRESCALER_DIV16;
+  TC5->COUNT16.WAVE.reg = TC_WAVE_WAVEGEN_MFRQ;
+  TC5->COUNT16.CC[0].reg = period_us * PROF_TICKS_PER_US - 1;
+  while (TC5->COUNT16.SYNCBUSY.bit.CC0) {}
+  TC5->COUNT16.INTENSET.reg = TC_INTENSET_OVF;
+
+  // Highest priority, to sample the other interrupt handlers as well
+  NVIC_ClearPendingIRQ(TC5_IRQn);
+  NVIC_SetPriority(TC5_IRQn, 0);
+  NVIC_EnableIRQ(TC5_IRQn);
+
+  _running = true;
+  TC5->COUNT16.CTRLA.bit.ENABLE = 1;
+  while (TC5->COUNT16.SYNCBUSY.bit.ENABLE) {}
+  return true;
+}
+
+void SamplingProfiler::stop() {
+  if (!_running) {
+    return;
+  }
+  NVIC_DisableIRQ(TC5_IRQn);
+  TC5->COUNT16.CTRLA.bit.ENABLE = 0;
+  while (TC5->COUNT16.SYNCBUSY.bit.ENABLE) {}
+  TC5->COUNT16.INTFLAG.reg = TC_INTFLAG_OVF;
+  NVIC_ClearPendingIRQ(TC5_IRQn);
+  _running = false;
+}
+
+/**
+ * @brief Tail of `TC5_Handler()`, taking the exception stack frame of the
+ * interrupted code.
+ */
+extern "C" void prof_isr(const uint32_t *frame) {
+  TC5->COUNT16.INTFLAG.reg = TC_INTFLAG_OVF;
+  if (instance) {
+    instance->sample(frame[6], frame[7]); // Stacked PC and xPSR
+  }
+}
+
+/**
+ * @brief Naked, so that no prologue moves the stack pointer away from the
+ * exception stack frame. Bit 2 of the EXC_RETURN value in LR tells on which
+ * stack it got pushed. The program counter is the 7th word of the frame,
+ * also when the frame got extended with the FPU registers.
+ */
+extern "C" __attribute__((naked)) void TC5_Handler() {
+  __asm volatile("tst lr, #4      \n"
+                 "ite eq          \n"
+                 "mrseq r0, msp   \n"
+                 "mrsne r0, psp   \n"
+                 "b prof_isr      \n");
+}
+
+#else
+
+bool SamplingProfiler::start(uint32_t, uint32_t, uint32_t) { return false; }
+void SamplingProfiler::stop() {}
+
+#endif
+
+void SamplingProfiler::print(Stream &port) {
+#if defined(__SAMD51__)
+  NVIC_DisableIRQ(TC5_IRQn);
+#endif
+
+  uint16_t N_bins = 0;
+  for (uint16_t idx = 0; idx < PROF_N_BINS; ++idx) {
+    N_bins += (_bins[idx] != 0);
+  }
+
+  snprintf(buf, BUF_LEN, "%d\t%lu\t%lu\t%lu\t%lu\t%08lx\t%lu\t%u\n", _running,
+           (unsigned long)_period_us, (unsigned long)_N,
+           (unsigned long)_N_outside, (unsigned long)_N_isr,
+           (unsigned long)_lo, 1UL << _shift, N_bins);
+  port.print(buf);
+  for (uint16_t idx = 0; idx < PROF_N_BINS; ++idx) {
+    if (_bins[idx]) {
+      snprintf(buf, BUF_LEN, "%08lx\t%lu\n",
+               (unsigned long)(_lo + ((uint32_t)idx << _shift)),
+               (unsigned long)_bins[idx]);
+      port.print(buf);
+    }
+  }
+
+#if defined(__SAMD51__)
+  if (_running) {
+    NVIC_EnableIRQ(TC5_IRQn);
+  }
+#endif
+}
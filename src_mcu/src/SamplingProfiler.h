@@ -0,0 +1,115 @@
+/**
+ * @file    SamplingProfiler.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Statistical sampling profiler on the SAMD51 TC5 peripheral,
+ * finding the hotspots of the firmware without any instrumentation.
+ *
+ * A periodic timer interrupt takes the program counter of the interrupted
+ * code from its exception stack frame and counts it into a histogram of
+ * `PROF_N_BINS` equally sized address ranges. The histogram covers the
+ * firmware image in flash by default, or any narrower range to zoom in on.
+ * Each bin spans a power of 2 bytes, the smallest fitting the range.
+ * Samples outside of the range, e.g. code running from RAM, get counted
+ * separately.
+ *
+ * The interrupt runs at the highest priority, so that it also samples the
+ * other interrupt handlers, except those of the highest priority as well. It
+ * takes well below a µs. Pick a sampling period that is not a multiple of the
+ * periodic tasks, e.g. 97 µs, to avoid aliasing.
+ *
+ * The histogram gets symbolized on the PC against the firmware ELF, see the
+ * `prof` and `prof?` commands in `main.cpp` and `JettingGrid_profile.py`.
+ *
+ * On boards other than the SAMD51 the timer is not available and
+ * `start()` fails.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef SAMPLING_PROFILER_H_
+#define SAMPLING_PROFILER_H_
+
+#include <Arduino.h>
+
+// Number of histogram bins of the program counter
+const uint16_t PROF_N_BINS = 2048;
+
+// Range of the sampling period [µs], keeping the 16-bit timer in range
+const uint32_t PROF_PERIOD_MIN_US = 20;
+const uint32_t PROF_PERIOD_MAX_US = 20000;
+
+/*------------------------------------------------------------------------------
+  SamplingProfiler
+------------------------------------------------------------------------------*/
+
+/**
+ * Only a single instance can exist, because it claims the TC5 peripheral and
+ * its interrupt handler.
+ */
+class SamplingProfiler {
+public:
+  /**
+   * @brief Start sampling every @p period_us into a cleared histogram,
+   * covering the addresses [@p lo, @p hi). Restarts when already running.
+   *
+   * @param hi End of the range, 0 for the end of the firmware image. Idem,
+   * @p lo 0 for its start.
+   * @return False when the timer is not available, the period is out of
+   * range or the range is empty, true otherwise.
+   */
+  bool start(uint32_t period_us, uint32_t lo = 0, uint32_t hi = 0);
+
+  /**
+   * @brief Stop sampling, keeping the histogram.
+   */
+  void stop();
+
+  inline bool is_running() const { return _running; }
+
+  /**
+   * @brief Print the histogram. First a header line, tab delimited:
+   *   1) Is sampling?
+   *   2) Sampling period [µs]
+   *   3) Number of samples
+   *   4) Number of samples outside of the range
+   *   5) Number of samples having interrupted another interrupt handler
+   *   6) Start address of the range (hex)
+   *   7) Number of bytes per bin, a power of 2
+   *   8) Number of non-empty bins N
+   * followed by N lines: The start address of the bin (hex) and its number
+   * of samples. Sampling pauses while printing.
+   */
+  void print(Stream &port);
+
+  /**
+   * @brief Count the interrupted program counter @p pc, with @p xpsr the
+   * interrupted program status register. To be called exclusively from
+   * within the TC5 interrupt handler.
+   */
+  inline void sample(uint32_t pc, uint32_t xpsr) {
+    _N++;
+    _N_isr += (xpsr & 0x1FF) != 0; // Exception number
+    uint32_t offset = pc - _lo;
+    if (offset < _span) {
+      _bins[offset >> _shift]++;
+    } else {
+      _N_outside++;
+    }
+  }
+
+private:
+  uint32_t _bins[PROF_N_BINS] = {};
+  uint32_t _lo = 0;        // Start address of the range
+  uint32_t _span = 0;      // Length of the range [bytes]
+  uint8_t _shift = 0;      // Bin width: 2^_shift bytes
+  uint32_t _period_us = 0; // Sampling period
+  uint32_t _N = 0;         // Number of samples
+  uint32_t _N_outside = 0; // Number of samples outside of the range
+  uint32_t _N_isr = 0;     // Number of samples inside of a handler
+  bool _running = false;
+};
+
+#endif
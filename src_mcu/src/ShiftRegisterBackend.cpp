@@ -0,0 +1,164 @@
+/**
+ * @file    ShiftRegisterBackend.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "ShiftRegisterBackend.h"
+
+/*------------------------------------------------------------------------------
+  ShiftRegisterBackend
+------------------------------------------------------------------------------*/
+
+#ifdef __SAMD51__
+static ShiftRegisterBackend *instance = nullptr;
+#endif
+
+ShiftRegisterBackend::ShiftRegisterBackend(SPIClass *spi, uint8_t pin_latch,
+                                           uint32_t SPI_clock)
+    : _spi(spi), _pin_latch(pin_latch),
+      _settings(SPI_clock, MSBFIRST, SPI_MODE0) {}
+
+uint8_t ShiftRegisterBackend::begin() {
+  pinMode(_pin_latch, OUTPUT);
+  digitalWrite(_pin_latch, LOW);
+
+  uint16_t zeros[N_CP_PORTS] = {};
+  write_ports(zeros, CP_ALL_PORTS);
+  return 0;
+}
+
+void ShiftRegisterBackend::fill_frame(uint8_t *frame) {
+  // The first byte shifted in ends up in the last chip of the chain
+  for (uint8_t port = 0; port < N_CP_PORTS; ++port) {
+    uint8_t idx = N_BYTES - 1 - 2 * port;
+    frame[idx] = _values[port] & 0xFF;
+    frame[idx - 1] = _values[port] >> 8;
+  }
+}
+
+void ShiftRegisterBackend::store(const uint16_t *values, uint8_t portmask) {
+  for (uint8_t port = 0; port < N_CP_PORTS; ++port) {
+    if ((portmask >> port) & 1) {
+      _values[port] = values[port];
+    }
+  }
+}
+
+void ShiftRegisterBackend::pulse_latch() {
+  digitalWrite(_pin_latch, HIGH);
+  digitalWrite(_pin_latch, LOW);
+}
+
+uint8_t ShiftRegisterBackend::write_ports(const uint16_t *values,
+                                          uint8_t portmask, uint32_t *skew_us) {
+  uint8_t frame[N_BYTES];
+  store(values, portmask);
+  fill_frame(frame);
+
+  _spi->beginTransaction(_settings);
+  for (uint8_t idx = 0; idx < N_BYTES; ++idx) {
+    _spi->transfer(frame[idx]);
+  }
+  _spi->endTransaction();
+  pulse_latch();
+
+  if (skew_us) {
+    *skew_us = 0;
+  }
+  return 0;
+}
+
+#ifdef __SAMD51__
+
+bool ShiftRegisterBackend::begin_dma(Sercom *hw, uint8_t dmac_id) {
+  _hw = hw;
+  _dma.setTrigger(dmac_id);
+  _dma.setAction(DMA_TRIGGER_ACTON_BEAT);
+  if (_dma.allocate() != DMA_STATUS_OK) {
+    return false;
+  }
+  if (_dma.addDescriptor(_frame, (void *)&_hw->SPI.DATA.reg, N_BYTES,
+                         DMA_BEAT_SIZE_BYTE, true, false) == NULL) {
+    return false;
+  }
+  _dma.setCallback(dma_callback);
+
+  instance = this;
+  _dma_ready = true;
+  return true;
+}
+
+void ShiftRegisterBackend::write_ports_async(const uint16_t *values,
+                                             uint8_t portmask) {
+  if (!portmask) {
+    return;
+  }
+
+  // Restore the previous state, because we might be called from an interrupt
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  store(values, portmask);
+  if (_busy) {
+    _pending = true;
+  } else {
+    _busy = true;
+    start_dma();
+  }
+  __set_PRIMASK(primask);
+}
+
+void ShiftRegisterBackend::start_dma() {
+  _pending = false;
+  fill_frame(_frame);
+  _spi->beginTransaction(_settings);
+  _hw->SPI.INTFLAG.reg = SERCOM_SPI_INTFLAG_TXC;
+  _dma.startJob();
+}
+
+void ShiftRegisterBackend::dma_done() {
+  // The DMA has handed the last byte to the SERCOM, which still has to send
+  // it out. That takes less than a µs.
+  while (!_hw->SPI.INTFLAG.bit.TXC) {}
+  _spi->endTransaction();
+  pulse_latch();
+
+  if (_pending) {
+    start_dma();
+    return;
+  }
+
+  // All done. Clear the busy flag only after the callback, so that anyone
+  // seeing it cleared also sees the results of the callback.
+  if (_callback) {
+    _callback(micros(), 0, 0, _ctx);
+  }
+  _busy = false;
+}
+
+void ShiftRegisterBackend::abort() {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  if (_busy) {
+    _dma.abort();
+    _spi->endTransaction();
+  }
+  _pending = false;
+  _busy = false;
+  __set_PRIMASK(primask);
+}
+
+void ShiftRegisterBackend::dma_callback(Adafruit_ZeroDMA *dma) {
+  if (instance && (dma == &instance->_dma)) {
+    instance->dma_done();
+  }
+}
+
+#else
+
+void ShiftRegisterBackend::write_ports_async(const uint16_t *, uint8_t) {}
+void ShiftRegisterBackend::abort() {}
+
+#endif
@@ -0,0 +1,128 @@
+/**
+ * @file    ShiftRegisterBackend.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Output backend driving a daisy chain of 74HC595 shift registers via
+ * SPI, see `OutputBackend.h`.
+ *
+ * Each port maps onto two chained 74HC595s, 16 outputs. The whole chain gets
+ * shifted in on every write, port N_CP_PORTS - 1 first and the low byte of
+ * port 0 last, after which a single pulse on the latch pin updates all outputs
+ * at once. Hence, there is no skew between the ports at all.
+ *
+ * After `begin_dma()` the chain can also be written in the background: the
+ * DMA feeds the SERCOM and its callback pulses the latch. Writes queued while
+ * the chain is being shifted in get coalesced into a single follow-up.
+ *
+ * The shift registers can't be read back. The SPI bus must have been started
+ * and must be used by this backend only.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef SHIFT_REGISTER_BACKEND_H_
+#define SHIFT_REGISTER_BACKEND_H_
+
+#include "OutputBackend.h"
+#include <Arduino.h>
+#include <SPI.h>
+
+#ifdef __SAMD51__
+#  include "Adafruit_ZeroDMA.h"
+#endif
+
+/*------------------------------------------------------------------------------
+  ShiftRegisterBackend
+------------------------------------------------------------------------------*/
+
+/**
+ * Only a single instance can use the DMA, because the DMA callback has to find
+ * its way back to it.
+ */
+class ShiftRegisterBackend : public OutputBackend {
+public:
+  /**
+   * @param spi The SPI bus, started already
+   * @param pin_latch Storage register clock (RCLK) of all chips
+   * @param SPI_clock SPI clock frequency [Hz]
+   */
+  ShiftRegisterBackend(SPIClass *spi, uint8_t pin_latch, uint32_t SPI_clock);
+
+  const char *get_name() const override { return "74HC595"; }
+
+  /**
+   * @brief Turn all outputs LOW. Can't fail, as nothing can be read back.
+   */
+  uint8_t begin() override;
+
+#ifdef __SAMD51__
+  /**
+   * @brief Allocate a DMA channel feeding the SERCOM of the SPI bus, to
+   * write the chain in the background. Must be called before `begin()`.
+   *
+   * @param hw SERCOM of the SPI bus
+   * @param dmac_id DMA trigger of the SPI bus, e.g. `SERCOM2_DMAC_ID_TX`
+   * @return True when successful, false otherwise.
+   */
+  bool begin_dma(Sercom *hw, uint8_t dmac_id);
+#endif
+
+  uint8_t write_ports(const uint16_t *values, uint8_t portmask,
+                      uint32_t *skew_us = nullptr) override;
+
+  bool can_write_async() const override { return _dma_ready; }
+  void write_ports_async(const uint16_t *values, uint8_t portmask) override;
+  bool is_busy() const override { return _busy; }
+  void abort() override;
+
+private:
+  static const uint8_t N_BYTES = 2 * N_CP_PORTS; // Length of the chain
+
+  SPIClass *_spi;
+  uint8_t _pin_latch;
+  SPISettings _settings;
+  uint16_t _values[N_CP_PORTS] = {}; // Latest value per port
+  bool _dma_ready = false;           // Has the DMA been set up?
+  volatile bool _busy = false;       // Is the chain being shifted in?
+  volatile bool _pending = false;    // Queued writes awaiting a follow-up?
+
+#ifdef __SAMD51__
+  Sercom *_hw = nullptr;
+  Adafruit_ZeroDMA _dma;
+  uint8_t _frame[N_BYTES]; // Bytes being shifted in by the DMA
+#endif
+
+  /**
+   * @brief Fill @p frame with `_values` in the order of shifting in.
+   */
+  void fill_frame(uint8_t *frame);
+
+  /**
+   * @brief Copy the ports selected by @p portmask into `_values`.
+   */
+  void store(const uint16_t *values, uint8_t portmask);
+
+  /**
+   * @brief Transfer the outputs of the shift registers to their latches.
+   */
+  void pulse_latch();
+
+#ifdef __SAMD51__
+  /**
+   * @brief Start shifting in `_values` by DMA.
+   */
+  void start_dma();
+
+  /**
+   * @brief The DMA has handed the last byte to the SERCOM: Latch once it has
+   * been sent out and carry on with the queued writes, if any.
+   */
+  void dma_done();
+
+  static void dma_callback(Adafruit_ZeroDMA *dma);
+#endif
+};
+
+#endif
@@ -0,0 +1,184 @@
+/**
+ * @file    SpscQueue.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Provides class `SpscQueue`, a wait-free single-producer
+ * single-consumer ring buffer passing items between an interrupt and the main
+ * loop without ever disabling the interrupts.
+ *
+ * The producer only writes the head index and the consumer only writes the
+ * tail index, so neither side has to lock out the other and both `push()` and
+ * `pop()` take bounded time. Each side moves its index only after having
+ * copied its item, ordered by a data memory barrier (DMB). On the single-core
+ * Cortex-M4 the barrier mainly keeps the compiler from reordering the copy
+ * past the `volatile` index, yet it also covers the write buffer.
+ *
+ * One slot is kept empty to tell a full ring from an empty one. When full,
+ * `push()` drops the new item and counts it as an overflow, because the
+ * producer may not move the tail to drop the oldest item instead.
+ *
+ * The queue has to be fed by one producer and drained by one consumer at a
+ * time. Several producers, e.g. the main loop and an interrupt, are fine as
+ * long as they can't interleave, e.g. when the main loop pushes with the
+ * interrupts disabled.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef SPSC_QUEUE_H_
+#define SPSC_QUEUE_H_
+
+#include <Arduino.h>
+
+/*------------------------------------------------------------------------------
+  SpscQueue
+------------------------------------------------------------------------------*/
+
+template <class T> class SpscQueue {
+public:
+  SpscQueue() = default;
+  SpscQueue(const SpscQueue &) = delete;
+  SpscQueue &operator=(const SpscQueue &) = delete;
+
+  /**
+   * @brief Assign the storage of @p N_slots items at @p items to the queue,
+   * holding at most `N_slots - 1` items. Empties the queue. Neither side may
+   * be active meanwhile.
+   */
+  void assign(T *items, uint16_t N_slots) {
+    _items = items;
+    _N_slots = items ? N_slots : 0;
+    _head = 0;
+    _tail = 0;
+    _N_overflows = 0;
+    _N_overflows_seen = 0;
+  }
+
+  /*----------------------------------------------------------------------------
+    Producer side
+  ----------------------------------------------------------------------------*/
+
+  /**
+   * @brief Add an item to the back of the queue.
+   *
+   * @return True when successful. False otherwise, because the queue is full.
+   */
+  bool push(const T &item) {
+    uint16_t head = _head;
+    uint16_t next = (head + 1 >= _N_slots) ? 0 : head + 1;
+    if (next == _tail) {
+      // Full, or without storage
+      _N_overflows = _N_overflows + 1;
+      return false;
+    }
+    _items[head] = item;
+    __DMB(); // Publish the item before the index
+    _head = next;
+    return true;
+  }
+
+  /*----------------------------------------------------------------------------
+    Consumer side
+  ----------------------------------------------------------------------------*/
+
+  /**
+   * @brief Take the item from the front of the queue.
+   *
+   * @return True when successful. False otherwise, because the queue is
+   * empty.
+   */
+  bool pop(T &item) { return drain(&item, 1) == 1; }
+
+  /**
+   * @brief Copy the item at the front of the queue, leaving it in the queue.
+   *
+   * @return True when successful. False otherwise, because the queue is
+   * empty.
+   */
+  bool peek(T &item) const {
+    uint16_t tail = _tail;
+    if (tail == _head) {
+      return false;
+    }
+    __DMB(); // Read the item only after having seen the index
+    item = _items[tail];
+    return true;
+  }
+
+  /**
+   * @brief Take at most @p max_count of the oldest items out of the queue.
+   *
+   * @return The number of items copied into @p out.
+   */
+  uint16_t drain(T *out, uint16_t max_count) {
+    uint16_t tail = _tail;
+    uint16_t N = min(size(), max_count);
+    if (N == 0) {
+      return 0;
+    }
+    __DMB(); // Read the items only after having seen the index
+    for (uint16_t i = 0; i < N; ++i) {
+      out[i] = _items[tail];
+      tail = (tail + 1 == _N_slots) ? 0 : tail + 1;
+    }
+    __DMB(); // Finish reading before handing the slots back
+    _tail = tail;
+    return N;
+  }
+
+  /**
+   * @brief Discard all items and reset the overflow count.
+   */
+  inline void clear() {
+    _tail = _head;
+    _N_overflows_seen = _N_overflows;
+  }
+
+  /*----------------------------------------------------------------------------
+    Either side
+  ----------------------------------------------------------------------------*/
+
+  inline uint16_t size() const {
+    uint16_t head = _head;
+    uint16_t tail = _tail;
+    return (head >= tail) ? head - tail : head + _N_slots - tail;
+  }
+
+  inline bool empty() const { return _head == _tail; }
+  inline uint16_t capacity() const { return _N_slots ? _N_slots - 1 : 0; }
+
+  /**
+   * @brief Return the number of items dropped because the queue was full,
+   * since the last `clear()`.
+   */
+  inline uint32_t get_N_overflows() const {
+    return _N_overflows - _N_overflows_seen;
+  }
+
+private:
+  T *_items = nullptr;                // Storage, see `assign()`
+  uint16_t _N_slots = 0;              // Number of items fitting the storage
+  volatile uint16_t _head = 0;        // Slot to write next, by the producer
+  volatile uint16_t _tail = 0;        // Slot to read next, by the consumer
+  volatile uint32_t _N_overflows = 0; // Dropped items, by the producer
+  uint32_t _N_overflows_seen = 0;     // `_N_overflows` at the last `clear()`
+};
+
+/*------------------------------------------------------------------------------
+  SpscBuffer
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief `SpscQueue` holding at most @p N items in storage of its own.
+ */
+template <class T, uint16_t N> class SpscBuffer : public SpscQueue<T> {
+public:
+  SpscBuffer() { this->assign(_storage, N + 1); }
+
+private:
+  T _storage[N + 1];
+};
+
+#endif
@@ -0,0 +1,152 @@
+/**
+ * @file    TaskScheduler.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "TaskScheduler.h"
+#include "Trace.h"
+#include "halt.h"
+
+// See `main.cpp`
+extern const uint8_t BUF_LEN; // Common character buffer for string formatting
+extern char buf[];            // Common character buffer for string formatting
+
+/*------------------------------------------------------------------------------
+  TaskScheduler
+------------------------------------------------------------------------------*/
+
+void TaskScheduler::add(const char *name, TaskFun fun, uint32_t period_us,
+                        TaskPriority priority, uint32_t cost_us) {
+  if (_N_tasks >= SCHED_MAX_TASKS) {
+    snprintf(buf, BUF_LEN, "CRITICAL: Task table full, can't add task '%s'",
+             name);
+    halt(16, buf);
+  }
+
+  // Insert behind the tasks of equal or higher priority
+  uint8_t idx = _N_tasks;
+  while ((idx > 0) && (_tasks[idx - 1].priority < priority)) {
+    _tasks[idx] = _tasks[idx - 1];
+    idx--;
+  }
+
+  Task &task = _tasks[idx];
+  task = Task();
+  task.name = name;
+  task.fun = fun;
+  task.period_us = period_us;
+  task.cost_us = cost_us;
+  task.priority = priority;
+  task.t_due = micros();
+  _N_tasks++;
+}
+
+void TaskScheduler::set_idle(IdleFun idle) {
+#if defined(__SAMD51__)
+  // The CPU halts, while the clocks and peripherals keep running
+  PM->SLEEPCFG.reg = PM_SLEEPCFG_SLEEPMODE_IDLE;
+  while (PM->SLEEPCFG.reg != PM_SLEEPCFG_SLEEPMODE_IDLE) {}
+#endif
+  _idle = idle;
+  _t_stats = micros();
+  _stats_slept = _slept_us;
+}
+
+void TaskScheduler::run() {
+  for (uint8_t idx = 0; idx < _N_tasks; ++idx) {
+    Task &task = _tasks[idx];
+    uint32_t now = micros();
+    if ((int32_t)(now - task.t_due) < 0) {
+      continue; // Not yet due
+    }
+
+    bool deferrable = (task.priority < TASK_HIGH) ||
+                      ((task.priority == TASK_HIGH) &&
+                       (now - task.t_due < SCHED_MAX_DEFER_US));
+    if (deferrable && (task.cost_us + SCHED_MARGIN_US > _deadline())) {
+      task.N_deferred++;
+      continue;
+    }
+
+    task.max_late_us = max(task.max_late_us, now - task.t_due);
+    trace_begin(TRACE_TASK, idx);
+    task.fun();
+    trace_end(TRACE_TASK, idx);
+    uint32_t dt = micros() - now;
+
+    task.N_runs++;
+    task.max_us = max(task.max_us, dt);
+    if (dt > task.cost_us) {
+      task.N_overruns++;
+    }
+
+    // Like `EVERY_N_MILLIS()`: Count the period from the actual start, such
+    // that a late run does not trigger a burst of catch-up runs
+    task.t_due = now + task.period_us;
+  }
+
+  sleep_if_idle();
+}
+
+void TaskScheduler::sleep_if_idle() {
+  if (_idle == nullptr) {
+    return;
+  }
+
+  uint32_t now = micros();
+  uint32_t ahead = min(_idle(), _deadline());
+  for (uint8_t idx = 0; idx < _N_tasks; ++idx) {
+    int32_t due_in = (int32_t)(_tasks[idx].t_due - now);
+    ahead = min(ahead, (uint32_t)max(due_in, (int32_t)0));
+  }
+  if (ahead < SCHED_SLEEP_MIN_US) {
+    return;
+  }
+
+#if defined(__SAMD51__)
+  __DSB();
+  __WFI();
+#endif
+  uint32_t dt = micros() - now;
+  _slept_us += dt;
+  _N_sleeps++;
+  _max_sleep_us = max(_max_sleep_us, dt);
+}
+
+void TaskScheduler::reset_stats() {
+  for (uint8_t idx = 0; idx < _N_tasks; ++idx) {
+    Task &task = _tasks[idx];
+    task.N_runs = 0;
+    task.N_deferred = 0;
+    task.N_overruns = 0;
+    task.max_us = 0;
+    task.max_late_us = 0;
+  }
+  _t_stats = micros();
+  _stats_slept = _slept_us;
+  _N_sleeps = 0;
+  _max_sleep_us = 0;
+}
+
+void TaskScheduler::print_stats(Stream &mySerial) {
+  for (uint8_t idx = 0; idx < _N_tasks; ++idx) {
+    const Task &task = _tasks[idx];
+    snprintf(buf, BUF_LEN, "%s\t%u\t%lu\t%lu\t%lu\t%lu\t%lu\t%lu\t%lu\n",
+             task.name, task.priority, (unsigned long)task.period_us,
+             (unsigned long)task.cost_us, (unsigned long)task.N_runs,
+             (unsigned long)task.N_deferred, (unsigned long)task.N_overruns,
+             (unsigned long)task.max_us, (unsigned long)task.max_late_us);
+    mySerial.print(buf);
+  }
+}
+
+void TaskScheduler::print_idle(Stream &mySerial) {
+  uint32_t span = micros() - _t_stats;
+  float pct = span ? 100.f * (_slept_us - _stats_slept) / span : 0.f;
+  snprintf(buf, BUF_LEN, "%.1f\t%lu\t%lu\n", pct, (unsigned long)_N_sleeps,
+           (unsigned long)_max_sleep_us);
+  mySerial.print(buf);
+}
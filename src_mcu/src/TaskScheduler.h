@@ -0,0 +1,170 @@
+/**
+ * @file    TaskScheduler.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Cooperative scheduler of the main-loop tasks, aware of the next line
+ * switch of the protocol program.
+ *
+ * Each task declares its period, its priority and its worst-case cost. Each
+ * pass, `TaskScheduler::run()` walks the tasks from the highest priority down
+ * and runs those that are due. A task below `TASK_CRITICAL` is not started
+ * when its cost plus a safety margin exceeds the time left until the next line
+ * switch, as given by the deadline callback. It is then deferred to a later
+ * pass, leaving the valve timing untouched. Critical tasks, like feeding the
+ * watchdog, the state machine and the safety pulses, always run. High-priority
+ * tasks get deferred for at most `SCHED_MAX_DEFER_US` past their due time,
+ * such that a protocol of very short lines cannot starve them.
+ *
+ * Per task, the scheduler keeps the number of runs, deferrals and overruns,
+ * i.e. runs taking longer than the declared cost, and the longest run and the
+ * largest lateness with respect to its period. A task that keeps overrunning
+ * has its cost declared too low, and threatens the line switches it was meant
+ * to stay clear of.
+ *
+ * The refresh of the LED matrix paces itself, see `LEDGovernor`, because its
+ * cost depends on whether a frame is pending and gets measured on the go.
+ *
+ * @section Idle sleep
+ * When the idle callback reports nothing to do, see `set_idle()`, the CPU
+ * sleeps at the end of a pass until the next interrupt, rather than spinning
+ * over tasks that merely poll. The SysTick interrupt behind `micros()` wakes
+ * it each millisecond at the latest, as do USB, the DMA and the timers.
+ * Hence, it only sleeps when the next due task, the next line switch and the
+ * wake-up time of the idle callback all lie at least `SCHED_SLEEP_MIN_US`
+ * ahead. The fraction of time asleep measures the headroom of the firmware.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef TASK_SCHEDULER_H_
+#define TASK_SCHEDULER_H_
+
+#include <Arduino.h>
+
+// Maximum number of tasks
+const uint8_t SCHED_MAX_TASKS = 20;
+
+// Safety margin [µs] between the end of a task and the next line switch
+const uint32_t SCHED_MARGIN_US = 500;
+
+// Time [µs] past its due time after which a `TASK_HIGH` task runs regardless
+const uint32_t SCHED_MAX_DEFER_US = 20000;
+
+// Shortest time [µs] ahead of the next deadline to go to sleep for, exceeding
+// the SysTick period of 1 ms, see `TaskScheduler::set_idle()`
+const uint32_t SCHED_SLEEP_MIN_US = 1500;
+
+/**
+ * @brief Priority of a task. Tasks of higher priority run first within a pass.
+ */
+enum TaskPriority : uint8_t {
+  TASK_LOW,      // Cosmetic, may lag behind, e.g. LEDs
+  TASK_NORMAL,   // Wanted each pass, e.g. telemetry
+  TASK_HIGH,     // Deferred for a bounded time only, e.g. data acquisition
+  TASK_CRITICAL, // Never deferred, e.g. state machine and commands
+};
+
+/*------------------------------------------------------------------------------
+  TaskScheduler
+------------------------------------------------------------------------------*/
+
+class TaskScheduler {
+public:
+  typedef void (*TaskFun)();
+  typedef uint32_t (*DeadlineFun)();
+  typedef uint32_t (*IdleFun)();
+
+  /**
+   * @param deadline Function returning the time left [µs] until the next line
+   * switch, `UINT32_MAX` when no switch is pending
+   */
+  explicit TaskScheduler(DeadlineFun deadline) : _deadline(deadline) {}
+
+  /**
+   * @brief Add a task. Tasks of equal priority run in the order added.
+   *
+   * @param name Name to report the statistics by
+   * @param fun Function performing the task
+   * @param period_us Period [µs], 0 to run each pass
+   * @param priority See `TaskPriority`
+   * @param cost_us Worst-case duration [µs] of a single run
+   *
+   * Halts when `SCHED_MAX_TASKS` has been reached, rather than silently
+   * leaving the task out.
+   */
+  void add(const char *name, TaskFun fun, uint32_t period_us,
+           TaskPriority priority, uint32_t cost_us);
+
+  /**
+   * @brief Let the CPU sleep in between passes when idle, see above.
+   *
+   * @param idle Function returning how long [µs] the tasks can do without
+   * running, 0 when there is work pending and `UINT32_MAX` when merely the
+   * periods of the tasks matter
+   */
+  void set_idle(IdleFun idle);
+
+  /**
+   * @brief Perform a single pass over the tasks, see above. To be called
+   * repeatedly from within the main loop.
+   */
+  void run();
+
+  /**
+   * @brief Return the total time asleep [µs], wrapping around. Differences
+   * tell the time asleep in between.
+   */
+  inline uint32_t get_slept_us() const { return _slept_us; }
+
+  void reset_stats();
+
+  /**
+   * @brief Print the statistics, one line per task in order of execution, tab
+   * delimited: Name, priority, period [µs], declared cost [µs], number of runs,
+   * number of deferrals, number of overruns, longest run [µs] and largest
+   * lateness [µs].
+   */
+  void print_stats(Stream &mySerial);
+
+  /**
+   * @brief Print the idle sleep statistics, tab delimited: Percentage of time
+   * asleep, number of sleeps and longest sleep [µs].
+   */
+  void print_idle(Stream &mySerial);
+
+private:
+  struct Task {
+    const char *name;
+    TaskFun fun;
+    uint32_t period_us;
+    uint32_t cost_us;
+    TaskPriority priority;
+    uint32_t t_due;       // Time the task is due next [µs]
+    uint32_t N_runs;      // Number of runs
+    uint32_t N_deferred;  // Number of times deferred for lack of time
+    uint32_t N_overruns;  // Number of runs exceeding `cost_us`
+    uint32_t max_us;      // Longest run [µs]
+    uint32_t max_late_us; // Largest delay of a start past `t_due` [µs]
+  };
+
+  DeadlineFun _deadline;
+  Task _tasks[SCHED_MAX_TASKS];
+  uint8_t _N_tasks = 0;
+
+  // Idle sleep
+  IdleFun _idle = nullptr;
+  uint32_t _slept_us = 0;     // Total time asleep [µs]
+  uint32_t _stats_slept = 0;  // `_slept_us` at the last `reset_stats()`
+  uint32_t _t_stats = 0;      // Time of the last `reset_stats()` [µs]
+  uint32_t _N_sleeps = 0;     // Number of sleeps
+  uint32_t _max_sleep_us = 0; // Longest sleep [µs]
+
+  /**
+   * @brief Sleep until the next interrupt, when idle.
+   */
+  void sleep_if_idle();
+};
+
+#endif
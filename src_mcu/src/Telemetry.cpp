@@ -0,0 +1,204 @@
+/**
+ * @file    Telemetry.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include <stddef.h>
+
+#include "Telemetry.h"
+
+// See `main.cpp`
+extern const uint8_t BUF_LEN; // Common character buffer for string formatting
+extern char buf[];            // Common character buffer for string formatting
+
+/*------------------------------------------------------------------------------
+  cobs_encode
+------------------------------------------------------------------------------*/
+
+uint16_t cobs_encode(const uint8_t *src, uint16_t len, uint8_t *dst) {
+  uint16_t code_idx = 0; // Index of the pending code byte
+  uint16_t out_idx = 1;
+  uint8_t code = 1; // Distance to the next zero byte
+
+  for (uint16_t idx = 0; idx < len; ++idx) {
+    if (src[idx] != 0) {
+      dst[out_idx++] = src[idx];
+      code++;
+    }
+    if ((src[idx] == 0) || (code == 0xFF)) {
+      dst[code_idx] = code;
+      code_idx = out_idx++;
+      code = 1;
+    }
+  }
+  dst[code_idx] = code;
+
+  return out_idx;
+}
+
+uint16_t cobs_frame(const uint8_t *src, uint16_t len, uint8_t *dst) {
+  uint16_t frame_len = 0;
+  dst[frame_len++] = 0x00;
+  frame_len += cobs_encode(src, len, &dst[frame_len]);
+  dst[frame_len++] = 0x00;
+  return frame_len;
+}
+
+/*------------------------------------------------------------------------------
+  Fields
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Location of a `TelemetryField` inside of `TelemetrySnapshot`.
+ */
+struct FieldSpan {
+  uint8_t offset;
+  uint8_t len;
+};
+
+#define FIELD_SPAN(member)                                                     \
+  {offsetof(TelemetrySnapshot, member), sizeof(TelemetrySnapshot::member)}
+
+// In the order of the `TelemetryField` bits
+static const FieldSpan FIELD_SPANS[TFIELD_N] = {
+    FIELD_SPAN(time_us),   FIELD_SPAN(position),     FIELD_SPAN(fsm_state),
+    FIELD_SPAN(pres_mbar), FIELD_SPAN(pres_avg_mbar), FIELD_SPAN(EMA_q4),
+    FIELD_SPAN(raw),       FIELD_SPAN(N_open),       FIELD_SPAN(N_open_ahead),
+    FIELD_SPAN(i2c),
+};
+
+uint16_t telemetry_record_len(uint16_t fields) {
+  uint16_t len = sizeof(TelemetryRecordHeader);
+  for (uint8_t bit = 0; bit < TFIELD_N; ++bit) {
+    if (fields & (1U << bit)) {
+      len += FIELD_SPANS[bit].len;
+    }
+  }
+  return len;
+}
+
+bool telemetry_due(uint16_t period_ms, uint32_t &tick) {
+  if (period_ms == 0) {
+    return false;
+  }
+
+  uint32_t now = millis();
+  if (now - tick < period_ms) {
+    return false;
+  }
+
+  tick += period_ms;
+  if (now - tick >= period_ms) {
+    tick = now; // Fell behind: Skip the missed intervals
+  }
+  return true;
+}
+
+/*------------------------------------------------------------------------------
+  Telemetry
+------------------------------------------------------------------------------*/
+
+void Telemetry::set_period(uint16_t period_ms) {
+  _period_ms = period_ms;
+  _tick = millis() - period_ms; // Such that the first packet is due directly
+}
+
+bool Telemetry::due() { return telemetry_due(_period_ms, _tick); }
+
+void Telemetry::send(TxQueue &port, TelemetryPacket &packet) {
+  packet.seq = _seq++;
+
+  uint16_t len = cobs_frame((const uint8_t *)&packet, sizeof(packet), _frame);
+  port.write_or_drop(_frame, len);
+}
+
+/*------------------------------------------------------------------------------
+  TelemetrySubscriptions
+------------------------------------------------------------------------------*/
+
+bool TelemetrySubscriptions::set(uint8_t sub, uint16_t fields,
+                                 uint16_t period_ms) {
+  if (sub >= TELEMETRY_N_SUBS) {
+    return false;
+  }
+
+  Subscription &s = _subs[sub];
+  fields &= TFIELD_ALL;
+  if ((fields == 0) || (period_ms == 0)) {
+    fields = 0;
+    period_ms = 0;
+  }
+  s.fields = fields;
+  s.period_ms = period_ms;
+  s.tick = millis() - period_ms; // Such that the first record is due directly
+  s.seq = 0;
+  s.N_sent = 0;
+
+  _active = period_ms ? (_active | (1U << sub)) : (_active & ~(1U << sub));
+  _due &= ~(1U << sub);
+  return true;
+}
+
+void TelemetrySubscriptions::clear() {
+  for (uint8_t sub = 0; sub < TELEMETRY_N_SUBS; ++sub) {
+    set(sub, 0, 0);
+  }
+}
+
+uint16_t TelemetrySubscriptions::due() {
+  uint16_t fields = 0;
+  _due = 0;
+  for (uint8_t sub = 0; sub < TELEMETRY_N_SUBS; ++sub) {
+    if ((_active & (1U << sub)) &&
+        telemetry_due(_subs[sub].period_ms, _subs[sub].tick)) {
+      _due |= (1U << sub);
+      fields |= _subs[sub].fields;
+    }
+  }
+  return fields;
+}
+
+void TelemetrySubscriptions::send(TxQueue &port,
+                                  const TelemetrySnapshot &snap) {
+  uint8_t record[TELEMETRY_RECORD_MAX_LEN];
+  TelemetryRecordHeader header;
+  header.marker = TELEMETRY_RECORD_MARKER;
+
+  for (uint8_t sub = 0; sub < TELEMETRY_N_SUBS; ++sub) {
+    if (!(_due & (1U << sub))) {
+      continue;
+    }
+
+    Subscription &s = _subs[sub];
+    header.sub = sub;
+    header.seq = s.seq++;
+    header.fields = s.fields;
+    memcpy(record, &header, sizeof(header));
+
+    uint16_t len = sizeof(header);
+    for (uint8_t bit = 0; bit < TFIELD_N; ++bit) {
+      if (s.fields & (1U << bit)) {
+        const FieldSpan &span = FIELD_SPANS[bit];
+        memcpy(&record[len], (const uint8_t *)&snap + span.offset, span.len);
+        len += span.len;
+      }
+    }
+
+    len = cobs_frame(record, len, _frame);
+    port.write_or_drop(_frame, len);
+    s.N_sent++;
+  }
+  _due = 0;
+}
+
+void TelemetrySubscriptions::print(Stream &port) {
+  for (uint8_t sub = 0; sub < TELEMETRY_N_SUBS; ++sub) {
+    snprintf(buf, BUF_LEN, "%u\t%u\t%u\t%lu\n", sub,
+             _subs[sub].fields, _subs[sub].period_ms,
+             (unsigned long)_subs[sub].N_sent);
+    port.print(buf);
+  }
+}
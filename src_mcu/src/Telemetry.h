@@ -0,0 +1,275 @@
+/**
+ * @file    Telemetry.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Fixed-size binary telemetry packets, pushed to the PC at a fixed
+ * rate once subscribed to. Replaces polling via the ASCII `?` command, which
+ * costs ~320 µs of formatting per sample.
+ *
+ * Each packet is framed by Consistent Overhead Byte Stuffing (COBS) and sent
+ * as: 0x00, COBS-encoded packet, 0x00. The ASCII replies to commands never
+ * contain a 0x00 byte and never get interrupted by a frame, which allows the
+ * PC to tell both apart on the same serial port. Gaps in the sequence number
+ * reveal dropped packets. Other binary replies, like the valve-event dump, use
+ * the same framing and are told apart from the telemetry by their length.
+ *
+ * Next to the fixed packet, several consumers can each subscribe to their own
+ * selection of fields at their own rate, see `TelemetrySubscriptions`. Only the
+ * selected fields get gathered and serialized, packed back to back in the
+ * order of `TelemetryField`.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+#include <Arduino.h>
+
+#include "TxQueue.h"
+
+/**
+ * @brief Values of `TelemetryPacket::fsm_state`.
+ */
+enum TelemetryState : uint8_t {
+  TELEMETRY_OFF,
+  TELEMETRY_PAUSED,
+  TELEMETRY_RUNNING,
+  TELEMETRY_UPLOADING,
+  TELEMETRY_STREAMING,
+  TELEMETRY_GENERATING,
+  TELEMETRY_ARMED,
+  TELEMETRY_LIVE,
+  TELEMETRY_PWM,
+};
+
+/**
+ * @brief Binary telemetry packet, little endian.
+ */
+struct __attribute__((packed)) TelemetryPacket {
+  uint16_t seq;         // Sequence number, set by `Telemetry::send()`
+  uint16_t position;    // Protocol position starting at index 1
+  uint32_t time_us;     // Timestamp [µs]
+  uint16_t EMA_q4[4];   // Moving averages of the R Clicks [1/16 bitval]
+  int16_t pres_mbar[4]; // OMEGA pressure sensors [mbar]
+  uint8_t fsm_state;    // See `TelemetryState`
+  uint8_t N_open[4];    // Number of open valves per manifold
+  uint8_t N_open_ahead; // Idem, in total, of the upcoming line, see `lookahead`
+};
+
+static_assert(sizeof(TelemetryPacket) == 30, "TelemetryPacket got padded");
+
+/**
+ * @brief COBS-encode @p len bytes of @p src into @p dst, which must be able to
+ * hold `len + len / 254 + 1` bytes.
+ *
+ * @return The number of encoded bytes.
+ */
+uint16_t cobs_encode(const uint8_t *src, uint16_t len, uint8_t *dst);
+
+/**
+ * @brief Size of a full frame holding @p len bytes: 0x00, COBS-encoded bytes,
+ * 0x00.
+ */
+constexpr uint16_t cobs_frame_len(uint16_t len) { return len + len / 254 + 3; }
+
+/**
+ * @brief Build a full frame holding @p len bytes of @p src into @p dst, which
+ * must be able to hold `cobs_frame_len(len)` bytes.
+ *
+ * @return The number of frame bytes.
+ */
+uint16_t cobs_frame(const uint8_t *src, uint16_t len, uint8_t *dst);
+
+/**
+ * @brief Field selection bits of a telemetry subscription. The fields of a
+ * `TelemetryRecord` follow in the order of these bits.
+ */
+enum TelemetryField : uint16_t {
+  TFIELD_TIME = 1U << 0,         // uint32_t: Timestamp [µs]
+  TFIELD_POSITION = 1U << 1,     // uint16_t: Protocol position from index 1
+  TFIELD_STATE = 1U << 2,        // uint8_t: See `TelemetryState`
+  TFIELD_PRES = 1U << 3,         // int16_t[4]: OMEGA pressure sensors [mbar]
+  TFIELD_PRES_AVG = 1U << 4,     // int16_t: Average pressure [mbar]
+  TFIELD_EMA = 1U << 5,          // uint16_t[4]: EMA of the R Clicks [1/16 bv]
+  TFIELD_RAW = 1U << 6,          // uint16_t[4]: Last raw R Click reading [bv]
+  TFIELD_N_OPEN = 1U << 7,       // uint8_t[4]: Open valves per manifold
+  TFIELD_N_OPEN_AHEAD = 1U << 8, // uint8_t: Idem, in total, of upcoming line
+  TFIELD_I2C = 1U << 9,          // uint32_t[5]: See `TelemetrySnapshot::i2c`
+};
+
+// Number of defined `TelemetryField` bits
+const uint8_t TFIELD_N = 10;
+const uint16_t TFIELD_ALL = (1U << TFIELD_N) - 1;
+
+/**
+ * @brief All values a subscription can select from. Only the fields selected
+ * by at least one due subscription need to be filled in.
+ */
+struct TelemetrySnapshot {
+  uint32_t time_us;
+  uint16_t position;
+  uint8_t fsm_state;
+  int16_t pres_mbar[4];
+  int16_t pres_avg_mbar;
+  uint16_t EMA_q4[4];
+  uint16_t raw[4];
+  uint8_t N_open[4];
+  uint8_t N_open_ahead;
+  // Failed I2C port transactions, mismatching output latches, and the bus
+  // timeouts, bus clears and retried port writes of the Centipede boards
+  uint32_t i2c[5];
+};
+
+// Value of `TelemetryRecordHeader::marker`, telling the records apart from
+// other frames
+const uint8_t TELEMETRY_RECORD_MARKER = 0xDE;
+
+// Number of concurrent subscriptions
+const uint8_t TELEMETRY_N_SUBS = 4;
+
+/**
+ * @brief Header of a subscription record, little endian. It is followed by the
+ * selected fields, packed in the order of `TelemetryField`.
+ */
+struct __attribute__((packed)) TelemetryRecordHeader {
+  uint8_t marker;  // `TELEMETRY_RECORD_MARKER`
+  uint8_t sub;     // Subscription number, starting at index 0
+  uint16_t seq;    // Sequence number, per subscription
+  uint16_t fields; // Selected `TelemetryField` bits
+};
+
+static_assert(sizeof(TelemetryRecordHeader) == 6,
+              "TelemetryRecordHeader got padded");
+
+// Largest size of a subscription record, holding all fields
+const uint16_t TELEMETRY_RECORD_MAX_LEN =
+    sizeof(TelemetryRecordHeader) + 4 + 2 + 1 + 8 + 2 + 8 + 8 + 4 + 1 + 20;
+
+/**
+ * @brief Return the size of a subscription record selecting @p fields.
+ */
+uint16_t telemetry_record_len(uint16_t fields);
+
+/**
+ * @brief Is the next packet due, given the @p period_ms and the time @p tick
+ * [ms] the last packet was due? Advances @p tick when due. Intervals that got
+ * missed are skipped instead of being caught up on. Pass a period of 0 for
+ * never.
+ */
+bool telemetry_due(uint16_t period_ms, uint32_t &tick);
+
+/*------------------------------------------------------------------------------
+  Telemetry
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Class to push telemetry packets at a fixed rate.
+ */
+class Telemetry {
+public:
+  /**
+   * @brief Set the interval [ms] at which packets are due. Pass 0 to stop.
+   */
+  void set_period(uint16_t period_ms);
+  inline uint16_t get_period() { return _period_ms; }
+
+  /**
+   * @brief Is the next packet due? Call repeatedly from the main loop.
+   * Intervals that got missed are skipped instead of being caught up on.
+   */
+  bool due();
+
+  /**
+   * @brief Send @p packet as a COBS frame, stamping its sequence number.
+   *
+   * The packet gets dropped instead when the transmit queue can not take the
+   * full frame, such that a PC that stops reading can not block the main loop.
+   * The sequence number gets advanced regardless.
+   */
+  void send(TxQueue &port, TelemetryPacket &packet);
+
+private:
+  uint16_t _period_ms = 0; // Interval between packets [ms], 0 is off
+  uint32_t _tick = 0;      // Time [ms] the last packet was due
+  uint16_t _seq = 0;       // Sequence number of the next packet
+
+  uint8_t _frame[cobs_frame_len(sizeof(TelemetryPacket))];
+};
+
+/*------------------------------------------------------------------------------
+  TelemetrySubscriptions
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Class to push up to `TELEMETRY_N_SUBS` concurrent subscriptions, each
+ * selecting its own fields at its own rate. E.g. a GUI at 10 Hz taking the
+ * position and average pressure, a data logger at 1 kHz taking the raw R Click
+ * readings and a maintenance tool at 1 Hz taking the I2C error counters.
+ *
+ * Usage per main loop iteration: `due()` tells which fields to gather into a
+ * `TelemetrySnapshot`, after which `send()` pushes the records that are due.
+ */
+class TelemetrySubscriptions {
+public:
+  /**
+   * @brief (Re)define subscription @p sub to push the @p fields every
+   * @p period_ms. Pass 0 for either to stop the subscription. Undefined bits
+   * of @p fields get ignored.
+   *
+   * @return False when @p sub is out of range, true otherwise.
+   */
+  bool set(uint8_t sub, uint16_t fields, uint16_t period_ms);
+
+  /**
+   * @brief Stop all subscriptions.
+   */
+  void clear();
+
+  inline bool is_active() { return _active != 0; }
+  inline uint16_t get_fields(uint8_t sub) { return _subs[sub].fields; }
+  inline uint16_t get_period(uint8_t sub) { return _subs[sub].period_ms; }
+
+  /**
+   * @brief Determine which subscriptions are due. Call repeatedly from the
+   * main loop.
+   *
+   * @return The union of the fields of the due subscriptions, 0 when none.
+   */
+  uint16_t due();
+
+  /**
+   * @brief Send a record of each subscription found due by the last call to
+   * `due()`, taking the fields from @p snap. Like `Telemetry::send()`, a record
+   * gets dropped instead when the transmit queue can not take it.
+   */
+  void send(TxQueue &port, const TelemetrySnapshot &snap);
+
+  /**
+   * @brief Print each subscription as a line, tab delimited:
+   *   1) Subscription number
+   *   2) Selected fields
+   *   3) Period [ms], 0 when stopped
+   *   4) Number of records sent
+   */
+  void print(Stream &port);
+
+private:
+  struct Subscription {
+    uint16_t fields = 0;    // Selected `TelemetryField` bits
+    uint16_t period_ms = 0; // Interval between records [ms], 0 is off
+    uint32_t tick = 0;      // Time [ms] the last record was due
+    uint16_t seq = 0;       // Sequence number of the next record
+    uint32_t N_sent = 0;    // Number of records sent
+  };
+
+  Subscription _subs[TELEMETRY_N_SUBS];
+  uint8_t _active = 0; // Bit per running subscription
+  uint8_t _due = 0;    // Bit per subscription found due by `due()`
+
+  uint8_t _frame[cobs_frame_len(TELEMETRY_RECORD_MAX_LEN)];
+};
+
+#endif
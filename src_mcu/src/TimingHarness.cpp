@@ -0,0 +1,145 @@
+/**
+ * @file    TimingHarness.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "TimingHarness.h"
+#include "translations.h"
+
+// Number of valve events drained from the log at once
+const uint8_t HIL_EVENTS_PER_DRAIN = 16;
+
+/*------------------------------------------------------------------------------
+  TimingHarness
+------------------------------------------------------------------------------*/
+
+void TimingHarness::begin(uint16_t N_passes) {
+  _N_passes = N_passes;
+  for (ClassStats &stats : _stats) {
+    stats = ClassStats();
+  }
+  _N_stray = 0;
+  _has_prev = false;
+  _protocol_mgr->get_event_log().clear();
+  _capture->clear();
+  rewind();
+}
+
+void TimingHarness::rewind() {
+  _pass = 0;
+  _class = 0;
+  _line_no = 0;
+}
+
+bool TimingHarness::next_valves(uint16_t &duration, ValveSet &valves) {
+  if (_pass >= _N_passes) {
+    return false;
+  }
+
+  // Alternate the even and the odd valves, such that all ports get written
+  valves.clear();
+  for (uint8_t valve = 1 + (_line_no & 1); valve <= N_VALVES; valve += 2) {
+    valves.set(valve);
+  }
+  duration = encode_duration_us(HIL_TEST_DURATION_US[_class]);
+
+  if (++_line_no >= HIL_TEST_N_LINES[_class]) {
+    _line_no = 0;
+    if (++_class >= HIL_N_CLASSES) {
+      _class = 0;
+      _pass++;
+    }
+  }
+  return true;
+}
+
+void TimingHarness::update() {
+  ValveEvent events[HIL_EVENTS_PER_DRAIN];
+  uint16_t N;
+
+  do {
+    N = _protocol_mgr->get_event_log().drain(events, HIL_EVENTS_PER_DRAIN);
+    for (uint16_t idx = 0; idx < N; ++idx) {
+      if (_has_prev) {
+        resolve(_prev, events[idx]);
+      }
+      _prev = events[idx];
+      _has_prev = true;
+    }
+  } while (N == HIL_EVENTS_PER_DRAIN);
+}
+
+void TimingHarness::resolve(const ValveEvent &event, const ValveEvent &next) {
+  uint32_t duration_us = next.planned_us - event.planned_us;
+  uint8_t idx_class = 0;
+  while (duration_us >= HIL_CLASS_US[idx_class]) {
+    idx_class++;
+  }
+  ClassStats &stats = _stats[idx_class];
+
+  // Skip the edges preceding the switch
+  uint32_t edge_us;
+  while (_capture->peek(edge_us) &&
+         ((int32_t)(edge_us - event.actual_us + HIL_EARLY_US) < 0)) {
+    _capture->pop(edge_us);
+    _N_stray++;
+  }
+
+  if (!_capture->peek(edge_us) ||
+      ((int32_t)(edge_us - next.actual_us + HIL_EARLY_US) >= 0)) {
+    stats.N_missed++;
+    return;
+  }
+  _capture->pop(edge_us);
+
+  int32_t latency_us = edge_us - event.planned_us;
+  stats.N++;
+  stats.min_us = min(stats.min_us, latency_us);
+  stats.max_us = max(stats.max_us, latency_us);
+  stats.sum_us += latency_us;
+  stats.sum_sq_us += (int64_t)latency_us * latency_us;
+  stats.bins[(latency_us < 2) ? 0
+                              : min(31 - __builtin_clz(latency_us),
+                                    HIL_N_BINS - 1)]++;
+}
+
+void TimingHarness::print_report(Stream &mySerial) {
+  uint32_t N_paired = 0;
+  uint32_t N_missed = 0;
+  for (const ClassStats &stats : _stats) {
+    N_paired += stats.N;
+    N_missed += stats.N_missed;
+  }
+  snprintf(buf, BUF_LEN, "%u\t%lu\t%lu\t%lu\t%lu\n", _N_passes,
+           (unsigned long)N_paired, (unsigned long)N_missed,
+           (unsigned long)_N_stray, (unsigned long)_capture->get_N_lost());
+  mySerial.print(buf);
+
+  for (uint8_t idx_class = 0; idx_class < HIL_N_CLASSES; ++idx_class) {
+    const ClassStats &stats = _stats[idx_class];
+    float mean_us = NAN;
+    float jitter_us = NAN;
+    if (stats.N) {
+      mean_us = (float)stats.sum_us / stats.N;
+      jitter_us = sqrt(max(0.f, (float)stats.sum_sq_us / stats.N -
+                                    mean_us * mean_us));
+    }
+
+    snprintf(buf, BUF_LEN, "%lu\t%lu\t%lu\t%ld\t%.1f\t%ld\t%.1f",
+             (unsigned long)(idx_class < HIL_N_CLASSES - 1
+                                 ? HIL_CLASS_US[idx_class]
+                                 : 0),
+             (unsigned long)stats.N, (unsigned long)stats.N_missed,
+             (long)(stats.N ? stats.min_us : 0), mean_us,
+             (long)(stats.N ? stats.max_us : 0), jitter_us);
+    mySerial.print(buf);
+    for (uint32_t count : stats.bins) {
+      snprintf(buf, BUF_LEN, "\t%lu", (unsigned long)count);
+      mySerial.print(buf);
+    }
+    mySerial.print('\n');
+  }
+}
@@ -0,0 +1,160 @@
+/**
+ * @file    TimingHarness.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Hardware-in-the-loop self-test of the valve timing: Proof that the
+ * valves switch when the protocol says so.
+ *
+ * A marker output that flips with every line switch gets wired back into the
+ * capture input `PIN_CAPTURE_IN`, whose edges get time stamped in hardware, see
+ * `EdgeCapture`. The marker is either:
+ *
+ * - The sync output `PIN_SYNC_OUT`, flipping right after the valves got sent
+ *   out by the microcontroller. In the asynchronous I2C mode, that is before
+ *   the transmission has completed.
+ * - A spare output of a Centipede board, i.e. an MCP23017 pin not wired to a
+ *   valve, flipping together with the valves, see
+ *   `CentipedeManager::set_marker()`. This includes the full I2C transmission
+ *   and the port expander itself. Mind the logic level of the Centipede.
+ *
+ * The harness plays a test protocol of its own as a `LineSource`, alternating
+ * the even and the odd valves, with a block of lines for each line-duration
+ * class, see `HIL_TEST_DURATION_US`. Each line switch, as logged by
+ * `ProtocolManager` in its `ValveEventLog`, gets paired with the first edge
+ * captured from its start onwards, before the start of the next switch. The
+ * latency is the time from the planned switch time to that edge. Edges
+ * pairing with no switch count as stray, switches without an edge as missed.
+ *
+ * The latencies get collected per class of the duration of the line switched
+ * to: Minimum, mean, maximum, the jitter as standard deviation and a histogram
+ * with bins doubling in width. The last switch of the test has no next switch
+ * to bound it, and gets left out.
+ *
+ * The harness drains the valve-event log itself while the test plays, so the
+ * PC should not drain it meanwhile, see command `events?`.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef TIMING_HARNESS_H_
+#define TIMING_HARNESS_H_
+
+#include <Arduino.h>
+
+#include "EdgeCapture.h"
+#include "ProtocolManager.h"
+
+// Number of line-duration classes
+const uint8_t HIL_N_CLASSES = 5;
+
+/**
+ * @brief Exclusive upper bound [µs] of the line duration of each class. The
+ * last class is open ended.
+ */
+const uint32_t HIL_CLASS_US[HIL_N_CLASSES] = {1000, 10000, 100000, 1000000,
+                                              UINT32_MAX};
+
+/**
+ * @brief Line duration [µs] and number of lines per pass of the test protocol
+ * for each class.
+ */
+const uint32_t HIL_TEST_DURATION_US[HIL_N_CLASSES] = {500, 2000, 20000,
+                                                      200000, 1000000};
+const uint16_t HIL_TEST_N_LINES[HIL_N_CLASSES] = {200, 200, 50, 10, 4};
+
+/**
+ * @brief Number of histogram bins. Bin 0 holds the latencies below 2 µs, bin
+ * i > 0 those from 2^i up to 2^(i + 1) µs. The last bin is open ended.
+ */
+const uint8_t HIL_N_BINS = 16;
+
+/**
+ * @brief Time [µs] an edge may precede the start of a switch and still pair
+ * with it, covering the conversion of the capture onto the `micros()` time
+ * track.
+ */
+const uint32_t HIL_EARLY_US = 20;
+
+/*------------------------------------------------------------------------------
+  TimingHarness
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Class to verify the valve timing in hardware, see above.
+ */
+class TimingHarness : public LineSource {
+public:
+  TimingHarness(ProtocolManager *protocol_mgr, EdgeCapture *capture)
+      : _protocol_mgr(protocol_mgr), _capture(capture) {}
+
+  /**
+   * @brief Prepare a test of @p N_passes passes over the test protocol.
+   * Clears the statistics, the valve-event log and the captured edges. The
+   * protocol itself has to be played by the caller.
+   */
+  void begin(uint16_t N_passes);
+
+  /**
+   * @brief Start from the first line of the test protocol.
+   */
+  void rewind() override;
+
+  /**
+   * @brief Produce the next line of the test protocol into @p valves.
+   *
+   * @return False once all passes have been produced. True otherwise.
+   */
+  bool next_valves(uint16_t &duration, ValveSet &valves) override;
+
+  /**
+   * @brief Pair the logged line switches with the captured edges. To be called
+   * repeatedly from within the main loop while the test plays, right after
+   * `ProtocolManager::update()`.
+   */
+  void update();
+
+  /**
+   * @brief Print the report, tab delimited. First line: Number of passes,
+   * number of paired switches, number of missed switches, number of stray
+   * edges and number of edges lost by the capture. Then one line per class:
+   * Upper bound of the line duration [µs], 0 when open ended, number of paired
+   * switches, number of missed switches, the minimum, mean and maximum latency
+   * [µs] and the jitter [µs], followed by the `HIL_N_BINS` counts of the
+   * histogram.
+   */
+  void print_report(Stream &mySerial);
+
+private:
+  struct ClassStats {
+    uint32_t N = 0;                  // Paired switches
+    uint32_t N_missed = 0;           // Switches without an edge
+    int32_t min_us = INT32_MAX;      // Smallest latency [µs]
+    int32_t max_us = INT32_MIN;      // Largest latency [µs]
+    int64_t sum_us = 0;              // Sum of the latencies [µs]
+    uint64_t sum_sq_us = 0;          // Sum of the squared latencies [µs^2]
+    uint32_t bins[HIL_N_BINS] = {0}; // Histogram of the latencies
+  };
+
+  ProtocolManager *_protocol_mgr;
+  EdgeCapture *_capture;
+  ClassStats _stats[HIL_N_CLASSES];
+  uint32_t _N_stray = 0; // Edges pairing with no switch
+
+  uint16_t _N_passes = 0; // Passes to produce
+  uint16_t _pass = 0;     // Pass being produced
+  uint8_t _class = 0;     // Class being produced
+  uint16_t _line_no = 0;  // Line being produced within the class
+
+  ValveEvent _prev;        // Switch awaiting the next one to bound it
+  bool _has_prev = false;
+
+  /**
+   * @brief Pair the switch @p event with its edge, bounded by the start of the
+   * next switch @p next, and add it to the statistics of its class.
+   */
+  void resolve(const ValveEvent &event, const ValveEvent &next);
+};
+
+#endif
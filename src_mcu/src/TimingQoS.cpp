@@ -0,0 +1,79 @@
+/**
+ * @file    TimingQoS.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "TimingQoS.h"
+
+extern const uint8_t BUF_LEN; // Common character buffer for string formatting
+extern char buf[];            // Common character buffer for string formatting
+
+/*------------------------------------------------------------------------------
+  QuantileSketch
+------------------------------------------------------------------------------*/
+
+void QuantileSketch::clear() {
+  memset(_bins, 0, sizeof(_bins));
+  _N = 0;
+  _max = 0;
+}
+
+uint32_t QuantileSketch::midpoint(uint8_t idx) {
+  if (idx < QSKETCH_SUB) {
+    return idx;
+  }
+  uint8_t shift = (idx >> QSKETCH_SUB_BITS) - 1;
+  uint32_t lower = (uint32_t)(QSKETCH_SUB | (idx & (QSKETCH_SUB - 1)))
+                   << shift;
+  return lower + ((1UL << shift) >> 1);
+}
+
+uint32_t QuantileSketch::quantile(uint16_t permille) const {
+  if (_N == 0) {
+    return 0;
+  }
+
+  // Rank of the sample, rounded up, from 1 to `_N`
+  uint32_t rank = ((uint64_t)_N * permille + 999) / 1000;
+  rank = constrain(rank, 1UL, _N);
+
+  uint32_t N_seen = 0;
+  for (uint8_t idx = 0; idx < QSKETCH_BINS; ++idx) {
+    N_seen += _bins[idx];
+    if (N_seen >= rank) {
+      return min(midpoint(idx), _max);
+    }
+  }
+  return _max;
+}
+
+/*------------------------------------------------------------------------------
+  TimingQoS
+------------------------------------------------------------------------------*/
+
+void TimingQoS::reset() {
+  _lateness.clear();
+  _send.clear();
+  _N_late = 0;
+  _drift_us = 0;
+  _N_stalls = 0;
+  _update_known = false;
+}
+
+void TimingQoS::print(Stream &mySerial) const {
+  snprintf(buf, BUF_LEN, "%lu\t%lu\t%lu\t%lu\t%lu\t%lu\t%llu\t",
+           (unsigned long)_lateness.get_N(),
+           (unsigned long)_lateness.quantile(500),
+           (unsigned long)_lateness.quantile(990),
+           (unsigned long)_lateness.get_max(), (unsigned long)_N_late,
+           (unsigned long)_late_us, (unsigned long long)_drift_us);
+  mySerial.print(buf);
+  snprintf(buf, BUF_LEN, "%lu\t%lu\t%lu\t%lu\t%lu\n",
+           (unsigned long)_send.get_N(), (unsigned long)_send.quantile(500),
+           (unsigned long)_send.quantile(990), (unsigned long)_send.get_max(),
+           (unsigned long)_N_stalls);
+  mySerial.print(buf);
+}
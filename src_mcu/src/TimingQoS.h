@@ -0,0 +1,182 @@
+/**
+ * @file    TimingQoS.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Run-level summary of how well the hardware followed the timeline of
+ * the protocol: The lateness of the line switches, the time it took the
+ * valves to be sent their new states and the stalls of the main loop.
+ *
+ * Storing every sample of a run of hours is not an option. Instead, the
+ * percentiles come from a `QuantileSketch`: a histogram with bins spaced
+ * log-linearly, 4 bins per power of 2, covering the full `uint32_t` range in
+ * 124 bins. Adding a sample costs a count-leading-zeros and an increment. A
+ * percentile is off by at most 12.5 % of its value, the maximum is exact.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef TIMING_QOS_H_
+#define TIMING_QOS_H_
+
+#include <Arduino.h>
+
+// Default lateness [µs] above which a line switch counts as late
+const uint32_t QOS_LATE_US = 1000;
+
+// Gap [µs] between two calls of `ProtocolManager::update()` above which the
+// main loop counts as stalled, like `LOOP_SLOW_US`
+const uint32_t QOS_STALL_US = 20000;
+
+// Number of bits of the sub-bins per power of 2 of `QuantileSketch`
+const uint8_t QSKETCH_SUB_BITS = 2;
+const uint8_t QSKETCH_SUB = 1U << QSKETCH_SUB_BITS;
+
+// Number of bins of `QuantileSketch`
+const uint8_t QSKETCH_BINS = QSKETCH_SUB * (32 - QSKETCH_SUB_BITS + 1);
+
+/*------------------------------------------------------------------------------
+  QuantileSketch
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Streaming estimate of the percentiles of a series of durations, see
+ * above.
+ */
+class QuantileSketch {
+public:
+  QuantileSketch() { clear(); }
+
+  void clear();
+
+  /**
+   * @brief Add a sample. Safe to be called from within an interrupt.
+   */
+  inline void add(uint32_t value) {
+    _bins[bin(value)]++;
+    _N++;
+    if (value > _max) {
+      _max = value;
+    }
+  }
+
+  /**
+   * @brief Return the estimated value at @p permille / 1000 of the samples,
+   * e.g. 500 for the median, or 0 without samples.
+   */
+  uint32_t quantile(uint16_t permille) const;
+
+  inline uint32_t get_N() const { return _N; }
+  inline uint32_t get_max() const { return _max; }
+
+private:
+  uint32_t _bins[QSKETCH_BINS];
+  uint32_t _N;   // Number of samples
+  uint32_t _max; // Largest sample
+
+  /**
+   * @brief Return the bin holding @p value: Values below `QSKETCH_SUB` get a
+   * bin of their own, each next power of 2 gets split into `QSKETCH_SUB`.
+   */
+  static inline uint8_t bin(uint32_t value) {
+    if (value < QSKETCH_SUB) {
+      return value;
+    }
+    uint8_t octave = 31 - __builtin_clz(value);
+    return ((octave - QSKETCH_SUB_BITS + 1) << QSKETCH_SUB_BITS) |
+           ((value >> (octave - QSKETCH_SUB_BITS)) & (QSKETCH_SUB - 1));
+  }
+
+  /**
+   * @brief Return the value in the middle of bin @p idx.
+   */
+  static uint32_t midpoint(uint8_t idx);
+};
+
+/*------------------------------------------------------------------------------
+  TimingQoS
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Class to accumulate the timing summary of a run, see above. Gets fed
+ * by `ProtocolManager` and reset on `play`.
+ */
+class TimingQoS {
+public:
+  /**
+   * @brief Start a fresh summary, keeping the late threshold.
+   */
+  void reset();
+
+  /**
+   * @brief Count line switches later than @p late_us as late.
+   */
+  inline void set_late_threshold(uint32_t late_us) { _late_us = late_us; }
+
+  /**
+   * @brief Add a timed line switch, @p lag_us behind its deadline.
+   *
+   * @param drift_free True: The deadlines are absolute, hence the drift is
+   * the lag of the last switch. False: Each lag gets carried over into the
+   * next deadlines, hence the drift is the sum of all lags.
+   */
+  inline void add_switch(uint32_t lag_us, bool drift_free) {
+    _lateness.add(lag_us);
+    _N_late += (lag_us > _late_us);
+    _drift_us = drift_free ? lag_us : _drift_us + lag_us;
+  }
+
+  /**
+   * @brief Add the time @p dt_us it took the valves of a switch to be sent
+   * their new states. Safe to be called from within an interrupt.
+   */
+  inline void add_send(uint32_t dt_us) { _send.add(dt_us); }
+
+  /**
+   * @brief Mark a call of `ProtocolManager::update()` at time @p now_us,
+   * counting the long gaps as stalls of the main loop.
+   */
+  inline void update(uint32_t now_us) {
+    if (_update_known && (now_us - _update_us > QOS_STALL_US)) {
+      _N_stalls++;
+    }
+    _update_us = now_us;
+    _update_known = true;
+  }
+
+  /**
+   * @brief The main loop has not been calling `update()` on purpose, e.g.
+   * while paused. Do not count the gap as a stall.
+   */
+  inline void resume() { _update_known = false; }
+
+  /**
+   * @brief Print the summary, tab delimited:
+   *   1) Number of timed line switches
+   *   2) Median lateness [µs]
+   *   3) 99th percentile lateness [µs]
+   *   4) Max lateness [µs]
+   *   5) Number of switches later than the threshold
+   *   6) Late threshold [µs]
+   *   7) Cumulative drift [µs], see `add_switch()`
+   *   8) Number of sends timed
+   *   9) Median send time [µs]
+   *  10) 99th percentile send time [µs]
+   *  11) Max send time [µs]
+   *  12) Number of stalls of the main loop
+   */
+  void print(Stream &mySerial) const;
+
+private:
+  QuantileSketch _lateness; // Lag of each timed switch behind its deadline
+  QuantileSketch _send;     // Time to send the valves their new states
+  uint32_t _late_us = QOS_LATE_US;
+  uint32_t _N_late = 0;   // Number of switches later than `_late_us`
+  uint64_t _drift_us = 0; // Cumulative drift from the protocol timeline
+  uint32_t _N_stalls = 0; // Number of stalls of the main loop
+  uint32_t _update_us = 0;
+  bool _update_known = false; // Is `_update_us` valid?
+};
+
+#endif
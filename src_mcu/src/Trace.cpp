@@ -0,0 +1,66 @@
+/**
+ * @file    Trace.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    14-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "Trace.h"
+
+volatile bool trace_enabled = false;
+TraceRecord trace_records[TRACE_LEN];
+volatile uint32_t trace_N_traced = 0;
+
+static uint32_t trace_N_drained = 0; // Total number of drained records
+static uint32_t trace_N_lost = 0;    // Total number of overwritten records
+
+/*------------------------------------------------------------------------------
+  Trace
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Skip over the records that got overwritten. Must be called with
+ * interrupts disabled.
+ */
+static void trace_skip_lost() {
+  uint32_t N_waiting = trace_N_traced - trace_N_drained;
+  if (N_waiting > TRACE_LEN) {
+    trace_N_lost += N_waiting - TRACE_LEN;
+    trace_N_drained = trace_N_traced - TRACE_LEN;
+  }
+}
+
+uint16_t trace_drain(TraceRecord *out, uint16_t max_count) {
+  noInterrupts();
+  trace_skip_lost();
+  uint16_t N = min(trace_N_traced - trace_N_drained, (uint32_t)max_count);
+  for (uint16_t i = 0; i < N; ++i) {
+    out[i] = trace_records[trace_N_drained++ & (TRACE_LEN - 1)];
+  }
+  interrupts();
+  return N;
+}
+
+uint16_t trace_size() {
+  noInterrupts();
+  trace_skip_lost();
+  uint16_t N = trace_N_traced - trace_N_drained;
+  interrupts();
+  return N;
+}
+
+uint32_t trace_get_N_lost() {
+  noInterrupts();
+  trace_skip_lost();
+  uint32_t N_lost = trace_N_lost;
+  interrupts();
+  return N_lost;
+}
+
+void trace_clear() {
+  noInterrupts();
+  trace_N_drained = trace_N_traced;
+  trace_N_lost = 0;
+  interrupts();
+}
@@ -0,0 +1,171 @@
+/**
+ * @file    Trace.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Lightweight binary trace of firmware events, replacing the debug
+ * prints over serial.
+ *
+ * Each call to `trace()` stores a fixed-size `TraceRecord` holding a time
+ * stamp, an event ID and two arguments into a ring buffer. That costs a few
+ * stores, without any formatting or serial output, also from within an
+ * interrupt. Hence, tracing barely changes the timing that is being debugged.
+ * When the ring buffer is full, the oldest records get overwritten. The PC
+ * drains the records in binary and formats them, see the `trace` command in
+ * `main.cpp` and `TRACE_EVENTS` of the Python module.
+ *
+ * Besides single events, sections of code get traced as a span: a BEGIN and
+ * an END record, see `trace_begin()`, `trace_end()` and `TRACE_SPAN()`.
+ * Together with the time stamps in µs, the PC can then lay out the line
+ * activations, I2C transactions, LED shows, DAQ ticks, command handling,
+ * USB transmissions and scheduled tasks on a timeline, see
+ * `JettingGrid_trace.py` converting the records into the Chrome/Perfetto
+ * trace format. A missed deadline can then be traced back to what was
+ * keeping the main loop or the bus busy.
+ *
+ * Tracing is switched on and off at runtime by `trace_on` and `trace_off`.
+ * When off, a call to `trace()` costs a single test.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <Arduino.h>
+
+/**
+ * @brief The traced events, with the meaning of their arguments `a` and `b`.
+ * New events must be appended, to keep the PC-side names in sync.
+ */
+enum TraceEventID : uint8_t {
+  TRACE_LINE_ACTIVATED,  // A line got activated: a = line no., b = [ms]
+  TRACE_UPLOAD_LINE,     // A line got uploaded: a = N points, b = [ms]
+  TRACE_UPLOAD_EOP,      // End of an upload: a = N lines promised, b = N lines
+  TRACE_DAQ_LATE,        // Large R Click DAQ interval: b = interval [µs]
+  TRACE_CP_MISMATCH,     // Wrong latched outputs: a = port, b = read << 16 |
+                         // expected
+  TRACE_LOOP_SLOW,       // Slow main loop iteration: a = `LoopStage` taking the
+                         // longest, b = iteration [µs]
+  TRACE_PROGRAM_CORRUPT, // Scrubbed program failed its CRC32: a = N lines,
+                         // b = scrubbed CRC32
+  TRACE_PRESSURE_ANOMALY, // Anomaly capture triggered: a = line no., b =
+                         // `AnomalyCause` << 8 | manifold
+  TRACE_I2C_WRITE,       // Span, I2C transaction of `I2CEngine`: a = port,
+                         // b = failed? at the END
+  TRACE_LED_SHOW,        // Span, sending out the LED matrix
+  TRACE_DAQ_TICK,        // R Click reading at `DAQ_DT`: a = oversampling
+                         // factor, b = time stamp of the reading [µs]
+  TRACE_COMMAND,         // Span, handling a command: b = its first 4 chars
+  TRACE_USB_TX,          // Span, writing to the serial port: a = N bytes
+  TRACE_TASK,            // Span, task of `TaskScheduler`: a = task index
+  TRACE_N_EVENTS
+};
+
+/**
+ * @brief Kind of record: a single event or either end of a span.
+ */
+enum TracePhase : uint8_t { TRACE_INSTANT, TRACE_BEGIN, TRACE_END };
+
+/**
+ * @brief A single traced event, little endian.
+ */
+struct __attribute__((packed)) TraceRecord {
+  uint32_t time_us; // Time stamp [µs] on the `micros()` time track
+  uint8_t id;       // `TraceEventID`
+  uint8_t flags;    // Bit 0: Traced from within an interrupt handler?
+                    // Bits 1-2: `TracePhase`
+  uint16_t a;       // First argument, see `TraceEventID`
+  uint32_t b;       // Second argument, see `TraceEventID`
+};
+
+static_assert(sizeof(TraceRecord) == 12, "TraceRecord got padded");
+
+/**
+ * @brief Number of records the ring buffer can hold before the oldest ones get
+ * overwritten. Must be a power of 2. Holds ~1 s of a running protocol with
+ * all spans.
+ */
+const uint16_t TRACE_LEN = 1024;
+
+extern volatile bool trace_enabled; // See `trace_on` and `trace_off`
+extern TraceRecord trace_records[TRACE_LEN];
+extern volatile uint32_t trace_N_traced; // Total number of traced records
+
+/**
+ * @brief Add a record of event @p id of kind @p phase to the ring buffer, when
+ * enabled. Safe to call from within an interrupt handler.
+ */
+inline void trace_record(TraceEventID id, TracePhase phase, uint16_t a,
+                         uint32_t b) {
+  if (!trace_enabled) {
+    return;
+  }
+
+  // Claim a record. Restore the previous state, because we might be called
+  // from an interrupt.
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  TraceRecord &record = trace_records[trace_N_traced++ & (TRACE_LEN - 1)];
+  __set_PRIMASK(primask);
+
+#if defined(__arm__)
+  record.flags = (__get_IPSR() != 0) | (phase << 1);
+#else
+  record.flags = phase << 1;
+#endif
+  record.time_us = micros();
+  record.id = id;
+  record.a = a;
+  record.b = b;
+}
+
+/**
+ * @brief Trace a single event @p id, see `trace_record()`.
+ */
+inline void trace(TraceEventID id, uint16_t a = 0, uint32_t b = 0) {
+  trace_record(id, TRACE_INSTANT, a, b);
+}
+
+/**
+ * @brief Trace the start of a span of event @p id, see `trace_record()`.
+ */
+inline void trace_begin(TraceEventID id, uint16_t a = 0, uint32_t b = 0) {
+  trace_record(id, TRACE_BEGIN, a, b);
+}
+
+/**
+ * @brief Trace the end of a span of event @p id, see `trace_record()`.
+ */
+inline void trace_end(TraceEventID id, uint16_t a = 0, uint32_t b = 0) {
+  trace_record(id, TRACE_END, a, b);
+}
+
+/**
+ * @brief Traces a span from its construction until the end of the enclosing
+ * scope, see `TRACE_SPAN()`.
+ */
+class TraceSpan {
+public:
+  inline TraceSpan(TraceEventID id, uint16_t a = 0, uint32_t b = 0)
+      : _id(id), _a(a) {
+    trace_begin(id, a, b);
+  }
+  inline ~TraceSpan() { trace_end(_id, _a); }
+
+private:
+  TraceEventID _id;
+  uint16_t _a;
+};
+
+#define TRACE_CONCAT_(x, y) x##y
+#define TRACE_CONCAT(x, y) TRACE_CONCAT_(x, y)
+
+/**
+ * @brief Trace a span until the end of the enclosing scope. Takes the event ID
+ * optionally followed by the arguments `a` and `b`.
+ */
+#define TRACE_SPAN(...) TraceSpan TRACE_CONCAT(span_, __LINE__)(__VA_ARGS__)
+
+#endif
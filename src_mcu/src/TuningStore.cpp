@@ -0,0 +1,233 @@
+/**
+ * @file    TuningStore.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "TuningStore.h"
+#include "crc32.h"
+
+#include <stddef.h>
+
+extern const uint8_t BUF_LEN;
+extern char buf[];
+
+// "TUN1", to be bumped when the layout of `TuningValues` changes
+const uint32_t TUNING_MAGIC = 0x54554E31;
+
+// The bounds of `safety_period_ms` follow from the band accepted by the safety
+// MCU, 40 - 80 ms, while exceeding the widest symbol `SAFETY_SYMBOL_STOP`. The
+// upper bound of `daq_lp_Hz` stays below the Nyquist frequency at the longest
+// `daq_dt_us`.
+const TuningKnob TUNING_KNOBS[N_TUNING_KNOBS] = {
+    {"daq_dt_us", offsetof(TuningValues, daq_dt_us), TUNE_U32, 2000, 50000,
+     false},
+    {"daq_lp_Hz", offsetof(TuningValues, daq_lp_Hz), TUNE_FLOAT, 0.1, 10,
+     true},
+    {"watchdog_ms", offsetof(TuningValues, watchdog_ms), TUNE_U16, 2000, 16000,
+     true},
+    {"led_idle_ms", offsetof(TuningValues, led_idle_ms), TUNE_U16, 20, 1000,
+     true},
+    {"led_idle_running_ms", offsetof(TuningValues, led_idle_running_ms),
+     TUNE_U16, 20, 1000, true},
+    {"safety_period_ms", offsetof(TuningValues, safety_period_ms), TUNE_U16,
+     55, 75, true},
+};
+
+static_assert(SAFETY_SYMBOL_STOP < 55, "Safety pulse period bound too low");
+
+/*------------------------------------------------------------------------------
+  SmartEEPROM access
+------------------------------------------------------------------------------*/
+
+#if defined(__SAMD51__)
+
+/**
+ * @brief Return the size of the SmartEEPROM [bytes], 0 when not set up.
+ */
+static uint32_t seeprom_size() {
+  if (NVMCTRL->SEESTAT.bit.SBLK == 0) {
+    return 0;
+  }
+  // 512 bytes at PSZ = 0, doubling with each step up
+  return 512UL << NVMCTRL->SEESTAT.bit.PSZ;
+}
+
+static void seeprom_read(uint32_t addr, void *dest, uint32_t len) {
+  while (NVMCTRL->SEESTAT.bit.BUSY) {}
+  memcpy(dest, (const void *)(SEEPROM_ADDR + addr), len);
+}
+
+/**
+ * @brief Write the bytes that differ. The NVM controller commits each one in
+ * the background, hence wait until it is ready for the next.
+ */
+static bool seeprom_write(uint32_t addr, const void *src, uint32_t len) {
+  if (NVMCTRL->SEESTAT.bit.LOCK) {
+    return false;
+  }
+  volatile uint8_t *dest = (volatile uint8_t *)(SEEPROM_ADDR + addr);
+  const uint8_t *bytes = (const uint8_t *)src;
+  for (uint32_t idx = 0; idx < len; ++idx) {
+    while (NVMCTRL->SEESTAT.bit.BUSY) {}
+    if (dest[idx] != bytes[idx]) {
+      dest[idx] = bytes[idx];
+    }
+  }
+  while (NVMCTRL->SEESTAT.bit.BUSY) {}
+  return true;
+}
+
+#else
+
+static uint32_t seeprom_size() { return 0; }
+
+static void seeprom_read(uint32_t addr, void *dest, uint32_t len) {
+  (void)addr;
+  memset(dest, 0, len);
+}
+
+static bool seeprom_write(uint32_t addr, const void *src, uint32_t len) {
+  (void)addr;
+  (void)src;
+  (void)len;
+  return false;
+}
+
+#endif
+
+/*------------------------------------------------------------------------------
+  TuningStore
+------------------------------------------------------------------------------*/
+
+bool TuningStore::begin() {
+  _values = TuningValues{};
+  _dirty = false;
+  _available = (seeprom_size() >= sizeof(Record));
+  if (!_available) {
+    return false;
+  }
+
+  Record rec;
+  seeprom_read(0, &rec, sizeof(rec));
+  if ((rec.magic == TUNING_MAGIC) &&
+      (rec.crc == crc32(&rec, offsetof(Record, crc)))) {
+    // Keep the defaults of knobs whose bounds have narrowed since stored
+    for (uint8_t key = 0; key < N_TUNING_KNOBS; ++key) {
+      if (in_bounds(rec.values, key)) {
+        const TuningKnob &knob = TUNING_KNOBS[key];
+        memcpy((uint8_t *)&_values + knob.offset,
+               (const uint8_t *)&rec.values + knob.offset,
+               (knob.type == TUNE_U16) ? 2 : 4);
+      }
+    }
+  }
+  return true;
+}
+
+int8_t TuningStore::find(const char *name) {
+  for (uint8_t key = 0; key < N_TUNING_KNOBS; ++key) {
+    if (strcmp(TUNING_KNOBS[key].name, name) == 0) {
+      return key;
+    }
+  }
+  return -1;
+}
+
+/**
+ * @brief Return the value of knob @p key of @p values.
+ */
+static float read_knob(const TuningValues &values, uint8_t key) {
+  const TuningKnob &knob = TUNING_KNOBS[key];
+  const uint8_t *ptr = (const uint8_t *)&values + knob.offset;
+  switch (knob.type) {
+    case TUNE_U16:
+      return *(const uint16_t *)ptr;
+    case TUNE_U32:
+      return *(const uint32_t *)ptr;
+    default:
+      return *(const float *)ptr;
+  }
+}
+
+bool TuningStore::in_bounds(const TuningValues &values, uint8_t key) {
+  float value = read_knob(values, key);
+  // Written such that NaN fails
+  return (value >= TUNING_KNOBS[key].min_val) &&
+         (value <= TUNING_KNOBS[key].max_val);
+}
+
+float TuningStore::get(uint8_t key) const { return read_knob(_values, key); }
+
+bool TuningStore::set(uint8_t key, float value) {
+  if (key >= N_TUNING_KNOBS) {
+    return false;
+  }
+  const TuningKnob &knob = TUNING_KNOBS[key];
+  if (knob.type != TUNE_FLOAT) {
+    value = roundf(value);
+  }
+  if (!((value >= knob.min_val) && (value <= knob.max_val))) {
+    return false;
+  }
+
+  uint8_t *ptr = (uint8_t *)&_values + knob.offset;
+  switch (knob.type) {
+    case TUNE_U16:
+      *(uint16_t *)ptr = (uint16_t)value;
+      break;
+    case TUNE_U32:
+      *(uint32_t *)ptr = (uint32_t)value;
+      break;
+    default:
+      *(float *)ptr = value;
+      break;
+  }
+  _dirty = true;
+  return true;
+}
+
+void TuningStore::defaults() {
+  _values = TuningValues{};
+  _dirty = true;
+}
+
+bool TuningStore::save() {
+  if (!_available) {
+    return false;
+  }
+
+  Record rec;
+  rec.magic = TUNING_MAGIC;
+  rec.values = _values;
+  rec.crc = crc32(&rec, offsetof(Record, crc));
+  if (!seeprom_write(0, &rec, sizeof(rec))) {
+    return false;
+  }
+
+  // Read back, as a locked SmartEEPROM ignores writes
+  Record check;
+  seeprom_read(0, &check, sizeof(check));
+  if (memcmp(&check, &rec, sizeof(rec)) != 0) {
+    return false;
+  }
+  _dirty = false;
+  return true;
+}
+
+void TuningStore::print(Stream &mySerial) const {
+  snprintf(buf, BUF_LEN, "%d\t%d\n", _available, _dirty);
+  mySerial.print(buf);
+  for (uint8_t key = 0; key < N_TUNING_KNOBS; ++key) {
+    print_knob(mySerial, key);
+  }
+}
+
+void TuningStore::print_knob(Stream &mySerial, uint8_t key) const {
+  const TuningKnob &knob = TUNING_KNOBS[key];
+  snprintf(buf, BUF_LEN, "%s\t%g\t%g\t%g\t%d\n", knob.name, get(key),
+           knob.min_val, knob.max_val, knob.live);
+  mySerial.print(buf);
+}
@@ -0,0 +1,161 @@
+/**
+ * @file    TuningStore.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Runtime tuning of the performance knobs that used to be
+ * compile-time constants only, persisted in the SmartEEPROM of the SAMD51.
+ * Trying out another value on the rig then takes a serial command instead of
+ * a rebuild and a reflash.
+ *
+ * Each knob is typed and bounded, see `TUNING_KNOBS`. A value outside of its
+ * bounds gets refused by `set()`, as does a stored one when loaded: That knob
+ * falls back to its default. Most knobs take effect right away, see
+ * `apply_tuning()` of `main.cpp`. The others, marked as not live, take effect
+ * upon the next reboot.
+ *
+ * Not tunable are the lengths of the command buffers, because they size
+ * static arrays, and the I2C clock of the Centipedes, because it gets
+ * calibrated already, see `CentipedeManager::calibrate_clock()`.
+ *
+ * @section SmartEEPROM
+ * The SmartEEPROM emulates a byte-addressable EEPROM at `SEEPROM_ADDR`,
+ * wear-levelled by the NVM controller in the background. It has to be set up
+ * once through the user row fuses SBLK and PSZ, e.g. SBLK = 1 and PSZ = 1
+ * for 1 kB, which the Adafruit bootloader leaves at 0. Without it, the store
+ * reports not being available and the knobs can still be tuned, but get lost
+ * upon a reboot.
+ *
+ * It holds a single record at address 0: A magic number, the `TuningValues`
+ * and a CRC32 checksum. Only the bytes that have changed get written.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef TUNING_STORE_H_
+#define TUNING_STORE_H_
+
+#include "constants.h"
+
+#include <Arduino.h>
+
+/*------------------------------------------------------------------------------
+  TuningValues
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief The tunable knobs. Append new ones at the end and bump
+ * `TUNING_MAGIC` when changing the layout.
+ */
+struct TuningValues {
+  uint32_t daq_dt_us = DAQ_DT;                             // See `DAQRate`
+  float daq_lp_Hz = DAQ_LP;                                // See `EMAFilter`
+  uint16_t watchdog_ms = WATCHDOG_TIMEOUT;                 // Watchdog timeout
+  uint16_t led_idle_ms = LED_IDLE_PERIOD_DEFAULT;          // LED refresh
+  uint16_t led_idle_running_ms = LED_IDLE_PERIOD_RUNNING;  // Idem, running
+  uint16_t safety_period_ms = PERIOD_SAFETY_PULSES;        // `SafetyPulser`
+};
+
+// Index of each knob into `TUNING_KNOBS`
+enum TuningKey : uint8_t {
+  TUNE_DAQ_DT,
+  TUNE_DAQ_LP,
+  TUNE_WATCHDOG,
+  TUNE_LED_IDLE,
+  TUNE_LED_IDLE_RUNNING,
+  TUNE_SAFETY_PERIOD,
+  N_TUNING_KNOBS
+};
+
+enum TuningType : uint8_t { TUNE_U16, TUNE_U32, TUNE_FLOAT };
+
+struct TuningKnob {
+  const char *name;
+  uint8_t offset;  // Into `TuningValues`
+  TuningType type;
+  float min_val;   // Safe bounds, inclusive
+  float max_val;
+  bool live;       // Takes effect right away, or else upon the next reboot
+};
+
+extern const TuningKnob TUNING_KNOBS[N_TUNING_KNOBS];
+
+/*------------------------------------------------------------------------------
+  TuningStore
+------------------------------------------------------------------------------*/
+
+class TuningStore {
+public:
+  /**
+   * @brief Load the stored values. Without a valid record stored, or when the
+   * SmartEEPROM is not set up, the defaults are used.
+   *
+   * @return True when the SmartEEPROM is available. False otherwise.
+   */
+  bool begin();
+
+  inline bool available() const { return _available; }
+
+  inline const TuningValues &get() const { return _values; }
+
+  /**
+   * @brief Return the index of the knob named @p name, or -1 when unknown.
+   */
+  static int8_t find(const char *name);
+
+  /**
+   * @brief Return the value of knob @p key.
+   */
+  float get(uint8_t key) const;
+
+  /**
+   * @brief Set knob @p key to @p value, rounded for the integer knobs. Not
+   * stored until `save()`.
+   *
+   * @return True when successful. False when outside of its bounds.
+   */
+  bool set(uint8_t key, float value);
+
+  /**
+   * @brief Revert all knobs to their defaults. Not stored until `save()`.
+   */
+  void defaults();
+
+  /**
+   * @brief Store the values in the SmartEEPROM.
+   *
+   * @return True when successful. False otherwise, e.g. when not available.
+   */
+  bool save();
+
+  /**
+   * @brief Print the tuning, tab delimited: The availability of the
+   * SmartEEPROM and whether there are unsaved changes, followed by a line per
+   * knob: Name, value, lower bound, upper bound and whether it is live.
+   */
+  void print(Stream &mySerial) const;
+
+  /**
+   * @brief Print the line of knob @p key, as in `print()`.
+   */
+  void print_knob(Stream &mySerial, uint8_t key) const;
+
+private:
+  struct Record {
+    uint32_t magic;
+    TuningValues values;
+    uint32_t crc; // CRC32 over all of the above
+  };
+
+  TuningValues _values;
+  bool _available = false;
+  bool _dirty = false; // Have the values changed since loaded or saved?
+
+  /**
+   * @brief Is knob @p key of @p values within its bounds?
+   */
+  static bool in_bounds(const TuningValues &values, uint8_t key);
+};
+
+#endif
@@ -0,0 +1,90 @@
+/**
+ * @file    TxQueue.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "TxQueue.h"
+#include "Trace.h"
+
+TxQueue tx(Serial);
+
+/*------------------------------------------------------------------------------
+  TxQueue
+------------------------------------------------------------------------------*/
+
+size_t TxQueue::write(const uint8_t *data, size_t len) {
+  size_t N_left = len;
+  while (N_left) {
+    if (_count == TX_QUEUE_LEN) {
+      // Full: Wait on the serial port for room, like writing to it directly
+      _N_stalls++;
+      pop(64);
+    }
+
+    uint16_t N = min(N_left, (size_t)(TX_QUEUE_LEN - _count));
+    push(data, N);
+    data += N;
+    N_left -= N;
+  }
+  return len;
+}
+
+bool TxQueue::write_or_drop(const uint8_t *data, uint16_t len) {
+  if (len > TX_QUEUE_LEN - _count) {
+    _N_dropped++;
+    return false;
+  }
+  push(data, len);
+  return true;
+}
+
+void TxQueue::drain() {
+  while (_count) {
+    int room = _port.availableForWrite();
+    if (room <= 0) {
+      return;
+    }
+    pop(room);
+  }
+}
+
+void TxQueue::flush() {
+  while (_count) {
+    pop(_count);
+  }
+  _port.flush();
+}
+
+void TxQueue::push(const uint8_t *data, uint16_t len) {
+  uint16_t tail = _head + _count;
+  if (tail >= TX_QUEUE_LEN) {
+    tail -= TX_QUEUE_LEN;
+  }
+
+  // Copy in at most two parts, wrapping around the end of the buffer
+  uint16_t N = min(len, (uint16_t)(TX_QUEUE_LEN - tail));
+  memcpy(&_buf[tail], data, N);
+  memcpy(&_buf[0], data + N, len - N);
+
+  _count += len;
+  if (_count > _high_water) {
+    _high_water = _count;
+  }
+}
+
+void TxQueue::pop(uint16_t max_len) {
+  // Only the part up to the end of the buffer is contiguous
+  uint16_t N = min(min(_count, max_len), (uint16_t)(TX_QUEUE_LEN - _head));
+  trace_begin(TRACE_USB_TX, N);
+  _port.write(&_buf[_head], N);
+  trace_end(TRACE_USB_TX, N);
+
+  _head += N;
+  if (_head == TX_QUEUE_LEN) {
+    _head = 0;
+  }
+  _count -= N;
+}
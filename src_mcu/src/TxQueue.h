@@ -0,0 +1,136 @@
+/**
+ * @file    TxQueue.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    14-10-2026
+ *
+ * @brief   Transmit queue in front of the serial port, through which all the
+ * output of the firmware to the PC gets sent.
+ *
+ * Writing into the queue returns immediately. The main loop drains the queue
+ * into the serial port by calling `drain()`, taking only as many bytes as the
+ * serial transmit buffer has room for. Hence, a PC that is slow to read can no
+ * longer block the main loop and with it the protocol playback.
+ *
+ * Replies to commands must not get lost. When the queue runs full, writing
+ * falls back to waiting on the serial port, like before, which gets counted as
+ * a stall. Low-priority output, like the telemetry, gets written via
+ * `write_or_drop()` instead: It gets dropped as a whole when the queue can not
+ * take it, which gets counted as well. The order of all output is preserved.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef TX_QUEUE_H_
+#define TX_QUEUE_H_
+
+#include <Arduino.h>
+#include <array>
+
+/**
+ * @brief Capacity of the transmit queue [bytes].
+ */
+const uint16_t TX_QUEUE_LEN = 4096;
+
+/*------------------------------------------------------------------------------
+  TxQueue
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Class to queue the output to a serial port, to be drained without
+ * blocking. Derives from `Stream` such that it can be passed to all functions
+ * reporting to a port. It never receives anything.
+ */
+class TxQueue : public Stream {
+public:
+  TxQueue(Stream &port) : _port(port) {}
+
+  /**
+   * @brief Queue @p len bytes. Waits on the serial port when the queue is
+   * full, see `get_N_stalls()`.
+   */
+  size_t write(const uint8_t *data, size_t len) override;
+  inline size_t write(uint8_t c) override { return write(&c, 1); }
+  using Print::write;
+
+  /**
+   * @brief Queue @p len bytes only when they fit in full, dropping them
+   * otherwise, see `get_N_dropped()`.
+   *
+   * @return True when queued, false when dropped.
+   */
+  bool write_or_drop(const uint8_t *data, uint16_t len);
+
+  /**
+   * @brief Return the free space in the queue [bytes].
+   */
+  inline int availableForWrite() override { return TX_QUEUE_LEN - _count; }
+
+  /**
+   * @brief Move as many queued bytes into the serial port as its transmit
+   * buffer has room for, without blocking. Call repeatedly from the main loop.
+   */
+  void drain();
+
+  /**
+   * @brief Send out all queued bytes, waiting on the serial port as needed.
+   */
+  void flush() override;
+
+  inline int available() override { return 0; }
+  inline int read() override { return -1; }
+  inline int peek() override { return -1; }
+
+  inline uint16_t size() const { return _count; }
+
+  /**
+   * @brief Return the largest number of bytes that were queued at once.
+   */
+  inline uint16_t get_high_water() const { return _high_water; }
+
+  /**
+   * @brief Return the number of times the queue ran full, making a write wait
+   * on the serial port.
+   */
+  inline uint32_t get_N_stalls() const { return _N_stalls; }
+
+  /**
+   * @brief Return the number of low-priority writes that got dropped.
+   */
+  inline uint32_t get_N_dropped() const { return _N_dropped; }
+
+  inline void reset_stats() {
+    _high_water = _count;
+    _N_stalls = 0;
+    _N_dropped = 0;
+  }
+
+private:
+  Stream &_port; // Serial port to drain into
+  std::array<uint8_t, TX_QUEUE_LEN> _buf;
+  uint16_t _head = 0;  // Index of the oldest queued byte
+  uint16_t _count = 0; // Number of queued bytes
+
+  uint16_t _high_water = 0; // Largest number of bytes queued at once
+  uint32_t _N_stalls = 0;   // Number of times the queue ran full
+  uint32_t _N_dropped = 0;  // Number of dropped low-priority writes
+
+  /**
+   * @brief Append @p len bytes, which must fit.
+   */
+  void push(const uint8_t *data, uint16_t len);
+
+  /**
+   * @brief Write at most @p max_len of the oldest queued bytes into the serial
+   * port, taking them out of the queue.
+   */
+  void pop(uint16_t max_len);
+};
+
+/**
+ * @brief Transmit queue in front of `Serial`. All output to the PC should go
+ * through here.
+ */
+extern TxQueue tx;
+
+#endif
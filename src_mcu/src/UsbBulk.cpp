@@ -0,0 +1,34 @@
+/**
+ * @file    UsbBulk.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "UsbBulk.h"
+
+/*------------------------------------------------------------------------------
+  UsbBulk
+------------------------------------------------------------------------------*/
+
+void UsbBulk::begin() {
+#if USB_BULK
+  _vendor.begin();
+
+  // The core has enumerated the device before `setup()` already
+  if (TinyUSBDevice.mounted()) {
+    TinyUSBDevice.detach();
+    delay(10);
+    TinyUSBDevice.attach();
+  }
+#endif
+}
+
+Stream &UsbBulk::port() {
+#if USB_BULK
+  return _vendor;
+#else
+  return Serial;
+#endif
+}
@@ -0,0 +1,75 @@
+/**
+ * @file    UsbBulk.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Optional USB vendor-class interface with a pair of bulk endpoints,
+ * next to the USB CDC serial port, to carry the binary bulk data separately
+ * from the ASCII commands and their replies.
+ *
+ * All traffic normally shares the single CDC serial port, such that a command
+ * and its reply can get stuck behind a program upload or the pushed telemetry.
+ * With the vendor interface, the PC can move the bulk uploads and the pushed
+ * telemetry onto their own endpoints, see command `usb_bulk`, while the
+ * commands keep the CDC port to themselves.
+ *
+ * Requires the TinyUSB stack of the Adafruit SAMD core, i.e. building with
+ * `-DUSE_TINYUSB -DUSB_BULK=1`, see the `adafruit_feather_m4_usb_bulk`
+ * environment in `platformio.ini`. The interface is a WebUSB-style vendor
+ * interface of the Adafruit TinyUSB library and can be claimed by libusb on
+ * the PC. Otherwise, the interface is not available and `port()` falls back
+ * to `Serial`.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef USB_BULK_H_
+#define USB_BULK_H_
+
+#include <Arduino.h>
+
+/**
+ * @brief Add the USB vendor interface? Requires the TinyUSB stack.
+ */
+#ifndef USB_BULK
+#  define USB_BULK 0
+#endif
+
+#if USB_BULK
+#  if !defined(USE_TINYUSB)
+#    error "USB_BULK requires the TinyUSB stack: Build with -DUSE_TINYUSB"
+#  endif
+#  include "Adafruit_TinyUSB.h"
+#endif
+
+/*------------------------------------------------------------------------------
+  UsbBulk
+------------------------------------------------------------------------------*/
+
+class UsbBulk {
+public:
+  /**
+   * @brief Is the vendor interface built in?
+   */
+  static constexpr bool available() { return USB_BULK; }
+
+  /**
+   * @brief Add the vendor interface to the USB device and have the PC
+   * enumerate it anew. Call once from `setup()`, before `Serial.begin()`.
+   */
+  void begin();
+
+  /**
+   * @brief Return the port of the vendor interface, or `Serial` when not
+   * available.
+   */
+  Stream &port();
+
+private:
+#if USB_BULK
+  Adafruit_USBD_WebUSB _vendor;
+#endif
+};
+
+#endif
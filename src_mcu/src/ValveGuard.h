@@ -0,0 +1,139 @@
+/**
+ * @file    ValveGuard.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    14-10-2026
+ *
+ * @brief   Enforcement of a minimum valve on/off duration on the lines being
+ * played, protecting the solenoid valves from rapid toggling, whatever the
+ * source of the protocol.
+ *
+ * Equivalent to `adjust_minimum_valve_durations()` of the Python protocol
+ * generator, but applied online, line by line: A valve that has switched state
+ * keeps that state for at least the minimum number of lines, ignoring the
+ * protocol in the meantime. Unlike the Python version, which knows the future
+ * lines, the current state simply gets extended.
+ *
+ * Each valve has a countdown of the number of lines it is still held. The
+ * countdowns are bit-sliced: Bit plane `i` holds bit `i` of the countdowns of
+ * all 16 valves of a Centipede port. Hence, holding, decrementing and
+ * reloading the countdowns take a few bit operations per port for all valves
+ * at once.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef VALVE_GUARD_H_
+#define VALVE_GUARD_H_
+
+#include <Arduino.h>
+#include <array>
+
+#include "CentipedeManager.h"
+
+/**
+ * @brief Number of bits of the countdowns, setting the largest minimum
+ * duration.
+ */
+const uint8_t VALVE_GUARD_BITS = 4;
+
+/**
+ * @brief Largest minimum valve on/off duration [number of lines].
+ */
+const uint8_t VALVE_GUARD_MAX_LINES = 1 << VALVE_GUARD_BITS;
+
+/*------------------------------------------------------------------------------
+  ValveGuard
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Class to enforce a minimum on/off duration on the Centipede port
+ * bitmasks of subsequent lines.
+ */
+class ValveGuard {
+public:
+  /**
+   * @brief Set the minimum valve on/off duration to @p N_lines, up to
+   * `VALVE_GUARD_MAX_LINES`. 0 or 1 disables the guard. Releases all valves.
+   */
+  void set_min_lines(uint8_t N_lines) {
+    _min_lines = min(N_lines, VALVE_GUARD_MAX_LINES);
+    reset(_state);
+  }
+
+  inline uint8_t get_min_lines() const { return _min_lines; }
+
+  /**
+   * @brief Take @p masks as the current valve states, with none of the valves
+   * being held. To be called when the valves got set outside of the regular
+   * playback, e.g. by a manual `goto`.
+   */
+  void reset(const CP_Masks &masks) {
+    _state = masks;
+    for (CP_Masks &plane : _planes) {
+      plane.fill(0);
+    }
+  }
+
+  /**
+   * @brief Advance to the next line, with the valves opened in @p masks. The
+   * valves still being held get their current state written into @p masks.
+   */
+  void apply(CP_Masks &masks) {
+    if (_min_lines <= 1) {
+      _state = masks;
+      return;
+    }
+
+    for (uint8_t port = 0; port < N_CP_PORTS; ++port) {
+      // Held: Countdown not yet at 0
+      uint16_t held = 0;
+      for (const CP_Masks &plane : _planes) {
+        held |= plane[port];
+      }
+
+      uint16_t wanted = masks[port];
+      uint16_t out = (_state[port] & held) | (wanted & ~held);
+      uint16_t switched = out ^ _state[port];
+      _N_held += __builtin_popcount(out ^ wanted);
+
+      // Decrement the nonzero countdowns, rippling the borrow up the planes
+      uint16_t borrow = held;
+      for (CP_Masks &plane : _planes) {
+        uint16_t bit = plane[port];
+        plane[port] = bit ^ borrow;
+        borrow &= ~bit;
+      }
+
+      // Reload the countdowns of the switched valves, which were all at 0
+      uint8_t reload = _min_lines - 1;
+      for (CP_Masks &plane : _planes) {
+        if (reload & 0x01) {
+          plane[port] |= switched;
+        }
+        reload >>= 1;
+      }
+
+      masks[port] = out;
+      _state[port] = out;
+    }
+  }
+
+  /**
+   * @brief Return the number of times a valve got held in its state against
+   * the protocol, counted per line.
+   */
+  inline uint32_t get_N_held() const { return _N_held; }
+
+  inline void reset_stats() { _N_held = 0; }
+
+private:
+  uint8_t _min_lines = 0; // See `set_min_lines()`
+  CP_Masks _state{};      // Valve states of the last line
+  uint32_t _N_held = 0;   // See `get_N_held()`
+
+  // Bit-sliced countdowns: Plane `i` holds bit `i` of the countdowns
+  std::array<CP_Masks, VALVE_GUARD_BITS> _planes{};
+};
+
+#endif
@@ -0,0 +1,177 @@
+/**
+ * @file    ValveHealth.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "ValveHealth.h"
+#include "PressureScale.h"
+#include "translations.h"
+
+// Number of standard errors a flagged score must lie away from 0
+const float HEALTH_MIN_T = 3.f;
+
+/*------------------------------------------------------------------------------
+  ValveHealth
+------------------------------------------------------------------------------*/
+
+void ValveHealth::start(uint16_t settle_ms, uint16_t min_N,
+                        uint8_t threshold_pct) {
+  _settle_us = (uint32_t)settle_ms * 1000;
+  _min_N = max(min_N, (uint16_t)2);
+  _threshold = threshold_pct / 100.f;
+
+  _N_sum = 0;
+  _fault = false;
+  _prev_valid = false;
+  memset(_S_nn, 0, sizeof(_S_nn));
+  memset(_S_np, 0, sizeof(_S_np));
+  memset(_valves, 0, sizeof(_valves));
+  _N_switches = 0;
+  _active = true;
+}
+
+void ValveHealth::add(uint32_t t_us, const int16_t (&pres_mbar)[N_R_CLICKS],
+                      const CP_Masks &masks) {
+  if (!_active) {
+    return;
+  }
+  if (masks != _masks) {
+    finish_segment(t_us, masks);
+  }
+  if (t_us - _t_switch_us < _settle_us) {
+    return;
+  }
+
+  for (uint8_t ch = 0; ch < N_R_CLICKS; ++ch) {
+    _fault |= (pres_mbar[ch] == PRESSURE_FAULT);
+    _sum_mbar[ch] += pres_mbar[ch];
+  }
+  _N_sum++;
+}
+
+void ValveHealth::finish_segment(uint32_t t_us, const CP_Masks &masks) {
+  bool valid = (_N_sum > 0) && !_fault;
+  float mean_mbar[N_R_CLICKS];
+  for (uint8_t ch = 0; ch < N_R_CLICKS; ++ch) {
+    mean_mbar[ch] = valid ? (float)_sum_mbar[ch] / _N_sum : 0;
+  }
+
+  if (valid && _prev_valid) {
+    float dp[N_MANIFOLDS];
+    float dn[N_MANIFOLDS];
+    for (uint8_t m = 0; m < N_MANIFOLDS; ++m) {
+      int8_t delta = 0;
+      for (uint8_t port = 0; port < N_CP_PORTS; ++port) {
+        uint16_t manifold = MANIFOLD2CP_MASKS[m][port];
+        delta += __builtin_popcount(_masks[port] & manifold);
+        delta -= __builtin_popcount(_prev_masks[port] & manifold);
+      }
+      dp[m] = mean_mbar[m] - _prev_mbar[m];
+      dn[m] = delta;
+      _S_nn[m] += dn[m] * dn[m];
+      _S_np[m] += dn[m] * dp[m];
+    }
+    _N_switches++;
+
+    for (uint8_t port = 0; port < N_CP_PORTS; ++port) {
+      uint16_t switched = _masks[port] ^ _prev_masks[port];
+      while (switched) {
+        uint8_t bit = __builtin_ctz(switched);
+        switched &= switched - 1; // Clear lowest set bit
+        uint8_t valve = CP2VALVE[port][bit];
+        if (!valve) {
+          continue;
+        }
+
+        uint8_t m = (valve - 1) / (N_VALVES / N_MANIFOLDS);
+        float s = ((_masks[port] >> bit) & 0x01) ? 1.f : -1.f;
+        Evidence &ev = _valves[valve - 1];
+        if (ev.N < UINT16_MAX) {
+          ev.N++;
+          ev.dp_s += dp[m] * s;
+          ev.dn_s += dn[m] * s;
+          ev.dp_dp += dp[m] * dp[m];
+          ev.dp_dn += dp[m] * dn[m];
+          ev.dn_dn += dn[m] * dn[m];
+        }
+      }
+    }
+  }
+
+  // Start the next segment
+  _prev_masks = _masks;
+  memcpy(_prev_mbar, mean_mbar, sizeof(_prev_mbar));
+  _prev_valid = valid;
+  _masks = masks;
+  _t_switch_us = t_us;
+  memset(_sum_mbar, 0, sizeof(_sum_mbar));
+  _N_sum = 0;
+  _fault = false;
+}
+
+float ValveHealth::get_gain(uint8_t manifold) const {
+  float g = (_S_nn[manifold] > 0) ? -_S_np[manifold] / _S_nn[manifold] : 0;
+  return (g > 0) ? g : 0; // Anything else is no pressure response at all
+}
+
+bool ValveHealth::get_score(uint8_t valve, float &score,
+                            float &std_err) const {
+  const Evidence &ev = _valves[valve - 1];
+  float g = get_gain((valve - 1) / (N_VALVES / N_MANIFOLDS));
+  if ((ev.N < 2) || (g <= 0)) {
+    score = NAN;
+    std_err = NAN;
+    return false;
+  }
+
+  // Moments of `r * s / g`, with `r = dp + g * dn` and s^2 = 1
+  float mean = (ev.dp_s + g * ev.dn_s) / (g * ev.N);
+  float mean_sq =
+      (ev.dp_dp + 2 * g * ev.dp_dn + g * g * ev.dn_dn) / (g * g * ev.N);
+  float var = max(mean_sq - mean * mean, 0.f);
+  score = mean;
+  std_err = sqrtf(var / ev.N);
+
+  return (ev.N >= _min_N) && (score >= _threshold) &&
+         (score >= HEALTH_MIN_T * std_err);
+}
+
+void ValveHealth::print(Stream &mySerial) const {
+  snprintf(buf, BUF_LEN, "%u\t%lu\t%u\t%u\t%lu", _active,
+           (unsigned long)(_settle_us / 1000), _min_N,
+           (uint8_t)lroundf(_threshold * 100), (unsigned long)_N_switches);
+  mySerial.print(buf);
+  for (uint8_t m = 0; m < N_MANIFOLDS; ++m) {
+    snprintf(buf, BUF_LEN, "\t%.2f", get_gain(m));
+    mySerial.print(buf);
+  }
+
+  uint8_t flagged[N_VALVES];
+  uint8_t N_flagged = 0;
+  for (uint8_t valve = 1; valve <= N_VALVES; ++valve) {
+    float score, std_err;
+    if (get_score(valve, score, std_err)) {
+      flagged[N_flagged++] = valve;
+    }
+  }
+  snprintf(buf, BUF_LEN, "\t%u", N_flagged);
+  mySerial.print(buf);
+  for (uint8_t idx = 0; idx < N_flagged; ++idx) {
+    snprintf(buf, BUF_LEN, "\t%u", flagged[idx]);
+    mySerial.print(buf);
+  }
+  mySerial.print('\n');
+}
+
+void ValveHealth::print_valves(Stream &mySerial) const {
+  for (uint8_t valve = 1; valve <= N_VALVES; ++valve) {
+    float score, std_err;
+    bool flagged = get_score(valve, score, std_err);
+    snprintf(buf, BUF_LEN, "%u\t%u\t%.1f\t%.1f\t%u\n", valve,
+             _valves[valve - 1].N, score * 100, std_err * 100, flagged);
+    mySerial.print(buf);
+  }
+}
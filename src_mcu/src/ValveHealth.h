@@ -0,0 +1,141 @@
+/**
+ * @file    ValveHealth.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Online detection of stuck valves from the response of the manifold
+ * pressures to the valve switches, without extra hardware.
+ *
+ * The readings in between two writes of the Centipede ports form a segment,
+ * whose first `settle` ms get skipped to let the transient die out. Across
+ * each pair of successive segments, each manifold m sees a change in mean
+ * pressure dp_m and in open-valve count dn_m. Opening valves drops the
+ * pressure, modelled as `dp_m = -g_m * dn_m` with a gain g_m [mbar/valve]
+ * fitted by least squares over all switches.
+ *
+ * A valve that fails to follow its command leaves the residual
+ * `r = dp_m + g_m * dn_m` at `g_m * s`, with s = +1 when commanded to open and
+ * -1 to close, whereas the residual of a healthy valve does not correlate with
+ * its own switches. Hence, the score of a valve is the mean of `r * s / g_m`
+ * over its switches: ~0 when healthy, ~1 when stuck and in between when
+ * partially clogged.
+ *
+ * As the residual is linear in g_m, each valve merely accumulates the sums of
+ * `dp * s`, `dn * s` and the second moments of dp and dn, such that the score
+ * and its standard error follow from the latest g_m at any time. A valve gets
+ * flagged once it has switched at least `min_N` times with a score beyond the
+ * threshold and at least 3 standard errors away from 0.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef VALVE_HEALTH_H_
+#define VALVE_HEALTH_H_
+
+#include <Arduino.h>
+
+#include "CentipedeManager.h"
+#include "RClickDAQ.h"
+
+/*------------------------------------------------------------------------------
+  ValveHealth
+------------------------------------------------------------------------------*/
+
+class ValveHealth {
+public:
+  /**
+   * @brief Skip the first @p settle_ms of each segment, and flag the valves
+   * that switched at least @p min_N times with a score of at least
+   * @p threshold_pct %. Clears all statistics and starts monitoring.
+   */
+  void start(uint16_t settle_ms, uint16_t min_N, uint8_t threshold_pct);
+
+  inline void stop() { _active = false; }
+  inline bool is_active() const { return _active; }
+
+  /**
+   * @brief Add a reading of all manifolds taken at time @p t_us while the
+   * Centipede ports held @p masks.
+   *
+   * @param pres_mbar The pressure of each manifold [mbar], or
+   * `PRESSURE_FAULT`
+   */
+  void add(uint32_t t_us, const int16_t (&pres_mbar)[N_R_CLICKS],
+           const CP_Masks &masks);
+
+  /**
+   * @brief Return the fitted gain g_m [mbar/valve] of manifold @p manifold,
+   * or 0 when unknown.
+   */
+  float get_gain(uint8_t manifold) const;
+
+  /**
+   * @brief Compute the score and its standard error of valve number
+   * @p valve.
+   *
+   * @return True when flagged.
+   */
+  bool get_score(uint8_t valve, float &score, float &std_err) const;
+
+  /**
+   * @brief Print the summary on one line, tab delimited:
+   *   1) Is monitoring?
+   *   2) Settle time [ms], min_N and threshold [%]
+   *   5) Number of switches used
+   *   6) Gain of each manifold [mbar/valve]
+   *  10) Number of flagged valves, followed by their valve numbers
+   */
+  void print(Stream &mySerial) const;
+
+  /**
+   * @brief Print a line per valve, tab delimited:
+   *   1) Valve number
+   *   2) Number of switches used
+   *   3) Score and its standard error [%]
+   *   5) Flagged?
+   */
+  void print_valves(Stream &mySerial) const;
+
+private:
+  bool _active = false;
+  uint32_t _settle_us = 0;
+  uint16_t _min_N = 0;
+  float _threshold = 0;
+
+  // Segment being acquired
+  CP_Masks _masks{};                // Bitmasks held during the segment
+  uint32_t _t_switch_us = 0;        // Start of the segment
+  int32_t _sum_mbar[N_R_CLICKS]{};  // Sum of the settled readings [mbar]
+  uint16_t _N_sum = 0;              // Number of settled readings
+  bool _fault = false;              // Sensor fault during the segment?
+
+  // Previous segment
+  CP_Masks _prev_masks{};
+  float _prev_mbar[N_R_CLICKS]{}; // Mean pressure [mbar]
+  bool _prev_valid = false;
+
+  // Least-squares fit of `dp = -g * dn` per manifold
+  float _S_nn[N_MANIFOLDS]{};
+  float _S_np[N_MANIFOLDS]{};
+  uint32_t _N_switches = 0;
+
+  // Sums of each valve, see above, indexed by valve number - 1
+  struct Evidence {
+    uint16_t N;
+    float dp_s;  // Sum of dp * s
+    float dn_s;  // Sum of dn * s
+    float dp_dp; // Sum of dp^2
+    float dp_dn; // Sum of dp * dn
+    float dn_dn; // Sum of dn^2
+  };
+  Evidence _valves[N_VALVES]{};
+
+  /**
+   * @brief Finish the segment, account for the switch from the previous one
+   * and start a new segment holding @p masks at time @p t_us.
+   */
+  void finish_segment(uint32_t t_us, const CP_Masks &masks);
+};
+
+#endif
@@ -0,0 +1,153 @@
+/**
+ * @file    ValveLatency.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "ValveLatency.h"
+#include "translations.h"
+
+/*------------------------------------------------------------------------------
+  ValveLatency
+------------------------------------------------------------------------------*/
+
+void ValveLatency::set(bool enabled, uint16_t slot_us) {
+  _enabled = enabled;
+  _slot_us = max(slot_us, (uint16_t)1);
+}
+
+bool ValveLatency::set_valve(uint8_t valve, uint16_t open_us,
+                             uint16_t close_us) {
+  if (valve > N_VALVES) {
+    return false;
+  }
+
+  open_us = min(open_us, VALVE_LATENCY_MAX_US);
+  close_us = min(close_us, VALVE_LATENCY_MAX_US);
+  uint8_t first = valve ? valve - 1 : 0;
+  uint8_t last = valve ? valve - 1 : N_VALVES - 1;
+  for (uint8_t idx = first; idx <= last; ++idx) {
+    _open_us[idx] = open_us;
+    _close_us[idx] = close_us;
+  }
+  return true;
+}
+
+uint8_t ValveLatency::plan(const CP_Masks &from, const CP_Masks &to,
+                           CP_Masks (&steps)[STAGGER_MAX_STEPS],
+                           int32_t (&offsets_us)[STAGGER_MAX_STEPS]) {
+  // Latency of each toggling valve
+  struct Change {
+    uint8_t port;
+    uint8_t bit;
+    uint16_t latency_us;
+  };
+  Change changes[N_CP_PORTS * 16];
+  uint8_t N_changes = 0;
+  bool any_latency = false;
+
+  for (uint8_t port = 0; port < N_CP_PORTS; ++port) {
+    uint16_t changed = from[port] ^ to[port];
+    while (changed) {
+      uint8_t bit = __builtin_ctz(changed);
+      changed &= changed - 1; // Clear lowest set bit
+      uint8_t valve = CP2VALVE[port][bit];
+      uint16_t latency_us = 0;
+      if (valve) {
+        latency_us = ((to[port] >> bit) & 0x01) ? _open_us[valve - 1]
+                                                : _close_us[valve - 1];
+      }
+      changes[N_changes++] = {port, bit, latency_us};
+      any_latency |= (latency_us > 0);
+    }
+  }
+
+  offsets_us[0] = 0;
+  if (!any_latency) {
+    steps[0] = to;
+    return 1;
+  }
+
+  // Group the changes into time slots, widening the slots until they fit
+  uint32_t width_us = _slot_us;
+  uint16_t slots[STAGGER_MAX_STEPS]; // Distinct slots, in units of the width
+  uint8_t N_slots;
+  bool fits;
+  do {
+    N_slots = 0;
+    fits = true;
+    for (uint8_t idx = 0; (idx < N_changes) && fits; ++idx) {
+      uint16_t slot = (changes[idx].latency_us + width_us / 2) / width_us;
+      uint8_t s = 0;
+      while ((s < N_slots) && (slots[s] != slot)) {
+        s++;
+      }
+      if (s == N_slots) {
+        if (N_slots == STAGGER_MAX_STEPS) {
+          fits = false;
+        } else {
+          slots[N_slots++] = slot;
+        }
+      }
+    }
+    if (!fits) {
+      width_us *= 2;
+    }
+  } while (!fits);
+  _N_widened += (width_us != _slot_us);
+
+  // Largest latency fires first
+  for (uint8_t i = 1; i < N_slots; ++i) {
+    uint16_t slot = slots[i];
+    uint8_t j = i;
+    for (; (j > 0) && (slots[j - 1] < slot); --j) {
+      slots[j] = slots[j - 1];
+    }
+    slots[j] = slot;
+  }
+
+  // Deal out the changes over their slots, each step toggling its own share
+  CP_Masks toggle[STAGGER_MAX_STEPS] = {};
+  for (uint8_t idx = 0; idx < N_changes; ++idx) {
+    const Change &change = changes[idx];
+    uint16_t slot = (change.latency_us + width_us / 2) / width_us;
+    uint8_t s = 0;
+    while (slots[s] != slot) {
+      s++;
+    }
+    toggle[s][change.port] |= 1U << change.bit;
+  }
+
+  // Accumulate
+  CP_Masks masks = from;
+  for (uint8_t step = 0; step < N_slots; ++step) {
+    for (uint8_t port = 0; port < N_CP_PORTS; ++port) {
+      masks[port] ^= toggle[step][port];
+    }
+    steps[step] = masks;
+    offsets_us[step] = -(int32_t)(slots[step] * width_us);
+  }
+
+  _N_compensated++;
+  return N_slots;
+}
+
+void ValveLatency::print(Stream &mySerial) const {
+  uint16_t max_us = 0;
+  for (uint8_t idx = 0; idx < N_VALVES; ++idx) {
+    max_us = max(max_us, max(_open_us[idx], _close_us[idx]));
+  }
+  snprintf(buf, BUF_LEN, "%u\t%u\t%u\t%lu\t%lu\n", _enabled, _slot_us, max_us,
+           (unsigned long)_N_compensated, (unsigned long)_N_widened);
+  mySerial.print(buf);
+}
+
+void ValveLatency::print_table(Stream &mySerial) const {
+  for (uint8_t valve = 1; valve <= N_VALVES; ++valve) {
+    snprintf(buf, BUF_LEN, "%u\t%u\t%u\n", valve, _open_us[valve - 1],
+             _close_us[valve - 1]);
+    mySerial.print(buf);
+  }
+}
@@ -0,0 +1,120 @@
+/**
+ * @file    ValveLatency.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Compensation of the opening and closing latency of each solenoid
+ * valve, so that the jets follow the timeline of the protocol instead of the
+ * electrical one.
+ *
+ * A solenoid valve takes a few milliseconds to open or close after being sent
+ * its new state, differing between opening and closing and from valve to
+ * valve. Given a calibration table of both latencies per valve, each toggling
+ * valve gets sent its new state early by its own latency.
+ *
+ * The toggling valves get grouped into time slots by their latency, each slot
+ * becoming a sub-step of the switch, like the sub-steps of `ActuationStagger`.
+ * A sub-step writes only the Centipede ports it changes, hence a switch costs
+ * one I2C write per changing port per slot. When the latencies spread over
+ * more than `STAGGER_MAX_STEPS` slots, the slots get widened until they fit.
+ *
+ * The sub-steps get planned once per line, when staging it ahead of time, see
+ * `ProtocolManager::stage_next_line()`. The playback timer interrupt then
+ * fires them at the deadline of the line minus the latency of their slot,
+ * eating into the duration of the current line. A current line shorter than
+ * the largest latency has its next line compensated only partially, as any
+ * sub-step already overdue fires at once.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef VALVE_LATENCY_H_
+#define VALVE_LATENCY_H_
+
+#include <Arduino.h>
+
+#include "ActuationStagger.h"
+#include "CentipedeManager.h"
+#include "constants.h"
+
+// Largest opening or closing latency [µs] of a valve
+const uint16_t VALVE_LATENCY_MAX_US = 50000;
+
+// Default width [µs] of the time slots grouping the toggling valves
+const uint16_t VALVE_LATENCY_SLOT_US = 250;
+
+/*------------------------------------------------------------------------------
+  ValveLatency
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Class to plan the sub-steps of a line switch compensating the latency
+ * of each toggling valve.
+ */
+class ValveLatency {
+public:
+  /**
+   * @brief Enable or disable (default) the compensation, grouping the toggling
+   * valves into time slots of @p slot_us wide, at least 1.
+   */
+  void set(bool enabled, uint16_t slot_us);
+
+  inline bool is_enabled() const { return _enabled; }
+
+  /**
+   * @brief Set the calibrated latencies [µs] of valve number @p valve, up to
+   * `VALVE_LATENCY_MAX_US`. Valve 0 sets those of all valves.
+   *
+   * @return True when successful. False otherwise, because the valve number
+   * is out of range.
+   */
+  bool set_valve(uint8_t valve, uint16_t open_us, uint16_t close_us);
+
+  inline uint16_t get_open_us(uint8_t valve) const {
+    return _open_us[valve - 1];
+  }
+  inline uint16_t get_close_us(uint8_t valve) const {
+    return _close_us[valve - 1];
+  }
+
+  /**
+   * @brief Plan the switch from bitmasks @p from to bitmasks @p to into
+   * @p steps, the last one being @p to. Sub-step `i` is to be fired at
+   * @p offsets_us[i] relative to the deadline of the line, being 0 or
+   * negative and ascending.
+   *
+   * @return The number of sub-steps.
+   */
+  uint8_t plan(const CP_Masks &from, const CP_Masks &to,
+               CP_Masks (&steps)[STAGGER_MAX_STEPS],
+               int32_t (&offsets_us)[STAGGER_MAX_STEPS]);
+
+  /**
+   * @brief Print the settings and statistics, tab delimited:
+   *   1) Enabled (1) or not (0)
+   *   2) Width of the time slots [µs]
+   *   3) Largest latency in the table [µs]
+   *   4) Number of switches compensated
+   *   5) Number of switches that needed wider slots
+   */
+  void print(Stream &mySerial) const;
+
+  /**
+   * @brief Print the calibration table, one valve per line, tab delimited:
+   *   1) Valve number
+   *   2) Opening latency [µs]
+   *   3) Closing latency [µs]
+   */
+  void print_table(Stream &mySerial) const;
+
+private:
+  uint16_t _open_us[N_VALVES] = {};  // Opening latency per valve [µs]
+  uint16_t _close_us[N_VALVES] = {}; // Closing latency per valve [µs]
+  bool _enabled = false;
+  uint16_t _slot_us = VALVE_LATENCY_SLOT_US;
+  uint32_t _N_compensated = 0;
+  uint32_t _N_widened = 0;
+};
+
+#endif
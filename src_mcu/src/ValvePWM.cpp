@@ -0,0 +1,251 @@
+/**
+ * @file    ValvePWM.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "ValvePWM.h"
+#include "translations.h"
+
+// See `main.cpp`
+extern const uint8_t BUF_LEN; // Common character buffer for string formatting
+extern char buf[];            // Common character buffer for string formatting
+
+/**
+ * @brief Write @p value into bit @p bit of port @p port of the bit-sliced
+ * numbers @p planes.
+ */
+template <typename Planes>
+static void put(Planes &planes, uint8_t port, uint8_t bit, uint8_t value) {
+  for (CP_Masks &plane : planes) {
+    if (value & 0x01) {
+      plane[port] |= 1U << bit;
+    } else {
+      plane[port] &= ~(1U << bit);
+    }
+    value >>= 1;
+  }
+}
+
+/**
+ * @brief Read bit @p bit of port @p port of the bit-sliced numbers @p planes.
+ */
+template <typename Planes>
+static uint8_t take(const Planes &planes, uint8_t port, uint8_t bit) {
+  uint8_t value = 0;
+  for (uint8_t idx = 0; idx < PWM_BITS; ++idx) {
+    value |= ((planes[idx][port] >> bit) & 0x01) << idx;
+  }
+  return value;
+}
+
+/*------------------------------------------------------------------------------
+  ValvePWM
+------------------------------------------------------------------------------*/
+
+bool ValvePWM::set(uint8_t valve, uint8_t on, uint8_t period) {
+  if (valve > N_VALVES) {
+    return false;
+  }
+
+  // Keep the tick interrupt out while the planes are half written
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  for (uint8_t idx = 0; idx < N_VALVES; ++idx) {
+    if (valve && (idx != valve - 1)) {
+      continue;
+    }
+    const ValveAddress &addr = VALVE2ADDR[idx];
+    put(_on, addr.cp_port, addr.cp_bit, on);
+    put(_reload, addr.cp_port, addr.cp_bit, period ? period - 1 : 0);
+    if (period) {
+      _enabled[addr.cp_port] |= 1U << addr.cp_bit;
+    } else {
+      _enabled[addr.cp_port] &= ~(1U << addr.cp_bit);
+    }
+  }
+  __set_PRIMASK(primask);
+  return true;
+}
+
+void ValvePWM::get(uint8_t valve, uint8_t &on, uint8_t &period) const {
+  on = 0;
+  period = 0;
+  if ((valve == 0) || (valve > N_VALVES)) {
+    return;
+  }
+  const ValveAddress &addr = VALVE2ADDR[valve - 1];
+  if ((_enabled[addr.cp_port] >> addr.cp_bit) & 0x01) {
+    on = take(_on, addr.cp_port, addr.cp_bit);
+    period = take(_reload, addr.cp_port, addr.cp_bit) + 1;
+  }
+}
+
+void ValvePWM::set_tick_us(uint16_t tick_us) {
+  _tick_us = max(tick_us, PWM_MIN_TICK_US);
+}
+
+CP_Masks ValvePWM::get_active_masks() const {
+  CP_Masks masks;
+  for (uint8_t port = 0; port < N_CP_PORTS; ++port) {
+    uint16_t on = 0;
+    for (const CP_Masks &plane : _on) {
+      on |= plane[port];
+    }
+    masks[port] = on & _enabled[port];
+  }
+  return masks;
+}
+
+void ValvePWM::start() {
+  stop();
+
+  // Spread the phases of the valves evenly over their period
+  for (uint8_t idx = 0; idx < N_VALVES; ++idx) {
+    const ValveAddress &addr = VALVE2ADDR[idx];
+    uint16_t period = take(_reload, addr.cp_port, addr.cp_bit) + 1;
+    put(_count, addr.cp_port, addr.cp_bit, idx * period / N_VALVES);
+  }
+
+  _stats = Stats();
+  _stats.t_start_us = micros();
+  _tx_pending = false;
+  _use_timer = (_timer != nullptr) && PlaybackTimer::available();
+  _deadline_us = micros();
+  _running = true;
+  if (_use_timer) {
+    _timer->arm(_deadline_us);
+  }
+}
+
+void ValvePWM::stop() {
+  if (_running && _use_timer) {
+    _timer->disarm();
+  }
+  _running = false;
+}
+
+void ValvePWM::update() {
+  if (!_running) {
+    return;
+  }
+  if (_use_timer) {
+    // Only mind the I2C time, the interrupt takes care of the ticks. Re-arm
+    // the timer when it got disarmed from elsewhere, e.g. by the protocol.
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    poll_tx_done();
+    if (!_timer->is_armed()) {
+      _deadline_us = micros();
+      _timer->arm(_deadline_us);
+    }
+    __set_PRIMASK(primask);
+    return;
+  }
+  if ((int32_t)(micros() - _deadline_us) >= 0) {
+    tick();
+    schedule_next();
+  }
+}
+
+void ValvePWM::isr_tick() {
+  if (!_running) {
+    return;
+  }
+  tick();
+  schedule_next();
+  _timer->arm(_deadline_us);
+}
+
+void ValvePWM::schedule_next() {
+  _deadline_us += _tick_us;
+  if ((int32_t)(micros() - _deadline_us) >= (int32_t)_tick_us) {
+    _deadline_us = micros(); // Catch up instead of firing a burst
+  }
+}
+
+void ValvePWM::poll_tx_done() {
+  if (_tx_pending && !_cp_mgr->tx_busy()) {
+    _tx_pending = false;
+    uint32_t dt = _cp_mgr->get_tx_done_us() - _t_sent_us;
+    _stats.N_timed++;
+    _stats.i2c_us_sum += dt;
+    _stats.i2c_us_max = max(_stats.i2c_us_max, dt);
+  }
+}
+
+void ValvePWM::tick() {
+  CP_Masks masks;
+  uint8_t N_changed = 0;
+  CP_Masks sent = _cp_mgr->get_masks();
+
+  for (uint8_t port = 0; port < N_CP_PORTS; ++port) {
+    // Open while the countdown is below the on-time, comparing from the most
+    // significant plane down
+    uint16_t lt = 0;
+    uint16_t eq = 0xFFFF;
+    for (int8_t idx = PWM_BITS - 1; idx >= 0; --idx) {
+      uint16_t c = _count[idx][port];
+      uint16_t o = _on[idx][port];
+      lt |= eq & ~c & o;
+      eq &= ~(c ^ o);
+    }
+    masks[port] = lt & _enabled[port];
+    N_changed += (masks[port] != sent[port]);
+
+    // Decrement the nonzero countdowns, rippling the borrow up the planes
+    uint16_t zero = 0xFFFF;
+    for (const CP_Masks &plane : _count) {
+      zero &= ~plane[port];
+    }
+    uint16_t borrow = ~zero;
+    for (CP_Masks &plane : _count) {
+      uint16_t bit = plane[port];
+      plane[port] = bit ^ borrow;
+      borrow &= ~bit;
+    }
+
+    // Reload the countdowns that were at 0, starting a new period
+    for (uint8_t idx = 0; idx < PWM_BITS; ++idx) {
+      _count[idx][port] |= _reload[idx][port] & zero;
+    }
+  }
+
+  poll_tx_done();
+  _stats.N_ticks++;
+  if (N_changed == 0) {
+    return;
+  }
+  if (_cp_mgr->tx_busy()) {
+    // Dropped, but the change will get sent along with the next tick
+    _stats.N_overruns++;
+    return;
+  }
+
+  _cp_mgr->set_masks(masks);
+  _t_sent_us = micros();
+  _cp_mgr->send_masks();
+  _stats.N_updates++;
+  _stats.N_port_writes += N_changed;
+  _tx_pending = true;
+  poll_tx_done();
+}
+
+void ValvePWM::print_stats(Stream &mySerial) {
+  // Copy, as the interrupt keeps on ticking
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  Stats s = _stats;
+  __set_PRIMASK(primask);
+
+  uint32_t elapsed_us = micros() - s.t_start_us;
+  float rate = elapsed_us ? s.N_ticks * 1e6f / elapsed_us : 0;
+  snprintf(buf, BUF_LEN, "%u\t%lu\t%.1f\t%lu\t%lu\t%lu\t%lu\t%lu\n", _tick_us,
+           (unsigned long)s.N_ticks, rate, (unsigned long)s.N_updates,
+           (unsigned long)s.N_port_writes, (unsigned long)s.N_overruns,
+           (unsigned long)(s.N_timed ? s.i2c_us_sum / s.N_timed : 0),
+           (unsigned long)s.i2c_us_max);
+  mySerial.print(buf);
+}
@@ -0,0 +1,176 @@
+/**
+ * @file    ValvePWM.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Pulse-width modulation of the valves, for a partially open average
+ * jet momentum instead of binary valve states.
+ *
+ * Each valve gets its own period and on-time, both in ticks of a common tick
+ * interval. Every tick, the Centipede port bitmasks get produced for all
+ * valves at once and sent out. Only the ports that changed get written, see
+ * `CentipedeManager::send_masks()`, and a tick without any change skips the
+ * I2C bus altogether.
+ *
+ * Like `ValveGuard`, the engine is bit-sliced: Bit plane `i` holds bit `i` of
+ * the per-valve numbers of all 16 valves of a Centipede port. Each valve counts
+ * down its period and is open during the last on-time ticks of it. Hence,
+ * decrementing, reloading and comparing the counters of all valves take a few
+ * bit operations per port and plane, whatever the number of valves.
+ *
+ * The on-time is a single pulse per period, as the solenoid valves would wear
+ * out fast when switched at the tick rate. The phases of the valves get spread
+ * evenly over their period, such that not all of them close at once, which
+ * would trip the jetting pump, see `SafetyPulser`.
+ *
+ * The ticks get fired by the hardware timer, see `PlaybackTimer`, and from
+ * within the main loop on boards without it. The achievable tick rate is bound
+ * by the I2C bandwidth, see `print_stats()`.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef VALVE_PWM_H_
+#define VALVE_PWM_H_
+
+#include <Arduino.h>
+#include <array>
+
+#include "CentipedeManager.h"
+#include "PlaybackTimer.h"
+
+/**
+ * @brief Number of bits of the per-valve periods and on-times, setting the
+ * longest period in ticks.
+ */
+const uint8_t PWM_BITS = 8;
+
+const uint8_t PWM_MAX_TICKS = (1 << PWM_BITS) - 1; // Longest period [ticks]
+const uint16_t PWM_TICK_US = 2000;    // Default tick interval [µs]
+const uint16_t PWM_MIN_TICK_US = 250; // Shortest tick interval [µs]
+
+/*------------------------------------------------------------------------------
+  ValvePWM
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Class to pulse-width modulate the valves, see above.
+ */
+class ValvePWM {
+public:
+  ValvePWM(CentipedeManager *cp_mgr) : _cp_mgr(cp_mgr) {}
+
+  /**
+   * @brief Attach the hardware timer to fire the ticks from within an
+   * interrupt. Its callback must call `isr_tick()` while `is_running()`.
+   */
+  inline void attach_timer(PlaybackTimer *timer) { _timer = timer; }
+
+  /**
+   * @brief Set valve @p valve to be open for @p on ticks out of every
+   * @p period ticks. A period of 0 or an on-time of 0 keeps the valve closed,
+   * an on-time of at least the period keeps it open. Valve 0 sets all valves.
+   * Takes effect from the next period of the valve onwards.
+   *
+   * @return False when the valve number is out of range, true otherwise.
+   */
+  bool set(uint8_t valve, uint8_t on, uint8_t period);
+
+  /**
+   * @brief Get the on-time and the period [ticks] of valve @p valve.
+   */
+  void get(uint8_t valve, uint8_t &on, uint8_t &period) const;
+
+  /**
+   * @brief Set the tick interval [µs], down to `PWM_MIN_TICK_US`. Takes effect
+   * from the next tick onwards.
+   */
+  void set_tick_us(uint16_t tick_us);
+  inline uint16_t get_tick_us() const { return _tick_us; }
+
+  /**
+   * @brief Start ticking, all valves starting at their spread-out phase.
+   * Resets the statistics.
+   */
+  void start();
+
+  /**
+   * @brief Stop ticking. The valves are left as they are.
+   */
+  void stop();
+
+  inline bool is_running() const { return _running; }
+
+  /**
+   * @brief Return the Centipede port bitmasks of the valves that are being
+   * modulated, i.e. not kept closed, e.g. to light up their LEDs.
+   */
+  CP_Masks get_active_masks() const;
+
+  /**
+   * @brief To be called repeatedly from within the main loop: Fire the due
+   * tick when no hardware timer is being used.
+   */
+  void update();
+
+  /**
+   * @brief To be called exclusively by the hardware timer callback.
+   */
+  void isr_tick();
+
+  /**
+   * @brief Print the statistics, tab delimited: Tick interval [µs], number of
+   * ticks, achieved tick rate [Hz], number of ticks that changed any valve,
+   * number of port writes, number of ticks that could not be sent because the
+   * I2C bus was still busy with the previous one, followed by the mean and
+   * max time [µs] the I2C bus took per sent tick.
+   */
+  void print_stats(Stream &mySerial);
+
+private:
+  CentipedeManager *_cp_mgr;
+  PlaybackTimer *_timer = nullptr;
+  uint16_t _tick_us = PWM_TICK_US;
+  volatile bool _running = false;
+  bool _use_timer = false;     // Tick from the hardware timer interrupt?
+  uint32_t _deadline_us = 0;   // Time [µs] of the next tick
+
+  // Bit-sliced per-valve numbers, see above
+  using Planes = std::array<CP_Masks, PWM_BITS>;
+  Planes _count{};  // Ticks left in the present period, minus 1
+  Planes _reload{}; // Period minus 1
+  Planes _on{};     // On-time
+  CP_Masks _enabled{}; // Valves with a nonzero period
+
+  struct Stats {
+    uint32_t N_ticks = 0;
+    uint32_t N_updates = 0;     // Ticks that changed any valve
+    uint32_t N_port_writes = 0; // Ports written
+    uint32_t N_overruns = 0;    // Ticks skipped as the I2C bus was busy
+    uint32_t N_timed = 0;       // Sent ticks of which the I2C time is known
+    uint64_t i2c_us_sum = 0;
+    uint32_t i2c_us_max = 0;
+    uint32_t t_start_us = 0;
+  } _stats;
+  bool _tx_pending = false; // Is the I2C time of the last sent tick pending?
+  uint32_t _t_sent_us = 0;  // Time [µs] the last tick got sent
+
+  /**
+   * @brief Produce the bitmasks of the present tick, send them out and
+   * advance all counters by one tick.
+   */
+  void tick();
+
+  /**
+   * @brief Schedule the next tick, catching up when more than a tick behind.
+   */
+  void schedule_next();
+
+  /**
+   * @brief Finish measuring the I2C time of the last sent tick, once done.
+   */
+  void poll_tx_done();
+};
+
+#endif
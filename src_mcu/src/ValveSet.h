@@ -0,0 +1,255 @@
+/**
+ * @file    ValveSet.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Provides class `ValveSet`, the set of open valves as a bitset
+ * indexed by valve number.
+ *
+ * The generators decide per valve, not per PCS point. Building their lines as
+ * a `ValveSet` skips the detour via a list of PCS points, which costs a
+ * look-up of each valve its PCS point, a copy of up to 112 points and a
+ * checked look-up of each point its valve again when packing. Here, the
+ * translation into Centipede port bitmasks boils down to extracting a bit
+ * field per port, as long as the wiring in `constants.h` stays in groups of
+ * consecutive valves, checked at compile time. Otherwise, it falls back to
+ * the wiring arrays per open valve.
+ *
+ * Bit `valve - 1` is set when the valve is open, matching the bit order of
+ * `PACKING_VALVE_BITS` and of the live frames.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef VALVE_SET_H_
+#define VALVE_SET_H_
+
+#include <Arduino.h>
+#include <array>
+
+#include "CentipedeManager.h"
+#include "constants.h"
+
+// Number of valves per Centipede port when wired in consecutive groups
+constexpr uint8_t VALVES_PER_CP_PORT =
+    (N_VALVES + N_CP_PORTS - 1) / N_CP_PORTS;
+
+/**
+ * @brief Is valve number `v` wired to Centipede port `(v - 1) / n` and bit
+ * `(v - 1) % n`, with n = `VALVES_PER_CP_PORT`?
+ */
+constexpr bool valve_wiring_is_consecutive() {
+  for (uint8_t idx = 0; idx < N_VALVES; ++idx) {
+    if ((VALVE2CP_PORT[idx] != idx / VALVES_PER_CP_PORT) ||
+        (VALVE2CP_BIT[idx] != idx % VALVES_PER_CP_PORT)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+constexpr bool CP_WIRING_CONSECUTIVE = valve_wiring_is_consecutive();
+
+/*------------------------------------------------------------------------------
+  ValveSet
+------------------------------------------------------------------------------*/
+
+class ValveSet {
+public:
+  static constexpr uint8_t N_WORDS = (N_VALVES + 31) / 32;
+  using Words = std::array<uint32_t, N_WORDS>;
+
+  constexpr ValveSet() : _words{} {}
+  constexpr explicit ValveSet(const Words &words) : _words(words) {}
+
+  inline void clear() { _words.fill(0); }
+
+  /**
+   * @brief Open valve number @p valve, from 1 to `N_VALVES`. Unchecked.
+   */
+  constexpr void set(uint8_t valve) {
+    _words[(valve - 1) >> 5] |= 1UL << ((valve - 1) & 31);
+  }
+
+  constexpr void reset(uint8_t valve) {
+    _words[(valve - 1) >> 5] &= ~(1UL << ((valve - 1) & 31));
+  }
+
+  constexpr bool test(uint8_t valve) const {
+    return (_words[(valve - 1) >> 5] >> ((valve - 1) & 31)) & 0x01;
+  }
+
+  /**
+   * @brief Number of open valves.
+   */
+  inline uint8_t count() const {
+    uint8_t N = 0;
+    for (uint32_t word : _words) {
+      N += __builtin_popcountl(word);
+    }
+    return N;
+  }
+
+  inline bool any() const {
+    uint32_t bits = 0;
+    for (uint32_t word : _words) {
+      bits |= word;
+    }
+    return bits != 0;
+  }
+
+  inline ValveSet &operator&=(const ValveSet &other) {
+    for (uint8_t w = 0; w < N_WORDS; ++w) {
+      _words[w] &= other._words[w];
+    }
+    return *this;
+  }
+
+  inline ValveSet &operator|=(const ValveSet &other) {
+    for (uint8_t w = 0; w < N_WORDS; ++w) {
+      _words[w] |= other._words[w];
+    }
+    return *this;
+  }
+
+  inline ValveSet &operator^=(const ValveSet &other) {
+    for (uint8_t w = 0; w < N_WORDS; ++w) {
+      _words[w] ^= other._words[w];
+    }
+    return *this;
+  }
+
+  /**
+   * @brief Close the valves that are open in @p other.
+   */
+  inline ValveSet &andnot(const ValveSet &other) {
+    for (uint8_t w = 0; w < N_WORDS; ++w) {
+      _words[w] &= ~other._words[w];
+    }
+    return *this;
+  }
+
+  inline bool operator==(const ValveSet &other) const {
+    return _words == other._words;
+  }
+  inline bool operator!=(const ValveSet &other) const {
+    return _words != other._words;
+  }
+
+  /**
+   * @brief Call @p fun with the number of each open valve, in ascending
+   * order. Takes time proportional to the number of open valves.
+   */
+  template <class Fun> inline void for_each(Fun fun) const {
+    for (uint8_t w = 0; w < N_WORDS; ++w) {
+      uint32_t bits = _words[w];
+      while (bits) {
+        uint8_t bit = __builtin_ctzl(bits);
+        bits &= bits - 1; // Clear lowest set bit
+        fun((uint8_t)((w << 5) + bit + 1));
+      }
+    }
+  }
+
+  /**
+   * @brief Translate into the Centipede port bitmasks that will open these
+   * valves.
+   */
+  constexpr CP_Masks to_cp_masks() const {
+    CP_Masks masks{};
+    if constexpr (CP_WIRING_CONSECUTIVE) {
+      for (uint8_t port = 0; port < N_CP_PORTS; ++port) {
+        masks[port] = extract_field(port * VALVES_PER_CP_PORT);
+      }
+    } else {
+      for (uint8_t w = 0; w < N_WORDS; ++w) {
+        uint32_t bits = _words[w];
+        while (bits) {
+          uint8_t idx = (w << 5) + __builtin_ctzl(bits);
+          bits &= bits - 1; // Clear lowest set bit
+          masks[VALVE2CP_PORT[idx]] |= 1U << VALVE2CP_BIT[idx];
+        }
+      }
+    }
+    return masks;
+  }
+
+  /**
+   * @brief Translate Centipede port bitmasks back into valves. Unwired bits
+   * get ignored.
+   */
+  static constexpr ValveSet from_cp_masks(const CP_Masks &masks) {
+    ValveSet valves;
+    if constexpr (CP_WIRING_CONSECUTIVE) {
+      for (uint8_t port = 0; port < N_CP_PORTS; ++port) {
+        valves.deposit_field(port * VALVES_PER_CP_PORT, masks[port]);
+      }
+    } else {
+      for (uint8_t idx = 0; idx < N_VALVES; ++idx) {
+        if ((masks[VALVE2CP_PORT[idx]] >> VALVE2CP_BIT[idx]) & 0x01) {
+          valves.set(idx + 1);
+        }
+      }
+    }
+    return valves;
+  }
+
+  /**
+   * @brief Set the valves from a little-endian byte-encoded bitset of
+   * @p N_bytes bytes, e.g. a live frame. Bits beyond `N_VALVES` get ignored.
+   */
+  inline void unpack_bytes(const uint8_t *bytes, uint8_t N_bytes) {
+    clear();
+    N_bytes = min(N_bytes, (uint8_t)(N_WORDS * 4));
+    for (uint8_t idx = 0; idx < N_bytes; ++idx) {
+      _words[idx >> 2] |= (uint32_t)bytes[idx] << ((idx & 3) << 3);
+    }
+    if (N_VALVES % 32) {
+      _words[N_WORDS - 1] &= (1UL << (N_VALVES % 32)) - 1;
+    }
+  }
+
+  /**
+   * @brief Write the valves as a little-endian byte-encoded bitset of
+   * @p N_bytes bytes, the counterpart of `unpack_bytes()`.
+   */
+  inline void pack_bytes(uint8_t *bytes, uint8_t N_bytes) const {
+    N_bytes = min(N_bytes, (uint8_t)(N_WORDS * 4));
+    for (uint8_t idx = 0; idx < N_bytes; ++idx) {
+      bytes[idx] = _words[idx >> 2] >> ((idx & 3) << 3);
+    }
+  }
+
+  constexpr const Words &words() const { return _words; }
+
+private:
+  Words _words;
+
+  // Bitmask of the valves of a single Centipede port
+  static constexpr uint32_t FIELD_MASK = (1UL << VALVES_PER_CP_PORT) - 1;
+
+  /**
+   * @brief Extract the `VALVES_PER_CP_PORT` bits starting at bit @p offset,
+   * possibly straddling two words.
+   */
+  constexpr uint16_t extract_field(uint16_t offset) const {
+    uint8_t w = offset >> 5;
+    uint64_t pair = _words[w];
+    if (w + 1 < N_WORDS) {
+      pair |= (uint64_t)_words[w + 1] << 32;
+    }
+    return (pair >> (offset & 31)) & FIELD_MASK;
+  }
+
+  constexpr void deposit_field(uint16_t offset, uint32_t field) {
+    uint8_t w = offset >> 5;
+    uint64_t pair = (uint64_t)(field & FIELD_MASK) << (offset & 31);
+    _words[w] |= (uint32_t)pair;
+    if (w + 1 < N_WORDS) {
+      _words[w + 1] |= (uint32_t)(pair >> 32);
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,141 @@
+/**
+ * @file    ValveStats.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "ValveStats.h"
+#include "translations.h"
+
+// See `main.cpp`
+extern const uint8_t BUF_LEN; // Common character buffer for string formatting
+extern char buf[];            // Common character buffer for string formatting
+
+/*------------------------------------------------------------------------------
+  ValveStats
+------------------------------------------------------------------------------*/
+
+void ValveStats::reset(const uint16_t *masks, uint32_t now_ms) {
+  // Account for any difference first, as the lifetime totals carry on
+  update(masks, now_ms);
+
+  _t_reset_ms = now_ms;
+  for (uint8_t port = 0; port < Grid::N_CP_PORTS; ++port) {
+    for (uint8_t bit = 0; bit < 16; ++bit) {
+      uint8_t chan = port * 16 + bit;
+      _count_base[chan] = get_N_switches(port, bit);
+      _open_base[chan] = get_open_ms(port, bit, now_ms);
+      _open_ms[chan] = _open_base[chan];
+      _t_switch_ms[chan] = now_ms;
+    }
+  }
+  memset(_hist, 0, sizeof(_hist));
+}
+
+void ValveStats::update(const uint16_t *masks, uint32_t now_ms) {
+  for (uint8_t port = 0; port < Grid::N_CP_PORTS; ++port) {
+    uint16_t switched = _state[port] ^ masks[port];
+    if (!switched) {
+      continue;
+    }
+
+    // Increment the counts of the switched valves, rippling the carry up the
+    // planes
+    uint16_t carry = switched;
+    for (auto &plane : _count_planes) {
+      uint16_t bit = plane[port];
+      plane[port] = bit ^ carry;
+      carry &= bit;
+      if (!carry) {
+        break;
+      }
+    }
+
+    // Time and bin the on or off duration that just ended
+    while (switched) {
+      uint8_t bit = __builtin_ctz(switched);
+      switched &= switched - 1; // Clear lowest set bit
+
+      uint8_t chan = port * 16 + bit;
+      uint32_t duration = now_ms - _t_switch_ms[chan];
+      bool was_open = (_state[port] >> bit) & 0x01;
+      if (was_open) {
+        _open_ms[chan] += duration;
+      }
+
+      uint8_t bin = duration ? 31 - __builtin_clz(duration) : 0;
+      if (bin >= VALVE_STATS_BINS) {
+        bin = VALVE_STATS_BINS - 1;
+      }
+      uint16_t &count = _hist[was_open][chan][bin];
+      if (count < UINT16_MAX) {
+        count++;
+      }
+      _t_switch_ms[chan] = now_ms;
+    }
+
+    _state[port] = masks[port];
+  }
+}
+
+uint32_t ValveStats::get_N_switches(uint8_t port, uint8_t bit) const {
+  uint32_t count = 0;
+  for (uint8_t idx = 0; idx < VALVE_STATS_COUNT_BITS; ++idx) {
+    count |= (uint32_t)((_count_planes[idx][port] >> bit) & 0x01) << idx;
+  }
+  return count;
+}
+
+uint32_t ValveStats::get_open_ms(uint8_t port, uint8_t bit,
+                                 uint32_t now_ms) const {
+  uint8_t chan = port * 16 + bit;
+  uint32_t open_ms = _open_ms[chan];
+  if ((_state[port] >> bit) & 0x01) {
+    open_ms += now_ms - _t_switch_ms[chan];
+  }
+  return open_ms;
+}
+
+void ValveStats::get_lifetime(uint8_t valve, uint32_t now_ms,
+                              uint32_t &N_switches, uint32_t &open_ms) const {
+  const ValveAddress &addr = VALVE2ADDR[valve - 1];
+
+  // Snapshot, as `update()` might fire from within an interrupt
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  N_switches = get_N_switches(addr.cp_port, addr.cp_bit);
+  open_ms = get_open_ms(addr.cp_port, addr.cp_bit, now_ms);
+  __set_PRIMASK(primask);
+}
+
+void ValveStats::print(Stream &mySerial, uint32_t now_ms) const {
+  snprintf(buf, BUF_LEN, "%u\t%lu\n", N_VALVES,
+           (unsigned long)(now_ms - _t_reset_ms));
+  mySerial.print(buf);
+
+  for (const ValveAddress &addr : VALVE2ADDR) {
+    uint8_t chan = addr.cp_port * 16 + addr.cp_bit;
+    uint32_t N_switches;
+    uint32_t open_ms;
+    get_lifetime(addr.valve, now_ms, N_switches, open_ms);
+
+    snprintf(buf, BUF_LEN, "%u\t%lu\t%lu\n", addr.valve,
+             (unsigned long)(N_switches - _count_base[chan]),
+             (unsigned long)(open_ms - _open_base[chan]));
+    mySerial.print(buf);
+  }
+}
+
+void ValveStats::print_histograms(Stream &mySerial, uint8_t valve) const {
+  const ValveAddress &addr = VALVE2ADDR[valve - 1];
+  uint8_t chan = addr.cp_port * 16 + addr.cp_bit;
+
+  for (int8_t on = 1; on >= 0; --on) {
+    for (uint8_t bin = 0; bin < VALVE_STATS_BINS; ++bin) {
+      mySerial.print(_hist[on][chan][bin]);
+      mySerial.write(bin < VALVE_STATS_BINS - 1 ? '\t' : '\n');
+    }
+  }
+}
@@ -0,0 +1,120 @@
+/**
+ * @file    ValveStats.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Per-valve statistics of what actually got sent to the valves:
+ * Switch count, total open time and histograms of the on and off durations.
+ *
+ * The online counterpart of `valve_on_off_PDFs()` of the Python protocol
+ * tools, which works on the planned protocol. These statistics follow the
+ * Centipede outputs instead, hence including pauses, gotos, manual valve
+ * control and the minimum valve on/off duration. The switch counts double as
+ * a measure of solenoid wear.
+ *
+ * Updated on every write of the Centipede ports from the XOR of the old and
+ * new port bitmasks. The switch counts are bit-sliced like the countdowns of
+ * `ValveGuard`: Bit plane `i` holds bit `i` of the counts of all 16 valves of
+ * a port, such that counting takes a few bit operations per port. Only the
+ * valves that switched get their duration timed and binned.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef VALVE_STATS_H_
+#define VALVE_STATS_H_
+
+#include <Arduino.h>
+#include <array>
+
+#include "constants.h"
+
+/**
+ * @brief Number of log2-spaced bins of the on and off duration histograms.
+ * Bin `b` counts the durations of [2^b, 2^(b + 1)) ms, bin 0 including those
+ * below 1 ms and the last bin those beyond.
+ */
+const uint8_t VALVE_STATS_BINS = 16;
+
+/**
+ * @brief Number of bit planes of the switch counts.
+ */
+const uint8_t VALVE_STATS_COUNT_BITS = 32;
+
+/*------------------------------------------------------------------------------
+  ValveStats
+------------------------------------------------------------------------------*/
+
+class ValveStats {
+public:
+  /**
+   * @brief Clear all statistics, taking @p masks as the current Centipede
+   * port bitmasks at time @p now_ms. Ongoing on and off durations count from
+   * now on. The lifetime totals, see `get_lifetime()`, are left untouched.
+   */
+  void reset(const uint16_t *masks, uint32_t now_ms);
+
+  /**
+   * @brief Account for the Centipede port bitmasks @p masks being written at
+   * time @p now_ms. Safe to call from within an interrupt.
+   */
+  void update(const uint16_t *masks, uint32_t now_ms);
+
+  /**
+   * @brief Print the statistics of all valves at time @p now_ms. The first
+   * line holds, tab delimited: The number of valves and the time since the
+   * reset [ms]. Then follows a line per valve, tab delimited:
+   *   1) Valve number
+   *   2) Switch count
+   *   3) Total open time [ms], including an ongoing one
+   */
+  void print(Stream &mySerial, uint32_t now_ms) const;
+
+  /**
+   * @brief Print the histograms of the on and off durations of valve number
+   * @p valve on two lines, each holding `VALVE_STATS_BINS` tab-delimited
+   * counts, see `VALVE_STATS_BINS`. The counts saturate at 65535.
+   */
+  void print_histograms(Stream &mySerial, uint8_t valve) const;
+
+  /**
+   * @brief Get the switch count and the total open time [ms] of valve number
+   * @p valve since boot at time @p now_ms, ignoring any `reset()`. The open
+   * time wraps around after ~49 days, so take differences. Safe to call while
+   * `update()` might fire from within an interrupt.
+   */
+  void get_lifetime(uint8_t valve, uint32_t now_ms, uint32_t &N_switches,
+                    uint32_t &open_ms) const;
+
+private:
+  static const uint8_t N_CHANNELS = Grid::N_CP_PORTS * 16;
+
+  std::array<uint16_t, Grid::N_CP_PORTS> _state{}; // Bitmasks last written
+  uint32_t _t_reset_ms = 0; // Time of the last reset [ms]
+
+  // Bit-sliced switch counts: Plane `i` holds bit `i` of the counts
+  std::array<std::array<uint16_t, Grid::N_CP_PORTS>, VALVE_STATS_COUNT_BITS>
+      _count_planes{};
+
+  // Per Centipede channel, i.e. `port * 16 + bit`. The switch counts and open
+  // times run since boot, their values at the last reset get subtracted.
+  std::array<uint32_t, N_CHANNELS> _t_switch_ms{}; // Time of the last switch
+  std::array<uint32_t, N_CHANNELS> _open_ms{};     // Total open time [ms]
+  std::array<uint32_t, N_CHANNELS> _count_base{};  // Switch count at reset
+  std::array<uint32_t, N_CHANNELS> _open_base{};   // Open time [ms] at reset
+  uint16_t _hist[2][N_CHANNELS][VALVE_STATS_BINS] = {}; // [off/on][channel]
+
+  /**
+   * @brief Return the switch count since boot of Centipede @p port and @p bit.
+   */
+  uint32_t get_N_switches(uint8_t port, uint8_t bit) const;
+
+  /**
+   * @brief Return the total open time [ms] since boot of Centipede @p port and
+   * @p bit at time @p now_ms, including an ongoing one.
+   */
+  uint32_t get_open_ms(uint8_t port, uint8_t bit, uint32_t now_ms) const;
+};
+
+#endif
@@ -0,0 +1,134 @@
+/**
+ * @file    WarmStart.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "WarmStart.h"
+#include "crc32.h"
+
+// See `main.cpp`
+extern const uint8_t BUF_LEN; // Common character buffer for string formatting
+extern char buf[];            // Common character buffer for string formatting
+
+// Marks a valid record: "TWTW"
+const uint32_t WARM_MAGIC = 0x57545754;
+
+#if !defined(__SAMD51__)
+static uint8_t bkupram[WARM_BKUPRAM_OFFSET + 64]; // Stand-in for the backup RAM
+#  define BKUPRAM_ADDR bkupram
+#endif
+
+/*------------------------------------------------------------------------------
+  WarmStart
+------------------------------------------------------------------------------*/
+
+void WarmStart::begin() {
+  _rec = (Record *)((uint8_t *)BKUPRAM_ADDR + WARM_BKUPRAM_OFFSET);
+
+  // The backup RAM holds garbage after a power cycle
+  _last = *_rec;
+  _last_valid = (_last.magic == WARM_MAGIC) &&
+                (_last.crc == crc32(&_last, offsetof(Record, crc))) &&
+                (_last.state != WARM_NONE) && (_last.state <= WARM_PAUSED) &&
+                (_last.pos < _last.N_lines);
+
+  *_rec = Record();
+  _rec->magic = WARM_MAGIC;
+  _rec->state = WARM_NONE;
+  _rec->crc = crc32(_rec, offsetof(Record, crc));
+}
+
+bool WarmStart::update_crc(ProtocolManager &protocol_mgr) {
+  if (protocol_mgr.get_program_gen() != _crc_gen) {
+    _crc_gen = protocol_mgr.get_program_gen();
+    _crc_ofs = 0;
+    _crc_acc = 0;
+    _crc_done = false;
+    _crc_pending = false; // A chunk still ongoing simply gets ignored
+  }
+  if (_crc_done) {
+    return true;
+  }
+
+  // Hand the next chunk to the CRC engine, which runs in the background
+  if (!_crc_pending) {
+    Program &program = protocol_mgr.get_program();
+    uint32_t len = min(program.get_N_image_bytes() - _crc_ofs, WARM_CRC_CHUNK);
+    if (!crc32_start(program.image() + _crc_ofs, len, _crc_acc)) {
+      return false; // Stale chunk of a previous program not finished yet
+    }
+    _crc_ofs += len;
+    _crc_pending = true;
+  }
+  if (crc32_is_busy()) {
+    return false;
+  }
+
+  _crc_acc = crc32_result();
+  _crc_pending = false;
+  _crc_done = (_crc_ofs == protocol_mgr.get_program().get_N_image_bytes());
+  return _crc_done;
+}
+
+void WarmStart::update(ProtocolManager &protocol_mgr, WarmState state) {
+  if (_rec == nullptr) {
+    return; // Before `begin()`
+  }
+
+  Record rec = Record();
+  rec.magic = WARM_MAGIC;
+  rec.state = WARM_NONE;
+  if ((state != WARM_NONE) && update_crc(protocol_mgr)) {
+    const MaskTransform &xform = protocol_mgr.get_transform();
+    rec.program_crc = _crc_acc;
+    rec.speed_q16 = protocol_mgr.get_speed();
+    rec.left_us = protocol_mgr.get_us_left_in_line();
+    rec.N_lines = protocol_mgr.get_active_N_lines();
+    rec.pos = protocol_mgr.get_position();
+    rec.state = state;
+    rec.orientation = xform.get_orientation();
+    rec.dx = xform.get_dx();
+    rec.dy = xform.get_dy();
+    rec.invert = xform.get_invert();
+  }
+  rec.crc = crc32(&rec, offsetof(Record, crc));
+  *_rec = rec;
+}
+
+bool WarmStart::restore_program(ProtocolLibrary &protocol_lib,
+                                ProtocolManager &protocol_mgr) {
+  if (!_last_valid) {
+    return false;
+  }
+
+  const char *name = protocol_lib.find_crc(_last.program_crc);
+  if ((name == nullptr) || !protocol_lib.load(name, protocol_mgr) ||
+      (protocol_mgr.get_active_N_lines() != _last.N_lines) ||
+      !protocol_mgr.set_transform(_last.orientation, _last.dx, _last.dy,
+                                  _last.invert)) {
+    return false;
+  }
+  protocol_mgr.set_speed(_last.speed_q16);
+  _recovered = true;
+  return true;
+}
+
+WarmState WarmStart::restore_position(ProtocolManager &protocol_mgr) {
+  protocol_mgr.goto_line(_last.pos);
+  protocol_mgr.set_us_left_in_line(_last.left_us);
+  return (WarmState)_last.state;
+}
+
+void WarmStart::print_last(Stream &mySerial) {
+  if (!_last_valid) {
+    mySerial.println("none");
+    return;
+  }
+  snprintf(buf, BUF_LEN, "%u\t%u\t%u\t%u\t%lu\t%08lx\n", _recovered,
+           _last.state, _last.pos + 1, _last.N_lines,
+           (unsigned long)_last.left_us, (unsigned long)_last.program_crc);
+  mySerial.print(buf);
+}
@@ -0,0 +1,148 @@
+/**
+ * @file    WarmStart.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Warm recovery of the playback after a watchdog reset.
+ *
+ * While a protocol program plays, the playback state gets kept in the backup
+ * RAM of the SAMD51, which survives a reset other than a power cycle: The
+ * CRC32 checksum of the program image, its number of lines, the position, the
+ * time left within the current line, whether it was running or paused, the
+ * playback speed and the mask transform. The record is guarded by a CRC32
+ * checksum of its own.
+ *
+ * After a watchdog reset, the program with the same checksum gets loaded back
+ * from the protocol library in flash, see `ProtocolLibrary::find_crc()`, and
+ * the playback continues at the recorded position within milliseconds,
+ * instead of the operator having to re-upload and seek. When any check fails,
+ * e.g. the program never got saved into the library, the firmware boots as
+ * usual into the Off state.
+ *
+ * The checksum of the program image gets computed in the background, chunk by
+ * chunk, whenever the program changes. Until done, the playback is not
+ * recoverable. The time left within the line is as recorded at the last
+ * `update()`, hence the line stalling into the watchdog gets replayed for its
+ * remainder.
+ *
+ * The backup RAM is shared with `LoopMonitor`, taking the bytes from offset
+ * `WARM_BKUPRAM_OFFSET` on. Elsewhere, the record lives in ordinary RAM and
+ * does not survive a reset.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef WARM_START_H_
+#define WARM_START_H_
+
+#include "ProtocolLibrary.h"
+#include "ProtocolManager.h"
+
+#include <Arduino.h>
+
+// Offset [bytes] of the record inside the backup RAM, past the `LoopMonitor`
+const uint32_t WARM_BKUPRAM_OFFSET = 64;
+
+// Bytes of the program image to checksum per `update()` call, in the
+// background when the CRC engine of the DMA controller is available
+const uint32_t WARM_CRC_CHUNK = 4096;
+
+/**
+ * @brief Playback state to recover.
+ */
+enum WarmState : uint8_t {
+  WARM_NONE,    // Nothing to recover, boot into the Off state
+  WARM_RUNNING, // Continue playing
+  WARM_PAUSED,  // Restore the position, but stay paused
+};
+
+/*------------------------------------------------------------------------------
+  WarmStart
+------------------------------------------------------------------------------*/
+
+class WarmStart {
+public:
+  /**
+   * @brief Pick up the record left behind by the previous run, if any, and
+   * start a fresh one. Call once at boot.
+   */
+  void begin();
+
+  /**
+   * @brief Record the playback state of @p protocol_mgr. To be called
+   * repeatedly from within the main loop.
+   *
+   * @param state The playback state, `WARM_NONE` when not playing the
+   * protocol program in memory, e.g. while streaming or uploading
+   */
+  void update(ProtocolManager &protocol_mgr, WarmState state);
+
+  /**
+   * @brief Load the program of the record left behind by the previous run
+   * from @p protocol_lib, and restore the playback speed and the mask
+   * transform. The program must match the recorded number of lines.
+   *
+   * @return True when successful. False when there is nothing to recover or
+   * any check fails, leaving the record of the previous run unused.
+   */
+  bool restore_program(ProtocolLibrary &protocol_lib,
+                       ProtocolManager &protocol_mgr);
+
+  /**
+   * @brief Activate the recorded line and shorten it to the recorded time
+   * left, leaving the time track frozen. Call after `restore_program()`
+   * succeeded, once the state machine has entered its initial state.
+   *
+   * @return The playback state to continue in.
+   */
+  WarmState restore_position(ProtocolManager &protocol_mgr);
+
+  /**
+   * @brief Print, tab delimited: Whether the previous run got recovered (1)
+   * or not (0), its recorded state, see `WarmState`, position starting at
+   * index 1, number of lines, time left within the line [µs] and the CRC32
+   * checksum of the program image in hex. Prints "none" when no valid record
+   * was found.
+   */
+  void print_last(Stream &mySerial);
+
+private:
+  // Kept across resets, hence no initializers
+  struct Record {
+    uint32_t magic;
+    uint32_t program_crc; // CRC32 of the program image
+    uint32_t speed_q16;   // See `ProtocolManager::set_speed()`
+    uint32_t left_us;     // Time left within the current line [µs]
+    uint16_t N_lines;     // Number of lines of the program
+    uint16_t pos;         // Playback position starting at index 0
+    uint8_t state;        // See `WarmState`
+    uint8_t orientation;  // See `MaskTransform`
+    int8_t dx;
+    int8_t dy;
+    uint8_t invert;
+    uint8_t reserved[3];
+    uint32_t crc; // CRC32 of all of the above
+  };
+
+  Record *_rec = nullptr; // Live record, inside the backup RAM when available
+  Record _last;           // Copy of the record of the previous run
+  bool _last_valid = false;
+  bool _recovered = false;
+
+  // Background checksum of the program image
+  uint32_t _crc_gen = UINT32_MAX; // Program generation being checksummed
+  uint32_t _crc_ofs = 0;          // Bytes checksummed so far
+  uint32_t _crc_acc = 0;          // Checksum of the bytes so far
+  bool _crc_done = false;
+  bool _crc_pending = false; // Chunk handed to `crc32_start()` ongoing?
+
+  /**
+   * @brief Continue the checksum of the program image of @p protocol_mgr.
+   *
+   * @return True once the checksum is complete for the present program.
+   */
+  bool update_crc(ProtocolManager &protocol_mgr);
+};
+
+#endif
@@ -0,0 +1,141 @@
+/**
+ * @file    WearJournal.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "WearJournal.h"
+#include "crc32.h"
+
+#include <stddef.h>
+
+// See `main.cpp`
+extern const uint8_t BUF_LEN; // Common character buffer for string formatting
+extern char buf[];            // Common character buffer for string formatting
+
+// Marks a valid record: "TWTW"
+const uint32_t WEAR_MAGIC = 0x57545754;
+
+/*------------------------------------------------------------------------------
+  WearJournal
+------------------------------------------------------------------------------*/
+
+bool WearJournal::begin(QSPIFlash *flash) {
+  _flash = flash;
+  _available = (_flash->size() >= 2 * WEAR_JOURNAL_SIZE);
+  _start = _flash->size() - WEAR_JOURNAL_SIZE;
+
+  // Pick the valid record with the highest sequence number
+  int16_t best_slot = -1;
+  uint32_t best_seq = 0;
+  for (uint8_t slot = 0; slot < N_SLOTS && _available; ++slot) {
+    uint32_t addr = _start + slot * SLOT_SIZE;
+    uint32_t head[2]; // Magic and sequence number
+    _flash->read(addr, head, sizeof(head));
+    if ((head[0] != WEAR_MAGIC) ||
+        ((best_slot >= 0) && (head[1] <= best_seq))) {
+      continue;
+    }
+    _flash->read(addr, &_rec, sizeof(_rec));
+    if (_rec.crc == crc32(&_rec, offsetof(Record, crc))) {
+      best_slot = slot;
+      best_seq = _rec.seq;
+    }
+  }
+
+  if (best_slot < 0) {
+    // Unformatted journal: Start from zero
+    memset(&_rec, 0, sizeof(_rec));
+    _next_slot = 0;
+  } else {
+    _flash->read(_start + best_slot * SLOT_SIZE, &_rec, sizeof(_rec));
+    _next_slot = (best_slot + 1) % N_SLOTS;
+  }
+  _tick_flush = millis();
+
+  return _available;
+}
+
+void WearJournal::collect(const ValveStats &stats) {
+  uint32_t now = millis();
+
+  for (uint8_t valve = 1; valve <= N_VALVES; ++valve) {
+    uint8_t idx = valve - 1;
+    uint32_t N_switches;
+    uint32_t open_ms;
+    stats.get_lifetime(valve, now, N_switches, open_ms);
+
+    uint32_t d_switches = N_switches - _seen_switches[idx];
+    uint32_t d_open_ms = open_ms - _seen_open_ms[idx] + _open_ms_rem[idx];
+    _seen_switches[idx] = N_switches;
+    _seen_open_ms[idx] = open_ms;
+
+    _rec.N_switches[idx] += d_switches;
+    _rec.open_s[idx] += d_open_ms / 1000;
+    _open_ms_rem[idx] = d_open_ms % 1000;
+    _dirty |= (d_switches != 0) || (d_open_ms >= 1000);
+  }
+}
+
+void WearJournal::update(const ValveStats &stats) {
+  if (!_available || (millis() - _tick_flush < WEAR_FLUSH_INTERVAL)) {
+    return;
+  }
+  flush(stats);
+}
+
+bool WearJournal::flush(const ValveStats &stats) {
+  _tick_flush = millis();
+  if (!_available) {
+    return false;
+  }
+
+  collect(stats);
+  if (!_dirty) {
+    return true;
+  }
+
+  _rec.magic = WEAR_MAGIC;
+  _rec.seq++;
+  _rec.crc = crc32(&_rec, offsetof(Record, crc));
+
+  // Entering a sector: Erase it, dropping the oldest records
+  uint32_t addr = _start + _next_slot * SLOT_SIZE;
+  bool success = true;
+  if (_next_slot % SLOTS_PER_SECTOR == 0) {
+    success &= _flash->erase_sector(addr);
+  }
+  success &= _flash->write(addr, &_rec, sizeof(_rec));
+
+  // Move on regardless, as a failed slot is simply skipped when reading back
+  _next_slot = (_next_slot + 1) % N_SLOTS;
+  _dirty = !success;
+  return success;
+}
+
+void WearJournal::clear(const ValveStats &stats, uint8_t valve) {
+  collect(stats);
+  for (uint8_t idx = 0; idx < N_VALVES; ++idx) {
+    if ((valve == 0) || (valve == idx + 1)) {
+      _rec.N_switches[idx] = 0;
+      _rec.open_s[idx] = 0;
+      _open_ms_rem[idx] = 0;
+    }
+  }
+  _dirty = true;
+}
+
+void WearJournal::print(Stream &mySerial, const ValveStats &stats) {
+  collect(stats);
+
+  snprintf(buf, BUF_LEN, "%u\t%lu\n", N_VALVES, (unsigned long)_rec.seq);
+  mySerial.print(buf);
+  for (uint8_t idx = 0; idx < N_VALVES; ++idx) {
+    snprintf(buf, BUF_LEN, "%u\t%lu\t%lu\n", idx + 1,
+             (unsigned long)_rec.N_switches[idx],
+             (unsigned long)_rec.open_s[idx]);
+    mySerial.print(buf);
+  }
+}
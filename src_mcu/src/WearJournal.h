@@ -0,0 +1,135 @@
+/**
+ * @file    WearJournal.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Lifetime switch counts and open times of the valves, persisted
+ * across reboots inside the QSPI flash of the Feather M4 for maintenance
+ * scheduling of the solenoids.
+ *
+ * The counting itself is done by `ValveStats` on every write of the Centipede
+ * ports. The journal only collects its increments from within the main loop
+ * and appends the resulting totals as a new record to flash every
+ * `WEAR_FLUSH_INTERVAL`, such that the line switches never wait on the flash.
+ * At most the increments of a single interval get lost on power failure.
+ *
+ * @section Flash layout
+ * The last `WEAR_JOURNAL_SECTORS` sectors of the flash form a ring of record
+ * slots, kept out of reach of the `ProtocolLibrary`. Each record holds the
+ * full totals, a sequence number and a CRC32 checksum, and the valid record
+ * with the highest sequence number is in effect. A sector gets erased only
+ * when the ring wraps onto it, spreading the erase cycles evenly over the
+ * sectors: At one record per 10 minutes, each sector sees an erase every ~5
+ * hours, i.e. ~100,000 erase cycles take over 50 years.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef WEAR_JOURNAL_H_
+#define WEAR_JOURNAL_H_
+
+#include "QSPIFlash.h"
+#include "ValveStats.h"
+#include "constants.h"
+
+#include <Arduino.h>
+
+// Number of flash sectors at the end of the flash holding the journal
+const uint8_t WEAR_JOURNAL_SECTORS = 8;
+
+// Bytes at the end of the flash holding the journal
+const uint32_t WEAR_JOURNAL_SIZE =
+    WEAR_JOURNAL_SECTORS * QSPIFlash::SECTOR_SIZE;
+
+// Interval [ms] between appending records, when the totals have changed
+const uint32_t WEAR_FLUSH_INTERVAL = 10 * 60 * 1000;
+
+/*------------------------------------------------------------------------------
+  WearJournal
+------------------------------------------------------------------------------*/
+
+class WearJournal {
+public:
+  /**
+   * @brief Read in the record in effect from flash. An unformatted journal
+   * results in all totals being zero. The flash must have been set up
+   * already, see `QSPIFlash::begin()`.
+   *
+   * @return True when the flash is available. False otherwise.
+   */
+  bool begin(QSPIFlash *flash);
+
+  inline bool available() { return _available; }
+
+  /**
+   * @brief Collect the increments of @p stats and append a record to flash
+   * when `WEAR_FLUSH_INTERVAL` has passed. Call from within the main loop.
+   * Erasing a sector blocks for ~50 ms, once every few records.
+   */
+  void update(const ValveStats &stats);
+
+  /**
+   * @brief Collect the increments of @p stats and append a record to flash
+   * right away, when the totals have changed.
+   *
+   * @return True when successful. False otherwise.
+   */
+  bool flush(const ValveStats &stats);
+
+  /**
+   * @brief Zero the totals of valve number @p valve, e.g. after replacing its
+   * solenoid, or of all valves when 0. Takes effect in flash on the next
+   * flush.
+   */
+  void clear(const ValveStats &stats, uint8_t valve);
+
+  /**
+   * @brief Print the lifetime totals, including the increments not flushed
+   * yet. The first line holds, tab delimited: The number of valves and the
+   * sequence number of the record in effect. Then follows a line per valve,
+   * tab delimited:
+   *   1) Valve number
+   *   2) Switch count
+   *   3) Total open time [s]
+   */
+  void print(Stream &mySerial, const ValveStats &stats);
+
+private:
+  struct Record {
+    uint32_t magic;
+    uint32_t seq;                   // Sequence number, incremented per record
+    uint32_t N_switches[N_VALVES];  // Lifetime switch count per valve
+    uint32_t open_s[N_VALVES];      // Lifetime open time per valve [s]
+    uint32_t crc;                   // CRC32 of all of the above
+  };
+
+  // Records get stored in fixed slots, never straddling a sector boundary
+  static const uint16_t SLOT_SIZE = 1024;
+  static const uint8_t SLOTS_PER_SECTOR = QSPIFlash::SECTOR_SIZE / SLOT_SIZE;
+  static const uint8_t N_SLOTS = WEAR_JOURNAL_SECTORS * SLOTS_PER_SECTOR;
+
+  static_assert(sizeof(Record) <= SLOT_SIZE,
+                "Wear journal record must fit inside a slot");
+
+  QSPIFlash *_flash = nullptr;
+  bool _available = false;
+  uint32_t _start = 0;    // Flash address of the journal
+  uint8_t _next_slot = 0; // Slot to append the next record to
+  Record _rec;            // Totals, including the increments not flushed yet
+  bool _dirty = false;    // Do the totals differ from the record in flash?
+  uint32_t _tick_flush = 0; // Time [ms] of the last flush
+
+  // Lifetime values of `ValveStats` at the last collection, per valve
+  uint32_t _seen_switches[N_VALVES] = {};
+  uint32_t _seen_open_ms[N_VALVES] = {};
+  uint16_t _open_ms_rem[N_VALVES] = {}; // Open time [ms] short of a second
+
+  /**
+   * @brief Add the increments of @p stats since the last collection to the
+   * totals.
+   */
+  void collect(const ValveStats &stats);
+};
+
+#endif
@@ -2,7 +2,7 @@
  * @file    constants.h
  * @author  Dennis van Gils (vangils.dennis@gmail.com)
  * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
- * @date    23-03-2023
+ * @date    15-10-2026
  *
  * @brief   Constants of the TWT jetting grid.
  *
@@ -13,6 +13,7 @@
 #define CONSTANTS_H_
 
 #include "MIKROE_4_20mA_RT_Click.h"
+#include <type_traits>
 
 /*------------------------------------------------------------------------------
   PURPOSE
@@ -75,14 +76,85 @@
 
 ------------------------------------------------------------------------------*/
 
-const int8_t PCS_X_MIN = -7; // Minimum x-axis coordinate of the PCS
-const int8_t PCS_X_MAX = 7;  // Maximum x-axis coordinate of the PCS
-const int8_t PCS_Y_MIN = -7; // Minimum y-axis coordinate of the PCS
-const int8_t PCS_Y_MAX = 7;  // Maximum y-axis coordinate of the PCS
-const uint8_t NUMEL_PCS_AXIS = PCS_X_MAX - PCS_X_MIN + 1;
-const uint8_t NUMEL_LED_AXIS = 16; // 16x16 matrix
-const uint8_t N_VALVES = 112;      // From 1 to 112, not counting 0
-                                   // == floor(NUMEL_PCS_AXIS**2 / 2)
+/*------------------------------------------------------------------------------
+  Grid geometry
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Return the number of bits needed to index @p N elements.
+ */
+constexpr uint8_t bits_for(uint32_t N) {
+  uint8_t bits = 0;
+  while ((1UL << bits) < N) {
+    bits++;
+  }
+  return bits;
+}
+
+/**
+ * @brief The smallest unsigned integer type holding at least @p BITS bits.
+ */
+template <uint8_t BITS>
+using uint_least_bits_t = typename std::conditional<
+    (BITS <= 8), uint8_t,
+    typename std::conditional<
+        (BITS <= 16), uint16_t,
+        typename std::conditional<(BITS <= 32), uint32_t,
+                                  uint64_t>::type>::type>::type;
+
+/**
+ * @brief Compile-time descriptor of the geometry of a jetting grid, from which
+ * all array dimensions, look-up tables and packed integer widths derive.
+ *
+ * The PCS spans (-`HALF_SPAN`, -`HALF_SPAN`) to (`HALF_SPAN`, `HALF_SPAN`) with
+ * a valve at every other point, and the valves get driven by `N_CP_BOARDS`
+ * Centipede boards of 4 ports each.
+ *
+ * @tparam HALF_SPAN Largest PCS coordinate, i.e. 7 for a 15x15 grid
+ * @tparam N_CP_BOARDS Number of Centipede boards
+ */
+template <int8_t HALF_SPAN, uint8_t N_CP_BOARDS> struct GridGeometry {
+  static constexpr int8_t PCS_MIN = -HALF_SPAN;
+  static constexpr int8_t PCS_MAX = HALF_SPAN;
+  static constexpr uint8_t NUMEL_PCS_AXIS = 2 * HALF_SPAN + 1;
+
+  // Every other PCS point holds a valve, i.e. floor(NUMEL_PCS_AXIS**2 / 2)
+  static constexpr uint16_t N_VALVES = NUMEL_PCS_AXIS * NUMEL_PCS_AXIS / 2;
+  static constexpr uint8_t N_CP_PORTS = 4 * N_CP_BOARDS;
+
+  // Bits per coordinate of a packed PCS point, see `P::pack_into_byte()`
+  static constexpr uint8_t P_BITS = bits_for(NUMEL_PCS_AXIS);
+  static constexpr uint16_t N_PACKED_P = 1U << (2 * P_BITS);
+
+  using row_t = uint_least_bits_t<NUMEL_PCS_AXIS>; // PCS row bitmask
+  using packed_p_t = uint_least_bits_t<2 * P_BITS>; // Packed PCS point
+  using valve_t = uint_least_bits_t<bits_for(N_VALVES + 1)>; // Valve number
+
+  // The MCP23017 chips on a single I2C bus take 3 address bits
+  static_assert(N_CP_PORTS <= 8, "A Centipede bus addresses at most 8 ports");
+  static_assert(N_VALVES <= 16 * N_CP_PORTS,
+                "Not enough Centipede channels for all valves");
+};
+
+/**
+ * @brief The geometry of the jetting grid this firmware gets built for: A 15x15
+ * PCS with 112 valves, driven by 2 Centipede boards.
+ */
+using Grid = GridGeometry<7, 2>;
+
+const int8_t PCS_X_MIN = Grid::PCS_MIN; // Minimum x-axis coordinate of the PCS
+const int8_t PCS_X_MAX = Grid::PCS_MAX; // Maximum x-axis coordinate of the PCS
+const int8_t PCS_Y_MIN = Grid::PCS_MIN; // Minimum y-axis coordinate of the PCS
+const int8_t PCS_Y_MAX = Grid::PCS_MAX; // Maximum y-axis coordinate of the PCS
+const uint8_t NUMEL_PCS_AXIS = Grid::NUMEL_PCS_AXIS;
+const uint8_t NUMEL_LED_AXIS = 16;       // 16x16 matrix
+const uint8_t N_VALVES = Grid::N_VALVES; // From 1 to 112, not counting 0
+const uint8_t N_MANIFOLDS = 4; // Valves 1-28, 29-56, 57-84 and 85-112
+
+static_assert(NUMEL_PCS_AXIS < NUMEL_LED_AXIS,
+              "The PCS must fit inside of the LED matrix");
+static_assert(N_VALVES == Grid::N_VALVES,
+              "Widen the valve number type for this grid geometry");
 
 // clang-format off
 
@@ -90,7 +162,7 @@ const uint8_t N_VALVES = 112;      // From 1 to 112, not counting 0
 //   [dim 1]: y-coordinate [0: y =  7, 14: y = -7]
 //   [dim 2]: x-coordinate [0: x = -7, 14: x =  7]
 //   Returns: The valve numbered 1 to 112, with 0 indicating 'no valve'
-const uint8_t P2VALVE[NUMEL_PCS_AXIS][NUMEL_PCS_AXIS] = {
+constexpr Grid::valve_t P2VALVE[NUMEL_PCS_AXIS][NUMEL_PCS_AXIS] = {
   // -7   -6   -5   -4   -3   -2   -1    0    1    2    3    4    5    6    7
   {   0,   1,   0,   5,   0,   9,   0,  13,   0,  17,   0,  21,   0,  25,   0 }, //  7
   { 109,   0, 110,   0, 111,   0, 112,   0,  32,   0,  31,   0,  30,   0,  29 }, //  6
@@ -114,7 +186,7 @@ const uint8_t P2VALVE[NUMEL_PCS_AXIS][NUMEL_PCS_AXIS] = {
 //   [dim 1]: y-coordinate [0: y =  7, 14: y = -8]
 //   [dim 2]: x-coordinate [0: x = -8, 15: x =  7]
 //   Returns: The LED index 0 to 255
-const uint8_t P2LED[NUMEL_LED_AXIS][NUMEL_LED_AXIS] = {
+constexpr uint8_t P2LED[NUMEL_LED_AXIS][NUMEL_LED_AXIS] = {
   // -8   -7   -6   -5   -4   -3   -2   -1    0    1    2    3    4    5    6    7
   { 240, 239, 208, 207, 176, 175, 144, 143, 112, 111,  80,  79,  48,  47,  16,  15 }, //  7
   { 241, 238, 209, 206, 177, 174, 145, 142, 113, 110,  81,  78,  49,  46,  17,  14 }, //  6
@@ -210,7 +282,7 @@ const uint8_t P2LED[NUMEL_LED_AXIS][NUMEL_LED_AXIS] = {
 // This array must reflect the physical wiring inside the electronics cabinet.
 //   [dim 1]: The valve number - 1, so from 0 to 111
 //   Returns: The Centipede port index
-const uint8_t VALVE2CP_PORT[N_VALVES] = {
+constexpr uint8_t VALVE2CP_PORT[N_VALVES] = {
   //  1    2    3    4    5    6    7    8    9   10   11   12   13   14
       0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
   // 15   16   17   18   19   20   21   22   23   24   25   26   27   28
@@ -233,7 +305,7 @@ const uint8_t VALVE2CP_PORT[N_VALVES] = {
 // This array must reflect the physical wiring inside the electronics cabinet.
 //   [dim 1]: The valve number - 1, so from 0 to 111
 //   Returns: The Centipede bitmask bit index
-const uint8_t VALVE2CP_BIT[N_VALVES] = {
+constexpr uint8_t VALVE2CP_BIT[N_VALVES] = {
   //  1    2    3    4    5    6    7    8    9   10   11   12   13   14
       0,   1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,  13,
   // 15   16   17   18   19   20   21   22   23   24   25   26   27   28
@@ -254,6 +326,75 @@ const uint8_t VALVE2CP_BIT[N_VALVES] = {
 
 // clang-format on
 
+// Centipede channel holding the per-line marker of the protocol lines, see
+// `PackedLine::is_marked()`. It must be one of the channels not connected to a
+// valve and it never gets written to the Centipede.
+const uint8_t LINE_MARKER_CP_PORT = 0;
+const uint8_t LINE_MARKER_CP_BIT = 15;
+
+/**
+ * @brief Is the Centipede channel at @p port and @p bit wired to a valve?
+ */
+constexpr bool cp_channel_has_valve(uint8_t port, uint8_t bit) {
+  for (uint8_t idx = 0; idx < N_VALVES; ++idx) {
+    if ((VALVE2CP_PORT[idx] == port) && (VALVE2CP_BIT[idx] == bit)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static_assert(!cp_channel_has_valve(LINE_MARKER_CP_PORT, LINE_MARKER_CP_BIT),
+              "The line marker must not share its channel with a valve");
+
+/*------------------------------------------------------------------------------
+  Centipede I2C buses
+------------------------------------------------------------------------------*/
+
+// Place the second Centipede board, i.e. ports 4 to 7, on its own I2C bus
+// instead of sharing `Wire` with the first board. Both halves of a port update
+// then get written concurrently, roughly halving the update latency and the
+// skew between manifolds 1-2 and 3-4. Requires the second board to be wired to
+// SERCOM4 on the pins below.
+const bool CP_SPLIT_BUS = false;
+const uint8_t PIN_CP2_SDA = 16; // A2, SERCOM4 PAD[0]
+const uint8_t PIN_CP2_SCL = 17; // A3, SERCOM4 PAD[1]
+
+// I2C clock rates [Hz] to step through in ascending order when calibrating the
+// buses, see `CentipedeManager::calibrate_clock()`. The MCP23017 is rated up
+// to 1.7 MHz, the SAMD51 up to 3.4 MHz.
+const uint32_t CP_CLOCK_STEPS[] = {100000,  400000,  1000000,
+                                   1200000, 1400000, 1700000};
+
+// I2C clock rate [Hz] when not calibrated or when the calibration fails
+const uint32_t CP_CLOCK_DEFAULT = 1000000;
+
+// Calibrate the I2C clock at boot? Cable runs differ between the tunnel
+// configurations, and so does the fastest reliable rate.
+const bool CP_CALIBRATE_AT_BOOT = true;
+
+/*------------------------------------------------------------------------------
+  Output SPI bus, see `OUTPUT_BACKEND` in `OutputBackend.h`
+------------------------------------------------------------------------------*/
+
+// The SPI output backends replace the Centipede boards and take over their
+// I2C pins and SERCOM2: MOSI on SDA (PA12, SERCOM2 PAD[0]), SCK on SCL (PA13,
+// PAD[1]) and MISO on D4 (PA14, PAD[2]). MISO only serves reading back the
+// MCP23S17 chips. D4 is the only other SERCOM2 pad broken out on the Feather
+// M4, hence the driver enable of the RS485 transceiver sits elsewhere, see
+// `PIN_RS485_DE`.
+const uint8_t PIN_OUT_MISO = 4;
+
+// Chip select shared by all MCP23S17 chips, or latch clock (RCLK) of the
+// 74HC595 chain. A0 (PA02), as pin 12 carries the safety pulses.
+const uint8_t PIN_OUT_CS = 14;
+
+// SPI clock [Hz] of the MCP23S17 chips, rated up to 10 MHz
+const uint32_t OUT_MCP23S17_SPI_CLOCK = 10000000;
+
+// SPI clock [Hz] of the 74HC595 chain, leaving margin for the cable run
+const uint32_t OUT_SHIFT_SPI_CLOCK = 12000000;
+
 /*------------------------------------------------------------------------------
   LED matrix, 16x16 WS2812 RGB NeoPixel (Adafruit #2547)
 ------------------------------------------------------------------------------*/
@@ -261,6 +402,11 @@ const uint8_t VALVE2CP_BIT[N_VALVES] = {
 const uint16_t N_LEDS = NUMEL_LED_AXIS * NUMEL_LED_AXIS;
 const uint8_t PIN_LED_MATRIX = 11;
 
+// Refresh period [ms] of the alive blinker by itself on the LED matrix, while
+// running and otherwise. Defaults, see `TuningStore`.
+const uint16_t LED_IDLE_PERIOD_RUNNING = 100;
+const uint16_t LED_IDLE_PERIOD_DEFAULT = 40;
+
 /*------------------------------------------------------------------------------
   MIKROE 4-20 mA R click boards for reading out the OMEGA pressure sensors
 ------------------------------------------------------------------------------*/
@@ -280,9 +426,14 @@ const RT_Click_Calibration R_CLICK_4_CALIB{3.98, 19.83, 828, 3981};
 // Single R click readings fluctuate a lot and so we will employ an exponential
 // moving average by using oversampling and subsequent low-pass filtering as
 // data-acquisition (DAQ) routine.
+// Defaults, see `TuningStore`.
 const uint32_t DAQ_DT = 10000; // Desired oversampling interval [µs]
 const float DAQ_LP = 2.;       // Low-pass filter cut-off frequency [Hz]
 
+// SPI clock during a burst capture of the raw readings, see `RClickDAQ`. It is
+// the maximum clock of the MCP3201 ADC at VDD = 5 V.
+const uint32_t R_CLICK_BURST_SPI_CLOCK = 1600000; // [Hz]
+
 /*------------------------------------------------------------------------------
   OMEGA pressure sensors, type PXM309-007GI
 ------------------------------------------------------------------------------*/
@@ -332,14 +483,76 @@ As long as the safety MCU receives pulses within the set time period, the
 */
 
 const uint8_t PIN_SAFETY_PULSE_OUT = 12;
-const uint16_t PERIOD_SAFETY_PULSES = 60; // [ms]
+const uint16_t PERIOD_SAFETY_PULSES = 60; // [ms], default, see `TuningStore`
+
+// The pulses get generated in hardware, see `SafetyPulser`. They stop when the
+// main loop fails to allow them within this time period [ms].
+const uint16_t SAFETY_ALLOW_DEADLINE = 500;
+
+// Encoded heartbeat: Each pulse period carries a single symbol, encoded in the
+// time [ms] that the pulse stays high. Must match the safety MCU firmware. A
+// plain square wave of 50% duty cycle purposefully decodes as invalid.
+const uint8_t SAFETY_SYMBOL_0 = 10;     // Frame bit 0
+const uint8_t SAFETY_SYMBOL_1 = 20;     // Frame bit 1
+const uint8_t SAFETY_SYMBOL_START = 40; // Start of a frame
+const uint8_t SAFETY_SYMBOL_STOP = 50;  // End of the pulse train, relay off
+
+// Width [µs] of the pulse sent by `SafetyPulser::trip()`. Being shorter than
+// any valid symbol, the safety MCU drops the relay on it straight away instead
+// of waiting for its timeout.
+const uint16_t SAFETY_TRIP_PULSE_US = 1000;
+
+/*------------------------------------------------------------------------------
+  Trigger input, sync output and capture input
+------------------------------------------------------------------------------*/
+
+// A rising edge on the trigger input starts the playback of the protocol
+// program once armed by command `trigger`, with a deterministic latency instead
+// of the USB latency jitter of command `play`. The sync output toggles each
+// time the valves have been switched, as an electrical marker of the line
+// transitions for e.g. PIV and LDA systems. Or it pulses on the marked lines
+// only, see command `sync_marked`.
+const uint8_t PIN_TRIGGER_IN = 18; // A4
+const uint8_t PIN_SYNC_OUT = 19;   // A5
+
+// The edges on the capture input get time stamped in hardware, to verify the
+// valve timing against a marker output wired back into it, see
+// `TimingHarness`.
+const uint8_t PIN_CAPTURE_IN = 15; // A1
+
+/*------------------------------------------------------------------------------
+  Pump controller over Modbus RTU
+------------------------------------------------------------------------------*/
+
+// The Xylem Hydrovar HVL pump controller gets talked to over Modbus RTU via an
+// RS485 transceiver on `Serial1`, i.e. pins RX (0) and TX (1), see
+// `HydrovarPump`. The settings must match those of the pump controller: P1205
+// for the slave address and P1210 for the baud rate, 8N1. The driver enable
+// (and inverted receiver enable) sits on D13 (PA23), shared with the red
+// onboard LED, which hence lights up while transmitting.
+const uint8_t PIN_RS485_DE = 13;
+const uint32_t PUMP_BAUDRATE = 115200;
+const uint8_t PUMP_SLAVE_ADDRESS = 1;
+
+// Software-limited maximum pressure setpoint [mbar] of the pump
+const int16_t PUMP_MAX_PRESSURE_MBAR = 3000;
+
+// The output SPI bus, the safety pulses and the RS485 transceiver must each
+// own their pins, regardless of `OUTPUT_BACKEND`
+static_assert(PIN_OUT_MISO != PIN_OUT_CS &&
+                  PIN_OUT_MISO != PIN_SAFETY_PULSE_OUT &&
+                  PIN_OUT_MISO != PIN_RS485_DE &&
+                  PIN_OUT_CS != PIN_SAFETY_PULSE_OUT &&
+                  PIN_OUT_CS != PIN_RS485_DE &&
+                  PIN_SAFETY_PULSE_OUT != PIN_RS485_DE,
+              "Pin assigned twice");
 
 /*------------------------------------------------------------------------------
   Watchdog
 ------------------------------------------------------------------------------*/
 
 // The microcontroller will auto-reboot when it fails to get a
-// `Watchdog.reset()` within this time period [ms]
+// `Watchdog.reset()` within this time period [ms]. Default, see `TuningStore`.
 const uint16_t WATCHDOG_TIMEOUT = 8000;
 
 #endif
\ No newline at end of file
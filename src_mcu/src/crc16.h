@@ -0,0 +1,27 @@
+/**
+ * @file    crc16.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   CRC16 checksum of the Modbus RTU frames, matching `crc16()` of
+ * `CRC_tools.py`. Guards the messages to and from the pump, see
+ * `ModbusMaster`.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef CRC16_H_
+#define CRC16_H_
+
+#include <Arduino.h>
+
+/**
+ * @brief Compute the Modbus CRC16 checksum of @p len bytes of @p data. It
+ * gets sent low byte first.
+ *
+ * Can be computed in chunks by passing the previous result as @p crc.
+ */
+uint16_t crc16_modbus(const void *data, uint16_t len, uint16_t crc = 0xFFFF);
+
+#endif
@@ -0,0 +1,253 @@
+/**
+ * @file    crc32.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "crc32.h"
+
+/**
+ * @brief Compute the CRC32 checksum in software, see `crc32()`.
+ */
+static uint32_t crc32_sw(const void *data, uint32_t len, uint32_t crc) {
+  // Nibble-wise look-up table of the reflected polynomial 0xEDB88320
+  static const uint32_t CRC_TABLE[16] = {
+      0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4,
+      0x4DB26158, 0x5005713C, 0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+      0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+
+  const uint8_t *p = (const uint8_t *)data;
+  crc = ~crc;
+  while (len--) {
+    crc ^= *p++;
+    crc = (crc >> 4) ^ CRC_TABLE[crc & 0x0F];
+    crc = (crc >> 4) ^ CRC_TABLE[crc & 0x0F];
+  }
+  return ~crc;
+}
+
+// Checksum started by `crc32_start()`, once complete
+static uint32_t job_result = 0;
+
+/*------------------------------------------------------------------------------
+  Hardware engine
+------------------------------------------------------------------------------*/
+
+#if defined(__SAMD51__)
+
+#  include "Adafruit_ZeroDMA.h"
+
+// Largest block of a single DMA transfer [bytes]
+const uint32_t CRC_DMA_MAX_LEN = 65535;
+
+/**
+ * @brief The datasheet leaves the bit order and the complement of the CRC32
+ * checksum register open to interpretation. `crc32_begin()` picks the
+ * transform that matches the software, applied both ways as each one is its
+ * own inverse.
+ */
+enum CRCTransform : uint8_t {
+  XFORM_NONE,
+  XFORM_NOT,
+  XFORM_RBIT,
+  XFORM_NOT_RBIT
+};
+
+static Adafruit_ZeroDMA crc_dma;
+static DmacDescriptor *crc_desc = nullptr;
+static volatile uint8_t crc_sink; // Dummy destination of the DMA
+static volatile bool crc_dma_done = true;
+static volatile bool hw_in_use = false; // Taken by a checksum?
+static bool hw_ok = false;
+static CRCTransform xform = XFORM_NONE;
+
+// Background checksum started by `crc32_start()`
+static bool job_busy = false;  // Ongoing on the engine?
+static const uint8_t *job_ptr; // Next byte to hand to the DMA
+static uint32_t job_left = 0;  // Bytes not yet handed to the DMA
+
+static void dma_callback(Adafruit_ZeroDMA *dma) {
+  (void)dma;
+  crc_dma_done = true;
+}
+
+static uint32_t transform(uint32_t x) {
+  switch (xform) {
+    case XFORM_NOT:
+      return ~x;
+    case XFORM_RBIT:
+      return __RBIT(x);
+    case XFORM_NOT_RBIT:
+      return ~__RBIT(x);
+    default:
+      return x;
+  }
+}
+
+/**
+ * @brief Seed the engine with @p crc and let it snoop on our DMA channel.
+ */
+static void engine_on(uint32_t crc) {
+  DMAC->CRCCTRL.reg = 0;
+  DMAC->CRCCHKSUM.reg = transform(crc);
+  DMAC->CRCCTRL.reg = DMAC_CRCCTRL_CRCBEATSIZE_BYTE |
+                      DMAC_CRCCTRL_CRCPOLY_CRC32 |
+                      DMAC_CRCCTRL_CRCSRC(0x20 + crc_dma.getChannel());
+}
+
+/**
+ * @brief Release the engine.
+ *
+ * @return The checksum over all bytes since `engine_on()`
+ */
+static uint32_t engine_off() {
+  uint32_t crc = transform(DMAC->CRCCHKSUM.reg);
+  DMAC->CRCSTATUS.reg = DMAC_CRCSTATUS_CRCBUSY;
+  DMAC->CRCCTRL.reg = 0;
+  return crc;
+}
+
+/**
+ * @brief Stream @p len bytes, at most `CRC_DMA_MAX_LEN`, past the engine.
+ *
+ * @return True when started. False otherwise.
+ */
+static bool start_block(const uint8_t *data, uint32_t len) {
+  crc_dma.changeDescriptor(crc_desc, (void *)data, (void *)&crc_sink, len);
+  crc_dma_done = false;
+  if (crc_dma.startJob() != DMA_STATUS_OK) {
+    crc_dma_done = true;
+    return false;
+  }
+  crc_dma.trigger();
+  return true;
+}
+
+/**
+ * @brief Compute the checksum on the engine, blocking. Whatever the DMA
+ * refuses gets finished in software.
+ */
+static uint32_t crc32_hw(const uint8_t *data, uint32_t len, uint32_t crc) {
+  engine_on(crc);
+  while (len > 0) {
+    uint32_t N = min(len, CRC_DMA_MAX_LEN);
+    if (!start_block(data, N)) {
+      break;
+    }
+    while (!crc_dma_done) {}
+    data += N;
+    len -= N;
+  }
+  crc = engine_off();
+  return len ? crc32_sw(data, len, crc) : crc;
+}
+
+bool crc32_begin() {
+  hw_ok = false;
+  if (crc_desc == nullptr) {
+    if (crc_dma.allocate() != DMA_STATUS_OK) {
+      return false;
+    }
+    crc_desc = crc_dma.addDescriptor((void *)&crc_sink, (void *)&crc_sink,
+                                     1, DMA_BEAT_SIZE_BYTE, true, false);
+    crc_dma.setCallback(dma_callback);
+  }
+
+  // The check value of CRC32, also once computed in two chunks to verify the
+  // seeding
+  static const char CHECK[] = "123456789";
+  const uint32_t CHECK_CRC = 0xCBF43926;
+  uint8_t check[9];
+  memcpy(check, CHECK, sizeof(check));
+  for (uint8_t idx = XFORM_NONE; idx <= XFORM_NOT_RBIT; ++idx) {
+    xform = (CRCTransform)idx;
+    if ((crc32_hw(check, 9, 0) == CHECK_CRC) &&
+        (crc32_hw(check + 4, 5, crc32_hw(check, 4, 0)) == CHECK_CRC)) {
+      hw_ok = true;
+      break;
+    }
+  }
+  return hw_ok;
+}
+
+bool crc32_hw_available() { return hw_ok; }
+
+uint32_t crc32(const void *data, uint32_t len, uint32_t crc) {
+  if (!hw_ok || (len < CRC32_HW_MIN_LEN) || hw_in_use) {
+    return crc32_sw(data, len, crc);
+  }
+  hw_in_use = true;
+  crc = crc32_hw((const uint8_t *)data, len, crc);
+  hw_in_use = false;
+  return crc;
+}
+
+bool crc32_start(const void *data, uint32_t len, uint32_t crc) {
+  if (crc32_is_busy()) {
+    return false;
+  }
+  if (!hw_ok || (len < CRC32_HW_MIN_LEN) || hw_in_use) {
+    job_result = crc32_sw(data, len, crc);
+    return true;
+  }
+  hw_in_use = true;
+  job_busy = true;
+  job_ptr = (const uint8_t *)data;
+  job_left = len;
+  engine_on(crc);
+  return crc32_is_busy();
+}
+
+bool crc32_is_busy() {
+  if (!job_busy) {
+    return false;
+  }
+  if (!crc_dma_done) {
+    return true;
+  }
+
+  // Continue with the next block, as long as the DMA accepts it
+  if (job_left > 0) {
+    uint32_t N = min(job_left, CRC_DMA_MAX_LEN);
+    if (start_block(job_ptr, N)) {
+      job_ptr += N;
+      job_left -= N;
+      return true;
+    }
+  }
+
+  job_result = engine_off();
+  if (job_left > 0) {
+    job_result = crc32_sw(job_ptr, job_left, job_result);
+    job_left = 0;
+  }
+  job_busy = false;
+  hw_in_use = false;
+  return false;
+}
+
+#else
+
+bool crc32_begin() { return false; }
+
+bool crc32_hw_available() { return false; }
+
+uint32_t crc32(const void *data, uint32_t len, uint32_t crc) {
+  return crc32_sw(data, len, crc);
+}
+
+bool crc32_start(const void *data, uint32_t len, uint32_t crc) {
+  job_result = crc32_sw(data, len, crc);
+  return true;
+}
+
+bool crc32_is_busy() { return false; }
+
+#endif
+
+uint32_t crc32_result() {
+  while (crc32_is_busy()) {}
+  return job_result;
+}
@@ -0,0 +1,70 @@
+/**
+ * @file    crc32.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   CRC32 checksum, matching `zlib.crc32()` of Python. Guards the
+ * protocol library in flash, the bulk upload and the uploaded scripts, and
+ * hashes the protocol program for the patch upload.
+ *
+ * On the SAMD51 the CRC engine of the DMA controller takes over the larger
+ * buffers, see `crc32_begin()`: A DMA channel streams the data past it into
+ * a dummy destination. A checksum can thereby also run in the background, see
+ * `crc32_start()`, leaving the CPU free. Elsewhere, or when the engine fails
+ * its self-test, a nibble-wise look-up table does the work.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef CRC32_H_
+#define CRC32_H_
+
+#include <Arduino.h>
+
+// Buffers shorter than this [bytes] are not worth setting up the DMA for
+const uint32_t CRC32_HW_MIN_LEN = 128;
+
+/**
+ * @brief Set up the CRC engine of the DMA controller and check it against
+ * the software implementation. Without, everything runs in software.
+ *
+ * @return True when the hardware engine is in use. False otherwise.
+ */
+bool crc32_begin();
+
+/**
+ * @brief Is the hardware engine in use, see `crc32_begin()`?
+ */
+bool crc32_hw_available();
+
+/**
+ * @brief Compute the CRC32 checksum (IEEE 802.3) of @p len bytes of @p data.
+ * Blocks until done, also when handed to the hardware engine.
+ *
+ * Can be computed in chunks by passing the previous result as @p crc.
+ */
+uint32_t crc32(const void *data, uint32_t len, uint32_t crc = 0);
+
+/**
+ * @brief Start computing the CRC32 checksum of @p len bytes of @p data in the
+ * background, see `crc32()`. @p data must stay untouched meanwhile. Without
+ * the hardware engine it gets computed right away.
+ *
+ * @return True when started. False when a previous one is still ongoing,
+ * see `crc32_is_busy()`. Then simply try again later.
+ */
+bool crc32_start(const void *data, uint32_t len, uint32_t crc = 0);
+
+/**
+ * @brief Is the checksum started by `crc32_start()` still ongoing?
+ */
+bool crc32_is_busy();
+
+/**
+ * @brief Return the checksum started by `crc32_start()`, waiting for it to
+ * complete when still ongoing.
+ */
+uint32_t crc32_result();
+
+#endif
@@ -0,0 +1,78 @@
+/**
+ * @file    embedded_protocols.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "embedded_protocols.h"
+#include "TxQueue.h"
+#include "translations.h"
+
+/*------------------------------------------------------------------------------
+  Images, generated by `tools/embed_protocols.py`
+------------------------------------------------------------------------------*/
+
+// Without the pre-build script, e.g. on the host PC, nothing gets embedded
+#if __has_include("embedded_protocols.inc")
+#  define HAS_EMBEDDED_PROTOCOLS 1
+#else
+#  define HAS_EMBEDDED_PROTOCOLS 0
+#endif
+
+#if HAS_EMBEDDED_PROTOCOLS
+// The images, 4-byte aligned like the memory of a program slot
+#  define EMBEDDED_PROTOCOL(ident, name, N_lines, format, crc, ...)          \
+    static_assert(format == PROGRAM_IMAGE_FORMAT,                            \
+                  "Embedded protocol " name " got compiled under different " \
+                  "build flags than the firmware");                          \
+    alignas(4) static const uint8_t ident##_image[] = {__VA_ARGS__};
+#  include "embedded_protocols.inc"
+#  undef EMBEDDED_PROTOCOL
+#endif
+
+const EmbeddedProtocol EMBEDDED_PROTOCOLS[] = {
+#if HAS_EMBEDDED_PROTOCOLS
+#  define EMBEDDED_PROTOCOL(ident, name, N_lines, format, crc, ...)          \
+    {name, ident##_image, sizeof(ident##_image), N_lines, crc},
+#  include "embedded_protocols.inc"
+#  undef EMBEDDED_PROTOCOL
+#endif
+    {nullptr, nullptr, 0, 0, 0}, // Sentinel, keeping the array non-empty
+};
+
+const uint8_t N_EMBEDDED_PROTOCOLS =
+    sizeof(EMBEDDED_PROTOCOLS) / sizeof(EMBEDDED_PROTOCOLS[0]) - 1;
+
+/*------------------------------------------------------------------------------
+  Loading
+------------------------------------------------------------------------------*/
+
+bool load_embedded_protocol(const char *name, ProtocolManager &protocol_mgr) {
+  for (uint8_t idx = 0; idx < N_EMBEDDED_PROTOCOLS; ++idx) {
+    const EmbeddedProtocol &proto = EMBEDDED_PROTOCOLS[idx];
+    if (strcmp(proto.name, name) != 0) {
+      continue;
+    }
+    if (!protocol_mgr.attach_program(proto.name, proto.image, proto.N_lines,
+                                     proto.N_bytes)) {
+      tx.println("ERROR: Embedded protocol program is corrupt.");
+      return false;
+    }
+    return true;
+  }
+
+  tx.println("ERROR: Embedded protocol program not found.");
+  return false;
+}
+
+void print_embedded_protocols(Stream &mySerial) {
+  mySerial.println(N_EMBEDDED_PROTOCOLS);
+  for (uint8_t idx = 0; idx < N_EMBEDDED_PROTOCOLS; ++idx) {
+    const EmbeddedProtocol &proto = EMBEDDED_PROTOCOLS[idx];
+    snprintf(buf, BUF_LEN, "%s\t%u\t%lu\t%08lx", proto.name, proto.N_lines,
+             (unsigned long)proto.N_bytes, (unsigned long)proto.crc);
+    mySerial.println(buf);
+  }
+}
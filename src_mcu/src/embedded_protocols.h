@@ -0,0 +1,67 @@
+/**
+ * @file    embedded_protocols.h
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Standard protocol programs compiled into the firmware, living in
+ * the internal flash of the microcontroller.
+ *
+ * Each embedded protocol is the raw program image, see `Program::image()`, of
+ * a `.proto` file as compiled by `proto_compile -e`. Loading one attaches the
+ * image to the active program slot in place, see `Program::attach()`, and
+ * plays it from flash. Hence, it starts without any upload or copy and takes
+ * up no RAM, leaving the memory of the program slot untouched. The image is
+ * read-only, so any edit starts from a cleared program.
+ *
+ * The `.proto` files to embed are listed under `custom_embed_protocols` in
+ * `platformio.ini`. The pre-build script `tools/embed_protocols.py` compiles
+ * them into `embedded_protocols.inc` in the build folder, one
+ * `EMBEDDED_PROTOCOL(...)` entry per protocol. An image compiled under other
+ * build flags than the firmware, see `PROGRAM_IMAGE_FORMAT`, fails the build.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#ifndef EMBEDDED_PROTOCOLS_H_
+#define EMBEDDED_PROTOCOLS_H_
+
+#include "ProtocolManager.h"
+
+#include <Arduino.h>
+
+/**
+ * @brief A protocol program embedded in internal flash.
+ */
+struct EmbeddedProtocol {
+  const char *name;     // Name of the protocol program, i.e. its file name
+  const uint8_t *image; // Raw program image, see `Program::image()`
+  uint32_t N_bytes;     // Size of the image [bytes]
+  uint16_t N_lines;     // Number of lines
+  uint32_t crc;         // CRC32 of the image, as reported by `proto_compile`
+};
+
+extern const EmbeddedProtocol EMBEDDED_PROTOCOLS[];
+extern const uint8_t N_EMBEDDED_PROTOCOLS;
+
+/**
+ * @brief Load the embedded protocol named @p name into @p protocol_mgr, see
+ * `ProtocolManager::attach_program()`.
+ *
+ * Errors are reported over serial.
+ *
+ * @return True when successful. False otherwise.
+ */
+bool load_embedded_protocol(const char *name, ProtocolManager &protocol_mgr);
+
+/**
+ * @brief Print the number of embedded protocols, followed by one protocol per
+ * line, tab delimited:
+ *   1) Protocol name
+ *   2) N_lines
+ *   3) N_bytes
+ *   4) CRC32 of the image
+ */
+void print_embedded_protocols(Stream &mySerial);
+
+#endif
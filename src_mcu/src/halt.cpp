@@ -2,15 +2,35 @@
  * @file    halt.cpp
  * @author  Dennis van Gils (vangils.dennis@gmail.com)
  * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
- * @date    23-03-2023
+ * @date    15-10-2026
  * @copyright MIT License. See the LICENSE file for details.
  */
 
 #include "halt.h"
 #include "Adafruit_SleepyDog.h"
+#include "CentipedeManager.h"
 #include "DvG_StreamCommand.h"
+#include "LoopMonitor.h"
+#include "SafetyPulser.h"
+#include "TxQueue.h"
 
 extern DvG_StreamCommand sc;
+extern SafetyPulser safety_pulser;
+extern CentipedeManager cp_mgr;
+extern LoopMonitor loop_monitor;
+
+uint32_t halt_safe_state() {
+  uint32_t t0 = micros();
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  // Pump first, as it must not run against closed valves
+  safety_pulser.trip();
+  cp_mgr.close_all_now();
+
+  __set_PRIMASK(primask);
+  return micros() - t0;
+}
 
 void halt(uint8_t halt_ID, const char *msg) {
   const uint8_t arr_halt[] = {21,  38,  39,  40,  41,  42,  53,  70,  89,  102,
@@ -24,6 +44,10 @@ void halt(uint8_t halt_ID, const char *msg) {
       63,  64,  65,  94,  95,  96,  97,  126, 127, 128, 129, 158, 159,
       160, 161, 190, 191, 192, 193, 222, 223, 224, 225, 254, 255};
 
+  // Drop the pump relay and close all valves before anything else
+  uint32_t safe_us = halt_safe_state();
+  loop_monitor.record_halt(halt_ID, safe_us);
+
   // Display 'HALT' on LED matrix
   fill_solid(leds, 256, CRGB::Black);                    // Clear all
   for (uint8_t idx = 0; idx < sizeof(arr_bars); idx++) { // Top & bottom bars
@@ -34,6 +58,9 @@ void halt(uint8_t halt_ID, const char *msg) {
   }
   fill_solid(onboard_led, 1, CRGB::Red);
 
+  // Send out any pending output, so that it precedes the halt message
+  tx.flush();
+
   // Shorten Watchdog timeout
   Watchdog.disable();
   Watchdog.enable(1000);
@@ -60,11 +87,15 @@ void halt(uint8_t halt_ID, const char *msg) {
         if (msg != NULL) {
           Serial.println(msg);
         }
+        // Behind the message, as the PC reads the single line following the
+        // header as such
+        Serial.print("Safe state reached in [us]: ");
+        Serial.println(safe_us);
         FastLED.setBrightness(30);
       } else {
         FastLED.setBrightness(5);
       }
-      FastLED.show();
+      show_leds();
     }
   }
 }
\ No newline at end of file
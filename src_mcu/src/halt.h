@@ -2,7 +2,7 @@
  * @file    halt.h
  * @author  Dennis van Gils (vangils.dennis@gmail.com)
  * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
- * @date    25-08-2022
+ * @date    14-10-2026
  *
  * @brief   Gracefully halt the microcontroller of the TWT jetting grid.
  *
@@ -18,11 +18,27 @@
 // See `main.cpp`
 extern CRGB leds[256];
 extern CRGB onboard_led[1];
+extern void show_leds();
+
+/**
+ * @brief Bring the hardware into its safe state in bounded time, regardless of
+ * what the caller was doing: End the safety pulses by `SafetyPulser::trip()`,
+ * such that the pump relay drops, then close all valves by
+ * `CentipedeManager::close_all_now()`. Safe to be called from within an
+ * interrupt.
+ *
+ * @return The time it took [µs]
+ */
+uint32_t halt_safe_state();
 
 /**
  * @brief Halt execution and flash the text 'HALT' on the LED matrix and repeat
  * a given text message over the Serial port in an infinite loop.
  *
+ * The hardware gets brought into its safe state first, see
+ * `halt_safe_state()`, recording the halt ID and the time it took into the
+ * backup RAM, see `LoopMonitor`.
+ *
  * Can be used to gracefully catch an illegal operation, like trying to address
  * an out-of-bounds index of an array. Clearly, this function should never get
  * executed in "properly" working code and when it does, it is a message to the
@@ -2,7 +2,7 @@
  * @file    Main.cpp
  * @author  Dennis van Gils (vangils.dennis@gmail.com)
  * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
- * @date    07-11-2024
+ * @date    15-10-2026
  *
  * @brief   Firmware for the main microcontroller of the TWT Jetting Grid. See
  * `constants.h` for a detailed description.
@@ -19,9 +19,59 @@
  * @copyright MIT License. See the LICENSE file for details.
  */
 
+#include "AnomalyCapture.h"
+#include "BenchBaseline.h"
 #include "CentipedeManager.h"
+#include "CommandRegistry.h"
+#include "DAQRate.h"
+#include "Decimator.h"
+#include "DeltaDecoder.h"
+#include "EdgeCapture.h"
+#include "EMAFilter.h"
+#include "FlashLog.h"
+#include "HydrovarPump.h"
+#include "LEDCompositor.h"
+#include "LEDGovernor.h"
+#include "LEDMatrixDMA.h"
+#include "LEDMatrixPreempt.h"
+#include "LinePressureLog.h"
+#include "LoopMonitor.h"
+#include "MCP23S17Backend.h"
+#include "ManifoldMux.h"
+#include "MarkovGenerator.h"
+#include "MemStats.h"
+#include "MemoryArena.h"
+#include "MorphGenerator.h"
+#include "NoiseGenerator.h"
+#include "Perf.h"
+#include "PeripheralSim.h"
+#include "PhaseAverager.h"
+#include "PlaybackTimer.h"
+#include "Playlist.h"
+#include "PressureController.h"
+#include "PressureScale.h"
+#include "ProtocolLibrary.h"
 #include "ProtocolManager.h"
+#include "ProtocolScript.h"
+#include "QSPIFlash.h"
+#include "RClickDAQ.h"
+#include "SafetyPulser.h"
+#include "SamplingProfiler.h"
+#include "ShiftRegisterBackend.h"
+#include "TaskScheduler.h"
+#include "Telemetry.h"
+#include "TimingHarness.h"
+#include "Trace.h"
+#include "TuningStore.h"
+#include "TxQueue.h"
+#include "UsbBulk.h"
+#include "ValveHealth.h"
+#include "ValvePWM.h"
+#include "WarmStart.h"
+#include "WearJournal.h"
 #include "constants.h"
+#include "crc32.h"
+#include "embedded_protocols.h"
 #include "protocol_presets.h"
 #include "translations.h"
 
@@ -37,6 +87,7 @@
 #include <SPI.h>
 #include <Wire.h>
 #include <array>
+#include <wiring_private.h>
 
 // Serial port listener for receiving ASCII commands
 const uint8_t CMD_BUF_LEN = 64;  // Length of the ASCII command buffer
@@ -44,12 +95,47 @@ char cmd_buf[CMD_BUF_LEN]{'\0'}; // The ASCII command buffer
 char *str_cmd;                   // Incoming serial ASCII-command string
 DvG_StreamCommand sc(Serial, cmd_buf, CMD_BUF_LEN);
 
-// Serial port listener for receiving binary data decoding a protocol program
-const uint8_t BIN_BUF_LEN = 229;          // Length of the binary data buffer
+// Budget for handling the queued ASCII commands per `loop()` iteration, such
+// that a burst of commands can't starve the protocol playback
+const uint8_t CMD_MAX_PER_LOOP = 8;  // Maximum number of commands
+const uint16_t CMD_BUDGET_US = 1000; // Maximum time spent [µs]
+
+// Table of the serial ASCII commands, see `register_commands()`
+CommandRegistry commands;
+
+// Serial port listener for receiving binary data decoding a protocol program.
+// The buffer holds on to several lines of the largest size at once.
+const uint16_t BIN_BUF_LEN = 4 * 229;     // Length of the binary data buffer
 uint8_t bin_buf[BIN_BUF_LEN];             // The binary data buffer
 const uint8_t EOL[] = {0xff, 0xff, 0xff}; // End-of-line sentinel
 DvG_BinaryStreamCommand bsc(Serial, bin_buf, BIN_BUF_LEN, EOL, sizeof(EOL));
 
+// Optional USB vendor interface carrying the bulk uploads and the pushed
+// telemetry instead of the serial port, once the PC asks for it via command
+// `usb_bulk`. See `UsbBulk.h`.
+UsbBulk usb_bulk;
+bool bulk_routed = false; // Is the bulk data routed via the vendor interface?
+#if USB_BULK
+TxQueue usb_tx(usb_bulk.port()); // Transmit queue of the vendor interface
+#endif
+
+/**
+ * @brief Return the port the bulk uploads come in on.
+ */
+Stream &bulk_in() { return bulk_routed ? usb_bulk.port() : Serial; }
+
+/**
+ * @brief Return the transmit queue the telemetry gets pushed onto.
+ */
+TxQueue &bulk_out() {
+#if USB_BULK
+  if (bulk_routed) {
+    return usb_tx;
+  }
+#endif
+  return tx;
+}
+
 // Will be used externally
 const uint8_t BUF_LEN = 128; // Common character buffer for string formatting
 char buf[BUF_LEN]{'\0'};     // Common character buffer for string formatting
@@ -64,9 +150,18 @@ bool safety__allow_jetting_pump_to_run = false;
 // WARNING: Safety override to always allow the jetting pump to run.
 bool override_pump_safety = false;
 
+// Generates the safety pulses in hardware, see `SafetyPulser.h`
+SafetyPulser safety_pulser;
+
+// Talks to the pump controller over Modbus RTU, see `HydrovarPump.h`
+HydrovarPump pump(Serial1, PIN_RS485_DE);
+
+// Regulates the manifold pressure by the pump frequency, see
+// `PressureController.h`
+PressureController pressure_ctrl;
+
 // Debugging flags
 uint32_t utick = micros();         // DEBUG timer
-const bool DEBUG = false;          // Print debug info over serial?
 const bool NO_PERIPHERALS = false; // Allows developing code on a bare Arduino
                                    // without sensors & actuators attached
 
@@ -76,22 +171,23 @@ const bool NO_PERIPHERALS = false; // Allows developing code on a bare Arduino
 
 struct Readings {
   // Exponential moving averages (EMA) of the R Click boards
-  uint32_t DAQ_obtained_DT; // Obtained oversampling interval [µs]
-  float EMA_1;              // Exponential moving average of R Click 1 [bitval]
-  float EMA_2;              // Exponential moving average of R Click 2 [bitval]
-  float EMA_3;              // Exponential moving average of R Click 3 [bitval]
-  float EMA_4;              // Exponential moving average of R Click 4 [bitval]
-
-  // OMEGA pressure sensors
-  float pres_1_mA = NAN;    // OMEGA pressure sensor 1 [mA]
-  float pres_2_mA = NAN;    // OMEGA pressure sensor 2 [mA]
-  float pres_3_mA = NAN;    // OMEGA pressure sensor 3 [mA]
-  float pres_4_mA = NAN;    // OMEGA pressure sensor 4 [mA]
-  float pres_1_bar = NAN;   // OMEGA pressure sensor 1 [bar]
-  float pres_2_bar = NAN;   // OMEGA pressure sensor 2 [bar]
-  float pres_3_bar = NAN;   // OMEGA pressure sensor 3 [bar]
-  float pres_4_bar = NAN;   // OMEGA pressure sensor 4 [bar]
-  float pres_avg_bar = NAN; // Average pressure        [bar]
+  uint32_t DAQ_obtained_DT;          // Obtained oversampling interval [µs]
+  EMAFilter<N_R_CLICKS> EMA;         // EMA of R Clicks 1 to 4 [bitval]
+  uint16_t bitval[N_R_CLICKS] = {}; // Last reading of R Clicks 1 to 4 [bitval]
+
+  // OMEGA pressure sensors 1 to 4, see `PressureScale`. Set to
+  // `PRESSURE_FAULT` when in the fault state or not yet read out.
+  int16_t pres_uA[N_R_CLICKS];   // OMEGA pressure sensors [µA]
+  int16_t pres_mbar[N_R_CLICKS]; // OMEGA pressure sensors [mbar]
+  int16_t pres_avg_mbar;         // Average pressure [mbar]
+
+  Readings() {
+    for (uint8_t ch = 0; ch < N_R_CLICKS; ++ch) {
+      pres_uA[ch] = PRESSURE_FAULT;
+      pres_mbar[ch] = PRESSURE_FAULT;
+    }
+    pres_avg_mbar = PRESSURE_FAULT;
+  }
 };
 Readings readings; // Structure holding the sensor readings and actuator states
 
@@ -102,6 +198,25 @@ Readings readings; // Structure holding the sensor readings and actuator states
 // One object controls both Centipede boards over ports 0 to 7
 CentipedeManager cp_mgr;
 
+// Runtime stand-in for the Centipede boards, R Clicks and LED matrix, see
+// `sim_on`
+PeripheralSim peripheral_sim;
+
+// I2C bus of the second Centipede board, only in use when `CP_SPLIT_BUS`
+TwoWire Wire2(&sercom4, PIN_CP2_SDA, PIN_CP2_SCL);
+
+#if OUTPUT_BACKEND != OUTPUT_MCP23017
+// SPI bus replacing the Centipede boards, see `OUTPUT_BACKEND`
+SPIClass SPI_OUT(&sercom2, PIN_OUT_MISO, PIN_WIRE_SCL, PIN_WIRE_SDA,
+                 SPI_PAD_0_SCK_1, SERCOM_RX_PAD_2);
+#endif
+
+#if OUTPUT_BACKEND == OUTPUT_MCP23S17
+MCP23S17Backend out_backend(&SPI_OUT, PIN_OUT_CS, OUT_MCP23S17_SPI_CLOCK);
+#elif OUTPUT_BACKEND == OUTPUT_SHIFT_REGISTER
+ShiftRegisterBackend out_backend(&SPI_OUT, PIN_OUT_CS, OUT_SHIFT_SPI_CLOCK);
+#endif
+
 /*------------------------------------------------------------------------------
   LEDs
 ------------------------------------------------------------------------------*/
@@ -109,7 +224,90 @@ CentipedeManager cp_mgr;
 uint8_t alive_blinker_hue = HUE_GREEN;
 CRGB onboard_led[1]; // Onboard NeoPixel of the Adafruit Feather M4 board
 CRGB leds[N_LEDS];   // LED matrix, 16x16 RGB NeoPixel (Adafruit #2547)
-uint16_t idx_led;    // Frequently used LED index
+LEDCompositor led_compositor(leds); // Layers flattened into `leds[]`
+
+// Each LED strip has its own FastLED controller that gets refreshed on its own
+// schedule: Sending out the onboard LED takes ~30 µs, whereas sending out the
+// LED matrix via FastLED takes 8 ms. Hence, the onboard LED can follow the
+// alive blinker closely, while the LED matrix only gets refreshed when a layer
+// of `led_compositor` has changed. The alive blinker on the matrix by itself
+// only gets refreshed every `led_idle_ms` or `led_idle_running_ms` of
+// `tuning`, as selected per FSM state.
+CLEDController *onboard_led_ctrl = nullptr;
+// Stays null when driven via DMA or via the preemptible bit-banging
+CLEDController *led_matrix_ctrl = nullptr;
+bool onboard_led_dirty = true; // Has `onboard_led[]` changed since its refresh?
+bool leds_dirty = true;        // Has `leds[]` changed since its refresh?
+bool led_idle_running = false; // Selects the refresh period, see above
+
+// Non-blocking SPI/DMA output of the LED matrix, when available
+LEDMatrixDMA led_matrix_dma;
+bool led_matrix_via_dma = false; // Set in `setup()`
+
+// Interruptible bit-banging of the LED matrix, as fallback to the DMA
+LEDMatrixPreempt led_matrix_preempt;
+bool led_matrix_via_preempt = false; // Set in `setup()`
+
+// Schedules the refreshes of the LED matrix in between the line switches
+LEDGovernor led_governor;
+const uint32_t ONBOARD_LED_COST_US = 50; // Duration [µs] of its refresh
+
+/**
+ * @brief Send out the LED data of only those LED strips that are marked dirty,
+ * see `onboard_led_dirty` and `leds_dirty`.
+ *
+ * When the DMA backend is in use the LED matrix gets streamed out in the
+ * background and this call returns within ~100 µs. Otherwise, the LED matrix
+ * gets bit-banged, taking 8 ms, preemptible by the interrupts in between the
+ * pixels, see `LEDMatrixPreempt`, or else by FastLED. When the previous DMA
+ * frame is still ongoing, the new frame gets queued to start once it
+ * completes, see `LEDMatrixDMA`.
+ *
+ * @param gap_us Time left [µs] until the next line switch, see
+ * `us_until_line_switch()`. A strip that won't fit in the gap stays dirty and
+ * gets sent out at a later call, see `LEDGovernor`.
+ */
+void flush_leds(uint32_t gap_us = UINT32_MAX) {
+  PERF_SCOPE(PERF_FLUSH_LEDS);
+  uint8_t brightness = FastLED.getBrightness();
+  if (onboard_led_dirty && onboard_led_ctrl &&
+      ((gap_us == UINT32_MAX) ||
+       (gap_us >= ONBOARD_LED_COST_US + LED_GOVERNOR_MARGIN_US))) {
+    onboard_led_ctrl->showLeds(brightness);
+    onboard_led_dirty = false;
+  }
+  if (leds_dirty && led_governor.may_show(gap_us)) {
+    TRACE_SPAN(TRACE_LED_SHOW);
+    uint32_t t0_us = micros();
+    bool shown = false; // Only a frame that actually got sent clears the flag
+    if (peripheral_sim.is_enabled()) {
+      peripheral_sim.show_leds();
+      shown = true;
+    } else if (led_matrix_via_dma) {
+      shown = led_matrix_dma.show(leds, brightness);
+    } else if (led_matrix_via_preempt) {
+      shown = led_matrix_preempt.show(leds, brightness);
+    } else if (led_matrix_ctrl) {
+      led_matrix_ctrl->showLeds(brightness);
+      shown = true;
+    }
+    if (shown) {
+      leds_dirty = false;
+      led_governor.shown(micros() - t0_us);
+    }
+  }
+}
+
+/**
+ * @brief Send out the LED data of the onboard NeoPixel and of the LED matrix,
+ * regardless of them being dirty. E.g. after a change of the global
+ * brightness.
+ */
+void show_leds() {
+  onboard_led_dirty = true;
+  leds_dirty = true;
+  flush_leds();
+}
 
 /*------------------------------------------------------------------------------
   ProtocolManager
@@ -117,6 +315,81 @@ uint16_t idx_led;    // Frequently used LED index
 
 ProtocolManager protocol_mgr(&cp_mgr);
 
+// All RAM that is free at boot, minus `MEM_RESERVE_BYTES`, gets claimed as a
+// single arena holding the protocol program slots and the valve-event log, see
+// `MemoryArena`. The reserve covers the stack and the heap use of the
+// libraries after boot.
+MemoryArena mem_arena;
+const uint32_t MEM_RESERVE_BYTES = 16384;
+
+/**
+ * @brief Claim the memory arena and carve it up, see `mem_arena`.
+ */
+void claim_mem_arena() {
+  int32_t N_free = freeMemory();
+  uint32_t N_bytes = (N_free > (int32_t)MEM_RESERVE_BYTES)
+                         ? N_free - MEM_RESERVE_BYTES
+                         : 0;
+  uint8_t *base = (uint8_t *)malloc(N_bytes);
+  if (base == nullptr) {
+    snprintf(buf, BUF_LEN,
+             "CRITICAL: Failed to claim %lu bytes for the memory arena",
+             (unsigned long)N_bytes);
+    halt(15, buf);
+  }
+  mem_arena.begin(base, N_bytes);
+  protocol_mgr.begin(mem_arena);
+}
+
+// Pulse-width modulation of the valves, see `FSM: PWM`
+ValvePWM valve_pwm(&cp_mgr);
+
+// Hardware timer to fire the protocol line switches from within an interrupt,
+// or the ticks of the valve PWM
+PlaybackTimer playback_timer;
+void playback_timer_callback() {
+  if (valve_pwm.is_running()) {
+    valve_pwm.isr_tick();
+  } else {
+    protocol_mgr.isr_switch();
+  }
+}
+void trigger_callback() { protocol_mgr.isr_trigger(); }
+
+/**
+ * @brief Follow the sync edges of a leader MCU on the trigger input, or not,
+ * see `ProtocolManager::set_follower()`. A follower reacts to both edges.
+ */
+void set_follower(bool follower) {
+  if (follower == protocol_mgr.is_follower()) {
+    return;
+  }
+  protocol_mgr.set_follower(follower);
+  attachInterrupt(digitalPinToInterrupt(PIN_TRIGGER_IN), trigger_callback,
+                  follower ? CHANGE : RISING);
+}
+
+// Persistent library of protocol programs inside the on-board QSPI flash
+QSPIFlash qspi_flash;
+ProtocolLibrary protocol_lib;
+
+// Sequence of stored protocol programs played back to back, see `pl_play`
+Playlist playlist(&protocol_mgr, &protocol_lib);
+
+// Lifetime switch counts and open times of the valves, persisted at the end of
+// the QSPI flash
+WearJournal wear_journal;
+
+// Standalone log of the pressures and line switches, right below the wear
+// journal
+FlashLog flash_log;
+
+// Baseline of the `bench` command, right below the flash log
+BenchBaseline bench_baseline;
+
+// Runtime tuning of the performance knobs, persisted in the SmartEEPROM
+TuningStore tuning;
+
 /**
  * @brief Return the current protocol position starting at index 1.
  */
@@ -129,73 +402,462 @@ uint16_t get_protocol_position() {
   MIKROE 4-20 mA R Click boards for reading out the OMEGA pressure sensors
 ------------------------------------------------------------------------------*/
 
-R_Click R_click_1(PIN_R_CLICK_1, R_CLICK_1_CALIB);
-R_Click R_click_2(PIN_R_CLICK_2, R_CLICK_2_CALIB);
-R_Click R_click_3(PIN_R_CLICK_3, R_CLICK_3_CALIB);
-R_Click R_click_4(PIN_R_CLICK_4, R_CLICK_4_CALIB);
+const uint8_t R_CLICK_CS_PINS[N_R_CLICKS] = {PIN_R_CLICK_1, PIN_R_CLICK_2,
+                                             PIN_R_CLICK_3, PIN_R_CLICK_4};
+
+// All R Clicks read out within a single SPI transaction, when polled
+R_Click_Array R_clicks(R_CLICK_CS_PINS, N_R_CLICKS);
+
+// Background acquisition of the R Clicks at a fixed rate, when available
+RClickDAQ r_click_daq;
+bool r_click_via_dma = false; // Set in `setup()`
+
+// Oversampling interval of the R Clicks, adapting to the headroom of the main
+// loop, see command `daq_os`
+DAQRate daq_rate(DAQ_DT);
+uint8_t DAQ_phase = 0; // Readings since the last one at `DAQ_DT`
+
+// Statistics of the R Click acquisition, see command `daq?`
+uint32_t DAQ_tick = 0;      // Time of the last reading [µs]
+uint32_t DAQ_t_first = 0;   // Time of the first reading since reset [µs]
+uint32_t DAQ_N_samples = 0; // Number of readings since reset
+
+// Calibrations of the R Clicks and OMEGA pressure sensors, folded together
+const PressureScale pres_scale[N_R_CLICKS] = {
+    PressureScale(R_CLICK_1_CALIB, OMEGA_1_CALIB),
+    PressureScale(R_CLICK_2_CALIB, OMEGA_2_CALIB),
+    PressureScale(R_CLICK_3_CALIB, OMEGA_3_CALIB),
+    PressureScale(R_CLICK_4_CALIB, OMEGA_4_CALIB)};
+
+// Pressure statistics per played protocol line, see command `pstats`
+LinePressureLog line_pressure_log;
+PhaseAverager phase_avg;
+
+// Alias-free pressure streams at lower rates, see command `decim`
+Decimator decimator(DAQ_DT, pres_scale);
+
+// Capture of the raw readings around a pressure anomaly, see `anomaly_arm`
+AnomalyCapture anomaly_capture(DAQ_DT, pres_scale);
+
+// Stuck-valve detection from the pressure response, see command `health`
+ValveHealth valve_health;
+
+/**
+ * @brief Add a reading of all R Clicks to their exponential moving averages
+ * (EMA), i.e. low-pass filter the oversampled readings. While running, the
+ * reading also adds to the pressure statistics of the current protocol line
+ * and to the stuck-valve detection.
+ * The reading also feeds the decimated pressure streams and the anomaly
+ * capture, at the nominal interval `DAQ_DT` only, see `DAQRate.h`.
+ *
+ * @param t_us Time of the reading on the `micros()` time track
+ * @param bitval The reading of each R Click [bitval]
+ */
+void R_click_add_to_EMA(uint32_t t_us, const uint16_t (&bitval)[N_R_CLICKS]) {
+  // The smoothing factor follows from the obtained interval, because an exact
+  // time interval is not garantueed. See `EMAFilter`.
+  readings.DAQ_obtained_DT = t_us - DAQ_tick;
+  readings.EMA.update(readings.DAQ_obtained_DT, bitval);
+  memcpy(readings.bitval, bitval, sizeof(readings.bitval));
+
+  if (DAQ_N_samples == 0) {
+    DAQ_t_first = t_us;
+  }
+  DAQ_N_samples++;
+  DAQ_tick = t_us;
+
+  if (line_pressure_log.is_active() || valve_health.is_active() ||
+      phase_avg.is_active()) {
+    // The raw readings, as the moving averages lag behind the line switches
+    int16_t pres_mbar[N_R_CLICKS];
+    for (uint8_t ch = 0; ch < N_R_CLICKS; ++ch) {
+      pres_mbar[ch] = pres_scale[ch].bitval2mbar(bitval[ch] << 4);
+    }
+    line_pressure_log.add(protocol_mgr.get_position(), pres_mbar);
+    valve_health.add(t_us, pres_mbar, cp_mgr.get_masks());
+    if (phase_avg.is_active()) {
+      int16_t pos;
+      int32_t us_into_line = protocol_mgr.get_phase(t_us, pos);
+      phase_avg.add(pos, us_into_line, pres_mbar,
+                    protocol_mgr.get_program_gen());
+    }
+  }
+
+  if (++DAQ_phase < daq_rate.get_factor()) {
+    return;
+  }
+  DAQ_phase = 0;
+  trace(TRACE_DAQ_TICK, daq_rate.get_factor(), t_us);
+
+  if (decimator.is_active()) {
+    decimator.add(t_us, bitval, bulk_out());
+  }
+
+  if (anomaly_capture.add(t_us, bitval, protocol_mgr.get_position())) {
+    const AnomalyTag &tag = anomaly_capture.get_tag();
+    trace(TRACE_PRESSURE_ANOMALY, tag.line_pos, tag.cause << 8 | tag.channel);
+  }
+}
 
 /**
- * @brief Perform an exponential moving average (EMA) on each R Click reading by
- * using oversampling and subsequent low-pass filtering.
+ * @brief Convert bit values @p bitval_q4 in units of 1/16 bitval into the
+ * currents and pressures of the readings.
+ */
+void update_pressures(const uint16_t (&bitval_q4)[N_R_CLICKS]) {
+  int32_t sum_mbar = 0;
+  bool fault = false;
+  for (uint8_t ch = 0; ch < N_R_CLICKS; ++ch) {
+    readings.pres_uA[ch] = pres_scale[ch].bitval2uA(bitval_q4[ch]);
+    readings.pres_mbar[ch] = pres_scale[ch].bitval2mbar(bitval_q4[ch]);
+    sum_mbar += readings.pres_mbar[ch];
+    fault |= (readings.pres_mbar[ch] == PRESSURE_FAULT);
+  }
+  readings.pres_avg_mbar = fault ? PRESSURE_FAULT : sum_mbar / N_R_CLICKS;
+  flash_log.add_pressure(readings.pres_mbar);
+}
+
+/**
+ * @brief Acquire new R Click readings and add them to the exponential moving
+ * averages.
  *
- * This function should be repeatedly called in the main loop, ideally at a
- * faster pace than the given oversampling interval `DAQ_DT` as set in
- * `constants.h`.
+ * When `r_click_via_dma` is set, the readings get acquired in the background
+ * at the oversampling interval of `daq_rate`, see `DAQRate.h`, and this
+ * function merely drains them. Otherwise, the R Clicks get read out right here
+ * once that interval has passed, blocking for ~70 µs @ 1 MHz SPI clock, of
+ * which 64 µs are spent clocking in the 4 x 16 bits, see `R_Click_Array`. The
+ * function should then be repeatedly called in the main loop, ideally at a
+ * faster pace than the interval.
  *
- * @return True when a new sample has been read and added to the moving
- * average. False otherwise, because it was not yet time to read out a new
- * sample.
+ * @return True when at least one new reading has been added to the moving
+ * averages. False otherwise.
  */
 bool R_click_poll_EMA_collectively() {
-  static bool at_startup = true;
-  static uint32_t tick = micros();
+  if (r_click_via_dma && !peripheral_sim.is_enabled()) {
+    DAQ_Sample sample;
+    bool added = false;
+
+    while (r_click_daq.pop(sample)) {
+      PERF_SCOPE(PERF_R_CLICK);
+      R_click_add_to_EMA(sample.t_us, sample.bitval);
+      added = true;
+    }
+    return added;
+  }
+
   uint32_t now_us = micros();
-  float alpha; // Derived smoothing factor of the exponential moving average
-
-  if ((now_us - tick) >= DAQ_DT) {
-    // Enough time has passed -> Acquire a new reading.
-    // Calculate the smoothing factor every time because an exact time interval
-    // is not garantueed.
-    readings.DAQ_obtained_DT = now_us - tick;
-    alpha = 1.f - exp(-float(readings.DAQ_obtained_DT) * DAQ_LP * 1e-6);
-
-    if (at_startup) {
-      at_startup = false;
-      readings.EMA_1 = R_click_1.read_bitval();
-      readings.EMA_2 = R_click_2.read_bitval();
-      readings.EMA_3 = R_click_3.read_bitval();
-      readings.EMA_4 = R_click_4.read_bitval();
+  if ((now_us - DAQ_tick) >= daq_rate.get_interval_us()) {
+    PERF_SCOPE(PERF_R_CLICK);
+
+    // Enough time has passed -> Acquire a new reading
+    uint16_t bitval[N_R_CLICKS];
+    if (peripheral_sim.is_enabled()) {
+      for (uint8_t ch = 0; ch < N_R_CLICKS; ++ch) {
+        bitval[ch] = peripheral_sim.read_adc(ch, now_us);
+      }
     } else {
-      // Block takes 94 µs @ 1 MHz SPI clock
-      // utick = micros();
-      readings.EMA_1 += alpha * (R_click_1.read_bitval() - readings.EMA_1);
-      readings.EMA_2 += alpha * (R_click_2.read_bitval() - readings.EMA_2);
-      readings.EMA_3 += alpha * (R_click_3.read_bitval() - readings.EMA_3);
-      readings.EMA_4 += alpha * (R_click_4.read_bitval() - readings.EMA_4);
-      // Serial.println(micros() - utick);
-    }
-    tick = now_us;
+      R_clicks.read_bitvals(bitval);
+    }
+    R_click_add_to_EMA(now_us, bitval);
     return true;
+  }
+
+  return false;
+}
+
+/**
+ * @brief Report the R Click acquisition statistics since the last reset, tab
+ * delimited:
+ *   1) Acquired in the background via DMA (1) or polled (0)
+ *   2) Desired oversampling interval [µs]
+ *   3) Achieved oversampling rate [Hz]
+ *   4) Number of readings
+ *   5) Number of skipped timer ticks, because the bus was still busy
+ *   6) Number of dropped readings, because the main loop lagged behind
+ *   7) Current oversampling interval [µs], see `DAQRate`
+ *   8) Current oversampling factor
+ *   9) Bound on the oversampling factor
+ *  10) Longest iteration of the main loop of the last window [µs]
+ */
+void print_DAQ_stats() {
+  uint32_t span_us = DAQ_tick - DAQ_t_first;
+  float rate_Hz = ((DAQ_N_samples > 1) && (span_us > 0))
+                      ? (DAQ_N_samples - 1) * 1e6f / span_us
+                      : NAN;
+
+  snprintf(buf, BUF_LEN, "%d\t%lu\t%.2f\t%lu\t%lu\t%lu\t", r_click_via_dma,
+           (unsigned long)tuning.get().daq_dt_us, rate_Hz,
+           (unsigned long)DAQ_N_samples,
+           (unsigned long)r_click_daq.get_N_overruns(),
+           (unsigned long)r_click_daq.get_N_dropped());
+  tx.print(buf);
+  snprintf(buf, BUF_LEN, "%lu\t%u\t%u\t%lu\n",
+           (unsigned long)daq_rate.get_interval_us(), daq_rate.get_factor(),
+           daq_rate.get_max_factor(),
+           (unsigned long)daq_rate.get_loop_max_us());
+  tx.print(buf);
+}
+
+/**
+ * @brief Have the background acquisition, if any, follow the oversampling
+ * interval of `daq_rate`.
+ */
+void apply_DAQ_rate() {
+  if (r_click_via_dma) {
+    r_click_daq.set_interval(daq_rate.get_interval_us());
+  }
+}
+
+void reset_DAQ_stats() {
+  DAQ_N_samples = 0;
+  r_click_daq.reset_stats();
+}
+
+/**
+ * @brief Have knob @p key of `tuning` take effect right away, when live.
+ */
+void apply_tuning(uint8_t key) {
+  const TuningValues &tuned = tuning.get();
+  switch (key) {
+    case TUNE_DAQ_LP:
+      // Restarts the moving averages at the next reading
+      readings.EMA.begin(tuned.daq_lp_Hz);
+      break;
+    case TUNE_WATCHDOG:
+      Watchdog.enable(tuned.watchdog_ms);
+      break;
+    case TUNE_SAFETY_PERIOD:
+      safety_pulser.set_period(tuned.safety_period_ms);
+      break;
+    default:
+      // The LED idle periods get read on use, see `task_compose_leds()`. The
+      // oversampling interval only takes effect upon the next reboot.
+      break;
+  }
+}
+
+/*------------------------------------------------------------------------------
+  Burst capture of the raw R Click readings
+------------------------------------------------------------------------------*/
+
+// The burst buffer gets lent from the unused tail of the protocol program
+// storage, see `ProtocolManager::lend_spare_memory()`. Hence, the captured
+// samples are valid only until the next edit, upload or library access.
+BurstSample *burst_buf = nullptr;
+uint32_t burst_capacity = 0;    // Capacity of the burst buffer [samples]
+uint32_t burst_duration_us = 0; // Requested duration of the burst [µs]
+bool burst_armed = false;       // Start at the next line switch?
+int16_t burst_armed_pos = 0;    // Protocol position at the time of arming
+bool burst_done = false;        // Is a finished burst waiting to be dumped?
+uint32_t burst_N_dumped = 0;    // Number of samples dumped so far
+
+// Maximum number of burst samples per dump, see `dump_burst()`
+const uint16_t BURST_SAMPLES_PER_DUMP = 64;
+
+/**
+ * @brief Start a burst capture of @p duration_us into the lent burst buffer,
+ * see `RClickDAQ::start_burst()`.
+ *
+ * @return True when successful, false otherwise.
+ */
+bool start_burst(uint32_t duration_us) {
+  uint32_t N_bytes;
+  burst_buf = (BurstSample *)protocol_mgr.lend_spare_memory(N_bytes);
+  burst_capacity = N_bytes / sizeof(BurstSample);
+  burst_done = false;
+  burst_N_dumped = 0;
+  return r_click_daq.start_burst(burst_buf, burst_capacity, duration_us,
+                                 R_CLICK_BURST_SPI_CLOCK);
+}
+
+/**
+ * @brief Start an armed burst capture once the protocol switches lines and
+ * resume the periodic acquisition once the burst capture has finished. To be
+ * called once per main loop iteration, hence the start lags the line switch
+ * by at most one iteration.
+ */
+void update_burst() {
+  if (burst_armed && (protocol_mgr.get_position() != burst_armed_pos)) {
+    burst_armed = false;
+    start_burst(burst_duration_us);
+  }
+
+  if (r_click_daq.update_burst()) {
+    burst_done = true;
+  }
+}
+
+/**
+ * @brief Report the state of the burst capture, tab delimited:
+ *   1) Idle (0), armed (1), capturing (2) or finished (3)
+ *   2) Number of captured samples
+ *   3) Obtained duration from the first to the last sample [µs]
+ *   4) Capacity of the burst buffer [samples]
+ */
+void print_burst_state() {
+  uint8_t state = burst_armed                 ? 1
+                  : r_click_daq.is_bursting() ? 2
+                  : burst_done                ? 3
+                                              : 0;
 
+  snprintf(buf, BUF_LEN, "%u\t%lu\t%lu\t%lu\n", state,
+           (unsigned long)r_click_daq.get_N_burst_samples(),
+           (unsigned long)r_click_daq.get_burst_span_us(),
+           (unsigned long)burst_capacity);
+  tx.print(buf);
+}
+
+/**
+ * @brief Handle the `burst <ms>` command, or `burst_line <ms>` when @p at_line
+ * is set. Echoes the capacity of the burst buffer [samples] back.
+ *
+ * @param args The duration of the burst capture [ms]
+ * @param at_line Start at the next line switch instead of right away?
+ */
+void burst_command(const char *args, bool at_line) {
+  uint32_t duration_ms = constrain(atoi(args), 1, 1000);
+  if (!r_click_via_dma) {
+    tx.println("ERROR: Burst capture not available.");
+  } else if (burst_armed || r_click_daq.is_bursting()) {
+    tx.println("ERROR: Burst capture already ongoing.");
+  } else if (at_line) {
+    uint32_t N_bytes;
+    protocol_mgr.lend_spare_memory(N_bytes);
+    burst_duration_us = duration_ms * 1000;
+    burst_armed_pos = protocol_mgr.get_position();
+    burst_armed = true;
+    burst_done = false;
+    tx.println(N_bytes / sizeof(BurstSample));
+  } else if (start_burst(duration_ms * 1000)) {
+    tx.println(burst_capacity);
   } else {
-    return false;
+    tx.println("ERROR: Burst capture failed to start.");
+  }
+}
+
+/**
+ * @brief Drain the next samples of the finished burst capture. Replies with
+ * the number N of drained samples as ASCII line, followed by a single frame
+ * holding N packed `BurstSample`s, see `Telemetry.h`.
+ */
+void dump_burst() {
+  static uint8_t frame[cobs_frame_len(BURST_SAMPLES_PER_DUMP *
+                                      sizeof(BurstSample))];
+
+  uint32_t N = 0;
+  if (burst_done) {
+    N = min(r_click_daq.get_N_burst_samples() - burst_N_dumped,
+            (uint32_t)BURST_SAMPLES_PER_DUMP);
   }
+  tx.println(N);
+  tx.write(frame, cobs_frame((const uint8_t *)&burst_buf[burst_N_dumped],
+                             N * sizeof(BurstSample), frame));
+  burst_N_dumped += N;
+}
+
+/*------------------------------------------------------------------------------
+  Capture of the raw R Click readings around a pressure anomaly
+------------------------------------------------------------------------------*/
+
+uint16_t anomaly_N_dumped = 0; // Number of captured readings dumped so far
+
+/**
+ * @brief Drain the next readings of the frozen anomaly capture. Replies with
+ * the number N of drained readings as ASCII line, followed by a single frame
+ * holding N `DAQ_Sample`s, see `Telemetry.h`.
+ */
+void dump_anomaly() {
+  static DAQ_Sample samples[BURST_SAMPLES_PER_DUMP];
+  static uint8_t frame[cobs_frame_len(sizeof(samples))];
+
+  uint16_t N = anomaly_capture.read(anomaly_N_dumped, samples,
+                                    BURST_SAMPLES_PER_DUMP);
+  tx.println(N);
+  tx.write(frame, cobs_frame((const uint8_t *)samples,
+                             N * sizeof(DAQ_Sample), frame));
+  anomaly_N_dumped += N;
+}
+
+/**
+ * @brief Format the readings into `buf`, tab delimited, as reported by the `?`
+ * command: Protocol position, pressures 1 to 4 [µA], pressures 1 to 4 [mbar].
+ * A sensor in the fault state reports `PRESSURE_FAULT`.
+ *
+ * NOTE:
+ *   Using `snprintf()` to print a large array of formatted values to a buffer
+ *   followed by a single `tx.print(buf)` is many times faster than
+ *   multiple dumb `tx.print(value, 3); tx.write('\t')` statements.
+ *   The latter is > 3400 µs, the former just ~ 320 µs !!! See the `bench`
+ *   command for up-to-date numbers.
+ */
+void format_readings() {
+  // clang-format off
+  snprintf(buf, BUF_LEN,
+           "%d\t"
+           "%d\t%d\t%d\t%d\t"
+           "%d\t%d\t%d\t%d\n",
+           get_protocol_position(),
+           readings.pres_uA[0],
+           readings.pres_uA[1],
+           readings.pres_uA[2],
+           readings.pres_uA[3],
+           readings.pres_mbar[0],
+           readings.pres_mbar[1],
+           readings.pres_mbar[2],
+           readings.pres_mbar[3]);
+  // clang-format on
 }
 
 /*------------------------------------------------------------------------------
-  set_LED_matrix_data_fixed_grid
+  Pressure VU meter
 ------------------------------------------------------------------------------*/
 
+// clang-format off
+// Pressure [mbar] at which each LED of the VU meter lights up, top-down, see
+// `LEDCompositor`. All multiples of `VU_STEP`, so that the level can be looked
+// up at that resolution.
+constexpr int16_t VU_LEVELS[VU_N_LEDS] = {
+  4330, 4000, 3670, 3330, 3000, 2670, 2330,
+  2000, 1670, 1330, 1000,  670,  330,    0};
+// clang-format on
+
+const int16_t VU_STEP = 10; // [mbar]
+const uint16_t VU_LUT_LEN = VU_LEVELS[0] / VU_STEP + 1;
+
+static constexpr bool vu_levels_on_step() {
+  for (int16_t level : VU_LEVELS) {
+    if (level % VU_STEP) {
+      return false;
+    }
+  }
+  return true;
+}
+static_assert(vu_levels_on_step(), "VU levels must be multiples of VU_STEP");
+
 /**
- * @brief Set the LED colors at PCS points without a valve
+ * @brief Look-up table: Pressure / `VU_STEP` to the number of lit LEDs.
  */
-void set_LED_matrix_data_fixed_grid() {
-  for (int8_t x = PCS_X_MIN; x <= PCS_X_MAX; x++) {
-    for (int8_t y = PCS_Y_MIN; y <= PCS_Y_MAX; y++) {
-      if ((x + y) % 2 == 0) { leds[p2led(P{x, y})] = CRGB(12, 12, 12); }
+static constexpr std::array<uint8_t, VU_LUT_LEN> build_vu_lut() {
+  std::array<uint8_t, VU_LUT_LEN> out{};
+  for (uint16_t idx = 0; idx < VU_LUT_LEN; ++idx) {
+    for (int16_t level : VU_LEVELS) {
+      out[idx] += (idx * VU_STEP >= level);
     }
   }
-  leds[p2led(P{0, 0})] = CRGB(0, 64, 0); // Center (0, 0)
+  return out;
+}
+constexpr std::array<uint8_t, VU_LUT_LEN> VU_LUT = build_vu_lut();
+
+/**
+ * @brief Show the averaged pressure on the VU meter. Only the LEDs that
+ * changed between the previous and the new number of lit LEDs get recomposed,
+ * and nothing at all as long as that number stays the same.
+ */
+void update_vu_meter() {
+  int16_t pres = readings.pres_avg_mbar;
+  led_compositor.set_pressure((pres < 0) ? 0
+                              : (pres / VU_STEP < VU_LUT_LEN)
+                                  ? VU_LUT[pres / VU_STEP]
+                                  : VU_N_LEDS);
 }
 
 /*------------------------------------------------------------------------------
@@ -209,6 +871,31 @@ uint8_t idx_valve; // Frequently used valve index
 // new protocol program via a binary-command listener.
 bool loading_program = false;
 
+// Keeps the active protocol program playing while a new one gets uploaded into
+// the staging slot, see `PROTOCOL_SLOTS`
+bool upload_in_background = false;
+
+// Suspends the LED matrix refresh and the pressure DAQ during a foreground
+// upload, such that the upload is limited by the USB bandwidth instead of by
+// the `loop()` rate. See command `upload_fast`.
+bool upload_fast = true;
+bool io_suspended = false; // Are the LED refresh and DAQ suspended right now?
+
+// Boot timing since the reset of the MCU, excluding the bootloader. See `boot?`
+uint32_t boot_safe_us = 0;  // Time [µs] at which the valves had been closed
+uint32_t boot_ready_us = 0; // Time [µs] at which `setup()` had finished
+uint8_t reset_cause = 0;    // RCAUSE register: Cause of the last reset
+
+// Latency of the main loop, and what stalled it before the last reset
+LoopMonitor loop_monitor;
+
+// Where the CPU spends its time, see `SamplingProfiler.h`
+SamplingProfiler profiler;
+
+// Playback state to recover after a watchdog reset
+WarmStart warm_start;
+bool warm_restart = false; // Did the playback get recovered at boot?
+
 /*------------------------------------------------------------------------------
   FSM: Off
 
@@ -217,31 +904,56 @@ bool loading_program = false;
 
 void FSM_fun_off__ent() {
   alive_blinker_hue = HUE_YELLOW;
+  led_idle_running = false;
+  set_follower(false);
 
   if (!NO_PERIPHERALS) {
     cp_mgr.clear_masks();
-    cp_mgr.send_masks();
+    cp_mgr.send_masks(true); // Force, in case a port got out of sync
   }
 
-  for (idx_valve = 0; idx_valve < N_VALVES; ++idx_valve) {
-    leds[p2led(valve2p(idx_valve + 1))] = 0;
-  }
-}
+  led_compositor.clear_valves();
+  protocol_mgr.invalidate_leds();
 
-void FSM_fun_off__upd() {}
+  // The valves got closed, so the current line can't be resumed
+  protocol_mgr.resync();
+  playlist.stop();
+}
 
-State state_off("Off", FSM_fun_off__ent, FSM_fun_off__upd);
+// Idle: Has no update function, so it costs the main loop nothing
+State state_off("Off", FSM_fun_off__ent, nullptr);
 FiniteStateMachine fsm(state_off);
 
+/**
+ * @brief Only let `sim_on` start simulating the peripherals while Off with the
+ * real valves closed, see `PeripheralSim::set_start_guard()`.
+ */
+const char *sim_start_guard(void *) {
+  if (!fsm.isInState(state_off)) {
+    return "Can only simulate the peripherals in state Off.";
+  }
+  if (!cp_mgr.is_simulated() && !cp_mgr.outputs_closed()) {
+    return "The valves must be closed before simulating the peripherals.";
+  }
+  return nullptr;
+}
+
 /*------------------------------------------------------------------------------
   FSM: Paused
 
-  Leave previously activated valves open and idle
+  Leave previously activated valves open and idle. The elapsed time within the
+  current line is retained, such that the playback resumes where it left off.
 ------------------------------------------------------------------------------*/
 
-void FSM_fun_paused__ent() { alive_blinker_hue = HUE_YELLOW; }
-void FSM_fun_paused__upd() {}
-State state_paused("Paused", FSM_fun_paused__ent, FSM_fun_paused__upd);
+void FSM_fun_paused__ent() {
+  alive_blinker_hue = HUE_YELLOW;
+  led_idle_running = false;
+  set_follower(false); // A paused follower has lost track of the leader
+  protocol_mgr.freeze();
+}
+
+// Idle: Has no update function, so it costs the main loop nothing
+State state_paused("Paused", FSM_fun_paused__ent, nullptr);
 
 /*------------------------------------------------------------------------------
   FSM: Running
@@ -250,9 +962,81 @@ State state_paused("Paused", FSM_fun_paused__ent, FSM_fun_paused__upd);
   Will activate solenoid valves and will drive the LED matrix.
 ------------------------------------------------------------------------------*/
 
-void FSM_fun_running__ent() { alive_blinker_hue = HUE_GREEN; }
-void FSM_fun_running__upd() { protocol_mgr.update(); }
-State state_running("Running", FSM_fun_running__ent, FSM_fun_running__upd);
+void FSM_fun_running__ent() {
+  alive_blinker_hue = HUE_GREEN;
+  led_idle_running = true;
+
+  if (upload_in_background) {
+    // Playback has continued during the upload, so just carry on
+    upload_in_background = false;
+  } else {
+    // Continue on the frozen time track, or otherwise prevent a rapid catch-up
+    // of the lines missed while not running
+    protocol_mgr.resume();
+    line_pressure_log.start();
+    phase_avg.resume();
+  }
+  playlist.resume();
+}
+void FSM_fun_running__upd() {
+  protocol_mgr.update();
+
+  switch (playlist.update()) {
+    case PLAYLIST_DONE:
+      tx.println("Success! Played the playlist.");
+      fsm.transitionTo(state_off);
+      return;
+    case PLAYLIST_FAILED:
+      fsm.transitionTo(state_off);
+      return;
+    default:
+      break;
+  }
+
+  if (protocol_mgr.step_done()) {
+    fsm.transitionTo(state_paused);
+  }
+}
+
+void FSM_fun_running__ext() {
+  // Hand the valves back to the main loop
+  protocol_mgr.stop_timer();
+
+  if (!upload_in_background) {
+    // The line being played got cut short
+    line_pressure_log.stop();
+    phase_avg.pause();
+  }
+}
+
+State state_running("Running", FSM_fun_running__ent, FSM_fun_running__upd,
+                    FSM_fun_running__ext);
+
+/*------------------------------------------------------------------------------
+  FSM: Armed
+
+  Rewind the protocol program and wait for the trigger input to start playing
+  it, see `PIN_TRIGGER_IN`. Previously activated valves are left open.
+------------------------------------------------------------------------------*/
+
+void FSM_fun_armed__ent() {
+  alive_blinker_hue = HUE_PURPLE;
+  led_idle_running = false;
+  protocol_mgr.arm_trigger();
+}
+void FSM_fun_armed__upd() {
+  if (protocol_mgr.triggered()) {
+    fsm.transitionTo(state_running);
+  }
+}
+
+void FSM_fun_armed__ext() {
+  // Disarm, or do the bookkeeping of the first line when triggered
+  protocol_mgr.stop_timer();
+}
+
+State state_armed("Armed", FSM_fun_armed__ent, FSM_fun_armed__upd,
+                  FSM_fun_armed__ext);
 
 /*------------------------------------------------------------------------------
   FSM: Uploading
@@ -265,132 +1049,548 @@ State state_running("Running", FSM_fun_running__ent, FSM_fun_running__upd);
 // Stage 2: Load in via binary the protocol program line-by-line until the
 //          end-of-program (EOP) sentinel is received. The EOP is signalled by
 //          receiving two end-of-line (EOL) sentinels directly after each other.
+//          When started by command "upload_rows", each line is send as PCS row
+//          bitmasks instead, see `decode_rows_line()`. Or, when started by
+//          command "upload_bulk", load in the protocol program in chunks
+//          instead, see `upload_bulk__upd()`. Command "upload_patch" does the
+//          same, but additionally accepts chunks that copy lines of the
+//          active protocol program. Command "upload_delta" sends the chunks
+//          in the compact delta format instead, see `DeltaDecoder.h`.
 uint8_t loading_stage = 0;
 bool loading_successful = false;
 
-void FSM_fun_uploading__ent() {
-  alive_blinker_hue = HUE_BLUE;
-  loading_program = true;
-  loading_stage = 0;
-  loading_successful = false;
-  protocol_mgr.clear();
+// Format of the protocol program as send by the PC in stage 2
+enum UploadFormat {
+  UPLOAD_POINTS, // Line-by-line, as a list of byte-encoded PCS points
+  UPLOAD_ROWS,   // Line-by-line, as PCS row bitmasks
+  UPLOAD_BULK,   // In chunks of lines as PCS row bitmasks
+  UPLOAD_PATCH,  // Like `UPLOAD_BULK`, mixed with copies of the active program
+  UPLOAD_DELTA   // In chunks of lines as deltas, see `DeltaDecoder.h`
+};
+UploadFormat upload_format = UPLOAD_POINTS;
+
+/**
+ * @brief Does the upload format send the protocol program in chunks?
+ */
+inline bool upload_is_chunked() {
+  return (upload_format == UPLOAD_BULK) || (upload_format == UPLOAD_PATCH) ||
+         (upload_format == UPLOAD_DELTA);
 }
 
-void FSM_fun_uploading__upd() {
-  static uint16_t promised_N_lines;
-  Line line;
+// Inactivity time-out: The upload gets aborted when no data has been received
+// for this long, regardless of the size of the protocol program
+const uint16_t LOADING_TIMEOUT = 2000; // [ms]
 
-  // Stage 0: Load in via ASCII the name of the protocol program
-  if (loading_stage == 0) {
-    if (sc.available()) {
-      protocol_mgr.set_name(sc.getCommand());
-      Serial.println(protocol_mgr.get_name()); // Echo the name back
-      loading_stage++;
-    }
-  }
+// Maximum time spent on parsing the received lines per FSM update, such that a
+// playback continuing in the background does not get starved
+const uint16_t LOADING_BUDGET_US = 5000; // [µs]
 
-  // Stage 1: Load in via ASCII the total number of protocol lines that follow
-  if (loading_stage == 1) {
-    if (sc.available()) {
-      promised_N_lines = atoi(sc.getCommand());
+// During stage 2 the progress gets reported at this interval, tab delimited:
+//   "progress", N_lines received, N_bytes received, lines/s, bytes/s
+const uint16_t LOADING_PROGRESS_INTERVAL = 500; // [ms]
 
-      if (promised_N_lines > PROTOCOL_MAX_LINES) {
-        // Protocol program will not fit inside pre-allocated memory
-        snprintf(buf, BUF_LEN,
-                 "ERROR: Protocol program exceeds maximum number of lines. "
-                 "Requested were %d lines, but the maximum is %d.",
-                 promised_N_lines, PROTOCOL_MAX_LINES);
-        Serial.println(buf);
-        loading_program = false;
-        fsm.transitionTo(state_off);
-        return;
-      }
+uint32_t loading_tick_start = 0; // Timestamp [ms] of the start of stage 2
+uint32_t loading_N_bytes = 0;    // Number of bytes received during stage 2
+uint16_t loading_N_promised = 0; // Number of lines promised in stage 1
 
-      Serial.println(promised_N_lines);
-      loading_stage++;
-    }
-  }
+/*
+  Bulk upload
 
-  // Stage 2: Load in via binary the protocol program line-by-line
-  if (loading_stage == 2) {
+  Instead of line-by-line in stage 2, the protocol program can be send in
+  chunks of many lines, each guarded by a CRC32. Each chunk gets replied to by
+  "ACK <seq>" when accepted, or by "NACK <seq>" requesting the PC to resend all
+  chunks starting from sequence number <seq>. Corrupt and out-of-order chunks
+  are discarded. The PC may have a window of several chunks underway before
+  having to wait for their ACKs.
 
-    // Binary stream command availability status
-    int8_t bsc_available = bsc.available();
-    if (bsc_available == -1) {
-      halt(8, "Stream command buffer overrun in `load_program()`");
-    }
+  Chunk format, multi-byte values are little endian:
+    1 byte      : Start-of-chunk marker 0xA5
+    1 byte      : uint8_t sequence number, starting at 0 and wrapping around
+    1 byte      : uint8_t number of lines N in this chunk, at most
+                  `BULK_MAX_LINES`. N = 0 signals the end-of-program (EOP).
+    N x 32 bytes: Protocol lines, each being 1 x uint16_t encoded time
+                  duration, see `encode_duration_us()`, followed by 15 x
+                  uint16_t PCS row bitmasks, see `PCS_Rows`
+    4 bytes     : uint32_t CRC32 over the sequence number, N and the lines
 
-    if (bsc_available) {
-      // Incoming binary data length in bytes
-      uint16_t data_len = bsc.getCommandLength();
+  Patch upload
 
-      if (data_len == 0) {
-        // Found just the EOL sentinel without further information on the line
-        // --> This signals the end-of-program EOP.
-        if (DEBUG) { Serial.println("Found EOP"); }
-
-        if (protocol_mgr.get_N_lines() != promised_N_lines) {
-          // Number of received lines does not match the promise
-          snprintf(buf, BUF_LEN,
-                   "ERROR: Protocol program received incorrect number of "
-                   "lines. Promised were %d lines, but %d were received.",
-                   promised_N_lines, protocol_mgr.get_N_lines());
-          Serial.println(buf);
-          loading_program = false;
-          fsm.transitionTo(state_off);
-          return;
+  Only the lines that differ from the active protocol program have to be send,
+  found by comparing the hashes of `proto_hash`. The lines in between get
+  copied from the active program by copy chunks, which share the sequence
+  numbers and the ACK/NACK scheme with the chunks of lines. Requires a staging
+  slot, as the active program must stay intact until the upload has finished.
+
+  Copy chunk format, multi-byte values are little endian:
+    1 byte : Start-of-copy-chunk marker 0x5A
+    1 byte : uint8_t sequence number
+    2 bytes: uint16_t first line number of the active program to copy
+    2 bytes: uint16_t number of lines to copy, at most `BULK_MAX_COPY_LINES`
+    4 bytes: uint32_t CRC32 over the sequence number and the line range
+
+  Delta upload
+
+  Same as the bulk upload, but the lines get send as deltas against their
+  previous line, see `DeltaDecoder.h`. A temporally smooth protocol then costs
+  a few bytes per line instead of 32. The decoder state carries over from
+  chunk to chunk.
+
+  Delta chunk format, multi-byte values are little endian:
+    1 byte : Start-of-chunk marker 0xA5
+    1 byte : uint8_t sequence number
+    1 byte : uint8_t number of lines N in this chunk. N = 0 signals the EOP.
+    2 bytes: uint16_t number of bytes L of the lines, at most
+             `BULK_MAX_DELTA_BYTES`
+    L bytes: N protocol lines in the delta format
+    4 bytes: uint32_t CRC32 over the sequence number, N, L and the lines
+*/
+const uint8_t BULK_MARKER = 0xA5;
+const uint8_t BULK_LINE_LEN = 2 + 2 * NUMEL_PCS_AXIS; // [bytes]
+const uint8_t BULK_MAX_LINES = 32;
+const uint16_t BULK_NACK_HOLDOFF = 50; // [ms] Minimum time between NACKs
+const uint8_t BULK_COPY_MARKER = 0x5A;
+const uint8_t BULK_COPY_LEN = 1 + 1 + 2 + 2 + 4; // [bytes]
+
+// Bounds the time spent copying per chunk, such that a playback continuing in
+// the background does not get starved
+const uint16_t BULK_MAX_COPY_LINES = 512;
+
+// A delta chunk fits the chunk buffer as well
+const uint16_t BULK_MAX_DELTA_BYTES = BULK_MAX_LINES * BULK_LINE_LEN - 2;
+
+// The upload formats carry 16-bit PCS rows and single-byte PCS points
+static_assert(sizeof(Grid::row_t) == 2 && sizeof(Grid::packed_p_t) == 1,
+              "Extend the upload formats for this grid geometry");
+
+uint8_t bulk_buf[3 + BULK_MAX_LINES * BULK_LINE_LEN + 4]; // Chunk buffer
+uint16_t bulk_len = 0;       // Number of bytes received of the current chunk
+uint8_t bulk_seq = 0;        // Sequence number of the next chunk to accept
+bool bulk_nacked = false;    // Has the next chunk already been NACKed?
+uint32_t bulk_tick_nack = 0; // Timestamp [ms] of the last NACK
+DeltaDecoder delta_decoder;  // State of the delta upload
+uint32_t bulk_crc = 0;       // CRC32 over the CRCs of all accepted chunks
+
+/*
+  Resuming an upload
+
+  When a chunked upload into the staging slot times out, e.g. because the USB
+  connection dropped, the lines received so far are kept in the staging slot.
+  Command "upload_resume" then continues the upload straight at stage 2, right
+  after the last accepted chunk, replying tab delimited:
+    "resume", the sequence number of the next chunk, the number of lines
+    received so far and `bulk_crc` in hex
+  The PC checks `bulk_crc` against its own chunks to make sure it resumes the
+  same upload. Starting any other upload discards the partial program.
+*/
+bool upload_resumable = false; // Is there an interrupted upload to resume?
+bool upload_resuming = false;  // Is the upload a resumed one?
+
+/**
+ * @brief Decode a protocol line send as PCS row bitmasks: 1 x uint16_t encoded
+ * time duration followed by 15 x uint16_t PCS row bitmasks, little endian.
+ *
+ * Because valid PCS row bitmasks alternate their bits there can never be three
+ * 0xFF bytes in a row, so the format is safe to be terminated by the EOL
+ * sentinel.
+ *
+ * @param p Pointer to the `BULK_LINE_LEN` bytes of the line
+ * @param rows Reference to the PCS row bitmasks to write into
+ * @return The encoded time duration, see `decode_duration_us()`
+ */
+uint16_t decode_rows_line(const uint8_t *p, PCS_Rows &rows) {
+  for (uint8_t row = 0; row < NUMEL_PCS_AXIS; ++row) {
+    rows[row] = p[2 + 2 * row] | (uint16_t)p[3 + 2 * row] << 8;
+  }
+  return p[0] | (uint16_t)p[1] << 8;
+}
+
+/**
+ * @brief Receive and process the incoming chunks of the bulk upload.
+ *
+ * @return 1 when the end-of-program has been received, -1 when the protocol
+ * program exceeds the available memory, -2 when a chunk holds invalid
+ * contents, e.g. a copy chunk exceeding the active protocol program, 0
+ * otherwise.
+ */
+int8_t upload_bulk__upd() {
+  Stream &port = bulk_in();
+  while (port.available()) {
+    fsm.restartTimeout();
+    if (bulk_len == 0) {
+      uint8_t marker = port.read();
+      if ((marker == BULK_MARKER) ||
+          ((marker == BULK_COPY_MARKER) && (upload_format == UPLOAD_PATCH))) {
+        bulk_buf[bulk_len++] = marker;
+      }
+      continue; // Resynchronize on the start-of-chunk marker
+    }
+
+    bool is_copy = (bulk_buf[0] == BULK_COPY_MARKER);
+    bool is_delta = !is_copy && (upload_format == UPLOAD_DELTA);
+    uint8_t header_len = is_copy ? 1 : (is_delta ? 5 : 3);
+    if (bulk_len < header_len) {
+      bulk_buf[bulk_len++] = port.read();
+      if (!is_delta && (bulk_len == 3) && (bulk_buf[2] > BULK_MAX_LINES)) {
+        bulk_len = 0; // Corrupt header
+      }
+      if (is_delta && (bulk_len == 5) &&
+          ((bulk_buf[3] | bulk_buf[4] << 8) > BULK_MAX_DELTA_BYTES)) {
+        bulk_len = 0; // Corrupt header
+      }
+      continue;
+    }
+
+    uint16_t chunk_len;
+    if (is_copy) {
+      chunk_len = BULK_COPY_LEN;
+    } else if (is_delta) {
+      chunk_len = 5 + (bulk_buf[3] | bulk_buf[4] << 8) + 4;
+    } else {
+      chunk_len = 3 + bulk_buf[2] * BULK_LINE_LEN + 4;
+    }
+    uint16_t N_read = port.readBytes(
+        (char *)&bulk_buf[bulk_len],
+        min(port.available(), chunk_len - bulk_len));
+    bulk_len += N_read;
+    loading_N_bytes += N_read;
+    if (bulk_len < chunk_len) {
+      continue;
+    }
+    bulk_len = 0;
+
+    uint8_t seq = bulk_buf[1];
+    const uint8_t *p_crc = &bulk_buf[chunk_len - 4];
+    uint32_t crc = (uint32_t)p_crc[0] | (uint32_t)p_crc[1] << 8 |
+                   (uint32_t)p_crc[2] << 16 | (uint32_t)p_crc[3] << 24;
+
+    if ((seq != bulk_seq) || (crc != crc32(&bulk_buf[1], chunk_len - 5))) {
+      // Corrupt or out-of-order chunk
+      if (!bulk_nacked || (millis() - bulk_tick_nack > BULK_NACK_HOLDOFF)) {
+        snprintf(buf, BUF_LEN, "NACK %d", bulk_seq);
+        tx.println(buf);
+        bulk_nacked = true;
+        bulk_tick_nack = millis();
+      }
+      continue;
+    }
+
+    uint16_t N_lines;
+    if (is_copy) {
+      uint16_t first = bulk_buf[2] | (uint16_t)bulk_buf[3] << 8;
+      N_lines = bulk_buf[4] | (uint16_t)bulk_buf[5] << 8;
+      if ((N_lines > BULK_MAX_COPY_LINES) ||
+          ((uint32_t)first + N_lines > protocol_mgr.get_active_N_lines())) {
+        return -2;
+      }
+      if (!protocol_mgr.copy_active_lines(first, first + N_lines)) {
+        return -1;
+      }
+
+    } else if (is_delta) {
+      N_lines = bulk_buf[2];
+      const uint8_t *p = &bulk_buf[5];
+      const uint8_t *end = &bulk_buf[chunk_len - 4];
+      for (uint8_t idx_line = 0; idx_line < N_lines; ++idx_line) {
+        if (!delta_decoder.next_line(p, end)) {
+          return -2;
+        }
+        if (!protocol_mgr.add_line(delta_decoder.get_duration(),
+                                   delta_decoder.get_rows())) {
+          return -1;
         }
+      }
+      if (p != end) {
+        return -2; // Trailing bytes
+      }
 
-        // Successful exit
-        Serial.println("Success!");
-        loading_successful = true;
-        loading_program = false;
-        fsm.transitionTo(state_off);
-        return;
+    } else {
+      N_lines = bulk_buf[2];
+      PCS_Rows rows;
+      for (uint8_t idx_line = 0; idx_line < N_lines; ++idx_line) {
+        uint16_t duration =
+            decode_rows_line(&bulk_buf[3 + idx_line * BULK_LINE_LEN], rows);
+        if (!protocol_mgr.add_line(duration, rows)) {
+          return -1;
+        }
       }
+    }
+
+    snprintf(buf, BUF_LEN, "ACK %d", bulk_seq);
+    tx.println(buf);
+    bulk_crc = crc32(p_crc, 4, bulk_crc);
+    bulk_seq++;
+    bulk_nacked = false;
+
+    if (!is_copy && (N_lines == 0)) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * @brief Abort the upload once no data has been received for
+ * `LOADING_TIMEOUT`, see `FiniteStateMachine::setTimeout()`.
+ */
+void uploading_timed_out() {
+  tx.println("ERROR: Loading in protocol program timed out.");
+
+  // Keep the lines received so far, see `upload_resume`
+  upload_resumable = upload_is_chunked() && (loading_stage == 2) &&
+                     protocol_mgr.has_staging_slot();
+  end_uploading();
+}
+
+void FSM_fun_uploading__ent() {
+  alive_blinker_hue = HUE_BLUE;
+  led_idle_running = false;
+  loading_program = true;
+  loading_successful = false;
+  bulk_len = 0;
+  bulk_nacked = false;
+  fsm.setTimeout(LOADING_TIMEOUT, uploading_timed_out);
+  loading_N_bytes = 0;
+  io_suspended = upload_fast && !upload_in_background;
+  upload_resumable = false;
 
-      // Try to parse the newly send line of the protocol program
-      // Expecting a binary stream as follows:
-      // 1 x 2 bytes: uint16_t time duration in [ms]
-      // N x 1 byte : byte-encoded PCS coordinate where
-      //              upper 4 bits = PCS.x, lower 4 bits = PCS.y
-      line.duration = (uint16_t)bin_buf[0] << 8 | //
-                      (uint16_t)bin_buf[1];
-
-      uint16_t idx_P = 0; // Index of newly unpacked point
-      for (uint16_t idx = 2; idx < data_len; ++idx) {
-        line.points[idx_P].unpack_byte(bin_buf[idx]);
-        idx_P++;
+  if (upload_resuming) {
+    // Continue at stage 2, see `upload_resume`
+    protocol_mgr.reopen_staging();
+    loading_stage = 2;
+    loading_tick_start = millis();
+    snprintf(buf, BUF_LEN, "resume\t%u\t%u\t%08lx", bulk_seq,
+             protocol_mgr.get_N_lines(), (unsigned long)bulk_crc);
+    tx.println(buf);
+    return;
+  }
+
+  loading_stage = 0;
+  bulk_seq = 0;
+  bulk_crc = 0;
+  delta_decoder.reset();
+  protocol_mgr.open_staging();
+}
+
+/**
+ * @brief Report the progress of stage 2 of the upload, see
+ * `LOADING_PROGRESS_INTERVAL`.
+ */
+void report_uploading_progress() {
+  uint32_t elapsed = max(millis() - loading_tick_start, 1UL); // [ms]
+  snprintf(buf, BUF_LEN, "progress\t%u\t%lu\t%lu\t%lu",
+           protocol_mgr.get_N_lines(), (unsigned long)loading_N_bytes,
+           (unsigned long)(protocol_mgr.get_N_lines() * 1000UL / elapsed),
+           (unsigned long)(loading_N_bytes * 1000ULL / elapsed));
+  tx.println(buf);
+}
+
+/**
+ * @brief Leave the uploading state. Back to running when the upload happened
+ * in the background, else to off.
+ */
+void end_uploading() {
+  loading_program = false;
+  fsm.transitionTo(upload_in_background ? state_running : state_off);
+}
+
+/**
+ * @brief Report a protocol line that could not be added and abort the upload.
+ */
+void abort_uploading_full() {
+  snprintf(buf, BUF_LEN,
+#if PROTOCOL_COMPRESSED == COMPRESSION_FRAMES
+           "ERROR: Protocol program exceeds available memory or changes its "
+           "line duration after %d lines.",
+#else
+           "ERROR: Protocol program exceeds available memory after %d lines.",
+#endif
+           protocol_mgr.get_N_lines());
+  tx.println(buf);
+  end_uploading();
+}
+
+/**
+ * @brief Conclude the upload once the end-of-program has been received.
+ */
+void finish_uploading(uint16_t promised_N_lines) {
+  if (protocol_mgr.get_N_lines() != promised_N_lines) {
+    // Number of received lines does not match the promise
+    snprintf(buf, BUF_LEN,
+             "ERROR: Protocol program received incorrect number of "
+             "lines. Promised were %d lines, but %d were received.",
+             promised_N_lines, protocol_mgr.get_N_lines());
+    tx.println(buf);
+    end_uploading();
+    return;
+  }
+
+  // Successful exit
+  tx.println("Success!");
+  loading_successful = true;
+  end_uploading();
+}
+
+void FSM_fun_uploading__upd() {
+  if (upload_in_background) {
+    // Keep on playing the active protocol program
+    protocol_mgr.update();
+  }
+
+  // Stage 0: Load in via ASCII the name of the protocol program
+  if (loading_stage == 0) {
+    if (sc.available()) {
+      protocol_mgr.set_name(sc.getCommand());
+      tx.println(protocol_mgr.get_name()); // Echo the name back
+      fsm.restartTimeout();
+      loading_stage++;
+    }
+  }
+
+  // Stage 1: Load in via ASCII the total number of protocol lines that follow
+  if (loading_stage == 1) {
+    if (sc.available()) {
+      loading_N_promised = atoi(sc.getCommand());
+
+      if (loading_N_promised > PROTOCOL_MAX_LINES) {
+        // Protocol program will not fit inside pre-allocated memory
+        snprintf(buf, BUF_LEN,
+                 "ERROR: Protocol program exceeds maximum number of lines. "
+                 "Requested were %d lines, but the maximum is %d.",
+                 loading_N_promised, PROTOCOL_MAX_LINES);
+        tx.println(buf);
+        end_uploading();
+        return;
       }
-      line.points[idx_P].set_null(); // Add end sentinel
 
-      protocol_mgr.add_line(line);
-      if (DEBUG) { line.print(); }
+      tx.println(loading_N_promised);
+      bsc.reset(); // Discard any lines left over from an aborted upload
+      fsm.restartTimeout();
+      loading_tick_start = millis();
+      loading_stage++;
     }
   }
 
-  // Time-out check
-  const uint16_t LOADING_TIMEOUT = 7000; // [ms]
-  if (fsm.timeInCurrentState() > LOADING_TIMEOUT) {
-    Serial.println("ERROR: Loading in protocol program timed out.");
-    loading_program = false;
-    fsm.transitionTo(state_off);
+  // Progress report
+  static uint32_t tick_progress = 0;
+  if ((loading_stage == 2) &&
+      (millis() - tick_progress >= LOADING_PROGRESS_INTERVAL)) {
+    tick_progress = millis();
+    report_uploading_progress();
+  }
+
+  // Stage 2: Load in via binary the protocol program in chunks
+  bool chunked = upload_is_chunked();
+  if ((loading_stage == 2) && chunked) {
+    int8_t status = upload_bulk__upd();
+    if (status == 1) {
+      finish_uploading(loading_N_promised);
+      return;
+    } else if (status == -2) {
+      tx.println("ERROR: Upload holds an invalid chunk.");
+      end_uploading();
+      return;
+    } else if (status == -1) {
+      // Protocol program does not fit inside pre-allocated memory
+      abort_uploading_full();
+      return;
+    }
+  }
+
+  // Stage 2: Load in via binary the protocol program line-by-line, handling
+  // all lines received so far
+  if ((loading_stage == 2) && !chunked) {
+
+    // Binary stream command availability status
+    uint32_t t0 = micros();
+    int8_t bsc_available;
+    while ((micros() - t0 < LOADING_BUDGET_US) &&
+           (bsc_available = bsc.available())) {
+      if (bsc_available == -1) {
+        halt(8, "Stream command buffer overrun in `load_program()`");
+      }
+
+      // Incoming binary data length in bytes
+      uint16_t data_len = bsc.getCommandLength();
+      uint8_t *data = bsc.getCommandData();
+      fsm.restartTimeout();
+      loading_N_bytes += data_len + sizeof(EOL);
+
+      if (data_len == 0) {
+        // Found just the EOL sentinel without further information on the line
+        // --> This signals the end-of-program EOP.
+        trace(TRACE_UPLOAD_EOP, loading_N_promised,
+              protocol_mgr.get_N_lines());
+        finish_uploading(loading_N_promised);
+        return;
+      }
+
+      bool added;
+      if (upload_format == UPLOAD_ROWS) {
+        // Try to parse the newly send line of the protocol program
+        // Expecting PCS row bitmasks, see `decode_rows_line()`. These get
+        // packed directly, without the detour via a list of PCS points.
+        if (data_len != BULK_LINE_LEN) {
+          tx.println("ERROR: Protocol line has an incorrect length.");
+          end_uploading();
+          return;
+        }
+
+        PCS_Rows rows;
+        uint16_t duration = decode_rows_line(data, rows);
+        added = protocol_mgr.add_line(duration, rows);
+
+      } else {
+        // Try to parse the newly send line of the protocol program
+        // Expecting a binary stream as follows:
+        // 1 x 2 bytes: uint16_t encoded time duration, big endian. Plain
+        //              [ms] below 16384 ms, see `DURATION_UNIT_SHIFT`.
+        // N x 1 byte : byte-encoded PCS coordinate where
+        //              upper 4 bits = PCS.x, lower 4 bits = PCS.y
+        Line line;
+        line.duration = (uint16_t)data[0] << 8 | //
+                        (uint16_t)data[1];
+        line.unpack_points(&data[2], data_len > 2 ? data_len - 2 : 0);
+
+        added = protocol_mgr.add_line(line);
+        trace(TRACE_UPLOAD_LINE, line.N_points, line.duration);
+      }
+
+      if (!added) {
+        // Protocol program does not fit inside pre-allocated memory
+        abort_uploading_full();
+        return;
+      }
+    }
   }
 }
 
 void FSM_fun_uploading__ext() {
-  if (!loading_successful) {
+  io_suspended = false;
+  protocol_mgr.close_staging(loading_successful);
+
+  if (upload_in_background) {
+    // The active protocol program has kept on playing. A successfully uploaded
+    // program is left staged, to be swapped in by the `swap` command.
+    return;
+  }
+
+  if (loading_successful) {
+    // Make the staged program the active one, when there is a staging slot
+    protocol_mgr.swap(false);
+
+  } else if (!protocol_mgr.has_staging_slot()) {
     // Unsuccesful load --> Create a safe protocol program where all valves are
-    // always open.
+    // always open. With a staging slot, the active program is left intact
+    // instead.
     protocol_mgr.clear();
     protocol_mgr.set_name("All valves open");
 
     Line line;
     line.duration = 1000; // [ms]
     for (idx_valve = 1; idx_valve <= N_VALVES; ++idx_valve) {
-      line.points[idx_valve - 1] = valve2p(idx_valve);
+      line.add_point(valve2p(idx_valve));
     }
-    line.points[N_VALVES].set_null(); // Add end sentinel
     protocol_mgr.add_line(line);
   }
 
@@ -403,376 +1603,3303 @@ void FSM_fun_uploading__ext() {
 State state_uploading("Uploading", FSM_fun_uploading__ent,
                       FSM_fun_uploading__upd, FSM_fun_uploading__ext);
 
+/**
+ * @brief Start uploading a new protocol program in the given @p format. When
+ * running and there is a staging slot, the active program keeps on playing.
+ * When @p resume is set, the interrupted upload gets continued instead, see
+ * `upload_resume`.
+ */
+void start_uploading(UploadFormat format, bool resume = false) {
+  upload_format = format;
+  upload_resuming = resume;
+  upload_in_background =
+      fsm.isInState(state_running) && protocol_mgr.has_staging_slot();
+  fsm.transitionTo(state_uploading);
+}
+
 /*------------------------------------------------------------------------------
-  setup
+  FSM: Streaming
+
+  Play a jetting protocol that is continuously being streamed in from the PC,
+  line by line, allowing for protocols larger than memory. The protocol program
+  in memory is left intact.
 ------------------------------------------------------------------------------*/
 
-void setup() {
-  // To enable float support in `snprintf()` we must add the following
-  asm(".global _printf_float");
+// Stage 0: Load in via ASCII the name of the protocol.
+// Stage 1: Load in via binary the protocol line-by-line, using the same format
+//          as for uploading, while playing. Flow control is credit based: The
+//          Arduino grants the PC a number of lines it may send by replying
+//          "credit <N>". The end-of-stream is signalled by sending just the
+//          EOL sentinel, like the end-of-program when uploading.
+uint8_t streaming_stage = 0;
+uint16_t stream_credit = 0; // Lines the PC may still send without a new grant
 
-  // Safety pulses to be send to the safety MCU
-  pinMode(PIN_SAFETY_PULSE_OUT, OUTPUT);
-  digitalWrite(PIN_SAFETY_PULSE_OUT, LOW);
+// Grant new credit to the PC in batches of at least this many lines
+const uint16_t STREAM_CREDIT_BATCH = 64;
 
-  // Onboard LED & LED matrix
-  //
-  // NOTE:
-  //   Don't call `FastLED.setMaxRefreshRate()`, because it will turn
-  //   `FastLED.show()` into a blocking call.
-  // NOTE:
-  //   Type `NEOPIXEL` is internally `WS2812Controller800Khz`, so already
-  //   running at the max clock frequency of 800 kHz.
+// Abort when no data has been received for this long while the stream buffer
+// has run dry
+const uint16_t STREAMING_TIMEOUT = 7000; // [ms]
 
-  FastLED.addLeds<NEOPIXEL, PIN_NEOPIXEL>(onboard_led, 1);
-  FastLED.addLeds<NEOPIXEL, PIN_LED_MATRIX>(leds, N_LEDS);
-  FastLED.setCorrection(UncorrectedColor);
-  // FastLED.setCorrection(TypicalSMD5050);
-  FastLED.setBrightness(30);
-  fill_solid(onboard_led, 1, CRGB::Blue);
-  fill_rainbow(leds, N_LEDS, 0, 1); // Show rainbow during setup
-  FastLED.show();
+/**
+ * @brief Abort the stream once no data has been received for
+ * `STREAMING_TIMEOUT`, see `FiniteStateMachine::setTimeout()`. While lines are
+ * left to play, keep on waiting.
+ */
+void streaming_timed_out() {
+  if ((streaming_stage > 0) && !protocol_mgr.stream_dry()) {
+    fsm.restartTimeout();
+    return;
+  }
 
-  Serial.begin(9600);
-  if (DEBUG) {
-    while (!Serial) {}
-    Serial.print("Free mem @ setup: ");
-    Serial.println(freeMemory());
+  // The valves are already closed when the buffer ran dry
+  tx.println("ERROR: Streaming protocol timed out.");
+  fsm.transitionTo(state_off);
+}
+
+void FSM_fun_streaming__ent() {
+  alive_blinker_hue = HUE_BLUE;
+  led_idle_running = true;
+  loading_program = true;
+  streaming_stage = 0;
+  stream_credit = 0;
+  fsm.setTimeout(STREAMING_TIMEOUT, streaming_timed_out);
+}
+
+void FSM_fun_streaming__upd() {
+  static uint32_t N_underruns = 0;
+  Line line;
+
+  // Stage 0: Load in via ASCII the name of the protocol
+  if (streaming_stage == 0) {
+    if (sc.available()) {
+      protocol_mgr.set_name(sc.getCommand());
+      tx.println(protocol_mgr.get_name()); // Echo the name back
+      protocol_mgr.start_stream();
+      bsc.reset(); // Discard any lines left over from an aborted upload
+      N_underruns = 0;
+      fsm.restartTimeout();
+      streaming_stage++;
+    } else {
+      return;
+    }
   }
 
-  // Build reverse look-up table to be able to translate valve indices to PCS
-  // points using function `valve2p()`
-  init_valve2p();
+  // Stage 1: Load in via binary the protocol line-by-line, while playing
+  int8_t bsc_available;
+  while ((bsc_available = bsc.available())) {
+    if (bsc_available == -1) {
+      halt(8, "Stream command buffer overrun in `FSM_fun_streaming__upd()`");
+    }
+    fsm.restartTimeout();
 
-  // R Click
-  R_click_1.begin();
-  R_click_2.begin();
-  R_click_3.begin();
-  R_click_4.begin();
+    uint16_t data_len = bsc.getCommandLength();
+    uint8_t *data = bsc.getCommandData();
+    if (data_len == 0) {
+      // Found just the EOL sentinel --> This signals the end-of-stream
+      protocol_mgr.end_stream();
+      break;
+    }
 
-  // Centipedes
-  //
-  // Supported I2C clock speeds:
-  //   MCP23017 datasheet: 100 kHz, 400 kHz, 1.7 MHz
-  //   SAMD51   datasheet: 100 kHz, 400 kHz, 1 MHz, 3.4 MHz
-  // Arduino's default I2C clock speed is 100 kHz.
-  //
-  // Resulting timings of the following code block:
-  //   ```
-  //   for (cp_port = 0; cp_port < 8; cp_port++) {
-  //     cp.portWrite(cp_port, cp_data);
-  //   }
-  //   ```
-  //   100 kHz: 3177 µs
-  //   400 kHz:  908 µs
-  //   1   MHz:  457 µs  <------- Chosen
-  //   1.7 MHz: fails, too fast
+    // See `FSM_fun_uploading__upd()` for the binary format
+    line.duration = (uint16_t)data[0] << 8 | //
+                    (uint16_t)data[1];
+    line.unpack_points(&data[2], data_len > 2 ? data_len - 2 : 0);
 
-  Wire.begin();
-  Wire.setClock(1000000); // 1 MHz
-  if (!NO_PERIPHERALS) { cp_mgr.begin(); }
+    if (!protocol_mgr.push_stream_line(line)) {
+      tx.println("ERROR: Stream buffer overflow. Credit was exceeded.");
+      fsm.transitionTo(state_off);
+      return;
+    }
+    if (stream_credit > 0) {
+      stream_credit--;
+    }
+  }
 
-  // Load a protocol preset
-  load_protocol_preset(0);
+  // Grant new credit when enough room has become available
+  uint16_t room = protocol_mgr.get_stream_room();
+  if (room >= stream_credit + STREAM_CREDIT_BATCH) {
+    snprintf(buf, BUF_LEN, "credit %d", room - stream_credit);
+    tx.println(buf);
+    stream_credit = room;
+  }
 
-  // Reached the end of setup, so now show the fixed grid in the LED matrix
-  FastLED.clearData();
-  // set_LED_matrix_data_fixed_grid();
-  FastLED.show();
+  protocol_mgr.update();
 
-  if (DEBUG) {
-    Serial.print("Free mem @ loop : ");
-    Serial.println(freeMemory());
+  if (protocol_mgr.get_N_underruns() != N_underruns) {
+    N_underruns = protocol_mgr.get_N_underruns();
+    snprintf(buf, BUF_LEN, "underrun %lu", (unsigned long)N_underruns);
+    tx.println(buf);
   }
 
-  // Start Watchdog timer
-  Watchdog.enable(WATCHDOG_TIMEOUT);
+  if (protocol_mgr.stream_finished()) {
+    snprintf(buf, BUF_LEN, "Success! Streamed %lu lines with %lu underruns.",
+             (unsigned long)protocol_mgr.get_N_streamed(),
+             (unsigned long)N_underruns);
+    tx.println(buf);
+    fsm.transitionTo(state_off);
+  }
+}
+
+void FSM_fun_streaming__ext() {
+  loading_program = false;
+  protocol_mgr.stop_stream();
 }
 
+State state_streaming("Streaming", FSM_fun_streaming__ent,
+                      FSM_fun_streaming__upd, FSM_fun_streaming__ext);
+
 /*------------------------------------------------------------------------------
-  loop
+  FSM: Generating
+
+  Play a jetting protocol that gets produced on the fly by a `LineSource`:
+  Either generated endlessly from noise, see `NoiseGenerator.h`, or from
+  independently switching valves, see `MarkovGenerator.h`, interpreted from a
+  script, see `ProtocolScript.h`, repeating a protocol preset, see
+  `protocol_presets.h`, merging sub-programs per manifold, see
+  `ManifoldMux.h`, morphing between two patterns, see `MorphGenerator.h`, or
+  the timing self-test, see `TimingHarness.h`. The produced
+  lines get fed into the same ring buffer as when streaming. The protocol
+  program in memory is left intact.
 ------------------------------------------------------------------------------*/
 
-void loop() {
-  EVERY_N_SECONDS(1) { // Slowed down, because of overhead otherwise
-    Watchdog.reset();
-  }
+NoiseGenerator noise_gen;
+NoiseParams noise_params; // Parameters for the next generation, see `gen`
+MarkovGenerator markov_gen;
+MarkovParams markov_params; // Parameters for the next generation, see `markov`
+ProtocolScript protocol_script;
+PresetGenerator preset_gen; // See `preset_play_command()`
+ManifoldMux manifold_mux;   // See `manifolds_command()`
+MorphGenerator morph_gen;   // See `morph_command()`
 
-  // ---------------------------------------------------------------------------
-  //   Measure manifold pressures
-  // ---------------------------------------------------------------------------
+// Timing self-test, see `hil_command()`
+EdgeCapture edge_capture;
+bool edge_capture_ok = false; // Did `edge_capture.begin()` succeed?
+TimingHarness timing_harness(&protocol_mgr, &edge_capture);
 
-  if (!NO_PERIPHERALS) {
-    if (R_click_poll_EMA_collectively()) {
-      /*
-      if (DEBUG) {
-        // DEBUG info: Show warning when obtained interval is too large.
-        // Not necessarily problematic though. The EMA will adjust for this.
-        if (readings.DAQ_obtained_DT > DAQ_DT * 1.05) {
-          Serial.print("WARNING: Large DAQ DT ");
-          Serial.println(readings.DAQ_obtained_DT);
-        }
-      }
-      */
+LineSource *line_source = &noise_gen; // Source of the lines being played
+bool line_source_ended = false;       // Has the source run out of lines?
 
-      readings.pres_1_mA = R_click_1.bitval2mA(readings.EMA_1);
-      readings.pres_2_mA = R_click_2.bitval2mA(readings.EMA_2);
-      readings.pres_3_mA = R_click_3.bitval2mA(readings.EMA_3);
-      readings.pres_4_mA = R_click_4.bitval2mA(readings.EMA_4);
-      readings.pres_1_bar = mA2bar(readings.pres_1_mA, OMEGA_1_CALIB);
-      readings.pres_2_bar = mA2bar(readings.pres_2_mA, OMEGA_2_CALIB);
-      readings.pres_3_bar = mA2bar(readings.pres_3_mA, OMEGA_3_CALIB);
-      readings.pres_4_bar = mA2bar(readings.pres_4_mA, OMEGA_4_CALIB);
-    }
-  } else {
-    // Generate fake pressure data
-    float sin_value = 16.f + sin(2.f * PI * .1f * millis() / 1.e3f);
-    readings.pres_1_mA = sin_value;
-    readings.pres_2_mA = sin_value + .5;
-    readings.pres_3_mA = sin_value + 1.;
-    readings.pres_4_mA = sin_value + 1.5;
-    readings.pres_1_bar = mA2bar(readings.pres_1_mA, OMEGA_1_CALIB);
-    readings.pres_2_bar = mA2bar(readings.pres_2_mA, OMEGA_2_CALIB);
-    readings.pres_3_bar = mA2bar(readings.pres_3_mA, OMEGA_3_CALIB);
-    readings.pres_4_bar = mA2bar(readings.pres_4_mA, OMEGA_4_CALIB);
-  }
-
-  readings.pres_avg_bar = (readings.pres_1_bar + readings.pres_2_bar +
-                           readings.pres_3_bar + readings.pres_4_bar) /
-                          4;
-
-  // ---------------------------------------------------------------------------
-  //   Process incoming serial commands
-  // ---------------------------------------------------------------------------
+void FSM_fun_generating__ent() {
+  alive_blinker_hue = HUE_BLUE;
+  led_idle_running = true;
+  line_source->rewind();
+  line_source_ended = false;
+  protocol_mgr.start_stream();
+}
 
-  if (!loading_program) {
-    EVERY_N_MILLISECONDS(10) {
-      if (sc.available()) {
-        str_cmd = sc.getCommand();
-
-        // ***** Reporting ****
-        // ********************
-
-        if (strcmp(str_cmd, "id?") == 0) {
-          // Report identity
-          Serial.println("Arduino, Jetting Grid");
-
-        } else if (strcmp(str_cmd, "pos?") == 0) {
-          // Report current protocol position starting at index 1
-          Serial.println(get_protocol_position());
-
-        } else if (strcmp(str_cmd, "p?") == 0) {
-          // Report current protocol information, tab delimited:
-          //   1) Protocol name
-          //   2) N_lines
-          protocol_mgr.print_program();
-
-        } else if (strcmp(str_cmd, "?") == 0) {
-          // Report readings, tab delimited
-
-          // NOTE:
-          //   Using `snprintf()` to print a large array of formatted values
-          //   to a buffer followed by a single `Serial.print(buf)` is many
-          //   times faster than multiple dumb `Serial.print(value, 3);
-          //   Serial.write('\t')` statements. The latter is > 3400 µs, the
-          //   former just ~ 320 µs !!!
-          // clang-format off
-          snprintf(buf, BUF_LEN,
-                   "%d\t"
-                   "%.2f\t%.2f\t%.2f\t%.2f\t"
-                   "%.3f\t%.3f\t%.3f\t%.3f\n",
-                   get_protocol_position(),
-                   readings.pres_1_mA,
-                   readings.pres_2_mA,
-                   readings.pres_3_mA,
-                   readings.pres_4_mA,
-                   readings.pres_1_bar,
-                   readings.pres_2_bar,
-                   readings.pres_3_bar,
-                   readings.pres_4_bar);
-          // clang-format on
-          Serial.print(buf); // Takes 320 µs per call
-
-          // *****  Control  ****
-          // ********************
-
-        } else if (strcmp(str_cmd, "upload") == 0) {
-          // Upload a new protocol from the PC into Arduino memory
-          fsm.transitionTo(state_uploading);
-
-        } else if (strcmp(str_cmd, "play") == 0) {
-          // Play the protocol and automatically actuate valves over time
-          fsm.transitionTo(state_running);
-
-        } else if (strcmp(str_cmd, "stop") == 0) {
-          // Stop the protocol and close all valves immediately
-          fsm.transitionTo(state_off);
-          Serial.println(get_protocol_position());
-
-        } else if (strcmp(str_cmd, "pause") == 0) {
-          // Pause the protocol keeping the last actuated state of the valves
-          fsm.transitionTo(state_paused);
-          Serial.println(get_protocol_position());
-
-        } else if (strcmp(str_cmd, ",") == 0) {
-          // "<" Go to the previous line of the protocol and immediately
-          // activate the valves
-          protocol_mgr.goto_prev_line();
-          Serial.println(get_protocol_position());
-
-        } else if (strcmp(str_cmd, ".") == 0) {
-          // "<" Go to the next line of the protocol and immediately
-          // activate the valves
-          protocol_mgr.goto_next_line();
-          Serial.println(get_protocol_position());
-
-        } else if (strncmp(str_cmd, "goto", 4) == 0) {
-          // Go to the specified line (index starts at 1) of the protocol and
-          // immediately activate the solenoid valves
-          uint16_t tmp_int = max(parseIntInString(str_cmd, 4), 1);
-          protocol_mgr.goto_line(tmp_int - 1);
-          Serial.println(get_protocol_position());
-
-        } else if (strncmp(str_cmd, "preset", 6) == 0) {
-          // Load a protocol preset
-          uint16_t idx_preset = max(parseIntInString(str_cmd, 6), 0);
-          load_protocol_preset(idx_preset);
-
-          // ***** Debugging  ****
-          // *********************
-
-        } else if (strcmp(str_cmd, "b?") == 0) {
-          // Pretty print the current line buffer contents
-          protocol_mgr.print_buffer();
-
-        } else if (strcmp(str_cmd, "proto?") == 0) {
-          // Pretty print the full protocol program, line by line
-          protocol_mgr.print_full_program();
-
-        } else if (strcmp(str_cmd, "fsm?") == 0) {
-          // Report current Finite State Machine state name
-          Serial.println(fsm.getCurrentStateName());
-
-        } else if (strcmp(str_cmd, "halt") == 0) {
-          // Trigger a halt
-          halt(0, "Halted by user command.");
-
-        } else if (strcmp(str_cmd, "override_safety") == 0) {
-          // WARNING: Will override enable the jetting pump, regardless of
-          // whether any valves are actually open or not. This function should
-          // be used for troubleshooting only.
-          override_pump_safety = true;
-
-        } else if (strcmp(str_cmd, "restore_safety") == 0) {
-          // Revert back from the "override_safety" command: Restore the regular
-          // safety procedure to enable the jetting pump only when at least one
-          // valve is open.
-          override_pump_safety = false;
-        }
-      }
-    }
-  }
+void FSM_fun_generating__upd() {
+  uint16_t duration;
+  ValveSet valves;
 
-  // Fade out all purely blue LEDs over time, i.e. previously active valves.
-  // Keep in front of any other LED color assignments.
-  EVERY_N_MILLIS(20) {
-    for (idx_led = 0; idx_led < N_LEDS; idx_led++) {
-      if (leds[idx_led].b && !leds[idx_led].r && !leds[idx_led].g) {
-        leds[idx_led].nscale8(255 - 10);
-        // ↑ equivalent to but faster `fadeToBlackBy(&leds[idx_led], 1, 10);`
-      }
+  // Keep the stream buffer topped up, one line per iteration to bound the time
+  // spent in here
+  if (!line_source_ended && (protocol_mgr.get_stream_room() > 0)) {
+    if (line_source->next_valves(duration, valves)) {
+      protocol_mgr.push_stream_valves(duration, valves);
+    } else {
+      line_source_ended = true;
+      protocol_mgr.end_stream();
     }
   }
 
-  // ---------------------------------------------------------------------------
-  //   Handle the finite state machine
-  // ---------------------------------------------------------------------------
-
-  fsm.update();
-
-  // ---------------------------------------------------------------------------
-  //   Send out LED data to the matrix
-  // ---------------------------------------------------------------------------
-  //
-  // NOTE:
-  //   It takes 30 µs to write to one WS2812 LED. Hence, for the full 16x16
-  //   LED matrix is takes 7680 µs. I actually measure 8000 µs, using
-  //   '''
-  //     utick = micros();
-  //     FastLED.show();
-  //     Serial.println(micros() - utick);
-  //   '''
-  //   Hence, we must limit the framerate to a theoretical max of 125 Hz in
-  //   order to prevent flickering of the LEDs. Actually measured limit is
-  //   <= 80 Hz.
-  //
-  // NOTE:
-  //   Capping the framerate by calling `FastLED.setMaxRefreshRate(80)` is not
-  //   advised, because this makes `FastLED.show()` blocking while it is
-  //   waiting for the correct time to pass. Hence, we simply put the call to
-  //   `FastLED.show()` inside an `EVERY_N_MILLIS()` call to leave it
-  //   unblocking, while still capping the framerate.
-
-  EVERY_N_MILLIS(20) {
-    // Blink the 'alive' status LEDs
-    CRGB alive_blinker_color;
-    alive_blinker_color.setHSV(alive_blinker_hue, 255, beatsin8(60, 96, 223));
-    leds[p2led(P{-8, -8})] = alive_blinker_color;
-    onboard_led[0] = alive_blinker_color;
-
-    // Show the pressure VU meter on the left column of the LED matrix
-    // clang-format off
-    float P = readings.pres_avg_bar;
-    leds[240] = P >= 4.33 ? CRGB(255, 0  , 0) : CRGB(0);
-    leds[241] = P >= 4.00 ? CRGB(255, 51 , 0) : CRGB(0);
-    leds[242] = P >= 3.67 ? CRGB(255, 91 , 0) : CRGB(0);
-    leds[243] = P >= 3.33 ? CRGB(255, 128, 0) : CRGB(0);
-    leds[244] = P >= 3.00 ? CRGB(255, 163, 0) : CRGB(0);
-    leds[245] = P >= 2.67 ? CRGB(255, 199, 0) : CRGB(0);
-    leds[246] = P >= 2.33 ? CRGB(255, 235, 0) : CRGB(0);
-    leds[247] = P >= 2.00 ? CRGB(238, 255, 0) : CRGB(0);
-    leds[248] = P >= 1.67 ? CRGB(201, 255, 0) : CRGB(0);
-    leds[249] = P >= 1.33 ? CRGB(164, 255, 0) : CRGB(0);
-    leds[250] = P >= 1.00 ? CRGB(129, 255, 0) : CRGB(0);
-    leds[251] = P >= 0.67 ? CRGB(93 , 255, 0) : CRGB(0);
-    leds[252] = P >= 0.33 ? CRGB(51 , 255, 0) : CRGB(0);
-    leds[253] = P >= 0.00 ? CRGB(0  , 255, 0) : CRGB(0);
-    // clang-format on
-
-    // utick = micros();
-    FastLED.show(); // Takes 8003 µs per call
-    // Serial.println("show");
-    // Serial.println(micros() - utick);
-  }
-
-  // ---------------------------------------------------------------------------
-  //   Safety pulses
-  // ---------------------------------------------------------------------------
-
-  if (override_pump_safety) {
-    // WARNING! SAFETY OVERRIDE! FOR DEBUGGING ONLY!
-    safety__allow_jetting_pump_to_run = true;
+  protocol_mgr.update();
+  if (line_source == &timing_harness) {
+    timing_harness.update();
+  }
 
-  } else {
-    // Final safety check in effect:
-    // Don't allow the jetting pump to run when none of the valves are open
-    if (cp_mgr.all_masks_are_zero()) {
-      safety__allow_jetting_pump_to_run = false;
+  if (protocol_mgr.stream_finished()) {
+    if ((line_source == &protocol_script) && protocol_script.get_error()) {
+      tx.println(protocol_script.get_error());
+    } else if (line_source == &timing_harness) {
+      timing_harness.print_report(tx);
     } else {
-      safety__allow_jetting_pump_to_run = true;
+      snprintf(buf, BUF_LEN, "Success! Played %lu lines.",
+               (unsigned long)protocol_mgr.get_N_streamed());
+      tx.println(buf);
     }
+    fsm.transitionTo(state_off);
   }
+}
 
-  if (safety__allow_jetting_pump_to_run) {
-    // Send out safety pulses to the safety MCU
-    EVERY_N_MILLIS(PERIOD_SAFETY_PULSES / 2) {
-      // static uint32_t tick = millis();
-      // Serial.print("----> ");
-      // Serial.println(millis() - tick);
-      // tick = millis();
-      static bool toggler = false;
-      toggler = !toggler;
-      digitalWrite(PIN_SAFETY_PULSE_OUT, toggler);
-    }
+void FSM_fun_generating__ext() {
+  protocol_mgr.stop_stream();
+  if (line_source == &timing_harness) {
+    cp_mgr.set_marker(-1, 0);
   }
 }
+
+State state_generating("Generating", FSM_fun_generating__ent,
+                       FSM_fun_generating__upd, FSM_fun_generating__ext);
+
+/**
+ * @brief (Re)start playing the lines produced by @p source.
+ */
+void play_line_source(LineSource &source) {
+  line_source = &source;
+  if (fsm.isInState(state_generating)) {
+    // Restart, as transitioning to the current state is no transition
+    FSM_fun_generating__ent();
+  } else {
+    fsm.transitionTo(state_generating);
+  }
+}
+
+/**
+ * @brief Report the generator parameters, tab delimited: Seed, spatial feature
+ * size [px] and temporal feature size [lines] of set A, the same for set B,
+ * transparency [%], line duration [ms], the number of lines generated and the
+ * number of lines for which the threshold search did not converge.
+ */
+void print_noise_params() {
+  const NoiseParams &p = noise_gen.get_params();
+  snprintf(buf, BUF_LEN, "%u\t%u\t%u\t%u\t%u\t%u\t%u\t%u\t%lu\t%lu",
+           p.A.seed, p.A.spatial_feature_size, p.A.temporal_feature_size,
+           p.B.seed, p.B.spatial_feature_size, p.B.temporal_feature_size,
+           p.open_percent, p.duration,
+           (unsigned long)noise_gen.get_N_generated(),
+           (unsigned long)noise_gen.get_N_unconverged());
+  tx.println(buf);
+}
+
+/**
+ * @brief Parse up to @p N whitespace-separated integers from @p args into
+ * @p values, leaving the values beyond the given ones as they are.
+ */
+void parse_integers(const char *args, long *values, uint8_t N) {
+  char *end;
+  for (uint8_t i = 0; i < N; ++i) {
+    long parsed = strtol(args, &end, 10);
+    if (end == args) {
+      break;
+    }
+    values[i] = parsed;
+    args = end;
+  }
+}
+
+/**
+ * @brief Parse up to @p N whitespace-separated floats from @p args into
+ * @p values, leaving the values beyond the given ones as they are.
+ */
+void parse_floats(const char *args, float *values, uint8_t N) {
+  char *end;
+  for (uint8_t i = 0; i < N; ++i) {
+    float parsed = strtof(args, &end);
+    if (end == args) {
+      break;
+    }
+    values[i] = parsed;
+    args = end;
+  }
+}
+
+/**
+ * @brief (Re)start playing a protocol generated from the current
+ * `noise_params`, echoing them back, see `print_noise_params()`.
+ */
+void start_generating() {
+  noise_gen.begin(noise_params);
+  print_noise_params();
+  play_line_source(noise_gen);
+}
+
+/**
+ * @brief Handle the `gen <seed> <spatial> <temporal> <open %> <ms>` command:
+ * Start playing a protocol generated from noise, with the given parameters for
+ * set A. Trailing parameters can be left out, keeping their previous values.
+ */
+void gen_command(const char *args) {
+  long values[5] = {noise_params.A.seed, noise_params.A.spatial_feature_size,
+                    noise_params.A.temporal_feature_size,
+                    noise_params.open_percent, noise_params.duration};
+  parse_integers(args, values, 5);
+
+  noise_params.A.seed = constrain(values[0], 0, 65535);
+  noise_params.A.spatial_feature_size = constrain(values[1], 1, 60000);
+  noise_params.A.temporal_feature_size = constrain(values[2], 1, 60000);
+  noise_params.open_percent = constrain(values[3], 0, 100);
+  noise_params.duration = constrain(values[4], 1, 60000);
+  start_generating();
+}
+
+/**
+ * @brief Handle the `preset_play <idx> <ms> <percent>` command: Start playing
+ * protocol preset `idx` endlessly, without loading it into memory, see
+ * `PresetGenerator::begin()`. Trailing parameters can be left out, taking
+ * their defaults. Echoes the name of the preset back.
+ */
+void preset_play_command(const char *args) {
+  long values[3] = {0, 0, 50};
+  parse_integers(args, values, 3);
+
+  preset_gen.begin(constrain(values[0], 0, 255), constrain(values[1], 0, 60000),
+                   constrain(values[2], 0, 100));
+  tx.println(preset_gen.get_name());
+  play_line_source(preset_gen);
+}
+
+/**
+ * @brief Handle the `manifolds <N1> <N2> <N3> <N4>` command: Start playing the
+ * protocol program in memory as independent sub-programs of `N1` to `N4` lines
+ * for manifolds 1 to 4, back to back, see `ManifoldMux.h`. Trailing parameters
+ * can be left out, defaulting to 0, i.e. keeping that manifold closed. Echoes
+ * the sub-programs back, see `manifolds?`.
+ */
+void manifolds_command(const char *args) {
+  long values[N_MANIFOLDS] = {0};
+  parse_integers(args, values, N_MANIFOLDS);
+
+  std::array<uint16_t, N_MANIFOLDS> N_lines;
+  for (uint8_t idx = 0; idx < N_MANIFOLDS; ++idx) {
+    N_lines[idx] = constrain(values[idx], 0, PROTOCOL_MAX_LINES);
+  }
+  if (!manifold_mux.begin(&protocol_mgr, N_lines)) {
+    tx.println("ERROR: Sub-programs don't fit the protocol program.");
+    return;
+  }
+  manifold_mux.print(tx);
+  play_line_source(manifold_mux);
+}
+
+/**
+ * @brief Handle the `morph <line A> <line B> <T ms> <step ms> <seed>` command:
+ * Start morphing the valve pattern of line A of the protocol program in
+ * memory into that of line B over T ms, in time steps of `step ms`, see
+ * `MorphGenerator.h`. Line numbers start at index 1. Trailing parameters can
+ * be left out, defaulting to lines 1 and 2, 10 s, 100 ms and seed 1. Echoes
+ * the morph back, see `morph?`.
+ */
+void morph_command(const char *args) {
+  long values[5] = {1, 2, 10000, 100, 1};
+  parse_integers(args, values, 5);
+
+  if (!morph_gen.begin(&protocol_mgr, constrain(values[0] - 1, 0, 65535),
+                       constrain(values[1] - 1, 0, 65535),
+                       constrain(values[2], 0, 86400000),
+                       constrain(values[3], 1, 60000),
+                       constrain(values[4], 0, 65535))) {
+    tx.println("ERROR: Lines exceed the protocol program.");
+    return;
+  }
+  morph_gen.print(tx);
+  play_line_source(morph_gen);
+}
+
+/**
+ * @brief Handle the `gen_b <seed> <spatial> <temporal>` command: Set the
+ * parameters of set B, mixed into set A when generating. A spatial feature size
+ * of 0 disables set B. Trailing parameters can be left out, keeping their
+ * previous values. Restarts the generation when generating from noise, else
+ * only echoes the parameters back.
+ */
+void gen_b_command(const char *args) {
+  long values[3] = {noise_params.B.seed, noise_params.B.spatial_feature_size,
+                    noise_params.B.temporal_feature_size};
+  parse_integers(args, values, 3);
+
+  noise_params.B.seed = constrain(values[0], 0, 65535);
+  noise_params.B.spatial_feature_size = constrain(values[1], 0, 60000);
+  noise_params.B.temporal_feature_size = constrain(values[2], 1, 60000);
+  if (fsm.isInState(state_generating) && (line_source == &noise_gen)) {
+    start_generating();
+  } else {
+    noise_gen.begin(noise_params);
+    print_noise_params();
+  }
+}
+
+/**
+ * @brief Report the parameters of the Markov generator, tab delimited: Seed,
+ * time quantum [ms], mean on duration [ms], mean off duration [ms], the number
+ * of lines generated and the number of valve switches.
+ */
+void print_markov_params() {
+  snprintf(buf, BUF_LEN, "%u\t%u\t%lu\t%lu\t%lu\t%lu",
+           markov_gen.get_params().seed, markov_gen.get_params().quantum,
+           (unsigned long)markov_gen.get_mean_on_ms(),
+           (unsigned long)markov_gen.get_mean_off_ms(),
+           (unsigned long)markov_gen.get_N_generated(),
+           (unsigned long)markov_gen.get_N_switches());
+  tx.println(buf);
+}
+
+/**
+ * @brief Handle the `markov <seed> <quantum ms>` command: Start playing a
+ * protocol of independently switching valves, see `MarkovGenerator.h`, echoing
+ * the parameters back, see `print_markov_params()`. Trailing parameters can be
+ * left out, keeping their previous values.
+ */
+void markov_command(const char *args) {
+  long values[2] = {markov_params.seed, markov_params.quantum};
+  parse_integers(args, values, 2);
+
+  markov_params.seed = constrain(values[0], 0, 65535);
+  markov_params.quantum = constrain(values[1], 1, MARKOV_QUANTUM_MAX);
+  markov_gen.begin(markov_params);
+  print_markov_params();
+  play_line_source(markov_gen);
+}
+
+/**
+ * @brief Handle the `markov_on <q1> ... <q16>` and `markov_off <q1> ... <q16>`
+ * commands: Set the `MARKOV_TABLE_LEN` quantiles [ms] of the distribution of
+ * the on or off durations into @p table. Trailing quantiles can be left out,
+ * keeping their previous values. Restarts the generation when generating from
+ * the Markov generator, else only echoes the parameters back.
+ */
+void markov_table_command(const char *args, MarkovTable &table) {
+  long values[MARKOV_TABLE_LEN];
+  for (uint8_t idx = 0; idx < MARKOV_TABLE_LEN; ++idx) {
+    values[idx] = table[idx];
+  }
+  parse_integers(args, values, MARKOV_TABLE_LEN);
+
+  for (uint8_t idx = 0; idx < MARKOV_TABLE_LEN; ++idx) {
+    table[idx] = constrain(values[idx], 0, 60000);
+  }
+  markov_gen.begin(markov_params);
+  print_markov_params();
+  if (fsm.isInState(state_generating) && (line_source == &markov_gen)) {
+    play_line_source(markov_gen);
+  }
+}
+
+/*------------------------------------------------------------------------------
+  FSM: Live
+
+  Apply the valve states sent by a real-time controller on the PC right away,
+  frame by frame, e.g. for closed-loop control on flow measurements. No timing
+  is involved on the Arduino side: A frame holds for as long as the next one
+  takes to arrive. The protocol program in memory is left intact.
+------------------------------------------------------------------------------*/
+
+// Binary frame, `LIVE_FRAME_LEN` bytes:
+//   [0]       `LIVE_MARKER`, or `LIVE_END_MARKER` to end the live mode
+//   [1]       Sequence number, incremented per frame, wrapping around
+//   [2..15]   Valve bitset: Bit `(valve - 1) % 8` of byte `(valve - 1) / 8`
+//   [16..19]  CRC32 over bytes 1 to 15, little endian
+// Frames with a sequence number not newer than the last applied one are stale
+// and get dropped, as are corrupt frames.
+const uint8_t LIVE_MARKER = 0x3C;
+const uint8_t LIVE_END_MARKER = 0x3E;
+const uint8_t LIVE_BITSET_LEN = (N_VALVES + 7) / 8;
+const uint8_t LIVE_FRAME_LEN = 2 + LIVE_BITSET_LEN + 4;
+
+// Default time [ms] without a valid frame after which all valves get closed
+const uint16_t LIVE_DEADLINE = 100;
+
+// Leave the live mode when no valid frame has been received for this long
+const uint16_t LIVE_TIMEOUT = 7000; // [ms]
+
+uint8_t live_frame[LIVE_FRAME_LEN];
+uint8_t live_len = 0;                   // Bytes of `live_frame` received
+uint8_t live_seq = 0;                   // Sequence number of the last frame
+uint16_t live_deadline = LIVE_DEADLINE; // See `LIVE_DEADLINE`
+bool live_ack = false;                  // Reply "ack <seq>" per frame?
+bool live_expired = false;              // Have the valves been closed?
+uint32_t live_tick_frame = 0;           // Time [ms] of the last valid frame
+uint32_t live_t_marker_us = 0;          // Time [µs] the frame marker came in
+bool live_pending = false;              // Are port writes pending completion?
+
+/**
+ * @brief Statistics of the live mode, kept after leaving it, see `live?`.
+ */
+struct LiveStats {
+  uint32_t N_applied = 0;        // Frames applied
+  uint32_t N_stale = 0;          // Frames dropped for being out of order
+  uint32_t N_corrupt = 0;        // Frames dropped for a CRC mismatch
+  uint32_t N_expired = 0;        // Deadline misses, closing all valves
+  uint32_t min_us = UINT32_MAX;  // Shortest frame-to-valve latency [µs]
+  uint32_t max_us = 0;           // Longest frame-to-valve latency [µs]
+  uint64_t sum_us = 0;           // Sum of the frame-to-valve latencies [µs]
+} live_stats;
+
+/**
+ * @brief Translate the valve bitset of a live frame into Centipede port
+ * bitmasks.
+ */
+CP_Masks live_bitset_to_masks(const uint8_t *bitset) {
+  ValveSet valves;
+  valves.unpack_bytes(bitset, LIVE_BITSET_LEN);
+  return valves.to_cp_masks();
+}
+
+/**
+ * @brief Send out @p masks to the valves and the LED matrix.
+ */
+void live_apply(const CP_Masks &masks) {
+  cp_mgr.set_masks(masks);
+  cp_mgr.send_masks();
+  protocol_mgr.color_leds(masks);
+}
+
+/**
+ * @brief Leave live mode once no frame has been applied for `LIVE_TIMEOUT`,
+ * see `FiniteStateMachine::setTimeout()`.
+ */
+void live_timed_out() {
+  tx.println("ERROR: Live mode timed out.");
+  fsm.transitionTo(state_off);
+}
+
+void FSM_fun_live__ent() {
+  alive_blinker_hue = HUE_BLUE;
+  led_idle_running = true;
+  loading_program = true;
+  live_stats = LiveStats();
+  live_len = 0;
+  live_expired = true; // Valves stay as they are until the first frame
+  live_pending = false;
+  live_tick_frame = millis();
+  fsm.setTimeout(LIVE_TIMEOUT, live_timed_out);
+  tx.println("live");
+}
+
+void FSM_fun_live__upd() {
+  // Complete the latency measurement once the port writes have gone out
+  if (live_pending && !cp_mgr.tx_busy()) {
+    live_pending = false;
+    uint32_t dt = cp_mgr.get_tx_done_us() - live_t_marker_us;
+    live_stats.min_us = min(live_stats.min_us, dt);
+    live_stats.max_us = max(live_stats.max_us, dt);
+    live_stats.sum_us += dt;
+    if (live_ack) {
+      snprintf(buf, BUF_LEN, "ack %u", live_seq);
+      tx.println(buf);
+    }
+  }
+
+  while (!live_pending && Serial.available()) {
+    if (live_len == 0) {
+      uint8_t marker = Serial.read();
+      if ((marker == LIVE_MARKER) || (marker == LIVE_END_MARKER)) {
+        live_frame[live_len++] = marker;
+        live_t_marker_us = micros();
+      }
+      continue; // Resynchronize on the start-of-frame marker
+    }
+
+    live_len += Serial.readBytes((char *)&live_frame[live_len],
+                                 min(Serial.available(),
+                                     (int)(LIVE_FRAME_LEN - live_len)));
+    if (live_len < LIVE_FRAME_LEN) {
+      break;
+    }
+    live_len = 0;
+
+    const uint8_t *p_crc = &live_frame[LIVE_FRAME_LEN - 4];
+    uint32_t crc = (uint32_t)p_crc[0] | (uint32_t)p_crc[1] << 8 |
+                   (uint32_t)p_crc[2] << 16 | (uint32_t)p_crc[3] << 24;
+    if (crc != crc32(&live_frame[1], LIVE_FRAME_LEN - 5)) {
+      live_stats.N_corrupt++;
+      continue;
+    }
+    if (live_frame[0] == LIVE_END_MARKER) {
+      fsm.transitionTo(state_off);
+      return;
+    }
+
+    uint8_t seq = live_frame[1];
+    if ((live_stats.N_applied > 0) && ((int8_t)(seq - live_seq) <= 0)) {
+      live_stats.N_stale++;
+      continue;
+    }
+
+    live_apply(live_bitset_to_masks(&live_frame[2]));
+    live_seq = seq;
+    live_stats.N_applied++;
+    live_tick_frame = millis();
+    fsm.restartTimeout();
+    live_expired = false;
+    live_pending = true; // Leave the next frame for the next iteration
+  }
+
+  // Deadline: Close all valves when the controller has gone quiet
+  if (!live_expired && (millis() - live_tick_frame > live_deadline)) {
+    live_expired = true;
+    live_stats.N_expired++;
+    live_apply(CP_Masks{});
+  }
+}
+
+void FSM_fun_live__ext() { loading_program = false; }
+
+State state_live("Live", FSM_fun_live__ent, FSM_fun_live__upd,
+                 FSM_fun_live__ext);
+
+/**
+ * @brief Handle the `live <deadline ms> <ack>` command: Enter the live mode,
+ * see `FSM: Live`. Trailing parameters can be left out, taking their defaults.
+ * Replies "live" once ready to receive frames.
+ */
+void live_command(const char *args) {
+  if (fsm.isInState(state_running) || fsm.isInState(state_streaming) ||
+      fsm.isInState(state_generating) || fsm.isInState(state_armed)) {
+    tx.println("ERROR: Not allowed while running.");
+    return;
+  }
+
+  long values[2] = {LIVE_DEADLINE, 0};
+  parse_integers(args, values, 2);
+  live_deadline = constrain(values[0], 1, LIVE_TIMEOUT);
+  live_ack = (values[1] != 0);
+  fsm.transitionTo(state_live);
+}
+
+/**
+ * @brief Print the statistics of the live mode, tab delimited: Frames applied,
+ * stale, corrupt, deadline misses, followed by the min, mean and max latency
+ * [µs] from receiving the frame marker until the valves had been written.
+ */
+void print_live_stats() {
+  const LiveStats &s = live_stats;
+  uint32_t N = s.N_applied - live_pending;
+  snprintf(buf, BUF_LEN, "%lu\t%lu\t%lu\t%lu\t%lu\t%lu\t%lu",
+           (unsigned long)s.N_applied, (unsigned long)s.N_stale,
+           (unsigned long)s.N_corrupt, (unsigned long)s.N_expired,
+           (unsigned long)(N ? s.min_us : 0),
+           (unsigned long)(N ? s.sum_us / N : 0), (unsigned long)s.max_us);
+  tx.println(buf);
+}
+
+/*------------------------------------------------------------------------------
+  FSM: PWM
+
+  Pulse-width modulate the valves, each at its own duty cycle and period, see
+  `ValvePWM.h`. Set up the valves with `pwm` first.
+------------------------------------------------------------------------------*/
+
+void FSM_fun_pwm__ent() {
+  alive_blinker_hue = HUE_BLUE;
+  led_idle_running = true;
+
+  // The LEDs would flicker at the tick rate, hence show the modulated valves
+  protocol_mgr.color_leds(valve_pwm.get_active_masks());
+  valve_pwm.start();
+}
+
+void FSM_fun_pwm__upd() { valve_pwm.update(); }
+
+void FSM_fun_pwm__ext() { valve_pwm.stop(); }
+
+State state_pwm("PWM", FSM_fun_pwm__ent, FSM_fun_pwm__upd, FSM_fun_pwm__ext);
+
+/**
+ * @brief Handle the `pwm <valve> <on ticks> <period ticks>` command: Set the
+ * modulation of a single valve, or of all valves for valve 0, see
+ * `ValvePWM::set()`. Leaving out the period keeps the present one, leaving out
+ * the on-time as well only reports them. Replies with the on-time and period,
+ * tab delimited, of valve 1 in case of all valves.
+ */
+void pwm_command(const char *args) {
+  long values[3] = {-1, -1, -1};
+  parse_integers(args, values, 3);
+  if ((values[0] < 0) || (values[0] > N_VALVES)) {
+    tx.println("ERROR: Invalid valve number.");
+    return;
+  }
+
+  uint8_t valve = values[0];
+  uint8_t on, period;
+  valve_pwm.get(valve ? valve : 1, on, period);
+  if (values[1] >= 0) {
+    on = constrain(values[1], 0, PWM_MAX_TICKS);
+    if (values[2] >= 0) {
+      period = constrain(values[2], 0, PWM_MAX_TICKS);
+    }
+    valve_pwm.set(valve, on, period);
+  }
+  snprintf(buf, BUF_LEN, "%u\t%u", on, period);
+  tx.println(buf);
+}
+
+/*------------------------------------------------------------------------------
+  FSM: Uploading script
+
+  Upload a protocol script from the PC into Arduino memory, see
+  `ProtocolScript.h`. Any playback gets stopped.
+------------------------------------------------------------------------------*/
+
+// Stage 0: Load in via ASCII the size [bytes] of the script that follows.
+// Stage 1: Load in via binary the script, followed by its uint32_t CRC32,
+//          little endian.
+uint8_t script_stage = 0;
+uint16_t script_N_bytes = 0;    // Promised size of the script [bytes]
+uint16_t script_N_received = 0; // Number of bytes received, including the CRC
+uint8_t script_crc[4];          // Received CRC32 of the script
+
+/**
+ * @brief Abort the script upload once no data has been received for
+ * `LOADING_TIMEOUT`, see `FiniteStateMachine::setTimeout()`.
+ */
+void uploading_script_timed_out() {
+  if (script_stage == 1) {
+    protocol_script.adopt(0); // Partially overwritten
+  }
+  tx.println("ERROR: Loading in script timed out.");
+  fsm.transitionTo(state_off);
+}
+
+void FSM_fun_uploading_script__ent() {
+  alive_blinker_hue = HUE_BLUE;
+  led_idle_running = false;
+  loading_program = true;
+  script_stage = 0;
+  script_N_received = 0;
+  fsm.setTimeout(LOADING_TIMEOUT, uploading_script_timed_out);
+}
+
+void FSM_fun_uploading_script__upd() {
+  // Stage 0: Load in via ASCII the size of the script
+  if ((script_stage == 0) && sc.available()) {
+    int N_bytes = atoi(sc.getCommand());
+    if ((N_bytes < 0) || (N_bytes > SCRIPT_MAX_BYTES)) {
+      snprintf(buf, BUF_LEN,
+               "ERROR: Script exceeds the maximum size of %u bytes.",
+               SCRIPT_MAX_BYTES);
+      tx.println(buf);
+      fsm.transitionTo(state_off);
+      return;
+    }
+
+    script_N_bytes = N_bytes;
+    tx.println(script_N_bytes);
+    fsm.restartTimeout();
+    script_stage++;
+  }
+
+  // Stage 1: Load in via binary the script, followed by its CRC32. The old
+  // script gets overwritten.
+  if (script_stage == 1) {
+    uint8_t *script = protocol_script.buffer();
+    while (Serial.available() && (script_N_received < script_N_bytes + 4)) {
+      uint8_t c = Serial.read();
+      if (script_N_received < script_N_bytes) {
+        script[script_N_received] = c;
+      } else {
+        script_crc[script_N_received - script_N_bytes] = c;
+      }
+      script_N_received++;
+      fsm.restartTimeout();
+    }
+
+    if (script_N_received == script_N_bytes + 4) {
+      uint32_t crc = (uint32_t)script_crc[0] | (uint32_t)script_crc[1] << 8 |
+                     (uint32_t)script_crc[2] << 16 |
+                     (uint32_t)script_crc[3] << 24;
+      if (crc != crc32(script, script_N_bytes)) {
+        protocol_script.adopt(0);
+        tx.println("ERROR: Script failed its CRC check.");
+      } else if (protocol_script.adopt(script_N_bytes)) {
+        tx.println("Success!");
+      } else {
+        tx.println(protocol_script.get_error());
+      }
+      fsm.transitionTo(state_off);
+    }
+  }
+}
+
+void FSM_fun_uploading_script__ext() { loading_program = false; }
+
+State state_uploading_script("Uploading script", FSM_fun_uploading_script__ent,
+                             FSM_fun_uploading_script__upd,
+                             FSM_fun_uploading_script__ext);
+
+/*------------------------------------------------------------------------------
+  Telemetry
+------------------------------------------------------------------------------*/
+
+// Binary telemetry packets pushed to the PC once subscribed to. Suspended while
+// loading in a protocol program, because the PC is then awaiting replies.
+Telemetry telemetry;
+
+// Concurrent subscriptions to a selection of fields, each at its own rate. See
+// command `tsub`.
+TelemetrySubscriptions telemetry_subs;
+
+// Number of lines to look ahead for the open-valve count in the telemetry, for
+// feed-forward control of the pump. See command `lookahead`.
+uint16_t lookahead_lines = 0;
+
+/**
+ * @brief Return the current FSM state as a `TelemetryState`.
+ */
+uint8_t get_telemetry_state() {
+  if (fsm.isInState(state_running)) {
+    return TELEMETRY_RUNNING;
+  } else if (fsm.isInState(state_paused)) {
+    return TELEMETRY_PAUSED;
+  } else if (fsm.isInState(state_uploading) ||
+             fsm.isInState(state_uploading_script)) {
+    return TELEMETRY_UPLOADING;
+  } else if (fsm.isInState(state_streaming)) {
+    return TELEMETRY_STREAMING;
+  } else if (fsm.isInState(state_generating)) {
+    return TELEMETRY_GENERATING;
+  } else if (fsm.isInState(state_armed)) {
+    return TELEMETRY_ARMED;
+  } else if (fsm.isInState(state_live)) {
+    return TELEMETRY_LIVE;
+  } else if (fsm.isInState(state_pwm)) {
+    return TELEMETRY_PWM;
+  }
+  return TELEMETRY_OFF;
+}
+
+/**
+ * @brief Return the current FSM state as a `SafetyState`, to be reported to
+ * the safety MCU.
+ */
+SafetyState get_safety_state() {
+  switch (get_telemetry_state()) {
+    case TELEMETRY_OFF:
+      return SAFETY_STATE_IDLE;
+    case TELEMETRY_PAUSED:
+      return SAFETY_STATE_PAUSED;
+    case TELEMETRY_UPLOADING:
+      return SAFETY_STATE_LOADING;
+    default:
+      return SAFETY_STATE_PLAYING;
+  }
+}
+
+/**
+ * @brief Return the time left [µs] until the next protocol line switch, or
+ * `UINT32_MAX` when no protocol is being played, see `LEDGovernor`.
+ */
+uint32_t us_until_line_switch() {
+  bool playing = (get_safety_state() == SAFETY_STATE_PLAYING) ||
+                 (fsm.isInState(state_uploading) && upload_in_background);
+  return playing ? protocol_mgr.get_us_until_switch() : UINT32_MAX;
+}
+
+// Runs the main-loop tasks in between the line switches, see `add_tasks()`
+TaskScheduler scheduler(us_until_line_switch);
+
+/**
+ * @brief Return how long [µs] the main loop can sleep, see
+ * `TaskScheduler::set_idle()`. Only in the Off and Paused states, with no
+ * command, output, background write or dump pending. A polled reading of the
+ * R Clicks wakes it in time for the next DAQ tick.
+ */
+uint32_t us_idle() {
+  loop_monitor.stage(LOOP_IDLE); // Any sleep counts as such
+  if (!fsm.isInState(state_off) && !fsm.isInState(state_paused)) {
+    return 0;
+  }
+  if (Serial.available() || tx.size() || cp_mgr.tx_busy() ||
+      protocol_mgr.is_dumping()) {
+    return 0;
+  }
+#if USB_BULK
+  if (usb_tx.size()) {
+    return 0;
+  }
+#endif
+
+  if (r_click_via_dma && !peripheral_sim.is_enabled()) {
+    return UINT32_MAX; // The readings queue up in the background
+  }
+  uint32_t since_us = micros() - DAQ_tick;
+  uint32_t DT_us = daq_rate.get_interval_us();
+  return (since_us < DT_us) ? DT_us - since_us : 0;
+}
+
+/**
+ * @brief Send out a telemetry packet with the current readings.
+ */
+void send_telemetry() {
+  TelemetryPacket packet;
+  packet.position = get_protocol_position();
+  packet.time_us = micros();
+  for (uint8_t ch = 0; ch < N_R_CLICKS; ++ch) {
+    packet.EMA_q4[ch] = bitval2q4(readings.EMA.value[ch]);
+    packet.pres_mbar[ch] = readings.pres_mbar[ch];
+  }
+  packet.fsm_state = get_telemetry_state();
+  for (uint8_t idx = 0; idx < N_MANIFOLDS; ++idx) {
+    packet.N_open[idx] = cp_mgr.get_N_open(idx);
+  }
+  packet.N_open_ahead = protocol_mgr.get_N_open_ahead(lookahead_lines);
+  telemetry.send(bulk_out(), packet);
+}
+
+/**
+ * @brief Send out a record of each due telemetry subscription, gathering only
+ * the @p fields selected by them, see `TelemetrySubscriptions`.
+ */
+void send_telemetry_records(uint16_t fields) {
+  TelemetrySnapshot snap;
+  if (fields & TFIELD_TIME) {
+    snap.time_us = micros();
+  }
+  if (fields & TFIELD_POSITION) {
+    snap.position = get_protocol_position();
+  }
+  if (fields & TFIELD_STATE) {
+    snap.fsm_state = get_telemetry_state();
+  }
+  for (uint8_t ch = 0; ch < N_R_CLICKS; ++ch) {
+    snap.pres_mbar[ch] = readings.pres_mbar[ch];
+    snap.raw[ch] = readings.bitval[ch];
+  }
+  snap.pres_avg_mbar = readings.pres_avg_mbar;
+  if (fields & TFIELD_EMA) {
+    for (uint8_t ch = 0; ch < N_R_CLICKS; ++ch) {
+      snap.EMA_q4[ch] = bitval2q4(readings.EMA.value[ch]);
+    }
+  }
+  if (fields & TFIELD_N_OPEN) {
+    for (uint8_t idx = 0; idx < N_MANIFOLDS; ++idx) {
+      snap.N_open[idx] = cp_mgr.get_N_open(idx);
+    }
+  }
+  if (fields & TFIELD_N_OPEN_AHEAD) {
+    snap.N_open_ahead = protocol_mgr.get_N_open_ahead(lookahead_lines);
+  }
+  if (fields & TFIELD_I2C) {
+    const CSFaults &faults = cp_mgr.get_faults();
+    snap.i2c[0] = cp_mgr.get_N_tx_failed();
+    snap.i2c[1] = cp_mgr.get_N_mismatches();
+    snap.i2c[2] = faults.timeouts;
+    snap.i2c[3] = faults.clears;
+    snap.i2c[4] = faults.retries;
+  }
+  telemetry_subs.send(bulk_out(), snap);
+}
+
+// Maximum number of valve events per dump, see `dump_valve_events()`
+const uint16_t VALVE_EVENTS_PER_DUMP = 32;
+
+/**
+ * @brief Drain the oldest valve events from the log, see `ValveEventLog`.
+ * Replies with the number N of drained events as ASCII line, followed by a
+ * single frame holding N packed `ValveEvent`s, see `Telemetry.h`.
+ */
+void dump_valve_events() {
+  ValveEvent events[VALVE_EVENTS_PER_DUMP];
+  static uint8_t frame[cobs_frame_len(sizeof(events))];
+
+  uint16_t N =
+      protocol_mgr.get_event_log().drain(events, VALVE_EVENTS_PER_DUMP);
+  tx.println(N);
+  tx.write(frame, cobs_frame((const uint8_t *)events,
+                             N * sizeof(ValveEvent), frame));
+}
+
+// Maximum number of line pressure records per dump, see `dump_line_pressures()`
+const uint16_t LINE_PRESSURES_PER_DUMP = 16;
+
+/**
+ * @brief Drain the oldest line pressure records from the log, see
+ * `LinePressureLog`. Replies with the number N of drained records as ASCII
+ * line, followed by a single frame holding N packed `LinePressure`s.
+ */
+void dump_line_pressures() {
+  LinePressure records[LINE_PRESSURES_PER_DUMP];
+  static uint8_t frame[cobs_frame_len(sizeof(records))];
+
+  uint16_t N = line_pressure_log.drain(records, LINE_PRESSURES_PER_DUMP);
+  tx.println(N);
+  tx.write(frame, cobs_frame((const uint8_t *)records,
+                             N * sizeof(LinePressure), frame));
+}
+
+// Maximum number of trace records per dump, see `dump_trace()`
+const uint16_t TRACE_RECORDS_PER_DUMP = 32;
+
+/**
+ * @brief Drain the oldest records from the trace, see `Trace.h`. Replies with
+ * the number N of drained records as ASCII line, followed by a single frame
+ * holding N packed `TraceRecord`s.
+ */
+void dump_trace() {
+  TraceRecord records[TRACE_RECORDS_PER_DUMP];
+  static uint8_t frame[cobs_frame_len(sizeof(records))];
+
+  uint16_t N = trace_drain(records, TRACE_RECORDS_PER_DUMP);
+  tx.println(N);
+  tx.write(frame, cobs_frame((const uint8_t *)records,
+                             N * sizeof(TraceRecord), frame));
+}
+
+// Maximum number of flash log records per dump, see `dump_flash_log()`
+const uint16_t FLASH_LOG_RECORDS_PER_DUMP = 32;
+
+/**
+ * @brief Read the next records from the flash log, see `FlashLog::rewind()`.
+ * Replies with the number N of read records as ASCII line, followed by a
+ * single frame holding N packed `FlashLogRecord`s. N is 0 at the end of the
+ * log.
+ */
+void dump_flash_log() {
+  FlashLogRecord records[FLASH_LOG_RECORDS_PER_DUMP];
+  static uint8_t frame[cobs_frame_len(sizeof(records))];
+
+  uint16_t N = flash_log.read(records, FLASH_LOG_RECORDS_PER_DUMP);
+  tx.println(N);
+  tx.write(frame, cobs_frame((const uint8_t *)records,
+                             N * sizeof(FlashLogRecord), frame));
+}
+
+// Maximum number of phase-averaged cells per dump, see `dump_phase_avg()`
+const uint16_t PHASE_CELLS_PER_DUMP = 32;
+
+/**
+ * @brief Read out the next cells of the phase-averaged grid, see
+ * `PhaseAverager::rewind()`. Replies with the number N of read cells as ASCII
+ * line, followed by a single frame holding N packed `PhaseCell`s. N is 0 past
+ * the last cell.
+ */
+void dump_phase_avg() {
+  PhaseCell cells[PHASE_CELLS_PER_DUMP];
+  static uint8_t frame[cobs_frame_len(sizeof(cells))];
+
+  uint16_t N = phase_avg.read(cells, PHASE_CELLS_PER_DUMP);
+  tx.println(N);
+  tx.write(frame,
+           cobs_frame((const uint8_t *)cells, N * sizeof(PhaseCell), frame));
+}
+
+// Snapshot of the applied valves, see `dump_valve_snapshot()`
+struct __attribute__((packed)) ValveSnapshot {
+  uint32_t time_us;                // Timestamp [µs]
+  uint8_t bitset[LIVE_BITSET_LEN]; // Open valves, as in a live frame
+};
+
+/**
+ * @brief Reply with a single frame holding a `ValveSnapshot` of the valves as
+ * last sent to the Centipedes, i.e. the ground truth, whether playing the
+ * program in memory, streaming, generating, live, transformed or not. Bit
+ * `(valve - 1) % 8` of byte `(valve - 1) / 8` is set for an open valve. Cheap
+ * enough to be polled at the refresh rate of a GUI.
+ */
+void dump_valve_snapshot() {
+  ValveSnapshot snapshot{};
+  static uint8_t frame[cobs_frame_len(sizeof(snapshot))];
+
+  CP_Masks masks = cp_mgr.get_sent_masks();
+  snapshot.time_us = micros();
+  for (uint8_t port = 0; port < N_CP_PORTS; ++port) {
+    uint16_t bits = masks[port];
+    while (bits) {
+      uint8_t valve = CP2VALVE[port][__builtin_ctz(bits)];
+      bits &= bits - 1; // Clear lowest set bit
+      if (valve) {
+        snapshot.bitset[(valve - 1) / 8] |= 1U << ((valve - 1) % 8);
+      }
+    }
+  }
+  tx.write(frame, cobs_frame((const uint8_t *)&snapshot, sizeof(snapshot),
+                             frame));
+}
+
+/*------------------------------------------------------------------------------
+  Benchmark
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Time fixed workloads of the hot paths with the DWT cycle counter and
+ * print the results via `perf_bench_print()`, one line per workload, compared
+ * against the baseline stored in flash, see `BenchBaseline.h`. Closes with
+ * the number of regressions, see `perf_bench_end()`. See also
+ * `perf_bench_cycles()`.
+ *
+ * The `send_masks` workloads toggle the unwired Centipede channels only, so
+ * no valve moves. The `activate_112` workload does open and close all valves
+ * and ends with the valves of the current line restored. The
+ * `halt_safe_state` workload, see `halt_safe_state()`, only runs when all
+ * valves are closed already, as it drops the pump relay.
+ */
+void run_benchmark() {
+  CP_Masks masks = cp_mgr.get_masks();
+  CP_Masks spare_all;
+  CP_Masks spare_one;
+
+  perf_cycles_begin();
+  perf_bench_begin();
+
+  // Per port, a single Centipede channel without a valve wired to it
+  for (uint8_t port = 0; port < N_CP_PORTS; ++port) {
+    spare_all[port] = 0;
+    spare_one[port] = 0;
+    for (uint8_t bit = 0; bit < 16; ++bit) {
+      if (cp2valve(CP_Address{port, bit}) == 0) {
+        spare_all[port] = 1 << bit;
+        break;
+      }
+    }
+  }
+  spare_one[0] = spare_all[0];
+
+  // Sends out the current masks XOR-ed with the spare channels
+  auto send_toggled = [&](const CP_Masks &spare) {
+    CP_Masks toggled;
+    for (uint8_t port = 0; port < N_CP_PORTS; ++port) {
+      toggled[port] = masks[port] ^ spare[port];
+    }
+    cp_mgr.set_masks(toggled);
+    cp_mgr.send_masks();
+  };
+  auto send_current = [&] {
+    cp_mgr.set_masks(masks);
+    cp_mgr.send_masks();
+  };
+
+  protocol_mgr.benchmark(tx);
+
+  if (!NO_PERIPHERALS) {
+    perf_bench_print(tx, "send_masks_all",
+                     perf_bench_cycles(send_current,
+                                       [&] { send_toggled(spare_all); }),
+                     sizeof(CP_Masks));
+    perf_bench_print(tx, "send_masks_one",
+                     perf_bench_cycles(send_current,
+                                       [&] { send_toggled(spare_one); }),
+                     sizeof(uint16_t));
+    send_current();
+  }
+
+  perf_bench_print(tx, "show_onboard_led", perf_bench_cycles([] {
+                     onboard_led_ctrl->showLeds(FastLED.getBrightness());
+                   }),
+                   sizeof(CRGB));
+  if (led_matrix_ctrl) {
+    perf_bench_print(tx, "show_led_matrix", perf_bench_cycles([] {
+                       led_matrix_ctrl->showLeds(FastLED.getBrightness());
+                     }),
+                     sizeof(leds));
+  }
+
+  if (!NO_PERIPHERALS && !r_click_via_dma) {
+    // The SPI bus is owned by the background acquisition otherwise
+    uint16_t bitval[N_R_CLICKS];
+    perf_bench_print(tx, "R_click_x4", perf_bench_cycles([&] {
+                       R_clicks.read_bitvals(bitval);
+                     }),
+                     sizeof(bitval));
+  }
+
+  EMAFilter<N_R_CLICKS> EMA = readings.EMA;
+  const uint16_t bitval[N_R_CLICKS] = {2000, 2001, 2002, 2003};
+  perf_bench_print(tx, "EMA_update",
+                   perf_bench_cycles([&] { EMA.update(DAQ_DT, bitval); }));
+
+  perf_bench_print(tx, "format_readings",
+                   perf_bench_cycles([] { format_readings(); }));
+
+  if (cp_mgr.all_masks_are_zero()) {
+    // The safety pulses resume by themselves in the next `loop()`
+    perf_bench_print(tx, "halt_safe_state",
+                     perf_bench_cycles([] { halt_safe_state(); }));
+  }
+
+  perf_bench_end(tx);
+}
+
+// Largest number of bytes of a USB benchmark, see `bench_usb_command()`
+const uint32_t BENCH_USB_MAX_BYTES = 1 << 20;
+
+// Time-out [ms] of a USB benchmark when the PC stops reading or writing
+const uint16_t BENCH_USB_TIMEOUT = 1000;
+
+/**
+ * @brief Return the port of the USB benchmarks: The serial port (0) or the
+ * vendor interface (1), or nullptr when not available.
+ */
+Stream *bench_usb_port(long port) {
+  if (port == 0) {
+    return &Serial;
+  } else if ((port == 1) && UsbBulk::available()) {
+    return &usb_bulk.port();
+  }
+  return nullptr;
+}
+
+/**
+ * @brief Handle the `bench_usb <port> <N>` command: Write N bytes of a counting
+ * pattern straight into the serial port (0) or the vendor interface (1),
+ * bypassing the transmit queues, to measure the throughput towards the PC.
+ * Replies with N as ASCII line before the bytes and with the time spent
+ * writing them [µs] as ASCII line after.
+ */
+void bench_usb_command(const char *args) {
+  long values[2] = {0, 0};
+  parse_integers(args, values, 2);
+  Stream *port = bench_usb_port(values[0]);
+  if (port == nullptr) {
+    tx.println("ERROR: Port not available.");
+    return;
+  }
+
+  uint32_t N_left = constrain(values[1], 0, (long)BENCH_USB_MAX_BYTES);
+  tx.println(N_left);
+  tx.flush();
+
+  uint8_t chunk[64];
+  for (uint8_t idx = 0; idx < sizeof(chunk); ++idx) {
+    chunk[idx] = idx;
+  }
+  uint32_t t0 = micros();
+  uint32_t tick = millis();
+  while (N_left && (millis() - tick < BENCH_USB_TIMEOUT)) {
+    int room = port->availableForWrite();
+    if (room > 0) {
+      uint32_t N = min(min(N_left, (uint32_t)room), (uint32_t)sizeof(chunk));
+      N_left -= port->write(chunk, N);
+      tick = millis();
+    }
+    Watchdog.reset();
+  }
+  port->flush();
+  uint32_t elapsed_us = micros() - t0;
+
+  if (N_left) {
+    tx.println("ERROR: PC stopped reading.");
+  } else {
+    tx.println(elapsed_us);
+  }
+}
+
+/**
+ * @brief Handle the `bench_usb_sink <port> <N>` command: Read N bytes from the
+ * serial port (0) or the vendor interface (1), discarding them, to measure the
+ * throughput from the PC. Replies with N as ASCII line once ready to receive,
+ * and with the time between the first and last byte [µs] as ASCII line when
+ * done.
+ */
+void bench_usb_sink_command(const char *args) {
+  long values[2] = {0, 0};
+  parse_integers(args, values, 2);
+  Stream *port = bench_usb_port(values[0]);
+  if (port == nullptr) {
+    tx.println("ERROR: Port not available.");
+    return;
+  }
+
+  uint32_t N_left = constrain(values[1], 0, (long)BENCH_USB_MAX_BYTES);
+  tx.println(N_left);
+  tx.flush();
+
+  uint8_t chunk[64];
+  bool started = false;
+  uint32_t t0 = 0; // Time of the first byte [µs]
+  uint32_t t1 = 0; // Time of the last byte [µs]
+  uint32_t tick = millis();
+  while (N_left && (millis() - tick < BENCH_USB_TIMEOUT)) {
+    int avail = port->available();
+    if (avail > 0) {
+      t1 = micros();
+      if (!started) {
+        started = true;
+        t0 = t1;
+      }
+      uint32_t N = min(min(N_left, (uint32_t)avail), (uint32_t)sizeof(chunk));
+      N_left -= port->readBytes(chunk, N);
+      tick = millis();
+    }
+    Watchdog.reset();
+  }
+
+  if (N_left) {
+    tx.println("ERROR: PC stopped writing.");
+  } else {
+    tx.println(t1 - t0);
+  }
+}
+
+/*------------------------------------------------------------------------------
+  Serial commands
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Handle the `batch` command: Dispatch each of the `;`-separated
+ * commands in @p args in turn, e.g. `batch pos?;?;fsm?;b?`. The reply of each
+ * command gets terminated by a line holding just `;`, also when the command
+ * itself does not reply. Batches can not be nested. State transitions requested
+ * by a command take effect only after the whole batch, i.e. a subsequent `fsm?`
+ * still reports the old state.
+ */
+void batch_command(const char *args) {
+  char batch[CMD_BUF_LEN];
+  strncpy(batch, args, CMD_BUF_LEN - 1);
+  batch[CMD_BUF_LEN - 1] = '\0';
+
+  char *cmd = batch;
+  while (true) {
+    char *sep = strchr(cmd, ';');
+    if (sep) {
+      *sep = '\0';
+    }
+    while (*cmd == ' ') {
+      cmd++;
+    }
+
+    if (strncmp(cmd, "batch", 5) == 0) {
+      tx.println("ERROR: Batches can not be nested.");
+    } else {
+      commands.dispatch(cmd);
+    }
+    tx.println(';');
+
+    if (!sep) {
+      break;
+    }
+    cmd = sep + 1;
+  }
+}
+
+/**
+ * @brief Handle the `#` command: Dispatch the command following the request ID
+ * in @p args, e.g. `#12 pos?`, and terminate its reply by a line holding `#`
+ * and the same request ID, e.g. `#12`, also when the command itself does not
+ * reply. This allows the PC to match the replies to its requests while
+ * asynchronous data is streaming in.
+ */
+void tagged_command(const char *args) {
+  char *cmd;
+  unsigned long request_id = strtoul(args, &cmd, 10);
+  if (cmd == args) {
+    tx.println("ERROR: Missing request ID.");
+    return;
+  }
+  while (*cmd == ' ') {
+    cmd++;
+  }
+
+  commands.dispatch(cmd);
+  snprintf(buf, BUF_LEN, "#%lu", request_id);
+  tx.println(buf);
+}
+
+/*------------------------------------------------------------------------------
+  Memory usage
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Print the memory usage, tab delimited. First the high-water marks,
+ * see `mem_print_watermarks()`. Then a line holding the number of subsystems
+ * N, followed by N lines holding the name and static memory [bytes] of each
+ * subsystem. The program slots and the event log live in the memory arena,
+ * see `mem?` for its split.
+ */
+void print_ram_usage() {
+  struct Part {
+    const char *name;
+    uint32_t N_bytes;
+  };
+  const Part parts[] = {
+      {"mem_arena", mem_arena.get_N_bytes()},
+      {"protocol_mgr", sizeof(protocol_mgr)},
+      {"cp_mgr", sizeof(cp_mgr)},
+      {"peripheral_sim", sizeof(peripheral_sim)},
+      {"leds", sizeof(leds) + sizeof(led_compositor)},
+      {"led_matrix_dma", sizeof(led_matrix_dma) + sizeof(led_matrix_preempt)},
+      {"tx", sizeof(tx)},
+      {"commands", sizeof(commands) + CMD_BUF_LEN + BIN_BUF_LEN},
+      {"r_click_daq", sizeof(r_click_daq)},
+      {"protocol_lib", sizeof(protocol_lib)},
+      {"playlist", sizeof(playlist)},
+      {"noise_gen", sizeof(noise_gen)},
+      {"markov_gen", sizeof(markov_gen)},
+      {"morph_gen", sizeof(morph_gen)},
+      {"protocol_script", sizeof(protocol_script)},
+      {"timing_harness", sizeof(timing_harness) + sizeof(edge_capture)},
+      {"line_pressure_log", sizeof(line_pressure_log)},
+      {"phase_avg", sizeof(phase_avg)},
+      {"decimator", sizeof(decimator)},
+      {"anomaly_capture", sizeof(anomaly_capture)},
+      {"valve_health", sizeof(valve_health)},
+      {"flash_log", sizeof(flash_log)},
+      {"pump", sizeof(pump) + sizeof(pressure_ctrl)},
+      {"profiler", sizeof(profiler)},
+  };
+  const uint8_t N_parts = sizeof(parts) / sizeof(parts[0]);
+
+  mem_print_watermarks(tx);
+  tx.println(N_parts);
+  for (uint8_t idx = 0; idx < N_parts; ++idx) {
+    snprintf(buf, BUF_LEN, "%s\t%lu\n", parts[idx].name,
+             (unsigned long)parts[idx].N_bytes);
+    tx.print(buf);
+  }
+}
+
+/**
+ * @brief Handle the `pl_add <repeats> <seconds> <name>` command: Append the
+ * stored protocol program `name` to the playlist, playing it for `repeats`
+ * passes or for `seconds` seconds, whichever comes first. Pass 0 to not limit
+ * by that measure. Echoes the playlist back, see `pl?`.
+ */
+void pl_add_command(const char *args) {
+  long values[2] = {0, 0};
+  char *end;
+  for (uint8_t i = 0; i < 2; ++i) {
+    values[i] = strtol(args, &end, 10);
+    if (end == args) {
+      tx.println("ERROR: Expected `pl_add <repeats> <seconds> <name>`.");
+      return;
+    }
+    args = end;
+  }
+  while (*args == ' ') {
+    args++;
+  }
+
+  if (fsm.isInState(state_running)) {
+    tx.println("ERROR: Not allowed while running.");
+  } else if (!playlist.add(args, constrain(values[0], 0, 65535),
+                           constrain(values[1], 0, 604800))) {
+    tx.println("ERROR: Playlist is full, or no name, repeats nor seconds.");
+  } else {
+    playlist.print(tx);
+  }
+}
+
+/**
+ * @brief Handle the `hil <passes> <port> <bit>` command: Verify the valve
+ * timing in hardware by playing the test protocol for `passes` passes, see
+ * `TimingHarness`. Without `port` and `bit`, the sync output serves as marker.
+ * Otherwise, the spare Centipede output at `port` and `bit` does. Reports when
+ * done, see `hil?`.
+ */
+void hil_command(const char *args) {
+  long values[3] = {1, -1, 0};
+  parse_integers(args, values, 3);
+
+  if (!edge_capture_ok) {
+    tx.println("ERROR: Edge capture not available.");
+    return;
+  }
+  if ((values[1] >= 0) &&
+      ((values[1] >= N_CP_PORTS) || (values[2] < 0) || (values[2] > 15) ||
+       CP2VALVE[values[1]][values[2]])) {
+    tx.println("ERROR: Not a spare Centipede output.");
+    return;
+  }
+
+  timing_harness.begin(constrain(values[0], 1, 1000));
+  cp_mgr.set_marker(values[1], values[2]);
+  play_line_source(timing_harness);
+}
+
+/**
+ * @brief Register the serial commands handled by `main.cpp`, see
+ * `CommandRegistry`. The commands of the protocol manager and the Centipede
+ * manager get registered by themselves.
+ */
+// Number of commands registered by `register_commands()` below. Update when
+// adding or removing one.
+const uint8_t N_MAIN_COMMANDS = 161;
+
+static_assert(N_MAIN_COMMANDS + ProtocolManager::N_COMMANDS +
+                      CentipedeManager::N_COMMANDS +
+                      PeripheralSim::N_COMMANDS <=
+                  MAX_COMMANDS,
+              "Too many commands, raise MAX_COMMANDS");
+
+void register_commands() {
+  // ***** Reporting ****
+  // ********************
+
+  // Report the registered commands, see `CommandRegistry::print()`
+  commands.add("cmds?", [](const char *, void *) { commands.print(tx); });
+
+  // Handle several commands at once, costing the PC a single round trip. See
+  // `batch_command()`.
+  commands.add_with_args("batch",
+                         [](const char *args, void *) { batch_command(args); });
+
+  // Handle a command tagged by a request ID, see `tagged_command()`
+  commands.add_with_args(
+      "#", [](const char *args, void *) { tagged_command(args); });
+
+  // Report identity
+  commands.add("id?", [](const char *, void *) {
+    tx.println("Arduino, Jetting Grid");
+  });
+
+  // Report whether the CRC32 checksums run on the CRC engine of the DMA
+  // controller (1) or in software (0), see `crc32_begin()`
+  commands.add("crc?", [](const char *, void *) {
+    tx.println(crc32_hw_available() ? "1" : "0");
+  });
+
+  // Clock synchronization with the PC: Echo the token back, together with
+  // the time of receipt on the `micros()` time track, tab delimited. The PC
+  // estimates the clock offset and drift from the round trips, such that the
+  // µs timestamps of the telemetry, valve events and trace can be mapped onto
+  // its own clock.
+  commands.add_with_args("ping", [](const char *args, void *) {
+    uint32_t now_us = micros();
+    snprintf(buf, BUF_LEN, "%.16s\t%lu", args, (unsigned long)now_us);
+    tx.println(buf);
+  });
+
+  // Report current protocol position starting at index 1
+  commands.add("pos?", [](const char *, void *) {
+    tx.println(get_protocol_position());
+  });
+
+  // Report readings, tab delimited
+  commands.add("?", [](const char *, void *) {
+    format_readings();
+    tx.print(buf); // Takes 320 µs per call
+  });
+
+  // Push binary telemetry packets every N ms, see `Telemetry.h`.
+  // Echoes the period [ms] back.
+  commands.add_with_args("subscribe", [](const char *args, void *) {
+    uint16_t period_ms = constrain(atoi(args), 1, 60000); // [ms]
+    tx.println(period_ms);
+    telemetry.set_period(period_ms);
+  });
+
+  // Push binary records of subscription <sub 0-3> holding the <fields>, see
+  // `TelemetryField`, every <period ms>, concurrently with the other
+  // subscriptions and the fixed packets of `subscribe`. Pass 0 for either to
+  // stop the subscription. Echoes the subscription, fields and period back, tab
+  // delimited.
+  commands.add_with_args("tsub", [](const char *args, void *) {
+    long values[3] = {-1, 0, 0};
+    parse_integers(args, values, 3);
+    uint16_t period_ms = constrain(values[2], 0, 60000); // [ms]
+    if ((values[0] < 0) ||
+        !telemetry_subs.set(values[0], values[1] & TFIELD_ALL, period_ms)) {
+      tx.println("ERROR: Invalid subscription number.");
+      return;
+    }
+    snprintf(buf, BUF_LEN, "%ld\t%u\t%u", values[0],
+             telemetry_subs.get_fields(values[0]),
+             telemetry_subs.get_period(values[0]));
+    tx.println(buf);
+  });
+
+  // Report the telemetry subscriptions, see `TelemetrySubscriptions::print()`
+  commands.add("tsub?", [](const char *, void *) {
+    telemetry_subs.print(tx);
+  });
+
+  // Stop pushing binary telemetry packets, including the subscriptions and the
+  // decimated pressure streams
+  commands.add("unsubscribe", [](const char *, void *) {
+    telemetry.set_period(0);
+    telemetry_subs.clear();
+    for (uint8_t stream = 0; stream < DECIM_N_STREAMS; ++stream) {
+      decimator.set_period(stream, 0);
+    }
+    tx.println(0);
+  });
+
+  // Push the pressures decimated to an interval of <period µs> as binary
+  // packets on stream <stream 0/1>, or stop the stream when the period is 0,
+  // see `Decimator.h`. The period gets rounded to an even multiple of the
+  // oversampling interval `DAQ_DT`. Optionally <compressed 0/1>: Push
+  // delta/varint compressed blocks instead. Echoes the obtained period [µs]
+  // back.
+  commands.add_with_args("decim", [](const char *args, void *) {
+    long values[3] = {0, 0, 0};
+    parse_integers(args, values, 3);
+    if ((values[0] < 0) || (values[0] >= DECIM_N_STREAMS)) {
+      tx.println("ERROR: Invalid stream number.");
+    } else {
+      tx.println(decimator.set_period(values[0], max(values[1], 0L),
+                                      values[2] != 0));
+    }
+  });
+
+  // Report the decimated pressure streams, see `Decimator::print()`
+  commands.add("decim?", [](const char *, void *) { decimator.print(tx); });
+
+  // Route the bulk uploads and the pushed telemetry via the USB vendor
+  // interface (1) instead of the serial port (0), see `UsbBulk.h`. Echoes the
+  // routing back.
+  commands.add_with_args("usb_bulk", [](const char *args, void *) {
+    bool routed = (atoi(args) != 0);
+    if (routed && !UsbBulk::available()) {
+      tx.println("ERROR: USB vendor interface not available.");
+    } else {
+      bulk_routed = routed;
+      tx.println(bulk_routed);
+    }
+  });
+
+  // Report the open-valve count of the line N lines ahead of the playback
+  // position in the telemetry, instead of that of the current line (N = 0).
+  // The feed-forward of the pressure controller uses that same line. Echoes N
+  // back.
+  commands.add_with_args("lookahead", [](const char *args, void *) {
+    lookahead_lines = constrain(atoi(args), 0, STREAM_BUFFER_LINES);
+    tx.println(lookahead_lines);
+  });
+
+  // Drain the log of measured line switch timings in binary, see
+  // `dump_valve_events()`. Repeat until 0 events are returned.
+  commands.add("events", [](const char *, void *) { dump_valve_events(); });
+
+  // Report the valve-event log, tab delimited:
+  //   1) Number of events waiting to be drained
+  //   2) Number of events dropped because the log was full
+  commands.add("events?", [](const char *, void *) {
+    snprintf(buf, BUF_LEN, "%u\t%lu",
+             protocol_mgr.get_event_log().size(),
+             (unsigned long)protocol_mgr.get_event_log().get_N_overflows());
+    tx.println(buf);
+  });
+
+  // Empty the valve-event log
+  commands.add("events_reset", [](const char *, void *) {
+    protocol_mgr.get_event_log().clear();
+  });
+
+  // Report the transmit queue statistics, tab delimited, see `TxQueue`:
+  //   1) Number of queued bytes
+  //   2) Largest number of bytes queued at once
+  //   3) Number of times the queue ran full, waiting on the serial port
+  //   4) Number of dropped telemetry packets
+  commands.add("tx?", [](const char *, void *) {
+    snprintf(buf, BUF_LEN, "%u\t%u\t%lu\t%lu", tx.size(), tx.get_high_water(),
+             (unsigned long)tx.get_N_stalls(),
+             (unsigned long)tx.get_N_dropped());
+    tx.println(buf);
+  });
+
+  // Reset the transmit queue statistics
+  commands.add("tx_reset", [](const char *, void *) { tx.reset_stats(); });
+
+  // Report the boot timing since the reset of the MCU, excluding the
+  // bootloader, tab delimited:
+  //   1) Time until the valves had been closed [µs]
+  //   2) Time until the end of `setup()` [µs]
+  //   3) Cause of the reset: RCAUSE register, e.g. 0x20 for the watchdog
+  //   4) Main loop stage active at the reset, "-" when unknown, see `stall?`
+  commands.add("boot?", [](const char *, void *) {
+    snprintf(buf, BUF_LEN, "%lu\t%lu\t0x%02x\t%s",
+             (unsigned long)boot_safe_us, (unsigned long)boot_ready_us,
+             reset_cause, loop_monitor.get_last_stage_name());
+    tx.println(buf);
+  });
+
+  // Report the latency of the main loop, tab delimited:
+  //   1) Threshold above which an iteration counts as slow [µs]
+  //   2) Number of iterations
+  //   3) Number of slow iterations
+  //   4) Duration of the worst iteration [µs]
+  //   5) Stage of the worst iteration that took the longest
+  commands.add("loop?", [](const char *, void *) { loop_monitor.print(tx); });
+
+  commands.add("loop_reset", [](const char *, void *) {
+    loop_monitor.reset();
+  });
+
+  // Report the statistics of the main-loop tasks, one line per task in order
+  // of execution, tab delimited:
+  //   1) Name
+  //   2) Priority: 0 low, 1 normal, 2 high, 3 critical
+  //   3) Period [µs], 0 when running each pass
+  //   4) Declared worst-case cost [µs]
+  //   5) Number of runs
+  //   6) Number of times deferred for lack of time before the next line switch
+  //   7) Number of overruns, i.e. runs exceeding the declared cost
+  //   8) Longest run [µs]
+  //   9) Largest lateness with respect to its period [µs]
+  commands.add("tasks?", [](const char *, void *) {
+    scheduler.print_stats(tx);
+  });
+
+  commands.add("tasks_reset", [](const char *, void *) {
+    scheduler.reset_stats();
+  });
+
+  // Report the idle sleep of the main MCU in the Off and Paused states since
+  // `tasks_reset`, tab delimited:
+  //   1) Percentage of time asleep
+  //   2) Number of sleeps
+  //   3) Longest sleep [µs]
+  commands.add("idle?", [](const char *, void *) {
+    scheduler.print_idle(tx);
+  });
+
+  // Set the threshold above which an iteration of the main loop counts as
+  // slow [µs]
+  commands.add_with_args("loop_slow", [](const char *args, void *) {
+    loop_monitor.set_threshold(max(atol(args), 1L));
+  });
+
+  // Report the main loop latency recorded by the previous run, kept across
+  // the reset, tab delimited, or "none" after a power cycle:
+  //   1) Stage active when it ended, e.g. the one stalling into the watchdog
+  //   2) Uptime at its last iteration [ms]
+  //   3) Number of slow iterations
+  //   4) Duration of the worst iteration [µs]
+  //   5) Stage of the worst iteration that took the longest
+  commands.add("stall?", [](const char *, void *) {
+    loop_monitor.print_last(tx);
+  });
+
+  // Report the playback state recorded by the previous run, kept across the
+  // reset, tab delimited, or "none" when it was not playing:
+  //   1) Recovered at boot (1) or not (0), e.g. after a power cycle or when
+  //      its program is missing from the protocol library
+  //   2) State: 1 running, 2 paused
+  //   3) Protocol position
+  //   4) Number of lines
+  //   5) Time left within the line [µs]
+  //   6) CRC32 checksum of the program image in hex
+  commands.add("warm?", [](const char *, void *) {
+    warm_start.print_last(tx);
+  });
+
+  // Drain the log of pressure statistics per played line in binary,
+  // see `dump_line_pressures()`. Repeat until 0 records are returned.
+  commands.add("pstats", [](const char *, void *) { dump_line_pressures(); });
+
+  // Report the line pressure log, tab delimited:
+  //   1) Number of records waiting to be drained
+  //   2) Number of records overwritten before having been drained
+  commands.add("pstats?", [](const char *, void *) {
+    snprintf(buf, BUF_LEN, "%u\t%lu", line_pressure_log.size(),
+             (unsigned long)line_pressure_log.get_N_lost());
+    tx.println(buf);
+  });
+
+  // Empty the line pressure log
+  commands.add("pstats_reset", [](const char *, void *) {
+    line_pressure_log.clear();
+  });
+
+  // "phase <first line> <N lines> <N bins> <bin ms>": (Re)start the
+  // phase-locked averaging of the pressures over the repetitions of a block
+  // of lines, see `PhaseAverager.h`, clearing its grid. Echoes the status
+  // back as `phase?`.
+  commands.add_with_args("phase", [](const char *args, void *) {
+    long values[4] = {0, 1, 50, 10};
+    parse_integers(args, values, 4);
+    if (!phase_avg.configure(constrain(values[0], 0, 65535),
+                             constrain(values[1], 0, 65535),
+                             constrain(values[2], 0, 65535),
+                             constrain(values[3], 0, 65535) * 1000)) {
+      tx.println("ERROR: Phase-averaging grid too large or empty.");
+      return;
+    }
+    phase_avg.print(tx);
+  });
+
+  // Stop the phase-locked averaging, keeping its grid
+  commands.add("phase_off", [](const char *, void *) { phase_avg.disable(); });
+
+  // Empty the grid of the phase-locked averaging
+  commands.add("phase_reset", [](const char *, void *) { phase_avg.clear(); });
+
+  // Report the phase-locked averaging, see `PhaseAverager::print()`
+  commands.add("phase?", [](const char *, void *) { phase_avg.print(tx); });
+
+  // Start downloading the phase-averaged grid from its first cell onwards
+  commands.add("phase_rewind", [](const char *, void *) {
+    phase_avg.rewind();
+  });
+
+  // Download the next cells of the phase-averaged grid, see
+  // `dump_phase_avg()`
+  commands.add("phase_read", [](const char *, void *) { dump_phase_avg(); });
+
+  // "health <settle ms> <min N> <threshold %>": (Re)start the stuck-valve
+  // detection, see `ValveHealth.h`, clearing its statistics. Echoes the
+  // summary back as `health?`.
+  commands.add_with_args("health", [](const char *args, void *) {
+    long values[3] = {50, 20, 50};
+    parse_integers(args, values, 3);
+    valve_health.start(constrain(values[0], 0, 65535),
+                       constrain(values[1], 0, 65535),
+                       constrain(values[2], 0, 255));
+    valve_health.print(tx);
+  });
+
+  // Stop the stuck-valve detection, keeping its statistics
+  commands.add("health_off", [](const char *, void *) {
+    valve_health.stop();
+  });
+
+  // Report the stuck-valve detection, see `ValveHealth::print()`
+  commands.add("health?", [](const char *, void *) { valve_health.print(tx); });
+
+  // Report the score of each valve, see `ValveHealth::print_valves()`
+  commands.add("health_valves?", [](const char *, void *) {
+    valve_health.print_valves(tx);
+  });
+
+  // Report the valves as applied right now in binary, see
+  // `dump_valve_snapshot()`
+  commands.add("valves?", [](const char *, void *) {
+    dump_valve_snapshot();
+  });
+
+  // Drain the trace in binary, see `dump_trace()`. Repeat until 0 records
+  // are returned.
+  commands.add("trace", [](const char *, void *) { dump_trace(); });
+
+  // Report the trace, tab delimited:
+  //   1) Is tracing enabled?
+  //   2) Number of records waiting to be drained
+  //   3) Number of records overwritten before having been drained
+  commands.add("trace?", [](const char *, void *) {
+    snprintf(buf, BUF_LEN, "%d\t%u\t%lu", trace_enabled, trace_size(),
+             (unsigned long)trace_get_N_lost());
+    tx.println(buf);
+  });
+
+  // Start tracing, discarding any previous records
+  commands.add("trace_on", [](const char *, void *) {
+    trace_clear();
+    trace_enabled = true;
+  });
+
+  // Stop tracing, keeping the records to be drained
+  commands.add("trace_off",
+               [](const char *, void *) { trace_enabled = false; });
+
+  // Report the free memory [bytes] between the heap and the stack, i.e. what
+  // is left of `MEM_RESERVE_BYTES` after claiming the memory arena
+  commands.add("free?", [](const char *, void *) {
+    tx.println(freeMemory());
+  });
+
+  // Report the high-water marks of the stack and the heap, followed by the
+  // static memory per subsystem, see `print_ram_usage()`
+  commands.add("ram?", [](const char *, void *) { print_ram_usage(); });
+
+  // *****  Control  ****
+  // ********************
+
+  // Upload a new protocol from the PC into Arduino memory
+  commands.add("upload", [](const char *, void *) {
+    start_uploading(UPLOAD_POINTS);
+  });
+
+  // Upload a new protocol from the PC into Arduino memory, with the
+  // lines send as PCS row bitmasks
+  commands.add("upload_rows", [](const char *, void *) {
+    start_uploading(UPLOAD_ROWS);
+  });
+
+  // Upload a new protocol from the PC into Arduino memory, in chunks
+  // guarded by a CRC
+  commands.add("upload_bulk", [](const char *, void *) {
+    start_uploading(UPLOAD_BULK);
+  });
+
+  // Upload a new protocol from the PC into Arduino memory, in chunks
+  // guarded by a CRC holding the lines as deltas
+  commands.add("upload_delta", [](const char *, void *) {
+    start_uploading(UPLOAD_DELTA);
+  });
+
+  // Resume the chunked upload that timed out, see `upload_resumable`
+  commands.add("upload_resume", [](const char *, void *) {
+    if (!upload_resumable) {
+      tx.println("ERROR: No upload to resume.");
+      return;
+    }
+    start_uploading(upload_format, true);
+  });
+
+  // Upload a new protocol from the PC into Arduino memory as a patch
+  // against the active protocol, see `upload_bulk__upd()`. Requires a
+  // staging slot.
+  commands.add("upload_patch", [](const char *, void *) {
+    if (!protocol_mgr.has_staging_slot()) {
+      tx.println("ERROR: Patch upload requires a staging slot.");
+      return;
+    }
+    start_uploading(UPLOAD_PATCH);
+  });
+
+  // Suspend the LED matrix refresh and the pressure DAQ during a foreground
+  // upload (1, default), or not (0). Echoes the setting back.
+  commands.add_with_args("upload_fast", [](const char *args, void *) {
+    upload_fast = (atoi(args) != 0);
+    tx.println(upload_fast ? 1 : 0);
+  });
+
+  // Swap in the staged protocol program. When running, it takes
+  // effect once the current line has expired, continuing at line 0.
+  commands.add("swap", [](const char *, void *) {
+    if (protocol_mgr.swap(fsm.isInState(state_running))) {
+      protocol_mgr.print_slots();
+    } else {
+      tx.println("ERROR: No protocol program staged.");
+    }
+  });
+
+  // Play a protocol that gets streamed in from the PC while playing
+  commands.add("stream", [](const char *, void *) {
+    fsm.transitionTo(state_streaming);
+  });
+
+  // Play an endless protocol generated from noise, see `gen_command()`
+  commands.add_with_args("gen", [](const char *args, void *) {
+    gen_command(args);
+  });
+
+  // Set the parameters of the second set of noise, see `gen_b_command()`
+  commands.add_with_args("gen_b", [](const char *args, void *) {
+    gen_b_command(args);
+  });
+
+  // Play an endless protocol of independently switching valves, see
+  // `markov_command()`
+  commands.add_with_args("markov", [](const char *args, void *) {
+    markov_command(args);
+  });
+
+  // Set the distribution of the valve on durations, see
+  // `markov_table_command()`
+  commands.add_with_args("markov_on", [](const char *args, void *) {
+    markov_table_command(args, markov_params.on_ms);
+  });
+
+  // Set the distribution of the valve off durations, see
+  // `markov_table_command()`
+  commands.add_with_args("markov_off", [](const char *args, void *) {
+    markov_table_command(args, markov_params.off_ms);
+  });
+
+  // Apply live valve frames sent by a real-time controller on the PC, see
+  // `live_command()`
+  commands.add_with_args("live", [](const char *args, void *) {
+    live_command(args);
+  });
+
+  // Statistics of the live mode, see `print_live_stats()`
+  commands.add("live?", [](const char *, void *) { print_live_stats(); });
+
+  // Set the pulse-width modulation of a valve, see `pwm_command()`
+  commands.add_with_args("pwm", [](const char *args, void *) {
+    pwm_command(args);
+  });
+
+  // Set the tick interval [µs] of the valve PWM, see `ValvePWM.h`. Echoes the
+  // tick interval back.
+  commands.add_with_args("pwm_tick", [](const char *args, void *) {
+    valve_pwm.set_tick_us(constrain(atol(args), 0, UINT16_MAX));
+    tx.println(valve_pwm.get_tick_us());
+  });
+
+  // Start the pulse-width modulation of the valves
+  commands.add("pwm_run", [](const char *, void *) {
+    fsm.transitionTo(state_pwm);
+  });
+
+  // Report the statistics of the valve PWM, see `ValvePWM::print_stats()`
+  commands.add("pwm?", [](const char *, void *) {
+    valve_pwm.print_stats(tx);
+  });
+
+  // Upload a protocol script from the PC into Arduino memory, see
+  // `FSM_fun_uploading_script__upd()`
+  commands.add("upload_script", [](const char *, void *) {
+    fsm.transitionTo(state_uploading_script);
+  });
+
+  // Play the uploaded protocol script. Echoes its size [bytes] back.
+  commands.add("script", [](const char *, void *) {
+    if (protocol_script.size() == 0) {
+      tx.println("ERROR: No script uploaded.");
+    } else {
+      tx.println(protocol_script.size());
+      play_line_source(protocol_script);
+    }
+  });
+
+  // Report the status of the protocol script, see
+  // `ProtocolScript::print_status()`
+  commands.add("script?", [](const char *, void *) {
+    protocol_script.print_status();
+  });
+
+  // Report the parameters of the generated protocol, see
+  // `print_noise_params()`
+  commands.add("gen?", [](const char *, void *) { print_noise_params(); });
+
+  // Play the protocol and automatically actuate valves over time
+  commands.add("play", [](const char *, void *) {
+    protocol_mgr.set_single_step(false);
+    protocol_mgr.get_qos().reset();
+    fsm.transitionTo(state_running);
+  });
+
+  // Play the protocol up to the next line switch and pause right at the start
+  // of the new line. Hence, each next step plays exactly one line with its
+  // real duration. See `ProtocolManager::set_single_step()`.
+  commands.add("step", [](const char *, void *) {
+    protocol_mgr.set_single_step(true);
+    fsm.transitionTo(state_running);
+  });
+
+  // Stop the protocol and close all valves immediately
+  commands.add("stop", [](const char *, void *) {
+    fsm.transitionTo(state_off);
+    tx.println(get_protocol_position());
+  });
+
+  // Rewind the protocol and start playing it on the next rising edge of the
+  // trigger input, see `PIN_TRIGGER_IN`
+  commands.add("trigger", [](const char *, void *) {
+    set_follower(false);
+    fsm.transitionTo(state_armed);
+  });
+
+  // Rewind the protocol and play it as follower of a leader MCU, whose sync
+  // output is wired to the trigger input: The first edge starts the playback
+  // and each next edge switches to the next line. See `follow?`.
+  commands.add("follow", [](const char *, void *) {
+    if (fsm.isInState(state_streaming) || fsm.isInState(state_generating)) {
+      tx.println("ERROR: Not allowed while streaming.");
+      return;
+    }
+    set_follower(true);
+    fsm.transitionTo(state_armed);
+  });
+
+  // Pause the protocol keeping the last actuated state of the valves
+  commands.add("pause", [](const char *, void *) {
+    fsm.transitionTo(state_paused);
+    tx.println(get_protocol_position());
+  });
+
+  // "<" Go to the previous line of the protocol and immediately
+  // activate the valves
+  commands.add(",", [](const char *, void *) {
+    protocol_mgr.goto_prev_line();
+    tx.println(get_protocol_position());
+  });
+
+  // "<" Go to the next line of the protocol and immediately
+  // activate the valves
+  commands.add(".", [](const char *, void *) {
+    protocol_mgr.goto_next_line();
+    tx.println(get_protocol_position());
+  });
+
+  // Go to the specified line (index starts at 1) of the protocol and
+  // immediately activate the solenoid valves
+  commands.add_with_args("goto", [](const char *args, void *) {
+    uint16_t tmp_int = max(atoi(args), 1);
+    protocol_mgr.goto_line(tmp_int - 1);
+    tx.println(get_protocol_position());
+  });
+
+  // Go to the line of the protocol being played at the specified time [ms]
+  // since its start and immediately activate the solenoid valves, see
+  // `ProtocolManager::goto_time()`
+  commands.add_with_args("gototime", [](const char *args, void *) {
+    double t_ms = atof(args);
+    protocol_mgr.goto_time(t_ms > 0 ? t_ms * 1000 + 0.5 : 0);
+    tx.println(get_protocol_position());
+  });
+
+  // Load a protocol preset
+  commands.add_with_args("preset", [](const char *args, void *) {
+    uint16_t idx_preset = max(atoi(args), 0);
+    load_protocol_preset(idx_preset);
+  });
+
+  // Play a protocol preset on the fly, leaving the protocol program in memory
+  // intact, see `preset_play_command()`
+  commands.add_with_args("preset_play", [](const char *args, void *) {
+    preset_play_command(args);
+  });
+
+  // Play the protocol program in memory as independent sub-programs per
+  // manifold, see `manifolds_command()`
+  commands.add_with_args("manifolds", [](const char *args, void *) {
+    manifolds_command(args);
+  });
+
+  // Report the sub-programs per manifold, one line per manifold, tab
+  // delimited: First line number, N_lines and current line number
+  commands.add("manifolds?", [](const char *, void *) {
+    manifold_mux.print(tx);
+  });
+
+  // Morph the valve pattern of one line of the protocol program in memory
+  // into that of another, see `morph_command()`
+  commands.add_with_args("morph", [](const char *args, void *) {
+    morph_command(args);
+  });
+
+  // Report the morph, tab delimited: Number of differing valves, number of
+  // time steps, time step [ms] and number of valves swapped so far
+  commands.add("morph?", [](const char *, void *) { morph_gen.print(tx); });
+
+  // ***** Protocol library ****
+  // ***************************
+
+  // Report the programs stored in the protocol library. First the
+  // number of programs, then one program per line, tab delimited:
+  //   1) Protocol name
+  //   2) N_lines
+  //   3) N_bytes
+  //   4) Asterisk when it got saved or loaded last
+  commands.add("lib?", [](const char *, void *) {
+    protocol_lib.print_directory();
+  });
+
+  // Store the protocol program in memory under its current name
+  commands.add("save", [](const char *, void *) {
+    if (fsm.isInState(state_running)) {
+      tx.println("ERROR: Not allowed while running.");
+    } else if (protocol_lib.save(protocol_mgr)) {
+      protocol_mgr.print_program();
+    }
+  });
+
+  // Load the named protocol program from the protocol library
+  commands.add_with_args("load", [](const char *args, void *) {
+    if (fsm.isInState(state_running)) {
+      tx.println("ERROR: Not allowed while running.");
+    } else if (protocol_lib.load(args, protocol_mgr)) {
+      protocol_mgr.print_program();
+    }
+  });
+
+  // "load_crc <hex>": Load the protocol program from the protocol library
+  // whose lines have the given CRC32 checksum, see `proto_crc?`. Lets the PC
+  // select a stored program by content instead of uploading it again.
+  commands.add_with_args("load_crc", [](const char *args, void *) {
+    if (fsm.isInState(state_running)) {
+      tx.println("ERROR: Not allowed while running.");
+      return;
+    }
+    const char *name =
+        protocol_lib.find_program_crc(strtoul(args, nullptr, 16));
+    if (name == nullptr) {
+      tx.println("ERROR: Protocol program not found in library.");
+    } else if (protocol_lib.load(name, protocol_mgr)) {
+      protocol_mgr.print_program();
+    }
+  });
+
+  // Play the named protocol program from the protocol library in place,
+  // read ahead from flash instead of loaded into memory. Suits programs
+  // exceeding the memory of the program slot.
+  commands.add_with_args("lib_play", [](const char *args, void *) {
+    if (fsm.isInState(state_running)) {
+      tx.println("ERROR: Not allowed while running.");
+    } else if (protocol_lib.play(args, protocol_mgr)) {
+      protocol_mgr.print_program();
+    }
+  });
+
+  // Report the reader of the protocol program playing from flash, tab
+  // delimited:
+  //   1) N_lines, 0 when none plays from flash
+  //   2) N_bytes
+  //   3) First block of lines of the read-ahead window
+  //   4) Number of blocks read ahead
+  //   5) Number of blocks read for random access, e.g. `goto`
+  //   6) Number of blocks read late, stalling the playback
+  //   7) Number of read errors
+  commands.add("lib_play?", [](const char *, void *) {
+    protocol_lib.print_reader();
+  });
+
+  // Remove the named protocol program from the protocol library
+  commands.add_with_args("del",[](const char *args, void *) {
+    if (fsm.isInState(state_running)) {
+      tx.println("ERROR: Not allowed while running.");
+    } else {
+      protocol_lib.remove(args);
+    }
+  });
+
+  // Remove all protocol programs from the protocol library
+  commands.add("lib_format", [](const char *, void *) {
+    if (fsm.isInState(state_running)) {
+      tx.println("ERROR: Not allowed while running.");
+    } else {
+      protocol_lib.format();
+    }
+  });
+
+  // Report the protocol programs embedded in internal flash. First the number
+  // of programs, then one program per line, tab delimited:
+  //   1) Protocol name
+  //   2) N_lines
+  //   3) N_bytes
+  //   4) CRC32 of the image
+  commands.add("embedded?", [](const char *, void *) {
+    print_embedded_protocols(tx);
+  });
+
+  // Play the named protocol program embedded in internal flash in place,
+  // without copying it into memory, see `embedded_protocols.h`
+  commands.add_with_args("load_embedded", [](const char *args, void *) {
+    if (fsm.isInState(state_running)) {
+      tx.println("ERROR: Not allowed while running.");
+    } else if (load_embedded_protocol(args, protocol_mgr)) {
+      protocol_mgr.print_program();
+    }
+  });
+
+  // ***** Playlist ****
+  // ********************
+
+  // Report the playlist. First the number of entries, the index of the entry
+  // playing (-1 when idle), its number of passes started and its seconds
+  // played. Then one entry per line, tab delimited:
+  //   1) Repeats
+  //   2) Duration [s]
+  //   3) Protocol name
+  commands.add("pl?", [](const char *, void *) { playlist.print(tx); });
+
+  // Remove all entries from the playlist
+  commands.add("pl_clear", [](const char *, void *) {
+    if (fsm.isInState(state_running)) {
+      tx.println("ERROR: Not allowed while running.");
+    } else {
+      playlist.clear();
+    }
+  });
+
+  // Append the stored protocol program named `name` to the playlist, see
+  // `pl_add_command()`
+  commands.add_with_args("pl_add", [](const char *args, void *) {
+    pl_add_command(args);
+  });
+
+  // Load the first program of the playlist and start running it
+  commands.add("pl_play", [](const char *, void *) {
+    if (fsm.isInState(state_running)) {
+      tx.println("ERROR: Not allowed while running.");
+    } else if (playlist.start()) {
+      protocol_mgr.print_program();
+      fsm.transitionTo(state_running);
+    }
+  });
+
+  // ***** Valve wear ****
+  // *********************
+
+  // Report the lifetime totals of each valve, persisted across reboots. First
+  // line, tab delimited:
+  //   1) Number of valves
+  //   2) Sequence number of the record in flash
+  // Followed by a line per valve, tab delimited:
+  //   1) Valve number
+  //   2) Switch count
+  //   3) Total open time [s]
+  commands.add("wear?", [](const char *, void *) {
+    if (!wear_journal.available()) {
+      tx.println("ERROR: Wear journal not available.");
+    } else {
+      wear_journal.print(tx, cp_mgr.get_valve_stats());
+    }
+  });
+
+  // Write the lifetime totals to flash right away
+  commands.add("wear_flush", [](const char *, void *) {
+    if (!wear_journal.flush(cp_mgr.get_valve_stats())) {
+      tx.println("ERROR: Failed to write to the wear journal.");
+    }
+  });
+
+  // Zero the lifetime totals of the valve number given as argument, e.g. after
+  // replacing its solenoid, or of all valves when 0
+  commands.add_with_args("wear_reset", [](const char *args, void *) {
+    int valve = atoi(args);
+    if ((valve < 0) || (valve > N_VALVES)) {
+      tx.println("ERROR: Invalid valve number.");
+    } else {
+      wear_journal.clear(cp_mgr.get_valve_stats(), valve);
+      wear_journal.flush(cp_mgr.get_valve_stats());
+    }
+  });
+
+  // ***** Flash log  ****
+  // *********************
+
+  // Start logging the mean pressures into flash every <period ms>, and the
+  // line switches too when <lines> is 1, or stop logging when <period ms> is 0.
+  // Trailing parameters can be left out, defaulting to 0 and 1. Replies with
+  // the period and whether the lines get logged, tab delimited.
+  commands.add_with_args("flog", [](const char *args, void *) {
+    long values[2] = {0, 1};
+    parse_integers(args, values, 2);
+    if (!flash_log.available()) {
+      tx.println("ERROR: Flash log not available.");
+    } else {
+      flash_log.set_period(constrain(values[0], 0, 60000), values[1] != 0);
+      snprintf(buf, BUF_LEN, "%u\t%u\n", flash_log.get_period(),
+               values[1] != 0);
+      tx.print(buf);
+    }
+  });
+
+  // Report the status of the flash log, see `FlashLog::print()`
+  commands.add("flog?", [](const char *, void *) { flash_log.print(tx); });
+
+  // Start downloading the flash log from its oldest record onwards
+  commands.add("flog_rewind", [](const char *, void *) {
+    flash_log.rewind();
+  });
+
+  // Download the next records of the flash log, see `dump_flash_log()`
+  commands.add("flog_read", [](const char *, void *) { dump_flash_log(); });
+
+  // ***** Pump controller  ****
+  // ***************************
+
+  // Poll the pump controller over Modbus RTU every <period ms>, writing the
+  // setpoint, or stop polling when 0, see `HydrovarPump.h`. Echoes the period
+  // back.
+  commands.add_with_args("pump_poll", [](const char *args, void *) {
+    pump.set_poll_period(constrain(atoi(args), 0, 60000));
+    tx.println(pump.get_poll_period());
+  });
+
+  // Have the pump regulate <pressure mbar> by itself, limited to
+  // `PUMP_MAX_PRESSURE_MBAR`. Replies with the status, see
+  // `HydrovarPump::print()`.
+  commands.add_with_args("pump_p", [](const char *args, void *) {
+    pressure_ctrl.stop();
+    pump.set_pressure(constrain(atoi(args), 0, INT16_MAX),
+                      PUMP_MAX_PRESSURE_MBAR);
+    pump.print(tx);
+  });
+
+  // Have the pump run at <frequency 0.1 Hz>. Replies with the status, see
+  // `HydrovarPump::print()`.
+  commands.add_with_args("pump_f", [](const char *args, void *) {
+    pressure_ctrl.stop();
+    pump.set_frequency(constrain(atoi(args), 0, INT16_MAX));
+    pump.print(tx);
+  });
+
+  // Regulate <pressure mbar> on manifold <channel 1-4>, or on the mean over
+  // all manifolds when 0, by writing the frequency of the pump each polling
+  // period, see `PressureController.h`. Starts bumpless from the actual
+  // frequency. Trailing parameters can be left out, defaulting to 0. Replies
+  // with the settings, see `PressureController::print_settings()`.
+  commands.add_with_args("pump_pid", [](const char *args, void *) {
+    long values[2] = {0, 0};
+    parse_integers(args, values, 2);
+    pressure_ctrl.begin(constrain(values[0], 0L, (long)PUMP_MAX_PRESSURE_MBAR),
+                        constrain(values[1], 0L, (long)N_R_CLICKS),
+                        pump.get_frequency() / 10.f);
+    pressure_ctrl.print_settings(tx);
+  });
+
+  // Set the gains <Kp Hz/bar> <Ki Hz/(bar s)> <Kd Hz s/bar> of the pressure
+  // controller. Replies with the settings.
+  commands.add_with_args("pump_gains", [](const char *args, void *) {
+    float values[3] = {0, 0, 0};
+    parse_floats(args, values, 3);
+    pressure_ctrl.set_gains(values[0], values[1], values[2]);
+    pressure_ctrl.print_settings(tx);
+  });
+
+  // Set the feed-forward <f_0 Hz> plus <K_ff Hz> per valve opened by the
+  // upcoming line of the pressure controller, see `lookahead`. Replies with
+  // the settings.
+  commands.add_with_args("pump_ff", [](const char *args, void *) {
+    float values[2] = {0, 0};
+    parse_floats(args, values, 2);
+    pressure_ctrl.set_feedforward(values[0], values[1]);
+    pressure_ctrl.print_settings(tx);
+  });
+
+  // Limit the frequency of the pressure controller to <f_min Hz> <f_max Hz>
+  // and its rate of change to <rate Hz/s>, unlimited when 0. Replies with the
+  // settings.
+  commands.add_with_args("pump_limits", [](const char *args, void *) {
+    float values[3] = {0, 50, 0};
+    parse_floats(args, values, 3);
+    pressure_ctrl.set_limits(values[0], values[1], values[2]);
+    pressure_ctrl.print_settings(tx);
+  });
+
+  // Report the settings of the pressure controller, see
+  // `PressureController::print_settings()`
+  commands.add("pump_pid?", [](const char *, void *) {
+    pressure_ctrl.print_settings(tx);
+  });
+
+  // Report the terms of the pressure controller of the last polling period,
+  // see `PressureController::print_terms()`
+  commands.add("pump_terms?", [](const char *, void *) {
+    pressure_ctrl.print_terms(tx);
+  });
+
+  // Read <register>, or write <value> into it when given, waiting on the
+  // reply, e.g. to configure the pump. Blocks the main loop meanwhile, at most
+  // for all queued requests timing out. Replies with the value read or
+  // written, or the exception code, and the `ModbusStatus`, tab delimited.
+  commands.add_with_args("pump_reg", [](const char *args, void *) {
+    long values[2] = {0, -1};
+    parse_integers(args, values, 2);
+    uint16_t value = max(values[1], 0L);
+    ModbusStatus status = pump.transact(values[0], values[1] >= 0, value);
+    snprintf(buf, BUF_LEN, "%u\t%u\n", value, status);
+    tx.print(buf);
+  });
+
+  // Report the status of the pump, see `HydrovarPump::print()`
+  commands.add("pump?", [](const char *, void *) { pump.print(tx); });
+
+  // Report the Modbus statistics, see `ModbusMaster::print()`
+  commands.add("modbus?", [](const char *, void *) { pump.print_modbus(tx); });
+
+  // ***** Debugging  ****
+  // *********************
+
+  // Verify the valve timing in hardware, see `hil_command()`
+  commands.add_with_args("hil", [](const char *args, void *) {
+    hil_command(args);
+  });
+
+  // Report the valve timing as verified by the last `hil` run, see
+  // `TimingHarness::print_report()`
+  commands.add("hil?", [](const char *, void *) {
+    timing_harness.print_report(tx);
+  });
+
+  // Benchmark a full 128-channel update of the Centipedes, reporting
+  // the average duration [µs] via `portWrite()` and `writeAllPorts()`,
+  // tab delimited. The outputs stay unchanged.
+  commands.add("i2c_bench", [](const char *, void *) {
+    if (fsm.isInState(state_running)) {
+      tx.println("ERROR: Not allowed while running.");
+    } else if (!cp_mgr.uses_i2c()) {
+      tx.println("ERROR: Outputs not driven over I2C.");
+    } else if (!NO_PERIPHERALS) {
+      Watchdog.reset();
+      cp_mgr.benchmark(tx);
+    }
+  });
+
+  // Find the fastest reliable I2C clock rate of the Centipedes and
+  // keep running at it. Reports the rate and the duration of a full
+  // update, see `i2c_clock?`. The outputs stay unchanged.
+  commands.add("i2c_calibrate", [](const char *, void *) {
+    if (fsm.isInState(state_running) || fsm.isInState(state_streaming) ||
+        fsm.isInState(state_generating) || fsm.isInState(state_armed)) {
+      tx.println("ERROR: Not allowed while running.");
+    } else if (!cp_mgr.uses_i2c()) {
+      tx.println("ERROR: Outputs not driven over I2C.");
+    } else if (!NO_PERIPHERALS) {
+      Watchdog.reset();
+      if (!cp_mgr.calibrate_clock()) {
+        tx.println("ERROR: I2C clock calibration failed.");
+      } else {
+        cp_mgr.report_clock(tx);
+      }
+    }
+  });
+
+  // Time fixed workloads of the hot paths, one per line, tab
+  // delimited: Name, number of CPU clock cycles, duration [µs]. See
+  // `run_benchmark()`.
+  commands.add("bench", [](const char *, void *) {
+    if (fsm.isInState(state_running) || fsm.isInState(state_streaming) ||
+        fsm.isInState(state_generating)) {
+      tx.println("ERROR: Not allowed while running.");
+    } else {
+      Watchdog.reset();
+      run_benchmark();
+    }
+  });
+
+  // Store the results of the latest `bench` as the baseline in flash, with a
+  // tolerance of <tolerance %>, default `PERF_BENCH_TOLERANCE_PCT`
+  commands.add_with_args("bench_save", [](const char *args, void *) {
+    char *end;
+    long tolerance = strtol(args, &end, 10);
+    if (end == args) {
+      tolerance = PERF_BENCH_TOLERANCE_PCT;
+    }
+    if (!bench_baseline.save(constrain(tolerance, 0, 255))) {
+      tx.println("ERROR: Run `bench` first, or flash not available.");
+    } else {
+      bench_baseline.print(tx);
+    }
+  });
+
+  // Report the baseline of `bench`, see `BenchBaseline::print()`
+  commands.add("bench_base?",
+               [](const char *, void *) { bench_baseline.print(tx); });
+
+  // Erase the baseline of `bench`
+  commands.add("bench_clear", [](const char *, void *) {
+    tx.println(bench_baseline.clear() ? "Baseline erased."
+                                      : "ERROR: Flash not available.");
+  });
+
+  // Report the runtime tuning, see `TuningStore::print()`
+  commands.add("tune?", [](const char *, void *) { tuning.print(tx); });
+
+  // Set the tuning knob <name> to <value>, taking effect right away when live
+  // or else upon the next reboot. Not stored until `tune_save`. Echoes the
+  // knob back, as in `tune?`.
+  commands.add_with_args("tune", [](const char *args, void *) {
+    char name[24];
+    const char *sep = strchr(args, ' ');
+    size_t len = sep ? (size_t)(sep - args) : strlen(args);
+    int8_t key = -1;
+    if (len < sizeof(name)) {
+      memcpy(name, args, len);
+      name[len] = '\0';
+      key = TuningStore::find(name);
+    }
+    if (key < 0) {
+      tx.println("ERROR: Unknown knob, see `tune?`.");
+      return;
+    }
+
+    float value = NAN;
+    if (sep) {
+      char *end;
+      value = strtof(sep, &end);
+      if (end == sep) {
+        value = NAN;
+      }
+    }
+    if (!tuning.set(key, value)) {
+      tx.println("ERROR: Value missing or out of bounds, see `tune?`.");
+      return;
+    }
+    apply_tuning(key);
+    tuning.print_knob(tx, key);
+  });
+
+  // Store the runtime tuning in the SmartEEPROM
+  commands.add("tune_save", [](const char *, void *) {
+    tx.println(tuning.save() ? "Tuning saved."
+                             : "ERROR: SmartEEPROM not available.");
+  });
+
+  // Revert all tuning knobs to their defaults. Not stored until `tune_save`.
+  commands.add("tune_defaults", [](const char *, void *) {
+    tuning.defaults();
+    for (uint8_t key = 0; key < N_TUNING_KNOBS; ++key) {
+      apply_tuning(key);
+    }
+    tuning.print(tx);
+  });
+
+  // Measure the USB throughput towards the PC, on the serial port (0) or the
+  // vendor interface (1), see `bench_usb_command()`
+  commands.add_with_args("bench_usb", [](const char *args, void *) {
+    bench_usb_command(args);
+  });
+
+  // Idem, from the PC, see `bench_usb_sink_command()`
+  commands.add_with_args("bench_usb_sink", [](const char *args, void *) {
+    bench_usb_sink_command(args);
+  });
+
+  // Report the timing instrumentation of the hot paths, one probe per
+  // line, see `perf_print()`
+  commands.add("perf?", [](const char *, void *) { perf_print(tx); });
+
+  // Reset the timing instrumentation
+  commands.add("perf_reset", [](const char *, void *) { perf_reset(); });
+
+  // "prof <period us> [<lo> <hi>]": Start the sampling profiler into a
+  // cleared histogram, covering the firmware image or the addresses [lo, hi),
+  // decimal or 0x-prefixed hex. A period of 0 stops it, keeping the
+  // histogram. See `SamplingProfiler.h`.
+  commands.add_with_args("prof", [](const char *args, void *) {
+    char *end;
+    uint32_t period_us = strtoul(args, &end, 10);
+    uint32_t lo = strtoul(end, &end, 0);
+    uint32_t hi = strtoul(end, &end, 0);
+    if (period_us == 0) {
+      profiler.stop();
+    } else if (!profiler.start(period_us, lo, hi)) {
+      snprintf(buf, BUF_LEN,
+               "ERROR: Period must lie within [%lu, %lu] us, or timer not "
+               "available.",
+               (unsigned long)PROF_PERIOD_MIN_US,
+               (unsigned long)PROF_PERIOD_MAX_US);
+      tx.println(buf);
+    }
+  });
+
+  // Report the histogram of the sampling profiler, see
+  // `SamplingProfiler::print()`
+  commands.add("prof?", [](const char *, void *) { profiler.print(tx); });
+
+  // Report the LED matrix refresh statistics, see
+  // `LEDGovernor::print_stats()`
+  commands.add("leds?",
+               [](const char *, void *) { led_governor.print_stats(tx); });
+
+  // Report the statistics of the preemptible bit-banging of the LED matrix,
+  // see `LEDMatrixPreempt::print_stats()`. All zero when not in use.
+  commands.add("leds_preempt?", [](const char *, void *) {
+    led_matrix_preempt.print_stats(tx);
+  });
+
+  // Reset the LED matrix refresh statistics
+  commands.add("leds_reset", [](const char *, void *) {
+    led_governor.reset_stats();
+    led_matrix_preempt.reset_stats();
+  });
+
+  // Report the R Click acquisition statistics, see `print_DAQ_stats()`
+  commands.add("daq?", [](const char *, void *) { print_DAQ_stats(); });
+
+  // Reset the R Click acquisition statistics
+  commands.add("daq_reset", [](const char *, void *) { reset_DAQ_stats(); });
+
+  // Bound the oversampling factor of the R Clicks over `DAQ_DT` to <factor>,
+  // 1 fixing the interval at `DAQ_DT`, see `DAQRate.h`. Echoes the bound back.
+  commands.add_with_args("daq_os", [](const char *args, void *) {
+    if (daq_rate.set_max_factor(constrain(atoi(args), 1, 255))) {
+      apply_DAQ_rate();
+    }
+    tx.println(daq_rate.get_max_factor());
+  });
+
+  // Report the state of the burst capture, see `print_burst_state()`
+  commands.add("burst?", [](const char *, void *) { print_burst_state(); });
+
+  // Drain the finished burst capture in binary, see `dump_burst()`.
+  // Repeat until 0 samples are returned.
+  commands.add("burst_dump", [](const char *, void *) { dump_burst(); });
+
+  // "burst <ms>": Capture the raw R Click readings back-to-back for the given
+  // duration, starting right away. "burst_line <ms>": Same, but starting at
+  // the next line switch of the protocol. See `burst_command()`.
+  commands.add_with_args("burst", [](const char *args, void *) {
+    burst_command(args, false);
+  });
+  commands.add_with_args("burst_line", [](const char *args, void *) {
+    burst_command(args, true);
+  });
+
+  // "anomaly_window <pre ms> <post ms>": Set the windows of the anomaly
+  // capture before and after the trigger, see `AnomalyCapture.h`. Echoes the
+  // state back as `anomaly?`.
+  commands.add_with_args("anomaly_window", [](const char *args, void *) {
+    long values[2] = {1000, 500};
+    parse_integers(args, values, 2);
+    anomaly_capture.set_window(max(values[0], 0L), max(values[1], 0L));
+    anomaly_capture.print(tx);
+  });
+
+  // "anomaly_trig <low mbar> <high mbar> <slope mbar/s> <fault>": Set the
+  // triggers of the anomaly capture, each level or slope of 0 disabling it.
+  // Echoes the state back as `anomaly?`.
+  commands.add_with_args("anomaly_trig", [](const char *args, void *) {
+    long values[4] = {0, 0, 0, 0};
+    parse_integers(args, values, 4);
+    anomaly_capture.set_triggers(constrain(values[0], 0, INT16_MAX),
+                                 constrain(values[1], 0, INT16_MAX),
+                                 max(values[2], 0L), values[3] != 0);
+    anomaly_capture.print(tx);
+  });
+
+  // (Re-)arm the anomaly capture, discarding the previous one
+  commands.add("anomaly_arm", [](const char *, void *) {
+    anomaly_capture.arm();
+    anomaly_N_dumped = 0;
+    anomaly_capture.print(tx);
+  });
+
+  // Stop the anomaly capture, discarding the previous one
+  commands.add("anomaly_off", [](const char *, void *) {
+    anomaly_capture.disarm();
+    anomaly_capture.print(tx);
+  });
+
+  // Report the anomaly capture, see `AnomalyCapture::print()`
+  commands.add("anomaly?", [](const char *, void *) {
+    anomaly_capture.print(tx);
+  });
+
+  // Drain the frozen anomaly capture in binary, see `dump_anomaly()`.
+  // Repeat until 0 readings are returned.
+  commands.add("anomaly_dump", [](const char *, void *) { dump_anomaly(); });
+
+  // Report current Finite State Machine state name
+  commands.add("fsm?", [](const char *, void *) {
+    tx.println(fsm.getCurrentStateName());
+  });
+
+  // Trigger a halt
+  commands.add("halt", [](const char *, void *) {
+    halt(0, "Halted by user command.");
+  });
+
+  // WARNING: Will override enable the jetting pump, regardless of
+  // whether any valves are actually open or not. This function should
+  // be used for troubleshooting only.
+  commands.add("override_safety", [](const char *, void *) {
+    override_pump_safety = true;
+  });
+
+  // Revert back from the "override_safety" command: Restore the regular
+  // safety procedure to enable the jetting pump only when at least one
+  // valve is open.
+  commands.add("restore_safety", [](const char *, void *) {
+    override_pump_safety = false;
+  });
+
+  protocol_mgr.register_commands(commands);
+  cp_mgr.register_commands(commands);
+  peripheral_sim.register_commands(commands);
+}
+
+/*------------------------------------------------------------------------------
+  Main-loop tasks
+------------------------------------------------------------------------------*/
+
+void task_watchdog() { Watchdog.reset(); }
+
+void task_tx() {
+  // Send out the queued output, as far as the serial port can take it
+  loop_monitor.stage(LOOP_TX);
+  tx.drain();
+#if USB_BULK
+  usb_tx.drain();
+#endif
+}
+
+void task_i2c() {
+  // Abort hung background writes to the Centipede ports, if any
+  loop_monitor.stage(LOOP_I2C);
+  cp_mgr.update();
+}
+
+/**
+ * @brief Measure the manifold pressures.
+ */
+void task_daq() {
+  loop_monitor.stage(LOOP_DAQ);
+
+  // Time asleep in between does not count against the headroom
+  static uint32_t slept_us = 0;
+  daq_rate.discount(scheduler.get_slept_us() - slept_us);
+  slept_us = scheduler.get_slept_us();
+  if (daq_rate.update(micros())) {
+    apply_DAQ_rate();
+  }
+
+  if (io_suspended) {
+    // Skip, in favor of the upload
+
+  } else if (!NO_PERIPHERALS || peripheral_sim.is_enabled()) {
+    update_burst();
+    if (R_click_poll_EMA_collectively()) {
+      // Trace when the obtained interval is too large. Not necessarily
+      // problematic though. The EMA will adjust for this.
+      if (readings.DAQ_obtained_DT > daq_rate.get_interval_us() * 21 / 20) {
+        trace(TRACE_DAQ_LATE, 0, readings.DAQ_obtained_DT);
+      }
+
+      uint16_t bitval_q4[N_R_CLICKS];
+      for (uint8_t ch = 0; ch < N_R_CLICKS; ++ch) {
+        bitval_q4[ch] = bitval2q4(readings.EMA.value[ch]);
+      }
+      update_pressures(bitval_q4);
+    }
+  } else {
+    // Generate fake pressure data, ~16 mA plus 0.5 mA per channel
+    float sin_value = 3180.f + 200.f * sin(2.f * PI * .1f * millis() / 1.e3f);
+    uint16_t bitval_q4[N_R_CLICKS];
+    for (uint8_t ch = 0; ch < N_R_CLICKS; ++ch) {
+      bitval_q4[ch] = bitval2q4(sin_value + 100.f * ch);
+    }
+    update_pressures(bitval_q4);
+  }
+}
+
+/**
+ * @brief Process the incoming serial commands.
+ *
+ * Handle all queued commands, within budget. Stop short when a command has
+ * requested a state transition, because the new state might interpret the
+ * subsequent incoming bytes differently, e.g. as a binary protocol upload.
+ */
+void task_commands() {
+  loop_monitor.stage(LOOP_COMMANDS);
+  if (loading_program) {
+    return;
+  }
+
+  uint32_t t0 = micros();
+  uint8_t N_cmds = 0;
+  while (!fsm.isTransitionPending() && sc.available()) {
+    PERF_SCOPE(PERF_COMMANDS);
+    str_cmd = sc.getCommand();
+    commands.dispatch(str_cmd);
+    if ((++N_cmds == CMD_MAX_PER_LOOP) || (micros() - t0 >= CMD_BUDGET_US)) {
+      break;
+    }
+  }
+}
+
+void task_dump() {
+  // Continue an ongoing dump of the protocol program, see `proto?`
+  loop_monitor.stage(LOOP_DUMP);
+  protocol_mgr.update_dump();
+}
+
+void task_fade() {
+  // Fade out the LEDs of previously active valves over time
+  loop_monitor.stage(LOOP_LEDS);
+  led_compositor.fade();
+}
+
+void task_fsm() {
+  loop_monitor.stage(loading_program ? LOOP_UPLOAD : LOOP_FSM);
+  fsm.update();
+}
+
+void task_read_ahead() {
+  // Read ahead the protocol program playing from flash, if any
+  protocol_lib.update_reader();
+}
+
+void task_flash() {
+  // Persist the valve wear every now and then
+  loop_monitor.stage(LOOP_FLASH);
+  if (!loading_program) {
+    wear_journal.update(cp_mgr.get_valve_stats());
+  }
+}
+
+void task_flash_log() {
+  // Collect the flash log records and write them out page by page
+  if (!loading_program) {
+    flash_log.update(get_telemetry_state(), protocol_mgr.get_position());
+  }
+}
+
+void task_pump() {
+  // The simulated pressures must not drive the real pump
+  if (cp_mgr.is_simulated() && pressure_ctrl.is_active()) {
+    pressure_ctrl.stop();
+  }
+
+  // Advance the Modbus traffic with the pump controller, and regulate the
+  // pressure once per polling period
+  if (pump.update() && pressure_ctrl.is_active() && !loading_program) {
+    float f_Hz = pressure_ctrl.step(
+        readings.pres_mbar, protocol_mgr.get_N_open_ahead(lookahead_lines),
+        pump.get_poll_period() / 1000.f, !safety__allow_jetting_pump_to_run);
+    pump.control_frequency(f_Hz * 10 + .5f);
+  }
+}
+
+void task_telemetry() {
+  loop_monitor.stage(LOOP_TELEMETRY);
+  if (telemetry.due() && !loading_program) {
+    send_telemetry();
+  }
+  uint16_t fields = telemetry_subs.due();
+  if (fields && !loading_program) {
+    send_telemetry_records(fields);
+  }
+}
+
+/**
+ * @brief Compose the LED data of the next frame.
+ *
+ * NOTE:
+ *   It takes 30 µs to write to one WS2812 LED. Hence, for the full 16x16
+ *   LED matrix is takes 7680 µs. I actually measure 8000 µs, using
+ *   '''
+ *     utick = micros();
+ *     FastLED.show();
+ *     tx.println(micros() - utick);
+ *   '''
+ *   Hence, we must limit the framerate to a theoretical max of 125 Hz in
+ *   order to prevent flickering of the LEDs. Actually measured limit is
+ *   <= 80 Hz.
+ *
+ * NOTE:
+ *   Capping the framerate by calling `FastLED.setMaxRefreshRate(80)` is not
+ *   advised, because this makes `FastLED.show()` blocking while it is
+ *   waiting for the correct time to pass. Hence, we simply compose the frames
+ *   in a task with a period of 20 ms to leave it unblocking, while still
+ *   capping the framerate.
+ */
+void task_compose_leds() {
+  loop_monitor.stage(LOOP_LEDS);
+  update_vu_meter();
+  leds_dirty |= led_compositor.flatten();
+
+  // Blink the 'alive' status LEDs. The onboard LED turns pale when the LED
+  // matrix is frozen because the protocol lines are too short to refresh it.
+  CRGB alive_blinker_color;
+  alive_blinker_color.setHSV(alive_blinker_hue, 255, beatsin8(60, 96, 223));
+  CRGB onboard_color = alive_blinker_color;
+  if (led_governor.starved()) {
+    onboard_color.setHSV(alive_blinker_hue, 96, beatsin8(60, 96, 223));
+  }
+  if (onboard_led[0] != onboard_color) {
+    onboard_led[0] = onboard_color;
+    onboard_led_dirty = true;
+  }
+
+  // Only let the alive blinker by itself dirty the LED matrix once every
+  // idle period
+  static uint32_t tick_blink = 0;
+  const TuningValues &tuned = tuning.get();
+  uint16_t idle_ms =
+      led_idle_running ? tuned.led_idle_running_ms : tuned.led_idle_ms;
+  now = millis();
+  if (leds_dirty || (now - tick_blink >= idle_ms)) {
+    tick_blink = now;
+    led_compositor.set_status(alive_blinker_color);
+    leds_dirty |= led_compositor.flatten();
+  }
+}
+
+/**
+ * @brief Send out the LED data. A frame that didn't fit in between the line
+ * switches gets retried each pass, until a large enough gap comes by.
+ */
+void task_show_leds() {
+  loop_monitor.stage(LOOP_LEDS);
+  if (led_matrix_via_dma && led_matrix_dma.take_dropped()) {
+    leds_dirty = true; // The queued frame never made it out
+  }
+  if (!io_suspended && (onboard_led_dirty || leds_dirty)) {
+    flush_leds(us_until_line_switch()); // 8003 µs via FastLED, ~100 µs via DMA
+  }
+}
+
+/**
+ * @brief Record the playback state, to recover after a watchdog reset. Only
+ * the plain playback of the protocol program in memory is recoverable.
+ */
+void task_warm_start() {
+  WarmState state = WARM_NONE;
+  if (playlist.is_playing() || protocol_mgr.is_follower()) {
+    // Not recoverable
+  } else if (fsm.isInState(state_running)) {
+    state = WARM_RUNNING;
+  } else if (fsm.isInState(state_paused)) {
+    state = WARM_PAUSED;
+  }
+  warm_start.update(protocol_mgr, state);
+}
+
+/**
+ * @brief Scrub the protocol program in memory in the background, see
+ * `ProtocolManager::update_scrub()`. A program found corrupt stops playing.
+ */
+void task_scrub() {
+  if (protocol_mgr.update_scrub()) {
+    return;
+  }
+
+  tx.println("ERROR: Protocol program in memory is corrupt.");
+  if (fsm.isInState(state_running) || fsm.isInState(state_paused)) {
+    fsm.transitionTo(state_off);
+  }
+}
+
+/**
+ * @brief Send out safety pulses to the safety MCU, carrying our health. The
+ * pulses stop by themselves when this task fails to refresh them in time.
+ */
+void task_safety() {
+  loop_monitor.stage(LOOP_SAFETY);
+  if (cp_mgr.is_simulated()) {
+    // The masks are merely simulated, the real valves are closed
+    safety__allow_jetting_pump_to_run = false;
+
+  } else if (override_pump_safety) {
+    // WARNING! SAFETY OVERRIDE! FOR DEBUGGING ONLY!
+    safety__allow_jetting_pump_to_run = true;
+
+  } else {
+    // Final safety check in effect:
+    // Don't allow the jetting pump to run when none of the valves are open
+    if (cp_mgr.all_masks_are_zero()) {
+      safety__allow_jetting_pump_to_run = false;
+    } else {
+      safety__allow_jetting_pump_to_run = true;
+    }
+  }
+
+  // Report the valves as open while overridden, else the safety MCU drops the
+  // relay regardless. Likewise, simulated valves are reported as closed.
+  safety_pulser.set_health(get_safety_state(),
+                           safety__allow_jetting_pump_to_run);
+  safety_pulser.allow(safety__allow_jetting_pump_to_run);
+}
+
+// Number of tasks added by `add_tasks()` below. Update when adding or removing
+// one.
+const uint8_t N_MAIN_TASKS = 18;
+
+static_assert(N_MAIN_TASKS <= SCHED_MAX_TASKS,
+              "Too many tasks, raise SCHED_MAX_TASKS");
+
+/**
+ * @brief Add the main-loop tasks to the scheduler, see `TaskScheduler`. The
+ * costs are worst cases [µs]. The commands are critical, such that a protocol
+ * can always be stopped. Within a priority, the tasks run in the order added.
+ */
+void add_tasks() {
+  // Slowed down, because of overhead otherwise
+  scheduler.add("watchdog", task_watchdog, 1000000, TASK_CRITICAL, 100);
+  scheduler.add("i2c", task_i2c, 0, TASK_CRITICAL, 100);
+  scheduler.add("commands", task_commands, 0, TASK_CRITICAL, CMD_BUDGET_US);
+  scheduler.add("fsm", task_fsm, 0, TASK_CRITICAL, 1000);
+  scheduler.add("safety", task_safety, 0, TASK_CRITICAL, 50);
+  scheduler.add("tx", task_tx, 0, TASK_HIGH, 200);
+  scheduler.add("daq", task_daq, 0, TASK_HIGH, 200);
+  scheduler.add("warm", task_warm_start, 10000, TASK_HIGH, 1000);
+  scheduler.add("read_ahead", task_read_ahead, 0, TASK_HIGH, 300);
+  scheduler.add("dump", task_dump, 0, TASK_NORMAL, 500);
+  scheduler.add("telemetry", task_telemetry, 0, TASK_NORMAL, 200);
+  scheduler.add("scrub", task_scrub, 10000, TASK_NORMAL, 500);
+  scheduler.add("flash_log", task_flash_log, 10000, TASK_NORMAL, 2000);
+  scheduler.add("pump", task_pump, 0, TASK_NORMAL, 100);
+  scheduler.add("fade", task_fade, 20000, TASK_LOW, 300);
+  scheduler.add("compose", task_compose_leds, 20000, TASK_LOW, 1000);
+
+  // Paces itself, see `flush_leds()`. Merely the onboard LED.
+  scheduler.add("leds", task_show_leds, 0, TASK_LOW, ONBOARD_LED_COST_US);
+
+  // Erasing a flash sector blocks for ~50 ms, see `WearJournal::update()`
+  scheduler.add("flash", task_flash, 1000000, TASK_LOW, 50000);
+}
+
+/*------------------------------------------------------------------------------
+  setup
+------------------------------------------------------------------------------*/
+
+void setup() {
+  // To enable float support in `snprintf()` we must add the following
+  asm(".global _printf_float");
+
+  reset_cause = Watchdog.resetCause();
+  crc32_begin(); // Before anything gets checksummed
+  loop_monitor.begin();
+  warm_start.begin();
+  tuning.begin();
+  const TuningValues &tuned = tuning.get();
+
+  // Safety pulses to be send to the safety MCU
+  pinMode(PIN_SAFETY_PULSE_OUT, OUTPUT);
+  digitalWrite(PIN_SAFETY_PULSE_OUT, LOW);
+  safety_pulser.set_period(tuned.safety_period_ms);
+  safety_pulser.begin();
+
+  // Centipedes, first thing, to close any valves left open by a watchdog
+  // reset as soon as possible
+  //
+  // Supported I2C clock speeds:
+  //   MCP23017 datasheet: 100 kHz, 400 kHz, 1.7 MHz
+  //   SAMD51   datasheet: 100 kHz, 400 kHz, 1 MHz, 3.4 MHz
+  // Arduino's default I2C clock speed is 100 kHz.
+  //
+  // Resulting timings of the following code block:
+  //   ```
+  //   for (cp_port = 0; cp_port < 8; cp_port++) {
+  //     cp.portWrite(cp_port, cp_data);
+  //   }
+  //   ```
+  //   100 kHz: 3177 µs
+  //   400 kHz:  908 µs
+  //   1   MHz:  457 µs  <------- Default
+  //   1.7 MHz: fails, too fast
+  //
+  // The fastest reliable rate depends on the cable runs of the installation,
+  // hence it gets calibrated at boot, see `CP_CALIBRATE_AT_BOOT`.
+
+#if OUTPUT_BACKEND == OUTPUT_MCP23017
+  // The SERCOM registers and pins of the buses allow recovering from a stuck
+  // bus. `Wire` runs on SERCOM2 of the Adafruit Feather M4.
+  Centipede &cp = cp_mgr.get_centipede();
+  Wire.begin();
+  Wire.setClock(CP_CLOCK_DEFAULT);
+  cp.setBusPins(0, PIN_WIRE_SDA, PIN_WIRE_SCL, PIO_SERCOM);
+  if (CP_SPLIT_BUS) {
+    Wire2.begin();
+    Wire2.setClock(CP_CLOCK_DEFAULT);
+    pinPeripheral(PIN_CP2_SDA, PIO_SERCOM_ALT);
+    pinPeripheral(PIN_CP2_SCL, PIO_SERCOM_ALT);
+    cp.setBusPins(1, PIN_CP2_SDA, PIN_CP2_SCL, PIO_SERCOM_ALT);
+    cp.setBuses(&Wire, &Wire2, SERCOM2, SERCOM4);
+  } else {
+    cp.setBuses(&Wire, &Wire, SERCOM2);
+  }
+#else
+  // The SPI outputs take over SERCOM2 and the I2C pins, see `PIN_OUT_MISO`
+  SPI_OUT.begin();
+  pinPeripheral(PIN_WIRE_SDA, PIO_SERCOM);
+  pinPeripheral(PIN_WIRE_SCL, PIO_SERCOM);
+  pinPeripheral(PIN_OUT_MISO, PIO_SERCOM);
+#  if OUTPUT_BACKEND == OUTPUT_SHIFT_REGISTER && defined(__SAMD51__)
+  // Stays with the blocking writes when no DMA channel is left
+  out_backend.begin_dma(SERCOM2, SERCOM2_DMAC_ID_TX);
+#  endif
+  cp_mgr.set_backend(&out_backend);
+#endif
+  if (!NO_PERIPHERALS) {
+    cp_mgr.begin();
+  }
+  cp_mgr.set_sim(&peripheral_sim);
+  peripheral_sim.set_start_guard(sim_start_guard);
+  boot_safe_us = micros();
+
+  // Onboard LED & LED matrix
+  //
+  // NOTE:
+  //   Don't call `FastLED.setMaxRefreshRate()`, because it will turn
+  //   `FastLED.show()` into a blocking call.
+  // NOTE:
+  //   Type `NEOPIXEL` is internally `WS2812Controller800Khz`, so already
+  //   running at the max clock frequency of 800 kHz.
+
+  // NOTE:
+  //   When the DMA backend is available, FastLED only drives the onboard LED.
+  //   Otherwise, the preemptible bit-banging takes over the LED matrix, and
+  //   only when that is disabled too, FastLED.
+
+  // NOTE:
+  //   The controllers get refreshed individually via `flush_leds()`, never
+  //   all at once via `FastLED.show()`.
+
+  onboard_led_ctrl = &FastLED.addLeds<NEOPIXEL, PIN_NEOPIXEL>(onboard_led, 1);
+  if (LEDMatrixDMA::available()) {
+    led_matrix_via_dma = led_matrix_dma.begin();
+  }
+  if (!led_matrix_via_dma && LEDMatrixPreempt::available()) {
+    led_matrix_via_preempt = led_matrix_preempt.begin(PIN_LED_MATRIX);
+  }
+  if (!led_matrix_via_dma && !led_matrix_via_preempt) {
+    led_matrix_ctrl = &FastLED.addLeds<NEOPIXEL, PIN_LED_MATRIX>(leds, N_LEDS);
+  }
+  FastLED.setCorrection(UncorrectedColor);
+  // FastLED.setCorrection(TypicalSMD5050);
+  FastLED.setBrightness(30);
+  led_governor.begin(led_matrix_via_dma ? 150 : 8100); // [µs]
+  fill_solid(onboard_led, 1, CRGB::Blue);
+  fill_rainbow(leds, N_LEDS, 0, 1); // Show rainbow during setup
+  show_leds();
+
+  usb_bulk.begin();
+  Serial.begin(9600);
+
+  // R Click
+  daq_rate.set_nominal_interval(tuned.daq_dt_us);
+  decimator.set_interval(tuned.daq_dt_us);
+  anomaly_capture.set_interval(tuned.daq_dt_us);
+  R_clicks.begin();
+  readings.EMA.begin(tuned.daq_lp_Hz);
+  if (RClickDAQ::available() && !NO_PERIPHERALS) {
+    r_click_via_dma = r_click_daq.begin(R_CLICK_CS_PINS, tuned.daq_dt_us,
+                                        DEFAULT_RT_CLICK_SPI_CLOCK);
+  }
+  daq_rate.set_ring_len(r_click_via_dma ? RClickDAQ::get_capacity() : 0);
+
+  // Centipede I2C clock, skipped after a watchdog reset in favor of a fast
+  // recovery. See `i2c_calibrate` to redo it.
+  if (!NO_PERIPHERALS && cp_mgr.uses_i2c()) {
+    if (CP_CALIBRATE_AT_BOOT && !(reset_cause & RSTC_RCAUSE_WDT)) {
+      cp_mgr.calibrate_clock();
+    }
+#if CP_I2C_DMA && defined(__SAMD51__)
+    // From now on write the ports in the background. Stays with the blocking
+    // writes when no DMA channel is left.
+    if (CP_SPLIT_BUS) {
+      cp_mgr.begin_async(SERCOM2, SERCOM2_DMAC_ID_TX, SERCOM4,
+                         SERCOM4_DMAC_ID_TX);
+    } else {
+      cp_mgr.begin_async(SERCOM2, SERCOM2_DMAC_ID_TX);
+    }
+#endif
+  }
+
+  // Serial commands
+  register_commands();
+
+  // Claim all the remaining free RAM for the protocol programs, then paint
+  // what is left over for the high-water marks
+  claim_mem_arena();
+  mem_paint();
+
+  // Evaluate the feasibility of the uploaded programs against the LED refresh
+  // of this board, see `feas?`
+  ActuationCost actuation_cost;
+  actuation_cost.led_us = led_governor.get_cost_us();
+  protocol_mgr.set_actuation_cost(actuation_cost);
+
+  // Hardware timer for firing the protocol line switches
+  playback_timer.begin(playback_timer_callback);
+  protocol_mgr.attach_timer(&playback_timer);
+  valve_pwm.attach_timer(&playback_timer);
+
+  // Trigger input and sync output
+  pinMode(PIN_TRIGGER_IN, INPUT_PULLDOWN);
+  attachInterrupt(digitalPinToInterrupt(PIN_TRIGGER_IN), trigger_callback,
+                  RISING);
+  pinMode(PIN_SYNC_OUT, OUTPUT);
+  digitalWrite(PIN_SYNC_OUT, LOW);
+  protocol_mgr.set_sync_pin(PIN_SYNC_OUT);
+  edge_capture_ok = edge_capture.begin(PIN_CAPTURE_IN);
+
+  // Load the protocol program that got saved or loaded last from the protocol
+  // library. Fall back to the first embedded protocol, or else a preset.
+  // After a watchdog reset, rather pick up the program that was playing.
+  protocol_lib.begin(&qspi_flash,
+                     WEAR_JOURNAL_SIZE + FLASH_LOG_SIZE + BENCH_BASELINE_SIZE);
+  warm_restart = (reset_cause & RSTC_RCAUSE_WDT) &&
+                 warm_start.restore_program(protocol_lib, protocol_mgr);
+  if (!warm_restart && !protocol_lib.load_last(protocol_mgr) &&
+      (!N_EMBEDDED_PROTOCOLS ||
+       !load_embedded_protocol(EMBEDDED_PROTOCOLS[0].name, protocol_mgr))) {
+    load_protocol_preset(0);
+  }
+  wear_journal.begin(&qspi_flash);
+  flash_log.begin(&qspi_flash, protocol_lib.get_used_end());
+  bench_baseline.begin(&qspi_flash, protocol_lib.get_used_end());
+  pump.begin(PUMP_BAUDRATE, PUMP_SLAVE_ADDRESS);
+
+  // Reached the end of setup, so now replace the rainbow by the layers
+  // led_compositor.set_visible(LAYER_GRID, true);
+  led_compositor.invalidate();
+  led_compositor.flatten();
+  while (led_matrix_dma.is_busy()) {} // Rainbow frame might still be ongoing
+  show_leds();
+
+  // Continue the playback where the watchdog reset cut it short. The state
+  // machine has to enter its initial state first, closing all valves.
+  if (warm_restart) {
+    fsm.update();
+    if (warm_start.restore_position(protocol_mgr) == WARM_RUNNING) {
+      fsm.transitionTo(state_running);
+    } else {
+      fsm.transitionTo(state_paused);
+    }
+  }
+
+  add_tasks();
+  scheduler.set_idle(us_idle);
+
+  // Start Watchdog timer
+  Watchdog.enable(tuned.watchdog_ms);
+  boot_ready_us = micros();
+}
+
+/*------------------------------------------------------------------------------
+  loop
+------------------------------------------------------------------------------*/
+
+void loop() {
+  PERF_SCOPE(PERF_LOOP);
+  loop_monitor.next_iteration();
+  scheduler.run();
+}
@@ -2,7 +2,7 @@
  * @file    protocol_presets.cpp
  * @author  Dennis van Gils (vangils.dennis@gmail.com)
  * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
- * @date    14-04-2023
+ * @date    15-10-2026
  * @copyright MIT License. See the LICENSE file for details.
  */
 
@@ -10,182 +10,139 @@
 #include "constants.h"
 #include "translations.h"
 
-/**
- * @brief Open all valves
- */
-static void generate_preset_0() {
-  protocol_mgr.set_name("Open all valves");
-  Line line;
-
-  for (uint8_t idx_valve = 1; idx_valve <= N_VALVES; ++idx_valve) {
-    line.points[idx_valve - 1] = valve2p(idx_valve);
-  }
+// Number of valves fed by each manifold
+const uint8_t VALVES_PER_MANIFOLD = N_VALVES / N_MANIFOLDS;
 
-  line.points[N_VALVES].set_null(); // Add end sentinel
-  line.duration = 1000;             // [ms]
-  protocol_mgr.add_line(line);
-}
+static const char *const PRESET_NAMES[N_PRESETS] = {
+    "Open all valves",  "Walk over valves", "Walk over manifolds",
+    "Checkerboard",     "Even/odd valves",  "Sweep over rows",
+    "Random fraction",  "Expanding rings"};
 
-/**
- * @brief Walk over all valves
- */
-static void generate_preset_1() {
-  protocol_mgr.set_name("Walk over valves");
-  Line line;
+/*------------------------------------------------------------------------------
+  PresetGenerator
+------------------------------------------------------------------------------*/
 
-  for (uint8_t idx_valve = 1; idx_valve <= N_VALVES; ++idx_valve) {
-    line.points[0] = valve2p(idx_valve);
-    line.points[1].set_null(); // Add end sentinel
-    line.duration = 500;       // [ms]
-    protocol_mgr.add_line(line);
-  }
+void PresetGenerator::begin(uint8_t idx_preset, uint16_t duration,
+                            uint8_t percent) {
+  _idx_preset = (idx_preset < N_PRESETS) ? idx_preset : 0;
+  _duration = duration ? duration : (_idx_preset == 1 ? 500 : 1000);
+  _percent = min(percent, (uint8_t)100);
+  rewind();
 }
 
-/**
- * @brief Walk over all manifolds
- */
-static void generate_preset_2() {
-  protocol_mgr.set_name("Walk over manifolds");
-  Line line;
-  uint8_t idx_valve;
-  uint8_t idx_point;
-
-  // Manifold 1: Valves 1 to 28
-  idx_point = 0;
-  for (idx_valve = 1; idx_valve <= 28; ++idx_valve) {
-    line.points[idx_point] = valve2p(idx_valve);
-    idx_point++;
-  }
-  line.points[idx_point].set_null(); // Add end sentinel
-  line.duration = 1000;              // [ms]
-  protocol_mgr.add_line(line);
-
-  // Manifold 2: Valves 29 to 56
-  idx_point = 0;
-  for (idx_valve = 29; idx_valve <= 56; ++idx_valve) {
-    line.points[idx_point] = valve2p(idx_valve);
-    idx_point++;
-  }
-  line.points[idx_point].set_null(); // Add end sentinel
-  line.duration = 1000;              // [ms]
-  protocol_mgr.add_line(line);
-
-  // Manifold 3: Valves 57 to 84
-  idx_point = 0;
-  for (idx_valve = 57; idx_valve <= 84; ++idx_valve) {
-    line.points[idx_point] = valve2p(idx_valve);
-    idx_point++;
-  }
-  line.points[idx_point].set_null(); // Add end sentinel
-  line.duration = 1000;              // [ms]
-  protocol_mgr.add_line(line);
-
-  // Manifold 4: Valves 85 to 112
-  idx_point = 0;
-  for (idx_valve = 85; idx_valve <= 112; ++idx_valve) {
-    line.points[idx_point] = valve2p(idx_valve);
-    idx_point++;
+void PresetGenerator::rewind() { _pos = 0; }
+
+uint16_t PresetGenerator::get_period() const {
+  switch (_idx_preset) {
+    case 1:
+      return N_VALVES;
+    case 2:
+      return N_MANIFOLDS;
+    case 3:
+    case 4:
+      return 2;
+    case 5:
+      return NUMEL_PCS_AXIS;
+    case 6:
+      return PRESET_RANDOM_PERIOD;
+    case 7:
+      return PCS_X_MAX; // Rings 1 to 7, as the center holds no valve
+    default:
+      return 1;
   }
-  line.points[idx_point].set_null(); // Add end sentinel
-  line.duration = 1000;              // [ms]
-  protocol_mgr.add_line(line);
 }
 
-/**
- * @brief Alternating checkerboard
- */
-static void generate_preset_3() {
-  protocol_mgr.set_name("Checkerboard");
-  Line line;
-  uint8_t idx_valve;
-  uint8_t idx_point;
-
-  // First half of checkboard: Valves 1 to 28
-  idx_point = 0;
-  for (idx_valve = 1; idx_valve <= 28; ++idx_valve) {
-    line.points[idx_point] = valve2p(idx_valve);
-    idx_point++;
-  }
-  // First half of checkboard: Valves 57 to 84
-  for (idx_valve = 57; idx_valve <= 84; ++idx_valve) {
-    line.points[idx_point] = valve2p(idx_valve);
-    idx_point++;
-  }
-  line.points[idx_point].set_null(); // Add end sentinel
-  line.duration = 1000;              // [ms]
-  protocol_mgr.add_line(line);
-
-  // Second half of checkboard: Valves 29 to 56
-  idx_point = 0;
-  for (idx_valve = 29; idx_valve <= 56; ++idx_valve) {
-    line.points[idx_point] = valve2p(idx_valve);
-    idx_point++;
-  }
-  // Second half of checkboard: Valves 85 to 112
-  for (idx_valve = 85; idx_valve <= 112; ++idx_valve) {
-    line.points[idx_point] = valve2p(idx_valve);
-    idx_point++;
-  }
-  line.points[idx_point].set_null(); // Add end sentinel
-  line.duration = 1000;              // [ms]
-  protocol_mgr.add_line(line);
+const char *PresetGenerator::get_name() const {
+  return PRESET_NAMES[_idx_preset];
 }
 
-/**
- * @brief Alternating even/odd valves
- */
-static void generate_preset_4() {
-  protocol_mgr.set_name("Even/odd valves");
-  Line line;
-  uint8_t idx_valve;
-  uint8_t idx_point;
-
-  idx_point = 0;
-  for (idx_valve = 1; idx_valve <= N_VALVES; ++idx_valve) {
-    if (idx_valve % 2 == 0) {
-      line.points[idx_point] = valve2p(idx_valve);
-      idx_point++;
-    }
-  }
-  line.points[idx_point].set_null(); // Add end sentinel
-  line.duration = 1000;              // [ms]
-  protocol_mgr.add_line(line);
-
-  idx_point = 0;
-  for (idx_valve = 1; idx_valve <= N_VALVES; ++idx_valve) {
-    if (idx_valve % 2 == 1) {
-      line.points[idx_point] = valve2p(idx_valve);
-      idx_point++;
+template <typename Fun>
+void PresetGenerator::add_valves(Line &line, Fun select) {
+  for (uint8_t valve = 1; valve <= N_VALVES; ++valve) {
+    P p = valve2p(valve);
+    if (select(valve, p)) {
+      line.add_point(p);
     }
   }
-  line.points[idx_point].set_null(); // Add end sentinel
-  line.duration = 1000;              // [ms]
-  protocol_mgr.add_line(line);
 }
 
-void load_protocol_preset(uint16_t idx_preset) {
-  protocol_mgr.clear();
+bool PresetGenerator::next_line(Line &line) {
+  uint16_t pos = _pos;
+  _pos = (_pos + 1 == get_period()) ? 0 : _pos + 1;
 
-  switch (idx_preset) {
-    case 0:
-      generate_preset_0();
+  line.clear_points();
+  line.duration = _duration;
+
+  switch (_idx_preset) {
+    case 1: // Walk over all valves
+      line.add_point(valve2p(pos + 1));
       break;
-    case 1:
-      generate_preset_1();
+
+    case 2: // Walk over all manifolds
+      add_valves(line, [&](uint8_t valve, const P &) {
+        return (valve - 1) / VALVES_PER_MANIFOLD == pos;
+      });
       break;
-    case 2:
-      generate_preset_2();
+
+    case 3: // Alternating checkerboard, i.e. manifolds 1 & 3 versus 2 & 4
+      add_valves(line, [&](uint8_t valve, const P &) {
+        return ((valve - 1) / VALVES_PER_MANIFOLD) % 2 == pos;
+      });
       break;
-    case 3:
-      generate_preset_3();
+
+    case 4: // Alternating even/odd valves
+      add_valves(line, [&](uint8_t valve, const P &) {
+        return valve % 2 == pos;
+      });
       break;
-    case 4:
-      generate_preset_4();
+
+    case 5: // Sweep over the PCS rows
+      add_valves(line, [&](uint8_t, const P &p) {
+        return p.y == PCS_Y_MIN + (int8_t)pos;
+      });
       break;
-    default:
-      generate_preset_0();
+
+    case 6: // Random fraction
+      if (pos == 0) {
+        _rng = 1; // Repeat the same sequence each period
+      }
+      add_valves(line, [&](uint8_t, const P &) {
+        // Xorshift32
+        _rng ^= _rng << 13;
+        _rng ^= _rng >> 17;
+        _rng ^= _rng << 5;
+        return _rng % 100 < _percent;
+      });
+      break;
+
+    case 7: // Expanding rings, by Chebyshev distance to the center
+      add_valves(line, [&](uint8_t, const P &p) {
+        return max(abs(p.x), abs(p.y)) == pos + 1;
+      });
+      break;
+
+    default: // Open all valves
+      add_valves(line, [](uint8_t, const P &) { return true; });
       break;
   }
 
+  return true;
+}
+
+/*------------------------------------------------------------------------------
+  load_protocol_preset
+------------------------------------------------------------------------------*/
+
+void load_protocol_preset(uint16_t idx_preset) {
+  PresetGenerator preset;
+  Line line;
+
+  protocol_mgr.clear();
+  preset.begin(min(idx_preset, (uint16_t)255));
+  protocol_mgr.set_name(preset.get_name());
+  for (uint16_t idx = 0; idx < preset.get_period(); ++idx) {
+    preset.next_line(line);
+    protocol_mgr.add_line(line);
+  }
   protocol_mgr.prime_start();
-}
\ No newline at end of file
+}
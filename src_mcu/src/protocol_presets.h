@@ -2,24 +2,104 @@
  * @file    protocol_presets.h
  * @author  Dennis van Gils (vangils.dennis@gmail.com)
  * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
- * @date    14-04-2023
+ * @date    15-10-2026
  *
  * @brief   Predefined protocol program presets for the TWT jetting grid.
  *
+ * Each preset is a periodic pattern produced line by line by
+ * `PresetGenerator`. A preset can either be played directly as a `LineSource`,
+ * leaving the protocol program in memory intact and taking up no program
+ * memory, or get loaded into memory as a single period by
+ * `load_protocol_preset()`.
+ *
  * @copyright MIT License. See the LICENSE file for details.
  */
 
+#ifndef PROTOCOL_PRESETS_H_
+#define PROTOCOL_PRESETS_H_
+
 #include "ProtocolManager.h"
 
 // See `main.cpp`
 extern ProtocolManager protocol_mgr;
 
 /**
- * @brief Load a protocol preset into Arduino memory:
+ * @brief The protocol presets:
  *   0: Open all valves
  *   1: Walk over all valves
  *   2: Walk over all manifolds
  *   3: Alternating checkerboard
  *   4: Alternating even/odd valves
+ *   5: Sweep over the PCS rows, bottom to top
+ *   6: Random fraction of the valves, see `PresetGenerator::begin()`
+ *   7: Rings expanding from the center of the PCS
+ */
+const uint8_t N_PRESETS = 8;
+
+// Number of lines of preset 6 before its random sequence repeats
+const uint16_t PRESET_RANDOM_PERIOD = 256;
+
+/*------------------------------------------------------------------------------
+  PresetGenerator
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Class to produce the lines of a protocol preset on demand, repeating
+ * its period endlessly.
+ */
+class PresetGenerator : public LineSource {
+public:
+  /**
+   * @brief Select preset @p idx_preset, starting from its first line. Unknown
+   * presets fall back to preset 0.
+   *
+   * @param duration Line duration [ms], 0 for the default of the preset
+   * @param percent Preset 6 only: Chance [%] of each valve to be open per line
+   */
+  void begin(uint8_t idx_preset, uint16_t duration = 0, uint8_t percent = 50);
+
+  /**
+   * @brief Start from the first line of the period again.
+   */
+  void rewind() override;
+
+  /**
+   * @brief Produce the next line into @p line.
+   *
+   * @return Always true, as the period repeats endlessly.
+   */
+  bool next_line(Line &line) override;
+
+  inline uint8_t get_preset() const { return _idx_preset; }
+
+  /**
+   * @brief Return the number of lines of a single period.
+   */
+  uint16_t get_period() const;
+
+  /**
+   * @brief Return the descriptive name of the preset.
+   */
+  const char *get_name() const;
+
+private:
+  uint8_t _idx_preset = 0;
+  uint16_t _duration = 1000; // [ms]
+  uint8_t _percent = 50;     // Preset 6
+  uint16_t _pos = 0;         // Line number within the period
+  uint32_t _rng = 1;         // State of the random generator of preset 6
+
+  /**
+   * @brief Add the valves for which @p select returns true.
+   */
+  template <typename Fun>
+  void add_valves(Line &line, Fun select);
+};
+
+/**
+ * @brief Load a single period of protocol preset @p idx_preset into Arduino
+ * memory, see `N_PRESETS`.
  */
-void load_protocol_preset(uint16_t idx_preset);
\ No newline at end of file
+void load_protocol_preset(uint16_t idx_preset);
+
+#endif
@@ -2,24 +2,119 @@
  * @file    translations.cpp
  * @author  Dennis van Gils (vangils.dennis@gmail.com)
  * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
- * @date    23-03-2023
+ * @date    15-10-2026
  * @copyright MIT License. See the LICENSE file for details.
  */
 
 #include "translations.h"
 #include "constants.h"
 #include "halt.h"
-#include <algorithm>
 
-// Translation matrix: Valve number to PCS point.
-// Reverse look-up. Must be build from the source array `P2VALVE` by calling
-// `init_valve2p()` during `setup()`.
-//   [dim 1]: The valve numbered 1 to 112, with 0 indicating 'no valve'
-//   [dim 2]: PCS axis [0: x, 1: y]
-//   Returns: The x or y-coordinate of the valve
-int8_t VALVE2P[N_VALVES + 1][2] = {0};
+/*------------------------------------------------------------------------------
+  Reverse look-up tables, generated at compile time
+------------------------------------------------------------------------------*/
 
-uint8_t p2valve(P p) {
+using Valve2P = std::array<std::array<int8_t, 2>, N_VALVES + 1>;
+using CP2Valve = std::array<std::array<Grid::valve_t, 16>, N_CP_PORTS>;
+using CP2Led = std::array<std::array<uint8_t, 16>, N_CP_PORTS>;
+
+static constexpr Valve2P build_valve2p() {
+  Valve2P out{};
+  for (auto &p : out) {
+    p = {P_NULL_VAL, P_NULL_VAL};
+  }
+  for (int8_t y = PCS_Y_MIN; y <= PCS_Y_MAX; y++) {
+    for (int8_t x = PCS_X_MIN; x <= PCS_X_MAX; x++) {
+      Grid::valve_t valve = P2VALVE[PCS_Y_MAX - y][x - PCS_X_MIN];
+      if ((valve > 0) && (valve <= N_VALVES)) {
+        out[valve] = {x, y};
+      }
+    }
+  }
+  return out;
+}
+
+/**
+ * @brief Does each valve from 1 to 112 appear exactly once in `P2VALVE`, and
+ * no other valve numbers?
+ */
+static constexpr bool all_valves_accounted_for() {
+  std::array<uint16_t, N_VALVES + 1> count{};
+  for (auto &row : P2VALVE) {
+    for (Grid::valve_t valve : row) {
+      if (valve > N_VALVES) {
+        return false;
+      }
+      count[valve]++;
+    }
+  }
+  for (Grid::valve_t valve = 1; valve <= N_VALVES; valve++) {
+    if (count[valve] != 1) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Is each valve wired to an in-bounds Centipede address that no other
+ * valve is wired to?
+ */
+static constexpr bool all_cp_addresses_unique() {
+  std::array<std::array<bool, 16>, N_CP_PORTS> taken{};
+  for (uint8_t idx = 0; idx < N_VALVES; idx++) {
+    uint8_t port = VALVE2CP_PORT[idx];
+    uint8_t bit = VALVE2CP_BIT[idx];
+    if ((port >= N_CP_PORTS) || (bit >= 16) || taken[port][bit]) {
+      return false;
+    }
+    taken[port][bit] = true;
+  }
+  return true;
+}
+
+static_assert(all_valves_accounted_for(),
+              "Not all valve numbers from 1 to 112 appear exactly once in "
+              "`P2VALVE`");
+static_assert(all_cp_addresses_unique(),
+              "A valve is wired to an out-of-bounds Centipede address or to "
+              "the same Centipede address as another valve");
+
+// Reverse look-up of `P2VALVE`
+constexpr Valve2P VALVE2P = build_valve2p();
+
+static constexpr CP2Valve build_cp2valve() {
+  CP2Valve out{};
+  for (Grid::valve_t valve = 1; valve <= N_VALVES; valve++) {
+    out[VALVE2CP_PORT[valve - 1]][VALVE2CP_BIT[valve - 1]] = valve;
+  }
+  return out;
+}
+
+static constexpr CP2Led build_cp2led() {
+  CP2Led out{};
+  for (Grid::valve_t valve = 1; valve <= N_VALVES; valve++) {
+    int8_t x = VALVE2P[valve][0];
+    int8_t y = VALVE2P[valve][1];
+    if (x == P_NULL_VAL) {
+      continue; // Valve is missing, already caught by a `static_assert`
+    }
+    out[VALVE2CP_PORT[valve - 1]][VALVE2CP_BIT[valve - 1]] =
+        P2LED[PCS_Y_MAX - y][x + PCS_X_MAX + 1];
+  }
+  return out;
+}
+
+// Reverse look-up of `VALVE2CP_PORT` and `VALVE2CP_BIT`
+constexpr CP2Valve CP2VALVE = build_cp2valve();
+
+constexpr CP2Led CP2LED = build_cp2led();
+
+/*------------------------------------------------------------------------------
+  Checked translations
+------------------------------------------------------------------------------*/
+
+Grid::valve_t p2valve(P p) {
   int8_t tmp_x = p.x - PCS_X_MIN;
   int8_t tmp_y = PCS_Y_MAX - p.y;
   if ((tmp_x < 0) || (tmp_x >= NUMEL_PCS_AXIS) || //
@@ -43,7 +138,7 @@ uint8_t p2led(P p) {
   return P2LED[tmp_y][tmp_x];
 }
 
-P valve2p(uint8_t valve) {
+P valve2p(Grid::valve_t valve) {
   if ((valve == 0) || (valve > N_VALVES)) {
     snprintf(buf, BUF_LEN,
              "CRITICAL: Out-of-bounds valve number %d in `valve2p()`", valve);
@@ -52,43 +147,170 @@ P valve2p(uint8_t valve) {
   return P{VALVE2P[valve][0], VALVE2P[valve][1]};
 }
 
-void init_valve2p() {
-  uint8_t valve;
-  int8_t x;
-  int8_t y;
+CP_Address valve2cp(Grid::valve_t valve) {
+  if ((valve == 0) || (valve > N_VALVES)) {
+    snprintf(buf, BUF_LEN,
+             "CRITICAL: Out-of-bounds valve number %d in `valve2cp()`", valve);
+    halt(6, buf);
+  }
+  return CP_Address{VALVE2CP_PORT[valve - 1], VALVE2CP_BIT[valve - 1]};
+}
+
+Grid::valve_t cp2valve(CP_Address cp_addr) {
+  if ((cp_addr.port >= N_CP_PORTS) || (cp_addr.bit >= 16)) {
+    snprintf(buf, BUF_LEN,
+             "CRITICAL: Out-of-bounds Centipede address (%d, %d) in "
+             "`cp2valve()`",
+             cp_addr.port, cp_addr.bit);
+    halt(9, buf);
+  }
+  return CP2VALVE[cp_addr.port][cp_addr.bit];
+}
+
+uint8_t cp2led(CP_Address cp_addr) {
+  if ((cp_addr.port >= N_CP_PORTS) || (cp_addr.bit >= 16)) {
+    snprintf(buf, BUF_LEN,
+             "CRITICAL: Out-of-bounds Centipede address (%d, %d) in "
+             "`cp2led()`",
+             cp_addr.port, cp_addr.bit);
+    halt(10, buf);
+  }
+  return CP2LED[cp_addr.port][cp_addr.bit];
+}
 
-  // Initialize array with special value `P_NULL_VAL` to be able to check
-  // if valves are missing from the reverse look-up table.
-  std::fill(*VALVE2P, *VALVE2P + (N_VALVES + 1) * 2, P_NULL_VAL);
+/*------------------------------------------------------------------------------
+  Fused look-up tables
+------------------------------------------------------------------------------*/
 
-  // Build the reverse look-up table
-  for (y = PCS_Y_MIN; y <= PCS_Y_MAX; y++) {
-    for (x = PCS_X_MIN; x <= PCS_X_MAX; x++) {
-      valve = P2VALVE[PCS_Y_MAX - y][x - PCS_X_MIN];
+/**
+ * @brief Return the hardware addresses of valve number @p valve located at
+ * PCS point (@p x, @p y).
+ */
+static constexpr ValveAddress make_valve_address(Grid::valve_t valve, int8_t x,
+                                                 int8_t y) {
+  return ValveAddress{valve, VALVE2CP_PORT[valve - 1], VALVE2CP_BIT[valve - 1],
+                      P2LED[PCS_Y_MAX - y][x + PCS_X_MAX + 1]};
+}
+
+static constexpr std::array<ValveAddress, Grid::N_PACKED_P> build_p2addr() {
+  std::array<ValveAddress, Grid::N_PACKED_P> out{};
+  for (int8_t y = PCS_Y_MIN; y <= PCS_Y_MAX; y++) {
+    for (int8_t x = PCS_X_MIN; x <= PCS_X_MAX; x++) {
+      Grid::valve_t valve = P2VALVE[PCS_Y_MAX - y][x - PCS_X_MIN];
       if (valve > 0) {
-        VALVE2P[valve][0] = x;
-        VALVE2P[valve][1] = y;
+        out[P::pack_indices(x - PCS_X_MIN, y - PCS_Y_MIN)] =
+            make_valve_address(valve, x, y);
       }
     }
   }
+  return out;
+}
 
-  // Check if all valves from 1 to 112 are accounted for
-  for (valve = 1; valve < N_VALVES + 1; valve++) {
-    x = VALVE2P[valve][0];
-    y = VALVE2P[valve][1];
-    if ((x == P_NULL_VAL) || (y == P_NULL_VAL)) {
-      snprintf(buf, BUF_LEN, "CRITICAL: Valve number %d is not accounted for",
-               valve);
-      halt(4, buf);
+static constexpr std::array<ValveAddress, N_VALVES> build_valve2addr() {
+  std::array<ValveAddress, N_VALVES> out{};
+  for (int8_t y = PCS_Y_MIN; y <= PCS_Y_MAX; y++) {
+    for (int8_t x = PCS_X_MIN; x <= PCS_X_MAX; x++) {
+      Grid::valve_t valve = P2VALVE[PCS_Y_MAX - y][x - PCS_X_MIN];
+      if (valve > 0) {
+        out[valve - 1] = make_valve_address(valve, x, y);
+      }
     }
   }
+  return out;
 }
 
-CP_Address valve2cp(uint8_t valve) {
-  if ((valve == 0) || (valve > N_VALVES)) {
+static_assert(N_VALVES % N_MANIFOLDS == 0,
+              "Each manifold must feed an equal number of valves");
+
+static constexpr std::array<CP_Masks, N_MANIFOLDS> build_manifold2cp_masks() {
+  std::array<CP_Masks, N_MANIFOLDS> out{};
+  for (Grid::valve_t valve = 1; valve <= N_VALVES; valve++) {
+    out[(valve - 1) / (N_VALVES / N_MANIFOLDS)][VALVE2CP_PORT[valve - 1]] |=
+        1U << VALVE2CP_BIT[valve - 1];
+  }
+  return out;
+}
+
+constexpr std::array<ValveAddress, Grid::N_PACKED_P> P2ADDR = build_p2addr();
+constexpr std::array<ValveAddress, N_VALVES> VALVE2ADDR = build_valve2addr();
+constexpr std::array<CP_Masks, N_MANIFOLDS> MANIFOLD2CP_MASKS =
+    build_manifold2cp_masks();
+
+using PCSRow2CP = std::array<
+    std::array<std::array<CP_MaskPairs, 1U << PCS_ROW_LUT_BITS>,
+               PCS_ROW_CHUNKS>,
+    NUMEL_PCS_AXIS>;
+
+static constexpr PCSRow2CP build_pcs_row2cp() {
+  PCSRow2CP out{};
+  for (uint8_t row = 0; row < NUMEL_PCS_AXIS; row++) {
+    for (uint8_t chunk = 0; chunk < PCS_ROW_CHUNKS; chunk++) {
+      for (uint16_t bits = 0; bits < (1U << PCS_ROW_LUT_BITS); bits++) {
+        for (uint8_t bit = 0; bit < PCS_ROW_LUT_BITS; bit++) {
+          uint8_t col = chunk * PCS_ROW_LUT_BITS + bit;
+          if (!((bits >> bit) & 0x01) || (col >= NUMEL_PCS_AXIS)) {
+            continue;
+          }
+          Grid::valve_t valve = P2VALVE[row][col];
+          if (valve > 0) {
+            uint8_t port = VALVE2CP_PORT[valve - 1];
+            out[row][chunk][bits][port >> 1] |=
+                1UL << (VALVE2CP_BIT[valve - 1] + ((port & 1) << 4));
+          }
+        }
+      }
+    }
+  }
+  return out;
+}
+
+static constexpr PCS_Rows build_pcs_row_valves() {
+  PCS_Rows out{};
+  for (uint8_t row = 0; row < NUMEL_PCS_AXIS; row++) {
+    for (uint8_t col = 0; col < NUMEL_PCS_AXIS; col++) {
+      if (P2VALVE[row][col] > 0) {
+        out[row] |= 1UL << col;
+      }
+    }
+  }
+  return out;
+}
+
+constexpr PCSRow2CP PCS_ROW2CP = build_pcs_row2cp();
+constexpr PCS_Rows PCS_ROW_VALVES = build_pcs_row_valves();
+
+void pcs_rows2cp_masks(const PCS_Rows &rows, CP_Masks &masks) {
+  CP_MaskPairs pairs{};
+  for (uint8_t row = 0; row < NUMEL_PCS_AXIS; ++row) {
+    uint32_t bits = rows[row];
+    for (uint8_t chunk = 0; chunk < PCS_ROW_CHUNKS; ++chunk) {
+      const CP_MaskPairs &part =
+          PCS_ROW2CP[row][chunk][bits & ((1U << PCS_ROW_LUT_BITS) - 1)];
+      bits >>= PCS_ROW_LUT_BITS;
+      for (uint8_t w = 0; w < pairs.size(); ++w) {
+        pairs[w] |= part[w];
+      }
+    }
+  }
+
+  for (uint8_t port = 0; port < N_CP_PORTS; ++port) {
+    masks[port] = pairs[port >> 1] >> ((port & 1) << 4);
+  }
+}
+
+const ValveAddress &p2addr(P p) {
+  if ((p.x < PCS_X_MIN) || (p.x > PCS_X_MAX) || //
+      (p.y < PCS_Y_MIN) || (p.y > PCS_Y_MAX)) {
     snprintf(buf, BUF_LEN,
-             "CRITICAL: Out-of-bounds valve number %d in `valve2cp()`", valve);
-    halt(6, buf);
+             "CRITICAL: Out-of-bounds index (%d, %d) in `p2addr()`", p.x, p.y);
+    halt(1, buf);
   }
-  return CP_Address{VALVE2CP_PORT[valve - 1], VALVE2CP_BIT[valve - 1]};
-}
\ No newline at end of file
+
+  const ValveAddress &addr = P2ADDR[p.pack_into_byte()];
+  if (addr.valve == 0) {
+    snprintf(buf, BUF_LEN, "CRITICAL: No valve exists at PCS point (%d, %d)",
+             p.x, p.y);
+    halt(5, buf);
+  }
+  return addr;
+}
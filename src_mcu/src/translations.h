@@ -2,7 +2,7 @@
  * @file    translations.h
  * @author  Dennis van Gils (vangils.dennis@gmail.com)
  * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
- * @date    10-08-2022
+ * @date    15-10-2026
  *
  * @brief   Contains the translation functions for points P in the Protocol
  * Coordinate System (PCS), valves, LEDs and Centipede (CP) addresses.
@@ -10,6 +10,11 @@
  * Will gracefully halt the microcontroller when out-of-bounds indices are
  * supplied.
  *
+ * All look-up tables get generated at compile time from the source arrays in
+ * `constants.h`, living in flash. Their consistency, i.e. each valve appearing
+ * exactly once in `P2VALVE` and being wired to its own Centipede address, gets
+ * checked at compile time as well.
+ *
  * @copyright MIT License. See the LICENSE file for details.
  */
 
@@ -19,6 +24,7 @@
 #include "CentipedeManager.h"
 #include "ProtocolManager.h"
 #include <Arduino.h>
+#include <array>
 
 // Common character buffer for string formatting, see `main.cpp`
 extern const uint8_t BUF_LEN;
@@ -31,7 +37,7 @@ extern char buf[];
  * @return The valve numbered 1 to 112, with 0 indicating 'no valve'
  * @throw Halts when the PCS point is out-of-bounds
  */
-uint8_t p2valve(P p);
+Grid::valve_t p2valve(P p);
 
 /**
  * @brief Translate PCS point to LED index.
@@ -49,25 +55,169 @@ uint8_t p2led(P p);
  * @return The PCS point
  * @throw Halts when the valve number is out-of-bounds
  */
-P valve2p(uint8_t valve);
+P valve2p(Grid::valve_t valve);
 
 /**
- * @brief Build the reverse look-up table in order for `valve2p()` to work.
+ * @brief Translate valve number to Centipede port and bit address.
  *
- * The reverse look-up table will get build from the source array `P2VALVE`. A
- * check will be performed to see if all valves from 1 to 112 are accounted for.
+ * @param valve The valve numbered 1 to 112
+ * @return The Centipede port and bit address
+ * @throw Halts when the valve number is out-of-bounds
+ */
+CP_Address valve2cp(Grid::valve_t valve);
+
+/**
+ * @brief Translate Centipede port and bit address to valve number.
  *
- * @throw Halts when not all valve numbers from 1 to 112 are accounted for
+ * @param cp_addr The Centipede port and bit address
+ * @return The valve numbered 1 to 112, with 0 indicating 'no valve'
+ * @throw Halts when the Centipede address is out-of-bounds
  */
-void init_valve2p();
+Grid::valve_t cp2valve(CP_Address cp_addr);
 
 /**
- * @brief Translate valve number to Centipede port and bit address.
+ * @brief Translate Centipede port and bit address to LED index.
  *
- * @param valve The valve numbered 1 to 112
- * @return The Centipede port and bit address
- * @throw Halts when the valve number is out-of-bounds
+ * Only meaningful for Centipede addresses that are wired to a valve, i.e.
+ * `cp2valve()` returns > 0.
+ *
+ * @param cp_addr The Centipede port and bit address
+ * @return The LED index
+ * @throw Halts when the Centipede address is out-of-bounds
+ */
+uint8_t cp2led(CP_Address cp_addr);
+
+/*------------------------------------------------------------------------------
+  Fused look-up tables
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Structure to hold all hardware addresses of a single valve.
+ */
+struct ValveAddress {
+  Grid::valve_t valve; // The valve numbered 1 to 112, 0 indicating 'no valve'
+  uint8_t cp_port;     // Centipede port
+  uint8_t cp_bit;      // Centipede bitmask bit
+  uint8_t led;         // LED index
+};
+
+/**
+ * @brief Fused translation table: Byte-encoded PCS point, see
+ * `P::pack_into_byte()`, to the hardware addresses of its valve. Replaces the
+ * chain of `p2valve()`, `valve2cp()` and `p2led()` by a single unchecked
+ * look-up. Entries without a valve hold `valve = 0`.
+ *
+ * Generated at compile time from `P2VALVE`, `P2LED`, `VALVE2CP_PORT` and
+ * `VALVE2CP_BIT`.
+ */
+extern const std::array<ValveAddress, Grid::N_PACKED_P> P2ADDR;
+
+/**
+ * @brief Fused translation table: Valve bit index, i.e. the valve number - 1,
+ * to the hardware addresses of the valve.
+ *
+ * Generated at compile time from `P2VALVE`, `P2LED`, `VALVE2CP_PORT` and
+ * `VALVE2CP_BIT`.
+ */
+extern const std::array<ValveAddress, N_VALVES> VALVE2ADDR;
+
+/**
+ * @brief Translation matrix: Valve number to PCS point, for unchecked look-ups
+ * in the hot path. See `valve2p()` for the checked version.
+ *   [dim 1]: The valve numbered 1 to 112, with 0 indicating 'no valve'
+ *   [dim 2]: PCS axis [0: x, 1: y]
+ *   Returns: The x or y-coordinate of the valve
+ */
+extern const std::array<std::array<int8_t, 2>, N_VALVES + 1> VALVE2P;
+
+/**
+ * @brief Translation matrix: Centipede address to valve number, for unchecked
+ * look-ups in the hot path. See `cp2valve()` for the checked version.
+ *   [dim 1]: The Centipede port
+ *   [dim 2]: The Centipede bitmask bit
+ *   Returns: The valve numbered 1 to 112, with 0 indicating 'no valve'
+ */
+extern const std::array<std::array<Grid::valve_t, 16>, N_CP_PORTS> CP2VALVE;
+
+/**
+ * @brief Translation matrix: Centipede address to LED index, for unchecked
+ * look-ups in the hot path. See `cp2led()` for the checked version.
+ *   [dim 1]: The Centipede port
+ *   [dim 2]: The Centipede bitmask bit
+ *   Returns: The LED index, only meaningful when a valve is wired to it
+ */
+extern const std::array<std::array<uint8_t, 16>, N_CP_PORTS> CP2LED;
+
+/**
+ * @brief Translation matrix: Manifold to the Centipede bitmasks of all its
+ * valves. Manifold 0 feeds valves 1 to 28, manifold 1 valves 29 to 56, etc.
+ *   [dim 1]: The manifold index, from 0 to `N_MANIFOLDS` - 1
+ *   [dim 2]: The Centipede port
+ *   Returns: The bitmask of the valves on that port fed by the manifold
+ *
+ * Generated at compile time from `VALVE2CP_PORT` and `VALVE2CP_BIT`.
+ */
+extern const std::array<CP_Masks, N_MANIFOLDS> MANIFOLD2CP_MASKS;
+
+/**
+ * @brief Width [bits] of the chunks of a PCS row bitmask that index
+ * `PCS_ROW2CP`. Wider chunks take fewer look-ups, but a much larger table in
+ * flash: 60 look-ups per line and 15 KB at 4 bits, versus 30 look-ups per
+ * line and 120 KB at 8 bits.
+ */
+#ifndef PCS_ROW_LUT_BITS
+#  define PCS_ROW_LUT_BITS 4
+#endif
+
+constexpr uint8_t PCS_ROW_CHUNKS =
+    (NUMEL_PCS_AXIS + PCS_ROW_LUT_BITS - 1) / PCS_ROW_LUT_BITS;
+
+/**
+ * @brief Centipede port bitmasks packed in pairs: port `2 * w` in the low and
+ * port `2 * w + 1` in the high half of word w, such that ORing them takes half
+ * the operations.
+ */
+using CP_MaskPairs = std::array<uint32_t, (N_CP_PORTS + 1) / 2>;
+
+/**
+ * @brief Fused translation table: Chunk of a PCS row bitmask to the Centipede
+ * port bitmasks of its valves, for transcoding a whole line in a fixed number
+ * of look-ups regardless of the number of open valves.
+ *   [dim 1]: The PCS row, i.e. `PCS_Y_MAX - y`
+ *   [dim 2]: The chunk, covering columns `chunk * PCS_ROW_LUT_BITS` and up
+ *   [dim 3]: The bits of the chunk
+ *   Returns: The contribution to the Centipede port bitmasks
+ *
+ * Generated at compile time from `P2VALVE`, `VALVE2CP_PORT` and
+ * `VALVE2CP_BIT`. Columns without a valve contribute nothing.
+ */
+extern const std::array<
+    std::array<std::array<CP_MaskPairs, 1U << PCS_ROW_LUT_BITS>,
+               PCS_ROW_CHUNKS>,
+    NUMEL_PCS_AXIS>
+    PCS_ROW2CP;
+
+/**
+ * @brief PCS row bitmasks of all valves, for checking a whole row at once.
+ */
+extern const PCS_Rows PCS_ROW_VALVES;
+
+/**
+ * @brief Transcode PCS row bitmasks @p rows into the Centipede port bitmasks
+ * @p masks via `PCS_ROW2CP`. Unchecked: bits without a valve get ignored, see
+ * `PCS_ROW_VALVES`.
+ */
+void pcs_rows2cp_masks(const PCS_Rows &rows, CP_Masks &masks);
+
+/**
+ * @brief Translate PCS point to the hardware addresses of its valve, checking
+ * its validity once. Meant for checking points on entry, e.g. during upload,
+ * after which `P2ADDR` can be indexed unchecked.
+ *
+ * @param p The PCS point
+ * @return The hardware addresses of the valve
+ * @throw Halts when the PCS point is out-of-bounds or holds no valve
  */
-CP_Address valve2cp(uint8_t valve);
+const ValveAddress &p2addr(P p);
 
 #endif
\ No newline at end of file
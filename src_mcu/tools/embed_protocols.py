@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""embed_protocols.py
+
+PlatformIO pre-build script compiling the `.proto` files listed under
+`custom_embed_protocols` into program images embedded in the internal flash of
+the microcontroller, see `src/embedded_protocols.h`. Paths are relative to the
+project folder:
+
+    [env:adafruit_feather_m4]
+    extra_scripts = pre:tools/embed_protocols.py
+    custom_embed_protocols =
+        ../protocols/protocols/simplex_001.proto
+
+Each file gets compiled by `proto_compile -e`, which has to be built first:
+
+    pio run -e proto_compile
+
+The entries get collected into `embedded_protocols.inc` inside the build
+folder, rewritten only when changed to avoid needless rebuilds.
+"""
+__author__ = "Dennis van Gils"
+__authoremail__ = "vangils.dennis@gmail.com"
+__url__ = "https://github.com/Dennis-van-Gils/project-TWT-jetting-grid"
+__date__ = "15-10-2026"
+__version__ = "1.0"
+# pylint: disable=undefined-variable, invalid-name
+
+import os
+import subprocess
+import sys
+import tempfile
+
+Import("env")  # type: ignore
+
+# No limit on the arena, as the image does not go into a program slot
+ARENA_BYTES = 64 * 1024**2
+
+# ------------------------------------------------------------------------------
+#   Compile
+# ------------------------------------------------------------------------------
+
+project_dir = env.subst("$PROJECT_DIR")
+out_dir = os.path.join(env.subst("$BUILD_DIR"), "embedded")
+out_path = os.path.join(out_dir, "embedded_protocols.inc")
+protos = env.GetProjectOption("custom_embed_protocols", "").split()
+
+if protos:
+    compiler = os.path.join(
+        env.subst("$PROJECT_BUILD_DIR"), "proto_compile", "program"
+    )
+    if not os.path.isfile(compiler):
+        sys.exit(
+            "error: `proto_compile` not found. Build it first with: "
+            "pio run -e proto_compile"
+        )
+
+    entries = []
+    with tempfile.TemporaryDirectory() as tmp_dir:
+        for proto in protos:
+            inc_path = os.path.join(tmp_dir, "entry.inc")
+            result = subprocess.run(
+                [
+                    compiler,
+                    os.path.join(project_dir, proto),
+                    "-m",
+                    str(ARENA_BYTES),
+                    "-e",
+                    inc_path,
+                ],
+                stdout=subprocess.DEVNULL,
+                check=False,
+            )
+            if result.returncode != 0:
+                sys.exit(f"error: Failed to embed '{proto}'.")
+            with open(inc_path, "r", encoding="utf-8") as f:
+                entries.append(f.read())
+            print(f"Embedded protocol: {proto}")
+
+    contents = "".join(entries)
+    old_contents = None
+    if os.path.isfile(out_path):
+        with open(out_path, "r", encoding="utf-8") as f:
+            old_contents = f.read()
+    if contents != old_contents:
+        os.makedirs(out_dir, exist_ok=True)
+        with open(out_path, "w", encoding="utf-8") as f:
+            f.write(contents)
+
+    env.Append(CPPPATH=[out_dir])
+
+elif os.path.isfile(out_path):
+    # Nothing to embed anymore
+    os.remove(out_path)
@@ -0,0 +1,450 @@
+/**
+ * @file    proto_compile.cpp
+ * @author  Dennis van Gils (vangils.dennis@gmail.com)
+ * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
+ * @date    15-10-2026
+ *
+ * @brief   Offline compiler of `.proto` protocol files, run on the host PC as
+ * the `proto_compile` PlatformIO environment:
+ *
+ *   pio run -e proto_compile
+ *   .pio/build/proto_compile/program <file.proto> [-o image.bin] [-b bulk.bin]
+ *       [-e embed.inc] [-m arena_bytes]
+ *
+ * The [DATA] section of the protocol file gets parsed and each point gets
+ * validated against `P2VALVE`, reporting all errors by line number instead of
+ * halfway an upload. The lines then get added to a `ProtocolManager` built
+ * from the very same sources and build flags as the firmware, such that the
+ * packing, the compression and the line durations are identical to the ones
+ * on the microcontroller. Set `PROTOCOL_COMPRESSED` in the build flags of the
+ * environment to compile for a firmware built with a different compression.
+ *
+ * Output files:
+ *   -o: The raw program image, see `Program::image()`, as stored in the
+ *       protocol library in flash. Its number of lines, number of bytes,
+ *       format and CRC32 get reported, see `ProtocolLibrary`.
+ *   -b: The lines in the 32-byte PCS rows format of the bulk upload, see
+ *       `upload_bulk` in `main.cpp`, ready to be chunked.
+ *   -e: The raw program image as an `EMBEDDED_PROTOCOL(...)` entry, to be
+ *       compiled into the firmware, see `embedded_protocols.h`. Normally
+ *       invoked by `tools/embed_protocols.py`.
+ *
+ * The program has to fit in the memory of a program slot, carved out of a
+ * memory arena of `-m` bytes, see `ProtocolManager::begin()`. Defaults to the
+ * same stand-in as `bench/bench.cpp`. Command `mem?` reports the arena size of
+ * the actual firmware.
+ *
+ * Exits with status 1 on any error.
+ *
+ * @copyright MIT License. See the LICENSE file for details.
+ */
+
+#include "CentipedeManager.h"
+#include "ProtocolManager.h"
+#include "crc32.h"
+#include "halt.h"
+#include "translations.h"
+
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Longest line of the protocol file, i.e. all valves open
+const uint16_t MAX_TEXT_LINE_LEN = 4096;
+
+// Errors beyond this number are counted, but not reported one by one
+const uint16_t MAX_REPORTED_ERRORS = 50;
+
+// Globals expected by the firmware sources, see `main.cpp`
+const uint8_t BUF_LEN = 128;
+char buf[BUF_LEN]{'\0'};
+const bool NO_PERIPHERALS = true;
+CRGB leds[N_LEDS];
+LEDCompositor led_compositor(leds);
+
+CentipedeManager cp_mgr;
+ProtocolManager protocol_mgr(&cp_mgr);
+MemoryArena mem_arena;
+
+void halt(uint8_t halt_ID, const char *msg) {
+  fflush(stdout);
+  fprintf(stderr, "EXECUTION HALTED, ID: %u\n", halt_ID);
+  if (msg != NULL) {
+    fprintf(stderr, "%s\n", msg);
+  }
+  exit(1);
+}
+
+/*------------------------------------------------------------------------------
+  Parsing
+------------------------------------------------------------------------------*/
+
+static const char *path_in = nullptr;
+static uint32_t N_errors = 0;
+
+/**
+ * @brief Report an error at line @p line_no of the protocol file.
+ */
+static void report_error(uint32_t line_no, const char *msg) {
+  if (N_errors < MAX_REPORTED_ERRORS) {
+    fprintf(stderr, "%s:%lu: error: %s\n", path_in, (unsigned long)line_no,
+            msg);
+  }
+  N_errors++;
+}
+
+/**
+ * @brief Parse a single line of the [DATA] section: The duration [ms] followed
+ * by the PCS points "x,y", all tab delimited. The same checks apply as when
+ * uploading, plus each point must be a valve, see `p2valve()`. A field "M"
+ * marks the line, see `PackedLine::is_marked()`.
+ *
+ * @param text Line of text, without its line ending, modified in place
+ * @param line_no Line number within the protocol file, for the errors
+ * @param line Line to parse into
+ * @param duration_err_us Added to with the rounding error of the duration
+ * @return True when valid, false otherwise
+ */
+static bool parse_line(char *text, uint32_t line_no, Line &line,
+                       double &duration_err_us) {
+  char *save;
+  char *field = strtok_r(text, "\t", &save);
+  char *end;
+
+  double duration_ms = strtod(field, &end);
+  if ((end == field) || (*end != '\0')) {
+    report_error(line_no, "Invalid duration.");
+    return false;
+  }
+  double duration_us = std::round(duration_ms * 1000);
+  if ((duration_us < 0) || (duration_us > DURATION_MAX_US)) {
+    snprintf(buf, BUF_LEN, "Duration out of range 0 to %lu ms.",
+             (unsigned long)(DURATION_MAX_US / 1000));
+    report_error(line_no, buf);
+    return false;
+  }
+  line.duration = encode_duration_us((uint32_t)duration_us);
+  duration_err_us +=
+      std::fabs(decode_duration_us(line.duration) - duration_us);
+
+  bool valid = true;
+  bool opened[N_VALVES + 1] = {false};
+  line.clear_points();
+  line.marked = false;
+  while ((field = strtok_r(nullptr, "\t", &save)) != nullptr) {
+    if (strcmp(field, "M") == 0) {
+      line.marked = true;
+      continue;
+    }
+
+    long x = strtol(field, &end, 10);
+    bool ok = (end != field) && (*end == ',');
+    char *str_y = end + 1;
+    long y = ok ? strtol(str_y, &end, 10) : 0;
+    ok &= (end != str_y) && (*end == '\0');
+    if (!ok) {
+      snprintf(buf, BUF_LEN, "Invalid point '%.32s'.", field);
+      report_error(line_no, buf);
+      valid = false;
+      continue;
+    }
+
+    if ((x < PCS_X_MIN) || (x > PCS_X_MAX) || (y < PCS_Y_MIN) ||
+        (y > PCS_Y_MAX)) {
+      snprintf(buf, BUF_LEN, "Point (%ld, %ld) is outside of the PCS.", x, y);
+      report_error(line_no, buf);
+      valid = false;
+      continue;
+    }
+
+    P p(x, y);
+    Grid::valve_t valve = p2valve(p);
+    if (valve == 0) {
+      snprintf(buf, BUF_LEN, "Point (%ld, %ld) is not a valve.", x, y);
+      report_error(line_no, buf);
+      valid = false;
+      continue;
+    }
+    if (opened[valve]) {
+      continue; // Listed twice, which is harmless
+    }
+    opened[valve] = true;
+    line.add_point(p);
+  }
+  return valid;
+}
+
+/*------------------------------------------------------------------------------
+  Output
+------------------------------------------------------------------------------*/
+
+/**
+ * @brief Write @p N_bytes bytes at @p data to the file at @p path.
+ */
+static bool write_file(const char *path, const void *data, size_t N_bytes) {
+  FILE *f = fopen(path, "wb");
+  if (f == nullptr) {
+    fprintf(stderr, "error: Can't open '%s' for writing.\n", path);
+    return false;
+  }
+  bool success = (fwrite(data, 1, N_bytes, f) == N_bytes);
+  success &= (fclose(f) == 0);
+  if (!success) {
+    fprintf(stderr, "error: Failed writing '%s'.\n", path);
+  }
+  return success;
+}
+
+/**
+ * @brief Format @p line in the bulk upload format into @p raw, see
+ * `decode_rows_line()` in `main.cpp`: 1 x uint16_t encoded time duration
+ * followed by the uint16_t PCS row bitmasks, little endian.
+ */
+static void line_to_rows(const Line &line, uint8_t *raw) {
+  uint16_t rows[NUMEL_PCS_AXIS] = {0};
+  for (const P &p : line) {
+    rows[PCS_Y_MAX - p.y] |= 1U << (p.x - PCS_X_MIN);
+  }
+  if (line.marked) {
+    rows[0] |= PCS_ROW_MARKER;
+  }
+
+  raw[0] = line.duration & 0xFF;
+  raw[1] = line.duration >> 8;
+  for (uint8_t row = 0; row < NUMEL_PCS_AXIS; ++row) {
+    raw[2 + 2 * row] = rows[row] & 0xFF;
+    raw[3 + 2 * row] = rows[row] >> 8;
+  }
+}
+
+/**
+ * @brief Write the lines of the program as stored, i.e. after a round trip
+ * through the firmware storage, in the bulk upload format to the file at
+ * @p path.
+ */
+static bool write_bulk(const char *path) {
+  FILE *f = fopen(path, "wb");
+  if (f == nullptr) {
+    fprintf(stderr, "error: Can't open '%s' for writing.\n", path);
+    return false;
+  }
+
+  bool success = true;
+  uint8_t raw[2 + 2 * NUMEL_PCS_AXIS];
+  protocol_mgr.unpack_range(0, protocol_mgr.get_N_lines(),
+                            [&](uint16_t, const Line &line) {
+                              line_to_rows(line, raw);
+                              success &= (fwrite(raw, 1, sizeof(raw), f) ==
+                                          sizeof(raw));
+                            });
+  success &= (fclose(f) == 0);
+  if (!success) {
+    fprintf(stderr, "error: Failed writing '%s'.\n", path);
+  }
+  return success;
+}
+
+/**
+ * @brief Write the program image @p image of @p N_bytes bytes as an
+ * `EMBEDDED_PROTOCOL(...)` entry to the file at @p path, see
+ * `embedded_protocols.h`. The identifier of the image derives from the
+ * protocol name.
+ */
+static bool write_embed(const char *path, const uint8_t *image,
+                        uint32_t N_bytes) {
+  if (N_bytes == 0) {
+    fprintf(stderr, "error: Can't embed a protocol without lines.\n");
+    return false;
+  }
+
+  // Keep the name a plain string literal and the identifier a valid one
+  const char *name = protocol_mgr.get_name();
+  char ident[80] = "proto_";
+  char literal[64];
+  size_t len = strlen(name);
+  len = min(len, sizeof(literal) - 1);
+  for (size_t idx = 0; idx < len; ++idx) {
+    char c = name[idx];
+    ident[6 + idx] = isalnum((unsigned char)c) ? c : '_';
+    literal[idx] = ((c == '"') || (c == '\\')) ? '_' : c;
+  }
+  ident[6 + len] = '\0';
+  literal[len] = '\0';
+
+  FILE *f = fopen(path, "w");
+  if (f == nullptr) {
+    fprintf(stderr, "error: Can't open '%s' for writing.\n", path);
+    return false;
+  }
+  fprintf(f, "// Generated by proto_compile from %s, do not edit\n", path_in);
+  fprintf(f, "EMBEDDED_PROTOCOL(%s, \"%s\", %u, 0x%04x, 0x%08lx", ident,
+          literal, protocol_mgr.get_N_lines(), PROGRAM_IMAGE_FORMAT,
+          (unsigned long)crc32(image, N_bytes));
+  for (uint32_t idx = 0; idx < N_bytes; ++idx) {
+    fprintf(f, (idx % 12 == 0) ? ",\n    0x%02x" : ", 0x%02x", image[idx]);
+  }
+  fprintf(f, ")\n");
+
+  bool success = (ferror(f) == 0);
+  success &= (fclose(f) == 0);
+  if (!success) {
+    fprintf(stderr, "error: Failed writing '%s'.\n", path);
+  }
+  return success;
+}
+
+/*------------------------------------------------------------------------------
+  main
+------------------------------------------------------------------------------*/
+
+static void print_usage() {
+  fprintf(stderr, "Usage: proto_compile <file.proto> [-o image.bin] "
+                  "[-b bulk.bin] [-e embed.inc] [-m arena_bytes]\n");
+}
+
+int main(int argc, char **argv) {
+  const char *path_image = nullptr;
+  const char *path_bulk = nullptr;
+  const char *path_embed = nullptr;
+  uint32_t arena_bytes = 128 * 1024; // Stand-in as in `bench/bench.cpp`
+
+  for (int idx = 1; idx < argc; ++idx) {
+    bool has_value = (idx + 1 < argc);
+    if ((strcmp(argv[idx], "-o") == 0) && has_value) {
+      path_image = argv[++idx];
+    } else if ((strcmp(argv[idx], "-b") == 0) && has_value) {
+      path_bulk = argv[++idx];
+    } else if ((strcmp(argv[idx], "-e") == 0) && has_value) {
+      path_embed = argv[++idx];
+    } else if ((strcmp(argv[idx], "-m") == 0) && has_value) {
+      arena_bytes = strtoul(argv[++idx], nullptr, 10);
+    } else if ((argv[idx][0] != '-') && (path_in == nullptr)) {
+      path_in = argv[idx];
+    } else {
+      print_usage();
+      return 1;
+    }
+  }
+  if (path_in == nullptr) {
+    print_usage();
+    return 1;
+  }
+
+  FILE *f = fopen(path_in, "r");
+  if (f == nullptr) {
+    fprintf(stderr, "error: Can't open '%s'.\n", path_in);
+    return 1;
+  }
+
+  uint8_t *arena_mem = (uint8_t *)malloc(arena_bytes);
+  if (arena_mem == nullptr) {
+    fprintf(stderr, "error: Can't allocate the memory arena.\n");
+    return 1;
+  }
+  cp_mgr.begin();
+  mem_arena.begin(arena_mem, arena_bytes);
+  protocol_mgr.begin(mem_arena);
+
+  // Keep the file name as the protocol name, like the Python uploader does
+  const char *name = strrchr(path_in, '/');
+  protocol_mgr.set_name(name ? name + 1 : path_in);
+
+  static char text[MAX_TEXT_LINE_LEN];
+  static Line line;
+  uint32_t line_no = 0;
+  bool in_data = false;
+  bool full = false;
+  double duration_err_us = 0;
+  uint64_t total_us = 0;
+  uint32_t min_us = UINT32_MAX;
+  uint32_t max_us = 0;
+  uint64_t sum_open = 0;
+  uint16_t max_open = 0;
+
+  while (fgets(text, sizeof(text), f) != nullptr) {
+    line_no++;
+    size_t len = strlen(text);
+    if ((len == sizeof(text) - 1) && (text[len - 1] != '\n')) {
+      report_error(line_no, "Line is too long.");
+      break;
+    }
+    while ((len > 0) && isspace((unsigned char)text[len - 1])) {
+      text[--len] = '\0'; // Strip the line ending and trailing whitespace
+    }
+
+    if (!in_data) {
+      in_data = (strcmp(text, "[DATA]") == 0);
+      continue;
+    }
+    if ((len == 0) || full) {
+      continue;
+    }
+
+    if (!parse_line(text, line_no, line, duration_err_us) || N_errors) {
+      continue; // Only validate the remainder
+    }
+    if (!protocol_mgr.add_line(line)) {
+      snprintf(buf, BUF_LEN,
+               "Protocol program exceeds available memory after %u lines.",
+               protocol_mgr.get_N_lines());
+      report_error(line_no, buf);
+      full = true;
+      continue;
+    }
+
+    uint32_t duration_us = decode_duration_us(line.duration);
+    total_us += duration_us;
+    min_us = min(min_us, duration_us);
+    max_us = max(max_us, duration_us);
+    sum_open += line.N_points;
+    max_open = max(max_open, line.N_points);
+  }
+  fclose(f);
+
+  if (!in_data) {
+    fprintf(stderr, "%s: error: No [DATA] section found.\n", path_in);
+    return 1;
+  }
+  if (N_errors) {
+    fprintf(stderr, "%s: %lu error(s)\n", path_in, (unsigned long)N_errors);
+    return 1;
+  }
+
+  uint16_t N_lines = protocol_mgr.get_N_lines();
+  Program &program = protocol_mgr.get_program();
+  uint8_t *image = program.image(); // Might rearrange, so before the size
+  uint32_t N_bytes = program.get_N_image_bytes();
+
+  printf("name             %s\n", protocol_mgr.get_name());
+  printf("PROTOCOL_PACKING    %d\n", PROTOCOL_PACKING);
+  printf("PROTOCOL_COMPRESSED %d\n", PROTOCOL_COMPRESSED);
+  printf("image format     0x%04x\n", PROGRAM_IMAGE_FORMAT);
+  printf("N_lines          %u\n", N_lines);
+  printf("N_bytes          %lu of %lu (%.1f%%)\n", (unsigned long)N_bytes,
+         (unsigned long)program.get_max_image_bytes(),
+         100.0 * N_bytes / program.get_max_image_bytes());
+  printf("bytes/line       %.2f\n", N_lines ? (double)N_bytes / N_lines : 0);
+  printf("image CRC32      0x%08lx\n",
+         (unsigned long)crc32(image, N_bytes));
+  printf("duration         %.3f s\n", total_us / 1e6);
+  printf("line duration    %.3f to %.3f ms\n", N_lines ? min_us / 1e3 : 0,
+         max_us / 1e3);
+  printf("rounding error   %.1f us/line\n",
+         N_lines ? duration_err_us / N_lines : 0);
+  printf("valves open      %.1f mean, %u max\n",
+         N_lines ? (double)sum_open / N_lines : 0, max_open);
+
+  bool success = true;
+  if (path_image) {
+    success &= write_file(path_image, image, N_bytes);
+  }
+  if (path_bulk) {
+    success &= write_bulk(path_bulk);
+  }
+  if (path_embed) {
+    success &= write_embed(path_embed, image, N_bytes);
+  }
+  return success ? 0 : 1;
+}
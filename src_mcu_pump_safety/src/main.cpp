@@ -2,7 +2,7 @@
  * @file    Main.cpp
  * @author  Dennis van Gils (vangils.dennis@gmail.com)
  * @version https://github.com/Dennis-van-Gils/project-TWT-jetting-grid
- * @date    28-11-2022
+ * @date    15-10-2026
  *
  * @brief   Firmware for the pump safety microcontroller.
  *
@@ -24,6 +24,49 @@ The main MCU should send a digital 'safety' pulse at least once every
 `SAFETY_PULSE_TIMEOUT` ms over to the safety MCU as indication that the main MCU
 is still operating all right. As long as the safety MCU receives pulses within
 the set time period, the 'pump on' relay will be engaged.
+
+Every rising edge gets timestamped, and the period between successive edges
+must lie within [`PULSE_PERIOD_MIN`, `PULSE_PERIOD_MAX`] us. A period out of
+band drops the relay straight away, without waiting for the timeout. The relay
+gets engaged again only after an in-band period has been received.
+
+The pulses carry an encoded heartbeat of the main MCU, see `SafetyPulser.h` of
+the main MCU firmware. Every period carries a single symbol, encoded in the time
+that the pulse stays high. A frame consists of a START symbol followed by 6 bit
+symbols, LSB first:
+
+  bits 0-1: FSM state of the main MCU
+  bits 2-3: Loop-latency bucket of the main MCU
+  bit  4  : Any valve open?
+  bit  5  : Even parity over bits 0-4
+
+The main MCU also sets bit 4 while its pump safety is overridden by command
+`override_safety`, regardless of the valves, as the relay follows this bit. The
+override thus keeps the relay engaged with all valves closed, as long as the
+heartbeat itself stays valid. This firmware can't tell the two apart: the
+reported valves-open flag then reads 1.
+
+The relay gets engaged only after a START symbol followed by an in-band period.
+It gets dropped straight away on:
+  - a STOP symbol, i.e. the main MCU has ended the pulse train gracefully,
+  - a frame reporting that none of the valves are open,
+  - an invalid symbol or a frame with a parity error (trip),
+  - the absence of a valid frame for `FRAME_TIMEOUT` ms (trip).
+
+A plain square wave of 50% duty cycle decodes as invalid, hence this firmware
+requires a main MCU sending the heartbeat.
+
+Both timeouts are kept by a hardware timer (TC4 + TC5 as a single 32-bit
+counter): the pulse interrupt re-arms a compare match on every in-band period
+and on every valid frame, and the compare interrupt drops the relay directly.
+Hence, the trip time does not depend on how soon the main loop gets around to
+it. In between interrupts the core sleeps. The main loop still checks both
+timeouts as a backstop.
+
+Statistics of the pulse period (min, max, mean and jitter = max - min) get
+reported as a tab-separated line over USB serial every `REPORT_INTERVAL` ms,
+followed by the number of periods received, the number of trips so far and the
+latest reported FSM state, loop-latency bucket and valves-open flag.
 */
 
 #include "Adafruit_SleepyDog.h"
@@ -34,12 +77,228 @@ const uint8_t PIN_PUMP_FRONT_PANEL_LED = 10;
 const uint8_t PIN_SAFETY_PULSE_IN = A0;
 const uint16_t SAFETY_PULSE_TIMEOUT = 100; // [ms]
 
+// Accepted band of the safety pulse period, nominally 60 ms, see
+// `PERIOD_SAFETY_PULSES` of the main MCU
+const uint32_t PULSE_PERIOD_MIN = 40000; // [us]
+const uint32_t PULSE_PERIOD_MAX = 80000; // [us]
+
+// Maximum time between two valid heartbeat frames, nominally 420 ms apart
+const uint16_t FRAME_TIMEOUT = 1000; // [ms]
+
+// Symbol widths: The time [us] that the pulse stays high. Must match
+// `SAFETY_SYMBOL_...` of the main MCU: 10, 20, 40 and 50 ms respectively.
+const uint32_t SYMBOL_WIDTH_MIN = 5000;  // Shorter is invalid
+const uint32_t SYMBOL_WIDTH_0_1 = 15000; // Bit 0 below, bit 1 above
+const uint32_t SYMBOL_WIDTH_GAP = 25000; // Invalid gap above, till 35 ms
+const uint32_t SYMBOL_WIDTH_START = 35000;
+const uint32_t SYMBOL_WIDTH_STOP = 45000;
+const uint32_t SYMBOL_WIDTH_MAX = 55000; // Longer is invalid
+
+// Number of frame bits following the START symbol
+const uint8_t N_FRAME_BITS = 6;
+
+// Interval of the pulse-period statistics report over USB serial
+const uint16_t REPORT_INTERVAL = 1000; // [ms]
+
+// Timeout timer: TC4 + TC5 as a 32-bit counter, clocked by GCLK0 (48 MHz)
+// divided by 16. Wraps around after 23 minutes.
+const uint32_t TIMEOUT_TICKS_PER_MS = 3000;
+
 // The microcontroller will auto-reboot when it fails to get a
 // `Watchdog.reset()` within this time period [ms]
 const uint16_t WATCHDOG_TIMEOUT = 200; // [ms]
 
-volatile bool received_pulse = false;
-void my_isr() { received_pulse = true; }
+/*------------------------------------------------------------------------------
+  Timeout timer
+------------------------------------------------------------------------------*/
+
+// Compare channels of the timeout timer
+const uint8_t CC_PULSE = 0; // Deadline of the next in-band period
+const uint8_t CC_FRAME = 1; // Deadline of the next valid frame
+
+volatile bool relay_engaged = false; // Timeout timer may drop the relay?
+volatile bool timed_out = false;     // Relay dropped by the timeout timer?
+
+void timeout_timer_begin() {
+  GCLK->CLKCTRL.reg = GCLK_CLKCTRL_CLKEN | GCLK_CLKCTRL_GEN_GCLK0 |
+                      GCLK_CLKCTRL_ID_TC4_TC5;
+  while (GCLK->STATUS.bit.SYNCBUSY) {}
+
+  TC4->COUNT32.CTRLA.reg = TC_CTRLA_SWRST;
+  while (TC4->COUNT32.CTRLA.bit.SWRST) {}
+
+  TC4->COUNT32.CTRLA.reg = TC_CTRLA_MODE_COUNT32 | TC_CTRLA_WAVEGEN_NFRQ |
+                           TC_CTRLA_PRESCALER_DIV16;
+  while (TC4->COUNT32.STATUS.bit.SYNCBUSY) {}
+
+  // Keep COUNT synchronized, so that it can be read without a read request
+  TC4->COUNT32.READREQ.reg =
+      TC_READREQ_RCONT | TC_READREQ_ADDR(TC_COUNT32_COUNT_OFFSET);
+
+  // The compare interrupts stay enabled. The handler only acts while the
+  // relay is engaged.
+  TC4->COUNT32.INTFLAG.reg = TC_INTFLAG_MC0 | TC_INTFLAG_MC1;
+  TC4->COUNT32.INTENSET.reg = TC_INTENSET_MC0 | TC_INTENSET_MC1;
+  NVIC_EnableIRQ(TC4_IRQn);
+
+  TC4->COUNT32.CTRLA.bit.ENABLE = 1;
+  while (TC4->COUNT32.STATUS.bit.SYNCBUSY) {}
+}
+
+/**
+ * @brief Set the deadline of compare channel @p cc to @p timeout_ms from now.
+ * Must be called with the interrupts disabled or from within an interrupt.
+ */
+void timeout_timer_arm(uint8_t cc, uint16_t timeout_ms) {
+  TC4->COUNT32.CC[cc].reg =
+      TC4->COUNT32.COUNT.reg + timeout_ms * TIMEOUT_TICKS_PER_MS;
+  while (TC4->COUNT32.STATUS.bit.SYNCBUSY) {}
+}
+
+void TC4_Handler() {
+  TC4->COUNT32.INTFLAG.reg = TC_INTFLAG_MC0 | TC_INTFLAG_MC1;
+
+  if (relay_engaged) {
+    digitalWrite(PIN_PUMP_RELAY, LOW);
+    digitalWrite(PIN_PUMP_FRONT_PANEL_LED, LOW);
+    relay_engaged = false;
+    timed_out = true;
+  }
+}
+
+/*------------------------------------------------------------------------------
+  Safety pulse ISR
+------------------------------------------------------------------------------*/
+
+struct PulseStats {
+  uint32_t N = 0;            // Number of periods received
+  uint32_t min = UINT32_MAX; // Shortest period [us]
+  uint32_t max = 0;          // Longest period [us]
+  uint64_t sum = 0;          // Summed periods [us]
+};
+
+enum Symbol : uint8_t {
+  SYMBOL_0,
+  SYMBOL_1,
+  SYMBOL_START,
+  SYMBOL_STOP,
+  SYMBOL_INVALID
+};
+
+volatile bool received_pulse = false; // Received an in-band period?
+volatile bool received_start = false; // Received a START symbol?
+volatile bool received_stop = false;  // Received a STOP symbol?
+volatile bool received_frame = false; // Received a valid frame?
+volatile bool pulse_anomaly = false;  // Received out-of-band or invalid data?
+volatile uint8_t health = 0;          // Latest valid frame
+volatile PulseStats stats;            // Since the last report
+
+Symbol decode_symbol(uint32_t width) {
+  if (width < SYMBOL_WIDTH_MIN) {
+    return SYMBOL_INVALID;
+  } else if (width < SYMBOL_WIDTH_0_1) {
+    return SYMBOL_0;
+  } else if (width < SYMBOL_WIDTH_GAP) {
+    return SYMBOL_1;
+  } else if (width < SYMBOL_WIDTH_START) {
+    return SYMBOL_INVALID;
+  } else if (width < SYMBOL_WIDTH_STOP) {
+    return SYMBOL_START;
+  } else if (width < SYMBOL_WIDTH_MAX) {
+    return SYMBOL_STOP;
+  }
+  return SYMBOL_INVALID;
+}
+
+/**
+ * @brief Decode the symbol carried by the high time of the pulse that just
+ * ended, and return it.
+ */
+Symbol isr_falling_edge(uint32_t width) {
+  static uint8_t bit_idx = N_FRAME_BITS; // Next frame bit, none when waiting
+  static uint8_t frame = 0;
+  Symbol symbol = decode_symbol(width);
+
+  switch (symbol) {
+    case SYMBOL_START:
+      received_start = true;
+      if (!relay_engaged) {
+        // Starts a fresh train, see `loop()`
+        timeout_timer_arm(CC_FRAME, FRAME_TIMEOUT);
+      }
+      bit_idx = 0;
+      frame = 0;
+      break;
+
+    case SYMBOL_STOP:
+      received_stop = true;
+      bit_idx = N_FRAME_BITS;
+      break;
+
+    case SYMBOL_0:
+    case SYMBOL_1:
+      if (bit_idx == N_FRAME_BITS) {
+        break; // Joined halfway a frame, await the next START symbol
+      }
+      frame |= symbol << bit_idx;
+      if (++bit_idx == N_FRAME_BITS) {
+        if (__builtin_parity(frame)) {
+          pulse_anomaly = true;
+        } else {
+          health = frame;
+          received_frame = true;
+          timeout_timer_arm(CC_FRAME, FRAME_TIMEOUT);
+        }
+      }
+      break;
+
+    default:
+      pulse_anomaly = true;
+      break;
+  }
+
+  return symbol;
+}
+
+void my_isr() {
+  static uint32_t prev_edge = 0;
+  static bool first_edge = true; // No period to check yet
+  uint32_t now = micros();
+
+  if (!digitalRead(PIN_SAFETY_PULSE_IN)) {
+    if (!first_edge) {
+      if (isr_falling_edge(now - prev_edge) == SYMBOL_STOP) {
+        // The train got ended gracefully. Don't check the period of the
+        // rising edge that restarts it.
+        first_edge = true;
+      }
+    }
+    return;
+  }
+
+  uint32_t period = now - prev_edge;
+  prev_edge = now;
+  if (first_edge) {
+    first_edge = false;
+    return;
+  }
+
+  if (period < PULSE_PERIOD_MIN || period > PULSE_PERIOD_MAX) {
+    pulse_anomaly = true;
+  } else {
+    received_pulse = true;
+    timeout_timer_arm(CC_PULSE, SAFETY_PULSE_TIMEOUT);
+  }
+
+  stats.N++;
+  stats.sum += period;
+  if (period < stats.min) {
+    stats.min = period;
+  }
+  if (period > stats.max) {
+    stats.max = period;
+  }
+}
 
 /*------------------------------------------------------------------------------
   setup
@@ -54,13 +313,18 @@ void setup() {
   pinMode(PIN_PUMP_FRONT_PANEL_LED, OUTPUT);
   digitalWrite(PIN_PUMP_FRONT_PANEL_LED, LOW);
 
+  // Pulse-period statistics
+  Serial.begin(9600);
+
   // Onboard LED always on
   pinMode(PIN_LED, OUTPUT);
   digitalWrite(PIN_LED, HIGH);
 
+  timeout_timer_begin();
+
   // Safety pulses coming from the main MCU
   pinMode(PIN_SAFETY_PULSE_IN, INPUT_PULLDOWN);
-  attachInterrupt(digitalPinToInterrupt(PIN_SAFETY_PULSE_IN), my_isr, RISING);
+  attachInterrupt(digitalPinToInterrupt(PIN_SAFETY_PULSE_IN), my_isr, CHANGE);
 
   Watchdog.enable(WATCHDOG_TIMEOUT);
 }
@@ -73,29 +337,125 @@ void loop() {
   uint32_t now = millis();
   static uint32_t tick_watchdog = now;
   static uint32_t tick_safety_pulse = now;
+  static uint32_t tick_frame = now;
+  static uint32_t tick_report = now;
+  static uint32_t N_trips = 0;
+  static uint8_t latest_health = 0;
+  static bool streaming = false; // Received START since the last stop or trip?
+  static bool valves_open = false;
   static bool engage_relay = false;
   static bool prev_state_relay = false;
+  bool anomaly, stop, start, pulse, frame;
 
   noInterrupts();
-  if (received_pulse) {
-    received_pulse = false;
-    tick_safety_pulse = now;
-    engage_relay = true;
-  }
+  anomaly = pulse_anomaly || timed_out; // The timer has dropped the relay
+  stop = received_stop;
+  start = received_start;
+  pulse = received_pulse;
+  frame = received_frame;
+  latest_health = frame ? health : latest_health;
+  pulse_anomaly = false;
+  timed_out = false;
+  received_stop = false;
+  received_start = false;
+  received_pulse = false;
+  received_frame = false;
   interrupts();
 
-  if (now - tick_safety_pulse > SAFETY_PULSE_TIMEOUT) {
+  if (anomaly) {
+    // Takes precedence over anything received in the meantime
+    if (engage_relay) {
+      N_trips++;
+    }
+    engage_relay = false;
+    streaming = false;
+
+  } else if (stop) {
     engage_relay = false;
+    streaming = false;
+
+  } else {
+    if (start && !streaming) {
+      // The main MCU only starts the train when any valve is open
+      streaming = true;
+      valves_open = true;
+      tick_frame = now;
+    }
+    if (frame) {
+      valves_open = latest_health & (1 << 4);
+      tick_frame = now;
+    }
+    if (pulse && streaming) {
+      tick_safety_pulse = now;
+      engage_relay = valves_open;
+    } else if (!valves_open) {
+      engage_relay = false;
+    }
+  }
+
+  // Backstop of the timeout timer
+  if (engage_relay && ((now - tick_safety_pulse > SAFETY_PULSE_TIMEOUT) ||
+                       (now - tick_frame > FRAME_TIMEOUT))) {
+    N_trips++;
+    engage_relay = false;
+    streaming = false;
   }
 
   if (prev_state_relay != engage_relay) {
+    noInterrupts();
     digitalWrite(PIN_PUMP_RELAY, engage_relay);
     digitalWrite(PIN_PUMP_FRONT_PANEL_LED, engage_relay);
+    relay_engaged = engage_relay;
+    interrupts();
     prev_state_relay = engage_relay;
   }
 
+  if (now - tick_report >= REPORT_INTERVAL) {
+    PulseStats snapshot;
+
+    tick_report = now;
+    noInterrupts();
+    snapshot.N = stats.N;
+    snapshot.min = stats.min;
+    snapshot.max = stats.max;
+    snapshot.sum = stats.sum;
+    stats.N = 0;
+    stats.min = UINT32_MAX;
+    stats.max = 0;
+    stats.sum = 0;
+    interrupts();
+
+    // Only when a host has the port open, so that we never block on USB
+    if (Serial) {
+      if (snapshot.N > 0) {
+        Serial.print(snapshot.min);
+        Serial.write('\t');
+        Serial.print(snapshot.max);
+        Serial.write('\t');
+        Serial.print((uint32_t)(snapshot.sum / snapshot.N));
+        Serial.write('\t');
+        Serial.print(snapshot.max - snapshot.min);
+      } else {
+        Serial.print("nan\tnan\tnan\tnan");
+      }
+      Serial.write('\t');
+      Serial.print(snapshot.N);
+      Serial.write('\t');
+      Serial.print(N_trips);
+      Serial.write('\t');
+      Serial.print(latest_health & 0b11);
+      Serial.write('\t');
+      Serial.print((latest_health >> 2) & 0b11);
+      Serial.write('\t');
+      Serial.println((latest_health >> 4) & 1);
+    }
+  }
+
   if (now - tick_watchdog > 1) { // Slowed down, because of overhead otherwise
     Watchdog.reset();
     tick_watchdog = now;
   }
+
+  // Sleep till the next interrupt, at the latest the 1 ms SysTick
+  __WFI();
 }
\ No newline at end of file
@@ -7,9 +7,13 @@ Manages low-level serial communication with the Jetting Grid Arduino
 __author__ = "Dennis van Gils"
 __authoremail__ = "vangils.dennis@gmail.com"
 __url__ = "https://github.com/Dennis-van-Gils/project-TWT-jetting-grid"
-__date__ = "14-04-2023"
+__date__ = "15-10-2026"
 __version__ = "1.0"
 
+import struct
+import threading
+import time
+import zlib
 from datetime import datetime
 
 import numpy as np
@@ -17,6 +21,8 @@ import numpy as np
 from dvg_debug_functions import dprint, print_fancy_traceback as pft
 from dvg_devices.Arduino_protocol_serial import Arduino
 
+from JettingGrid_profile import parse_profile
+
 
 # ------------------------------------------------------------------------------
 #   current_date_time_strings
@@ -31,6 +37,266 @@ def current_date_time_strings():
     )
 
 
+# ------------------------------------------------------------------------------
+#   Binary telemetry, see `Telemetry.h` of the firmware
+# ------------------------------------------------------------------------------
+
+# seq, position, time_us, 4 x EMA [1/16 bitval], 4 x pressure [mbar], FSM state,
+# 4 x number of open valves per manifold, number of open valves N lines ahead
+TELEMETRY_PACKET = struct.Struct("<HHI4H4hB4BB")
+
+# The same packet as numpy dtype, to decode many packets at once
+TELEMETRY_DTYPE = np.dtype(
+    [
+        ("seq", "<u2"),
+        ("pos", "<u2"),
+        ("time_us", "<u4"),
+        ("EMA", "<u2", 4),  # [1/16 bitval]
+        ("pres_mbar", "<i2", 4),
+        ("fsm_state", "u1"),
+        ("N_open", "u1", 4),
+        ("N_open_ahead", "u1"),
+    ]
+)
+assert TELEMETRY_DTYPE.itemsize == TELEMETRY_PACKET.size
+
+# Fields a telemetry subscription can select, in the order of the
+# `TelemetryField` bits of the firmware, which is also their order inside of a
+# record. See `subscribe_fields()`.
+TELEMETRY_FIELDS = (
+    ("time_us", "<u4"),  # [µs]
+    ("pos", "<u2"),
+    ("fsm_state", "u1"),
+    ("pres_mbar", "<i2", 4),
+    ("pres_avg_mbar", "<i2"),
+    ("EMA", "<u2", 4),  # [1/16 bitval]
+    ("raw", "<u2", 4),  # [bitval]
+    ("N_open", "u1", 4),
+    ("N_open_ahead", "u1"),
+    # Failed I2C port transactions, mismatching output latches, bus timeouts,
+    # bus clears and retried port writes
+    ("i2c", "<u4", 5),
+)
+TELEMETRY_FIELD_NAMES = tuple(field[0] for field in TELEMETRY_FIELDS)
+TELEMETRY_N_SUBS = 4
+
+# marker, subscription, seq, selected fields, followed by the fields, see
+# `TelemetryRecordHeader` of the firmware
+TELEMETRY_RECORD_HEADER = struct.Struct("<BBHH")
+TELEMETRY_RECORD_MARKER = 0xDE
+
+
+def telemetry_record_dtype(fields: int) -> np.dtype:
+    """Return the numpy dtype of a subscription record selecting the
+    `fields` bitmask, see `TELEMETRY_FIELDS`."""
+    return np.dtype(
+        [("marker", "u1"), ("sub", "u1"), ("seq", "<u2"), ("fields", "<u2")]
+        + [
+            field
+            for bit, field in enumerate(TELEMETRY_FIELDS)
+            if fields & (1 << bit)
+        ]
+    )
+
+
+# marker, stream, seq, time_us, dt_us, 8 x 4 x pressure [mbar], see
+# `DecimPacket` of the firmware
+DECIM_PACKET = struct.Struct("<BBHII32h")
+DECIM_MARKER = 0xDC
+DECIM_N_STREAMS = 2
+
+# marker, stream, seq, time_us, dt_us, 4 x key pressure [mbar], followed by the
+# zig-zag varint differences of the other samples, see `DecimBlockHeader` of
+# the firmware
+DECIM_Z_HEADER = struct.Struct("<BBHII4h")
+DECIM_Z_MARKER = 0xDD
+DECIM_Z_SAMPLES_PER_BLOCK = 32
+
+# Number of open valves N lines ahead, when not known yet
+N_OPEN_UNKNOWN = 0xFF
+TELEMETRY_FSM_STATES = (
+    "Off",
+    "Paused",
+    "Running",
+    "Uploading",
+    "Streaming",
+    "Generating",
+    "Armed",
+    "Live",
+    "PWM",
+)
+
+# Live valve frames, see `FSM: Live` of the firmware
+LIVE_MARKER = 0x3C
+LIVE_END_MARKER = 0x3E
+LIVE_BITSET_LEN = 14  # Bytes holding one bit per valve
+
+# line_no, planned_us, actual_us, i2c_done_us, see `ValveEvent` of the firmware
+VALVE_EVENT = struct.Struct("<HIII")
+
+# time_us, valve bitset, see `ValveSnapshot` of the firmware
+VALVE_SNAPSHOT = struct.Struct(f"<I{LIVE_BITSET_LEN}s")
+
+# time_ms, type, FSM state, line_no, 4 x pressure, see `FlashLogRecord` of the
+# firmware
+FLASH_LOG_RECORD = struct.Struct("<IBBH4h")
+
+# Names of the record types, in sync with `FlashLogType` of the firmware
+FLASH_LOG_TYPES = {1: "start", 2: "pressure", 3: "line"}
+
+# N_samples, 4 x mean pressure, see `PhaseCell` of the firmware
+PHASE_CELL = struct.Struct("<H4h")
+
+# time_us, 4 x R Click bitval, see `DAQ_Sample` of the firmware
+DAQ_SAMPLE = struct.Struct("<I4H")
+
+# time_us, event ID, flags, a, b, see `TraceRecord` of the firmware
+TRACE_RECORD = struct.Struct("<IBBHI")
+
+# Names of the event IDs, in sync with `TraceEventID` of the firmware
+TRACE_EVENTS = (
+    "line_activated",
+    "upload_line",
+    "upload_EOP",
+    "DAQ_late",
+    "CP_mismatch",
+    "loop_slow",
+    "program_corrupt",
+    "pressure_anomaly",
+    "I2C_write",
+    "LED_show",
+    "DAQ_tick",
+    "command",
+    "USB_TX",
+    "task",
+)
+
+# Kind of trace record by `TracePhase` of the firmware, as the phase letters of
+# the Chrome trace format: Single event, begin and end of a span
+TRACE_PHASES = ("i", "B", "E")
+
+# Encoded duration, see `decode_duration()` of `JettingGrid_upload.py`, 15 x PCS
+# row bitmask, see `proto_rows?` of the firmware
+DUMPED_ROWS = struct.Struct("<H15H")
+
+# Integer currents [µA] and pressures [mbar] take this value when the sensor is
+# in a fault state, see `PressureScale.h` of the firmware
+PRESSURE_FAULT = -32768
+
+# Highest protocol preset number, see `protocol_presets.h` of the firmware
+IDX_PRESET_MAX = 7
+
+# Number of infeasible line ranges listed by `feas?`, see `Feasibility` of the
+# firmware
+FEASIBILITY_MAX_RANGES = 16
+
+
+def from_milli(value: int) -> float:
+    """Convert an integer current [µA] or pressure [mbar] as reported by the
+    firmware into [mA] or [bar], or NaN when the sensor is in a fault state."""
+    return np.nan if value == PRESSURE_FAULT else value / 1000
+
+
+def decode_decim_block(block: bytes):
+    """Decode a compressed block of a decimated pressure stream, see
+    `Decimator.h` of the firmware.
+    Returns: (stream, seq, time_us, dt_us, samples) with `samples` a list of
+    `DECIM_Z_SAMPLES_PER_BLOCK` tuples of the 4 pressures [mbar].
+    Raises: ValueError when the block is corrupt.
+    """
+    _marker, stream, seq, time_us, dt_us, *key = DECIM_Z_HEADER.unpack_from(
+        block
+    )
+    samples = [tuple(key)]
+    prev = key
+    diffs = []
+    value = shift = 0
+    for byte in block[DECIM_Z_HEADER.size :]:
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            diffs.append((value >> 1) ^ -(value & 1))  # Undo zig-zag
+            value = shift = 0
+            if len(diffs) == len(prev):
+                prev = [p + d for p, d in zip(prev, diffs)]
+                samples.append(tuple(prev))
+                diffs = []
+
+    if shift or diffs or len(samples) != DECIM_Z_SAMPLES_PER_BLOCK:
+        raise ValueError("Corrupt compressed block of a decimated stream")
+    return stream, seq, time_us, dt_us, samples
+
+
+def cobs_decode(data: bytes) -> bytes:
+    """Decode a single COBS-encoded frame, without its 0x00 delimiters."""
+    out = bytearray()
+    idx = 0
+    while idx < len(data):
+        code = data[idx]
+        if code == 0:
+            raise ValueError("Unexpected zero byte inside COBS frame")
+        out += data[idx + 1 : idx + code]
+        idx += code
+        if code < 0xFF and idx < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+# ------------------------------------------------------------------------------
+#   ClockSync
+# ------------------------------------------------------------------------------
+
+
+class ClockSync:
+    """Estimate the offset and drift of the `micros()` time track of the
+    Arduino relative to the host clock `time.time()`, from NTP-style ping round
+    trips, see `JettingGrid_Arduino.sync_clock()`. Each round trip yields a
+    sample pairing the Arduino time of receipt with the midpoint of the host
+    send and receive times. A straight line fitted through the recent samples
+    maps any Arduino timestamp onto the host clock.
+    """
+
+    WRAP = 1 << 32  # `micros()` wraps around every ~71.6 minutes
+
+    def __init__(self, max_samples: int = 32):
+        self.max_samples = max_samples
+        self.samples = []  # (Arduino time [µs], unwrapped; host time [s])
+        self.rtt_s = np.nan  # Round-trip time of the last sample [s]
+        self.offset_s = np.nan  # Host time at Arduino time 0 [s]
+        self.drift = 0.0  # Relative rate error of the Arduino clock
+
+    def unwrap(self, time_us: int) -> int:
+        """Unwrap a `micros()` timestamp, taking the wrap-around that brings it
+        closest to the last sample, i.e. within ~35 minutes."""
+        if not self.samples:
+            return time_us
+        ref_us = self.samples[-1][0]
+        return time_us + round((ref_us - time_us) / self.WRAP) * self.WRAP
+
+    def add_sample(self, t_send: float, time_us: int, t_recv: float):
+        """Add a round trip: Host send time [s], Arduino time of receipt [µs]
+        and host receive time [s]."""
+        self.samples.append((self.unwrap(time_us), (t_send + t_recv) / 2))
+        del self.samples[: -self.max_samples]
+        self.rtt_s = t_recv - t_send
+
+        t_mcu = np.array([x[0] for x in self.samples]) * 1e-6
+        t_host = np.array([x[1] for x in self.samples])
+        if len(self.samples) > 1 and np.ptp(t_mcu) > 0:
+            slope, self.offset_s = np.polyfit(t_mcu, t_host, 1)
+            self.drift = slope - 1
+        else:
+            self.offset_s = t_host[-1] - t_mcu[-1]
+            self.drift = 0.0
+
+    def to_host(self, time_us: int) -> float:
+        """Map an Arduino `micros()` timestamp onto the host clock [s], or NaN
+        when not yet synchronized."""
+        if not self.samples:
+            return np.nan
+        return self.offset_s + self.unwrap(time_us) * 1e-6 * (1 + self.drift)
+
+
 # ------------------------------------------------------------------------------
 #   JettingGrid_Arduino
 # ------------------------------------------------------------------------------
@@ -53,6 +319,10 @@ class JettingGrid_Arduino(Arduino):
             self.P_2_bar = np.nan  # [bar]
             self.P_3_bar = np.nan  # [bar]
             self.P_4_bar = np.nan  # [bar]
+            self.time_us = np.nan  # [µs], Arduino time, only via telemetry
+            self.fsm_state = ""
+            self.N_open = [0, 0, 0, 0]  # Open valves per manifold, telemetry
+            self.N_open_ahead = np.nan  # Open valves N lines ahead, telemetry
 
     # --------------------------------------------------------------------------
     #   JettingGrid_Arduino
@@ -68,6 +338,57 @@ class JettingGrid_Arduino(Arduino):
         # Container for the process and measurement variables
         self.state = self.State()
 
+        # Binary telemetry, see `subscribe_telemetry()`
+        self.telemetry_period_ms = 0  # 0 when not subscribed
+        # Packets received by the last DAQ, see `TELEMETRY_DTYPE`
+        self.telemetry_samples = np.zeros(0, dtype=TELEMETRY_DTYPE)
+        # Per packet, the number of packets missed right before it
+        self.telemetry_gaps = np.zeros(0, dtype=np.uint16)
+        self.telemetry_N_dropped = 0  # Packets missed, following from `seq`
+        self._telemetry_last_seq = None
+        self._telemetry_frames = []  # Packets not yet decoded
+
+        # Field-selectable subscriptions, see `subscribe_fields()`. Per
+        # subscription number a dict holding its `fields` bitmask, `dtype`,
+        # `period_ms`, records not yet decoded and last sequence number.
+        self.subscriptions = {}
+        # Per subscription number, the records received by the last DAQ
+        self.subscription_samples = {}
+        self.subscription_N_dropped = 0  # Records missed, following `seq`
+
+        # Decimated pressure streams, see `subscribe_decimated()`. Per stream
+        # a list of (time_us, (P_1, P_2, P_3, P_4)) tuples [mbar], to be
+        # emptied by the user.
+        self.decimated_samples = [[] for _ in range(DECIM_N_STREAMS)]
+        self._decim_last_seq = [None] * DECIM_N_STREAMS
+        self.decim_N_dropped = 0  # Packets or blocks missed, following `seq`
+
+        self._rx_buf = bytearray()  # Received bytes not yet demultiplexed
+        self._rx_buf_bulk = bytearray()  # Idem, via the vendor interface
+        self._rx_lines = []  # Demultiplexed ASCII reply lines
+        self._rx_frames = []  # Demultiplexed binary replies other than telemetry
+
+        # Mapping of the Arduino timestamps onto the host clock
+        self.clock_sync = ClockSync()
+        self._ping_token = 0
+
+        # Sequence number of the last live valve frame, see `send_live_frame()`
+        self._live_seq = 0
+
+        # USB vendor interface carrying the bulk data, see `attach_bulk()`
+        self.bulk = None
+
+        # Reader thread demultiplexing the received bytes in the background,
+        # see `start_reader()`. The condition guards all receive queues.
+        self._rx_cond = threading.Condition()
+        self._reader = None
+        self._reader_stop = threading.Event()
+        self._request_id = 0
+        self._requests = []  # IDs of the requests awaiting a reply, in order
+        self._reply_lines = []  # Reply lines of the oldest awaiting request
+        self._replies = {}  # Request ID to its list of reply lines
+        self._abandoned = set()  # IDs of the requests that timed out
+
     # --------------------------------------------------------------------------
     #   perform_DAQ
     # --------------------------------------------------------------------------
@@ -75,8 +396,11 @@ class JettingGrid_Arduino(Arduino):
     def perform_DAQ(self) -> bool:
         """Returns True when successful, False otherwise."""
 
-        # Query the Arduino for its state
-        success, reply = self.query_ascii_values("?", delimiter="\t")
+        if self.telemetry_period_ms or self.subscriptions:
+            return self._perform_DAQ_telemetry()
+
+        # Query the Arduino for its readings and FSM state in one go
+        success, replies = self.query_batch(["?", "fsm?"])
         if not success:
             str_cur_date, str_cur_time = current_date_time_strings()
             dprint(
@@ -84,8 +408,11 @@ class JettingGrid_Arduino(Arduino):
             )
             return False
 
-        # Parse readings into separate state variables
+        # Parse readings into separate state variables. The Arduino reports
+        # the currents in [µA] and the pressures in [mbar].
         try:
+            reply = replies[0][0].split("\t")
+            self.state.fsm_state = replies[1][0]
             # pylint: disable=unbalanced-tuple-unpacking
             (
                 self.state.protocol_pos,
@@ -97,7 +424,7 @@ class JettingGrid_Arduino(Arduino):
                 self.state.P_2_bar,
                 self.state.P_3_bar,
                 self.state.P_4_bar,
-            ) = reply
+            ) = [int(reply[0])] + [from_milli(int(x)) for x in reply[1:]]
             # pylint: enable=unbalanced-tuple-unpacking
         except Exception as err:
             str_cur_date, str_cur_time = current_date_time_strings()
@@ -109,6 +436,1263 @@ class JettingGrid_Arduino(Arduino):
 
         return True
 
+    # --------------------------------------------------------------------------
+    #   Binary telemetry
+    # --------------------------------------------------------------------------
+
+    def subscribe_telemetry(self, period_ms: int = 10) -> bool:
+        """Have the Arduino push binary telemetry packets every `period_ms`,
+        instead of having `perform_DAQ()` poll for the readings. All packets
+        received by the last call to `perform_DAQ()` are available as numpy
+        array in member `telemetry_samples`, see `TELEMETRY_DTYPE`, and their
+        sequence gaps in `telemetry_gaps`. Unsubscribe before uploading or
+        streaming a protocol.
+        Returns: True if successful, False otherwise.
+        """
+        success, reply = self.query(f"subscribe {int(period_ms):d}")
+        if not success:
+            return False
+
+        try:
+            self.telemetry_period_ms = int(reply)
+        except (TypeError, ValueError) as err:
+            pft(err)
+            return False
+
+        self._telemetry_last_seq = None
+        self._telemetry_frames = []
+        self.telemetry_N_dropped = 0
+        return True
+
+    def subscribe_fields(
+        self, sub: int, fields: list, period_ms: int = 100
+    ) -> bool:
+        """Have the Arduino push records holding only the `fields`, see
+        `TELEMETRY_FIELD_NAMES`, every `period_ms` on subscription `sub` 0 to
+        3, concurrently with the other subscriptions and the packets of
+        `subscribe_telemetry()`. E.g. a GUI taking `pos` and `pres_avg_mbar` at
+        10 Hz, next to a data logger taking `time_us` and `raw` at 1 kHz. The
+        records received by the last call to `perform_DAQ()` are available as
+        numpy array in member `subscription_samples[sub]`. Pass no fields to
+        stop the subscription.
+        Returns: True if successful, False otherwise.
+        """
+        mask = 0
+        for name in fields:
+            mask |= 1 << TELEMETRY_FIELD_NAMES.index(name)
+        if not mask:
+            period_ms = 0
+
+        success, reply = self.query(
+            f"tsub {int(sub):d} {mask:d} {int(period_ms):d}"
+        )
+        if not success:
+            return False
+
+        try:
+            _sub, mask, period_ms = [int(x) for x in reply.split("\t")]
+        except (AttributeError, ValueError) as err:
+            pft(reply)
+            pft(err)
+            return False
+
+        with self._rx_cond:
+            self.subscription_samples.pop(sub, None)
+            if not period_ms:
+                self.subscriptions.pop(sub, None)
+                return True
+
+            self.subscriptions[sub] = dict(
+                fields=mask,
+                dtype=telemetry_record_dtype(mask),
+                period_ms=period_ms,
+                frames=[],
+                last_seq=None,
+            )
+        return True
+
+    def unsubscribe_telemetry(self) -> bool:
+        """Stop the binary telemetry, including all subscriptions, and
+        return to polling.
+        Returns: True if successful, False otherwise.
+        """
+        success, _reply = self.query("unsubscribe")
+        with self._rx_cond:
+            self.telemetry_period_ms = 0
+            self.subscriptions = {}
+            self.subscription_samples = {}
+            self._rx_buf.clear()
+            self._rx_buf_bulk.clear()
+            self._rx_lines.clear()
+            self._rx_frames.clear()
+            self._telemetry_frames = []
+        return success
+
+    def subscribe_decimated(
+        self, stream: int, period_us: int, compressed: bool = False
+    ) -> int:
+        """Have the Arduino push the pressures, decimated alias-free to an
+        interval of `period_us`, on `stream` 0 or 1, or stop that stream when
+        0. Both streams can run concurrently at different intervals. The
+        period gets rounded to an even multiple of the oversampling interval
+        of the Arduino. When `compressed`, the samples get pushed as
+        delta/varint compressed blocks, taking 2 to 4 times less bandwidth. The
+        samples get collected by `perform_DAQ()` into member
+        `decimated_samples`, hence require being subscribed to the telemetry.
+        `unsubscribe_telemetry()` stops the streams too.
+        Returns: The obtained period [µs], or None when failed.
+        """
+        success, reply = self.query(
+            f"decim {int(stream):d} {int(period_us):d} {int(compressed):d}"
+        )
+        if not success:
+            return None
+
+        try:
+            period_us = int(reply)
+        except (TypeError, ValueError):
+            pft(reply)
+            return None
+
+        self._decim_last_seq[stream] = None
+        return period_us
+
+    def set_lookahead(self, N_lines: int) -> bool:
+        """Have the telemetry report the open-valve count of the line
+        `N_lines` ahead of the playback position, as `state.N_open_ahead`, for
+        feed-forward control of the pump. Pass 0 for the current line.
+        Returns: True if successful, False otherwise.
+        """
+        success, reply = self.query(f"lookahead {int(N_lines):d}")
+        return success and reply == f"{int(N_lines):d}"
+
+    def read_valve_events(self) -> list:
+        """Drain the log of measured line switch timings from the Arduino. Works
+        both with and without being subscribed to the telemetry.
+        Returns: List of (line_no, planned_us, actual_us, i2c_done_us) tuples
+        on the `micros()` time track of the Arduino, or None when failed.
+        """
+        events = []
+        while True:
+            if not self.write("events"):
+                return None
+            if not self._await_rx(lambda: self._rx_lines and self._rx_frames):
+                return None
+
+            N = int(self._rx_lines.pop(0))
+            frame = self._rx_frames.pop(0)
+            if len(frame) != N * VALVE_EVENT.size:
+                pft("Valve-event dump has an incorrect length")
+                return None
+            if N == 0:
+                return events
+            events.extend(VALVE_EVENT.iter_unpack(frame))
+
+    def read_trace(self, max_dumps: int = 0) -> list:
+        """Drain the trace from the Arduino, see `trace_on`. Works both with and
+        without being subscribed to the telemetry. While tracing, the dumps
+        get traced themselves, hence bound their number by `max_dumps`, 0
+        being unbounded.
+        Returns: List of (time_us, event name, in_isr, a, b, phase) tuples on
+        the `micros()` time track of the Arduino, with `phase` one of
+        `TRACE_PHASES`, or None when failed. See `JettingGrid_trace.py`.
+        """
+        records = []
+        N_dumps = 0
+        while not max_dumps or N_dumps < max_dumps:
+            N_dumps += 1
+            if not self.write("trace"):
+                return None
+            if not self._await_rx(lambda: self._rx_lines and self._rx_frames):
+                return None
+
+            N = int(self._rx_lines.pop(0))
+            frame = self._rx_frames.pop(0)
+            if len(frame) != N * TRACE_RECORD.size:
+                pft("Trace dump has an incorrect length")
+                return None
+            if N == 0:
+                return records
+            for time_us, ID, flags, a, b in TRACE_RECORD.iter_unpack(frame):
+                name = TRACE_EVENTS[ID] if ID < len(TRACE_EVENTS) else str(ID)
+                phase = TRACE_PHASES[(flags >> 1) & 0b11]
+                records.append((time_us, name, bool(flags & 1), a, b, phase))
+        return records
+
+    def read_flash_log(self) -> list:
+        """Download the standalone log from the flash of the Arduino, oldest
+        record first, see `flog` of the firmware. Takes a few seconds when the
+        log is full. Works both with and without being subscribed to the
+        telemetry.
+        Returns: List of (time_ms, type name, fsm_state, line_no, pres_mbar)
+        tuples, with `pres_mbar` a tuple of the 4 manifold pressures, or None
+        when failed.
+        """
+        if not self.write("flog_rewind"):
+            return None
+
+        records = []
+        while True:
+            if not self.write("flog_read"):
+                return None
+            if not self._await_rx(lambda: self._rx_lines and self._rx_frames):
+                return None
+
+            N = int(self._rx_lines.pop(0))
+            frame = self._rx_frames.pop(0)
+            if len(frame) != N * FLASH_LOG_RECORD.size:
+                pft("Flash log dump has an incorrect length")
+                return None
+            if N == 0:
+                return records
+            for rec in FLASH_LOG_RECORD.iter_unpack(frame):
+                time_ms, type_ID, fsm_state, line_no = rec[:4]
+                name = FLASH_LOG_TYPES.get(type_ID, str(type_ID))
+                records.append((time_ms, name, fsm_state, line_no, rec[4:]))
+
+    def read_anomaly(self) -> list:
+        """Drain the frozen anomaly capture from the Arduino, see
+        `anomaly_arm` and `anomaly?` of the firmware for its trigger. Works
+        both with and without being subscribed to the telemetry.
+        Returns: List of (time_us, bitvals) tuples on the `micros()` time track
+        of the Arduino, with `bitvals` a tuple of the 4 raw R Click readings,
+        empty when not frozen, or None when failed.
+        """
+        samples = []
+        while True:
+            if not self.write("anomaly_dump"):
+                return None
+            if not self._await_rx(lambda: self._rx_lines and self._rx_frames):
+                return None
+
+            N = int(self._rx_lines.pop(0))
+            frame = self._rx_frames.pop(0)
+            if len(frame) != N * DAQ_SAMPLE.size:
+                pft("Anomaly capture dump has an incorrect length")
+                return None
+            if N == 0:
+                return samples
+            for rec in DAQ_SAMPLE.iter_unpack(frame):
+                samples.append((rec[0], rec[1:]))
+
+    def read_phase_average(self):
+        """Download the phase-locked average of the manifold pressures over
+        the repetitions of a block of protocol lines, see `phase` of the
+        firmware for setting up its grid. Works both with and without being
+        subscribed to the telemetry.
+        Returns: (first_line, bin_us, grid) with `grid[line][bin]` a tuple
+        (N_samples, mean_mbar), `line` counting from `first_line` and
+        `mean_mbar` a tuple of the 4 mean manifold pressures, or None when
+        failed.
+        """
+        success, reply = self.query("phase?")
+        if not success:
+            return None
+        try:
+            fields = reply.split("\t")
+            first_line, N_lines, N_bins, bin_us = map(int, fields[1:5])
+        except (AttributeError, IndexError, ValueError):
+            pft("Unexpected reply to `phase?`")
+            return None
+
+        if not self.write("phase_rewind"):
+            return None
+        cells = []
+        while True:
+            if not self.write("phase_read"):
+                return None
+            if not self._await_rx(lambda: self._rx_lines and self._rx_frames):
+                return None
+
+            N = int(self._rx_lines.pop(0))
+            frame = self._rx_frames.pop(0)
+            if len(frame) != N * PHASE_CELL.size:
+                pft("Phase-average dump has an incorrect length")
+                return None
+            if N == 0:
+                break
+            for rec in PHASE_CELL.iter_unpack(frame):
+                cells.append((rec[0], rec[1:]))
+
+        if len(cells) != N_lines * N_bins:
+            pft("Phase-average grid changed while downloading")
+            return None
+        grid = [
+            cells[idx * N_bins : (idx + 1) * N_bins] for idx in range(N_lines)
+        ]
+        return first_line, bin_us, grid
+
+    def read_valve_snapshot(self):
+        """Read the valves as currently applied by the Arduino, i.e. the
+        ground truth regardless of the playback mode, see `valves?` of the
+        firmware. Cheap enough to be polled at 50 Hz. Works both with and
+        without being subscribed to the telemetry.
+        Returns: (time_us, open_valves) with `open_valves` a list of the open
+        valve numbers, or None when failed.
+        """
+        if not self.write("valves?"):
+            return None
+        if not self._await_rx(lambda: self._rx_frames):
+            return None
+
+        frame = self._rx_frames.pop(0)
+        if len(frame) != VALVE_SNAPSHOT.size:
+            pft("Valve snapshot has an incorrect length")
+            return None
+        time_us, bitset = VALVE_SNAPSHOT.unpack(frame)
+        open_valves = [
+            idx + 1
+            for idx in range(len(bitset) * 8)
+            if bitset[idx // 8] & (1 << (idx % 8))
+        ]
+        return time_us, open_valves
+
+    def read_protocol_rows(self):
+        """Dump the protocol program in the memory of the Arduino as PCS row
+        bitmasks. Works both with and without being subscribed to the
+        telemetry.
+        Returns: (name, lines) with `lines` a list of (duration, rows) tuples,
+        `duration` being encoded, see `JettingGrid_upload.decode_duration()`,
+        and `rows` holding the 15 PCS row bitmasks, or None when failed.
+        """
+        if not self.write("proto_rows?"):
+            return None
+        if not self._await_rx(lambda: self._rx_lines):
+            return None
+
+        try:
+            name, N_lines = self._rx_lines.pop(0).split("\t")
+        except ValueError:
+            pft("Unexpected reply to `proto_rows?`")
+            return None
+
+        lines = []
+        while True:
+            if not self._await_rx(lambda: self._rx_frames):
+                return None
+            frame = self._rx_frames.pop(0)
+            if not frame:
+                break
+            if len(frame) % DUMPED_ROWS.size:
+                pft("Protocol dump has an incorrect length")
+                return None
+            lines.extend((x[0], x[1:]) for x in DUMPED_ROWS.iter_unpack(frame))
+
+        if len(lines) != int(N_lines):
+            pft("Protocol dump got cut short")
+            return None
+        return name, lines
+
+    def read_protocol_masks(self, first: int = 0, last: int = 0xFFFF):
+        """Read back lines `first` up to but excluding `last` of the protocol
+        program in the memory of the Arduino, as compiled into Centipede port
+        bitmasks, see `proto_masks?` of the firmware. Each frame and the whole
+        readback get verified against their CRC32. Works both with and without
+        being subscribed to the telemetry.
+        Returns: (first, lines) with `lines` a list of (duration, masks)
+        tuples, `duration` being encoded, see
+        `JettingGrid_upload.decode_duration()`, and `masks` holding the
+        Centipede port bitmasks, or None when failed.
+        """
+        if not self.write(f"proto_masks? {first} {last}"):
+            return None
+        if not self._await_rx(lambda: self._rx_lines):
+            return None
+
+        try:
+            first, N_lines, N_ports = map(
+                int, self._rx_lines.pop(0).split("\t")
+            )
+        except ValueError:
+            pft("Unexpected reply to `proto_masks?`")
+            return None
+
+        dumped = struct.Struct(f"<H{N_ports}H")
+        lines = []
+        crc = 0
+        while True:
+            if not self._await_rx(lambda: self._rx_frames):
+                return None
+            frame = self._rx_frames.pop(0)
+            if len(frame) < 4:
+                pft("Protocol readback has an incorrect length")
+                return None
+            body, (frame_crc,) = frame[:-4], struct.unpack("<I", frame[-4:])
+            if not body:
+                if frame_crc != crc:
+                    pft("Protocol readback failed its checksum")
+                    return None
+                break
+            if len(body) % dumped.size or zlib.crc32(body) != frame_crc:
+                pft("Protocol readback has a corrupt frame")
+                return None
+            crc = zlib.crc32(body, crc)
+            lines.extend((x[0], x[1:]) for x in dumped.iter_unpack(body))
+
+        if len(lines) != N_lines:
+            pft("Protocol readback got cut short")
+            return None
+        return first, lines
+
+    def read_protocol_hashes(self, block_len: int = 32):
+        """Read the CRC32 hashes of the protocol program in the memory of the
+        Arduino, one per block of `block_len` lines, see `proto_hash` of the
+        firmware. Works both with and without being subscribed to the
+        telemetry.
+        Returns: (N_lines, patchable, hashes) with `patchable` telling whether
+        the Arduino accepts a patch upload, or None when failed.
+        """
+        if not self.write(f"proto_hash {block_len}"):
+            return None
+        if not self._await_rx(lambda: self._rx_lines):
+            return None
+
+        try:
+            N_lines, _, patchable = map(int, self._rx_lines.pop(0).split("\t"))
+        except ValueError:
+            pft("Unexpected reply to `proto_hash`")
+            return None
+
+        hashes = []
+        while True:
+            if not self._await_rx(lambda: self._rx_lines):
+                return None
+            line = self._rx_lines.pop(0)
+            if not line:
+                break
+            hashes.append(int(line, 16))
+
+        if len(hashes) != (N_lines + block_len - 1) // block_len:
+            pft("Protocol hashes got cut short")
+            return None
+        return N_lines, bool(patchable), hashes
+
+    def read_protocol_crc(self):
+        """Read the CRC32 checksum of the protocol program in the memory of
+        the Arduino, kept up to date by its background scrubbing, see
+        `proto_crc?` of the firmware. It matches `zlib.crc32()` over all lines
+        as sent in a bulk upload, i.e. in the format of `DUMPED_ROWS`.
+        Returns: (crc, N_lines, known, N_passes, N_mismatches) with `known`
+        telling whether the first scrub pass has completed for a program
+        loaded as a whole, or None when failed.
+        """
+        if not self.write("proto_crc?"):
+            return None
+        if not self._await_rx(lambda: self._rx_lines):
+            return None
+
+        try:
+            fields = self._rx_lines.pop(0).split("\t")
+            crc = int(fields[0], 16)
+            N_lines, known, N_passes, N_mismatches = map(int, fields[1:])
+        except ValueError:
+            pft("Unexpected reply to `proto_crc?`")
+            return None
+        return crc, N_lines, bool(known), N_passes, N_mismatches
+
+    def read_valve_stats(self):
+        """Read the switch count and the total open time of each valve, as
+        counted by the Arduino from the outputs it actually sent since boot or
+        the last `valve_stats_reset`. Works both with and without being
+        subscribed to the telemetry.
+        Returns: (elapsed_ms, stats) with `stats` a dict of valve number to
+        (N_switches, open_ms) tuples, or None when failed.
+        """
+        if not self.write("valve_stats?"):
+            return None
+        if not self._await_rx(lambda: self._rx_lines):
+            return None
+
+        try:
+            N_valves, elapsed_ms = map(int, self._rx_lines.pop(0).split("\t"))
+        except ValueError:
+            pft("Unexpected reply to `valve_stats?`")
+            return None
+
+        stats = {}
+        for _ in range(N_valves):
+            if not self._await_rx(lambda: self._rx_lines):
+                return None
+            valve, N_switches, open_ms = map(
+                int, self._rx_lines.pop(0).split("\t")
+            )
+            stats[valve] = (N_switches, open_ms)
+        return elapsed_ms, stats
+
+    def read_pump_terms(self):
+        """Read the terms of the pressure controller on the Arduino of its
+        last polling period, see `pump_pid` of the firmware. Works both with
+        and without being subscribed to the telemetry.
+        Returns: Dict of the terms, or None when failed. Pressures in [mbar],
+        frequencies in [Hz].
+        """
+        success, reply = self.query("pump_terms?")
+        if not success:
+            return None
+
+        try:
+            fields = reply.split("\t")
+            terms = dict(
+                pressure=int(fields[0]),
+                error=int(fields[1]),
+                N_open=int(fields[2]),
+                FF=float(fields[3]),
+                P=float(fields[4]),
+                I=float(fields[5]),
+                D=float(fields[6]),
+                f_Hz=float(fields[7]),
+                limited=int(fields[8]),
+            )
+        except (AttributeError, IndexError, ValueError):
+            pft("Unexpected reply to `pump_terms?`")
+            return None
+        return terms
+
+    def read_protocol_header(self):
+        """Read the [HEADER] section of the protocol file as stored alongside
+        the protocol program loaded into the Arduino, see `hdr?` of the
+        firmware and `send_protocol_header()` of `JettingGrid_upload`. Works
+        both with and without being subscribed to the telemetry.
+        Returns: The header as str, empty when none was stored, or None when
+        failed.
+        """
+        if not self.write("hdr?"):
+            return None
+        if not self._await_rx(lambda: self._rx_lines and self._rx_frames):
+            return None
+
+        N = int(self._rx_lines.pop(0))
+        frame = self._rx_frames.pop(0)
+        if len(frame) != N:
+            pft("Protocol header has an incorrect length")
+            return None
+        if N == 0:
+            return ""
+
+        try:
+            return zlib.decompress(frame).decode("utf8")
+        except (zlib.error, UnicodeDecodeError):
+            pft("Protocol header is corrupt")
+            return None
+
+    def read_program_info(self):
+        """Read the statistics of the protocol program loaded into the
+        Arduino, precomputed while uploading, see `pinfo?` of the firmware.
+        Works both with and without being subscribed to the telemetry.
+        Returns: Dict of the statistics, or None when failed. Open fractions
+        run from 0 to 1, `open_manifold` holds the mean number of open valves
+        per manifold and `hist` the number of lines with a duration of
+        [2^b, 2^(b + 1)) ms per bin b.
+        """
+        success, reply = self.query("pinfo?")
+        if not success:
+            return None
+
+        try:
+            fields = reply.split("\t")
+            info = dict(
+                name=fields[0],
+                N_lines=int(fields[1]),
+                duration_ms=int(fields[2]),
+                crc=int(fields[3], 16),
+                crc_known=bool(int(fields[4])),
+                open_mean=float(fields[5]),
+                open_mean_time=float(fields[6]),
+                open_min=float(fields[7]),
+                open_max=float(fields[8]),
+                open_manifold=[float(x) for x in fields[9:13]],
+                hist=[int(x) for x in fields[13:]],
+            )
+        except (AttributeError, IndexError, ValueError):
+            pft("Unexpected reply to `pinfo?`")
+            return None
+        return info
+
+    def read_feasibility(self):
+        """Read the predicted timing of the protocol program loaded into the
+        Arduino, evaluated while uploading against the cost of playing each
+        line, see `feas?` of the firmware. Works both with and without being
+        subscribed to the telemetry.
+        Returns: Dict with the cost model `i2c_base_us`, `i2c_port_us` and
+        `led_us`, the number of lines `N_lines` and of infeasible lines
+        `N_infeasible`, the minimum achievable line duration `min_us` set by
+        line `worst_line`, and `ranges`: A list of the (first, last) line
+        numbers of the infeasible ranges, of which there are `N_ranges` in
+        total. Or None when failed.
+        """
+        if not self.write("feas?"):
+            return None
+        if not self._await_rx(lambda: self._rx_lines):
+            return None
+
+        try:
+            fields = [int(x) for x in self._rx_lines.pop(0).split("\t")]
+            report = dict(
+                i2c_base_us=fields[0],
+                i2c_port_us=fields[1],
+                led_us=fields[2],
+                N_lines=fields[3],
+                N_infeasible=fields[4],
+                N_ranges=fields[5],
+                min_us=fields[6],
+                worst_line=fields[7],
+                ranges=[],
+            )
+        except (IndexError, ValueError):
+            pft("Unexpected reply to `feas?`")
+            return None
+
+        for _ in range(min(report["N_ranges"], FEASIBILITY_MAX_RANGES)):
+            if not self._await_rx(lambda: self._rx_lines):
+                return None
+            try:
+                first, last = self._rx_lines.pop(0).split("\t")
+                report["ranges"].append((int(first), int(last)))
+            except ValueError:
+                pft("Unexpected reply to `feas?`")
+                return None
+        return report
+
+    def start_profiler(self, period_us: int = 97, lo: int = 0, hi: int = 0):
+        """Start the sampling profiler of the Arduino into a cleared
+        histogram, sampling every `period_us` the code within the addresses
+        [lo, hi), by default the whole firmware image. A period of 0 stops it.
+        See `prof` of the firmware.
+        """
+        return self.write(f"prof {period_us} {lo:#x} {hi:#x}")
+
+    def read_profile(self):
+        """Read the histogram of the sampling profiler of the Arduino, see
+        `prof?` of the firmware. Symbolize it with
+        `JettingGrid_profile.symbolize()`. Works both with and without being
+        subscribed to the telemetry.
+        Returns: Dict, see `JettingGrid_profile.parse_profile()`, or None
+        when failed.
+        """
+        if not self.write("prof?"):
+            return None
+        if not self._await_rx(lambda: self._rx_lines):
+            return None
+
+        lines = [self._rx_lines.pop(0)]
+        try:
+            N_bins = int(lines[0].split("\t")[7])
+        except (IndexError, ValueError):
+            pft("Unexpected reply to `prof?`")
+            return None
+
+        for _ in range(N_bins):
+            if not self._await_rx(lambda: self._rx_lines):
+                return None
+            lines.append(self._rx_lines.pop(0))
+
+        try:
+            return parse_profile(lines)
+        except (IndexError, ValueError):
+            pft("Unexpected reply to `prof?`")
+            return None
+
+    def _await_rx(self, condition) -> bool:
+        """Demultiplex the received bytes until `condition()` holds or the
+        serial time-out expires.
+        Returns: True if the condition holds, False otherwise.
+        """
+        if self.reader_running:
+            with self._rx_cond:
+                return self._rx_cond.wait_for(condition, self.ser.timeout)
+
+        t_timeout = time.perf_counter() + self.ser.timeout
+        while not condition():
+            if time.perf_counter() > t_timeout:
+                return False
+            self._demultiplex(
+                self.ser.read(max(self.ser.in_waiting, 1)), self._rx_buf
+            )
+            self._read_bulk()
+        return True
+
+    def query(self, msg, *args, **kwargs):
+        """Send a message and return the single-line reply. While subscribed to
+        the telemetry, the reply gets picked out from in between the telemetry
+        packets.
+        Returns: (success, reply)
+        """
+        if self.reader_running:
+            lines = self.request(msg)
+            if lines is None:
+                return False, None
+            return True, (lines[0] if lines else None)
+
+        if not self.telemetry_period_ms:
+            return super().query(msg, *args, **kwargs)
+
+        if not self.write(msg) or not self._await_rx(lambda: self._rx_lines):
+            return False, None
+        return True, self._rx_lines.pop(0)
+
+    def readline(self, *args, **kwargs):
+        """Read a single reply line, e.g. of an upload. While the reader
+        thread runs, it gets taken from the demultiplexed reply lines.
+        Returns: (success, reply)
+        """
+        if not self.reader_running:
+            return super().readline(*args, **kwargs)
+
+        if not self._await_rx(lambda: self._rx_lines):
+            return False, None
+        return True, self._rx_lines.pop(0)
+
+    def query_batch(self, cmds: list):
+        """Send several commands at once and gather all of their replies,
+        costing a single round trip. The commands must not contain ';' and
+        together must fit the command buffer of the Arduino, see `batch` of
+        the firmware.
+        Returns: (success, replies) with `replies` holding the list of reply
+        lines of each command.
+        """
+        if not self.write("batch " + ";".join(cmds)):
+            return False, None
+
+        replies = []
+        lines = []
+        while len(replies) < len(cmds):
+            if not self._await_rx(lambda: self._rx_lines):
+                return False, None
+            line = self._rx_lines.pop(0)
+            if line == ";":
+                replies.append(lines)
+                lines = []
+            else:
+                lines.append(line)
+
+        return True, replies
+
+    def _demultiplex(self, data: bytes, rx_buf: bytearray):
+        """Split the received bytes, appended to the bytes of the same port
+        not yet demultiplexed in `rx_buf`, into telemetry packets, which get
+        queued to be decoded in bulk by `_decode_telemetry()`, other binary
+        replies and ASCII reply lines."""
+        rx_buf += data
+        while rx_buf:
+            if rx_buf[0] == 0:
+                # Telemetry frame, delimited by 0x00 on both sides
+                idx_end = rx_buf.find(b"\x00", 1)
+                if idx_end < 0:
+                    return  # Incomplete
+                frame = bytes(rx_buf[1:idx_end])
+                del rx_buf[: idx_end + 1]
+                try:
+                    frame = cobs_decode(frame)
+                except ValueError as err:
+                    pft(err)
+                    continue
+
+                if (len(frame) == DECIM_PACKET.size) and (
+                    frame[0] == DECIM_MARKER
+                ):
+                    self._add_decimated(DECIM_PACKET.unpack(frame))
+                    continue
+
+                if (len(frame) > DECIM_PACKET.size) and (
+                    frame[0] == DECIM_Z_MARKER
+                ):
+                    try:
+                        stream, seq, time_us, dt_us, samples = (
+                            decode_decim_block(frame)
+                        )
+                    except (ValueError, struct.error) as err:
+                        pft(err)
+                        continue
+                    self._add_decimated_samples(
+                        stream, seq, time_us, dt_us, samples
+                    )
+                    continue
+
+                if self._add_record(frame):
+                    continue
+
+                if len(frame) != TELEMETRY_PACKET.size:
+                    self._rx_frames.append(frame)
+                    continue
+
+                self._telemetry_frames.append(frame)
+
+            else:
+                # ASCII reply line
+                idx_end = rx_buf.find(b"\n")
+                if idx_end < 0:
+                    return  # Incomplete
+                line = bytes(rx_buf[:idx_end])
+                del rx_buf[: idx_end + 1]
+                line = line.decode(errors="replace").strip()
+                if not self._requests:
+                    self._rx_lines.append(line)
+                elif line[:1] == "#" and line[1:] in map(str, self._requests):
+                    self._add_reply(int(line[1:]))
+                else:
+                    self._reply_lines.append(line)
+
+    def _add_reply(self, request_id: int):
+        """Hand over the gathered reply lines to request `request_id`, whose
+        reply just got terminated. The Arduino handles the commands in order,
+        hence the requests ahead of it got lost."""
+        while self._requests[0] != request_id:
+            self._abandoned.discard(self._requests.pop(0))
+        self._requests.pop(0)
+
+        if request_id in self._abandoned:
+            self._abandoned.discard(request_id)
+        else:
+            self._replies[request_id] = self._reply_lines
+        self._reply_lines = []
+
+    def _add_record(self, frame: bytes) -> bool:
+        """Queue `frame` to be decoded in bulk by `_decode_records()` when
+        it is a record of a current subscription.
+        Returns: True when queued, False when not a subscription record.
+        """
+        if (len(frame) < TELEMETRY_RECORD_HEADER.size) or (
+            frame[0] != TELEMETRY_RECORD_MARKER
+        ):
+            return False
+
+        _marker, sub, _seq, fields = TELEMETRY_RECORD_HEADER.unpack_from(frame)
+        subscription = self.subscriptions.get(sub)
+        if (
+            subscription is None
+            or subscription["fields"] != fields
+            or subscription["dtype"].itemsize != len(frame)
+        ):
+            return False
+
+        subscription["frames"].append(frame)
+        return True
+
+    def _add_decimated(self, packet: tuple):
+        """Add the samples of a decimated pressure packet to
+        `decimated_samples`."""
+        _marker, stream, seq, time_us, dt_us = packet[:5]
+        pres = packet[5:]
+        samples = [
+            tuple(pres[idx : idx + 4]) for idx in range(0, len(pres), 4)
+        ]
+        self._add_decimated_samples(stream, seq, time_us, dt_us, samples)
+
+    def _add_decimated_samples(
+        self, stream: int, seq: int, time_us: int, dt_us: int, samples: list
+    ):
+        """Add the `samples` of a decimated pressure packet or compressed
+        block, the first one taken at `time_us`, to `decimated_samples`."""
+        if stream >= DECIM_N_STREAMS:
+            return
+
+        if self._decim_last_seq[stream] is not None:
+            gap = (seq - self._decim_last_seq[stream] - 1) & 0xFFFF
+            self.decim_N_dropped += gap
+        self._decim_last_seq[stream] = seq
+
+        for idx, sample in enumerate(samples):
+            self.decimated_samples[stream].append(
+                ((time_us + idx * dt_us) & 0xFFFFFFFF, sample)
+            )
+
+    def _decode_telemetry(self):
+        """Decode all telemetry packets queued by `_demultiplex()` at once
+        into `telemetry_samples` and detect the gaps in their sequence
+        numbers into `telemetry_gaps`, avoiding any per-packet parsing.
+        """
+        packets = np.frombuffer(
+            b"".join(self._telemetry_frames), dtype=TELEMETRY_DTYPE
+        )
+        self._telemetry_frames = []
+
+        seq = packets["seq"]
+        prev_seq = np.empty_like(seq)
+        prev_seq[1:] = seq[:-1]
+        if len(seq):
+            prev_seq[0] = (
+                (int(seq[0]) - 1) & 0xFFFF
+                if self._telemetry_last_seq is None
+                else self._telemetry_last_seq
+            )
+            self._telemetry_last_seq = int(seq[-1])
+
+        # Wraps around like the 16-bit sequence number itself
+        gaps = (seq - prev_seq - 1).astype(np.uint16)
+        self.telemetry_N_dropped += int(gaps.sum())
+        self.telemetry_samples = packets
+        self.telemetry_gaps = gaps
+
+    def _decode_records(self):
+        """Decode all subscription records queued by `_demultiplex()` at
+        once, per subscription, into `subscription_samples`."""
+        for sub, subscription in self.subscriptions.items():
+            records = np.frombuffer(
+                b"".join(subscription["frames"]), dtype=subscription["dtype"]
+            )
+            subscription["frames"] = []
+            self.subscription_samples[sub] = records
+            if not len(records):
+                continue
+
+            # Wraps around like the 16-bit sequence number itself
+            seq = records["seq"].astype(np.int64)
+            if subscription["last_seq"] is not None:
+                seq = np.concatenate(([subscription["last_seq"]], seq))
+            subscription["last_seq"] = int(seq[-1])
+            self.subscription_N_dropped += int(
+                ((np.diff(seq) - 1) & 0xFFFF).sum()
+            )
+
+    def _perform_DAQ_telemetry(self) -> bool:
+        """Gather the pushed telemetry packets, including those that arrived
+        while picking out query replies, and take over the most recent one into
+        the `state` member.
+        Returns: True if successful, False otherwise.
+        """
+        if self.reader_running:
+            with self._rx_cond:
+                self._decode_telemetry()
+                self._decode_records()
+        else:
+            try:
+                self._demultiplex(
+                    self.ser.read(self.ser.in_waiting), self._rx_buf
+                )
+                self._read_bulk()
+            except Exception as err:
+                pft(err)
+                return False
+
+            self._decode_telemetry()
+            self._decode_records()
+
+        # Take over the most recent values, the full packet last
+        for records in self.subscription_samples.values():
+            if len(records):
+                self._take_over_state(records[-1])
+        if len(self.telemetry_samples):
+            self._take_over_state(self.telemetry_samples[-1])
+        return True
+
+    def _take_over_state(self, packet):
+        """Take over the fields present in the telemetry packet or
+        subscription record `packet` into the `state` member."""
+        names = packet.dtype.names
+        if "pos" in names:
+            self.state.protocol_pos = int(packet["pos"])
+        if "time_us" in names:
+            self.state.time_us = int(packet["time_us"])
+
+        if "pres_mbar" in names:
+            pres_mbar = packet["pres_mbar"].tolist()
+            self.state.P_1_bar = from_milli(pres_mbar[0])
+            self.state.P_2_bar = from_milli(pres_mbar[1])
+            self.state.P_3_bar = from_milli(pres_mbar[2])
+            self.state.P_4_bar = from_milli(pres_mbar[3])
+
+        if "N_open" in names:
+            self.state.N_open = packet["N_open"].tolist()
+        if "N_open_ahead" in names:
+            N_open_ahead = int(packet["N_open_ahead"])
+            self.state.N_open_ahead = (
+                np.nan if N_open_ahead == N_OPEN_UNKNOWN else N_open_ahead
+            )
+
+        if "fsm_state" in names:
+            fsm_state = int(packet["fsm_state"])
+            if fsm_state < len(TELEMETRY_FSM_STATES):
+                self.state.fsm_state = TELEMETRY_FSM_STATES[fsm_state]
+
+    # --------------------------------------------------------------------------
+    #   Reader thread
+    # --------------------------------------------------------------------------
+
+    @property
+    def reader_running(self) -> bool:
+        """Is the reader thread running? See `start_reader()`."""
+        return self._reader is not None and self._reader.is_alive()
+
+    def start_reader(self):
+        """Start a dedicated thread reading the serial port and, when
+        attached, the USB vendor interface, demultiplexing the received bytes
+        into the queues of the reply lines, binary replies, telemetry and
+        decimated streams as soon as they arrive. From then on `perform_DAQ()`
+        merely decodes the queued telemetry without touching the port, hence
+        never blocks on a query of another thread, and no streamed data gets
+        lost while a query awaits its reply. `query()` tags each command by a
+        request ID, see `#` of the firmware, and picks out the reply matching
+        it. Stopped by `stop_reader()` or `close()`.
+        """
+        if self.reader_running:
+            return
+
+        with self._rx_cond:
+            self._requests.clear()
+            self._reply_lines = []
+            self._replies.clear()
+            self._abandoned.clear()
+        self._reader_stop.clear()
+        self._reader = threading.Thread(
+            target=self._reader_loop, name="Ard reader", daemon=True
+        )
+        self._reader.start()
+
+    def stop_reader(self):
+        """Stop the reader thread, returning to demultiplexing the received
+        bytes in the thread awaiting them."""
+        if self._reader is None:
+            return
+        self._reader_stop.set()
+        self._reader.join()
+        self._reader = None
+
+    def _reader_loop(self):
+        """Body of the reader thread, see `start_reader()`."""
+        while not self._reader_stop.is_set():
+            try:
+                if self.bulk is None:
+                    data = self.ser.read(max(self.ser.in_waiting, 1))
+                    data_bulk = b""
+                else:
+                    # Paced by the time-out of the vendor interface instead
+                    data = self.ser.read(self.ser.in_waiting)
+                    data_bulk = self.bulk.read(timeout=0.001)
+            except Exception as err:
+                pft(err)
+                return
+
+            if data or data_bulk:
+                with self._rx_cond:
+                    self._demultiplex(data, self._rx_buf)
+                    self._demultiplex(data_bulk, self._rx_buf_bulk)
+                    self._rx_cond.notify_all()
+
+    def request(self, msg: str) -> list:
+        """Send a command tagged by a new request ID and await the reply
+        lines matching it, while the reader thread runs. Safe to be called
+        from several threads at once, as long as none of them writes untagged
+        commands in the meantime.
+        Returns: List of the reply lines, empty when the command does not
+        reply, or None when failed.
+        """
+        with self._rx_cond:
+            self._request_id = (self._request_id + 1) & 0xFFFF
+            request_id = self._request_id
+            self._requests.append(request_id)
+            success = self.write(f"#{request_id:d} {msg}")
+            if success:
+                success = self._rx_cond.wait_for(
+                    lambda: request_id in self._replies, self.ser.timeout
+                )
+            if not success:
+                # A late reply still has to be told apart from the next one
+                if request_id in self._requests:
+                    self._abandoned.add(request_id)
+                self._replies.pop(request_id, None)
+                return None
+            return self._replies.pop(request_id)
+
+    def close(self, *args, **kwargs):
+        """Stop the reader thread, then close the serial port."""
+        self.stop_reader()
+        super().close(*args, **kwargs)
+
+    # --------------------------------------------------------------------------
+    #   USB vendor interface
+    # --------------------------------------------------------------------------
+
+    def attach_bulk(self, serial_number: str = None) -> bool:
+        """Open the USB vendor interface of the Arduino, see
+        `JettingGrid_usb_bulk.py`, and have the Arduino route the bulk uploads
+        and the pushed telemetry via it instead of via the serial port. The
+        commands and their replies stay on the serial port. Requires the
+        firmware being built with the `adafruit_feather_m4_usb_bulk`
+        environment.
+        Returns: True if successful, False otherwise.
+        """
+        # Imported here, keeping `pyusb` optional
+        from JettingGrid_usb_bulk import UsbBulkPort
+
+        try:
+            self.bulk = UsbBulkPort(serial_number, timeout=self.ser.timeout)
+        except Exception as err:
+            pft(err)
+            self.bulk = None
+            return False
+
+        self._rx_buf_bulk.clear()
+        success, reply = self.query("usb_bulk 1")
+        if not success or reply != "1":
+            pft(reply)
+            self.detach_bulk()
+            return False
+        return True
+
+    def detach_bulk(self):
+        """Route the bulk data via the serial port again and close the USB
+        vendor interface."""
+        if self.bulk is None:
+            return
+        self.query("usb_bulk 0")
+        self.bulk.close()
+        self.bulk = None
+        self._rx_buf_bulk.clear()
+
+    def write_bulk(self, data: bytes):
+        """Write bulk data, e.g. the frames of a bulk upload, via the USB
+        vendor interface when attached, or via the serial port otherwise."""
+        if self.bulk is not None:
+            self.bulk.write(data)
+        else:
+            self.ser.write(data)
+
+    def _read_bulk(self):
+        """Demultiplex the bytes received via the USB vendor interface, when
+        attached."""
+        if self.bulk is not None:
+            self._demultiplex(self.bulk.read(timeout=0.001), self._rx_buf_bulk)
+
+    def benchmark_usb(self, N_bytes: int = 1 << 20) -> dict:
+        """Measure the USB throughput in both directions of the serial port
+        and, when attached, of the USB vendor interface, see `bench_usb` and
+        `bench_usb_sink` of the firmware. Must not be subscribed to the
+        telemetry, nor be running the reader thread, see `start_reader()`.
+        Returns: Dict holding per port name the tuple (to PC, from PC) of
+        throughputs [MB/s] as timed by the Arduino, NaN when failed.
+        """
+        ports = {"serial": 0}
+        if self.bulk is not None:
+            ports["bulk"] = 1
+
+        results = {}
+        for name, port in ports.items():
+            rates = []
+            for cmd in ("bench_usb", "bench_usb_sink"):
+                success, reply = self.query(f"{cmd} {port:d} {N_bytes:d}")
+                try:
+                    N = int(reply)
+                except (TypeError, ValueError):
+                    pft(reply)
+                    rates.append(np.nan)
+                    continue
+
+                if cmd == "bench_usb":
+                    got = 0
+                    while got < N:
+                        chunk = (
+                            self.ser.read(max(self.ser.in_waiting, 1))
+                            if port == 0
+                            else self.bulk.read(N - got)
+                        )
+                        if not chunk:
+                            break
+                        got += len(chunk)
+                else:
+                    data = bytes(idx & 0xFF for idx in range(N))
+                    if port == 0:
+                        self.ser.write(data)
+                    else:
+                        self.bulk.write(data)
+
+                success, reply = self.readline()
+                try:
+                    rates.append(N / int(reply))  # [B/µs] == [MB/s]
+                except (TypeError, ValueError, ZeroDivisionError):
+                    pft(reply)
+                    rates.append(np.nan)
+
+            results[name] = tuple(rates)
+        return results
+
+    # --------------------------------------------------------------------------
+    #   Clock synchronization
+    # --------------------------------------------------------------------------
+
+    def sync_clock(self, N_pings: int = 8) -> bool:
+        """Ping the Arduino `N_pings` times and add the round trip having the
+        shortest round-trip time to `clock_sync`, as that one suffered the least
+        from the USB latency. Call it periodically to track the clock drift.
+        Works both with and without being subscribed to the telemetry.
+        Returns: True if successful, False otherwise.
+        """
+        best = None
+        for _ in range(N_pings):
+            self._ping_token = (self._ping_token + 1) & 0xFFFF
+            t_send = time.time()
+            success, reply = self.query(f"ping {self._ping_token:d}")
+            t_recv = time.time()
+            if not success:
+                return False
+
+            try:
+                token, time_us = (int(x) for x in reply.split("\t"))
+            except (AttributeError, ValueError) as err:
+                pft(err)
+                return False
+            if token != self._ping_token:
+                continue  # Stale reply
+
+            if best is None or (t_recv - t_send) < (best[2] - best[0]):
+                best = (t_send, time_us, t_recv)
+
+        if best is None:
+            return False
+
+        self.clock_sync.add_sample(*best)
+        return True
+
+    # --------------------------------------------------------------------------
+    #   Live mode
+    # --------------------------------------------------------------------------
+
+    def _live_frame(self, marker: int, open_valves) -> bytes:
+        self._live_seq = (self._live_seq + 1) & 0xFF
+        bitset = bytearray(LIVE_BITSET_LEN)
+        for valve in open_valves:
+            bitset[(valve - 1) // 8] |= 1 << ((valve - 1) % 8)
+        body = bytes((self._live_seq,)) + bytes(bitset)
+        return bytes((marker,)) + body + struct.pack("<I", zlib.crc32(body))
+
+    def start_live(self, deadline_ms: int = 100, ack: bool = False) -> bool:
+        """Enter the live mode, in which the Arduino applies the valve frames
+        sent by `send_live_frame()` right away. All valves get closed when no
+        frame arrives within `deadline_ms`. With `ack`, the Arduino replies
+        "ack <seq>" once each frame has been written out to the valves, letting
+        the host measure the round-trip latency.
+        Returns: True if successful, False otherwise.
+        """
+        success, reply = self.query(f"live {deadline_ms:d} {ack:d}")
+        return success and reply == "live"
+
+    def send_live_frame(self, open_valves) -> int:
+        """Send the set of valve numbers `open_valves` to be opened, closing all
+        others, while in the live mode.
+        Returns: The sequence number of the frame.
+        """
+        self.ser.write(self._live_frame(LIVE_MARKER, open_valves))
+        return self._live_seq
+
+    def stop_live(self):
+        """Leave the live mode, keeping the valves as they are.
+        """
+        self.ser.write(self._live_frame(LIVE_END_MARKER, ()))
+
+    def read_live_stats(self):
+        """Read the statistics of the last live mode session.
+        Returns: (N_applied, N_stale, N_corrupt, N_deadline_misses, min_us,
+        mean_us, max_us) with the latencies from receiving a frame until its
+        valves had been written, or None when failed.
+        """
+        success, reply = self.query("live?")
+        if not success:
+            return None
+        try:
+            return tuple(int(x) for x in reply.split("\t"))
+        except (AttributeError, ValueError) as err:
+            pft(err)
+            return None
+
     # --------------------------------------------------------------------------
     #   Misc. methods
     # --------------------------------------------------------------------------
@@ -139,6 +1723,22 @@ class JettingGrid_Arduino(Arduino):
         """
         return self.write("play")
 
+    def arm_trigger_protocol(self) -> bool:
+        """Rewind the protocol and start playing it on the next rising edge of
+        the hardware trigger input of the Arduino.
+        Returns: True if successful, False otherwise.
+        """
+        return self.write("trigger")
+
+    def arm_follower_protocol(self) -> bool:
+        """Rewind the protocol and play it as follower of a leader Arduino,
+        whose sync output is wired to the hardware trigger input of this
+        Arduino. The first edge starts the playback and each next edge switches
+        to the next protocol line.
+        Returns: True if successful, False otherwise.
+        """
+        return self.write("follow")
+
     def stop_protocol(self) -> bool:
         """Stop the protocol and immediately close all valves.
 
@@ -156,6 +1756,14 @@ class JettingGrid_Arduino(Arduino):
         """
         return self._protocol_query_fun("pause")
 
+    def step_protocol(self) -> bool:
+        """Play the protocol up to the next line switch and pause right at the
+        start of the new line, i.e. each step plays exactly one line with its
+        real duration.
+        Returns: True if successful, False otherwise.
+        """
+        return self.write("step")
+
     def rewind_protocol(self) -> bool:
         """Rewind the protocol and immediately actuate valves.
         Returns: True if successful, False otherwise.
@@ -187,6 +1795,18 @@ class JettingGrid_Arduino(Arduino):
 
         return self._protocol_query_fun(f"goto {idx_line:d}")
 
+    def gototime_protocol(self, t_ms: float) -> bool:
+        """Go to the line of the protocol being played at the given time [ms]
+        since its start and immediately actuate valves.
+        Returns: True if successful, False otherwise.
+        """
+        try:
+            t_ms = float(t_ms)
+        except (TypeError, ValueError):
+            t_ms = 0
+
+        return self._protocol_query_fun(f"gototime {t_ms:.3f}")
+
     def load_preset(self, preset_no: int) -> bool:
         """Load in a protocol preset:
             0: Open all valves
@@ -194,6 +1814,9 @@ class JettingGrid_Arduino(Arduino):
             2: Walk over all manifolds
             3: Alternating checkerboard
             4: Alternating even/odd valves
+            5: Sweep over the PCS rows
+            6: Random fraction of the valves, half of them open
+            7: Rings expanding from the center of the PCS
 
         The name and total number of lines of the protocol will get updated in
         members `state.protocol_name` and `state.protocol_N_lines`.
@@ -205,8 +1828,7 @@ class JettingGrid_Arduino(Arduino):
         except (TypeError, ValueError):
             idx_preset = 0
 
-        # Only presets 0 to 4 exist. Check user input.
-        IDX_PRESET_MAX = 4
+        # Only presets 0 to 7 exist. Check user input.
         if not idx_preset in range(IDX_PRESET_MAX + 1):
             idx_preset = 0
 
@@ -215,6 +1837,53 @@ class JettingGrid_Arduino(Arduino):
 
         return success
 
+    def play_preset(
+        self, preset_no: int, duration_ms: int = 0, percent: int = 50
+    ) -> bool:
+        """Play a protocol preset endlessly, produced on the fly by the Arduino.
+        Unlike `load_preset()`, the protocol loaded into the Arduino is left
+        intact. See `load_preset()` for the presets.
+
+        Args:
+            preset_no: Preset number
+            duration_ms: Line duration [ms], 0 for the default of the preset
+            percent: Preset 6 only, chance [%] of each valve to be open
+
+        Returns: True if successful, False otherwise.
+        """
+        try:
+            idx_preset = int(preset_no)
+        except (TypeError, ValueError):
+            idx_preset = 0
+
+        if not idx_preset in range(IDX_PRESET_MAX + 1):
+            idx_preset = 0
+
+        success, reply = self.query(
+            f"preset_play {idx_preset:d} {int(duration_ms):d} {int(percent):d}"
+        )
+        if not success:
+            return False
+
+        dprint(f"Playing preset: {reply}")
+        return True
+
+    def swap_protocol(self) -> bool:
+        """Swap in the protocol that got uploaded while the previous one kept
+        on playing. When playing, the swap takes effect once the current line
+        has expired, continuing at line 1 of the new protocol. Call
+        `get_protocol_info()` afterwards to update the protocol name and total
+        number of lines.
+
+        Returns: True if successful, False otherwise.
+        """
+        success, reply = self.query("swap")
+        if not success or reply.startswith("ERROR"):
+            dprint(reply)
+            return False
+
+        return True
+
     def get_protocol_info(self) -> bool:
         """Get the name and total number of lines of the protocol currently
         loaded into the Arduino, and write them into members
@@ -8,12 +8,13 @@ and the Xylem Hydrovar HVL pump.
 __author__ = "Dennis van Gils"
 __authoremail__ = "vangils.dennis@gmail.com"
 __url__ = "https://github.com/Dennis-van-Gils/project-TWT-jetting-grid"
-__date__ = "17-04-2023"
+__date__ = "15-10-2026"
 __version__ = "1.0"
 # pylint: disable=bare-except, broad-except, unnecessary-lambda, wrong-import-position
 
 import os
 import sys
+import time
 from functools import partial
 from pathlib import Path
 
@@ -111,8 +112,9 @@ from dvg_pyqtgraph_threadsafe import (
 )
 
 from JettingGrid_Arduino import JettingGrid_Arduino
+from JettingGrid_history import TieredHistory
 from JettingGrid_qdev import JettingGrid_qdev, GUI_objects
-from JettingGrid_upload import upload_protocol
+from JettingGrid_upload import UploadWorker, upload_protocol_bulk
 from XylemHydrovarHVL_protocol_RTU import XylemHydrovarHVL
 from XylemHydrovarHVL_qdev import XylemHydrovarHVL_qdev
 
@@ -192,6 +194,74 @@ def apply_PlotItem_style(
     # fmt: on
 
 
+class TieredHistoryChartCurve(HistoryChartCurve):
+    """Thread-safe curve like `HistoryChartCurve`, but buffering into a
+    `TieredHistory` spanning `history_time` seconds instead of a ring buffer of
+    fixed capacity. Each redraw fetches only the x-range shown, at the finest
+    level fitting in twice the pixel width of the plot. Hence, the redraw cost
+    stays constant regardless of the DAQ rate and the history length.
+    """
+
+    def __init__(self, history_time: float, linked_curve: pg.PlotDataItem):
+        # The ring buffer of the base class stays unused
+        super().__init__(capacity=1, linked_curve=linked_curve)
+        self._linked = linked_curve
+        self._history = TieredHistory(history_time)
+        self._history_mutex = QtCore.QMutex()
+        self._history_snapshot = None  # (t, y, t_last)
+
+    def appendData(self, x, y):
+        self._history_mutex.lock()
+        self._history.append(x, y)
+        self._history_mutex.unlock()
+
+    def extendData(self, x_list, y_list):
+        self._history_mutex.lock()
+        for x, y in zip(x_list, y_list):
+            self._history.append(x, y)
+        self._history_mutex.unlock()
+
+    def setData(self, x_list, y_list):
+        self._history_mutex.lock()
+        self._history.clear()
+        for x, y in zip(x_list, y_list):
+            self._history.append(x, y)
+        self._history_mutex.unlock()
+
+    def clear(self):
+        self._history_mutex.lock()
+        self._history.clear()
+        self._history_mutex.unlock()
+
+    def update(self, create_snapshot: bool = True):
+        divisor = float(self.x_axis_divisor)
+        vb = self._linked.getViewBox()
+        if vb is None:
+            x_min, width = -CHART_HISTORY_TIME / divisor, 1000
+        else:
+            x_min = vb.viewRange()[0][0]
+            width = max(int(vb.boundingRect().width()), 1)
+
+        if create_snapshot or self._history_snapshot is None:
+            self._history_mutex.lock()
+            t_last = self._history.last_time()
+            if t_last == t_last:  # Not NaN, i.e. not empty
+                t, y = self._history.window(
+                    t_last + x_min * divisor, 2 * width
+                )
+                self._history_snapshot = (t, y, t_last)
+            else:
+                self._history_snapshot = None
+            self._history_mutex.unlock()
+
+        if self._history_snapshot is None:
+            self._linked.setData([], [])
+            return
+
+        t, y, t_last = self._history_snapshot
+        self._linked.setData((t - t_last) / divisor, y, connect="finite")
+
+
 # ------------------------------------------------------------------------------
 #   MainWindow
 # ------------------------------------------------------------------------------
@@ -218,6 +288,10 @@ class MainWindow(QtWid.QWidget):
         self.grid: JettingGrid_Arduino = self.grid_qdev.dev
         self.pump: XylemHydrovarHVL = self.pump_qdev.dev
 
+        # Protocol upload running in the background, see `UploadWorker`
+        self.upload_worker: UploadWorker = None
+        self.feasibility: dict = None  # See `read_feasibility()`
+
         self.create_GUI()
 
     def create_GUI(self):
@@ -422,8 +496,8 @@ class MainWindow(QtWid.QWidget):
         vbox_protocol.addWidget(self.qpbt_preset_3)
         vbox_protocol.addWidget(self.qpbt_preset_4)
 
-        qgrp_protocol = QtWid.QGroupBox("Protocol")
-        qgrp_protocol.setLayout(vbox_protocol)
+        self.qgrp_protocol = QtWid.QGroupBox("Protocol")
+        self.qgrp_protocol.setLayout(vbox_protocol)
 
         #  Charts
         # -------------------------
@@ -438,35 +512,30 @@ class MainWindow(QtWid.QWidget):
         self.plots = [self.pi_pres]
 
         # Thread-safe curves
-        capacity = round(
-            CHART_HISTORY_TIME
-            * 1e3
-            / self.grid_qdev.worker_DAQ._DAQ_interval_ms
-        )
         PEN_01 = pg.mkPen(controls.COLOR_PEN_RED, width=3)
         PEN_02 = pg.mkPen(controls.COLOR_PEN_YELLOW, width=3)
         PEN_03 = pg.mkPen(controls.COLOR_PEN_GREEN, width=3)
         PEN_04 = pg.mkPen(controls.COLOR_PEN_TURQUOISE, width=3)
         PEN_05 = pg.mkPen(controls.COLOR_PEN_PINK, width=3)
 
-        self.curve_P_pump = HistoryChartCurve(
-            capacity=capacity,
+        self.curve_P_pump = TieredHistoryChartCurve(
+            history_time=CHART_HISTORY_TIME,
             linked_curve=self.pi_pres.plot(pen=PEN_01, name="P_pump"),
         )
-        self.curve_P_1 = HistoryChartCurve(
-            capacity=capacity,
+        self.curve_P_1 = TieredHistoryChartCurve(
+            history_time=CHART_HISTORY_TIME,
             linked_curve=self.pi_pres.plot(pen=PEN_02, name="P_1"),
         )
-        self.curve_P_2 = HistoryChartCurve(
-            capacity=capacity,
+        self.curve_P_2 = TieredHistoryChartCurve(
+            history_time=CHART_HISTORY_TIME,
             linked_curve=self.pi_pres.plot(pen=PEN_03, name="P_2"),
         )
-        self.curve_P_3 = HistoryChartCurve(
-            capacity=capacity,
+        self.curve_P_3 = TieredHistoryChartCurve(
+            history_time=CHART_HISTORY_TIME,
             linked_curve=self.pi_pres.plot(pen=PEN_04, name="P_3"),
         )
-        self.curve_P_4 = HistoryChartCurve(
-            capacity=capacity,
+        self.curve_P_4 = TieredHistoryChartCurve(
+            history_time=CHART_HISTORY_TIME,
             linked_curve=self.pi_pres.plot(pen=PEN_05, name="P_4"),
         )
 
@@ -600,7 +669,7 @@ class MainWindow(QtWid.QWidget):
         grid_bot = QtWid.QGridLayout()
         grid_bot.addLayout(vbox_pump, 0, 0)
         grid_bot.addWidget(
-            qgrp_protocol, 0, 1, QtCore.Qt.AlignmentFlag.AlignTop
+            self.qgrp_protocol, 0, 1, QtCore.Qt.AlignmentFlag.AlignTop
         )
         grid_bot.addWidget(self.gw, 0, 2)
         grid_bot.addLayout(vbox_readings, 0, 3)
@@ -632,6 +701,8 @@ class MainWindow(QtWid.QWidget):
 
         self.grid_qdev.signal_DAQ_updated.connect(self.update_GUI)
         self.grid_qdev.signal_GUI_needs_update.connect(self.update_GUI)
+        self.grid_qdev.signal_upload_progress.connect(self.update_upload)
+        self.grid_qdev.signal_upload_finished.connect(self.finish_upload)
 
         self.logger.signal_recording_started.connect(
             lambda filepath: self.qpbt_record.setText(
@@ -707,7 +778,7 @@ class MainWindow(QtWid.QWidget):
     def process_qpbt_proto_upload(self):
         # Extra safety check: Don't allow uploading a protocol when the pump is
         # still running
-        if self.pump.state.pump_is_running:
+        if self.pump.state.pump_is_running or self.upload_worker is not None:
             return
 
         # Get the folder that was last used to load in a protocol file
@@ -765,24 +836,79 @@ class MainWindow(QtWid.QWidget):
 
         self.grid_qdev.worker_DAQ.DAQ_function = empty_DAQ_function
 
-        # Wait a few DAQ iterations
-        i = self.grid_qdev.update_counter_DAQ
-        while self.grid_qdev.update_counter_DAQ <= i + 1:
-            pass
+        def prepare():
+            # Wait a few DAQ iterations
+            i = self.grid_qdev.update_counter_DAQ
+            while self.grid_qdev.update_counter_DAQ <= i + 1:
+                time.sleep(0.01)
+
+            # Flush serial buffer
+            self.grid.ser.flush()
+            return True
 
-        # Flush serial buffer
-        self.grid.ser.flush()
+        def on_finished(success: bool):
+            # Retrieve the name and total number of lines of the protocol
+            # currently loaded into the Arduino
+            self.grid.get_protocol_info()
+
+            # Predicted timing of the uploaded protocol, shown before `play`
+            self.feasibility = None
+            if success:
+                self.feasibility = self.grid.read_feasibility()
+
+            # Restore DAQ function
+            self.grid_qdev.worker_DAQ.DAQ_function = DAQ_function_backup
+            self.grid_qdev.signal_upload_finished.emit(success)
+
+        # Now we're ready to upload a new jetting protocol. The upload runs in
+        # the background, keeping the GUI responsive. The protocol controls
+        # stay disabled meanwhile, as they would interfere with the upload.
+        self.qgrp_protocol.setEnabled(False)
+        self.upload_worker = UploadWorker(
+            self.grid,
+            file_path,
+            upload_function=upload_protocol_bulk,
+            on_progress=self.grid_qdev.signal_upload_progress.emit,
+            on_finished=on_finished,
+            prepare=prepare,
+        )
+        self.upload_worker.start()
 
-        # Now we're ready to upload a new jetting protocol
-        upload_protocol(self.grid, file_path)
+    @Slot(int, int)
+    def update_upload(self, N_done: int, N_lines: int):
+        self.qlin_proto_name.setText(f"Uploading: line {N_done} of {N_lines}")
 
-        # Retrieve the name and total number of lines of the protocol currently
-        # loaded into the Arduino
-        self.grid.get_protocol_info()
+    @Slot(bool)
+    def finish_upload(self, success: bool):
+        self.upload_worker.join()
+        self.upload_worker = None
+        self.qgrp_protocol.setEnabled(True)
         self.update_GUI(GUI_objects.PROTO_INFO)
 
-        # Restore DAQ function
-        self.grid_qdev.worker_DAQ.DAQ_function = DAQ_function_backup
+        if not success:
+            QtWid.QMessageBox.warning(
+                self,
+                "Upload protocol file",
+                "The upload of the protocol failed. See the terminal.",
+            )
+        elif self.feasibility and self.feasibility["N_infeasible"]:
+            report = self.feasibility
+            ranges = ", ".join(
+                str(first) if first == last else f"{first}-{last}"
+                for first, last in report["ranges"]
+            )
+            if report["N_ranges"] > len(report["ranges"]):
+                ranges += ", ..."
+            QtWid.QMessageBox.warning(
+                self,
+                "Upload protocol file",
+                f"{report['N_infeasible']} of {report['N_lines']} lines are "
+                "predicted to be too short for the hardware to keep up with, "
+                f"in line ranges {ranges}.\n\nThe minimum achievable line "
+                f"duration is {report['min_us'] / 1000:.1f} ms, set by line "
+                f"{report['worst_line']}. Timing will not hold while playing "
+                "these lines, see `overload` of the firmware.",
+            )
 
     @Slot()
     def process_qpbt_proto_stop(self):
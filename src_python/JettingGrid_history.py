@@ -0,0 +1,168 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""JettingGrid_history.py
+
+Multi-resolution history of a timeseries for the charts of the GUI. The
+recent samples are kept at full resolution, the older ones aggregated into
+levels of min/max buckets spanning ever longer durations, see
+`TieredHistory`. A chart fetches the level matching its pixel width, see
+`TieredHistory.window()`, hence its redraw cost stays constant regardless of
+the sample rate and the history length.
+"""
+__author__ = "Dennis van Gils"
+__authoremail__ = "vangils.dennis@gmail.com"
+__url__ = "https://github.com/Dennis-van-Gils/project-TWT-jetting-grid"
+__date__ = "15-10-2026"
+__version__ = "1.0"
+
+from typing import Tuple
+
+import numpy as np
+
+
+class _Ring:
+    """Ring buffer of rows, ordered by ascending time in column 0."""
+
+    def __init__(self, capacity: int, N_columns: int):
+        self.data = np.full((capacity, N_columns), np.nan)
+        self.head = 0  # Next row to write
+        self.size = 0
+
+    def append(self, row):
+        self.data[self.head] = row
+        self.head = (self.head + 1) % len(self.data)
+        self.size = min(self.size + 1, len(self.data))
+
+    def is_full(self) -> bool:
+        return self.size == len(self.data)
+
+    def _segments(self):
+        """The rows as two contiguous segments, oldest first"""
+        if not self.is_full():
+            return self.data[: self.size], self.data[:0]
+        return self.data[self.head :], self.data[: self.head]
+
+    def oldest_time(self) -> float:
+        return self._segments()[0][0, 0] if self.size else np.nan
+
+    def since(self, t_from: float) -> np.ndarray:
+        """The rows with a time of at least `t_from`, oldest first"""
+        older, newer = self._segments()
+        if len(newer) and t_from >= newer[0, 0]:
+            return newer[np.searchsorted(newer[:, 0], t_from) :]
+        idx = np.searchsorted(older[:, 0], t_from)
+        return np.concatenate((older[idx:], newer))
+
+    def count_since(self, t_from: float) -> int:
+        older, newer = self._segments()
+        if len(newer) and t_from >= newer[0, 0]:
+            return len(newer) - np.searchsorted(newer[:, 0], t_from)
+        return len(older) - np.searchsorted(older[:, 0], t_from) + len(newer)
+
+
+class TieredHistory:
+    """History of a timeseries in tiers of decreasing resolution.
+
+    Level 0 holds the last `N_recent` samples as is. Level `k` >= 1 holds
+    `N_buckets` buckets of `bucket_time * factor**(k - 1)` seconds each,
+    storing the min and max of the samples inside. The number of levels is
+    chosen such that the coarsest one spans `history_time`. Hence, the memory
+    taken is independent of the sample rate, as is the number of points drawn
+    of an aggregated level. Not thread-safe, see `TieredHistoryChartCurve` of
+    `JettingGrid_gui.py`.
+
+    NaN samples are left out of the min and max. A bucket of only NaN samples
+    stays NaN, showing as a gap in the chart.
+    """
+
+    def __init__(
+        self,
+        history_time: float,
+        N_recent: int = 4096,
+        bucket_time: float = 0.1,
+        factor: int = 4,
+        N_buckets: int = 2048,
+    ):
+        self.N_recent = N_recent
+        self.bucket_times = [bucket_time]
+        while self.bucket_times[-1] * N_buckets < history_time:
+            self.bucket_times.append(self.bucket_times[-1] * factor)
+        self.N_buckets = N_buckets
+        self.clear()
+
+    def clear(self):
+        # Level 0: (t, y), aggregated levels: (t, y_min, y_max)
+        self._levels = [_Ring(self.N_recent, 2)] + [
+            _Ring(self.N_buckets, 3) for _ in self.bucket_times
+        ]
+        # Per aggregated level the bucket being filled: [idx, y_min, y_max]
+        self._pending = [[None, np.nan, np.nan] for _ in self.bucket_times]
+
+    @property
+    def N_levels(self) -> int:
+        return len(self._levels)
+
+    def append(self, t: float, y: float):
+        self._levels[0].append((t, y))
+
+        for level, bucket_time in enumerate(self.bucket_times, start=1):
+            pending = self._pending[level - 1]
+            idx = int(t // bucket_time)
+            if idx != pending[0]:
+                if pending[0] is not None:
+                    self._levels[level].append(
+                        ((pending[0] + 0.5) * bucket_time, *pending[1:])
+                    )
+                pending[:] = [idx, np.nan, np.nan]
+
+            if y == y:  # Not NaN
+                # Negated comparisons to also replace NaN
+                if not pending[1] <= y:
+                    pending[1] = y
+                if not pending[2] >= y:
+                    pending[2] = y
+
+    def last_time(self) -> float:
+        ring = self._levels[0]
+        return ring.data[ring.head - 1, 0] if ring.size else np.nan
+
+    def _covers(self, level: int, t_from: float) -> bool:
+        """Does the level reach back to `t_from`, or to the first sample?"""
+        ring = self._levels[level]
+        return not ring.is_full() or ring.oldest_time() <= t_from
+
+    def pick_level(self, t_from: float, N_points_max: int) -> int:
+        """The finest level covering `t_from` up to now in at most
+        `N_points_max` points to draw, else the coarsest level."""
+        for level in range(self.N_levels):
+            # Aggregated levels draw two points per bucket, plus the pending
+            N_points = self._levels[level].count_since(t_from)
+            if level > 0:
+                N_points = 2 * (N_points + 1)
+            if N_points <= N_points_max and self._covers(level, t_from):
+                return level
+        return self.N_levels - 1
+
+    def window(
+        self, t_from: float, N_points_max: int
+    ) -> Tuple[np.ndarray, np.ndarray]:
+        """The samples from `t_from` up to now, at the finest level fitting in
+        `N_points_max` points, e.g. twice the pixel width of the chart.
+        Aggregated levels come as a min/max pair per bucket, drawing the
+        envelope of the samples.
+
+        Returns: (Tuple)
+            t (np.ndarray): Time [s]
+            y (np.ndarray): Value
+        """
+        level = self.pick_level(t_from, N_points_max)
+        rows = self._levels[level].since(t_from)
+        if level == 0:
+            return rows[:, 0].copy(), rows[:, 1].copy()
+
+        pending = self._pending[level - 1]
+        if pending[0] is not None:
+            t_pending = (pending[0] + 0.5) * self.bucket_times[level - 1]
+            rows = np.vstack((rows, (t_pending, *pending[1:])))
+
+        return np.repeat(rows[:, 0], 2), rows[:, 1:].ravel()
@@ -0,0 +1,155 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""JettingGrid_profile.py
+
+Symbolizes the histogram of the sampling profiler of the Jetting Grid Arduino,
+see `SamplingProfiler.h` of the firmware, against the firmware ELF. Each bin
+spans an address range, of which the samples get divided over the functions
+overlapping it, in proportion to their overlap. Hence, the functions smaller
+than a bin come out approximate, see `prof <period us> <lo> <hi>` of the
+firmware to zoom in.
+
+Needs `arm-none-eabi-nm` of the GNU Arm toolchain, e.g. the one PlatformIO
+installs under `~/.platformio/packages/toolchain-gccarmnoneeabi/bin`.
+
+When run from the terminal, it symbolizes the reply to `prof?` as saved into a
+text file:
+
+    python JettingGrid_profile.py prof.txt firmware.elf [N_top]
+
+The ELF gets built into `src_mcu/.pio/build/adafruit_feather_m4/`.
+"""
+__author__ = "Dennis van Gils"
+__authoremail__ = "vangils.dennis@gmail.com"
+__url__ = "https://github.com/Dennis-van-Gils/project-TWT-jetting-grid"
+__date__ = "15-10-2026"
+__version__ = "1.0"
+
+import bisect
+import subprocess
+import sys
+
+NM = "arm-none-eabi-nm"
+
+# Symbol types of `nm` denoting code
+NM_CODE_TYPES = "tTwW"
+
+# Names of the samples that can't be attributed to a function
+OUTSIDE = "<outside of range>"
+UNKNOWN = "<unknown>"
+
+
+def parse_profile(lines: list) -> dict:
+    """Parse the reply to `prof?` of the firmware, given as a list of lines.
+    Returns: Dict with the fields of the header line and `bins`, a dict of
+    the start address of each non-empty bin to its number of samples.
+    Raises: ValueError or IndexError when malformed.
+    """
+    fields = lines[0].split("\t")
+    profile = dict(
+        running=bool(int(fields[0])),
+        period_us=int(fields[1]),
+        N=int(fields[2]),
+        N_outside=int(fields[3]),
+        N_isr=int(fields[4]),
+        lo=int(fields[5], 16),
+        bin_bytes=int(fields[6]),
+        bins={},
+    )
+    N_bins = int(fields[7])
+    for line in lines[1 : N_bins + 1]:
+        address, count = line.split("\t")
+        profile["bins"][int(address, 16)] = int(count)
+    if len(profile["bins"]) != N_bins:
+        raise ValueError(f"Expected {N_bins} bins")
+    return profile
+
+
+def read_symbols(elf_path: str, nm: str = NM) -> list:
+    """Read the functions of the firmware ELF, sorted by address.
+    Returns: List of (address, size, name) tuples.
+    """
+    reply = subprocess.run(
+        [nm, "--numeric-sort", "--print-size", "--demangle", elf_path],
+        capture_output=True,
+        check=True,
+        text=True,
+    )
+
+    symbols = []
+    for line in reply.stdout.splitlines():
+        fields = line.split(maxsplit=3)
+        if len(fields) != 4 or fields[2] not in NM_CODE_TYPES:
+            continue  # Lacks a size, or not code
+
+        address = int(fields[0], 16) & ~1  # Clear the Thumb bit
+        size = int(fields[1], 16)
+        if symbols and symbols[-1][0] == address:
+            continue  # Alias of the previous symbol
+        symbols.append((address, size, fields[3]))
+    return symbols
+
+
+def symbolize(profile: dict, elf_path: str, nm: str = NM) -> list:
+    """Divide the samples of `profile`, see `parse_profile()`, over the
+    functions of the firmware ELF.
+    Returns: List of (name, samples) tuples, most samples first. The samples
+    are floats, as a bin can be shared by several functions.
+    """
+    symbols = read_symbols(elf_path, nm)
+    starts = [symbol[0] for symbol in symbols]
+    width = profile["bin_bytes"]
+    totals = {}
+
+    for bin_lo, count in profile["bins"].items():
+        bin_hi = bin_lo + width
+        covered = 0
+        idx = max(bisect.bisect_right(starts, bin_lo) - 1, 0)
+        while idx < len(symbols) and symbols[idx][0] < bin_hi:
+            address, size, name = symbols[idx]
+            overlap = min(bin_hi, address + size) - max(bin_lo, address)
+            if overlap > 0:
+                totals[name] = totals.get(name, 0) + count * overlap / width
+                covered += overlap
+            idx += 1
+
+        if covered < width:
+            share = count * (width - covered) / width
+            totals[UNKNOWN] = totals.get(UNKNOWN, 0) + share
+
+    if profile["N_outside"]:
+        totals[OUTSIDE] = profile["N_outside"]
+
+    return sorted(totals.items(), key=lambda item: item[1], reverse=True)
+
+
+def print_report(profile: dict, table: list, N_top: int = 30):
+    """Print the `N_top` functions of `table`, see `symbolize()`."""
+    N = max(profile["N"], 1)
+    print(
+        f"{profile['N']} samples every {profile['period_us']} us, "
+        f"{profile['N_isr'] / N * 100:.1f} % inside of interrupt handlers, "
+        f"{profile['bin_bytes']} bytes per bin"
+    )
+    print(f"{'%':>6s} {'samples':>10s}  function")
+    for name, samples in table[:N_top]:
+        print(f"{samples / N * 100:6.2f} {samples:10.1f}  {name}")
+
+
+# ------------------------------------------------------------------------------
+#   Main
+# ------------------------------------------------------------------------------
+
+if __name__ == "__main__":
+    if len(sys.argv) < 3:
+        sys.exit(__doc__)
+
+    with open(sys.argv[1], "r", encoding="utf8") as f:
+        dump = [line.strip() for line in f if line.strip()]
+
+    prof = parse_profile(dump)
+    print_report(
+        prof,
+        symbolize(prof, sys.argv[2]),
+        int(sys.argv[3]) if len(sys.argv) > 3 else 30,
+    )
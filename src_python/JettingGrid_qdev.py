@@ -7,13 +7,16 @@ Manages multi-threaded communication with the Jetting Grid Arduino
 __author__ = "Dennis van Gils"
 __authoremail__ = "vangils.dennis@gmail.com"
 __url__ = "https://github.com/Dennis-van-Gils/project-TWT-jetting-grid"
-__date__ = "13-04-2023"
+__date__ = "14-10-2026"
 __version__ = "1.0"
 
 import os
 import sys
+import threading
 from enum import IntEnum
 
+import numpy as np
+
 # Mechanism to support both PyQt and PySide
 # -----------------------------------------
 
@@ -64,7 +67,7 @@ elif QT_LIB == PYSIDE6:
 # \end[Mechanism to support both PyQt and PySide]
 # -----------------------------------------------
 
-from JettingGrid_Arduino import JettingGrid_Arduino
+from JettingGrid_Arduino import JettingGrid_Arduino, TELEMETRY_DTYPE
 from dvg_debug_functions import print_fancy_traceback as pft
 from dvg_qdeviceio import QDeviceIO
 
@@ -76,6 +79,77 @@ class GUI_objects(IntEnum):
     PROTO_INFO = 2
 
 
+# ------------------------------------------------------------------------------
+#   TelemetryRing
+# ------------------------------------------------------------------------------
+
+# A telemetry packet, see `TELEMETRY_DTYPE`, extended by its host time [s] on
+# the `time.perf_counter()` track and the number of packets missed right
+# before it
+TELEMETRY_RING_DTYPE = np.dtype(
+    TELEMETRY_DTYPE.descr + [("t", "<f8"), ("gap", "<u2")]
+)
+
+
+class TelemetryRing:
+    """Preallocated ring buffer recording the binary telemetry packets, such
+    that the DAQ can keep up with kHz telemetry rates. The packets get added in
+    bulk per DAQ update and each consumer, like the file logger, reads all
+    packets since its own last read. Thread-safe.
+    """
+
+    def __init__(self, capacity: int = 1 << 16):
+        self.capacity = capacity
+        self.buffer = np.zeros(capacity, dtype=TELEMETRY_RING_DTYPE)
+        self.N_written = 0  # Total number of packets ever added
+        self.N_dropped = 0  # Total number of packets missed, following `seq`
+        self._lock = threading.Lock()
+
+    def clear(self):
+        with self._lock:
+            self.N_written = 0
+            self.N_dropped = 0
+
+    def extend(self, packets: np.ndarray, gaps: np.ndarray, t_last: float):
+        """Add the `packets` received by a DAQ update, see `telemetry_samples`
+        and `telemetry_gaps` of `JettingGrid_Arduino`. Their host times follow
+        from their Arduino timestamps relative to the last packet, which is
+        taken to have arrived at host time `t_last` [s].
+        """
+        N = len(packets)
+        if N == 0:
+            return
+
+        # Elapsed Arduino time up to the last packet, wrapping around like
+        # `micros()`
+        time_us = packets["time_us"]
+        dt_us = (time_us[-1] - time_us).astype(np.uint32)
+
+        # Only the newest packets fit when exceeding the capacity
+        first = max(0, N - self.capacity)
+        with self._lock:
+            idx = np.arange(self.N_written + first, self.N_written + N)
+            idx %= self.capacity
+            for name in TELEMETRY_DTYPE.names:
+                self.buffer[name][idx] = packets[name][first:]
+            self.buffer["t"][idx] = t_last - dt_us[first:] / 1e6
+            self.buffer["gap"][idx] = gaps[first:]
+            self.N_written += N
+            self.N_dropped += int(gaps.sum())
+
+    def read(self, since: int):
+        """Read all packets added since the packet count `since`.
+        Returns: (packets, N_written) with `packets` a copy, oldest first, and
+        `N_written` to pass as `since` to the next read. Packets already
+        overwritten are lost, as detectable by a `since` lagging more than
+        `capacity` behind.
+        """
+        with self._lock:
+            since = max(since, self.N_written - self.capacity)
+            idx = np.arange(since, self.N_written) % self.capacity
+            return self.buffer[idx], self.N_written
+
+
 # ------------------------------------------------------------------------------
 #   JettingGrid_qdev
 # ------------------------------------------------------------------------------
@@ -83,6 +157,8 @@ class GUI_objects(IntEnum):
 
 class JettingGrid_qdev(QDeviceIO):
     signal_GUI_needs_update = Signal(int)
+    signal_upload_progress = Signal(int, int)  # (N_done, N_lines)
+    signal_upload_finished = Signal(bool)  # Success?
 
     def __init__(
         self,
@@ -103,6 +179,9 @@ class JettingGrid_qdev(QDeviceIO):
         )
         self.create_worker_jobs(jobs_function=self.jobs_function, debug=debug)
 
+        # Recording of the binary telemetry, to be fed by the `DAQ_function`
+        self.telemetry = TelemetryRing()
+
         # Interaction flags to communicate with the Xylem jetting pump that is
         # running inside of another thread
         self.waiting_for_pump_standstill_to_stop_protocol = False
@@ -198,3 +277,16 @@ class JettingGrid_qdev(QDeviceIO):
             "signal_GUI_needs_update", GUI_objects.PROTO_INFO
         )
         self.process_jobs_queue()
+
+    @Slot(int)
+    def send_subscribe_telemetry(self, period_ms: int):
+        """Have the Arduino push binary telemetry packets every `period_ms`,
+        allowing the DAQ to record faster than polling allows."""
+        self.add_to_jobs_queue(self.dev.subscribe_telemetry, period_ms)
+        self.process_jobs_queue()
+
+    @Slot()
+    def send_unsubscribe_telemetry(self):
+        """Stop the binary telemetry and return to polling."""
+        self.add_to_jobs_queue(self.dev.unsubscribe_telemetry)
+        self.process_jobs_queue()
@@ -0,0 +1,189 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""JettingGrid_trace.py
+
+Converts the binary trace of the Jetting Grid Arduino, see `Trace.h` of the
+firmware and `JettingGrid_Arduino.read_trace()`, into the Chrome trace event
+format. Open the resulting JSON file in https://ui.perfetto.dev or in
+chrome://tracing to see the line activations, I2C transactions, LED shows,
+DAQ ticks, command handling, USB transmissions and scheduled tasks on a
+single timeline. A missed deadline can then be traced back to what kept the
+main loop or the bus busy.
+
+Each kind of event gets a track of its own, the I2C transactions one per
+port, because the I2C lanes run in the background and overlap the spans of
+the main loop. The line activations turn into a span per line, lasting up to
+the next activation. A line that outlasted its programmed duration by more
+than `LATE_US` gets flagged as late.
+
+When run from the terminal, it records the trace of the connected Arduino for
+a number of seconds:
+
+    python JettingGrid_trace.py trace.json [duration_s]
+"""
+__author__ = "Dennis van Gils"
+__authoremail__ = "vangils.dennis@gmail.com"
+__url__ = "https://github.com/Dennis-van-Gils/project-TWT-jetting-grid"
+__date__ = "15-10-2026"
+__version__ = "1.0"
+
+import json
+import sys
+import time
+
+from JettingGrid_Arduino import JettingGrid_Arduino
+from JettingGrid_upload import decode_duration
+
+# Tolerance [µs] on the duration of a line before flagging it as late
+LATE_US = 100
+
+# Process ID of all tracks
+PID = 1
+
+# Interval [s] of draining the trace while recording, well within the ~1 s the
+# ring buffer of the firmware holds
+DRAIN_INTERVAL = 0.2
+
+
+def _command_name(tag: int) -> str:
+    """Decode the first 4 chars of a command, packed by the firmware."""
+    chars = tag.to_bytes(4, "little").rstrip(b"\x00")
+    name = chars.decode("ascii", errors="replace")
+    return name + "..." if len(chars) == 4 else name
+
+
+def to_chrome_events(records: list, task_names: list = None) -> list:
+    """Convert the trace `records`, see `JettingGrid_Arduino.read_trace()`,
+    into a list of Chrome trace events. The time stamps get unwrapped and
+    start at 0. `task_names` lists the names of the tasks in the order of
+    `tasks?` of the firmware, naming the spans of `task`.
+    """
+    events = []
+    tids = {}  # Track name: thread ID
+    depth = {}  # Thread ID: number of spans open
+    line = None  # (Time [µs], line no., encoded duration) of the last line
+
+    def tid_of(track: str) -> int:
+        if track not in tids:
+            tids[track] = len(tids) + 1
+            events.append(
+                {
+                    "name": "thread_name",
+                    "ph": "M",
+                    "pid": PID,
+                    "tid": tids[track],
+                    "args": {"name": track},
+                }
+            )
+        return tids[track]
+
+    def add_line(t_end: float):
+        t_start, line_no, duration = line
+        planned_us = decode_duration(duration) * 1000
+        event = {
+            "name": f"line {line_no}",
+            "ph": "X",
+            "ts": t_start,
+            "dur": t_end - t_start,
+            "pid": PID,
+            "tid": tid_of("lines"),
+            "args": {"line_no": line_no, "planned_us": planned_us},
+        }
+        if t_end - t_start > planned_us + LATE_US:
+            event["cname"] = "terrible"
+            event["args"]["late_us"] = t_end - t_start - planned_us
+        events.append(event)
+
+    t = 0
+    raw_prev = records[0][0] if records else 0
+    for time_us, name, in_isr, a, b, phase in records:
+        # Unwrap `micros()`. The difference is signed, because an interrupt
+        # can stamp its record before the one it preempted.
+        t += ((time_us - raw_prev + (1 << 31)) & 0xFFFFFFFF) - (1 << 31)
+        raw_prev = time_us
+
+        if name == "line_activated":
+            if line is not None:
+                add_line(t)
+            line = (t, a, b)
+            continue
+
+        track = f"I2C port {a}" if name == "I2C_write" else name
+        tid = tid_of(track)
+        event = {"name": name, "ph": phase, "ts": t, "pid": PID, "tid": tid}
+
+        if phase == "E":
+            if not depth.get(tid):
+                continue  # Its begin got overwritten in the ring buffer
+            depth[tid] -= 1
+            if name == "I2C_write":
+                event["args"] = {"failed": b}
+            events.append(event)
+            continue
+
+        if phase == "B":
+            depth[tid] = depth.get(tid, 0) + 1
+        else:
+            event["s"] = "t"
+
+        if name == "command":
+            event["name"] = _command_name(b)
+        elif name == "task" and task_names and a < len(task_names):
+            event["name"] = task_names[a]
+        elif name == "task":
+            event["name"] = f"task {a}"
+        else:
+            event["args"] = {"a": a, "b": b}
+        if in_isr:
+            event.setdefault("args", {})["in_isr"] = True
+        events.append(event)
+
+    if line is not None:
+        add_line(line[0] + decode_duration(line[2]) * 1000)
+
+    return events
+
+
+def save_chrome_trace(records: list, file_path: str, task_names: list = None):
+    """Convert the trace `records`, see `to_chrome_events()`, and save them as
+    a Chrome trace JSON file."""
+    with open(file_path, "w", encoding="utf8") as f:
+        json.dump(
+            {
+                "traceEvents": to_chrome_events(records, task_names),
+                "displayTimeUnit": "ms",
+            },
+            f,
+        )
+
+
+# ------------------------------------------------------------------------------
+#   Main
+# ------------------------------------------------------------------------------
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        sys.exit(__doc__)
+    duration_s = float(sys.argv[2]) if len(sys.argv) > 2 else 1.0
+
+    grid = JettingGrid_Arduino()
+    grid.auto_connect()
+
+    success, replies = grid.query_batch(["tasks?"])
+    names = [line.split("\t")[0] for line in replies[0]] if success else None
+
+    trace = []
+    grid.write("trace_on")
+    t_stop = time.perf_counter() + duration_s
+    while time.perf_counter() < t_stop:
+        time.sleep(DRAIN_INTERVAL)
+        trace.extend(grid.read_trace(max_dumps=16) or [])
+    grid.write("trace_off")
+    trace.extend(grid.read_trace() or [])
+
+    success, reply = grid.query("trace?")
+    if success and reply:
+        print(f"Records lost: {reply.split()[2]}")
+    save_chrome_trace(trace, sys.argv[1], names)
+    print(f"Saved {len(trace)} records to {sys.argv[1]}")
+    grid.close()
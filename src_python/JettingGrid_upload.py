@@ -2,7 +2,7 @@
 # -*- coding: utf-8 -*-
 """JettingGrid_upload.py
 
-Manages uploading a jetting protocol to the Arduino.
+Manages uploading, or streaming, a jetting protocol to the Arduino.
 
 TODO: Work-in-progress. This module works but errors still need to be handled
 gracefully.
@@ -10,13 +10,18 @@ gracefully.
 __author__ = "Dennis van Gils"
 __authoremail__ = "vangils.dennis@gmail.com"
 __url__ = "https://github.com/Dennis-van-Gils/project-TWT-jetting-grid"
-__date__ = "17-04-2023"
+__date__ = "15-10-2026"
 __version__ = "1.0"
 # pylint: disable=pointless-string-statement
 
+import mmap
 import sys
+import time
 import struct
+import threading
+import zlib
 from pathlib import Path
+from typing import Callable, Optional
 
 from JettingGrid_Arduino import JettingGrid_Arduino
 
@@ -27,6 +32,13 @@ from JettingGrid_Arduino import JettingGrid_Arduino
 # Constants
 PCS_X_MIN = -7
 PCS_Y_MIN = -7
+PCS_Y_MAX = 7
+NUMEL_PCS_AXIS = 15
+
+# Field of a protocol line marking it, to pulse the sync output of the Arduino
+# when switched to, see `sync_marked` of the firmware. It gets sent as bit
+# `NUMEL_PCS_AXIS` of PCS row 0, see `PCS_ROW_MARKER` of the firmware.
+LINE_MARKER_TOKEN = "M"
 
 
 class P:
@@ -39,23 +51,49 @@ class P:
 
 
 # ------------------------------------------------------------------------------
-#   upload_protocol()
+#   Line duration
 # -----------------------------------------------------------------------------
 
+# A line duration is encoded into 16 bits: A 2-bit unit in the upper bits and a
+# 14-bit mantissa, see `DURATION_UNIT_SHIFT` of the firmware. Unit 0 equals the
+# plain milliseconds of old.
+DURATION_UNIT_SHIFT = 14
+DURATION_MANTISSA_MASK = (1 << DURATION_UNIT_SHIFT) - 1
+DURATION_UNIT_US = (1000, 1, 10000, 100000)  # Tick size [µs] per unit
 
-def upload_protocol(
-    grid: JettingGrid_Arduino,
-    file_path: Path = Path("..\protocols\protocols\simplex_example.proto"),
-):
-    print("Uploading protocol")
-    print("------------------")
 
-    # Extract file folder and filename from full path
-    file_path = Path(file_path)
-    file_folder = file_path.resolve().parent
-    filename = file_path.name
+def encode_duration(duration_ms: float) -> int:
+    """Encode the line duration `duration_ms` [ms], using the finest unit that
+    can hold it, like `encode_duration_us()` of the firmware.
+    """
+    duration_us = round(duration_ms * 1000)
+    if duration_us % 1000 == 0 and duration_us // 1000 <= DURATION_MANTISSA_MASK:
+        return duration_us // 1000
+
+    for unit in (1, 0, 2, 3):
+        tick_us = DURATION_UNIT_US[unit]
+        mantissa = (duration_us + tick_us // 2) // tick_us
+        if mantissa <= DURATION_MANTISSA_MASK:
+            return unit << DURATION_UNIT_SHIFT | mantissa
 
-    # Read in protocol file from disk
+    raise ValueError(f"Line duration of {duration_ms} ms is too long")
+
+
+def decode_duration(duration: int) -> float:
+    """Decode the encoded line duration `duration` into [ms]."""
+    unit = duration >> DURATION_UNIT_SHIFT
+    return (duration & DURATION_MANTISSA_MASK) * DURATION_UNIT_US[unit] / 1000
+
+
+# ------------------------------------------------------------------------------
+#   Protocol file helpers
+# -----------------------------------------------------------------------------
+
+
+def read_protocol_lines(file_path: Path) -> list:
+    """Read in the protocol file from disk and return the lines of its [DATA]
+    section.
+    """
     with open(file=file_path, mode="r", encoding="utf8") as f:
         lines = [line.rstrip() for line in f]
 
@@ -70,12 +108,221 @@ def upload_protocol(
         print("No [DATA] section found")
         sys.exit()  # TODO: Do not hard exit, but gracefully notify user
 
-    lines = lines[data_line_idx:]
+    return lines[data_line_idx:]
+
+
+# Header bytes per `hdr` command, keeping within the ASCII command buffer of
+# the Arduino
+HEADER_CHUNK_LEN = 24
+
+
+def read_protocol_header(file_path: Path) -> str:
+    """Read in the protocol file from disk and return its [HEADER] section,
+    holding the parameters the protocol was generated with.
+    """
+    with open(file=file_path, mode="r", encoding="utf8") as f:
+        text = f.read()
+
+    head, _, _ = text.partition("[DATA]")
+    _, _, header = head.partition("[HEADER]")
+    return header.strip("\n")
+
+
+def send_protocol_header(grid: JettingGrid_Arduino, file_path: Path) -> bool:
+    """Send the zlib-compressed [HEADER] section of the protocol file to the
+    Arduino, to be stored alongside the protocol program of the next upload,
+    see `hdr` of the firmware. Read it back by `read_protocol_header()` of
+    `JettingGrid_Arduino`.
+    Returns: True when successful, False otherwise.
+    """
+    blob = zlib.compress(read_protocol_header(file_path).encode("utf8"), 9)
+
+    grid.set_write_termination("\n")
+    if not grid.write("hdr_clear"):
+        return False
+
+    for idx in range(0, len(blob), HEADER_CHUNK_LEN):
+        chunk = blob[idx : idx + HEADER_CHUNK_LEN]
+        success, ans = grid.query(f"hdr {chunk.hex()}")
+        if not success:
+            return False
+        if ans[:5] == "ERROR":
+            print(f"Protocol header not stored: {ans}")
+            grid.write("hdr_clear")
+            return False
+
+    return True
+
+
+def line_to_raw(line: str) -> bytearray:
+    """Convert a protocol line as read from file into the raw byte stream to be
+    send to the Arduino, excluding the EOL sentinel. This format can't carry
+    the line marker, see `LINE_MARKER_TOKEN`, which gets ignored.
+    """
+    fields = line.split("\t")
+    duration = encode_duration(float(fields[0]))
+
+    raw = bytearray(struct.pack(">H", duration))  # Encoded time duration
+    str_points = fields[1:]
+    for str_point in str_points:
+        if str_point == LINE_MARKER_TOKEN:
+            continue
+        str_x, str_y = str_point.split(",")
+        raw.append(P(int(str_x), int(str_y)).pack_into_byte())
+
+    return raw
+
+
+def line_to_pcs_rows(line: str) -> bytes:
+    """Convert a protocol line as read from file into the 32-byte format of the
+    bulk upload: The time duration followed by the PCS row bitmasks, where bit
+    `x - PCS_X_MIN` of row `PCS_Y_MAX - y` opens the valve at PCS point (x, y).
+    Bit `NUMEL_PCS_AXIS` of row 0 marks the line, see `LINE_MARKER_TOKEN`.
+    """
+    fields = line.split("\t")
+    duration = encode_duration(float(fields[0]))
+
+    rows = [0] * NUMEL_PCS_AXIS
+    for str_point in fields[1:]:
+        if str_point == LINE_MARKER_TOKEN:
+            rows[0] |= 1 << NUMEL_PCS_AXIS
+            continue
+        str_x, str_y = str_point.split(",")
+        rows[PCS_Y_MAX - int(str_y)] |= 1 << (int(str_x) - PCS_X_MIN)
+
+    return struct.pack(f"<H{NUMEL_PCS_AXIS}H", duration, *rows)
+
+
+# ------------------------------------------------------------------------------
+#   Protocol cache
+# -----------------------------------------------------------------------------
+
+# Each protocol file gets a companion cache file next to it, holding its lines
+# as parsed by `line_to_pcs_rows()`, such that a protocol gets parsed only once.
+# It is validated against the CRC32 and size of the protocol file and gets
+# rewritten whenever stale. Layout: `PROTO_CACHE_HEADER` followed by N_lines
+# lines of `PROTO_ROW_LEN` bytes each.
+PROTO_CACHE_SUFFIX = ".rows"
+PROTO_CACHE_MAGIC = b"JGPR"
+PROTO_CACHE_VERSION = 1
+# magic, version, line length, N_lines, CRC32 and size of the protocol file
+PROTO_CACHE_HEADER = struct.Struct("<4sHHIIQ")
+PROTO_ROW_LEN = 2 + 2 * NUMEL_PCS_AXIS
+
+
+def proto_cache_path(file_path: Path) -> Path:
+    """Return the path of the cache file of protocol file `file_path`."""
+    file_path = Path(file_path)
+    return file_path.with_name(file_path.name + PROTO_CACHE_SUFFIX)
+
+
+def map_protocol_cache(file_path: Path, crc: int, N_bytes: int):
+    """Memory-map the cache file of protocol file `file_path`, whose contents
+    have CRC32 `crc` and size `N_bytes`.
+    Returns: List of the lines as read-only views into the mapping, or None
+    when the cache file is missing or stale.
+    """
+    try:
+        with open(proto_cache_path(file_path), "rb") as f:
+            mm = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+    except (OSError, ValueError):
+        return None  # Missing or empty
+
+    if len(mm) < PROTO_CACHE_HEADER.size:
+        return None
+
+    magic, version, row_len, N_lines, cache_crc, cache_N_bytes = (
+        PROTO_CACHE_HEADER.unpack_from(mm)
+    )
+    if (
+        magic != PROTO_CACHE_MAGIC
+        or version != PROTO_CACHE_VERSION
+        or row_len != PROTO_ROW_LEN
+        or (cache_crc, cache_N_bytes) != (crc, N_bytes)
+        or len(mm) != PROTO_CACHE_HEADER.size + N_lines * PROTO_ROW_LEN
+    ):
+        return None
+
+    view = memoryview(mm)[PROTO_CACHE_HEADER.size :]
+    return [
+        view[idx : idx + PROTO_ROW_LEN]
+        for idx in range(0, N_lines * PROTO_ROW_LEN, PROTO_ROW_LEN)
+    ]
+
+
+def read_protocol_rows(file_path: Path) -> list:
+    """Return the lines of the protocol file in the format of
+    `line_to_pcs_rows()`. They get taken from the cache file next to it when
+    valid, see `proto_cache_path()`. Otherwise, the protocol file gets parsed
+    and the cache file (re)written.
+    """
+    source = Path(file_path).read_bytes()
+    crc = zlib.crc32(source)
+
+    raw_lines = map_protocol_cache(file_path, crc, len(source))
+    if raw_lines is not None:
+        return raw_lines
+
+    lines = read_protocol_lines(file_path)
+    raw_lines = [line_to_pcs_rows(line) for line in lines]
+    header = PROTO_CACHE_HEADER.pack(
+        PROTO_CACHE_MAGIC,
+        PROTO_CACHE_VERSION,
+        PROTO_ROW_LEN,
+        len(raw_lines),
+        crc,
+        len(source),
+    )
+    try:
+        proto_cache_path(file_path).write_bytes(header + b"".join(raw_lines))
+    except OSError as err:
+        # Not fatal, e.g. a read-only folder: Parse again next time
+        print(f"Could not write the protocol cache: {err}")
+
+    return raw_lines
+
+
+def format_progress(ans: str) -> str:
+    """Format the progress report as send by the Arduino during an upload:
+    "progress", N_lines, N_bytes, lines/s, bytes/s, tab delimited.
+    """
+    fields = ans.split("\t")
+    return f"{fields[3]} lines/s, {int(fields[4]) / 1e3:.1f} kB/s"
+
+
+def read_past_progress(grid: JettingGrid_Arduino):
+    """Read the next reply of the Arduino that is not a progress report."""
+    while True:
+        success, ans = grid.readline()
+        if not success or ans[:8] != "progress":
+            return success, ans
+
+
+# ------------------------------------------------------------------------------
+#   upload_protocol()
+# -----------------------------------------------------------------------------
+
+
+def upload_protocol(
+    grid: JettingGrid_Arduino,
+    file_path: Path = Path("..\protocols\protocols\simplex_example.proto"),
+    as_rows: bool = False,
+):
+    """Upload the protocol program line-by-line. When `as_rows` is True, each
+    line is send as PCS row bitmasks which the Arduino can pack directly, see
+    `line_to_pcs_rows()`. Otherwise, as a list of byte-encoded PCS points.
+    """
+    print("Uploading protocol")
+    print("------------------")
+
+    filename = Path(file_path).name
+    lines = read_protocol_lines(file_path)
     N_lines = len(lines)
+    send_protocol_header(grid, file_path)
 
     # Enter the upload state
     grid.set_write_termination("\n")
-    if not grid.write("upload"):
+    if not grid.write("upload_rows" if as_rows else "upload"):
         # TODO: Show message box referring to error in terminal
         return
 
@@ -108,25 +355,14 @@ def upload_protocol(
 
     for idx_line, line in enumerate(lines):
         print(f"\rLine {idx_line + 1} of {N_lines}", end="")
-        fields = line.split("\t")
-        duration = int(fields[0])
-
-        # Build raw byte stream
-        raw = bytearray(struct.pack(">H", duration))  # Time duration [ms]
-        str_points = fields[1:]
-        for str_point in str_points:
-            str_x, str_y = str_point.split(",")
-            raw.append(P(int(str_x), int(str_y)).pack_into_byte())
-
-        # Send out raw byte stream
-        grid.write(raw)
+        grid.write(line_to_pcs_rows(line) if as_rows else line_to_raw(line))
 
     # Send EOP sentinel
     grid.write(b"")
     print("")
 
-    # Check for success
-    success, ans = grid.readline()
+    # Check for success, skipping any progress reports
+    success, ans = read_past_progress(grid)
     if not success:
         # TODO: Show message box referring to error in terminal
         grid.set_write_termination("\n")
@@ -147,6 +383,806 @@ def upload_protocol(
     grid.set_write_termination("\n")
 
 
+# ------------------------------------------------------------------------------
+#   upload_protocol_bulk()
+# -----------------------------------------------------------------------------
+
+# Bulk upload framing, see `upload_bulk__upd()` in the Arduino firmware
+BULK_MARKER = 0xA5
+BULK_COPY_MARKER = 0x5A  # Copy chunk of the patch upload
+BULK_MAX_LINES = 32  # Lines per chunk
+BULK_MAX_COPY_LINES = 512  # Lines per copy chunk
+BULK_WINDOW = 8  # Chunks allowed underway before having to wait for an ACK
+BULK_ACK_TIMEOUT = 1.0  # [s] Resend the window when no ACK arrives in time
+BULK_MAX_RETRIES = 10  # Give up after this many consecutive time-outs
+
+
+def bulk_frame(idx_frame: int, chunk: list) -> bytes:
+    """Frame the chunk of lines `chunk`, each in the format of
+    `line_to_pcs_rows()`, as bulk upload chunk number `idx_frame`. An empty
+    chunk signals the end-of-program (EOP).
+    """
+    body = struct.pack("<BB", idx_frame & 0xFF, len(chunk)) + b"".join(chunk)
+    return bytes((BULK_MARKER,)) + body + struct.pack("<I", zlib.crc32(body))
+
+
+def copy_frame(idx_frame: int, first: int, N: int) -> bytes:
+    """Frame a copy chunk of the patch upload as chunk number `idx_frame`,
+    copying `N` lines starting at line `first` of the protocol program loaded
+    in the Arduino.
+    """
+    body = struct.pack("<BHH", idx_frame & 0xFF, first, N)
+    return (
+        bytes((BULK_COPY_MARKER,)) + body + struct.pack("<I", zlib.crc32(body))
+    )
+
+
+def enter_bulk_upload(
+    grid: JettingGrid_Arduino, command: str, filename: str, N_lines: int
+) -> bool:
+    """Enter the upload state by `command` and pass stages 0 and 1 of the
+    upload, see `upload_protocol()`.
+    Returns: True when the Arduino awaits the chunks, False otherwise.
+    """
+    grid.set_write_termination("\n")
+    if not grid.write(command):
+        # TODO: Show message box referring to error in terminal
+        return False
+
+    # Stage 0: Send via ASCII the name of the protocol program.
+    # --------------------------------------------------------------------------
+    success, ans = grid.query(filename)
+    if not success:
+        # TODO: Show message box referring to error in terminal
+        return False
+
+    print(ans)
+
+    # Stage 1: Send via ASCII the total number of protocol lines that follow.
+    # --------------------------------------------------------------------------
+    success, ans = grid.query(f"{N_lines}")
+    if not success:
+        # TODO: Show message box referring to error in terminal
+        return False
+
+    if ans[:5] == "ERROR":
+        # TODO: Show error message box
+        print(ans)
+        return False
+
+    return True
+
+
+def resume_bulk_upload(
+    grid: JettingGrid_Arduino, frames: list, frame_ends: list
+):
+    """Resume the chunked upload of `frames` that timed out, see
+    `upload_resume` of the firmware. The Arduino tells how far it got, which
+    gets checked against `frames` and `frame_ends`, see `send_bulk_frames()`.
+    Returns: The index of the frame to continue with, or None when failed.
+    """
+    grid.set_write_termination("\n")
+    success, ans = grid.query("upload_resume")
+    if not success:
+        # TODO: Show message box referring to error in terminal
+        return None
+
+    if ans[:6] != "resume":
+        # TODO: Show error message box
+        print(ans)
+        return None
+
+    _, seq, N_received, crc = ans.split("\t")
+    seq, N_received, crc = int(seq), int(N_received), int(crc, 16)
+
+    # Find the frame at which the Arduino stands, chaining the CRCs of the
+    # frames before it like `bulk_crc` of the firmware
+    crc_frames = 0
+    for idx_frame, frame in enumerate(frames):
+        N_done = frame_ends[idx_frame - 1] if idx_frame else 0
+        if (idx_frame & 0xFF, N_done, crc_frames) == (seq, N_received, crc):
+            print(f"Resuming at line {N_done}")
+            return idx_frame
+        crc_frames = zlib.crc32(frame[-4:], crc_frames)
+
+    # The Arduino times out on its own, keeping the upload resumable
+    print("ERROR: The interrupted upload is of another protocol program.")
+    return None
+
+
+def send_bulk_frames(
+    grid: JettingGrid_Arduino,
+    command: str,
+    filename: str,
+    frames: list,
+    frame_ends: list,
+    resume: bool = False,
+    progress: Optional[Callable[[int, int], None]] = None,
+) -> bool:
+    """Enter the upload state by `command` and send the protocol program as
+    the chunks `frames`, see `upload_protocol_bulk()`. Element `i` of
+    `frame_ends` tells the number of lines uploaded once frame `i` has been
+    acknowledged. When `resume` is True, the same upload that timed out gets
+    continued instead, see `resume_bulk_upload()`.
+
+    Up to `BULK_WINDOW` chunks are underway at any time, such that the upload
+    is limited by the USB throughput instead of by the round trips. Callback
+    `progress(N_done, N_lines)` gets called each time a chunk is acknowledged.
+    Returns: True when the Arduino accepted the protocol program, False
+    otherwise.
+    """
+    N_lines = frame_ends[-1]
+
+    # Oldest frame not yet acknowledged
+    if resume:
+        idx_base = resume_bulk_upload(grid, frames, frame_ends)
+        if idx_base is None:
+            return False
+    else:
+        if not enter_bulk_upload(grid, command, filename, N_lines):
+            return False
+        idx_base = 0
+
+    # Stage 2: Send via binary the protocol program in chunks. An empty chunk
+    # signals the end-of-program (EOP).
+    # --------------------------------------------------------------------------
+    idx_next = idx_base  # Next frame to be send
+    N_retries = 0
+    t_ack = time.perf_counter()  # Time of the last ACK
+    str_progress = ""
+    while idx_base < len(frames):
+        while idx_next < min(idx_base + BULK_WINDOW, len(frames)):
+            grid.write_bulk(frames[idx_next])
+            idx_next += 1
+
+        success, ans = grid.readline()
+        if not success or (time.perf_counter() - t_ack > BULK_ACK_TIMEOUT):
+            # Time-out: Resend all frames that are underway
+            N_retries += 1
+            if N_retries > BULK_MAX_RETRIES:
+                print("\nERROR: Bulk upload timed out.")
+                return False
+            idx_next = idx_base
+            t_ack = time.perf_counter()
+            if not success:
+                continue
+
+        if ans[:8] == "progress":
+            str_progress = format_progress(ans)
+        elif ans[:3] == "ACK":
+            idx_frame = idx_base + ((int(ans[4:]) - idx_base) & 0xFF)
+            if idx_frame < idx_next:
+                idx_base = idx_frame + 1
+                N_retries = 0
+                t_ack = time.perf_counter()
+        elif ans[:4] == "NACK":
+            idx_frame = idx_base + ((int(ans[5:]) - idx_base) & 0xFF)
+            if idx_frame < idx_next:
+                idx_next = idx_frame
+        else:
+            # Error, or execution halted
+            print(f"\n{ans}")
+            if ans[:16] == "EXECUTION HALTED":
+                # This error has two lines to be read over serial
+                _, ans = grid.readline()
+                print(ans)
+            return False
+
+        N_done = frame_ends[idx_base - 1] if idx_base else 0
+        print(f"\rLine {N_done} of {N_lines}  {str_progress}", end="")
+        if progress is not None:
+            progress(N_done, N_lines)
+
+    print("")
+
+    # Check for success, skipping any progress reports
+    success, ans = read_past_progress(grid)
+    if not success:
+        # TODO: Show message box referring to error in terminal
+        return False
+
+    print(ans)
+    return ans[:5] != "ERROR" and ans[:16] != "EXECUTION HALTED"
+
+
+def upload_protocol_bulk(
+    grid: JettingGrid_Arduino,
+    file_path: Path = Path("..\protocols\protocols\simplex_example.proto"),
+    resume: bool = False,
+    progress: Optional[Callable[[int, int], None]] = None,
+) -> bool:
+    """Same as `upload_protocol()`, but much faster: The protocol program is
+    send in chunks of many lines, each guarded by a CRC32. The Arduino replies
+    to each chunk by "ACK <seq>" when accepted, or by "NACK <seq>" requesting
+    to resend all chunks starting from sequence number <seq>.
+
+    When the upload times out, e.g. because the USB connection dropped, call
+    again with `resume` set to True to continue where it stopped. See
+    `send_bulk_frames()` for `progress` and the return value.
+    """
+    print("Uploading protocol in bulk")
+    print("--------------------------")
+
+    raw_lines = read_protocol_rows(file_path)
+    N_lines = len(raw_lines)
+
+    frames = []
+    frame_ends = []
+    for idx_line in list(range(0, N_lines, BULK_MAX_LINES)) + [N_lines]:
+        chunk = raw_lines[idx_line : idx_line + BULK_MAX_LINES]
+        frames.append(bulk_frame(len(frames), chunk))
+        frame_ends.append(idx_line + len(chunk))
+
+    if not resume:
+        send_protocol_header(grid, file_path)
+
+    return send_bulk_frames(
+        grid,
+        "upload_bulk",
+        Path(file_path).name,
+        frames,
+        frame_ends,
+        resume,
+        progress,
+    )
+
+
+# ------------------------------------------------------------------------------
+#   upload_protocol_delta()
+# -----------------------------------------------------------------------------
+
+# Delta upload framing, see `DeltaDecoder.h` in the Arduino firmware
+BULK_MAX_DELTA_BYTES = BULK_MAX_LINES * 32 - 2  # Bytes of lines per chunk
+BULK_MAX_DELTA_LINES = 255  # Lines per chunk
+
+# The decoder starts from all valves closed and a duration of 0
+DELTA_INITIAL_LINE = bytes(2 + 2 * NUMEL_PCS_AXIS)
+
+
+def encode_varint(value: int) -> bytes:
+    """Encode `value` as unsigned LEB128 varint."""
+    out = bytearray()
+    while value >= 0x80:
+        out.append(value & 0x7F | 0x80)
+        value >>= 7
+    out.append(value)
+    return bytes(out)
+
+
+def line_to_delta(raw_line: bytes, prev_raw_line: bytes) -> bytes:
+    """Encode the protocol line `raw_line` as delta against its previous line
+    `prev_raw_line`, both in the format of `line_to_pcs_rows()`. See
+    `DeltaDecoder.h` of the firmware.
+    """
+    fmt = f"<H{NUMEL_PCS_AXIS}H"
+    duration, *rows = struct.unpack(fmt, raw_line)
+    prev_duration, *prev_rows = struct.unpack(fmt, prev_raw_line)
+
+    positions = []
+    for idx_row, (row, prev_row) in enumerate(zip(rows, prev_rows)):
+        toggled = row ^ prev_row
+        for col in range(NUMEL_PCS_AXIS):
+            if toggled >> col & 1:
+                positions.append(idx_row * NUMEL_PCS_AXIS + col)
+
+    # The line marker takes the one position past the PCS
+    if (rows[0] ^ prev_rows[0]) >> NUMEL_PCS_AXIS & 1:
+        positions.append(NUMEL_PCS_AXIS * NUMEL_PCS_AXIS)
+
+    changed = duration != prev_duration
+    delta = encode_varint(len(positions) << 1 | changed)
+    if changed:
+        delta += encode_varint(duration)
+
+    pos = 0
+    for position in positions:
+        delta += encode_varint(position - pos)
+        pos = position + 1
+
+    return delta
+
+
+def delta_frame(idx_frame: int, deltas: list) -> bytes:
+    """Frame the chunk of lines `deltas`, each encoded by `line_to_delta()`, as
+    delta upload chunk number `idx_frame`. An empty chunk signals the
+    end-of-program (EOP).
+    """
+    payload = b"".join(deltas)
+    body = struct.pack("<BBH", idx_frame & 0xFF, len(deltas), len(payload))
+    body += payload
+    return bytes((BULK_MARKER,)) + body + struct.pack("<I", zlib.crc32(body))
+
+
+def upload_protocol_delta(
+    grid: JettingGrid_Arduino,
+    file_path: Path = Path("..\protocols\protocols\simplex_example.proto"),
+    resume: bool = False,
+    progress: Optional[Callable[[int, int], None]] = None,
+) -> bool:
+    """Same as `upload_protocol_bulk()`, but each line is send as delta against
+    its previous line: Only the toggled valves, and the duration when it
+    changed. Best suited for temporally smooth protocols.
+    """
+    print("Uploading protocol as deltas")
+    print("----------------------------")
+
+    raw_lines = read_protocol_rows(file_path)
+    N_lines = len(raw_lines)
+
+    frames = []
+    frame_ends = []
+    deltas = []
+    N_bytes = 0  # Bytes of `deltas`
+    N_bytes_total = 0
+    prev_raw_line = DELTA_INITIAL_LINE
+    for idx_line, raw_line in enumerate(raw_lines):
+        delta = line_to_delta(raw_line, prev_raw_line)
+        prev_raw_line = raw_line
+        if (N_bytes + len(delta) > BULK_MAX_DELTA_BYTES) or (
+            len(deltas) == BULK_MAX_DELTA_LINES
+        ):
+            frames.append(delta_frame(len(frames), deltas))
+            frame_ends.append(idx_line)
+            deltas = []
+            N_bytes = 0
+        deltas.append(delta)
+        N_bytes += len(delta)
+        N_bytes_total += len(delta)
+
+    if deltas:
+        frames.append(delta_frame(len(frames), deltas))
+        frame_ends.append(N_lines)
+    frames.append(delta_frame(len(frames), []))  # EOP
+    frame_ends.append(N_lines)
+    N_bytes_bulk = N_lines * len(DELTA_INITIAL_LINE)
+    if N_bytes_total >= N_bytes_bulk:
+        print("Deltas do not pay off for this protocol")
+        return upload_protocol_bulk(grid, file_path, resume, progress)
+
+    print(f"Sending {N_bytes_total} bytes instead of {N_bytes_bulk}")
+
+    if not resume:
+        send_protocol_header(grid, file_path)
+
+    return send_bulk_frames(
+        grid,
+        "upload_delta",
+        Path(file_path).name,
+        frames,
+        frame_ends,
+        resume,
+        progress,
+    )
+
+
+# ------------------------------------------------------------------------------
+#   upload_protocol_patch()
+# -----------------------------------------------------------------------------
+
+# Number of lines per hash when comparing against the Arduino, see `proto_hash`
+PATCH_BLOCK_LEN = 32
+
+
+def upload_protocol_patch(
+    grid: JettingGrid_Arduino,
+    file_path: Path = Path("..\protocols\protocols\simplex_example.proto"),
+    block_len: int = PATCH_BLOCK_LEN,
+    resume: bool = False,
+    progress: Optional[Callable[[int, int], None]] = None,
+) -> bool:
+    """Same as `upload_protocol_bulk()`, but only the blocks of `block_len`
+    lines that differ from the protocol program loaded in the Arduino get send.
+    The others get copied over from the loaded program by the Arduino itself.
+    Falls back to `upload_protocol_bulk()` when the Arduino can not patch,
+    because it lacks a staging slot.
+    """
+    raw_lines = read_protocol_rows(file_path)
+    N_lines = len(raw_lines)
+
+    ans = grid.read_protocol_hashes(block_len)
+    if ans is None:
+        # TODO: Show message box referring to error in terminal
+        return False
+
+    N_lines_loaded, patchable, hashes = ans
+    if not patchable:
+        return upload_protocol_bulk(grid, file_path, resume, progress)
+
+    print("Uploading protocol as patch")
+    print("---------------------------")
+
+    # Build the chunks block by block, copying the unchanged blocks
+    frames = []
+    frame_ends = []
+    N_copied = 0
+    copy_first = None  # First line of the run of unchanged blocks
+    for idx_block, idx_line in enumerate(range(0, N_lines, block_len)):
+        block = raw_lines[idx_line : idx_line + block_len]
+        unchanged = (
+            idx_block < len(hashes)
+            and idx_line + len(block) <= N_lines_loaded
+            and zlib.crc32(b"".join(block)) == hashes[idx_block]
+        )
+        if unchanged and copy_first is None:
+            copy_first = idx_line
+        if unchanged:
+            continue
+
+        if copy_first is not None:
+            for first in range(copy_first, idx_line, BULK_MAX_COPY_LINES):
+                N = min(BULK_MAX_COPY_LINES, idx_line - first)
+                frames.append(copy_frame(len(frames), first, N))
+                frame_ends.append(first + N)
+                N_copied += N
+            copy_first = None
+
+        for first in range(0, len(block), BULK_MAX_LINES):
+            chunk = block[first : first + BULK_MAX_LINES]
+            frames.append(bulk_frame(len(frames), chunk))
+            frame_ends.append(idx_line + first + len(chunk))
+
+    if copy_first is not None:
+        for first in range(copy_first, N_lines, BULK_MAX_COPY_LINES):
+            N = min(BULK_MAX_COPY_LINES, N_lines - first)
+            frames.append(copy_frame(len(frames), first, N))
+            frame_ends.append(first + N)
+            N_copied += N
+
+    frames.append(bulk_frame(len(frames), []))  # EOP
+    frame_ends.append(N_lines)
+    print(f"Sending {N_lines - N_copied} of {N_lines} lines")
+
+    if not resume:
+        send_protocol_header(grid, file_path)
+
+    return send_bulk_frames(
+        grid,
+        "upload_patch",
+        Path(file_path).name,
+        frames,
+        frame_ends,
+        resume,
+        progress,
+    )
+
+
+# ------------------------------------------------------------------------------
+#   select_loaded_protocol()
+# -----------------------------------------------------------------------------
+
+
+def select_loaded_protocol(grid: JettingGrid_Arduino, file_path: Path) -> bool:
+    """Check whether the Arduino already holds the protocol file, by comparing
+    the CRC32 over its lines as sent in a bulk upload against `proto_crc?` of
+    the firmware. Otherwise, load the program with the same CRC32 from the
+    protocol library of the Arduino, if stored, see `load_crc` of the firmware.
+    Returns: True when the protocol is in memory now, such that the upload can
+    be skipped. False otherwise.
+    """
+    raw_lines = read_protocol_rows(file_path)
+    crc = zlib.crc32(b"".join(raw_lines))
+
+    ans = grid.read_protocol_crc()
+    if ans is not None:
+        crc_loaded, N_lines, known, _, _ = ans
+        if known and (crc_loaded, N_lines) == (crc, len(raw_lines)):
+            print("Protocol already loaded, skipping the upload\n")
+            return True
+
+    success, ans = grid.query(f"load_crc {crc:08x}")
+    if success and isinstance(ans, str) and not ans.startswith("ERROR"):
+        print(f"Protocol loaded from the library: {ans}\n")
+        return True
+    return False
+
+
+# ------------------------------------------------------------------------------
+#   UploadWorker
+# -----------------------------------------------------------------------------
+
+
+class UploadWorker(threading.Thread):
+    """Uploads a protocol file in a background thread, such that the caller,
+    e.g. the GUI thread, never blocks on the serial port. The upload itself is
+    paced by the window of unacknowledged chunks of `send_bulk_frames()`.
+
+    Callback `on_progress(N_done, N_lines)` gets called on each acknowledged
+    chunk and `on_finished(success)` once at the end. Both are called from
+    within the background thread, hence a GUI should relay them by a Qt signal.
+
+    Args:
+        grid: The Arduino, not to be used by anyone else until finished.
+        file_path: The protocol file.
+        upload_function: Any of `upload_protocol_bulk()`,
+            `upload_protocol_delta()` or `upload_protocol_patch()`.
+        prepare: Optional function called first within the background thread,
+            e.g. to silence the DAQ. Returning False aborts the upload.
+        skip_loaded: Skip the upload when the Arduino holds the protocol
+            already, or in its library, see `select_loaded_protocol()`.
+    """
+
+    def __init__(
+        self,
+        grid: JettingGrid_Arduino,
+        file_path: Path,
+        upload_function: Callable = upload_protocol_bulk,
+        on_progress: Optional[Callable[[int, int], None]] = None,
+        on_finished: Optional[Callable[[bool], None]] = None,
+        prepare: Optional[Callable[[], bool]] = None,
+        skip_loaded: bool = True,
+    ):
+        super().__init__(name="UploadWorker", daemon=True)
+        self.grid = grid
+        self.file_path = file_path
+        self.upload_function = upload_function
+        self.on_progress = on_progress
+        self.on_finished = on_finished
+        self.prepare = prepare
+        self.skip_loaded = skip_loaded
+        self.success = False
+
+    def run(self):
+        try:
+            if self.prepare is None or self.prepare():
+                if self.skip_loaded and select_loaded_protocol(
+                    self.grid, self.file_path
+                ):
+                    self.success = True
+                else:
+                    self.success = bool(
+                        self.upload_function(
+                            self.grid,
+                            self.file_path,
+                            progress=self.on_progress,
+                        )
+                    )
+        except Exception as err:  # pylint: disable=broad-except
+            print(f"\nERROR: Upload failed: {err}")
+            self.success = False
+        finally:
+            self.grid.set_write_termination("\n")
+            if self.on_finished is not None:
+                self.on_finished(self.success)
+
+
+# ------------------------------------------------------------------------------
+#   stream_protocol()
+# -----------------------------------------------------------------------------
+
+STREAM_BUFFER_LINES = 512  # See `ProtocolManager.h` of the Arduino firmware
+STREAM_DRAIN_MARGIN = 5.0  # [s] Slack on top of playing out the stream buffer
+
+
+def stream_protocol(
+    grid: JettingGrid_Arduino,
+    file_path: Path = Path("..\protocols\protocols\simplex_example.proto"),
+):
+    """Play a protocol directly from file by streaming it line-by-line to the
+    Arduino while it is playing. This allows for protocols that are too large to
+    fit inside the memory of the Arduino. The protocol program already in memory
+    is left intact.
+
+    The Arduino grants the number of lines that we may send by replying
+    "credit <N>", keeping its stream buffer filled without overflowing it.
+    """
+    print("Streaming protocol")
+    print("------------------")
+
+    filename = Path(file_path).name
+    lines = read_protocol_lines(file_path)
+    N_lines = len(lines)
+
+    # Enter the streaming state
+    grid.set_write_termination("\n")
+    if not grid.write("stream"):
+        # TODO: Show message box referring to error in terminal
+        return
+
+    # Stage 0: Send via ASCII the name of the protocol.
+    # --------------------------------------------------------------------------
+    success, ans = grid.query(filename)
+    if not success:
+        # TODO: Show message box referring to error in terminal
+        return
+
+    print(ans)
+
+    # Stage 1: Send via binary the protocol line-by-line, as long as we have
+    # credit. Sending just the EOL sentinel signals the end-of-stream.
+    # --------------------------------------------------------------------------
+    grid.set_write_termination(bytes((0xFF, 0xFF, 0xFF)))  # EOL sentinel
+    credit = 0
+
+    for idx_line, line in enumerate(lines):
+        while credit == 0:
+            success, ans = grid.readline()
+            if not success:
+                # TODO: Show message box referring to error in terminal
+                grid.set_write_termination("\n")
+                return
+
+            if ans[:6] == "credit":
+                credit += int(ans[7:])
+            elif ans[:8] == "underrun":
+                print(f"\nWARNING: Stream buffer ran dry ({ans[9:]}x)")
+            else:
+                # Error, or execution halted
+                print(f"\n{ans}")
+                grid.set_write_termination("\n")
+                return
+
+        print(f"\rLine {idx_line + 1} of {N_lines}", end="")
+        grid.write(line_to_raw(line))
+        credit -= 1
+
+    # Send end-of-stream sentinel
+    grid.write(b"")
+    print("")
+
+    # Wait for the stream to be played out. Playing out the remaining buffer
+    # can take longer than the serial time-out, hence keep waiting up to the
+    # duration of the lines that can still be buffered.
+    drain_s = sum(
+        decode_duration(encode_duration(float(line.split("\t")[0])))
+        for line in lines[-STREAM_BUFFER_LINES:]
+    ) / 1000
+    t_deadline = time.perf_counter() + drain_s + STREAM_DRAIN_MARGIN
+    while True:
+        success, ans = grid.readline()
+        if not success:
+            if time.perf_counter() > t_deadline:
+                print("ERROR: Timed out waiting for the end of the stream.")
+                break
+            continue
+
+        if ans[:6] == "credit":
+            continue
+        if ans[:8] == "underrun":
+            print(f"WARNING: Stream buffer ran dry ({ans[9:]}x)")
+            continue
+        if ans[:16] == "EXECUTION HALTED":
+            # This error has two lines to be read over serial
+            print(ans)
+            _, ans = grid.readline()
+
+        print(ans)
+        break
+
+    # Restore ASCII communication
+    grid.set_write_termination("\n")
+
+
+# ------------------------------------------------------------------------------
+#   ProtocolScript
+# ------------------------------------------------------------------------------
+
+# Opcodes, see `ProtocolScript.h` of the Arduino firmware
+SCRIPT_END = 0
+SCRIPT_LINE = 1
+SCRIPT_WAIT = 2
+SCRIPT_REPEAT = 3
+SCRIPT_NEXT = 4
+SCRIPT_CALL = 5
+SCRIPT_RET = 6
+SCRIPT_SPEED = 7
+
+
+class ProtocolScript:
+    """Assembler of a protocol script, to be played by the Arduino with loops
+    and subroutines instead of storing each line. Each method appends an
+    instruction and returns `self`, allowing for chaining. CALLs may refer to
+    labels defined later on.
+
+    Example:
+        script = ProtocolScript()
+        script.repeat(100).call("pattern").speed(200).call("pattern").next()
+        script.end()
+        script.label("pattern").line(500, [(0, 1), (2, 3)]).wait(200).ret()
+        code = script.assemble()
+    """
+
+    def __init__(self):
+        self._code = bytearray()
+        self._labels = {}
+        self._calls = []  # (Address of the operand, label)
+
+    def line(self, duration: float, points: list):
+        """Open the valves at the PCS `points`, given as (x, y) tuples, for
+        `duration` [ms]."""
+        self._code += struct.pack(
+            "<BHB", SCRIPT_LINE, encode_duration(duration), len(points)
+        )
+        self._code += bytes(P(x, y).pack_into_byte() for x, y in points)
+        return self
+
+    def wait(self, duration: float):
+        """Keep the valves of the last line for `duration` [ms]."""
+        self._code += struct.pack("<BH", SCRIPT_WAIT, encode_duration(duration))
+        return self
+
+    def repeat(self, count: int = 0):
+        """Start a block that gets played `count` times, 0 meaning forever."""
+        self._code += struct.pack("<BH", SCRIPT_REPEAT, count)
+        return self
+
+    def next(self):
+        """Close the innermost `repeat()` block."""
+        self._code.append(SCRIPT_NEXT)
+        return self
+
+    def call(self, label: str):
+        """Call the subroutine starting at `label`."""
+        self._calls.append((len(self._code) + 1, label))
+        self._code += struct.pack("<BH", SCRIPT_CALL, 0)
+        return self
+
+    def ret(self):
+        """Return from the subroutine."""
+        self._code.append(SCRIPT_RET)
+        return self
+
+    def speed(self, percent: int):
+        """Play all subsequent durations at `percent` speed."""
+        self._code += struct.pack("<BH", SCRIPT_SPEED, percent)
+        return self
+
+    def end(self):
+        """End the script."""
+        self._code.append(SCRIPT_END)
+        return self
+
+    def label(self, name: str):
+        """Mark the address of the next instruction as `name`."""
+        self._labels[name] = len(self._code)
+        return self
+
+    def assemble(self) -> bytes:
+        """Return the bytecode, with the labels of the CALLs resolved."""
+        code = bytearray(self._code)
+        for addr, label in self._calls:
+            struct.pack_into("<H", code, addr, self._labels[label])
+        return bytes(code)
+
+
+def upload_script(grid: JettingGrid_Arduino, script: ProtocolScript):
+    """Upload the protocol script to the Arduino, to be played by command
+    `script`. The bytecode is send in one go, guarded by a CRC32.
+    """
+    print("Uploading protocol script")
+    print("-------------------------")
+
+    code = script.assemble()
+
+    # Enter the upload state
+    grid.set_write_termination("\n")
+    if not grid.write("upload_script"):
+        # TODO: Show message box referring to error in terminal
+        return
+
+    # Stage 0: Send via ASCII the size of the script [bytes].
+    # --------------------------------------------------------------------------
+    success, ans = grid.query(f"{len(code)}")
+    if not success:
+        # TODO: Show message box referring to error in terminal
+        return
+
+    if ans[:5] == "ERROR":
+        # TODO: Show error message box
+        print(ans)
+        return
+
+    # Stage 1: Send via binary the script, followed by its CRC32.
+    # --------------------------------------------------------------------------
+    grid.ser.write(code + struct.pack("<I", zlib.crc32(code)))
+
+    success, ans = grid.readline()
+    if not success:
+        # TODO: Show message box referring to error in terminal
+        return
+
+    print(ans)
+
+
 # ------------------------------------------------------------------------------
 #   Main
 # ------------------------------------------------------------------------------
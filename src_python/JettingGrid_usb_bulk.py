@@ -0,0 +1,105 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""JettingGrid_usb_bulk.py
+
+Optional USB vendor interface of the Jetting Grid Arduino with a pair of bulk
+endpoints, next to its USB CDC serial port, see `UsbBulk.h` of the firmware.
+Carries the bulk uploads and the pushed telemetry once routed there, such that
+the ASCII commands keep the serial port to themselves.
+
+Requires the firmware being built with the `adafruit_feather_m4_usb_bulk`
+environment and the `pyusb` package together with a libusb backend. On Windows,
+the interface needs the WinUSB driver, e.g. installed via Zadig.
+"""
+__author__ = "Dennis van Gils"
+__authoremail__ = "vangils.dennis@gmail.com"
+__url__ = "https://github.com/Dennis-van-Gils/project-TWT-jetting-grid"
+__date__ = "15-10-2026"
+__version__ = "1.0"
+
+import usb.core
+import usb.util
+
+# USB vendor and product ID of the Adafruit Feather M4 Express
+USB_VID = 0x239A
+USB_PID = 0x8022
+
+# Interface class of a vendor-specific interface
+USB_CLASS_VENDOR = 0xFF
+
+
+class UsbBulkPort:
+    """Bulk endpoints of the vendor interface of the Arduino.
+
+    Args:
+        serial_number (str, optional): USB serial number of the Arduino to pick
+            when several are connected. Default: The first one found.
+
+        timeout (float, optional): Read and write time-out [s].
+    """
+
+    def __init__(self, serial_number: str = None, timeout: float = 1.0):
+        self.timeout = timeout
+        self._dev = None
+        self._ep_in = None
+        self._ep_out = None
+        self._intf = None
+
+        for dev in usb.core.find(
+            find_all=True, idVendor=USB_VID, idProduct=USB_PID
+        ):
+            if (serial_number is None) or (dev.serial_number == serial_number):
+                self._dev = dev
+                break
+        if self._dev is None:
+            raise IOError("Jetting Grid Arduino not found on USB")
+
+        cfg = self._dev.get_active_configuration()
+        self._intf = usb.util.find_descriptor(
+            cfg, bInterfaceClass=USB_CLASS_VENDOR
+        )
+        if self._intf is None:
+            raise IOError("Firmware lacks the USB vendor interface")
+
+        usb.util.claim_interface(self._dev, self._intf)
+        self._ep_in = usb.util.find_descriptor(
+            self._intf,
+            custom_match=lambda ep: usb.util.endpoint_direction(
+                ep.bEndpointAddress
+            )
+            == usb.util.ENDPOINT_IN,
+        )
+        self._ep_out = usb.util.find_descriptor(
+            self._intf,
+            custom_match=lambda ep: usb.util.endpoint_direction(
+                ep.bEndpointAddress
+            )
+            == usb.util.ENDPOINT_OUT,
+        )
+
+    def close(self):
+        """Release the vendor interface."""
+        if self._dev is not None:
+            usb.util.release_interface(self._dev, self._intf)
+            usb.util.dispose_resources(self._dev)
+            self._dev = None
+
+    def write(self, data: bytes) -> int:
+        """Write `data` to the bulk OUT endpoint.
+        Returns: The number of bytes written.
+        """
+        return self._ep_out.write(data, int(self.timeout * 1000))
+
+    def read(self, N_max: int = 4096, timeout: float = None) -> bytes:
+        """Read whatever the bulk IN endpoint holds, up to `N_max` bytes,
+        waiting at most `timeout` [s] for the first bytes to arrive.
+        Returns: The bytes read, empty when none arrived in time.
+        """
+        if timeout is None:
+            timeout = self.timeout
+        try:
+            return bytes(
+                self._ep_in.read(N_max, max(int(timeout * 1000), 1))
+            )
+        except usb.core.USBTimeoutError:
+            return b""
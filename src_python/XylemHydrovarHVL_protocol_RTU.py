@@ -60,7 +60,7 @@ class HVL_Mode(IntEnum):
 
 class HVL_FuncCode(IntEnum):
     # Implemented:
-    READ = 0x03  # Read the contents of a single register
+    READ = 0x03  # Read the contents of a block of contiguous registers
     WRITE = 0x06  # Write a value into a single register
 
     # Not implemented:
@@ -142,6 +142,63 @@ HVLREG_DEV_STATUS_H4 = HVL_Register(0x01c1, HVL_DType.B1)   # R     P-
 
 # fmt: on
 
+
+def N_points(hvlreg: HVL_Register) -> int:
+    """Return the number of 16-bit Modbus registers ('points') taken up by
+    the datum of `hvlreg`.
+    """
+    if hvlreg.datum_type in (HVL_DType.U32, HVL_DType.B2):
+        return 2
+    return 1
+
+
+# ------------------------------------------------------------------------------
+#   HVL_RegisterGroup
+# ------------------------------------------------------------------------------
+
+
+class HVL_RegisterGroup:
+    """Set of registers that get read out by a single 'read' RTU command,
+    spanning the address range from the first to the last register. Registers
+    inside of that range that are not part of the group get read along, but
+    are ignored.
+
+    Registers lying inside of a span, but missing from Table 5 of ref. (1),
+    might get refused by the HVL with an 'ILLEGAL DATA ADDRESS' exception. In
+    that case `XylemHydrovarHVL.read_register_group()` falls back to reading the
+    registers one by one and sets `batchable` to False for good.
+    """
+
+    # Maximum number of points of a single 'read' RTU command, set by the
+    # Modbus specification
+    MAX_POINTS = 125
+
+    def __init__(self, *hvlregs: HVL_Register):
+        self.hvlregs = hvlregs
+        self.address = min(reg.address for reg in hvlregs)
+        self.N_points = (
+            max(reg.address + N_points(reg) for reg in hvlregs) - self.address
+        )
+        self.batchable = True
+
+        if self.N_points > self.MAX_POINTS:
+            raise ValueError(
+                f"Register group spans {self.N_points} points, but Modbus "
+                f"allows at most {self.MAX_POINTS}."
+            )
+
+
+# Groups of registers that are close enough together to be read out by a
+# single 'read' RTU command each, instead of one command per register. The
+# status registers H3 and H4 lie too far apart to be grouped.
+# fmt: off
+HVLGRP_PROCESS  = HVL_RegisterGroup(HVLREG_ACTUAL_VALUE,   # 0x0032 - 0x0033
+                                    HVLREG_OUTPUT_FREQ)
+HVLGRP_INVERTER = HVL_RegisterGroup(HVLREG_TEMP_INVERTER,  # 0x0085 - 0x0088
+                                    HVLREG_CURR_INVERTER,
+                                    HVLREG_VOLT_INVERTER)
+# fmt: on
+
 # ------------------------------------------------------------------------------
 #   XylemHydrovarHVL
 # ------------------------------------------------------------------------------
@@ -482,6 +539,105 @@ class XylemHydrovarHVL(SerialDevice):
 
         return success, data_val
 
+    # --------------------------------------------------------------------------
+    #   _RTU_read_group
+    # --------------------------------------------------------------------------
+
+    def _RTU_read_group(
+        self, group: HVL_RegisterGroup
+    ) -> Tuple[bool, Union[list, None], bool]:
+        """Send a single 'read' RTU command over Modbus to the slave device,
+        spanning all registers of `group`.
+
+        Args:
+            group (HVL_RegisterGroup):
+                Registers to read from.
+
+        Returns: (Tuple)
+            success (bool):
+                True if successful, False otherwise.
+
+            data_vals (list[int] | None):
+                Read data values as raw integers, in the order of
+                `group.hvlregs`. `None` if unsuccessful.
+
+            refused (bool):
+                True if the slave device replied with a Modbus exception.
+        """
+        if not self.is_alive:
+            pft("Device is not connected yet or already closed.", 3)
+            return False, None, False  # --> leaving
+
+        # Construct 'read' command
+        byte_cmd = bytearray(8)
+        byte_cmd[0] = self.modbus_slave_address
+        byte_cmd[1] = HVL_FuncCode.READ
+        byte_cmd[2] = (group.address & 0xFF00) >> 8  # address HI
+        byte_cmd[3] = group.address & 0x00FF  # address LO
+        byte_cmd[4] = (group.N_points & 0xFF00) >> 8  # no. of points HI
+        byte_cmd[5] = group.N_points & 0x00FF  # no. of points LO
+        byte_cmd[6:] = crc16(byte_cmd[:6])
+
+        # Slow down message rate according to Modbus specification
+        silent_period = self._calculate_silent_period()
+        time_since_last_msg = time.perf_counter() - self._tick_last_msg
+        if time_since_last_msg < silent_period:
+            accurate_delay_ms((silent_period - time_since_last_msg) * 1000)
+
+        # Send command and read reply
+        N_expected_reply_bytes = 5 + 2 * group.N_points
+
+        success, reply = self.query_bytes(
+            msg=byte_cmd,
+            N_bytes_to_read=N_expected_reply_bytes,
+        )
+        self._tick_last_msg = time.perf_counter()
+
+        # Parse the returned data values
+        data_vals = None
+        if success and isinstance(reply, bytes):
+            if (
+                len(reply) == N_expected_reply_bytes
+                and reply[2] == 2 * group.N_points
+            ):
+                # All is correct
+                data_vals = []
+                for hvlreg in group.hvlregs:
+                    idx = 3 + 2 * (hvlreg.address - group.address)
+                    data_val = (reply[idx] << 8) + reply[idx + 1]
+                    if N_points(hvlreg) == 2:
+                        data_val = (
+                            (data_val << 16)
+                            + (reply[idx + 2] << 8)
+                            + reply[idx + 3]
+                        )
+
+                    if hvlreg.datum_type == HVL_DType.S08:
+                        if data_val >= (1 << 7):
+                            data_val = data_val - (1 << 8)
+                    elif hvlreg.datum_type == HVL_DType.S16:
+                        if data_val >= (1 << 15):
+                            data_val = data_val - (1 << 16)
+
+                    data_vals.append(data_val)
+            else:
+                pft(
+                    f"Unexpected reply to a read of {group.N_points} points."
+                )
+                print(f"Reply received: {pretty_hex(reply)}")
+                success = False
+
+        # A Modbus exception reply echoes the function code with its MSB set
+        refused = (
+            isinstance(reply, bytes)
+            and len(reply) >= 2
+            and reply[1] == (HVL_FuncCode.READ | 0x80)
+        )
+        if not success and isinstance(reply, bytes):
+            print(f"Reply received: {pretty_hex(reply)}")
+
+        return success, data_vals, refused
+
     # --------------------------------------------------------------------------
     #   _RTU_write
     # --------------------------------------------------------------------------
@@ -740,10 +896,7 @@ class XylemHydrovarHVL(SerialDevice):
         Readings will be stored in class member `state`.
         """
         success, data_val = self._RTU_read(HVLREG_ACTUAL_VALUE)
-        if data_val is not None:
-            val = float(data_val) / 100
-            self.state.actual_pressure = val
-            # print(f"Actual pressure : {val:4.2f} bar")
+        self._store_read_value(HVLREG_ACTUAL_VALUE, data_val)
 
         return success
 
@@ -816,10 +969,7 @@ class XylemHydrovarHVL(SerialDevice):
         Readings will be stored in class member `state`.
         """
         success, data_val = self._RTU_read(HVLREG_OUTPUT_FREQ)
-        if data_val is not None:
-            val = float(data_val) / 10
-            self.state.actual_frequency = val
-            # print(f"Actual frequency: {val:4.1f} Hz")
+        self._store_read_value(HVLREG_OUTPUT_FREQ, data_val)
 
         return success
 
@@ -935,29 +1085,86 @@ class XylemHydrovarHVL(SerialDevice):
         and voltage) of the inverter.
         Readings will be stored in class member `state`.
         """
-        success_1, data_val = self._RTU_read(HVLREG_TEMP_INVERTER)
-        if data_val is not None:
+        return self.read_register_group(HVLGRP_INVERTER)
+
+    def read_actual_process_values(self) -> bool:
+        """Read the actual pressure and the actual frequency of the inverter in
+        a single go. Readings will be stored in class member `state`.
+        """
+        return self.read_register_group(HVLGRP_PROCESS)
+
+    # --------------------------------------------------------------------------
+    #   read_register_group
+    # --------------------------------------------------------------------------
+
+    def read_register_group(self, group: HVL_RegisterGroup) -> bool:
+        """Read out all registers of `group` by a single 'read' RTU command and
+        store the readings in class member `state`.
+
+        When the HVL refuses the command, e.g. because the span of the group
+        holds an unlisted register, the registers of the group will be read out
+        one by one from then on.
+        """
+        if group.batchable:
+            success, data_vals, refused = self._RTU_read_group(group)
+            if data_vals is not None:
+                for hvlreg, data_val in zip(group.hvlregs, data_vals):
+                    self._store_read_value(hvlreg, data_val)
+                return success
+
+            if not refused:
+                return False
+
+            group.batchable = False
+            print(
+                f"HVL refused a read of {group.N_points} points at "
+                f"0x{group.address:04x}. Reading them one by one instead."
+            )
+
+        success = True
+        for hvlreg in group.hvlregs:
+            success_reg, data_val = self._RTU_read(hvlreg)
+            self._store_read_value(hvlreg, data_val)
+            success &= success_reg
+
+        return success
+
+    def _store_read_value(
+        self, hvlreg: HVL_Register, data_val: Union[int, None]
+    ):
+        """Convert the raw integer `data_val` read from `hvlreg` and store it
+        in class member `state`.
+        """
+        if data_val is None:
+            return
+
+        if hvlreg == HVLREG_ACTUAL_VALUE:
+            val = float(data_val) / 100
+            self.state.actual_pressure = val
+            # print(f"Actual pressure : {val:4.2f} bar")
+
+        elif hvlreg == HVLREG_OUTPUT_FREQ:
+            val = float(data_val) / 10
+            self.state.actual_frequency = val
+            # print(f"Actual frequency: {val:4.1f} Hz")
+
+        elif hvlreg == HVLREG_TEMP_INVERTER:
             val = float(data_val)
             self.state.inverter_temp = val
             # print(f"Read inverter temperature: {val:5.0f} 'C")
 
-        success_2, data_val = self._RTU_read(HVLREG_VOLT_INVERTER)
-        if data_val is not None:
+        elif hvlreg == HVLREG_VOLT_INVERTER:
             val = float(data_val)
             self.state.inverter_volt = val
             # print(f"Read inverter voltage    : {val:5.0f} V")
 
-        success_3, data_val = self._RTU_read(HVLREG_CURR_INVERTER)
-        if data_val is not None:
+        elif hvlreg == HVLREG_CURR_INVERTER:
             val = float(data_val) / 100
             self.state.inverter_curr_A = val
             self.state.inverter_curr_pct = (
                 val / self.state.nom_motor_current * 100
             )
             # print(f"Read inverter current    : {val:5.2f} A")
-            # print(f"Read inverter current    : {self.state.inverter_curr_pct:5.1f} %")
-
-        return success_1 and success_2 and success_3
 
     def use_digital_required_value_1(self) -> bool:
         """P805, P810, P815: Set up the registers to make use of a digitally
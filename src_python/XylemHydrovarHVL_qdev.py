@@ -117,6 +117,9 @@ class XylemHydrovarHVL_qdev(QDeviceIO):
         qgrp_error_status (PyQt5.QtWidgets.QGroupBox)
     """
 
+    # Number of DAQ time steps between reads of the slowly changing values
+    DAQ_SLOW_EVERY = 5
+
     signal_GUI_input_field_update = Signal(int)
     signal_pump_just_stopped_and_reached_standstill = Signal()
 
@@ -165,25 +168,36 @@ class XylemHydrovarHVL_qdev(QDeviceIO):
     # --------------------------------------------------------------------------
 
     def _DAQ_function(self):
-        """Every DAQ time step, read the following:
-        - error status
+        """Poll the HVL following a prioritised schedule, to keep the number of
+        Modbus messages per DAQ time step low.
+
+        Every DAQ time step, read the following:
         - device status
-        - actual pressure
-        - actual inverter frequency
+        - actual pressure and actual inverter frequency, as a single message
 
-        Every N'th DAQ time step, read the following:
-        - inverter diagnostics
+        Every `DAQ_SLOW_EVERY`'th DAQ time step, read the following, each at
+        a different time step to spread the load:
+        - error status, or every DAQ time step while the device status
+          reports an error or a warning
+        - inverter diagnostics, as a single message
         """
         DEBUG_local = False
         if DEBUG_local:
             tick = time.perf_counter()
 
-        success = self.dev.read_error_status()
-        success &= self.dev.read_device_status()
-        success &= self.dev.read_actual_pressure()
-        success &= self.dev.read_actual_frequency()
+        success = self.dev.read_device_status()
+        success &= self.dev.read_actual_process_values()
+
+        slot = self.update_counter_DAQ % self.DAQ_SLOW_EVERY
+        status = self.dev.device_status
+        if (
+            slot == 0
+            or status.device_has_an_error
+            or status.device_has_a_warning
+        ):
+            success &= self.dev.read_error_status()
 
-        if (self.update_counter_DAQ % 5) == 0:
+        if slot == self.DAQ_SLOW_EVERY // 2:
             success &= self.dev.read_inverter_diagnostics()
 
         if self.pump_is_stopping:
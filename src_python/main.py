@@ -77,10 +77,11 @@ elif QT_LIB == PYSIDE6:
 # \end[Mechanism to support both PyQt and PySide]
 # -----------------------------------------------
 
+import numpy as np
 import qtawesome as qta
 from dvg_pyqt_filelogger import FileLogger
 
-from JettingGrid_Arduino import JettingGrid_Arduino
+from JettingGrid_Arduino import JettingGrid_Arduino, PRESSURE_FAULT
 from JettingGrid_qdev import JettingGrid_qdev
 from JettingGrid_gui import MainWindow
 
@@ -153,6 +154,12 @@ def DAQ_function() -> bool:
     state = grid.state  # Shorthand
     state.time = time.perf_counter()
 
+    # Record all telemetry packets received, to be logged in full
+    if grid.telemetry_period_ms:
+        grid_qdev.telemetry.extend(
+            grid.telemetry_samples, grid.telemetry_gaps, state.time
+        )
+
     # Add readings to chart histories
     window.curve_P_pump.appendData(state.time, pump.state.actual_pressure)
     window.curve_P_1.appendData(state.time, state.P_1_bar)
@@ -172,7 +179,14 @@ def DAQ_function() -> bool:
 # ------------------------------------------------------------------------------
 
 
+# Packet count of `grid_qdev.telemetry` up to which has been logged
+telemetry_log_idx = 0
+
+
 def write_header_to_log():
+    global telemetry_log_idx
+    telemetry_log_idx = grid_qdev.telemetry.N_written
+
     str_cur_date, str_cur_time = current_date_time_strings()
     logger.write("[HEADER]\n")
     logger.write(f"Date: {str_cur_date}\n")
@@ -186,6 +200,10 @@ def write_header_to_log():
 
 
 def write_data_to_log():
+    if grid.telemetry_period_ms:
+        write_telemetry_to_log()
+        return
+
     logger.write(
         f"{logger.elapsed():.2f}\t"
         f"{grid.state.protocol_pos:.0f}\t"
@@ -195,6 +213,29 @@ def write_data_to_log():
     )
 
 
+def write_telemetry_to_log():
+    """Log every telemetry packet recorded since the last call, instead of
+    only the most recent readings."""
+    global telemetry_log_idx
+    packets, telemetry_log_idx = grid_qdev.telemetry.read(telemetry_log_idx)
+    if not len(packets):
+        return
+
+    # Map the host times onto the elapsed time of the logger
+    t = packets["t"] + (logger.elapsed() - grid.state.time)
+    P_bar = packets["pres_mbar"] / 1000
+    P_bar[packets["pres_mbar"] == PRESSURE_FAULT] = np.nan
+    P_pump = pump.state.actual_pressure
+
+    logger.write(
+        "".join(
+            f"{t_:.4f}\t{pos:d}\t{P_pump:.3f}\t"
+            f"{P[0]:.3f}\t{P[1]:.3f}\t{P[2]:.3f}\t{P[3]:.3f}\n"
+            for t_, pos, P in zip(t, packets["pos"].tolist(), P_bar)
+        )
+    )
+
+
 # ------------------------------------------------------------------------------
 #   Main
 # ------------------------------------------------------------------------------
@@ -214,6 +255,11 @@ if __name__ == "__main__":
 
     grid.get_protocol_info()
 
+    # Demultiplex the replies and the pushed telemetry in the background, such
+    # that the DAQ never blocks on a query of the jobs worker
+    if grid.is_alive:
+        grid.start_reader()
+
     # --------------------------------------------------------------------------
     #   Connect to Xylem Hydrovar HVL pump
     # --------------------------------------------------------------------------